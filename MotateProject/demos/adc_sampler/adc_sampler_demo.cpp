@@ -0,0 +1,208 @@
+/*
+ * adc_sampler_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/ADCSamplerDemo.elf
+ *
+ * Samples four ADC channels at a fixed sweep rate with ADCSampler, in simulated
+ * time, and checks that the rate is exact, that the per-channel averages match
+ * the (simulated) inputs, including one that changes every sweep, that there's
+ * one interrupt per block rather than per conversion, and that a late interrupt
+ * is counted as an overrun and sampling carries on.
+ */
+
+#include "MotatePins.h"
+#include "MotateADCSampler.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::ADC_Module;
+using Motate::HostADC;
+using Motate::HostAdc;
+using Motate::HostSim;
+using Motate::HostSimEvent;
+
+/****** Create file-global objects ******/
+
+// Four channels, so each block of 64 conversions is 16 sweeps
+static constexpr uint32_t kChannels = 0xF;
+static constexpr uint32_t kSweepsPerSecond = 10000;
+using Sampler = Motate::ADCSampler<0, 0, 64>;
+Sampler sampler;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static uint32_t callbacks = 0;
+static bool tags_in_order = true;
+static Sampler::block_t last_block;
+
+static void onBlock(const Sampler::block_t &block) {
+    callbacks++;
+    for (uint16_t i = 0; i < block.sampleCount; i++) {
+        if (Sampler::hardware_t::sampleChannel(block.samples[i]) != (i % 4)) {
+            tags_in_order = false;
+        }
+    }
+    last_block = block;
+}
+
+static void runFor(const uint64_t microseconds) {
+    HostSim::advance(HostSim::cyclesFromMicroseconds(microseconds));
+}
+
+static void check_rate() {
+    ADC_Module::simulateInput(0, 100);
+    ADC_Module::simulateInput(1, 2000);
+    ADC_Module::simulateInput(2, 4095);
+    ADC_Module::simulateInput(3, 0);
+
+    callbacks = 0;
+    const int32_t rate = sampler.start(kChannels, kSweepsPerSecond, onBlock);
+    check(rate == kSweepsPerSecond, "the timer runs at exactly the sweep rate");
+
+    // The first sweep is half a period in, so one second holds exactly 10000 sweeps
+    runFor(1000000);
+    const uint32_t expected = (kSweepsPerSecond * 4) / 64;
+    printf("1s at %" PRIu32 " sweeps/s of 4 channels: %" PRIu32 " blocks, %" PRIu32 " callbacks (expected %" PRIu32 ")\n",
+           kSweepsPerSecond, sampler.blocks(), callbacks, expected);
+    check(sampler.blocks() == expected, "one block per 16 sweeps");
+    check(callbacks == sampler.blocks(), "one callback per block");
+    check(sampler.overruns() == 0, "no overruns");
+    check(tags_in_order, "every conversion is tagged with its channel, in sweep order");
+
+    // Only the end-of-block interrupt is on -- nothing per conversion
+    check((HostADC.IMR & ~HostAdc::ENDRX) == 0, "only ENDRX is enabled");
+
+    check(last_block.channels == kChannels, "the block has all four channels");
+    check(last_block.count[0] == 16 && last_block.count[3] == 16, "16 conversions of each channel per block");
+    check(sampler.getAverage(0) == 100, "channel 0 averages 100");
+    check(sampler.getAverage(1) == 2000, "channel 1 averages 2000");
+    check(sampler.getAverage(2) == 4095, "channel 2 averages 4095");
+    check(sampler.getAverage(3) == 0, "channel 3 averages 0");
+    check(sampler.getAverage(4) == 0 && last_block.count[4] == 0, "channel 4 isn't sampled");
+}
+
+static void check_varying() {
+    // Change channel 1 between sweeps (they're at 50us, 150us, ...), alternating 1000 and 1003
+    static uint32_t toggles = 0;
+    static HostSimEvent toggle {[]() {
+        ADC_Module::simulateInput(1, (toggles++ & 1) ? 1003 : 1000);
+        HostSim::scheduleIn(&toggle, HostSim::cyclesFromMicroseconds(100));
+    }};
+    HostSim::scheduleIn(&toggle, HostSim::cyclesFromMicroseconds(20));
+
+    runFor(10000);
+    HostSim::cancel(&toggle);
+
+    // 8 of each in a block is 1001.5, rounded
+    printf("channel 1 alternating 1000/1003 every sweep averages %" PRId32 "\n", sampler.getAverage(1));
+    check(sampler.getAverage(1) == 1002, "alternating channel averages to the middle");
+    check(sampler.getAverage(0) == 100, "the other channels are unchanged");
+}
+
+static void check_overrun() {
+    // Hold off interrupts for three blocks, so both blocks of the ring fill and the PDC stops
+    const uint32_t before = sampler.blocks();
+    __disable_irq();
+    runFor(3 * 1600);
+    __enable_irq();
+    check(sampler.overruns() == 1, "a late interrupt is one overrun");
+    check(sampler.blocks() == before + 1, "the late interrupt handled one block");
+
+    runFor(16000);
+    printf("after an overrun: %" PRIu32 " overruns, %" PRIu32 " more blocks in 16ms\n",
+           sampler.overruns(), sampler.blocks() - before - 1);
+    check(sampler.blocks() - before - 1 >= 9, "sampling carries on after an overrun");
+    check(sampler.getAverage(2) == 4095, "and the averages are still right");
+}
+
+static void check_stop() {
+    sampler.stop();
+    const uint32_t before = sampler.blocks();
+    runFor(100000);
+    check(sampler.blocks() == before, "no blocks after stop()");
+
+    // Start again at a different rate and width: two channels at 1000 sweeps/s is 31.25 blocks/s
+    callbacks = 0;
+    sampler.start(0x3, 1000, nullptr);
+    runFor(4000000);
+    printf("4s at 1000 sweeps/s of 2 channels: %" PRIu32 " blocks (expected 125)\n", sampler.blocks());
+    check(sampler.blocks() == 125, "restarted sampler keeps exact time");
+    check(callbacks == 0, "an empty callback isn't called");
+    check(sampler.getAverage(1) == 1000 || sampler.getAverage(1) == 1003, "channel 1 is sampled");
+    check(sampler.getAverage(2) == 0, "channel 2 is not");
+    sampler.stop();
+}
+
+static void benchmark() {
+    // Host time to average and re-arm one block, as the interrupt does
+    static constexpr uint32_t kIterations = 200000;
+    sampler.start(kChannels, kSweepsPerSecond, nullptr);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kIterations; i++) {
+        sampler._blockDone();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    sampler.stop();
+    check(sampler.overruns() == 0, "the benchmark only re-armed blocks");
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count() / kIterations;
+    printf("\nhost ns per 64-conversion block: %.1f (%.2f per conversion)\n", ns, ns / 64);
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    check_rate();
+    check_varying();
+    check_overrun();
+    check_stop();
+    benchmark();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
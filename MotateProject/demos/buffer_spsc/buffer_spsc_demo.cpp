@@ -0,0 +1,159 @@
+/*
+ * buffer_spsc_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/BufferSPSCDemo.elf
+ *
+ * Host-only: this needs real threads, so it won't build for a board.
+ *
+ * Stress test: a producer thread and a consumer thread hammer an SPSCBuffer with
+ * a counting sequence, mixing single-value and bulk calls, and the consumer
+ * checks that every value arrives once and in order.
+ *
+ * Benchmark: the same transfer, timed, for SPSCBuffer and for the plain Buffer
+ * (volatile offsets). The plain Buffer is NOT safe for this -- it's only here
+ * for comparison, and errors it shows are reported but not counted as failures.
+ */
+
+#if !defined(__HOST_SIM__)
+#error The buffer_spsc demo requires BOARD=host
+#endif
+
+#include "MotateBuffer.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kStressValues = 20000000;
+static constexpr uint32_t kBenchmarkValues = 200000000;
+
+Motate::SPSCBuffer<256> stress_buffer;
+Motate::SPSCBuffer<1024> spsc_buffer;
+Motate::Buffer<1024> volatile_buffer;
+
+// The counting sequence. Like Buffer, read() returns -1 when empty, so keep the values
+// out of the negative range of char.
+inline char sequence(const uint32_t n) { return n & 0x7F; }
+
+// Send count values of the counting sequence through buffer, from one thread to another.
+// Returns the number of values that arrived out of sequence.
+template <typename buffer_t>
+uint32_t transfer(buffer_t &buffer, const uint32_t count, const bool mixed) {
+    std::thread producer([&buffer, count, mixed]() {
+        char chunk[61];
+        uint32_t sent = 0;
+        while (sent < count) {
+            // Alternate single-value and bulk writes of assorted sizes
+            if (mixed && (sent & 0x100)) {
+                if (buffer.write(sequence(sent)) > 0) {
+                    sent++;
+                } else {
+                    std::this_thread::yield(); // full
+                }
+                continue;
+            }
+            uint32_t length = mixed ? ((sent % 61) + 1) : sizeof(chunk);
+            if (length > count - sent) {
+                length = count - sent;
+            }
+            for (uint32_t i = 0; i < length; i++) {
+                chunk[i] = sequence(sent + i);
+            }
+            uint32_t written = buffer.write(chunk, length);
+            if (written == 0) {
+                std::this_thread::yield(); // full
+            }
+            sent += written;
+        }
+    });
+
+    uint32_t errors = 0;
+    char chunk[53];
+    uint32_t received = 0;
+    while (received < count) {
+        if (mixed && (received & 0x80)) {
+            int16_t value = buffer.read();
+            if (value >= 0) {
+                if ((char)value != sequence(received)) {
+                    errors++;
+                }
+                received++;
+            } else {
+                std::this_thread::yield(); // empty
+            }
+            continue;
+        }
+        int16_t length = buffer.read(chunk, std::min(sizeof(chunk), (size_t)(count - received)));
+        if (length == 0) {
+            std::this_thread::yield(); // empty
+        }
+        for (int16_t i = 0; i < length; i++) {
+            if (chunk[i] != sequence(received + i)) {
+                errors++;
+            }
+        }
+        received += length;
+    }
+
+    producer.join();
+    return errors;
+}
+
+template <typename buffer_t>
+uint32_t benchmark(const char *name, buffer_t &buffer) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t errors = transfer(buffer, kBenchmarkValues, /*mixed=*/false);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%-10s %8.1f MB/s (%" PRIu32 " out-of-sequence)\n", name,
+           (kBenchmarkValues / elapsed.count()) / 1e6, errors);
+    return errors;
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    uint32_t errors = transfer(stress_buffer, kStressValues, /*mixed=*/true);
+    printf("stress: %" PRIu32 " values, %" PRIu32 " out-of-sequence\n", kStressValues, errors);
+
+    benchmark("SPSCBuffer", spsc_buffer);
+    benchmark("Buffer", volatile_buffer);
+
+    exit(errors ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
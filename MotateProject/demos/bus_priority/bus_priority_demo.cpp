@@ -0,0 +1,448 @@
+/*
+ * bus_priority_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/BusPriorityDemo.elf
+ *
+ * Three "bulk" devices (think displays and EEPROMs) keep their queues full with
+ * 64-byte messages, re-queueing each one from its callback, while a fourth device
+ * is polled with a short message at (pseudo-)random times. For each bus, SPI and
+ * TWI, we report the latency from queueing the poll to its callback, in simulated
+ * time, with everything at kNormal and with the poll at kUrgent (and the stream
+ * at kBulk). The strictly-FIFO bound is what the buses did before they had
+ * priorities: the poll waited behind every message already queued.
+ *
+ * It also checks that deadlines order messages within a class, that a device
+ * can't queue past its max_queue_depth, and that an urgent message doesn't cut
+ * into a transaction that's already started.
+ */
+
+#include "MotatePins.h"
+#include "MotateSPI.h"
+#include "MotateTWI.h"
+#include "MotateTimers.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::BusPriority;
+using Motate::Deadline;
+using Motate::HostSim;
+using Motate::HostSPI0;
+using Motate::HostTWI0;
+using Motate::HostTwiSlave;
+using Motate::SPIMessage;
+using Motate::TWIMessage;
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kSPIBaud = 4000000;
+static constexpr uint16_t kSPIOptions = Motate::kSPIMode0 | Motate::kSPI8Bit;
+
+Motate::SPIBus<Motate::kSPI_MISOPinNumber, Motate::kSPI_MOSIPinNumber, Motate::kSPI_SCKPinNumber> spiBus;
+auto spiBulk0 = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS0PinNumber>{}, kSPIBaud, kSPIOptions, 0, 0, 0);
+auto spiBulk1 = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS1PinNumber>{}, kSPIBaud, kSPIOptions, 0, 0, 0);
+auto spiBulk2 = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS2PinNumber>{}, kSPIBaud, kSPIOptions, 0, 0, 0);
+auto spiPoller = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS3PinNumber>{}, kSPIBaud, kSPIOptions, 0, 0, 0);
+
+Motate::TWIBus<Motate::kI2C_SCLPinNumber, Motate::kI2C_SDAPinNumber> twiBus;
+auto twiBulk0 = twiBus.getDevice({0x50});
+auto twiBulk1 = twiBus.getDevice({0x51});
+auto twiBulk2 = twiBus.getDevice({0x52});
+auto twiPoller = twiBus.getDevice({0x20});
+
+static constexpr uint8_t kBulkDevices = 3;
+static constexpr uint8_t kBulkDepth = 4;   // each bulk device's max_queue_depth
+static constexpr uint16_t kBulkSize = 64;
+static constexpr uint16_t kPollSize = 2;
+static constexpr uint32_t kPolls = 2000;
+static constexpr uint8_t kPollTag = 0xF0;  // in the order log
+
+static Motate::SPIBusDeviceBase *const spi_bulk_devices[kBulkDevices] = {&spiBulk0, &spiBulk1, &spiBulk2};
+static Motate::TWIBusDeviceBase *const twi_bulk_devices[kBulkDevices] = {&twiBulk0, &twiBulk1, &twiBulk2};
+
+// One more message per device than it may have queued, to check the limit
+static SPIMessage spi_bulk[kBulkDevices][kBulkDepth + 1];
+static SPIMessage spi_poll;
+static TWIMessage twi_bulk[kBulkDevices][kBulkDepth + 1];
+static TWIMessage twi_poll;
+
+static uint8_t tx_buffer[kBulkSize];
+static uint8_t rx_buffer[kBulkSize];
+
+static bool streaming = false;               // bulk callbacks re-queue their message
+static BusPriority bulk_priority = BusPriority::kNormal;
+static volatile uint32_t bulk_outstanding = 0;
+
+static volatile bool poll_done = false;
+static uint64_t poll_queued_at = 0;
+static uint64_t poll_latency = 0;
+
+static uint8_t order[16];                    // tags of the callbacks, in the order they came
+static volatile uint8_t order_count = 0;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void logOrder(const uint8_t tag) {
+    if (order_count < sizeof(order)) {
+        order[order_count] = tag;
+    }
+    order_count = order_count + 1;
+}
+
+// Every address on the simulated TWI bus answers, and we log who was talked to
+static uint8_t twi_starts[16];
+static uint8_t twi_start_count = 0;
+
+struct LoggingSlave : HostTwiSlave {
+    LoggingSlave(const uint8_t _address) : HostTwiSlave{_address} {};
+
+    bool start(const bool is_read) override {
+        if (twi_start_count < sizeof(twi_starts)) {
+            twi_starts[twi_start_count++] = address;
+        }
+        return true;
+    };
+};
+
+static LoggingSlave twi_slaves[] = {{0x50}, {0x51}, {0x52}, {0x20}};
+
+/****** The buses under test ******/
+
+struct BusUnderTest {
+    const char *name;
+    bool (*queueBulk)(uint8_t device, uint8_t i, const Deadline &deadline);
+    void (*queuePoll)(BusPriority priority);
+    uint8_t (*bulkQueueDepth)(uint8_t device);
+};
+
+static bool spiQueueBulk(const uint8_t device, const uint8_t i, const Deadline &deadline) {
+    SPIMessage &msg = spi_bulk[device][i];
+    msg.setup(tx_buffer, rx_buffer, kBulkSize, SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+    msg.priority = bulk_priority;
+    msg.deadline = deadline;
+    if (!spi_bulk_devices[device]->queueMessage(&msg)) {
+        return false;
+    }
+    bulk_outstanding = bulk_outstanding + 1;
+    return true;
+}
+
+static void spiQueuePoll(const BusPriority priority) {
+    spi_poll.setup(tx_buffer, rx_buffer, kPollSize, SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+    spi_poll.priority = priority;
+    spiPoller.queueMessage(&spi_poll);
+}
+
+static bool twiQueueBulk(const uint8_t device, const uint8_t i, const Deadline &deadline) {
+    TWIMessage &msg = twi_bulk[device][i];
+    msg.setup(tx_buffer, kBulkSize, TWIMessage::Direction::kTX);
+    msg.priority = bulk_priority;
+    msg.deadline = deadline;
+    if (!twi_bulk_devices[device]->queueMessage(&msg)) {
+        return false;
+    }
+    bulk_outstanding = bulk_outstanding + 1;
+    return true;
+}
+
+static void twiQueuePoll(const BusPriority priority) {
+    twi_poll.setup(rx_buffer, kPollSize, TWIMessage::Direction::kRX);
+    twi_poll.priority = priority;
+    twiPoller.queueMessage(&twi_poll);
+}
+
+static const BusUnderTest spi_under_test = {
+    "SPI (4 MHz)", spiQueueBulk, spiQueuePoll,
+    [](uint8_t device) -> uint8_t { return spi_bulk_devices[device]->queueDepth(); }
+};
+static const BusUnderTest twi_under_test = {
+    "TWI (400 kHz)", twiQueueBulk, twiQueuePoll,
+    [](uint8_t device) -> uint8_t { return twi_bulk_devices[device]->queueDepth(); }
+};
+static const BusUnderTest *bus = nullptr;
+
+static void bulkDone(const uint8_t device, const uint8_t i) {
+    bulk_outstanding = bulk_outstanding - 1;
+    logOrder(device);
+    if (streaming) {
+        bus->queueBulk(device, i, Deadline{});
+    }
+}
+
+static void pollDone() {
+    poll_latency = HostSim::now() - poll_queued_at;
+    poll_done = true;
+    logOrder(kPollTag);
+}
+
+static void waitForBulk() {
+    while (bulk_outstanding > 0) {
+        HostSim::idle();
+    }
+}
+
+static void poll(const BusPriority priority) {
+    poll_done = false;
+    poll_queued_at = HostSim::now();
+    bus->queuePoll(priority);
+    while (!poll_done) {
+        HostSim::idle();
+    }
+}
+
+/****** The tests ******/
+
+// How long one message takes on an idle bus, from queueing to callback
+static uint64_t bulkAlone() {
+    const uint64_t start = HostSim::now();
+    bus->queueBulk(0, 0, Deadline{});
+    waitForBulk();
+    return HostSim::now() - start;
+}
+
+static uint64_t pollAlone() {
+    poll(BusPriority::kNormal);
+    return poll_latency;
+}
+
+struct Latency {
+    uint64_t worst = 0;
+    uint64_t total = 0;
+};
+
+// Poll at random points in a saturating bulk stream
+static Latency pollLatency(const BusPriority poll_priority, const BusPriority stream_priority, const uint64_t spacing) {
+    bulk_priority = stream_priority;
+    streaming = true;
+    for (uint8_t device = 0; device < kBulkDevices; device++) {
+        for (uint8_t i = 0; i < kBulkDepth; i++) {
+            bus->queueBulk(device, i, Deadline{});
+        }
+    }
+
+    Latency latency;
+    bool saturated = true;
+    uint32_t seed = 12345;
+    for (uint32_t p = 0; p < kPolls; p++) {
+        seed = seed * 1664525 + 1013904223;
+        HostSim::advance(seed % spacing);
+
+        for (uint8_t device = 0; device < kBulkDevices; device++) {
+            saturated &= (bus->bulkQueueDepth(device) == kBulkDepth);
+        }
+        poll(poll_priority);
+
+        latency.worst = (poll_latency > latency.worst) ? poll_latency : latency.worst;
+        latency.total += poll_latency;
+    }
+    check(saturated, "the bulk stream keeps every device's queue full");
+
+    streaming = false;
+    waitForBulk();
+    bulk_priority = BusPriority::kNormal;
+    return latency;
+}
+
+static void latencyTest() {
+    const uint64_t bulk_cycles = bulkAlone();
+    const uint64_t poll_cycles = pollAlone();
+
+    const Latency fair = pollLatency(BusPriority::kNormal, BusPriority::kNormal, 2 * bulk_cycles);
+    const Latency prioritized = pollLatency(BusPriority::kUrgent, BusPriority::kBulk, 2 * bulk_cycles);
+    const uint64_t fifo_bound = (kBulkDevices * kBulkDepth * bulk_cycles) + poll_cycles;
+
+    // An urgent poll only waits for the message that's on the wire
+    check(prioritized.worst <= bulk_cycles + poll_cycles, "an urgent poll waits for at most one bulk message");
+    // Devices in the same class take turns
+    check(fair.worst <= (kBulkDevices * bulk_cycles) + poll_cycles, "a normal poll waits for at most one message per device");
+    check(prioritized.worst < fair.worst, "priority lowers the worst-case latency");
+
+    const double us_per_cycle = 1000000.0 / SystemCoreClock;
+    printf("%s: %u-byte bulk message %.1f us, %u-byte poll %.1f us\n", bus->name, kBulkSize,
+           bulk_cycles * us_per_cycle, kPollSize, poll_cycles * us_per_cycle);
+    printf("  poll latency, us        worst     mean\n");
+    printf("  strictly FIFO (bound) %7.1f\n", fifo_bound * us_per_cycle);
+    printf("  all kNormal           %7.1f  %7.1f\n", fair.worst * us_per_cycle,
+           (double)fair.total / kPolls * us_per_cycle);
+    printf("  kUrgent over kBulk    %7.1f  %7.1f\n\n", prioritized.worst * us_per_cycle,
+           (double)prioritized.total / kPolls * us_per_cycle);
+}
+
+// Within a class, the earliest deadline goes first, then those without one in the order they were queued
+static void deadlineTest() {
+    order_count = 0;
+    bus->queueBulk(0, 0, Deadline{});  // goes right away, so the rest have to wait
+    bus->queueBulk(1, 0, Deadline::in_us(5000));
+    bus->queueBulk(2, 0, Deadline{});
+    bus->queueBulk(0, 1, Deadline{});  // device 0 goes to the back once its first is done
+    poll_done = false;
+    poll_queued_at = HostSim::now();
+    bus->queuePoll(BusPriority::kNormal);
+    bus->queueBulk(2, 1, Deadline::in_us(1000)); // waits for device 2's first, then goes on its deadline
+    waitForBulk();
+    while (!poll_done) {
+        HostSim::idle();
+    }
+
+    const uint8_t expected[] = {0, 1, 2, 2, kPollTag, 0};
+    bool ok = (order_count == sizeof(expected));
+    for (uint8_t i = 0; ok && (i < sizeof(expected)); i++) {
+        ok = (order[i] == expected[i]);
+    }
+    check(ok, "deadlines order devices within a class, and each device's messages stay in order");
+}
+
+static void depthLimitTest() {
+    bool queued = true;
+    for (uint8_t i = 0; i < kBulkDepth; i++) {
+        queued &= bus->queueBulk(1, i, Deadline{});
+    }
+    check(queued, "a device can queue up to its max_queue_depth");
+    check(!bus->queueBulk(1, kBulkDepth, Deadline{}), "a device can't queue past its max_queue_depth");
+
+    while (bulk_outstanding == kBulkDepth) {
+        HostSim::idle();
+    }
+    check(bus->queueBulk(1, kBulkDepth, Deadline{}), "a device can queue again once one is done");
+    waitForBulk();
+}
+
+// SPI: messages 1 and 2 of a transaction are queued after an urgent poll, while message 0 is on the wire
+static void spiTransactionTest() {
+    order_count = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        const bool last = (i == 2);
+        spi_bulk[0][i].setup(tx_buffer, rx_buffer, kBulkSize,
+                             last ? SPIMessage::DeassertAfter : SPIMessage::RemainAsserted,
+                             last ? SPIMessage::EndTransaction : SPIMessage::KeepTransaction);
+        spi_bulk[0][i].priority = BusPriority::kBulk;
+    }
+    bulk_outstanding = 3;
+    spiBulk0.queueMessage(&spi_bulk[0][0]);
+    poll_done = false;
+    spiQueuePoll(BusPriority::kUrgent);
+    spiBulk0.queueMessage(&spi_bulk[0][1]);
+    spiBulk0.queueMessage(&spi_bulk[0][2]);
+    waitForBulk();
+    while (!poll_done) {
+        HostSim::idle();
+    }
+
+    const uint8_t expected[] = {0, 0, 0, kPollTag};
+    check((order_count == 4) && (memcmp(order, expected, 4) == 0), "an urgent SPI message waits for the transaction");
+}
+
+// TWI: a register read (a write without a STOP, chained to the read) and an urgent poll queued behind it
+static void twiTransactionTest() {
+    order_count = 0;
+    twi_start_count = 0;
+    twi_bulk[0][1].setup(rx_buffer, kPollSize, TWIMessage::Direction::kRX);
+    twi_bulk[0][0].setup(tx_buffer, 1, TWIMessage::Direction::kTX, {}, TWIMessage::Instruction::kWithoutStop,
+                         &twi_bulk[0][1]);
+    twi_bulk[0][0].priority = BusPriority::kBulk;
+    twi_bulk[0][1].priority = BusPriority::kBulk;
+    bulk_outstanding = 2;
+    twiBulk0.queueMessage(&twi_bulk[0][0]);
+    poll_done = false;
+    twiQueuePoll(BusPriority::kUrgent);
+    waitForBulk();
+    while (!poll_done) {
+        HostSim::idle();
+    }
+
+    const uint8_t expected[] = {0, 0, kPollTag};
+    const uint8_t expected_starts[] = {0x50, 0x50, 0x20};
+    check((order_count == 3) && (memcmp(order, expected, 3) == 0), "an urgent TWI message waits for the transaction");
+    check((twi_start_count == 3) && (memcmp(twi_starts, expected_starts, 3) == 0), "the TWI slaves are addressed in that order");
+
+    // A chain whose second message is still queued from before is turned away, head and all
+    bulk_outstanding = 1;
+    twiBulk0.queueMessage(&twi_bulk[0][1]);
+    check(!twiBulk0.queueMessage(&twi_bulk[0][0]), "a TWI chain with a message still queued is rejected");
+    check(!twi_bulk[0][0]._bus_queued.load(), "the head of a rejected chain isn't queued");
+    waitForBulk();
+
+    twi_bulk[0][0].next_message = nullptr;
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    spiBus.init();
+    twiBus.init();
+
+    HostSPI0.slave = [](uint8_t cs, uint16_t mosi) -> uint16_t { return (uint8_t)~mosi; };
+    for (LoggingSlave &slave : twi_slaves) {
+        HostTWI0.attach(&slave);
+    }
+
+    for (uint8_t device = 0; device < kBulkDevices; device++) {
+        spi_bulk_devices[device]->setMaxQueueDepth(kBulkDepth);
+        twi_bulk_devices[device]->setMaxQueueDepth(kBulkDepth);
+        for (uint8_t i = 0; i <= kBulkDepth; i++) {
+            spi_bulk[device][i].message_done_callback = [device, i]() { bulkDone(device, i); };
+            twi_bulk[device][i].message_done_callback = [device, i](bool ok) {
+                check(ok, "every TWI message is ACKed");
+                bulkDone(device, i);
+            };
+        }
+    }
+    spi_poll.message_done_callback = []() { pollDone(); };
+    twi_poll.message_done_callback = [](bool ok) { pollDone(); };
+
+    for (const BusUnderTest *under_test : {&spi_under_test, &twi_under_test}) {
+        bus = under_test;
+        latencyTest();
+        deadlineTest();
+        depthLimitTest();
+    }
+    spiTransactionTest();
+    twiTransactionTest();
+
+    printf("%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
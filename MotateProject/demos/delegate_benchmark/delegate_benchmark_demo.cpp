@@ -0,0 +1,166 @@
+/*
+ * delegate_benchmark_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/DelegateBenchmarkDemo.elf
+ *
+ * Host-only: it counts heap allocations by replacing operator new.
+ *
+ * Call cost: the same interrupt-handler-style callback (a lambda capturing this)
+ * is called through std::function and through Delegate, and timed.
+ *
+ * Allocations: assigning a callback with a few captures makes std::function go to
+ * the heap, but never Delegate. Then, after setup, a UART sends a few thousand
+ * characters -- every transfer-done callback and interrupt handler in that path
+ * is a Delegate -- and no allocations are allowed.
+ *
+ * Empty: a Delegate made from a weak function that nobody defined (like a pin's
+ * interrupt()) has to be empty, whether it's passed by name or by address.
+ */
+
+#if !defined(__HOST_SIM__)
+#error The delegate_benchmark demo requires BOARD=host
+#endif
+
+#include "MotateDelegate.h"
+#include "MotateUART.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+
+/****** Count heap allocations ******/
+
+volatile uint32_t allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations++;
+    return malloc(size ? size : 1);
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { free(ptr); }
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kCalls = 100000000;
+static constexpr uint32_t kCharacters = 4000;
+
+Motate::UART<Motate::kSerial_RX, Motate::kSerial_TX> Serial {115200};
+uint32_t characters_sent = 0;
+
+// Stands in for a driver, like UART or SPIBus, that handles its own interrupts
+struct Driver {
+    volatile uint32_t interrupts = 0;
+    void interruptHandler(uint16_t interruptCause) { interrupts = interrupts + interruptCause; };
+};
+Driver driver;
+
+// Never defined, so its address is null
+void undefinedHandler() __attribute__((weak));
+
+// Call the callback n times, the way an interrupt would -- through a reference to
+// a stored callback the compiler can't see into.
+template <typename callback_t>
+__attribute__((noinline)) void callMany(const callback_t &callback, const uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        callback(1);
+    }
+}
+
+template <typename callback_t>
+double nanosecondsPerCall(const callback_t &callback) {
+    callMany(callback, kCalls / 100); // warm up
+    auto start = std::chrono::steady_clock::now();
+    callMany(callback, kCalls);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kCalls;
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    // Call cost
+    std::function<void(uint16_t)> function_callback = [&](uint16_t cause) { driver.interruptHandler(cause); };
+    Motate::Delegate<void(uint16_t)> delegate_callback = [&](uint16_t cause) { driver.interruptHandler(cause); };
+
+    printf("call: std::function %5.2f ns, Delegate %5.2f ns\n",
+           nanosecondsPerCall(function_callback), nanosecondsPerCall(delegate_callback));
+
+    // Allocations from assigning a callback with three captures
+    Driver *a = &driver, *b = &driver, *c = &driver;
+    uint32_t start_allocations = allocations;
+    function_callback = [a, b, c](uint16_t cause) { a->interruptHandler(cause); b->interruptHandler(cause); c->interruptHandler(cause); };
+    const uint32_t function_allocations = allocations - start_allocations;
+
+    start_allocations = allocations;
+    Motate::Delegate<void(uint16_t), 3 * sizeof(void *)> wide_delegate_callback =
+        [a, b, c](uint16_t cause) { a->interruptHandler(cause); b->interruptHandler(cause); c->interruptHandler(cause); };
+    const uint32_t delegate_allocations = allocations - start_allocations;
+    wide_delegate_callback(1);
+
+    printf("assign (3 captures): std::function %" PRIu32 " allocations, Delegate %" PRIu32 " allocations\n",
+           function_allocations, delegate_allocations);
+
+    // Empty from an undefined weak function
+    const Motate::Delegate<void(void)> by_name = undefinedHandler;
+    const Motate::Delegate<void(void)> by_address = &undefinedHandler;
+    const bool empty_ok = !by_name && !by_address;
+    printf("undefined weak function: %s\n", empty_ok ? "empty Delegate" : "FAIL: non-empty Delegate");
+
+    // Allocations while running
+    Motate::HostUARTs[Motate::UARTTxPin<Motate::kSerial_TX>::uartNum].tx_sink = [](uint8_t) { characters_sent++; };
+
+    static char line[] = "The quick brown fox jumps over the lazy dog.\n";
+    const uint32_t line_length = sizeof(line) - 1;
+
+    start_allocations = allocations;
+    uint32_t characters_queued = 0;
+    while (characters_queued < kCharacters) {
+        characters_queued += Serial.write(line, line_length, /*autoFlush=*/true);
+    }
+    while (characters_sent < characters_queued) {
+        Motate::HostSim::idle();
+    }
+    const uint32_t uart_allocations = allocations - start_allocations;
+
+    printf("UART: %" PRIu32 " characters sent, %" PRIu32 " allocations\n", characters_sent, uart_allocations);
+
+    exit((delegate_allocations || uart_allocations || !empty_ok) ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -0,0 +1,283 @@
+/*
+ * float_format_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/FloatFormatDemo.elf
+ *
+ * Host-only: it checks Motate's formatters against the C library's printf.
+ *
+ * Round trip: every Nth float bit pattern (N is FLOAT_FORMAT_STRIDE from the
+ * environment, 9973 by default -- use 1 to check all 2^32 of them, which takes a
+ * while) is formatted at every precision from 0 to 10 with c_floattoa, and has to
+ * match printf("%.*f") with the trailing zeros dropped. The integer formatters are
+ * checked the same way against "%u" and "%d".
+ *
+ * Speed: formatting the kind of values that go out in status reports, with the old
+ * c_floattoa (kept here as legacy_floattoa), the new one, and snprintf, the best of
+ * five runs each. The old one is built on float math, which the host does in hardware;
+ * the new one is integer math only.
+ */
+
+#if !defined(__HOST_SIM__)
+#error The float_format demo requires BOARD=host
+#endif
+
+#include "MotateUtilities.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kDefaultStride = 9973;
+static constexpr uint32_t kStatusValues = 4096;
+static constexpr uint32_t kPasses = 100;
+static constexpr uint32_t kRuns = 5;
+
+float status_values[kStatusValues];
+int status_precisions[kStatusValues];
+volatile uint32_t sink = 0;
+
+// The c_floattoa this replaced, for comparison
+static int legacy_floattoa(float in, char *buffer, int maxlen, int precision) {
+    static constexpr float round_lookup_[] = {0.5, 0.05, 0.005, 0.0005, 0.00005, 0.000005,
+        0.0000005, 0.00000005, 0.000000005, 0.0000000005, 0.00000000005};
+    int length_ = 0;
+    char *b_ = buffer;
+
+    if (in < 0.0) {
+        *b_++ = '-';
+        return legacy_floattoa(-in, b_, maxlen-1, precision) + 1;
+    }
+    in = in + round_lookup_[precision];
+
+    int int_length_ = 0;
+    int integer_part_ = (int)in;
+    while (integer_part_ > 0) {
+        if (length_++ > maxlen) {
+            *buffer = 0;
+            return 0;
+        }
+        int t_ = integer_part_ / 10;
+        *b_++ = '0' + (integer_part_ - (t_*10));
+        integer_part_ = t_;
+        int_length_++;
+    }
+    if (length_ > 0) {
+        Motate::Private::c_strreverse(buffer, int_length_);
+    } else {
+        *b_++ = '0';
+        int_length_++;
+    }
+
+    *b_++ = '.';
+    length_ = int_length_+1;
+
+    float frac_part_ = in;
+    frac_part_ -= (int)frac_part_;
+    while (precision-- > 0) {
+        if (length_++ > maxlen) {
+            *buffer = 0;
+            return 0;
+        }
+        frac_part_ *= 10.0;
+        *b_++ = ('0' + (int)frac_part_);
+        frac_part_ -= (int)frac_part_;
+    }
+    while (*(b_-1) == '0' && length_>1) {
+        b_--; *b_ = 0;
+        length_--;
+    }
+    if (*(b_-1) == '.') {
+        b_--; *b_ = 0;
+        length_--;
+    }
+    return length_;
+}
+
+// printf("%.*f"), with the trailing zeros (and '.') dropped
+static int reference_floattoa(float in, char *buffer, int maxlen, int precision) {
+    int length = snprintf(buffer, maxlen, "%.*f", precision, (double)in);
+    if (std::isnan(in)) {
+        return snprintf(buffer, maxlen, "nan");
+    }
+    if (strchr(buffer, '.')) {
+        while (buffer[length - 1] == '0') {
+            buffer[--length] = 0;
+        }
+        if (buffer[length - 1] == '.') {
+            buffer[--length] = 0;
+        }
+    }
+    return length;
+}
+
+static float floatFromBits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t checkFloat(float value) {
+    uint32_t failures = 0;
+    for (int precision = 0; precision <= 10; precision++) {
+        char expected[64], actual[64];
+        int expected_length = reference_floattoa(value, expected, sizeof(expected), precision);
+        int actual_length = Motate::Private::c_floattoa(value, actual, sizeof(actual), precision);
+        if ((expected_length != actual_length) || strcmp(expected, actual)) {
+            if (failures++ == 0) {
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                printf("  0x%08" PRIx32 " at %d: expected \"%s\", got \"%s\"\n", bits, precision, expected, actual);
+            }
+        }
+    }
+    return failures;
+}
+
+static uint32_t checkInteger(uint32_t value) {
+    char expected[16], actual[16];
+    uint32_t failures = 0;
+
+    snprintf(expected, sizeof(expected), "%" PRIu32, value);
+    if ((Motate::Private::c_u32toa(value, actual, sizeof(actual)) != (int)strlen(expected)) || strcmp(expected, actual)) {
+        failures++;
+    }
+    snprintf(expected, sizeof(expected), "%" PRId32, (int32_t)value);
+    if ((Motate::Private::c_i32toa((int32_t)value, actual, sizeof(actual)) != (int)strlen(expected)) || strcmp(expected, actual)) {
+        failures++;
+    }
+    return failures;
+}
+
+// The best of kRuns, so a busy machine doesn't swamp the difference
+template <typename format_t>
+double nanosecondsPerValue(format_t format) {
+    char buffer[64];
+    double best = 0;
+    for (uint32_t run = 0; run < kRuns; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t pass = 0; pass < kPasses; pass++) {
+            for (uint32_t i = 0; i < kStatusValues; i++) {
+                sink = sink + format(status_values[i], buffer, sizeof(buffer), status_precisions[i]);
+            }
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        const double nanoseconds = elapsed.count() / (kPasses * kStatusValues);
+        best = ((run == 0) || (nanoseconds < best)) ? nanoseconds : best;
+    }
+    return best;
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    uint32_t stride = kDefaultStride;
+    if (const char *stride_env = getenv("FLOAT_FORMAT_STRIDE")) {
+        stride = strtoul(stride_env, nullptr, 0);
+        if (stride == 0) {
+            stride = 1;
+        }
+    }
+
+    // Round trip
+    uint32_t float_failures = 0;
+    uint32_t floats_checked = 0;
+    uint64_t bits = 0;
+    while (bits <= 0xFFFFFFFF) {
+        float_failures += checkFloat(floatFromBits(bits));
+        floats_checked++;
+        bits += stride;
+    }
+    // Plus the edges, and values that land exactly on a rounding tie
+    const float edges[] = {0.0f, -0.0f, 0.5f, 1.5f, 2.5f, -2.5f, 0.125f, 0.375f, 9.5f, 99.5f, 999.9999f,
+        0.99999994f, 2147483648.0f, 4294967296.0f, 3.4028235e38f, 1.17549435e-38f, 1.4e-45f,
+        INFINITY, -INFINITY, NAN};
+    for (float edge : edges) {
+        float_failures += checkFloat(edge);
+        floats_checked++;
+    }
+    printf("c_floattoa: %" PRIu32 " floats x 11 precisions, %" PRIu32 " failures\n", floats_checked, float_failures);
+
+    uint32_t integer_failures = 0;
+    uint32_t integers_checked = 0;
+    bits = 0;
+    while (bits <= 0xFFFFFFFF) {
+        integer_failures += checkInteger(bits);
+        integers_checked++;
+        bits += (stride / 8) + 1;
+    }
+    const uint32_t integer_edges[] = {0, 9, 10, 99, 100, 999999999, 1000000000, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF};
+    for (uint32_t edge : integer_edges) {
+        integer_failures += checkInteger(edge);
+        integers_checked++;
+    }
+    printf("c_u32toa/c_i32toa: %" PRIu32 " integers, %" PRIu32 " failures\n", integers_checked, integer_failures);
+
+    // Small buffers
+    char small[5];
+    uint32_t overflow_failures = 0;
+    overflow_failures += (Motate::Private::c_floattoa(-12.5f, small, sizeof(small), 3) != 0) || small[0];
+    overflow_failures += (Motate::Private::c_floattoa(-1.5f, small, sizeof(small), 3) != 4) || strcmp(small, "-1.5");
+    overflow_failures += (Motate::Private::c_u32toa(12345, small, sizeof(small)) != 0) || small[0];
+    overflow_failures += (Motate::Private::c_i32toa(-123, small, sizeof(small)) != 4) || strcmp(small, "-123");
+    printf("small buffers: %" PRIu32 " failures\n", overflow_failures);
+
+    // Speed: positions, velocities and temperatures, with 2 to 4 decimal places
+    srand(1);
+    for (uint32_t i = 0; i < kStatusValues; i++) {
+        status_values[i] = ((float)rand() / RAND_MAX - 0.5f) * 2000.0f;
+        status_precisions[i] = 2 + (i % 3);
+    }
+    uint32_t legacy_wrong = 0;
+    for (uint32_t i = 0; i < kStatusValues; i++) {
+        char expected[64], actual[64] = {}; // the old one didn't always write the \0
+        reference_floattoa(status_values[i], expected, sizeof(expected), status_precisions[i]);
+        legacy_floattoa(status_values[i], actual, sizeof(actual), status_precisions[i]);
+        legacy_wrong += (strcmp(expected, actual) != 0);
+    }
+    printf("status values: legacy c_floattoa gets %" PRIu32 " of %" PRIu32 " wrong\n", legacy_wrong, kStatusValues);
+    printf("status values: legacy c_floattoa %6.1f ns, c_floattoa %6.1f ns, snprintf %6.1f ns\n",
+           nanosecondsPerValue(legacy_floattoa),
+           nanosecondsPerValue(Motate::Private::c_floattoa),
+           nanosecondsPerValue([](float value, char *buffer, int maxlen, int precision) {
+               return snprintf(buffer, maxlen, "%.*f", precision, (double)value);
+           }));
+
+    exit((float_failures || integer_failures || overflow_failures) ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
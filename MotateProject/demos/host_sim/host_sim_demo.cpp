@@ -0,0 +1,96 @@
+/*
+ * host_sim_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/HostSimDemo.elf
+ *
+ * This runs Motate against the simulated peripherals in Host_sim: a pin, a timer
+ * interrupt, SysTick, and a UART (with the simulated TX line printed to stdout).
+ */
+
+#include "MotatePins.h"
+#include "MotateTimers.h"
+#include "MotateUART.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+using Motate::delay;
+
+/****** Create file-global objects ******/
+
+Motate::OutputPin<13> led_pin;
+
+Motate::Timer<0> tick_timer {Motate::kTimerUpToMatch, 1000 /* Hz */};
+volatile uint32_t timer_ticks = 0;
+
+Motate::UART<Motate::kSerial_RX, Motate::kSerial_TX> Serial {115200};
+
+/****** Optional setup() function ******/
+
+void setup() {
+    // The simulated UART's TX line goes to stdout
+    Motate::HostUARTs[Motate::UARTTxPin<Motate::kSerial_TX>::uartNum].tx_sink =
+        [](uint8_t c) { putchar(c); };
+
+    // Stop after one simulated second
+    Motate::HostSim::loopHook = []() {
+        if (Motate::SysTickTimer.getValue() >= 1000) {
+            printf("simulated %" PRIu64 " cycles: %" PRIu32 " timer interrupts, led is %s\n",
+                   Motate::HostSim::now(), (uint32_t)timer_ticks,
+                   led_pin.getOutputValue() ? "on" : "off");
+            exit(0);
+        }
+    };
+
+    tick_timer.setInterrupts(Motate::kInterruptOnOverflow | Motate::kInterruptPriorityMedium);
+    tick_timer.start();
+
+    Serial.write("Startup...done.\n", 0, /*autoFlush=*/true);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+    led_pin.toggle();
+    Serial.write(led_pin.getOutputValue() ? "on\n" : "off\n", 0, /*autoFlush=*/true);
+
+    delay(250);
+}
+
+/****** timer interrupt handler ******/
+
+namespace Motate {
+    MOTATE_TIMER_INTERRUPT(0) {
+        int16_t interrupted_channel;
+        getInterruptCause(interrupted_channel);
+        timer_ticks++;
+    }
+}
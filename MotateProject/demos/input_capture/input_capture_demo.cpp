@@ -0,0 +1,236 @@
+/*
+ * input_capture_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/InputCaptureDemo.elf
+ *
+ * Feeds a square wave into TIOA of Timer<4>, and checks the timestamps that an
+ * InputCapture takes of it: every edge exactly where it was driven, across many
+ * wraps of the 16-bit counter, and the period, frequency and duty cycle from them.
+ * Also checks a capture on each side of a wrap that's handled late (interrupts off),
+ * that now() catches an overflow that hasn't been handled, that a full queue drops
+ * edges (and counts them), and that a stopped signal goes stale.
+ */
+
+#include "MotateInputCapture.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostSimEvent;
+using Motate::HostTC;
+using Motate::InputCapture;
+
+/****** Create file-global objects ******/
+
+static constexpr uint8_t kTimer = 4;
+typedef InputCapture<kTimer, 16> capture_t;
+capture_t capture;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Ticks are two core cycles (TIMER_CLOCK1), counted from start()
+static uint64_t start_cycle = 0;
+static uint64_t cycleOf(const uint64_t tick) { return start_cycle + (2 * tick); }
+static uint64_t nowTick() { return (HostSim::now() - start_cycle) / 2; }
+
+static void start(const Motate::TimerCaptureEdges edges) {
+    HostTC[kTimer].tioaInput(false);
+    capture.start(edges);
+    start_cycle = HostSim::now();
+}
+
+// A square wave on TIOA: high for high_ticks of every period_ticks, starting at first_tick
+struct SquareWave {
+    uint64_t next_rise = 0;
+    uint32_t period_ticks = 0;
+    uint32_t high_ticks = 0;
+    bool high = false;
+    HostSimEvent event {[this]() { edge(); }};
+
+    void start(const uint64_t first_tick, const uint32_t period, const uint32_t high_time) {
+        next_rise = first_tick;
+        period_ticks = period;
+        high_ticks = high_time;
+        high = false;
+        HostSim::schedule(&event, cycleOf(next_rise));
+    };
+    void stop() { HostSim::cancel(&event); };
+
+    void edge() {
+        high = !high;
+        HostTC[kTimer].tioaInput(high);
+        if (high) {
+            HostSim::schedule(&event, cycleOf(next_rise + high_ticks));
+            next_rise += period_ticks;
+        } else {
+            HostSim::schedule(&event, cycleOf(next_rise));
+        }
+    };
+};
+static SquareWave wave;
+
+static void test_timestamps() {
+    start(Motate::kCaptureBothEdges);
+    check(capture.getTickFrequency() == SystemCoreClock / 2, "ticks are MCK/2");
+
+    // 1000-tick periods, high for 250, for 300 wraps of the counter
+    const uint32_t periods = (300ul << 16) / 1000;
+    wave.start(100, 1000, 250);
+
+    uint32_t edges = 0, wrong = 0;
+    capture_t::edge_t edge;
+    while (edges < 2 * periods) {
+        HostSim::advance(10000);  // 5 periods, so the queue never fills
+        while (capture.read(edge)) {
+            const uint64_t expected = 100 + ((uint64_t)(edges / 2) * 1000) + ((edges & 1) ? 250 : 0);
+            if ((edge.time != (uint32_t)expected) || (edge.rising == (bool)(edges & 1))) {
+                if (wrong++ < 3) {
+                    printf("edge %" PRIu32 ": %" PRIu32 " (%s), expected %" PRIu64 "\n", edges, (uint32_t)edge.time,
+                           edge.rising ? "rising" : "falling", expected);
+                }
+            }
+            edges++;
+        }
+    }
+    wave.stop();
+
+    printf("timestamps: %" PRIu32 " edges over %" PRIu32 " counter wraps, %" PRIu32 " wrong\n", edges,
+           (uint32_t)(nowTick() >> 16), wrong);
+    check(wrong == 0, "every edge is timestamped where it was driven, across the wraps");
+    check(capture.dropped() == 0 && capture.overruns() == 0, "nothing dropped or overrun");
+
+    check(capture.getPeriod() == 1000, "the period is rise-to-rise");
+    check(capture.getHighTime() == 250, "the high time is rise-to-fall");
+    check(capture.getDutyFraction() == 0x4000, "a quarter duty cycle is 0x4000");
+    const float frequency = capture.getFrequency();
+    printf("measured: %" PRIu32 " ticks, %.1f Hz, %.3f duty\n", (uint32_t)capture.getPeriod(), frequency,
+           capture.getDutyCycle());
+    check(frequency > 41999.0 && frequency < 42001.0, "42MHz ticks / 1000 is 42kHz");
+}
+
+static void test_late_interrupt() {
+    start(Motate::kCaptureBothEdges);
+
+    // A rise just before the wrap and a fall just after it, with the interrupt held off
+    // until after both -- it sees the overflow and both captures all at once.
+    const uint64_t wrap = ((nowTick() >> 16) + 3) << 16;
+    HostSim::advance(cycleOf(wrap - 1000) - HostSim::now());
+    __disable_irq();
+    HostSim::advance(cycleOf(wrap - 10) - HostSim::now());
+    HostTC[kTimer].tioaInput(true);
+    HostSim::advance(20 * 2);
+    HostTC[kTimer].tioaInput(false);
+    HostSim::advance(100 * 2);
+    __enable_irq();
+
+    capture_t::edge_t rise {}, fall {};
+    check(capture.read(rise) && capture.read(fall), "both edges are queued");
+    printf("late interrupt: rise at %" PRIu32 ", fall at %" PRIu32 " (wrap at %" PRIu64 ")\n",
+           (uint32_t)rise.time, (uint32_t)fall.time, wrap);
+    check(rise.rising && rise.time == (uint32_t)(wrap - 10), "the capture before the wrap belongs before it");
+    check(!fall.rising && fall.time == (uint32_t)(wrap + 10), "the capture after the wrap belongs after it");
+    check(capture.getHighTime() == 20, "and the high time spans the wrap");
+
+    // With the TC interrupt off entirely, now() still handles the overflow it finds
+    NVIC_DisableIRQ(Motate::Timer<kTimer>::tcIRQ());
+    HostSim::advance(cycleOf(wrap + 0x10000 + 5) - HostSim::now());
+    const uint32_t polled = capture.now();
+    NVIC_EnableIRQ(Motate::Timer<kTimer>::tcIRQ());
+    check(polled == (uint32_t)(wrap + 0x10000 + 5), "now() extends past an overflow it finds pending");
+    HostSim::advance(0x10000 * 2);
+    check(capture.now() == (uint32_t)nowTick(), "and the interrupt doesn't count it again");
+}
+
+static void test_full_queue() {
+    start(Motate::kCaptureRisingEdges);
+
+    // 20 rises, with nothing reading the queue -- it holds 15 of them
+    wave.start(50, 500, 100);
+    HostSim::advance(cycleOf(50 + (19 * 500) + 200) - HostSim::now());
+    wave.stop();
+
+    capture_t::edge_t edges[16];
+    const uint16_t queued = capture.read(edges, 16);
+    bool in_order = true;
+    for (uint16_t i = 0; i < queued; i++) {
+        in_order &= edges[i].rising && (edges[i].time == 50 + (i * 500u));
+    }
+    printf("full queue: %u queued, %" PRIu32 " dropped, %" PRIu32 " measured\n", queued, capture.dropped(), capture.edges());
+    check(queued == 15 && in_order, "the queue keeps the oldest edges, in order");
+    check(capture.dropped() == 5, "and counts the rest as dropped");
+    check(capture.edges() == 20 && capture.getPeriod() == 500, "the measurements still see every edge");
+    check(capture.getHighTime() == 0, "rises alone have no high time");
+}
+
+static void test_stale() {
+    start(Motate::kCaptureBothEdges);
+    check(capture.isStale(1000), "stale before any edges");
+
+    wave.start(10, 1000, 500);
+    HostSim::advance(cycleOf(10 + 5000 + 100) - HostSim::now());
+    check(!capture.isStale(1000), "not stale while the edges keep coming");
+
+    wave.stop();
+    HostSim::advance(cycleOf(10 + 5000 + 2000) - HostSim::now());
+    check(capture.ticksSinceLastEdge() == 2000, "ticks since the last edge, the rise at 5010");
+    check(capture.isStale(1000), "stale once the signal stops");
+    check(capture.getPeriod() == 1000, "the last period is kept");
+    capture.stop();
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    test_timestamps();
+    test_late_interrupt();
+    test_full_queue();
+    test_stale();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
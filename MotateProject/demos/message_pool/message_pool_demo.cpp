@@ -0,0 +1,343 @@
+/*
+ * message_pool_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/MessagePoolDemo.elf
+ *
+ * Two "drivers" share one pool of SPIMessages on the simulated SPI bus, and queue
+ * them fire-and-forget: take a message, set it up, queue it, and drop the handle.
+ * We check that every message makes it (with its data), that the bus really runs
+ * with the whole pool outstanding, and that every message is back in the pool when
+ * it's done -- including one a handle holds on to, and one that's queued again from
+ * its own callback.
+ *
+ * Then the same on the TWI bus, with a register write and a chained write-then-read
+ * (two pooled messages, one transaction), and a chain to a device that isn't there.
+ *
+ * Last, we report the RAM the pool takes, against each driver keeping enough static
+ * messages of its own to be as deep.
+ */
+
+#include "MotatePins.h"
+#include "MotateSPI.h"
+#include "MotateTWI.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::BusPriority;
+using Motate::HostSim;
+using Motate::HostSPI0;
+using Motate::HostTWI0;
+using Motate::HostTwiRegisters;
+using Motate::SPIMessage;
+using Motate::SPIMessageHandle;
+using Motate::SPIMessagePool;
+using Motate::TWIMessage;
+using Motate::TWIMessageHandle;
+using Motate::TWIMessagePool;
+
+/****** Create file-global objects ******/
+
+Motate::SPIBus<Motate::kSPI_MISOPinNumber, Motate::kSPI_MOSIPinNumber, Motate::kSPI_SCKPinNumber> spiBus;
+auto spiDeviceA = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS0PinNumber>{},
+                                   4000000,                                  // baud
+                                   Motate::kSPIMode0 | Motate::kSPI8Bit,     // options
+                                   0,                                        // min_between_cs_delay_ns
+                                   0,                                        // cs_to_sck_delay_ns
+                                   0);                                       // between_word_delay_ns
+auto spiDeviceB = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS1PinNumber>{},
+                                   4000000,                                  // baud
+                                   Motate::kSPIMode0 | Motate::kSPI8Bit,     // options
+                                   0,                                        // min_between_cs_delay_ns
+                                   0,                                        // cs_to_sck_delay_ns
+                                   0);                                       // between_word_delay_ns
+
+Motate::TWIBus<Motate::kI2C_SCLPinNumber, Motate::kI2C_SDAPinNumber> twiBus;
+auto sensorDevice = twiBus.getDevice({0x20});
+auto missingDevice = twiBus.getDevice({0x51});
+
+static HostTwiRegisters<> sensor {0x20};
+
+static constexpr uint8_t kPoolSize = 8;
+static constexpr uint8_t kMessageSize = 4;
+static constexpr uint32_t kMessages = 10000;
+
+static SPIMessagePool<kPoolSize> spiPool;
+static TWIMessagePool<4> twiPool;
+
+// The data for each message goes with its slot in the pool
+static uint8_t tx_buffers[kPoolSize][kMessageSize];
+static uint8_t rx_buffers[kPoolSize][kMessageSize];
+
+static volatile uint32_t completed = 0;
+static volatile uint32_t twi_done = 0;
+static volatile uint32_t twi_failed = 0;
+static bool data_ok = true;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/****** The SPI tests ******/
+
+static uint8_t slotOf(const SPIMessage *msg) { return msg - spiPool._pooled; }
+
+static void spiDone(SPIMessage *msg) {
+    const uint8_t slot = slotOf(msg);
+    for (uint8_t j = 0; j < kMessageSize; j++) {
+        data_ok &= (rx_buffers[slot][j] == (uint8_t)~tx_buffers[slot][j]);
+    }
+    completed++;
+}
+
+// Set up msg (in slot) with the data for message number n
+static void spiSetup(SPIMessage *msg, const uint32_t n) {
+    const uint8_t slot = slotOf(msg);
+    for (uint8_t j = 0; j < kMessageSize; j++) {
+        tx_buffers[slot][j] = n * kMessageSize + j;
+        rx_buffers[slot][j] = 0;
+    }
+    msg->setup(tx_buffers[slot], rx_buffers[slot], kMessageSize, SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+    msg->message_done_callback = [msg] { spiDone(msg); };
+}
+
+static void waitForSpi(const uint32_t count) {
+    while (completed < count) {
+        HostSim::idle();
+    }
+}
+
+static void testAcquire() {
+    {
+        SPIMessageHandle handles[kPoolSize];
+        for (auto &h : handles) {
+            h = spiPool.acquire();
+        }
+        bool all = true;
+        for (auto &h : handles) {
+            all &= (bool)h;
+        }
+        check(all && (spiPool.available() == 0), "acquire the whole pool");
+        check(!spiPool.acquire(), "an empty pool gives an empty handle");
+
+        handles[3].reset();
+        check(spiPool.available() == 1, "reset() returns the message");
+
+        SPIMessageHandle moved {std::move(handles[4])};
+        check(moved && !handles[4] && (spiPool.available() == 1), "moving a handle moves the message");
+    }
+    check(spiPool.available() == kPoolSize, "every message is back when the handles go away");
+
+    // A message comes back without the last owner's callback or priority
+    SPIMessage *first;
+    {
+        auto h = spiPool.acquire();
+        first = h.get();
+        h->message_done_callback = [] {};
+        h->priority = BusPriority::kUrgent;
+        h->deadline.set_us(100);
+    }
+    auto h = spiPool.acquire();
+    check((h.get() == first) && !h->message_done_callback && (h->priority == BusPriority::kNormal) &&
+              !h->deadline.isSet(),
+          "a reused message starts clean");
+}
+
+static void testFireAndForget() {
+    completed = 0;
+    data_ok = true;
+    uint8_t least_available = kPoolSize;
+
+    uint32_t sent = 0;
+    while (sent < kMessages) {
+        SPIMessageHandle h = spiPool.acquire();
+        if (!h) {
+            HostSim::idle();  // all of them are out: wait for one to come back
+            continue;
+        }
+        spiSetup(h.get(), sent);
+
+        // The two drivers take turns
+        auto &device = (sent & 1) ? spiDeviceB : spiDeviceA;
+        check(device.queueMessage(h.get()), "queue a pooled message");
+        sent++;
+
+        if (spiPool.available() < least_available) {
+            least_available = spiPool.available();
+        }
+    }  // and the handle goes away, leaving the message with the bus
+    waitForSpi(kMessages);
+
+    check(data_ok, "every byte came back from the slave");
+    check(least_available == 0, "the bus ran with the whole pool outstanding");
+    check(spiPool.available() == kPoolSize, "every message went back to the pool when it was done");
+}
+
+static void testKeptHandle() {
+    completed = 0;
+    data_ok = true;
+
+    // Keep the handle, to queue the same message again
+    auto h = spiPool.acquire();
+    for (uint32_t n = 0; n < 3; n++) {
+        spiSetup(h.get(), n);
+        spiDeviceA.queueMessage(h.get());
+        waitForSpi(n + 1);
+        check(spiPool.available() == kPoolSize - 1, "a held message stays out of the pool when it's done");
+    }
+    check(data_ok, "queue a held message again");
+
+    h.reset();
+    check(spiPool.available() == kPoolSize, "it goes back when the handle lets go");
+}
+
+static uint32_t requeues = 0;
+
+static void testRequeueFromCallback() {
+    completed = 0;
+    requeues = 0;
+    {
+        auto h = spiPool.acquire();
+        spiSetup(h.get(), 0);
+        h->message_done_callback = [msg = h.get()] {
+            completed++;
+            if (++requeues < 4) {
+                msg->setup(msg->tx_buffer, msg->rx_buffer, msg->size, SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+                spiDeviceB.queueMessage(msg);
+            }
+        };
+        spiDeviceB.queueMessage(h.get());
+    }
+    check(spiPool.available() == kPoolSize - 1, "a queued message stays out of the pool");
+    waitForSpi(4);
+    check(spiPool.available() == kPoolSize, "a message queued again from its callback goes back after the last time");
+}
+
+/****** The TWI tests ******/
+
+static void twiDone(bool ok) {
+    twi_done++;
+    if (!ok) {
+        twi_failed++;
+    }
+}
+
+static void waitForTwi(const uint32_t count) {
+    while (twi_done < count) {
+        HostSim::idle();
+    }
+}
+
+static void testTwi() {
+    static uint8_t write_buffer[] = {0x10, 0xDE, 0xAD, 0xBE, 0xEF};
+    static uint8_t pointer[] = {0x10};
+    static uint8_t read[4];
+
+    twi_done = 0;
+    twi_failed = 0;
+    {
+        auto write = twiPool.acquire();
+        write->setup(write_buffer, sizeof(write_buffer), TWIMessage::Direction::kTX);
+        write->message_done_callback = twiDone;
+        sensorDevice.queueMessage(write.get());
+
+        // A chained read: the handles go away as soon as they're queued
+        auto read_pointer = twiPool.acquire();
+        auto read_data = twiPool.acquire();
+        read_data->setup(read, sizeof(read), TWIMessage::Direction::kRX);
+        read_data->message_done_callback = twiDone;
+        read_pointer->setup(pointer, sizeof(pointer), TWIMessage::Direction::kTX, {},
+                            TWIMessage::Instruction::kWithoutStop, read_data.get());
+        read_pointer->message_done_callback = twiDone;
+        sensorDevice.queueMessage(read_pointer.get());
+    }
+    check(twiPool.available() == 1, "queued TWI messages stay out of the pool");
+    waitForTwi(3);
+    check((twi_failed == 0) && (memcmp(read, write_buffer + 1, sizeof(read)) == 0), "write and read back with pooled messages");
+    check(twiPool.available() == 4, "the TWI messages went back to the pool");
+
+    // A device that isn't there fails the whole chain, and still gives the messages back
+    twi_done = 0;
+    twi_failed = 0;
+    {
+        auto read_pointer = twiPool.acquire();
+        auto read_data = twiPool.acquire();
+        read_data->setup(read, sizeof(read), TWIMessage::Direction::kRX);
+        read_data->message_done_callback = twiDone;
+        read_pointer->setup(pointer, sizeof(pointer), TWIMessage::Direction::kTX, {},
+                            TWIMessage::Instruction::kWithoutStop, read_data.get());
+        read_pointer->message_done_callback = twiDone;
+        missingDevice.queueMessage(read_pointer.get());
+    }
+    waitForTwi(2);
+    check(twi_failed == 2, "a missing device fails the whole chain");
+    check(twiPool.available() == 4, "failed messages go back to the pool too");
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    spiBus.init();
+    twiBus.init();
+    HostTWI0.attach(&sensor);
+
+    HostSPI0.slave = [](uint8_t cs, uint16_t mosi) -> uint16_t { return (uint8_t)~mosi; };
+
+    testAcquire();
+    testFireAndForget();
+    testKeptHandle();
+    testRequeueFromCallback();
+    testTwi();
+
+    // To be as deep on its own, each driver would need the whole pool's worth
+    const size_t per_driver = 2 * kPoolSize * sizeof(SPIMessage);
+    printf("%u SPIMessages outstanding across 2 drivers:\n", kPoolSize);
+    printf("  %-34s %6zu bytes\n", "static messages in each driver", per_driver);
+    printf("  %-34s %6zu bytes\n", "one pool for the bus", sizeof(spiPool));
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -0,0 +1,256 @@
+/*
+ * number_parse_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/NumberParseDemo.elf
+ *
+ * Host-only: it checks c_strtof against the C library's strtof.
+ *
+ * Round trip: every Nth float bit pattern (N is NUMBER_PARSE_STRIDE from the
+ * environment, 997 by default -- use 1 to check all 2^32 of them) is printed with
+ * "%.9g", which is enough digits to get the same float back, and has to parse back
+ * to the same bits. Then a set of odd-shaped inputs has to match strtof, including
+ * the length it took.
+ *
+ * Halfway: for every Nth float, the point exactly halfway to the next one up is
+ * written out in full (which a double can hold), and that, a hair above it, and a
+ * hair below it all have to match strtof. Those are the ones that need every digit.
+ *
+ * All of those are also checked with c_strtof<false>, the path for where double is
+ * only 32 bits (avr-gcc), which finds the float with integer math alone.
+ *
+ * Speed: parsing the kind of numbers that come in on command lines, with the old
+ * recursive c_atof (kept here as legacy_atof), c_strtof (with and without an end
+ * pointer), and strtof.
+ */
+
+#if !defined(__HOST_SIM__)
+#error The number_parse demo requires BOARD=host
+#endif
+
+#include "MotateUtilities.h"
+
+#include <chrono>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using Motate::Private::c_strtof;
+using Motate::Private::NumberParseError;
+
+// It's constexpr
+static_assert(c_strtof("12.5e1").value > 124.99f && c_strtof("12.5e1").value < 125.01f, "c_strtof isn't constexpr");
+static_assert(c_strtof("-0.001x").length == 6, "c_strtof isn't constexpr");
+static_assert(c_strtof("1e99").error == NumberParseError::kOverflow, "c_strtof isn't constexpr");
+static_assert(c_strtof("16777217.0000001").value > 16777217.0f, "c_strtof's slow path isn't constexpr");
+static_assert(c_strtof<false>("16777217.0000001").value > 16777217.0f, "c_strtof's float-only path isn't constexpr");
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kDefaultStride = 997;
+static constexpr uint32_t kCommandValues = 4096;
+static constexpr uint32_t kPasses = 500;
+
+char command_values[kCommandValues][16];
+const char *command_ends[kCommandValues];
+volatile float sink = 0;
+
+// The c_atof this replaced, for comparison
+namespace legacy {
+    constexpr float c_atof_frac_(char *&p_, float v_, float m_) {
+        return ((*p_ >= '0') && (*p_ <= '9'))
+        ? (v_=((v_)+((*p_)-'0')*m_), c_atof_frac_(++p_, v_, m_/10.0))
+        : v_;
+    }
+    template <typename int_type>
+    constexpr float c_atof_int_(char *&p_, int_type v_) {
+        return (*p_ == '.')
+        ? (float)(v_) + c_atof_frac_(++p_, 0, 1.0/10.0)
+        : (
+           ((*p_ >= '0') && (*p_ <= '9'))
+           ? ((v_=((*p_)-'0')+(v_*10)), c_atof_int_(++p_, v_))
+           : v_
+           );
+    }
+    constexpr float c_atof(char *&p_) {
+        return (*p_ == '-')
+        ? (c_atof_int_(++p_, 0) * -1.0)
+        : (c_atof_int_(p_, 0));
+    }
+}
+
+static uint32_t bitsOf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float floatFromBits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Same value (or both nan), same length, and an error exactly when strtof says ERANGE
+// and gives back 0 or inf (it also says ERANGE for denormals, which we take quietly)
+static uint32_t checkAgainstStrtof(const char *text) {
+    char *strtof_end = nullptr;
+    errno = 0;
+    const float expected = strtof(text, &strtof_end);
+    const bool expected_range_error = (errno == ERANGE) && ((std::fpclassify(expected) == FP_ZERO) || std::isinf(expected));
+    const int expected_length = strtof_end - text;
+
+    uint32_t failures = 0;
+    const char *ends[] = {nullptr, text + strlen(text)};
+    for (int path = 0; path < 4; path++) {
+        const char *end = ends[path & 1];
+        const bool float_only = (path >= 2);
+        const auto parsed = float_only ? c_strtof<false>(text, end) : c_strtof(text, end);
+        const bool same_value = (std::isnan(expected) && std::isnan(parsed.value)) || (bitsOf(expected) == bitsOf(parsed.value));
+        const bool range_error = (parsed.error == NumberParseError::kOverflow) || (parsed.error == NumberParseError::kUnderflow);
+        if (!same_value || (parsed.length != expected_length) || (range_error != expected_range_error) ||
+            ((parsed.error == NumberParseError::kNoDigits) != (expected_length == 0))) {
+            if (failures++ == 0) {
+                printf("  \"%s\"%s%s: expected %.9g (%d), got %.9g (%d, error %d)\n", text, end ? " with end" : "",
+                       float_only ? " (float only)" : "", expected, expected_length, parsed.value, parsed.length, (int)parsed.error);
+            }
+        }
+    }
+    return failures;
+}
+
+template <typename parse_t>
+double nanosecondsPerValue(parse_t parse) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t pass = 0; pass < kPasses; pass++) {
+        for (uint32_t i = 0; i < kCommandValues; i++) {
+            sink = sink + parse(command_values[i], command_ends[i]);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (kPasses * kCommandValues);
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    uint32_t stride = kDefaultStride;
+    if (const char *stride_env = getenv("NUMBER_PARSE_STRIDE")) {
+        stride = strtoul(stride_env, nullptr, 0);
+        if (stride == 0) {
+            stride = 1;
+        }
+    }
+
+    // Round trip
+    uint32_t round_trip_failures = 0;
+    uint32_t floats_checked = 0;
+    for (uint64_t bits = 0; bits <= 0xFFFFFFFF; bits += stride) {
+        const float value = floatFromBits(bits);
+        if (std::isnan(value)) {
+            continue;
+        }
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        const auto parsed = c_strtof(text);
+        const auto parsed_float_only = c_strtof<false>(text);
+        if ((bitsOf(parsed.value) != bits) || (bitsOf(parsed_float_only.value) != bits)) {
+            if (round_trip_failures++ < 5) {
+                printf("  0x%08" PRIx32 " \"%s\" came back as 0x%08" PRIx32 " (0x%08" PRIx32 " float only)\n", (uint32_t)bits,
+                       text, bitsOf(parsed.value), bitsOf(parsed_float_only.value));
+            }
+        }
+        floats_checked++;
+    }
+    printf("round trip: %" PRIu32 " floats, %" PRIu32 " failures\n", floats_checked, round_trip_failures);
+
+    // Odd shapes
+    const char *inputs[] = {"0", "-0", "+7", "5.", ".5", "-.5", ".", "-", "+", "", "abc", "-x", "1e", "1e+", "1e-x",
+        "1E3", "2.5e-3", "00000000000000123.4500000000", "0.000000000000000000000000000000000000000000001",
+        "123456789012345678901234567890", "3.40282347e38", "3.40282357e38", "1e39", "-1e39", "1e-46", "1e-45",
+        "1.17549435e-38", "16777217", "9007199254740993", "1e99999999999", "1e-99999999999",
+        "inf", "-INF", "Infinity", "infinit", "nan", "NaN(1)", "12345678", "1234.5678", "0.0001234", "1,2", "3 4",
+        "16777217.0000001", "1.00000005960464477550", "2.000000119209289550781251", "7.0064923216240862e-46",
+        "7.0064923216240861e-46", "1.00000005960464477539", "1.00000017881393432617", "16777219",
+        "3.40282356779733661637539395458142568448e38", "3.40282356779733661637539395458142568447e38",
+        "0.000000000000000000000000000000000000000000000700649232162408535461864791644958065640130970938257885878534141944895541342930300743319094181060791015625",
+        "4.2038953929744736e-45", "3.4028234663852885981170418348451692544e38"};
+    uint32_t shape_failures = 0;
+    for (const char *input : inputs) {
+        shape_failures += checkAgainstStrtof(input);
+    }
+    printf("odd shapes: %u inputs, %" PRIu32 " failures\n", (unsigned)(sizeof(inputs) / sizeof(inputs[0])), shape_failures);
+
+    // Halfway
+    uint32_t halfway_failures = 0;
+    uint32_t halfways_checked = 0;
+    for (uint64_t bits = 0; bits < 0x7F800000; bits += stride) {
+        const float value = floatFromBits(bits);
+        const double halfway = ((double)value + nextafterf(value, INFINITY)) / 2;
+        char text[160];
+        snprintf(text, sizeof(text), "%.120e", halfway);
+        char *exponent = strchr(text, 'e');
+        char above[168];
+        snprintf(above, sizeof(above), "%.*s00001%s", (int)(exponent - text), text, exponent);
+        char below[48];
+        snprintf(below, sizeof(below), "%.*s%s", 20, text, exponent);
+        halfway_failures += checkAgainstStrtof(text) + checkAgainstStrtof(above) + checkAgainstStrtof(below);
+        halfways_checked++;
+    }
+    printf("halfway: %" PRIu32 " floats, %" PRIu32 " failures\n", halfways_checked, halfway_failures);
+
+    // Speed: positions, feed rates and the like, with 0 to 4 decimal places
+    srand(1);
+    for (uint32_t i = 0; i < kCommandValues; i++) {
+        const float value = ((float)rand() / RAND_MAX - 0.5f) * 2000.0f;
+        snprintf(command_values[i], sizeof(command_values[i]), "%.*f", (int)(i % 5), value);
+        command_ends[i] = command_values[i] + strlen(command_values[i]);
+    }
+    uint32_t legacy_wrong = 0;
+    for (uint32_t i = 0; i < kCommandValues; i++) {
+        char *text = command_values[i];
+        legacy_wrong += (bitsOf(legacy::c_atof(text)) != bitsOf(strtof(command_values[i], nullptr)));
+    }
+    printf("command values: legacy c_atof gets %" PRIu32 " of %" PRIu32 " wrong\n", legacy_wrong, kCommandValues);
+    printf("command values: legacy c_atof %5.1f ns, c_strtof %5.1f ns, c_strtof with end %5.1f ns, strtof %5.1f ns\n",
+           nanosecondsPerValue([](char *text, const char *) { return legacy::c_atof(text); }),
+           nanosecondsPerValue([](char *text, const char *) { return c_strtof(text).value; }),
+           nanosecondsPerValue([](char *text, const char *end) { return c_strtof(text, end).value; }),
+           nanosecondsPerValue([](char *text, const char *) { return strtof(text, nullptr); }));
+
+    exit((round_trip_failures || shape_failures || halfway_failures) ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
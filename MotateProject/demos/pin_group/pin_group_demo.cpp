@@ -0,0 +1,231 @@
+/*
+ * pin_group_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/PinGroupDemo.elf
+ *
+ * Drives an 8-bit bus (in order on one port) and a group of pins spread over
+ * three ports (and out of order, with a null pin) through PinGroup, and checks
+ * every pin against its bit. Pin change interrupts on the bus show that the
+ * whole bus changes at once, then a small benchmark compares PinGroup to
+ * writing the pins one at a time.
+ */
+
+#include "MotatePins.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::Pin;
+using Motate::PinGroup;
+
+/****** Create file-global objects ******/
+
+// D33..D40 are PC1..PC8
+using Bus = PinGroup<33, 34, 35, 36, 37, 38, 39, 40>;
+static_assert(Bus::maskForPort('C') == 0x1FE, "the bus is PC1..PC8");
+static_assert(Bus::_scatterFor('C').term_count == 1, "an in-order bus is one mask and one shift");
+static_assert(Bus::toPort<'C'>(0xA5) == (0xA5 << 1), "bus bit n is PC(n+1)");
+
+// PA0, PB12, PC1, PA1, (none), PB13, PC2 -- pairs on each port
+using Mixed = PinGroup<69, 20, 33, 68, -1, 21, 34>;
+static_assert(Mixed::maskForPort('A') == 0x3, "Mixed has PA0 and PA1");
+static_assert(Mixed::maskForPort('B') == (0x3 << 12), "Mixed has PB12 and PB13");
+static_assert(Mixed::_scatterFor('A').term_count == 2, "PA0 and PA1 are bits 0 and 3, so need two shifts");
+static_assert(Mixed::toPort<'B'>(0b0100010) == ((1 << 12) | (1 << 13)), "bits 1 and 5 are PB12 and PB13");
+
+Bus bus {Motate::kOutput};
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Read the group back one pin at a time, as bits of a value
+template <Motate::pin_number... pinNums>
+static uint32_t read_pins() {
+    uint32_t value = 0;
+    uint32_t bit = 0;
+    ((value |= (Pin<pinNums>{}.getOutputValue() ? (1u << bit) : 0), bit++), ...);
+    return value;
+}
+
+// What the bus pins read on each pin change interrupt
+static uint32_t bus_seen[8];
+static uint32_t bus_interrupts = 0;
+
+struct BusWatcher {
+    uint32_t bit;
+    void operator()() {
+        bus_seen[bit] = Motate::HostPIOC.PDSR & Bus::maskForPort('C');
+        bus_interrupts++;
+    };
+};
+
+static double time_ns(void (*run)(uint32_t), const uint32_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        run(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void check_bus() {
+    for (uint32_t value = 0; value < 256; value++) {
+        bus = value;
+        if ((bus.getOutputValue() != value) || ((Motate::HostPIOC.ODSR & 0x1FE) != (value << 1)) ||
+            (read_pins<33, 34, 35, 36, 37, 38, 39, 40>() != value)) {
+            printf("FAIL: bus.write(0x%02" PRIx32 ") reads back 0x%02" PRIx32 "\n", value, bus.getOutputValue());
+            failures++;
+        }
+    }
+
+    bus.write(0x0F);
+    bus.set(0x30);
+    check(bus.getOutputValue() == 0x3F, "set() only sets the 1 bits");
+    bus.clear(0x05);
+    check(bus.getOutputValue() == 0x3A, "clear() only clears the 1 bits");
+    bus.set();
+    check(bus.getOutputValue() == 0xFF, "set() with no bits sets them all");
+    bus.clear();
+    check(bus.getOutputValue() == 0x00, "clear() with no bits clears them all");
+}
+
+static void check_mixed() {
+    Mixed mixed {Motate::kOutput};
+    Pin<31> neighbor {Motate::kOutput}; // PA7, not in the group
+    neighbor.set();
+
+    uint32_t value = 0x5A;
+    for (uint32_t i = 0; i < 1000; i++) {
+        value = value * 1103515245 + 12345;
+        const uint32_t expected = (value >> 9) & 0b1101111; // bit 4 is the null pin
+        mixed.write(value >> 9);
+        if ((mixed.getOutputValue() != expected) || (read_pins<69, 20, 33, 68, -1, 21, 34>() != expected)) {
+            printf("FAIL: mixed.write(0x%02" PRIx32 ") reads back 0x%02" PRIx32 "\n", expected, mixed.getOutputValue());
+            failures++;
+        }
+    }
+    check(neighbor.getOutputValue() != 0, "pins outside of the group are left alone");
+}
+
+static void check_simultaneous() {
+    Motate::_pinChangeInterrupt *watchers[8];
+    for (uint32_t bit = 0; bit < 8; bit++) {
+        watchers[bit] = new Motate::_pinChangeInterrupt(1u << (bit + 1), BusWatcher{bit}, Motate::PortHardware<'C'>::_interrupts);
+    }
+    Motate::PortHardware<'C'> port;
+    port.setInterrupts(Motate::kPinInterruptOnChange | Motate::kPinInterruptPriorityMedium, Bus::maskForPort('C'));
+
+    bus.clear();
+    bus_interrupts = 0;
+    bus = 0xFF;
+    bool all_at_once = (bus_interrupts == 8);
+    for (uint32_t bit = 0; bit < 8; bit++) {
+        all_at_once = all_at_once && (bus_seen[bit] == 0x1FE);
+    }
+    check(all_at_once, "every pin of the bus sees the whole new value");
+
+    // One at a time, the first pin's interrupt happens before the others change
+    bus.clear();
+    bus_interrupts = 0;
+    Pin<33> first;
+    Pin<34> second;
+    first.set();
+    second.set();
+    check(bus_interrupts == 2 && bus_seen[0] == 0x002, "one pin at a time changes one pin at a time");
+
+    port.setInterrupts(Motate::kPinInterruptsOff, Bus::maskForPort('C'));
+    for (uint32_t bit = 0; bit < 8; bit++) {
+        delete watchers[bit];
+    }
+}
+
+static void benchmark() {
+    static constexpr uint32_t kIterations = 2000000;
+
+    const double group_ns = time_ns([](uint32_t i) { bus = i; }, kIterations);
+    const double pins_ns = time_ns([](uint32_t i) {
+        Pin<33> d0; Pin<34> d1; Pin<35> d2; Pin<36> d3;
+        Pin<37> d4; Pin<38> d5; Pin<39> d6; Pin<40> d7;
+        d0.write(i & 0x01); d1.write(i & 0x02); d2.write(i & 0x04); d3.write(i & 0x08);
+        d4.write(i & 0x10); d5.write(i & 0x20); d6.write(i & 0x40); d7.write(i & 0x80);
+    }, kIterations);
+
+    // Step pulses on four "axes", two on each of two ports
+    using Steps = PinGroup<69, 68, 33, 34>;
+    const double steps_group_ns = time_ns([](uint32_t i) {
+        Steps steps;
+        steps.set(i & 0xF);
+        steps.clear(i & 0xF);
+    }, kIterations);
+    const double steps_pins_ns = time_ns([](uint32_t i) {
+        Pin<69> x; Pin<68> y; Pin<33> z; Pin<34> a;
+        if (i & 1) { x.set(); }
+        if (i & 2) { y.set(); }
+        if (i & 4) { z.set(); }
+        if (i & 8) { a.set(); }
+        if (i & 1) { x.clear(); }
+        if (i & 2) { y.clear(); }
+        if (i & 4) { z.clear(); }
+        if (i & 8) { a.clear(); }
+    }, kIterations);
+
+    printf("\nns per call (host port models included):\n");
+    printf("  8-bit bus write:      PinGroup %6.1f   one pin at a time %6.1f\n", group_ns, pins_ns);
+    printf("  4-axis step pulse:    PinGroup %6.1f   one pin at a time %6.1f\n", steps_group_ns, steps_pins_ns);
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    check_bus();
+    check_mixed();
+    check_simultaneous();
+    benchmark();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
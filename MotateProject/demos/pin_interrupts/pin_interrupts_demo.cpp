@@ -0,0 +1,296 @@
+/*
+ * pin_interrupts_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/PinInterruptsDemo.elf
+ *
+ * Checks the pin change interrupt dispatch: IRQPins on port A driven from the
+ * "outside" call just their own handlers, handlers on a table are called for
+ * exactly the bits that are set (lowest first, and in order on a shared bit),
+ * and destroying one takes it off the table. An IRQPin without a handler (its
+ * interrupt() isn't defined anywhere) has to ignore its edges, not call address 0.
+ *
+ * Then times one edge against a port with 1 to 32 handlers on it, for the
+ * table and for the linked-list walk it replaced (kept here for comparison).
+ */
+
+#include "MotatePins.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::Delegate;
+using Motate::_pinChangeInterrupt;
+using Motate::_pinChangeInterruptTable;
+
+/****** Create file-global objects ******/
+
+static constexpr Motate::pin_number kFirstPinNumber = 69;
+static constexpr Motate::pin_number kSecondPinNumber = 68;
+static constexpr Motate::pin_number kThirdPinNumber = 61;
+static constexpr Motate::pin_number kPlainPinNumber = 60;
+
+static uint32_t first_calls = 0;
+static uint32_t second_calls = 0;
+static uint32_t third_calls = 0;
+
+Motate::IRQPin<kFirstPinNumber> first_pin {[]() { first_calls++; }};
+Motate::IRQPin<kSecondPinNumber> second_pin {[]() { second_calls++; }};
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Toggle a pin from the outside, starting from low -- each call is one edge
+template <typename pin_t>
+static void toggle(pin_t &pin, const uint32_t times) {
+    for (uint32_t i = 0; i < times; i++) {
+        pin.port.simulateInput((i & 1) ? 0 : pin.mask, pin.mask);
+    }
+}
+
+// The order the handlers were called in, as (bit * 4 + which)
+static uint32_t call_order[64];
+static uint32_t call_count = 0;
+
+struct Recorder {
+    uint32_t id;
+    void operator()() {
+        if (call_count < 64) {
+            call_order[call_count] = id;
+        }
+        call_count++;
+    };
+};
+
+// The dispatch that _pinChangeInterruptTable replaced: walk every interrupt on the port
+struct LegacyInterrupt {
+    uint32_t pc_mask;
+    std::function<void(void)> interrupt_handler;
+    LegacyInterrupt *next;
+};
+
+static void __attribute__((noinline)) legacy_dispatch(LegacyInterrupt *first, const uint32_t isr) {
+    LegacyInterrupt *current = first;
+    while (current != nullptr) {
+        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
+            current->interrupt_handler();
+        }
+        current = current->next;
+    }
+}
+
+static void __attribute__((noinline)) table_dispatch(_pinChangeInterruptTable &table, const uint32_t isr) {
+    table.dispatch(isr);
+}
+
+static volatile uint32_t bench_calls = 0;
+static void bench_handler() { bench_calls = bench_calls + 1; }
+
+static void check_pins() {
+    toggle(first_pin, 10);
+    check(first_calls == 10 && second_calls == 0, "first pin edges call (only) its handler");
+
+    toggle(second_pin, 6);
+    check(first_calls == 10 && second_calls == 6, "second pin edges call (only) its handler");
+
+    // Both at once (one interrupt, two bits) -- they were both left low
+    first_pin.port.simulateInput(first_pin.mask | second_pin.mask, first_pin.mask | second_pin.mask);
+    first_pin.port.simulateInput(0, first_pin.mask | second_pin.mask);
+    check(first_calls == 12 && second_calls == 8, "two pins changing together call both handlers");
+
+    {
+        Motate::IRQPin<kThirdPinNumber> third_pin {[]() { third_calls++; }};
+        toggle(third_pin, 4);
+        check(third_calls == 4, "a pin made later is called");
+    }
+    // The IMR bit is still on, but the handler is gone
+    Motate::PortHardware<'A'>::rawPort()->drive(0, Motate::Pin<kThirdPinNumber>::mask);
+    Motate::PortHardware<'A'>::rawPort()->drive(Motate::Pin<kThirdPinNumber>::mask, Motate::Pin<kThirdPinNumber>::mask);
+    check(third_calls == 4, "a destroyed IRQPin is not called");
+
+    {
+        // No handler given, and IRQPin<kPlainPinNumber>::interrupt() is never defined
+        Motate::IRQPin<kPlainPinNumber> plain_pin;
+        toggle(plain_pin, 4);
+        check(first_calls == 12 && second_calls == 8 && third_calls == 4, "an IRQPin without a handler ignores its edges");
+    }
+
+    // Changing the handler
+    first_pin.setInterruptHandler([]() { first_calls += 100; });
+    toggle(first_pin, 1);
+    check(first_calls == 112, "setInterruptHandler replaces the handler");
+}
+
+static void check_table() {
+    _pinChangeInterruptTable table {};
+
+    _pinChangeInterrupt *on_bit[32][2] = {};
+    for (uint32_t bit = 0; bit < 32; bit += 3) {
+        on_bit[bit][0] = new _pinChangeInterrupt(1u << bit, Recorder{bit * 4}, table);
+    }
+    // A second handler on a couple of bits
+    on_bit[3][1] = new _pinChangeInterrupt(1u << 3, Recorder{3 * 4 + 1}, table);
+    on_bit[30][1] = new _pinChangeInterrupt(1u << 30, Recorder{30 * 4 + 1}, table);
+
+    // Adding the same one again does nothing
+    table.add(on_bit[0][0]);
+
+    call_count = 0;
+    table.dispatch(0xFFFFFFFF);
+    static const uint32_t expected[] = {0, 12, 13, 24, 36, 48, 60, 72, 84, 96, 108, 120, 121};
+    bool in_order = (call_count == sizeof(expected)/sizeof(expected[0]));
+    for (uint32_t i = 0; in_order && i < call_count; i++) {
+        in_order = (call_order[i] == expected[i]);
+    }
+    check(in_order, "every handler is called once, by bit and then in the order they were added");
+
+    call_count = 0;
+    table.dispatch((1u << 1) | (1u << 2) | (1u << 31));
+    check(call_count == 0, "bits without handlers are ignored");
+
+    call_count = 0;
+    table.dispatch((1u << 6) | (1u << 7));
+    check(call_count == 1 && call_order[0] == 24, "only the set bits are called");
+
+    delete on_bit[3][0];
+    call_count = 0;
+    table.dispatch(1u << 3);
+    check(call_count == 1 && call_order[0] == 13, "removing the first on a bit leaves the second");
+    check(table._mask & (1u << 3), "the bit stays in the mask while it has a handler");
+
+    delete on_bit[3][1];
+    call_count = 0;
+    table.dispatch(1u << 3);
+    check(call_count == 0 && !(table._mask & (1u << 3)), "removing the last on a bit clears it");
+
+    for (uint32_t bit = 0; bit < 32; bit++) {
+        if (bit != 3) {
+            delete on_bit[bit][0];
+            delete on_bit[bit][1];
+        }
+    }
+    check(table._mask == 0, "the table is empty when everything is removed");
+}
+
+static double time_ns(const std::function<void(void)> &edge, const uint32_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        edge();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void benchmark() {
+    static constexpr uint32_t kIterations = 2000000;
+
+    printf("\nns per edge (one bit set), by the number of handlers on the port:\n");
+    printf("%9s %10s %10s %12s\n", "handlers", "table", "list", "host PIOA");
+
+    for (uint32_t count = 1; count <= 32; count *= 2) {
+        _pinChangeInterruptTable table {};
+        _pinChangeInterrupt *handlers[32];
+        LegacyInterrupt legacy[32];
+        LegacyInterrupt *legacy_first = nullptr;
+
+        // Spread them over the port, and have the edge be on the last one -- the worst case for the list
+        uint32_t last_mask = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t mask = 1u << ((i * 32) / count);
+            handlers[i] = new _pinChangeInterrupt(mask, bench_handler, table);
+            legacy[i] = LegacyInterrupt{mask, bench_handler, legacy_first};
+            legacy_first = &legacy[i];
+            last_mask = mask;
+        }
+        // The list was added to at the end, so the first one made is first in the list
+        LegacyInterrupt *reversed = nullptr;
+        while (legacy_first != nullptr) {
+            LegacyInterrupt *next = legacy_first->next;
+            legacy_first->next = reversed;
+            reversed = legacy_first;
+            legacy_first = next;
+        }
+        legacy_first = reversed;
+
+        bench_calls = 0;
+        const double table_ns = time_ns([&]() { table_dispatch(table, last_mask); }, kIterations);
+        const double list_ns = time_ns([&]() { legacy_dispatch(legacy_first, last_mask); }, kIterations);
+        check(bench_calls == kIterations * 2, "benchmark handlers are called once per edge");
+
+        // The whole path on port A: the port model, the NVIC model, PIOA_Handler, and the table
+        _pinChangeInterrupt *port_handlers[32];
+        for (uint32_t i = 0; i < count; i++) {
+            port_handlers[i] = new _pinChangeInterrupt(1u << ((i * 32) / count), bench_handler, Motate::PortHardware<'A'>::_interrupts);
+        }
+        Motate::HostPio *pio = Motate::PortHardware<'A'>::rawPort();
+        const uint32_t saved_imr = pio->IMR;
+        pio->IMR = Motate::PortHardware<'A'>::_interrupts._mask;
+        uint32_t level = pio->PDSR & last_mask;
+        bench_calls = 0;
+        const double port_ns = time_ns([&]() { level ^= last_mask; pio->drive(level, last_mask); }, kIterations);
+        check(bench_calls == kIterations, "port A handlers are called once per edge");
+        pio->IMR = saved_imr;
+
+        printf("%9" PRIu32 " %10.1f %10.1f %12.1f\n", count, table_ns, list_ns, port_ns);
+
+        for (uint32_t i = 0; i < count; i++) {
+            delete handlers[i];
+            delete port_handlers[i];
+        }
+    }
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    check_pins();
+    check_table();
+    benchmark();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
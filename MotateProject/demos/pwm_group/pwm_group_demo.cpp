@@ -0,0 +1,176 @@
+/*
+ * pwm_group_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/PWMGroupDemo.elf
+ *
+ * Runs four PWM pins as a PWMOutputGroup, and checks that staged duty cycles
+ * wait for commit() (however many periods go by), then all change on the same
+ * period boundary of channel 0. Also checks the integer duty cycle math, and
+ * that write() won't stage over a commit that hasn't happened yet.
+ */
+
+#include "MotatePins.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::PWMOutputGroup;
+
+/****** Create file-global objects ******/
+
+// D9, D8, D7, D6 are PWM channels 4, 5, 6 and 7
+static constexpr uint32_t kFrequency = 10000;
+PWMOutputGroup<9, 8, 7, 6> outputs {kFrequency};
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// The duty cycles the outputs are running with now (not the staged ones)
+static void running(uint32_t (&duty)[4]) {
+    duty[0] = outputs.pin<0>().getExactDutyCycle();
+    duty[1] = outputs.pin<1>().getExactDutyCycle();
+    duty[2] = outputs.pin<2>().getExactDutyCycle();
+    duty[3] = outputs.pin<3>().getExactDutyCycle();
+}
+
+// Step one cycle at a time until any output changes, and note when each one did
+static bool run_until_change(uint64_t (&changed_at)[4], const uint64_t limit) {
+    uint32_t before[4], now[4];
+    running(before);
+    for (int i = 0; i < 4; i++) { changed_at[i] = 0; }
+
+    const uint64_t end = HostSim::now() + limit;
+    while (HostSim::now() < end) {
+        HostSim::advance(1);
+        running(now);
+        bool any = false;
+        for (int i = 0; i < 4; i++) {
+            if ((now[i] != before[i]) && (changed_at[i] == 0)) {
+                changed_at[i] = HostSim::now();
+                any = true;
+            }
+        }
+        if (any) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_staging() {
+    const uint32_t top = outputs.getTopValue();
+    const uint64_t period = top; // the prescaler is 1 at 10kHz
+    printf("period: %" PRIu32 " counts\n", top);
+    check(top == (SystemCoreClock / kFrequency), "the group runs at kFrequency");
+
+    // Starting the group is an update, too
+    while (outputs.isCommitPending()) {
+        HostSim::advance(1);
+    }
+
+    // Stage the pins a period and a half apart: nothing changes, for as long as it takes
+    outputs.stage(0, 0x4000);
+    HostSim::advance(period + (period / 2));
+    outputs.stage(1, 0x8000);
+    outputs.stage(2, 0xC000);
+    HostSim::advance(period * 3);
+    outputs.stage(3, 0x10000);
+    HostSim::advance(period * 2);
+
+    uint32_t duty[4];
+    running(duty);
+    check(duty[0] == 0 && duty[1] == 0 && duty[2] == 0 && duty[3] == 0, "staged duty cycles wait for commit()");
+
+    // Commit in the middle of a period, then all four change together, at the next boundary
+    HostSim::advance(period / 3);
+    outputs.commit();
+    check(outputs.isCommitPending(), "the commit is pending until the period ends");
+
+    uint64_t changed_at[4];
+    check(run_until_change(changed_at, 2 * period), "the outputs changed after commit()");
+    check(changed_at[0] == changed_at[1] && changed_at[1] == changed_at[2] && changed_at[2] == changed_at[3],
+          "every output changed on the same cycle");
+    check(outputs._master.getValue() == 0, "and that cycle is the start of a period");
+    check(!outputs.isCommitPending(), "the commit is done");
+
+    running(duty);
+    printf("after commit: %" PRIu32 ", %" PRIu32 ", %" PRIu32 ", %" PRIu32 "\n", duty[0], duty[1], duty[2], duty[3]);
+    check(duty[0] == top / 4 && duty[1] == top / 2 && duty[2] == (3 * top) / 4 && duty[3] == top, "25%, 50%, 75% and 100%, in integer math");
+}
+
+static void test_write() {
+    const uint32_t top = outputs.getTopValue();
+
+    check(outputs.write({0x1000, 0x2000, 0x3000, 0x4000}), "write() stages and commits");
+    check(!outputs.write({0, 0, 0, 0}), "write() refuses to stage over a pending commit");
+
+    uint64_t changed_at[4];
+    check(run_until_change(changed_at, 2 * top), "the outputs changed after write()");
+    check(changed_at[0] == changed_at[1] && changed_at[1] == changed_at[2] && changed_at[2] == changed_at[3],
+          "write() changes every output on the same cycle");
+
+    uint32_t duty[4];
+    running(duty);
+    check(duty[0] == top / 16 && duty[1] == top / 8 && duty[2] == (3 * top) / 16 && duty[3] == top / 4, "the refused write() changed nothing");
+
+    // Changing one pin (with stageRaw) leaves the others alone
+    outputs.stageRaw(2, 1234);
+    outputs.commit();
+    HostSim::advance(2 * top);
+    running(duty);
+    check(duty[0] == top / 16 && duty[1] == top / 8 && duty[2] == 1234 && duty[3] == top / 4, "stageRaw() changes just its pin");
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    test_staging();
+    test_write();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -0,0 +1,263 @@
+/*
+ * pwm_waveform_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/PWMWaveformDemo.elf
+ *
+ * Plays duty cycles from memory on two PWM pins with a PWMWaveformPlayer, and
+ * checks that each frame lands on its own period of channel 0: once (a WS2812-style
+ * bit pattern), looped, and streamed from two buffers that are refilled from the
+ * end-of-buffer interrupt -- one interrupt per buffer, not per period. Also checks
+ * that a refill that comes too late is counted, and the stream picks back up in order,
+ * and that more frames than a buffer's 16-bit length can hold are refused.
+ */
+
+#include "MotatePWMWaveformPlayer.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::PWMWaveformPlayer;
+
+/****** Create file-global objects ******/
+
+// D8 and D9 are PWM channels 5 and 4, so a frame is {channel 0, D9, D8}
+static constexpr uint32_t kFrequency = 10000;
+typedef PWMWaveformPlayer<8, 9> player_t;
+player_t player {kFrequency};
+
+static_assert(player_t::frameSize == 3, "channels 0, 4 and 5");
+static_assert(player_t::frameIndex(0) == 2 && player_t::frameIndex(1) == 1, "frames are in channel order, not pin order");
+
+static constexpr uint16_t kD8 = player_t::frameIndex(0);
+static constexpr uint16_t kD9 = player_t::frameIndex(1);
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Move to the middle of the next period, and return the duty cycles D8 and D9 are running with
+static uint64_t period_cycles = 0;
+static void next_period(uint32_t &d8, uint32_t &d9) {
+    const uint64_t ccnt = player.group()._master.getValue();
+    HostSim::advance((period_cycles - ccnt) + (period_cycles / 2));
+    d8 = player.group().pin<0>().getExactDutyCycle();
+    d9 = player.group().pin<1>().getExactDutyCycle();
+}
+
+static void test_play() {
+    // 0xA5, MSB first, WS2812-style: a 0 bit is high for a third of the period, a 1 for two thirds.
+    // D9 counts the bits, and the data ends with two all-zero frames.
+    const uint32_t top = player.getTopValue();
+    const uint8_t data = 0xA5;
+    uint16_t frames[10][player_t::frameSize] = {};
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        frames[bit][kD8] = ((data << bit) & 0x80) ? ((2 * top) / 3) : (top / 3);
+        frames[bit][kD9] = bit + 1;
+    }
+
+    player.play(&frames[0][0], 10);
+    check(player.isPlaying(), "play() is playing");
+
+    uint8_t decoded = 0;
+    bool in_order = true;
+    uint32_t d8, d9;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        next_period(d8, d9);
+        decoded = (decoded << 1) | ((d8 > (top / 2)) ? 1 : 0);
+        in_order &= (d9 == (uint32_t)bit + 1);
+    }
+    printf("play: decoded 0x%02X\n", decoded);
+    check(decoded == data, "the bits came out as they went in");
+    check(in_order, "one frame per period");
+
+    next_period(d8, d9);
+    next_period(d8, d9);
+    check(d8 == 0 && d9 == 0, "the all-zero frames end it");
+
+    next_period(d8, d9);
+    check(!player.isPlaying(), "play() stops at the end");
+    for (int i = 0; i < 5; i++) { next_period(d8, d9); }
+    check(d8 == 0 && d9 == 0, "and the last duty cycles hold");
+}
+
+static void test_loop() {
+    uint16_t frames[4][player_t::frameSize] = {};
+    for (uint8_t i = 0; i < 4; i++) {
+        frames[i][kD8] = 1000 * (i + 1);
+        frames[i][kD9] = 4000 - (1000 * i);
+    }
+
+    player.loop(&frames[0][0], 4);
+
+    bool matches = true;
+    uint32_t d8, d9;
+    for (uint8_t i = 0; i < 20; i++) {
+        next_period(d8, d9);
+        matches &= (d8 == frames[i % 4][kD8]) && (d9 == frames[i % 4][kD9]);
+    }
+    check(matches, "loop() repeats the frames, one per period");
+    check(player.isPlaying() && (player.underruns() == 0), "loop() plays until stop()");
+
+    player.stop();
+    const uint32_t held = d8;
+    for (int i = 0; i < 5; i++) { next_period(d8, d9); }
+    check(!player.isPlaying() && (d8 == held), "stop() holds the last duty cycle");
+}
+
+static void test_too_long() {
+    // 21846 frames of 3 is 65538 values, which is more than a buffer's 16-bit length
+    uint16_t frames[4][player_t::frameSize] = {};
+    check(player.loop(&frames[0][0], 4), "loop() takes 4 frames");
+    check(!player.play(&frames[0][0], 21846), "play() won't take more than 65535 values");
+    check(!player.loop(&frames[0][0], 0), "loop() won't take no frames");
+    check(!player.stream(&frames[0][0], &frames[2][0], 21846, nullptr), "stream() won't take more than 65535 values");
+    check(player.isPlaying(), "and what was playing keeps playing");
+    player.stop();
+}
+
+// The stream is a count on D8, and D9 is the refill that wrote it
+static constexpr uint16_t kStreamFrames = 8;
+static uint16_t stream_a[kStreamFrames][player_t::frameSize];
+static uint16_t stream_b[kStreamFrames][player_t::frameSize];
+static uint16_t stream_next = 1;
+static uint16_t stream_end = 0;
+static uint32_t refills = 0;
+
+static bool refill(uint16_t *buffer) {
+    if (stream_next >= stream_end) {
+        return false;
+    }
+    refills++;
+    for (uint16_t i = 0; i < kStreamFrames; i++) {
+        buffer[(i * player_t::frameSize) + kD8] = stream_next++;
+        buffer[(i * player_t::frameSize) + kD9] = refills;
+    }
+    return true;
+}
+
+// Watch the count on D8, starting from first, until the stream stops. Returns how many values
+// came out in order, and counts how often a value repeated (the PDC was stopped) or was skipped.
+static uint32_t watch_stream(uint32_t first, uint32_t &repeats, uint32_t &skips, uint32_t max_periods) {
+    uint32_t expect = first, in_order = 0, last = first - 1;
+    repeats = 0;
+    skips = 0;
+    uint32_t d8, d9;
+    while (player.isPlaying() && max_periods--) {
+        next_period(d8, d9);
+        if (d8 == expect) {
+            in_order++;
+            expect++;
+        } else if (d8 == last) {
+            repeats++;
+        } else {
+            skips++;
+            expect = d8 + 1;
+        }
+        last = d8;
+    }
+    return in_order;
+}
+
+static void test_stream() {
+    stream_next = 1;
+    stream_end = 1 + (6 * kStreamFrames);
+    refills = 0;
+
+    check(player.stream(&stream_a[0][0], &stream_b[0][0], kStreamFrames, refill), "stream() starts");
+
+    uint32_t repeats, skips;
+    const uint32_t in_order = watch_stream(1, repeats, skips, 100);
+    printf("stream: %" PRIu32 " values in order, %" PRIu32 " repeated, %" PRIu32 " skipped, %" PRIu32 " refills\n",
+           in_order, repeats, skips, refills);
+    check(in_order == (6 * kStreamFrames), "every value came out, in order, one per period");
+    check(repeats <= 1 && skips == 0, "with no gaps");
+    check(refills == 6, "one refill (and interrupt) per buffer, not per period");
+    check(player.underruns() == 0, "and no underruns");
+    check(!player.isPlaying(), "the stream ends when refill() has no more");
+}
+
+static void test_underrun() {
+    stream_next = 1;
+    stream_end = 1 + (6 * kStreamFrames);
+    refills = 0;
+
+    player.stream(&stream_a[0][0], &stream_b[0][0], kStreamFrames, refill);
+
+    // Keep the interrupt from running for both buffers and then some
+    uint32_t d8, d9;
+    next_period(d8, d9);
+    __disable_irq();
+    for (uint16_t i = 0; i < (2 * kStreamFrames) + 3; i++) {
+        next_period(d8, d9);
+    }
+    const uint32_t stalled = d8;
+    __enable_irq();
+
+    uint32_t repeats, skips;
+    uint32_t in_order = watch_stream(stalled + 1, repeats, skips, 100);
+    printf("underrun: stalled at %" PRIu32 ", then %" PRIu32 " values in order, %" PRIu32 " skipped, %" PRIu32 " underruns\n",
+           stalled, in_order, skips, player.underruns());
+    check(stalled == (2 * kStreamFrames), "the PDC stops when both buffers are played");
+    check(player.underruns() == 1, "the late refill is counted as an underrun");
+    check(in_order == (4 * kStreamFrames) && skips == 0, "and the stream picks up where it left off, in order");
+    check(!player.isPlaying(), "then ends");
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    period_cycles = player.getTopValue(); // the prescaler is 1 at 10kHz
+    check(period_cycles == (SystemCoreClock / kFrequency), "the player runs at kFrequency");
+
+    test_play();
+    test_loop();
+    test_too_long();
+    test_stream();
+    test_underrun();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -0,0 +1,223 @@
+/*
+ * sensor_table_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/SensorTableDemo.elf
+ *
+ * Linearizes the thermistor from demos/temperature_control with SensorTable, and
+ * compares it to computing Steinhart-Hart (with log() and pow()) on every read:
+ * the error of the table at a few sizes over 0..300ºC, and the time
+ * per conversion of each. Also builds a table from calibration points at compile
+ * time.
+ */
+
+#include "MotateSensorTable.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::SensorCalibration;
+using Motate::SensorTable;
+
+/****** Create file-global objects ******/
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// A probe calibrated at three points, in hundredths of a degree, built into a table by the compiler
+constexpr SensorCalibration<3> kProbe {{{100, -4000}, {2000, 2500}, {3900, 15000}}};
+constexpr SensorTable<65> kProbeTable {0, 4095, kProbe};
+static_assert(kProbeTable(0) == -4000 && kProbeTable(-100) == -4000, "flat below the first point, and clamped");
+static_assert(kProbeTable(kProbeTable._raw[20]) == kProbe(kProbeTable._raw[20]), "at the breakpoints, the table matches");
+static_assert(kProbeTable(1000) - kProbe(1000) <= 1 && kProbe(1000) - kProbeTable(1000) <= 1, "and it's linear between them");
+static_assert(kProbeTable(4095) == 15000 && kProbeTable(5000) == 15000, "flat above the last point, and clamped");
+
+// The thermistor from demos/temperature_control: 4.7k pullup, 3.3V, 12-bit ADC
+static constexpr float kSystemVoltage = 3.3;
+static constexpr int32_t kTop = 4095;
+
+struct Thermistor {
+    float c1, c2, c3;
+    const float pullup_resistance = 4700;
+
+    // Same as Thermistor::setup() in temperature_demo.cpp
+    Thermistor(const float temp_low, const float temp_med, const float temp_high, const float res_low, const float res_med, const float res_high) {
+        float temp_low_fixed = temp_low + 273.15;
+        float temp_med_fixed = temp_med + 273.15;
+        float temp_high_fixed = temp_high + 273.15;
+
+        float a1 = log(res_low);
+        float a2 = log(res_med);
+        float a3 = log(res_high);
+
+        float z = a1 - a2;
+        float y = a1 - a3;
+        float x = 1/temp_low_fixed - 1/temp_med_fixed;
+        float w = 1/temp_low_fixed - 1/temp_high_fixed;
+
+        float v = pow(a1,3) - pow(a2,3);
+        float u = pow(a1,3) - pow(a3,3);
+
+        c3 = (x-z*w/y)/(v-z*u/y);
+        c2 = (x-c3*v)/z;
+        c1 = 1/temp_low_fixed-c3*pow(a1,3)-c2*a1;
+    };
+
+    // Same as Thermistor::temperature_exact() in temperature_demo.cpp
+    float temperature(const int32_t raw) const {
+        float v = (float)raw * kSystemVoltage / kTop;
+        float r = (pullup_resistance * v) / (kSystemVoltage - v);
+        float lnr = log(r);
+        float Tinv = c1 + (c2*lnr) + (c3*pow(lnr,3));
+        return (1/Tinv) - 273.15;
+    };
+
+    // For filling a table, in hundredths of a degree. The ends of the range are a
+    // shorted or open thermistor, where the math blows up, so stay one count inside.
+    int32_t centidegrees(int32_t raw) const {
+        if (raw < 1) { raw = 1; }
+        if (raw > kTop - 1) { raw = kTop - 1; }
+        return lround(temperature(raw) * 100.0);
+    };
+};
+
+Thermistor thermistor {
+    /*T1:*/    25, /*T2:*/  160, /*T3:*/ 235,
+    /*R1:*/ 86500, /*R2:*/ 800, /*R3:*/ 190};
+
+// What the table is compared to: ADC counts for 0ºC .. 300ºC (it falls as temperature rises)
+static int32_t raw_hot = 0;
+static int32_t raw_cold = 0;
+
+static void find_range() {
+    for (int32_t raw = 1; raw < kTop; raw++) {
+        const float t = thermistor.temperature(raw);
+        if (raw_hot == 0 && t <= 300) { raw_hot = raw; }
+        if (t >= 0) { raw_cold = raw; }
+    }
+    printf("0..300ºC is ADC counts %" PRId32 "..%" PRId32 " (of %" PRId32 ")\n", raw_hot, raw_cold, kTop);
+}
+
+template <uint16_t points>
+static void accuracy(const float max_allowed) {
+    SensorTable<points> table {raw_hot, raw_cold, [](int32_t raw) { return thermistor.centidegrees(raw); }};
+
+    double worst = 0, total = 0, worst_counts = 0;
+    int32_t worst_raw = 0;
+    for (int32_t raw = raw_hot; raw <= raw_cold; raw++) {
+        const double error = fabs(table(raw) / 100.0 - thermistor.temperature(raw));
+        total += error;
+        if (error > worst) {
+            worst = error;
+            worst_raw = raw;
+        }
+        // The same error, in ADC counts: how far off the reading would have to be to get it with the exact math
+        const double per_count = fabs(thermistor.temperature(raw + 1) - thermistor.temperature(raw - 1)) / 2;
+        if (error / per_count > worst_counts) {
+            worst_counts = error / per_count;
+        }
+    }
+    const double mean = total / (raw_cold - raw_hot + 1);
+    int32_t closest = kTop, widest = 0;
+    for (uint16_t i = 1; i < points; i++) {
+        const int32_t apart = table._raw[i] - table._raw[i - 1];
+        if (apart < closest) { closest = apart; }
+        if (apart > widest) { widest = apart; }
+    }
+    printf("  %3u points (%2" PRId32 "..%3" PRId32 " counts apart, %4u bytes): max error %6.3fºC (at %5.1fºC), mean %6.4fºC, max %.2f counts\n",
+           points, closest, widest, (unsigned)sizeof(table), worst, thermistor.temperature(worst_raw), mean, worst_counts);
+
+    char what[64];
+    snprintf(what, sizeof(what), "%u points is within %.2fºC over 0..300ºC", points, max_allowed);
+    check(worst <= max_allowed, what);
+
+    // At the breakpoints, the lookup is the stored value
+    check(table(table._raw[points / 2]) == table._value[points / 2], "breakpoints come back exactly");
+}
+
+template <typename F>
+static double time_ns(F &&convert) {
+    static constexpr uint32_t kRounds = 200;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < kRounds; round++) {
+        for (int32_t raw = raw_hot; raw <= raw_cold; raw++) {
+            convert(raw);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (kRounds * (raw_cold - raw_hot + 1));
+}
+
+static void benchmark() {
+    static SensorTable<65> table {raw_hot, raw_cold, [](int32_t raw) { return thermistor.centidegrees(raw); }};
+    volatile float float_sink;
+    volatile int32_t table_sink;
+
+    const double float_ns = time_ns([&](int32_t raw) { float_sink = thermistor.temperature(raw); });
+    const double table_ns = time_ns([&](int32_t raw) { table_sink = table(raw); });
+
+    printf("\nns per conversion on the host: Steinhart-Hart %.1f, SensorTable<65> %.1f (%.0fx)\n",
+           float_ns, table_ns, float_ns / table_ns);
+    check(table_ns < float_ns, "the table is faster");
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    find_range();
+
+    printf("\nSensorTable error against Steinhart-Hart, over 0..300ºC:\n");
+    accuracy<33>(1.5);
+    accuracy<65>(0.4);
+    accuracy<129>(0.1);
+    accuracy<257>(0.03);
+
+    benchmark();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -0,0 +1,178 @@
+/*
+ * service_call_latency_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/ServiceCallLatencyDemo.elf
+ *
+ * Host-only: it times the dispatch with the host's clock.
+ *
+ * A ServiceCall at the highest priority queues a burst of kPending ServiceCalls,
+ * spread across all five priorities and queued in a scrambled order. None of them
+ * can run until the burst handler returns, so they are all pending at once. Then
+ * PendSV dispatches them one at a time, and we time the gap between each handler
+ * and the next -- the dispatch latency -- and check that they ran highest priority
+ * first, and in the order queued within a priority.
+ *
+ * The same is done with a single call pending, for comparison: with the ready
+ * queue, the dispatch latency doesn't depend on how many calls are pending.
+ *
+ * "worst" is the slowest dispatch of any burst, and on a desktop OS that's
+ * usually the process being scheduled out. "typical worst" is the median over
+ * the bursts of the slowest dispatch in each burst, which is a steadier number.
+ */
+
+#if !defined(__HOST_SIM__)
+#error The service_call_latency demo requires BOARD=host
+#endif
+
+#include "MotateServiceCall.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kPending = 32;
+static constexpr uint32_t kRounds = 20000;
+
+static constexpr uint32_t kPriorities[] = {
+    Motate::kInterruptPriorityHighest, Motate::kInterruptPriorityHigh, Motate::kInterruptPriorityMedium,
+    Motate::kInterruptPriorityLow, Motate::kInterruptPriorityLowest,
+};
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+time_point last_return;                   // when the last handler (or the burst) returned
+std::vector<std::chrono::nanoseconds> latencies;
+uint32_t calls_made = 0;
+uint32_t order_errors = 0;
+int32_t last_priority = 0;
+uint32_t last_sequence = 0;
+
+struct Job : Motate::ServiceCallEventHandler {
+    Motate::ServiceCall call;
+    int32_t priority;
+    uint32_t sequence = 0;              // position in the burst
+
+    void init(const int32_t _priority) {
+        priority = _priority;
+        call.setInterruptHandler(this);
+        call.setInterrupts(kPriorities[priority]);
+    };
+
+    void handleServiceCallEvent() override {
+        latencies.push_back(std::chrono::steady_clock::now() - last_return);
+
+        // Highest priority (lowest number) first, then in the order queued
+        if ((calls_made > 0) && ((priority < last_priority) ||
+                                 ((priority == last_priority) && (sequence < last_sequence)))) {
+            order_errors++;
+        }
+        last_priority = priority;
+        last_sequence = sequence;
+        calls_made++;
+
+        last_return = std::chrono::steady_clock::now();
+    };
+};
+
+Job jobs[kPending];
+
+struct Burst : Motate::ServiceCallEventHandler {
+    Motate::ServiceCall call;
+    uint32_t count = 0;
+
+    Burst() {
+        call.setInterruptHandler(this);
+        call.setInterrupts(Motate::kInterruptPriorityHighest);
+    };
+
+    void handleServiceCallEvent() override {
+        calls_made = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            // 7 is coprime with kPending, so this visits every job, out of order
+            Job &job = jobs[(i * 7) % kPending];
+            job.sequence = i;
+            job.call.call();
+        }
+        last_return = std::chrono::steady_clock::now();
+    };
+} burst;
+
+void run(const uint32_t count) {
+    latencies.clear();
+    latencies.reserve(kRounds * count);
+    order_errors = 0;
+
+    std::vector<std::chrono::nanoseconds> round_worsts;
+    round_worsts.reserve(kRounds);
+
+    uint32_t missing = 0;
+    burst.count = count;
+    for (uint32_t round = 0; round < kRounds; round++) {
+        const size_t first = latencies.size();
+        burst.call.call();  // from "thread mode", so this doesn't return until everything ran
+        missing += count - calls_made;
+        round_worsts.push_back(*std::max_element(latencies.begin() + first, latencies.end()));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(round_worsts.begin(), round_worsts.end());
+    printf("%2" PRIu32 " pending: median %4" PRId64 " ns, typical worst %4" PRId64 " ns, worst %7" PRId64 " ns (%" PRIu32
+           " out of order, %" PRIu32 " missing)\n",
+           count, (int64_t)latencies[latencies.size() / 2].count(),
+           (int64_t)round_worsts[round_worsts.size() / 2].count(), (int64_t)latencies.back().count(),
+           order_errors, missing);
+
+    if (order_errors || missing) {
+        exit(1);
+    }
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    for (uint32_t i = 0; i < kPending; i++) {
+        jobs[i].init(i % 5);
+    }
+
+    run(1);
+    run(kPending);
+
+    exit(0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
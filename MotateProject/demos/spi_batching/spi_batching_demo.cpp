@@ -0,0 +1,234 @@
+/*
+ * spi_batching_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/SpiBatchingDemo.elf
+ *
+ * Runs transactions of 1, 4, and 16 messages (five bytes each, like a stepper
+ * driver's datagrams) to one device on the simulated SPI bus, and checks that the
+ * callbacks come in order, that CS is held across the whole transaction, and that
+ * every byte came back from the slave.
+ *
+ * Each transaction is run twice: with all of its messages queued together, so the
+ * bus can chain them into one transfer (two at a time, on the simulated PDC), and
+ * with each message queued from the callback of the one before it, so it can't.
+ *
+ * For each we report the messages per second the driver can push, and how often
+ * (and for how long) the bus sat idle with CS held waiting for the software to
+ * start the next transfer. The simulated clock doesn't charge for the time the
+ * software takes, so both of those are timed with the host's clock.
+ */
+
+#include "MotatePins.h"
+#include "MotateSPI.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostSPI0;
+using Motate::SPIMessage;
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+/****** Create file-global objects ******/
+
+Motate::SPIBus<Motate::kSPI_MISOPinNumber, Motate::kSPI_MOSIPinNumber, Motate::kSPI_SCKPinNumber> spiBus;
+auto spiDevice = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS0PinNumber>{},
+                                  4000000,                                   // baud
+                                  Motate::kSPIMode0 | Motate::kSPI8Bit,      // options
+                                  0,                                         // min_between_cs_delay_ns
+                                  0,                                         // cs_to_sck_delay_ns
+                                  0);                                        // between_word_delay_ns
+
+static constexpr uint8_t kMaxMessages = 16;
+static constexpr uint8_t kMessageSize = 5;
+static constexpr uint32_t kRounds = 20000;
+
+static SPIMessage messages[kMaxMessages];
+static uint8_t tx_buffers[kMaxMessages][kMessageSize];
+static uint8_t rx_buffers[kMaxMessages][kMessageSize];
+
+static uint8_t message_count = 0;     // messages in this transaction
+static bool queue_together = true;    // false: each message is queued from the last one's callback
+static volatile uint8_t callbacks = 0; // callbacks seen in this transaction
+static bool out_of_order = false;
+
+// CS-idle tracking, from HostSPI0.clocking
+static bool gap_open = false;
+static time_point gap_start;
+static uint32_t gaps = 0;
+static std::chrono::nanoseconds cs_idle {0};
+static uint32_t deselects = 0;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/****** The transactions ******/
+
+static void queue(const uint8_t i) {
+    const bool last = (i == message_count - 1);
+    messages[i].setup(tx_buffers[i], rx_buffers[i], kMessageSize,
+                      last ? SPIMessage::DeassertAfter : SPIMessage::RemainAsserted,
+                      last ? SPIMessage::EndTransaction : SPIMessage::KeepTransaction);
+    spiDevice.queueMessage(&messages[i]);
+}
+
+static void runTransaction(const uint32_t round) {
+    callbacks = 0;
+    for (uint8_t i = 0; i < message_count; i++) {
+        for (uint8_t j = 0; j < kMessageSize; j++) {
+            tx_buffers[i][j] = round + i * kMessageSize + j;
+            rx_buffers[i][j] = 0;
+        }
+    }
+
+    if (queue_together) {
+        // Hold off the bus until they're all queued
+        __disable_irq();
+        for (uint8_t i = 0; i < message_count; i++) {
+            queue(i);
+        }
+        __enable_irq();
+    } else {
+        queue(0);
+    }
+
+    while (callbacks < message_count) {
+        HostSim::idle();
+    }
+}
+
+struct Result {
+    double messages_per_second;
+    double gaps_per_transaction;
+    double cs_idle_ns_per_transaction;
+};
+
+static Result run(const uint8_t count, const bool together) {
+    message_count = count;
+    queue_together = together;
+    out_of_order = false;
+
+    gaps = 0;
+    cs_idle = std::chrono::nanoseconds{0};
+    deselects = 0;
+
+    bool data_ok = true;
+    const time_point start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < kRounds; round++) {
+        runTransaction(round);
+
+        for (uint8_t i = 0; i < message_count; i++) {
+            for (uint8_t j = 0; j < kMessageSize; j++) {
+                data_ok &= (rx_buffers[i][j] == (uint8_t)~tx_buffers[i][j]);
+            }
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    check(data_ok, "every byte came back from the slave");
+    check(!out_of_order, "callbacks are in the order the messages were queued");
+    check(deselects == kRounds, "CS is held across each transaction");
+
+    // The simulated PDC chains two messages at a time
+    const uint32_t expected_gaps = together ? ((count + 1) / 2 - 1) : (count - 1);
+    check(gaps == kRounds * expected_gaps, "the bus only waits on the software between chains");
+
+    return {
+        (kRounds * count) / elapsed.count(),
+        (double)gaps / kRounds,
+        (double)cs_idle.count() / kRounds
+    };
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    spiBus.init();
+
+    HostSPI0.slave = [](uint8_t cs, uint16_t mosi) -> uint16_t { return (uint8_t)~mosi; };
+    HostSPI0.deselected = [](uint8_t cs) {
+        gap_open = false;
+        deselects++;
+    };
+    HostSPI0.clocking = [](bool active) {
+        const time_point now = std::chrono::steady_clock::now();
+        if (!active) {
+            gap_open = true;
+            gap_start = now;
+        } else if (gap_open) {
+            gap_open = false;
+            gaps++;
+            cs_idle += now - gap_start;
+        }
+    };
+
+    for (uint8_t i = 0; i < kMaxMessages; i++) {
+        messages[i].message_done_callback = [i]() {
+            if (i != callbacks) {
+                out_of_order = true;
+            }
+            callbacks = callbacks + 1;
+            if (!queue_together && (i + 1 < message_count)) {
+                queue(i + 1);
+            }
+        };
+    }
+
+    printf("%" PRIu32 " transactions of each size, %u bytes per message\n\n", kRounds, kMessageSize);
+    printf("messages  queued       messages/s  restarts/transaction  CS idle ns/transaction\n");
+    for (const uint8_t count : {1, 4, 16}) {
+        for (const bool together : {true, false}) {
+            const Result r = run(count, together);
+            printf("%8u  %-10s %12.0f  %20.1f  %22.1f\n", count, together ? "together" : "one by one",
+                   r.messages_per_second, r.gaps_per_transaction, r.cs_idle_ns_per_transaction);
+        }
+    }
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -0,0 +1,321 @@
+/*
+ * spi_stream_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/SpiStreamDemo.elf
+ *
+ * Streams frames from a simulated sensor on the SPI bus, the slave answering each byte
+ * with the next value of a counter, so every frame says where in the stream it came from.
+ *
+ * Free-running, the frames have to come back to back (the clock never stops and CS stays
+ * down), in order, with the right data. With the reader stalled, the oldest frames have
+ * to be dropped and counted. With the interrupt held off until the DMA runs dry, the
+ * ring has to start over, dropping what wasn't read. Timer-paced, there has to be one
+ * frame per tick, with CS
+ * released after each one. A message queued for another device while a stream has the
+ * bus has to wait for stop(), then go out.
+ */
+
+#include "MotatePins.h"
+#include "MotateSPI.h"
+#include "MotateSPIStream.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostSPI0;
+using Motate::SPIMessage;
+using Motate::SPIStream;
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kSPIBaud = 4000000;
+static constexpr uint16_t kSPIOptions = Motate::kSPIMode0 | Motate::kSPI8Bit;
+
+typedef Motate::SPIBus<Motate::kSPI_MISOPinNumber, Motate::kSPI_MOSIPinNumber, Motate::kSPI_SCKPinNumber> bus_t;
+bus_t spiBus;
+auto sensor = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS0PinNumber>{}, kSPIBaud, kSPIOptions, 0, 0, 0);
+auto other = spiBus.getDevice(Motate::SPIChipSelectPin<Motate::kSPI_CS1PinNumber>{}, kSPIBaud, kSPIOptions, 0, 0, 0);
+
+static constexpr uint16_t kFrameSize = 16;
+static constexpr uint8_t kFrameCount = 8;
+SPIStream<bus_t, kFrameSize, kFrameCount> freeRunning {sensor};
+
+static constexpr uint8_t kTimer = 3;
+static constexpr uint32_t kFramesPerSecond = 2000;
+SPIStream<bus_t, 6, 4, kTimer> paced {sensor, kFramesPerSecond};
+MOTATE_SPI_STREAM_INTERRUPT(kTimer, paced)
+
+static const uint8_t kCommand[] = {0xA5, 0x5A};
+
+// The slave: each byte it's sent must be the command (then zeros), and it answers with a counter
+static uint8_t counter = 0;
+static uint32_t bytes_in_frame = 0;
+static uint16_t frame_size = kFrameSize;
+static bool tx_ok = true;
+
+// From the HostSPI0 hooks
+static uint32_t deselects[4] = {};
+static uint32_t stops = 0; // the clock stopped, with nothing queued behind
+
+static uint32_t callbacks = 0;
+static bool sequence_ok = true;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/****** The tests ******/
+
+// Frame n (counting from one) of a stream that started with the counter at first
+static bool frameIs(const uint8_t *frame, const uint16_t size, const uint32_t n, const uint8_t first) {
+    for (uint16_t i = 0; i < size; i++) {
+        if (frame[i] != (uint8_t)(first + (n - 1) * size + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void resetCounts(const uint16_t size) {
+    frame_size = size;
+    bytes_in_frame = 0;
+    memset(deselects, 0, sizeof(deselects));
+    stops = 0;
+    callbacks = 0;
+    sequence_ok = true;
+    tx_ok = true;
+}
+
+static void testFreeRunning() {
+    static constexpr uint32_t kFrames = 2000;
+    resetCounts(kFrameSize);
+
+    freeRunning.setTxFrame(kCommand, sizeof(kCommand));
+    const uint8_t first = counter;
+    check(freeRunning.start([](const decltype(freeRunning)::frame_t &frame) {
+        sequence_ok &= (frame.sequence == ++callbacks);
+    }), "start() a stream");
+    check(freeRunning.start(), "start() is harmless while running");
+
+    uint8_t frame[kFrameSize];
+    uint32_t read = 0;
+    bool data_ok = true;
+    const uint64_t started = HostSim::now(); // the bus was free, so the first frame started with start()
+    while (read < kFrames) {
+        HostSim::idle();
+        while (freeRunning.readFrame(frame)) {
+            read++;
+            data_ok &= frameIs(frame, kFrameSize, read, first);
+        }
+    }
+    const uint64_t elapsed = HostSim::now() - started;
+
+    check(freeRunning.isStreaming(), "the stream has the bus");
+    check(data_ok, "every frame was read, in order, with the slave's data");
+    check(sequence_ok, "the callbacks have the frames in order");
+    check(tx_ok, "every frame sent the command");
+    check(stops == 0, "the clock never stopped between frames");
+    check(deselects[0] == 0, "CS is held for the whole stream");
+    check((freeRunning.overruns() == 0) && (freeRunning.restarts() == 0), "no frames were dropped");
+
+    const uint32_t frames = freeRunning.frames();
+    const uint64_t wire = (uint64_t)frames * kFrameSize * 8 * (SystemCoreClock / kSPIBaud);
+    check(elapsed <= wire, "frames are clocked back to back");
+    printf("free-running: %" PRIu32 " frames of %u bytes in %.1f ms, %.1f%% of the wire rate\n",
+           frames, kFrameSize, elapsed / (SystemCoreClock / 1000.0), (100.0 * wire) / elapsed);
+
+    // Stall the reader: only the newest frames are kept
+    const uint32_t before = freeRunning.frames();
+    while (freeRunning.frames() < before + 100) {
+        HostSim::idle();
+    }
+    const uint32_t kept = kFrameCount - decltype(freeRunning)::framesInFlight;
+    check(freeRunning.available() == kept, "a stalled reader keeps the frames that aren't in the DMA's way");
+    check(freeRunning.overruns() == freeRunning.frames() - read - kept, "dropped frames are counted");
+
+    const uint32_t done = freeRunning.frames();
+    read = done - freeRunning.available();
+    data_ok = true;
+    while (freeRunning.readFrame(frame)) {
+        read++;
+        data_ok &= frameIs(frame, kFrameSize, read, first);
+    }
+    check(data_ok && (read >= done), "the frames kept are the newest, in order");
+    printf("stalled reader: %" PRIu32 " frames kept, %" PRIu32 " dropped\n", kept, freeRunning.overruns());
+
+    // A message for another device waits for the stream
+    static uint8_t tx[4] = {1, 2, 3, 4};
+    static uint8_t rx[4];
+    static volatile bool message_done = false;
+    static SPIMessage message;
+    message.setup(tx, rx, sizeof(tx), SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+    message.message_done_callback = []() { message_done = true; };
+    check(other.queueMessage(&message), "queue a message during the stream");
+    for (uint32_t i = 0; i < 100; i++) {
+        HostSim::idle();
+    }
+    check(!message_done, "the message waits while the stream has the bus");
+
+    freeRunning.stop();
+    check(!freeRunning.isRunning() && (stops == 1), "stop() stops the clock at once");
+    check(deselects[0] == 1, "stop() releases CS");
+    for (uint32_t i = 0; (i < 1000) && !message_done; i++) {
+        HostSim::idle();
+    }
+    check(message_done, "the message goes out after stop()");
+    check(deselects[1] == 1, "the message had CS to itself");
+    counter += sizeof(tx);
+}
+
+static void testRunDry() {
+    resetCounts(kFrameSize);
+
+    check(freeRunning.start(), "start() the stream again");
+    uint8_t frame[kFrameSize];
+    uint32_t read = 0;
+    while (freeRunning.frames() < 10) {
+        HostSim::idle();
+        while (freeRunning.readFrame(frame)) {
+            read++;
+        }
+    }
+
+    // Hold off the interrupt past the frames the DMA has queued, so it stops
+    const uint64_t frame_time = (uint64_t)kFrameSize * 8 * (SystemCoreClock / kSPIBaud);
+    __disable_irq();
+    HostSim::advance(frame_time * 4);
+    __enable_irq();
+    check(freeRunning.restarts() == 1, "the ring starts over when the DMA runs dry");
+    check(freeRunning.available() == 0, "the frames that weren't read are dropped");
+
+    // And it keeps going, every frame read or dropped
+    const uint32_t restarted_at = freeRunning.frames();
+    bool data_ok = true;
+    while (freeRunning.frames() < restarted_at + 20) {
+        HostSim::idle();
+        for (uint32_t i = 0; (i < 2 * kFrameCount) && freeRunning.readFrame(frame); i++) {
+            read++;
+            for (uint16_t j = 1; j < kFrameSize; j++) {
+                data_ok &= (frame[j] == (uint8_t)(frame[j - 1] + 1));
+            }
+        }
+    }
+    freeRunning.stop();
+    while (freeRunning.readFrame(frame) && (read <= freeRunning.frames())) {
+        read++;
+    }
+    check(data_ok, "the frames after the restart have the slave's data");
+    check(freeRunning.available() == 0, "the rest can be read after stop()");
+    check(read + freeRunning.overruns() == freeRunning.frames(), "every frame was read or dropped, once");
+    printf("run dry: %" PRIu32 " restart, %" PRIu32 " frames dropped\n", freeRunning.restarts(), freeRunning.overruns());
+}
+
+static void testPaced() {
+    static constexpr uint32_t kMilliseconds = 50;
+    resetCounts(6);
+
+    paced.setTxFrame(kCommand, sizeof(kCommand));
+    const uint8_t first = counter;
+    check(paced.getFrameRate() == kFramesPerSecond, "the timer runs at the frame rate");
+    check(paced.start([](const decltype(paced)::frame_t &frame) {
+        sequence_ok &= (frame.sequence == ++callbacks);
+    }), "start() a paced stream");
+
+    uint8_t frame[6];
+    uint32_t read = 0;
+    bool data_ok = true;
+    const uint64_t end = HostSim::now() + HostSim::cyclesFromMicroseconds(kMilliseconds * 1000);
+    while (HostSim::now() < end) {
+        HostSim::idle();
+        while (paced.readFrame(frame)) {
+            read++;
+            data_ok &= frameIs(frame, 6, read, first);
+        }
+    }
+    const uint32_t released = deselects[0];
+    paced.stop();
+
+    const uint32_t expected = (kFramesPerSecond * kMilliseconds) / 1000;
+    const uint32_t frames = paced.frames();
+    check((frames + 1 >= expected) && (frames <= expected), "one frame per tick");
+    check(read == frames, "every frame was read");
+    check(data_ok, "the frames have the slave's data, in order");
+    check(sequence_ok && (callbacks == frames), "a callback for each frame");
+    check(tx_ok, "every frame sent the command");
+    check(released == frames, "CS is released after each frame");
+    check((paced.missedTicks() == 0) && (paced.overruns() == 0), "no ticks were missed");
+    printf("paced: %" PRIu32 " frames in %" PRIu32 " ms at %" PRIu32 " frames/s\n", frames, kMilliseconds, kFramesPerSecond);
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    spiBus.init();
+
+    HostSPI0.slave = [](uint8_t cs, uint16_t mosi) -> uint16_t {
+        if (cs == 0) {
+            const uint32_t i = bytes_in_frame++ % frame_size;
+            tx_ok &= (mosi == ((i < sizeof(kCommand)) ? kCommand[i] : 0));
+        }
+        return counter++;
+    };
+    HostSPI0.deselected = [](uint8_t cs) {
+        deselects[cs & 3]++;
+    };
+    HostSPI0.clocking = [](bool active) {
+        if (!active) {
+            stops++;
+        }
+    };
+
+    testFreeRunning();
+    testRunDry();
+    testPaced();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
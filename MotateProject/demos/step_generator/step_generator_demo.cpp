@@ -0,0 +1,316 @@
+/*
+ * step_generator_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/StepGeneratorDemo.elf
+ *
+ * Runs three axes from a StepGenerator at a 100kHz tick, and watches the step and
+ * direction pins (with pin change interrupts) on the simulated timeline: every step
+ * is counted and timed to the cycle, against the segments that were queued. Reports
+ * the DDA's step-to-step jitter, then the extra jitter from critical sections in the
+ * main loop, checks that the timer stops when the queue runs dry, and benchmarks the
+ * cost of a tick (on this machine) for one to six axes.
+ */
+
+#include "MotateStepGenerator.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostTC;
+using Motate::PinGroup;
+using Motate::StepGenerator;
+
+/****** Create file-global objects ******/
+
+// Steps on D33..D35 (PC1..PC3), directions on D36..D38 (PC4..PC6)
+static constexpr uint8_t kTimer = 3;
+static constexpr uint32_t kTickFrequency = 100000;
+typedef StepGenerator<kTimer, PinGroup<33, 34, 35>, PinGroup<36, 37, 38>> steppers_t;
+steppers_t steppers {kTickFrequency};
+MOTATE_STEP_GENERATOR_INTERRUPT(kTimer, steppers)
+
+static uint64_t tick_cycles = 0;
+static uint64_t pulse_cycles = 0;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// What the pins did, from their pin change interrupts
+struct AxisLog {
+    static constexpr uint32_t kMaxSteps = 32768;
+    uint64_t rises[kMaxSteps];
+    bool forward[kMaxSteps];   // the direction pin, at each rise
+    uint32_t steps = 0;
+    uint64_t last_rise = 0;
+    uint64_t min_width = UINT64_MAX, max_width = 0;
+    uint64_t last_direction_change = 0;
+    uint64_t min_setup = UINT64_MAX;  // direction change to the next rise
+    bool direction_changed = false;
+
+    void clear() { *this = AxisLog{}; };
+};
+static AxisLog logs[3];
+
+struct StepWatcher {
+    uint8_t axis;
+    void operator()() {
+        AxisLog &log = logs[axis];
+        const uint64_t now = HostSim::now();
+        if (Motate::HostPIOC.PDSR & (1u << (axis + 1))) {
+            if (log.steps < AxisLog::kMaxSteps) {
+                log.rises[log.steps] = now;
+                log.forward[log.steps] = Motate::HostPIOC.PDSR & (1u << (axis + 4));
+            }
+            log.steps++;
+            log.last_rise = now;
+            if (log.direction_changed) {
+                log.min_setup = std::min(log.min_setup, now - log.last_direction_change);
+                log.direction_changed = false;
+            }
+        } else {
+            log.min_width = std::min(log.min_width, now - log.last_rise);
+            log.max_width = std::max(log.max_width, now - log.last_rise);
+        }
+    };
+};
+struct DirectionWatcher {
+    uint8_t axis;
+    void operator()() {
+        logs[axis].last_direction_change = HostSim::now();
+        logs[axis].direction_changed = true;
+    };
+};
+
+static void watch_pins() {
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        new Motate::_pinChangeInterrupt(1u << (axis + 1), StepWatcher{axis}, Motate::PortHardware<'C'>::_interrupts);
+        new Motate::_pinChangeInterrupt(1u << (axis + 4), DirectionWatcher{axis}, Motate::PortHardware<'C'>::_interrupts);
+    }
+    Motate::PortHardware<'C'> port;
+    port.setInterrupts(Motate::kPinInterruptOnChange | Motate::kPinInterruptPriorityLow, 0x7E);
+}
+
+static void run_until_idle() {
+    do {
+        HostSim::advance(100 * tick_cycles);
+    } while (!steppers.isIdle());
+}
+
+// The cycles from the tick before to each rise -- how late the step interrupt was
+static uint64_t lateness(const uint64_t rise) {
+    return (rise - HostTC[kTimer].start_cycle) % tick_cycles;
+}
+
+// The largest difference between an interval between steps and the ideal one, steps first..last
+static double interval_jitter(const AxisLog &log, const uint32_t first, const uint32_t last, const double ideal) {
+    double worst = 0;
+    for (uint32_t i = first + 1; i <= last; i++) {
+        const double error = (double)(log.rises[i] - log.rises[i - 1]) - ideal;
+        worst = std::max(worst, (error < 0) ? -error : error);
+    }
+    return worst;
+}
+
+static void test_segments() {
+    for (AxisLog &log : logs) { log.clear(); }
+
+    // Forward, then a pause on X with Y at full speed, then X back
+    check(steppers.push(1000, {1000, 500, -333}), "push the first segment");
+    check(steppers.push(200, {0, 200, 7}), "push the second segment");
+    check(steppers.push(500, {-250, 1, 0}), "push the third segment");
+    check(!steppers.push(10, {11, 0, 0}), "more than one step per tick is refused");
+    check(!steppers.isIdle(), "push() starts the timer");
+
+    run_until_idle();
+
+    printf("segments: %" PRIu32 ", %" PRIu32 ", %" PRIu32 " steps, at %" PRId32 ", %" PRId32 ", %" PRId32 "\n",
+           logs[0].steps, logs[1].steps, logs[2].steps,
+           steppers.getPosition(0), steppers.getPosition(1), steppers.getPosition(2));
+    check(logs[0].steps == 1250 && logs[1].steps == 701 && logs[2].steps == 340, "every step came out");
+    check(steppers.getPosition(0) == 750 && steppers.getPosition(1) == 701 && steppers.getPosition(2) == -326,
+          "and the positions add up");
+    check(steppers.segmentsDone() == 3, "three segments done");
+
+    bool directions_right = true;
+    for (uint32_t i = 0; i < 1250; i++) { directions_right &= (logs[0].forward[i] == (i < 1000)); }
+    for (uint32_t i = 0; i < 701; i++)  { directions_right &= logs[1].forward[i]; }
+    for (uint32_t i = 0; i < 340; i++)  { directions_right &= (logs[2].forward[i] == (i >= 333)); }
+    check(directions_right, "every step has its segment's direction");
+
+    uint64_t min_setup = UINT64_MAX, late = 0;
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        check(logs[axis].min_width == pulse_cycles && logs[axis].max_width == pulse_cycles, "every pulse is 1us wide");
+        min_setup = std::min(min_setup, logs[axis].min_setup);
+        for (uint32_t i = 0; i < logs[axis].steps; i++) { late = std::max(late, lateness(logs[axis].rises[i])); }
+    }
+    check(late == 0, "every step is on a tick");
+    printf("direction setup: at least %" PRIu64 " cycles before the next step\n", min_setup);
+    check(min_setup >= tick_cycles - pulse_cycles, "the direction changes a tick (less the pulse) before the step");
+
+    // Y is at half speed and Z at a third in the first segment, so Z's intervals are 3 or 4 ticks.
+    // The steps are within a tick of the ideal spacing, and always on a tick.
+    printf("DDA jitter, first segment (ideal interval, worst error in cycles):\n");
+    printf("  X %5.0f  %4.0f\n", 1.0 * tick_cycles, interval_jitter(logs[0], 0, 999, tick_cycles));
+    printf("  Y %5.0f  %4.0f\n", 2.0 * tick_cycles, interval_jitter(logs[1], 0, 499, 2.0 * tick_cycles));
+    const double z_ideal = (1000.0 / 333.0) * tick_cycles;
+    const double z_jitter = interval_jitter(logs[2], 0, 332, z_ideal);
+    printf("  Z %5.0f  %4.0f\n", z_ideal, z_jitter);
+    check(interval_jitter(logs[0], 0, 999, tick_cycles) < 1 && interval_jitter(logs[1], 0, 499, 2.0 * tick_cycles) < 1,
+          "whole-tick intervals are exact");
+    check(z_jitter < tick_cycles, "the rest are within a tick");
+}
+
+static void test_critical_sections() {
+    for (AxisLog &log : logs) { log.clear(); }
+    steppers.setPosition(0, 0);
+
+    // A long move, while the main loop turns interrupts off for up to 80 cycles (just under
+    // the pulse width) at random, every 5-55us. Each late step's pulse is that much shorter.
+    check(steppers.push(20000, {20000, 10000, -5000}), "push a long segment");
+    uint32_t seed = 1;
+    uint32_t sections = 0;
+    while (!steppers.isIdle()) {
+        seed = seed * 1103515245 + 12345;
+        HostSim::advance(420 + ((seed >> 8) % 4200));
+        seed = seed * 1103515245 + 12345;
+        __disable_irq();
+        HostSim::advance((seed >> 8) % 81);
+        __enable_irq();
+        sections++;
+    }
+
+    uint64_t worst = 0, total = 0;
+    uint32_t late_steps = 0, count = 0;
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        for (uint32_t i = 0; i < std::min(logs[axis].steps, AxisLog::kMaxSteps); i++) {
+            const uint64_t late = lateness(logs[axis].rises[i]);
+            worst = std::max(worst, late);
+            total += late;
+            late_steps += (late > 0) ? 1 : 0;
+            count++;
+        }
+    }
+    printf("critical sections: %" PRIu32 " of them, %" PRIu32 " of %" PRIu32 " steps late, worst %" PRIu64
+           " cycles, mean %.2f, narrowest pulse %" PRIu64 " cycles\n",
+           sections, late_steps, count, worst, (double)total / count,
+           std::min(logs[0].min_width, std::min(logs[1].min_width, logs[2].min_width)));
+    check(logs[0].steps == 20000 && logs[1].steps == 10000 && logs[2].steps == 5000, "no steps lost");
+    check(steppers.getPosition(0) == 20000, "and the position is right");
+    check(worst <= 80, "no step is later than the longest critical section");
+}
+
+static void test_idle() {
+    check(steppers.isIdle() && !HostTC[kTimer].clock_enabled, "the timer stops when the queue is empty");
+
+    for (AxisLog &log : logs) { log.clear(); }
+    HostSim::advance(12345);
+    const uint64_t pushed = HostSim::now();
+    check(steppers.push(4, {4, 0, 0}), "push after idle");
+    check(HostTC[kTimer].clock_enabled, "push() restarts the timer");
+    run_until_idle();
+    check(logs[0].steps == 4, "the steps come out after a restart");
+    check(logs[0].rises[0] - pushed == tick_cycles, "the first one a tick after push()");
+
+    // Filling the queue
+    steppers.stop();
+    uint32_t pushes = 0;
+    while (steppers.push(1000, {1, 1, 1})) { pushes++; }
+    printf("idle: first step %" PRIu64 " cycles after push(), queue holds %" PRIu32 " segments\n",
+           logs[0].rises[0] - pushed, pushes);
+    check(pushes == 15, "a full queue refuses more");
+    steppers.stop();
+    check(steppers.isIdle() && !HostTC[kTimer].clock_enabled, "stop() stops");
+}
+
+// The cost of one tick (and the end of its pulse) with every axis stepping
+template <typename generator_t>
+static void benchmark(generator_t &generator) {
+    static constexpr uint32_t kIterations = 2000000;
+    int32_t steps[generator_t::axes];
+    for (auto &s : steps) { s = 1 << 30; }
+    generator.push(1u << 30, steps);
+    generator._tick(); // the direction
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kIterations; i++) {
+        generator._tick();
+        generator._pulseEnd();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    generator.stop();
+
+    const double ns = elapsed.count() / kIterations;
+    printf("  %u axes  %6.1f ns/tick  %8.0f kHz\n", generator_t::axes, ns, 1000000.0 / ns);
+}
+
+StepGenerator<4, PinGroup<33>, PinGroup<39>> bench1 {kTickFrequency};
+StepGenerator<5, PinGroup<33, 34>, PinGroup<39, 40>> bench2 {kTickFrequency};
+StepGenerator<6, PinGroup<33, 34, 35, 36>, PinGroup<39, 40, 69, 68>> bench4 {kTickFrequency};
+StepGenerator<7, PinGroup<33, 34, 35, 36, 37, 38>, PinGroup<39, 40, 69, 68, 20, 21>> bench6 {kTickFrequency};
+
+/****** Optional setup() function ******/
+
+void setup() {
+    tick_cycles = SystemCoreClock / kTickFrequency;
+    pulse_cycles = HostSim::cyclesFromNanoseconds(1000);
+    watch_pins();
+
+    test_segments();
+    test_critical_sections();
+    test_idle();
+
+    printf("max sustainable tick (and per-axis step) rate, on this machine:\n");
+    benchmark(bench1);
+    benchmark(bench2);
+    benchmark(steppers);
+    benchmark(bench4);
+    benchmark(bench6);
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -33,6 +33,7 @@
 #include "MotatePins.h"
 #include "MotateSerial.h"
 #include "MotateJSON.h"
+#include "MotateSensorTable.h"
 #include <cmath>
 #include <algorithm> // for std::max
 
@@ -50,11 +51,14 @@ OutputPin<Motate::kDebug2_PinNumber> debug_pin2;
 const float kSystemVoltage = 3.3;
 
 
-template<pin_number adc_pin_num, uint16_t min_temp = 0, uint16_t max_temp = 300, uint32_t table_size=64>
+template<pin_number adc_pin_num, uint16_t min_temp = 0, uint16_t max_temp = 300, uint16_t table_size=64>
 struct Thermistor {
     float c1, c2, c3, pullup_resistance;
     // We'll pull adc top value from the adc_pin.getTop()
 
+    // Temperature in hundredths of a degree, from raw adc values for max_temp to min_temp
+    SensorTable<table_size> lookup_table;
+
     ADCPin<adc_pin_num> adc_pin;
     uint16_t raw_adc_value = 0;
 
@@ -93,20 +97,34 @@ struct Thermistor {
         c2 = (x-c3*v)/z;
         c1 = 1/temp_low_fixed-c3*pow(a1,3)-c2*a1;
 
-//        int16_t temp = min_temp;
-//        for (int i=0; temp < max_temp && i < table_size; i++) {
-//            lookup_table[i][0] = adc_value(temp);
-//            lookup_table[i][0] = temp;
-//
-//            temp += (min_temp-max_temp)/(table_size-1);
-//        }
+        // The adc value falls as the temperature rises
+        lookup_table.build(adc_value_(max_temp), adc_value_(min_temp), [&](int32_t raw) -> int32_t {
+            return lround(temperature_exact(raw) * 100);
+        });
     };
 
+    // The inverse of temperature_exact(): the first adc value at or below temp.
+    // (The closed form needs c3 > 0, which isn't true of every thermistor.)
     uint16_t adc_value_(int16_t temp) {
-        float y = (c1 - (1/(temp+273.15))) / (2*c3);
-        float x = sqrt(pow(c2 / (3*c3),3) + pow(y,2));
-        float r = exp((x-y) - (x+y)); // resistance of thermistor
-        return (r / (pullup_resistance + r)) * (adc_pin.getTop());
+        uint16_t low = 1, high = adc_pin.getTop() - 1;
+        while (low < high) {
+            uint16_t middle = (low + high) / 2;
+            if (temperature_exact(middle) > temp) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    };
+
+    float temperature() {
+        // Sanity check:
+        if (raw_adc_value < 1) {
+            return -1; // invalid temperature from a thermistor
+        }
+
+        return lookup_table(raw_adc_value) / 100.0f;
     };
 
     float temperature_exact() {
@@ -115,7 +133,11 @@ struct Thermistor {
             return -1; // invalid temperature from a thermistor
         }
 
-        float v = (float)raw_adc_value * kSystemVoltage / (adc_pin.getTop()); // convert the 10 bit ADC value to a voltage
+        return temperature_exact(raw_adc_value);
+    };
+
+    float temperature_exact(const uint16_t raw) {
+        float v = (float)raw * kSystemVoltage / (adc_pin.getTop()); // convert the 10 bit ADC value to a voltage
         float r = (pullup_resistance * v) / (kSystemVoltage - v);   // resistance of thermistor
         float lnr = log(r);
         float Tinv = c1 + (c2*lnr) + (c3*pow(lnr,3));
@@ -155,7 +177,7 @@ struct Thermistor {
     };
 
     operator float() {
-        return temperature_exact();
+        return temperature();
     };
 
     void operator=(float) {;};
@@ -167,7 +189,7 @@ namespace Motate {
         bool relaxed_json = false;
 
 
-//        template <pin_number adc_pin_num, uint16_t min_temp, uint16_t max_temp, uint32_t table_size>
+//        template <pin_number adc_pin_num, uint16_t min_temp, uint16_t max_temp, uint16_t table_size>
 //        struct binderWriter_t<Thermistor<adc_pin_num, min_temp, max_temp, table_size>> {
 //            const int precision_ = 4;
 //
@@ -0,0 +1,144 @@
+/*
+ * timing_wheel_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/TimingWheelDemo.elf
+ *
+ * Schedules a few dozen soft timers on the SysTickTimer -- periodic ones with
+ * assorted periods, one-shots, and a Timeout with a callback -- then lets ten
+ * seconds of simulated time go by and checks that each was called on the right
+ * Ticks and the right number of times. A Timeout that's destroyed while it's set
+ * must never be called.
+ */
+
+#include "MotateTimers.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+using Motate::SysTickTimer;
+
+/****** Create file-global objects ******/
+
+static constexpr uint32_t kSoftTimers = 48;
+static constexpr uint32_t kRunTime = 10000; // ms
+
+struct SoftTimer {
+    Motate::TimingWheelEvent event;
+    uint32_t period = 0;
+    uint32_t next_due = 0;  // Tick it should be called on next
+    uint32_t calls = 0;
+    uint32_t late_or_early = 0;
+
+    void start(const uint32_t delay, const uint32_t _period) {
+        period = _period;
+        next_due = SysTickTimer.getValue() + delay + 1;
+        event.callback = [this]() {
+            if (SysTickTimer.getValue() != next_due) {
+                late_or_early++;
+            }
+            calls++;
+            next_due += period;
+        };
+        SysTickTimer.schedule(&event, delay, period);
+    };
+
+    // How many calls there should have been by the Tick end
+    uint32_t expectedCalls(const uint32_t end) const {
+        const uint32_t first = next_due - (calls * period);
+        if (first > end) {
+            return 0;
+        }
+        return (period == 0) ? 1 : ((end - first) / period) + 1;
+    };
+};
+
+SoftTimer soft_timers[kSoftTimers];
+
+volatile uint32_t timeout_called_at = 0;
+Motate::Timeout timeout {[]() { timeout_called_at = SysTickTimer.getValue(); }};
+volatile bool dropped_called = false;
+
+/****** Optional setup() function ******/
+
+void setup() {
+    // Timeout (and isPast()) treat a start at Tick 0 as not set
+    Motate::delay(1);
+
+    const uint32_t start = SysTickTimer.getValue();
+
+    for (uint32_t i = 0; i < kSoftTimers; i++) {
+        if (i % 4 == 3) {
+            soft_timers[i].start(37 * i, 0);                  // one-shot
+        } else {
+            soft_timers[i].start(i, 1 + ((i * 97) % 1500));   // periodic, some longer than a wheel level
+        }
+    }
+
+    // This one never fires
+    soft_timers[5].start(20000, 0);
+
+    timeout.set(2500);
+    uint32_t timeout_past_at = 0;
+
+    {
+        Motate::Timeout dropped {[]() { dropped_called = true; }};
+        dropped.set(100);
+    }
+
+    while (SysTickTimer.getValue() < start + kRunTime) {
+        Motate::delay(1);
+        if (!timeout_past_at && timeout.isPast()) {
+            timeout_past_at = SysTickTimer.getValue();
+        }
+    }
+    const uint32_t end = start + kRunTime;
+
+    uint32_t errors = 0;
+    for (uint32_t i = 0; i < kSoftTimers; i++) {
+        SysTickTimer.cancel(&soft_timers[i].event);
+        if (soft_timers[i].late_or_early || (soft_timers[i].calls != soft_timers[i].expectedCalls(end))) {
+            printf("soft timer %" PRIu32 ": %" PRIu32 " calls, %" PRIu32 " late or early\n", i,
+                   soft_timers[i].calls, soft_timers[i].late_or_early);
+            errors++;
+        }
+    }
+
+    printf("%" PRIu32 " soft timers over %" PRIu32 " ms: %" PRIu32 " errors\n", kSoftTimers, kRunTime, errors);
+    printf("timeout: callback at %" PRIu32 ", isPast() at %" PRIu32 "\n", (uint32_t)timeout_called_at, timeout_past_at);
+    printf("destroyed timeout: %s\n", dropped_called ? "FAIL: called" : "not called");
+
+    exit((errors || (timeout_called_at != timeout_past_at) || dropped_called) ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
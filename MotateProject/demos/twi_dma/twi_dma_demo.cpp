@@ -0,0 +1,280 @@
+/*
+ * twi_dma_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/TwiDmaDemo.elf
+ *
+ * Talks to a simulated 24C256 EEPROM and a simulated register device on the TWI bus.
+ *
+ * A register (or EEPROM address) write without a STOP, chained to a read, has to go out
+ * as one transfer with a repeated START: one DMA, and one interrupt. We check that the
+ * data makes it both ways, that the EEPROM's write cycle NACKs until it's done, and that
+ * a NACK fails every message of the chain.
+ *
+ * Then we read 256 bytes of the EEPROM three ways -- as one chained read, as a write and
+ * a separate read (with a STOP between them), and a byte at a time (as a driver that
+ * doesn't trust DMA would) -- and compare the interrupts, the time on the bus, and the
+ * host CPU time the driver takes for each. The simulated clock doesn't charge for the
+ * time the software takes, so that last one is timed with the host's clock. (Nor does
+ * the simulated bus charge for a STOP and START, so the first two take the same bus
+ * time here. On the wire, the STOP costs at least the bus free time, and the interrupt
+ * latency before the read can start.)
+ */
+
+#include "MotatePins.h"
+#include "MotateTWI.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostTWI0;
+using Motate::HostTwiEeprom;
+using Motate::HostTwiRegisters;
+using Motate::TWIMessage;
+
+/****** Create file-global objects ******/
+
+Motate::TWIBus<Motate::kI2C_SCLPinNumber, Motate::kI2C_SDAPinNumber> twiBus;
+auto eepromDevice = twiBus.getDevice({0x50});
+auto sensorDevice = twiBus.getDevice({0x20});
+auto missingDevice = twiBus.getDevice({0x51});
+
+// The register device counts STOPs, so we can see the repeated START
+struct Sensor : HostTwiRegisters<> {
+    uint32_t stops = 0;
+    Sensor(const uint8_t _address) : HostTwiRegisters<>{_address} {};
+    void stop() override { stops++; };
+};
+
+static HostTwiEeprom<> eeprom {0x50};
+static Sensor sensor {0x20};
+
+static constexpr uint16_t kPageSize = 64;
+static constexpr uint16_t kReadSize = 256;
+
+static TWIMessage messages[2];
+static uint8_t address_buffer[3];
+static uint8_t data_buffer[2 + kReadSize];
+static uint32_t done_count = 0;
+static uint32_t failed_count = 0;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/****** The tests ******/
+
+static void messageDone(bool ok) {
+    done_count++;
+    if (!ok) {
+        failed_count++;
+    }
+}
+
+// Queue first (and whatever's chained to it) on device, and wait for all count of them
+static void run(Motate::TWIBusDeviceBase &device, TWIMessage &first, const uint32_t count) {
+    done_count = 0;
+    failed_count = 0;
+    device.queueMessage(&first);
+    while (done_count < count) {
+        HostSim::idle();
+    }
+}
+
+// address_size bytes of address (already in address_buffer) written without a STOP, then size bytes read
+static void chainedRead(Motate::TWIBusDeviceBase &device, const uint8_t address_size, uint8_t *buffer, const uint16_t size) {
+    messages[1].setup(buffer, size, TWIMessage::Direction::kRX);
+    messages[0].setup(address_buffer, address_size, TWIMessage::Direction::kTX, {},
+                      TWIMessage::Instruction::kWithoutStop, &messages[1]);
+    run(device, messages[0], 2);
+}
+
+static void eepromAddress(const uint16_t address) {
+    address_buffer[0] = address >> 8;
+    address_buffer[1] = address & 0xFF;
+}
+
+static void testRegisters() {
+    // Write four registers from 0x10: the pointer, then the data
+    const uint8_t values[] = {0x10, 0xDE, 0xAD, 0xBE, 0xEF};
+    memcpy(data_buffer, values, sizeof(values));
+    messages[0].setup(data_buffer, sizeof(values), TWIMessage::Direction::kTX);
+    run(sensorDevice, messages[0], 1);
+    check((failed_count == 0) && (memcmp(sensor.registers + 0x10, values + 1, 4) == 0), "write registers");
+
+    sensor.stops = 0;
+    const uint32_t interrupts = HostTWI0.interrupts;
+    uint8_t read[4] = {};
+    address_buffer[0] = 0x10;
+    chainedRead(sensorDevice, 1, read, sizeof(read));
+    check((failed_count == 0) && (memcmp(read, values + 1, 4) == 0), "read registers back with a chained read");
+    check(sensor.stops == 1, "the chained read is one transaction, with a repeated START");
+    check(HostTWI0.interrupts - interrupts == 1, "the chained read takes one interrupt");
+}
+
+static void testEeprom() {
+    // Write a page at 0x0100
+    eepromAddress(0x0100);
+    memcpy(data_buffer, address_buffer, 2);
+    for (uint16_t i = 0; i < kPageSize; i++) {
+        data_buffer[2 + i] = i * 3;
+    }
+    messages[0].setup(data_buffer, 2 + kPageSize, TWIMessage::Direction::kTX);
+    run(eepromDevice, messages[0], 1);
+    check(failed_count == 0, "write an EEPROM page");
+
+    // It doesn't answer during the write cycle: both messages of the chain fail
+    uint8_t read[kPageSize];
+    chainedRead(eepromDevice, 2, read, kPageSize);
+    check(failed_count == 2, "the EEPROM NACKs during its write cycle, failing the whole chain");
+
+    // Poll for the ACK, like a driver would
+    uint32_t polls = 0;
+    do {
+        HostSim::advance(HostSim::cyclesFromMicroseconds(500));
+        eepromAddress(0x0100);
+        chainedRead(eepromDevice, 2, read, kPageSize);
+        polls++;
+    } while (failed_count && (polls < 20));
+    check(failed_count == 0, "the EEPROM answers once the write cycle is done");
+    bool data_ok = true;
+    for (uint16_t i = 0; i < kPageSize; i++) {
+        data_ok &= (read[i] == (uint8_t)(i * 3));
+    }
+    check(data_ok && (eeprom.writes == 1), "read the page back");
+
+    // A device that isn't there
+    address_buffer[0] = 0;
+    chainedRead(missingDevice, 1, read, 4);
+    check(failed_count == 2, "a missing device fails the whole chain");
+}
+
+/****** The comparison ******/
+
+struct Result {
+    uint32_t interrupts;
+    double bus_us;
+    double host_ns;
+};
+
+static Result measure(const char *name, void (*read)(uint8_t *)) {
+    static constexpr uint32_t kRounds = 200;
+    uint8_t buffer[kReadSize];
+
+    const uint32_t interrupts = HostTWI0.interrupts;
+    const uint64_t start = HostSim::now();
+    const auto host_start = std::chrono::steady_clock::now();
+    bool data_ok = true;
+    for (uint32_t round = 0; round < kRounds; round++) {
+        memset(buffer, 0, sizeof(buffer));
+        read(buffer);
+        data_ok &= (memcmp(buffer, eeprom.memory, kReadSize) == 0);
+    }
+    const std::chrono::duration<double, std::nano> host = std::chrono::steady_clock::now() - host_start;
+    const Result result {
+        (HostTWI0.interrupts - interrupts) / kRounds,
+        (double)(HostSim::now() - start) / kRounds / HostSim::cyclesFromMicroseconds(1),
+        host.count() / kRounds
+    };
+
+    check(data_ok, "every way of reading gets the same data");
+    printf("%-24s %10" PRIu32 " %10.1f %10.1f %12.0f\n", name, result.interrupts, result.bus_us,
+           kReadSize / result.bus_us * 1000000.0 / 1024.0, result.host_ns);
+    return result;
+}
+
+static void compare() {
+    for (uint16_t i = 0; i < kReadSize; i++) {
+        eeprom.memory[i] = i ^ 0x5A;
+    }
+
+    printf("\nreading %u bytes from the EEPROM at 400 kHz:\n", kReadSize);
+    printf("%-24s %10s %10s %10s %12s\n", "", "interrupts", "bus us", "KiB/s", "host ns");
+
+    const Result chained = measure("chained (repeated START)", [](uint8_t *buffer) {
+        eepromAddress(0);
+        chainedRead(eepromDevice, 2, buffer, kReadSize);
+    });
+    const Result separate = measure("write, STOP, read", [](uint8_t *buffer) {
+        eepromAddress(0);
+        messages[0].setup(address_buffer, 2, TWIMessage::Direction::kTX);
+        run(eepromDevice, messages[0], 1);
+        messages[1].setup(buffer, kReadSize, TWIMessage::Direction::kRX);
+        run(eepromDevice, messages[1], 1);
+    });
+    const Result bytes = measure("a byte at a time", [](uint8_t *buffer) {
+        for (uint16_t i = 0; i < kReadSize; i++) {
+            eepromAddress(i);
+            chainedRead(eepromDevice, 2, buffer + i, 1);
+        }
+    });
+
+    check(chained.interrupts == 1, "a chained read is one interrupt");
+    check(separate.interrupts == 2, "a write and a separate read are two");
+    check(bytes.interrupts == kReadSize, "a byte at a time is one per byte");
+    check(chained.bus_us <= separate.bus_us, "the repeated START takes no more bus time than a STOP and START");
+    check(chained.host_ns < bytes.host_ns, "DMA saves CPU time over a byte at a time");
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    twiBus.init();
+    HostTWI0.attach(&eeprom);
+    HostTWI0.attach(&sensor);
+
+    for (TWIMessage &message : messages) {
+        message.message_done_callback = messageDone;
+    }
+
+    testRegisters();
+    testEeprom();
+    compare();
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
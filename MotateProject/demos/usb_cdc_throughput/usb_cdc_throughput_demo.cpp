@@ -0,0 +1,292 @@
+/*
+ * usb_cdc_throughput_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/UsbCdcThroughputDemo.elf
+ *
+ * Plugs a USBCDC device into the simulated USB host, with an RXBuffer and a TXBuffer on its USBSerial the
+ * way a firmware would have them. The host streams patterned data through it -- echoed back, sunk, and
+ * sourced by the device -- checks every byte, and reports the throughput in simulated bus time, at high
+ * and full speed. It also checks that USBSerial keeps more than one DMA descriptor queued each way.
+ */
+
+#include "MotateUSB.h"
+#include "MotateUSBCDC.h"
+#include "MotateBuffer.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostUSB;
+using Motate::HostUsbTransfer;
+
+/****** Create file-global objects ******/
+
+const Motate::USBSettings_t Motate::USBSettings = {
+    /* vendorID         = */ 0x1d50,
+    /* productID        = */ 0x606d,
+    /* productVersion   = */ 0.1,
+    /* attributes       = */ Motate::kUSBConfigAttributeSelfPowered,
+    /* powerConsumption = */ 500
+};
+
+Motate::USBDevice<Motate::USBDeviceHardware, Motate::USBCDC> usb;
+auto &serial = usb.mixin<0>::Serial;
+
+static constexpr uint16_t kBufferSize = 4096;
+Motate::RXBuffer<kBufferSize, decltype(&serial)> rx_buffer {&serial};
+Motate::TXBuffer<kBufferSize, decltype(&serial)> tx_buffer {&serial};
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static char pattern(const uint32_t i) { return (char)(i * 7 + (i >> 9)); }
+
+/****** The device ******/
+
+enum DeviceMode { kEcho, kSink, kSource };
+static DeviceMode mode = kEcho;
+
+static uint32_t sunk = 0;               // kSink: bytes taken, and checked against the pattern
+static bool sunk_intact = true;
+static uint32_t sourced = 0;            // kSource: bytes handed to the TXBuffer
+static uint32_t source_total = 0;
+static uint8_t deepest_rx = 0;          // the most descriptors seen queued at once
+static uint8_t deepest_tx = 0;
+
+// What a firmware's main loop does with the buffers.
+static void pump() {
+    char chunk[512];
+
+    deepest_rx = std::max<uint8_t>(deepest_rx, serial._rx_ring.queued - serial._rx_ring.done);
+    deepest_tx = std::max<uint8_t>(deepest_tx, serial._tx_ring.queued - serial._tx_ring.done);
+
+    if (mode == kEcho) {
+        uint16_t room;
+        while ((room = tx_buffer.writableSpans().length()) > 0) {
+            const int16_t got = rx_buffer.read(chunk, std::min<uint16_t>(room, sizeof(chunk)));
+            if (got < 1) {
+                break;
+            }
+            tx_buffer.writableSpans().copyIn(chunk, got);
+            tx_buffer.commit(got);
+        }
+        tx_buffer.flush();
+    } else if (mode == kSink) {
+        int16_t got;
+        while ((got = rx_buffer.read(chunk, sizeof(chunk))) > 0) {
+            for (int16_t i = 0; i < got; i++) {
+                if (chunk[i] != pattern(sunk + i)) {
+                    sunk_intact = false;
+                }
+            }
+            sunk += got;
+        }
+    } else {
+        uint16_t room;
+        while ((sourced < source_total) && (room = tx_buffer.writableSpans().length()) > 0) {
+            const uint16_t count = std::min<uint32_t>(std::min<uint16_t>(room, sizeof(chunk)), source_total - sourced);
+            for (uint16_t i = 0; i < count; i++) {
+                chunk[i] = pattern(sourced + i);
+            }
+            tx_buffer.writableSpans().copyIn(chunk, count);
+            tx_buffer.commit(count);
+            sourced += count;
+        }
+        tx_buffer.flush();
+    }
+}
+
+/****** The host ******/
+
+// The host driver sends kTransferSize at a time, and reads a packet at a time: USBSerial doesn't end a
+// stream that stops on a packet boundary with a zero-length packet, so a longer read would wait for more.
+static constexpr uint32_t kStreamSize = 1024 * 1024;
+static constexpr uint32_t kTransferSize = 4096;
+static constexpr uint8_t kTransfers = 32;         // outstanding each way
+
+static char out_stream[kStreamSize];
+static char in_stream[kStreamSize];
+static uint32_t in_length = 0;
+
+static HostUsbTransfer out_transfers[kTransfers];
+static HostUsbTransfer in_transfers[kTransfers];
+static char in_data[kTransfers][512];
+
+static bool plugIn(const bool high_speed) {
+    HostUSB.connect(high_speed);
+    return HostUSB.enumerate();
+}
+
+// Stream length bytes through the device in the current mode: out from the host unless it's sourcing, back in
+// unless it's sinking. The device's main loop gets to the buffers every loop_us, or as soon as anything
+// happens if that's 0. Returns the simulated cycles it took.
+static uint64_t stream(const uint32_t length, const uint32_t loop_us = 0) {
+    const bool sending = (mode != kSource);
+    const bool receiving = (mode != kSink);
+    const uint8_t out_ep = serial.read_endpoint;
+    const uint8_t in_ep = serial.write_endpoint;
+
+    uint32_t out_queued = 0;    // bytes handed to the host controller
+    uint8_t out_next = 0;       // the oldest outstanding transfer each way (they finish in order)
+    uint8_t in_next = 0;
+    in_length = 0;
+    sunk = 0;
+    sunk_intact = true;
+    sourced = 0;
+    source_total = length;
+
+    auto submitOut = [&](const uint8_t t) {
+        const uint32_t size = std::min(kTransferSize, length - out_queued);
+        out_transfers[t] = HostUsbTransfer{out_stream + out_queued, size};
+        out_queued += size;
+        HostUSB.submit(out_ep, &out_transfers[t]);
+    };
+    auto submitIn = [&](const uint8_t t) {
+        in_transfers[t] = HostUsbTransfer{in_data[t], HostUSB.ep[in_ep].size};
+        HostUSB.submit(in_ep, &in_transfers[t]);
+    };
+
+    const uint64_t start = HostSim::now();
+    for (uint8_t t = 0; t < kTransfers; t++) {
+        if (sending && (out_queued < length)) {
+            submitOut(t);
+        }
+        if (receiving) {
+            submitIn(t);
+        }
+    }
+
+    const uint64_t give_up = start + (uint64_t)SystemCoreClock * 10;
+    while ((receiving ? in_length : sunk) < length) {
+        if (HostSim::now() > give_up) {
+            check(false, "the stream finishes");
+            break;
+        }
+
+        pump();
+        if (loop_us) {
+            HostSim::advance(HostSim::cyclesFromMicroseconds(loop_us));
+        } else {
+            HostSim::idle();
+        }
+
+        while (sending && (out_queued < length) && out_transfers[out_next].done) {
+            submitOut(out_next);
+            out_next = (out_next + 1) % kTransfers;
+        }
+        while (receiving && in_transfers[in_next].done) {
+            HostUsbTransfer &done = in_transfers[in_next];
+            const uint32_t count = std::min(done.actual, kStreamSize - in_length);
+            memcpy(in_stream + in_length, done.buffer, count);
+            in_length += count;
+            submitIn(in_next);
+            in_next = (in_next + 1) % kTransfers;
+        }
+    }
+    const uint64_t cycles = HostSim::now() - start;
+
+    // leave no IN transfers waiting on the next run
+    if (receiving) {
+        HostUSB.ep[in_ep].first = HostUSB.ep[in_ep].last = nullptr;
+    }
+    return cycles;
+}
+
+// A main loop with other work to do
+static constexpr uint32_t kBusyLoopMicroseconds = 100;
+
+static double megabytesPerSecond(const uint64_t bytes, const uint64_t cycles) {
+    return ((double)bytes / 1000000.0) / ((double)cycles / SystemCoreClock);
+}
+
+static void test_throughput(const char *speed) {
+    for (uint32_t i = 0; i < kStreamSize; i++) {
+        out_stream[i] = pattern(i);
+    }
+
+    mode = kEcho;
+    deepest_rx = deepest_tx = 0;
+    const uint64_t echo_cycles = stream(kStreamSize);
+    check((in_length == kStreamSize) && (memcmp(in_stream, out_stream, kStreamSize) == 0), "the echoed stream comes back intact");
+    check(deepest_rx >= 2 && deepest_tx >= 2, "more than one descriptor is queued each way");
+
+    const uint64_t busy_cycles = stream(kStreamSize, kBusyLoopMicroseconds);
+    check((in_length == kStreamSize) && (memcmp(in_stream, out_stream, kStreamSize) == 0), "the echoed stream comes back intact from a busy main loop");
+
+    mode = kSink;
+    const uint64_t sink_cycles = stream(kStreamSize);
+    check((sunk == kStreamSize) && sunk_intact, "the device takes the whole stream intact");
+
+    mode = kSource;
+    const uint64_t source_cycles = stream(kStreamSize);
+    check((in_length == kStreamSize) && (memcmp(in_stream, out_stream, kStreamSize) == 0), "the sourced stream arrives intact");
+
+    printf("%s, %" PRIu32 " bytes through %u byte buffers, up to %u/%u descriptors queued:\n",
+           speed, kStreamSize, kBufferSize, deepest_rx, deepest_tx);
+    printf("  loopback:  %6.2f MB/s each way\n", megabytesPerSecond(kStreamSize, echo_cycles));
+    printf("  loopback, main loop every %" PRIu32 "us:  %6.2f MB/s each way\n", kBusyLoopMicroseconds, megabytesPerSecond(kStreamSize, busy_cycles));
+    printf("  OUT only:  %6.2f MB/s\n", megabytesPerSecond(kStreamSize, sink_cycles));
+    printf("  IN only:   %6.2f MB/s\n", megabytesPerSecond(kStreamSize, source_cycles));
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    rx_buffer.init();
+    tx_buffer.init();
+
+    check(plugIn(true), "enumerate");
+    test_throughput("high speed");
+
+    HostUSB.disconnect();
+    check(plugIn(false), "enumerate at full speed");
+    test_throughput("full speed");
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
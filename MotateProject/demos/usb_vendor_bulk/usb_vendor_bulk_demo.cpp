@@ -0,0 +1,370 @@
+/*
+ * usb_vendor_bulk_demo.cpp - Motate
+ * This file is part of the Motate project.
+ *
+ * Copyright (c) 2018 Robert Giseburt
+ *
+ *  This file is part of the Motate Library.
+ *
+ *  This file ("the software") is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2 as published by the
+ *  Free Software Foundation. You should have received a copy of the GNU General Public
+ *  License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, you may use this file as part of a software library without
+ *  restriction. Specifically, if other files instantiate templates or use macros or
+ *  inline functions from this file, or you compile this file and link it with  other
+ *  files to produce an executable, this file does not by itself cause the resulting
+ *  executable to be covered by the GNU General Public License. This exception does not
+ *  however invalidate any other reasons why the executable file might be covered by the
+ *  GNU General Public License.
+ *
+ *  THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ *  WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ *  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ *  SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ *  OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
+ */
+
+/* Build and run on the development machine with:
+ *   make BOARD=host && ./bin/host/UsbVendorBulkDemo.elf
+ *
+ * Plugs a USBVendorBulk device into the simulated USB host and checks what it
+ * tells the host: a USB 2.1 device descriptor, one vendor-specific interface with
+ * two bulk endpoints, and the BOS and MS OS 2.0 descriptors that get WinUSB bound to
+ * it. Then the device echoes every message back from the slot it arrived in, and
+ * the host streams patterned messages through it, checks every byte that comes
+ * back, and reports the throughput in simulated bus time -- both ways at once, one
+ * way at a time, and at full speed.
+ */
+
+#include "MotateUSB.h"
+#include "MotateUSBVendorBulk.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(__HOST_SIM__)
+#error This demo only runs on the host simulation: make BOARD=host
+#endif
+
+using Motate::HostSim;
+using Motate::HostUSB;
+using Motate::HostUsbTransfer;
+
+/****** Create file-global objects ******/
+
+const Motate::USBSettings_t Motate::USBSettings = {
+    /* vendorID         = */ 0x1d50,
+    /* productID        = */ 0x606d,
+    /* productVersion   = */ 0.1,
+    /* attributes       = */ Motate::kUSBConfigAttributeSelfPowered,
+    /* powerConsumption = */ 500
+};
+
+static constexpr uint16_t kMessageSize = 2048;
+static constexpr uint8_t kSlots = 4;
+typedef Motate::USBVendorBulk<512, kMessageSize, kSlots> bulk_type;
+
+Motate::USBDevice<Motate::USBDeviceHardware, bulk_type> usb;
+auto &bulk = usb.mixin<0>::Bulk;
+
+static constexpr uint8_t kOutEndpoint = 1;
+static constexpr uint8_t kInEndpoint = 2;
+
+static uint32_t failures = 0;
+
+static void check(const bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/****** The device ******/
+
+enum DeviceMode { kEcho, kSink, kSource };
+static DeviceMode mode = kEcho;
+
+static uint8_t echoed = 0;              // received messages that are being sent back
+static uint32_t source_left = 0;        // kSource: messages still to send
+static char source_message[kMessageSize];
+
+// Echo whatever has come in, straight from the slot it came into.
+static void pump() {
+    const char *data;
+    uint16_t length;
+    while (bulk.receive(data, length, echoed)) {
+        if (!bulk.send(data, length)) {
+            break;
+        }
+        echoed++;
+    }
+}
+
+static void sourceSome() {
+    while (source_left && bulk.send(source_message, kMessageSize)) {
+        source_left--;
+    }
+}
+
+static void setupDevice() {
+    bulk.setMessageReceivedCallback([] {
+        if (mode == kEcho) {
+            pump();
+        } else {
+            bulk.release();
+        }
+    });
+    bulk.setMessageSentCallback([] {
+        if (mode == kEcho) {
+            bulk.release();
+            echoed--;
+            pump();
+        } else if (mode == kSource) {
+            sourceSome();
+        }
+    });
+}
+
+/****** The host ******/
+
+static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static bool plugIn(const bool high_speed) {
+    echoed = 0;
+    HostUSB.connect(high_speed);
+    return HostUSB.enumerate();
+}
+
+static void test_descriptors() {
+    uint8_t buffer[255];
+
+    check(plugIn(true), "enumerate");
+    check(bulk.isConnected(), "configured after enumeration");
+
+    // Device: USB 2.1, so the host asks for the BOS
+    check(HostUSB.controlTransfer(0x80, 6, 0x0100, 0, 18, buffer) == 18, "device descriptor");
+    check(le16(&buffer[2]) == 0x0210, "bcdUSB is 2.1");
+    check(buffer[4] == 0, "device class is per interface");
+
+    // Configuration: one vendor-specific interface, a bulk OUT and a bulk IN of 512 bytes
+    const int32_t config_length = HostUSB.controlTransfer(0x80, 6, 0x0200, 0, sizeof(buffer), buffer);
+    check(config_length == 9 + 9 + 7 + 7, "configuration length");
+    check(buffer[4] == 1, "one interface");
+    const uint8_t *interface = &buffer[9];
+    check(interface[1] == 4 && interface[4] == 2, "interface with two endpoints");
+    check(interface[5] == 0xFF && interface[6] == 0xFF && interface[7] == 0xFF, "interface is vendor-specific");
+    const uint8_t *out = &buffer[18], *in = &buffer[25];
+    check(out[2] == kOutEndpoint && in[2] == (0x80 | kInEndpoint), "endpoint addresses");
+    check(out[3] == 2 && in[3] == 2, "endpoints are bulk");
+    check(le16(&out[4]) == 512 && le16(&in[4]) == 512, "512 byte packets at high speed");
+
+    // BOS, with the MS OS 2.0 platform capability
+    check(HostUSB.controlTransfer(0x80, 6, 0x0F00, 0, 5, buffer) == 5, "BOS header");
+    const uint16_t bos_length = le16(&buffer[2]);
+    check(bos_length == 33 && buffer[4] == 1, "BOS has one capability");
+    check(HostUSB.controlTransfer(0x80, 6, 0x0F00, 0, bos_length, buffer) == bos_length, "BOS");
+    const uint8_t *capability = &buffer[5];
+    const uint8_t uuid[16] = {0xDF, 0x60, 0xDD, 0xD8, 0x89, 0x45, 0xC7, 0x4C, 0x9C, 0xD2, 0x65, 0x9D, 0x9E, 0x64, 0x8A, 0x9F};
+    check(capability[1] == 0x10 && capability[2] == 5, "platform capability");
+    check(memcmp(&capability[4], uuid, 16) == 0, "MS OS 2.0 platform UUID");
+    const uint16_t set_length = le16(&capability[24]);
+    const uint8_t vendor_code = capability[26];
+
+    // The MS OS 2.0 descriptor set, from the vendor request the BOS names
+    const int32_t got = HostUSB.controlTransfer(0xC0, vendor_code, 0, 7, set_length, buffer);
+    check(got == set_length && set_length == 162, "MS OS 2.0 descriptor set");
+    check(le16(&buffer[8]) == set_length, "set header total length");
+    check(memcmp(&buffer[14], "WINUSB\0\0", 8) == 0, "compatible ID is WINUSB");
+    const char16_t name[] = u"DeviceInterfaceGUIDs";
+    check(memcmp(&buffer[38], name, sizeof(name)) == 0, "registry property name");
+    check(buffer[82] == '{' && buffer[82 + 2 * 37] == '}', "interface GUID");
+
+    // Another vendor request is STALLed
+    check(HostUSB.controlTransfer(0xC0, vendor_code + 1, 0, 7, set_length, buffer) == -1, "unknown vendor request stalls");
+}
+
+static constexpr uint32_t kMessages = 256;
+static char out_data[kMessages][kMessageSize];
+static char in_data[kMessages][kMessageSize];
+static HostUsbTransfer out_transfers[kMessages];
+static HostUsbTransfer in_transfers[kMessages];
+
+static void fillPattern(const uint32_t seed) {
+    for (uint32_t m = 0; m < kMessages; m++) {
+        for (uint32_t i = 0; i < kMessageSize; i++) {
+            out_data[m][i] = (char)(m * 31 + i * 7 + seed);
+        }
+    }
+}
+
+static double megabytesPerSecond(const uint64_t bytes, const uint64_t cycles) {
+    return ((double)bytes / 1000000.0) / ((double)cycles / SystemCoreClock);
+}
+
+// Send count messages (of lengths[m], or a whole message) and read them back, with everything queued up front
+// like a driver with plenty of transfers outstanding.
+static uint64_t loopback(const uint32_t count, const uint16_t *lengths = nullptr) {
+    mode = kEcho;
+    memset(in_data, 0, sizeof(in_data));
+
+    const uint64_t start = HostSim::now();
+    for (uint32_t m = 0; m < count; m++) {
+        const uint16_t length = lengths ? lengths[m] : kMessageSize;
+        out_transfers[m] = HostUsbTransfer{out_data[m], length};
+        // (a full slot ends the message by itself, and a ZLP after it would be an empty message)
+        out_transfers[m].zero_length_packet = (length < kMessageSize);
+        in_transfers[m] = HostUsbTransfer{in_data[m], length};
+        HostUSB.submit(kOutEndpoint, &out_transfers[m]);
+        HostUSB.submit(kInEndpoint, &in_transfers[m]);
+    }
+    while (!in_transfers[count - 1].done) {
+        HostSim::idle();
+    }
+    const uint64_t cycles = HostSim::now() - start;
+
+    // the device hears that the last one was sent a little later
+    while (echoed) {
+        HostSim::idle();
+    }
+
+    bool intact = true;
+    for (uint32_t m = 0; m < count; m++) {
+        const uint16_t length = lengths ? lengths[m] : kMessageSize;
+        if ((in_transfers[m].actual != length) || memcmp(in_data[m], out_data[m], length) != 0) {
+            intact = false;
+        }
+    }
+    check(intact, "every message comes back intact, in order");
+    check(bulk.available() == 0 && echoed == 0, "every slot is released");
+    return cycles;
+}
+
+static uint64_t sink(const uint32_t count) {
+    mode = kSink;
+    const uint64_t start = HostSim::now();
+    for (uint32_t m = 0; m < count; m++) {
+        out_transfers[m] = HostUsbTransfer{out_data[m], kMessageSize};
+        HostUSB.submit(kOutEndpoint, &out_transfers[m]);
+    }
+    while (bulk.available() || HostUSB.ep[kOutEndpoint].first) {
+        HostSim::idle();
+    }
+    return HostSim::now() - start;
+}
+
+static uint64_t source(const uint32_t count) {
+    mode = kSource;
+    const uint64_t start = HostSim::now();
+    for (uint32_t m = 0; m < count; m++) {
+        in_transfers[m] = HostUsbTransfer{in_data[m], kMessageSize};
+        HostUSB.submit(kInEndpoint, &in_transfers[m]);
+    }
+    source_left = count;
+    {
+        Motate::HostCommon::InterruptDisabler disabler;
+        sourceSome();
+    }
+    while (!in_transfers[count - 1].done) {
+        HostSim::idle();
+    }
+    const uint64_t cycles = HostSim::now() - start;
+
+    bool intact = true;
+    for (uint32_t m = 0; m < count; m++) {
+        if ((in_transfers[m].actual != kMessageSize) || memcmp(in_data[m], source_message, kMessageSize) != 0) {
+            intact = false;
+        }
+    }
+    check(intact, "every sourced message arrives");
+    return cycles;
+}
+
+static void test_throughput(const char *speed) {
+    const uint64_t bytes = (uint64_t)kMessages * kMessageSize;
+
+    fillPattern(0);
+    const uint64_t echo_cycles = loopback(kMessages);
+    const uint64_t sink_cycles = sink(kMessages);
+    const uint64_t source_cycles = source(kMessages);
+
+    printf("%s, %" PRIu32 " messages of %u bytes, %u slots:\n", speed, kMessages, kMessageSize, kSlots);
+    printf("  loopback:  %6.2f MB/s each way\n", megabytesPerSecond(bytes, echo_cycles));
+    printf("  OUT only:  %6.2f MB/s\n", megabytesPerSecond(bytes, sink_cycles));
+    printf("  IN only:   %6.2f MB/s\n", megabytesPerSecond(bytes, source_cycles));
+}
+
+static void test_message_boundaries() {
+    // Short messages end at their short packet, and whole-packet ones at the zero-length packet after them
+    uint16_t lengths[16];
+    for (uint32_t m = 0; m < 16; m++) {
+        static const uint16_t picks[] = {1, 100, 511, 512, 513, 1024, 2047, 2048};
+        lengths[m] = picks[m % 8];
+    }
+    fillPattern(5);
+    loopback(16, lengths);
+
+    // Nothing goes out without a slot
+    mode = kSink;
+    static char message[16];
+    uint8_t sent = 0;
+    {
+        Motate::HostCommon::InterruptDisabler disabler;
+        while (bulk.send(message, sizeof(message))) {
+            sent++;
+        }
+    }
+    check(sent == kSlots, "send() takes one message per slot");
+    check(!bulk.send(message, kMessageSize + 1), "messages longer than a slot are refused");
+
+    // ... and the host takes them, which frees the slots again
+    for (uint32_t m = 0; m < sent; m++) {
+        in_transfers[m] = HostUsbTransfer{in_data[m], kMessageSize};
+        HostUSB.submit(kInEndpoint, &in_transfers[m]);
+    }
+    while (!in_transfers[sent - 1].done) {
+        HostSim::idle();
+    }
+    for (uint32_t i = 0; (i < 100) && (bulk.sendable() != kSlots); i++) {
+        HostSim::idle();
+    }
+    check(bulk.sendable() == kSlots, "slots are free once sent");
+}
+
+static void test_full_speed() {
+    HostUSB.disconnect();
+    check(!bulk.isConnected(), "disconnected");
+
+    check(plugIn(false), "enumerate at full speed");
+    uint8_t buffer[64];
+    HostUSB.controlTransfer(0x80, 6, 0x0200, 0, sizeof(buffer), buffer);
+    check(le16(&buffer[18 + 4]) == 64 && le16(&buffer[25 + 4]) == 64, "64 byte packets at full speed");
+}
+
+/****** Optional setup() function ******/
+
+void setup() {
+    for (uint32_t i = 0; i < kMessageSize; i++) {
+        source_message[i] = (char)(i * 13);
+    }
+    setupDevice();
+
+    test_descriptors();
+    test_message_boundaries();
+    test_throughput("high speed");
+
+    test_full_speed();
+    test_throughput("full speed");
+
+    printf("\n%" PRIu32 " failures\n", failures);
+    exit(failures ? 1 : 0);
+}
+
+/****** Main run loop() ******/
+
+void loop() {
+}
@@ -90,7 +90,10 @@ struct SamCommon {
         };
         ~InterruptDisabler() {
             sync();
-            __enable_irq();
+            // Only re-enable if they were enabled before, so these can nest
+            if (!flags) {
+                __enable_irq();
+            }
          };
     };
 };
@@ -36,9 +36,11 @@
 #ifndef SAMDMA_H_ONCE
 #define SAMDMA_H_ONCE
 
-#include <functional>  // for std::function
+#include <algorithm>   // for std::max
 #include <type_traits> // for std::alignment_of and std::remove_pointer
 
+#include "MotateDelegate.h"
+
 namespace Motate {
 
     // DMA template - MUST be specialized
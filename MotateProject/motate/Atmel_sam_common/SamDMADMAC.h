@@ -93,7 +93,7 @@ struct DMA_DMAC_common {
 };
 
 struct _DMACInterrupt {
-    const std::function<void(uint32_t)> interrupt_handler;
+    const Delegate<void(uint32_t)> interrupt_handler;
     uint8_t                         channel_num;
     uint32_t                        channel_mask;
     _DMACInterrupt*                 next;
@@ -102,9 +102,9 @@ struct _DMACInterrupt {
     _DMACInterrupt& operator=(const _DMACInterrupt&) = delete;  // delete the assigment operator, we only allow moves
 
     // Note we MOVE construct this interrupt function...
-    _DMACInterrupt(const std::function<void(uint32_t)>&& _interrupt, _DMACInterrupt*& _first)
+    _DMACInterrupt(const Delegate<void(uint32_t)>&& _interrupt, _DMACInterrupt*& _first)
         : interrupt_handler{std::move(_interrupt)}, next{nullptr} {
-        if (interrupt_handler) {  // std::function returns false if the function isn't valid
+        if (interrupt_handler) {  // Delegate returns false if the function isn't valid
             if (_first == nullptr) {
                 _first       = this;
                 channel_num  = 0;
@@ -148,7 +148,7 @@ struct DMA_DMAC_TX : virtual DMA_DMAC_TX_hardware<periph_t, periph_num> {
     typedef typename _hw::buffer_t buffer_t;
     static constexpr uint32_t buffer_width = std::alignment_of<typename std::remove_pointer<buffer_t>::type>::value;
 
-    const std::function<void(Interrupt::Type)>& _dmaCInterruptHandler;
+    const Delegate<void(Interrupt::Type)>& _dmaCInterruptHandler;
 
     _DMACInterrupt _tx_interrupt{
         [&](uint32_t status) {
@@ -170,7 +170,7 @@ struct DMA_DMAC_TX : virtual DMA_DMAC_TX_hardware<periph_t, periph_num> {
     DmacCh_num* const dmacTxChannel() const { return &(dmac()->DMAC_CH_NUM[dmacTxChannelNumber()]); };
 
     // we'll hold a reference to the handler, the peripheral owns the one it's passing
-    constexpr DMA_DMAC_TX(const std::function<void(Interrupt::Type)>& handler) : _dmaCInterruptHandler{handler} {};
+    constexpr DMA_DMAC_TX(const Delegate<void(Interrupt::Type)>& handler) : _dmaCInterruptHandler{handler} {};
 
     void resetTx() const {
         // init is called once after reset, so clean up after a reset
@@ -267,7 +267,7 @@ struct DMA_DMAC_TX : virtual DMA_DMAC_TX_hardware<periph_t, periph_num> {
     };
 
     // DMAC_Handler is handled with _tx_interrupt and _rx_interupt. They use
-    // the std::function _dmaCInterruptHandler, which get's set by the peripheral
+    // the Delegate _dmaCInterruptHandler, which get's set by the peripheral
     // in the constexpr constructor.
 
     // These two get called from the peripheral interrupt handler,
@@ -289,7 +289,7 @@ struct DMA_DMAC_RX : virtual DMA_DMAC_RX_hardware<periph_t, periph_num> {
     typedef typename _hw::buffer_t buffer_t;
     static constexpr uint32_t buffer_width = std::alignment_of<typename std::remove_pointer<buffer_t>::type>::value;
 
-    const std::function<void(Interrupt::Type)>& _dmaCInterruptHandler;
+    const Delegate<void(Interrupt::Type)>& _dmaCInterruptHandler;
 
     _DMACInterrupt _rx_interrupt{[&](uint32_t status) {
                                      if (_dmaCInterruptHandler) {
@@ -301,7 +301,7 @@ struct DMA_DMAC_RX : virtual DMA_DMAC_RX_hardware<periph_t, periph_num> {
     const uint8_t     dmacRxChannelNumber() const { return _rx_interrupt.getChannel(); }
     DmacCh_num* const dmacRxChannel() const { return &(dmac()->DMAC_CH_NUM[dmacRxChannelNumber()]); };
 
-    constexpr DMA_DMAC_RX(const std::function<void(Interrupt::Type)>& handler) : _dmaCInterruptHandler{handler} {};
+    constexpr DMA_DMAC_RX(const Delegate<void(Interrupt::Type)>& handler) : _dmaCInterruptHandler{handler} {};
     void resetRx() const {
         // init is called once after reset, so clean up after a reset
 
@@ -444,7 +444,7 @@ struct DMA_DMAC_RX : virtual DMA_DMAC_RX_hardware<periph_t, periph_num> {
     };
 
     // DMAC_Handler is handled with _tx_interrupt and _rx_interupt. They use
-    // the std::function _dmaCInterruptHandler, which gets set by the peripheral
+    // the Delegate _dmaCInterruptHandler, which gets set by the peripheral
     // in the constexpr constructor.
 
     // These two get called from the peripheral interrupt handler,
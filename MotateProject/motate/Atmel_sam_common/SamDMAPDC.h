@@ -181,6 +181,19 @@ namespace Motate {
             return (length > 0);
         }
 
+        // Receive into two regions (such as both halves of a wrapped circular buffer): the
+        // second one goes in the "next" registers, so there's no gap between them.
+        bool startRXTransfer(void * const buffer, const uint32_t length, void * const buffer2, const uint32_t length2, bool handle_interrupts = true) const
+        {
+            if (!startRXTransfer(buffer, length, handle_interrupts, /*include_next=*/ false)) {
+                return false;
+            }
+            if (length2 > 0) {
+                startRXTransfer(buffer2, length2, handle_interrupts, /*include_next=*/ true);
+            }
+            return true;
+        }
+
 
         void disableTx() const
         {
@@ -244,6 +257,19 @@ namespace Motate {
             }
             return false;
         }
+
+        // Send two regions (such as both halves of a wrapped circular buffer): the
+        // second one goes in the "next" registers, so there's no gap between them.
+        bool startTXTransfer(void * const buffer, const uint32_t length, void * const buffer2, const uint32_t length2, bool handle_interrupts = true) const
+        {
+            if (!startTXTransfer(buffer, length, handle_interrupts, /*include_next=*/ false)) {
+                return false;
+            }
+            if (length2 > 0) {
+                startTXTransfer(buffer2, length2, handle_interrupts, /*include_next=*/ true);
+            }
+            return true;
+        }
     };
 
 } // end namespace Motate
@@ -36,8 +36,34 @@
 // Only if we have an XDMAC
 #if defined(XDMAC)
 
+// The CMSIS headers don't define the fields of the descriptor's MBR_UBC word.
+// These are from the XDMAC linked list descriptor tables in the datasheet.
+#ifndef XDMAC_UBC_NDE
+#define XDMAC_UBC_UBLEN(value)  ((value) & 0xFFFFFFu)
+#define XDMAC_UBC_NDE           (0x1u << 24) // fetch another descriptor after this one
+#define XDMAC_UBC_NSEN          (0x1u << 25) // the next descriptor updates the source
+#define XDMAC_UBC_NDEN          (0x1u << 26) // the next descriptor updates the destination
+#define XDMAC_UBC_NVIEW_NDV1    (0x1u << 27) // the next descriptor is a "view 1" descriptor
+#endif
+
 namespace Motate {
 
+    // One block of a DMA transfer -- a chain of these is handed to the XDMAC in one go.
+    struct XDMACBlock {
+        void     *buffer;
+        uint32_t  length;
+    };
+
+    // A linked list descriptor, "view 1": next descriptor address, microblock control,
+    // source address, and destination address. The XDMAC reads these from RAM on its own
+    // at the end of each block, so they must stay put until the chain is done.
+    struct XDMACDescriptorView1 {
+        uint32_t mbr_nda;
+        uint32_t mbr_ubc;
+        uint32_t mbr_sa;
+        uint32_t mbr_da;
+    };
+
     // DMA_XDMAC_hardware template - - MUST be specialized
     template<typename periph_t, uint8_t periph_num>
     struct DMA_XDMAC_hardware {
@@ -57,6 +83,55 @@ namespace Motate {
         static Xdmac * const xdma() { return XDMAC; };
         static constexpr IRQn_Type xdmaIRQ() { return XDMAC_IRQn; };
 
+        // The most blocks a single chained transfer may have (per channel).
+        static constexpr uint8_t maxBlocks = 4;
+
+        // Fill in descriptors for a chain of blocks, all to (or from) one peripheral address.
+        // Empty blocks are skipped. Returns how many descriptors were used.
+        static uint8_t _fillDescriptors(XDMACDescriptorView1 *descriptors,
+                                        const XDMACBlock *blocks,
+                                        const uint8_t block_count,
+                                        const uint32_t peripheral_address,
+                                        const bool memory_to_peripheral)
+        {
+            uint8_t count = 0;
+            for (uint8_t i = 0; (i < block_count) && (count < maxBlocks); i++) {
+                if (blocks[i].length == 0) { continue; }
+
+                XDMACDescriptorView1 &d = descriptors[count];
+                d.mbr_nda = (uint32_t)(&d + 1);
+                d.mbr_ubc = XDMAC_UBC_NVIEW_NDV1 | XDMAC_UBC_NDE | XDMAC_UBC_UBLEN(blocks[i].length) |
+                            (memory_to_peripheral ? XDMAC_UBC_NSEN : XDMAC_UBC_NDEN);
+                d.mbr_sa  = memory_to_peripheral ? (uint32_t)blocks[i].buffer : peripheral_address;
+                d.mbr_da  = memory_to_peripheral ? peripheral_address : (uint32_t)blocks[i].buffer;
+                count++;
+            }
+            if (count > 0) {
+                // The last one ends the list
+                descriptors[count-1].mbr_nda = 0;
+                descriptors[count-1].mbr_ubc &= ~XDMAC_UBC_NDE;
+            }
+            return count;
+        };
+
+        // How much is left in the descriptors that have not been fetched yet.
+        static uint32_t _leftInDescriptors(XdmacChid * const channel,
+                                           const XDMACDescriptorView1 *descriptors,
+                                           const uint8_t count)
+        {
+            if ((count == 0) || !(channel->XDMAC_CNDC & XDMAC_CNDC_NDE)) {
+                return 0;
+            }
+            uint32_t left = 0;
+            const XDMACDescriptorView1 *next = (const XDMACDescriptorView1 *)(channel->XDMAC_CNDA & XDMAC_CNDA_NDA_Msk);
+            for (const XDMACDescriptorView1 *d = descriptors; d < descriptors + count; d++) {
+                if (d >= next) {
+                    left += XDMAC_UBC_UBLEN(d->mbr_ubc);
+                }
+            }
+            return left;
+        };
+
         void setInterrupts(const Interrupt::Type interrupts) const
         {
             // Once it's known that interrupts are required, always have them on
@@ -87,7 +162,7 @@ namespace Motate {
     };
 
     struct _XDMACInterrupt {
-        const std::function<void(void)> interrupt_handler;
+        const Delegate<void(void)> interrupt_handler;
         uint8_t                         channel_num;
         uint32_t                        channel_mask;
         _XDMACInterrupt*                 next;
@@ -96,10 +171,10 @@ namespace Motate {
         _XDMACInterrupt &operator=(const _XDMACInterrupt &) = delete; // delete the assigment operator, we only allow moves
 
         // Note we MOVE construct this interrupt function...
-        _XDMACInterrupt(const std::function<void(void)>&& _interrupt,
+        _XDMACInterrupt(const Delegate<void(void)>&& _interrupt,
                        _XDMACInterrupt*&                  _first)
             : interrupt_handler{std::move(_interrupt)}, next{nullptr} {
-            if (interrupt_handler) {  // std::function returns false if the function isn't valid
+            if (interrupt_handler) {  // Delegate returns false if the function isn't valid
                 if (_first == nullptr) {
                     _first = this;
                     channel_num = 0;
@@ -144,14 +219,15 @@ namespace Motate {
         static constexpr uint32_t buffer_width = std::alignment_of< typename std::remove_pointer<buffer_t>::type >::value;
 
 
-        const std::function<void(Interrupt::Type)> &_xdmaCInterruptHandler;
+        const Delegate<void(Interrupt::Type)> &_xdmaCInterruptHandler;
 
         _XDMACInterrupt _tx_interrupt{
             [&]() {
                 if (_xdmaCInterruptHandler) {
                     auto CIS_hold = xdmaTxChannel()->XDMAC_CIS;
-                    Interrupt::Type cause;
-                    if (CIS_hold & XDMAC_CIS_BIS) { cause = Interrupt::OnTxTransferDone; }
+                    Interrupt::Type cause = Interrupt::Unknown;
+                    // Chained transfers only interrupt at the end of the list (LIS), single blocks at the end of the block (BIS).
+                    if (CIS_hold & (XDMAC_CIS_BIS | XDMAC_CIS_LIS)) { cause = Interrupt::OnTxTransferDone; }
                     if (CIS_hold & XDMAC_CIS_WBEIS) { cause |= Interrupt::OnTxError; }
                     _xdmaCInterruptHandler(cause);
 
@@ -167,8 +243,12 @@ namespace Motate {
             return xdma()->XDMAC_CHID + xdmaTxChannelNumber();
         };
 
+        // Descriptors for chained transfers, and how many the current chain uses (0 means it's a single block).
+        mutable XDMACDescriptorView1 _tx_descriptors[DMA_XDMAC_common::maxBlocks] {};
+        mutable uint8_t _tx_descriptor_count = 0;
+
         // we'll hold a reference to the handler, the peripheral owns the one it's passing
-        constexpr DMA_XDMAC_TX(const std::function<void(Interrupt::Type)> &handler) : _xdmaCInterruptHandler{handler} {};
+        constexpr DMA_XDMAC_TX(const Delegate<void(Interrupt::Type)> &handler) : _xdmaCInterruptHandler{handler} {};
 
         void resetTX() const
         {
@@ -182,7 +262,8 @@ namespace Motate {
             // ASSUMPTIONS:
             //  * Tx is memory to peripheral
             //  * Not doing memory-to-memory or peripheral-to-peripheral (for now)
-            //  * Single Block, Single Microblock transfers (for now)
+            //  * Single Microblock per block, with either a single block or a
+            //    linked list of blocks (view 1 descriptors, see startTXTransfer)
             //  * All peripherals are using a FIFO for Rx and Tx
             //
             // If ANY of those assumptions are wrong, this code must change!!
@@ -202,8 +283,9 @@ namespace Motate {
             XDMAC_CC_DAM_FIXED_AM        | // destination address doesn't change (FIFO)
             XDMAC_CC_PERID(xdmaTxPeripheralId()) // and finally, set the peripheral identifier
             ;
+            xdmaTxChannel()->XDMAC_CNDC = 0; // no "next descriptor"
+            _tx_descriptor_count = 0;
             // Datasheep says to clear these out explicitly:
-            //            xdmaTxChannel()->XDMAC_CNDC = 0; // no "next descriptor"
             //            xdmaTxChannel()->XDMAC_CBC = 0;  // ???
             //            xdmaTxChannel()->XDMAC_CDS_MSP = 0; // striding is disabled
             //            xdmaTxChannel()->XDMAC_CSUS = 0;
@@ -225,25 +307,48 @@ namespace Motate {
         };
         void setTx(void * const buffer, const uint32_t length) const
         {
+            xdmaTxChannel()->XDMAC_CNDC = 0; // single block
+            _tx_descriptor_count = 0;
             xdmaTxChannel()->XDMAC_CSA = (uint32_t)buffer;
             xdmaTxChannel()->XDMAC_CUBC = length;
         };
+        // Point the channel at a chain of blocks. The first descriptor is fetched when the channel is enabled.
+        // Returns false if there was nothing to send.
+        bool setTxChain(const XDMACBlock *blocks, const uint8_t count) const
+        {
+            _tx_descriptor_count = DMA_XDMAC_common::_fillDescriptors(_tx_descriptors, blocks, count, (uint32_t)xdmaPeripheralTxAddress(), true);
+            if (_tx_descriptor_count == 0) {
+                return false;
+            }
+            xdmaTxChannel()->XDMAC_CUBC = 0;
+            xdmaTxChannel()->XDMAC_CNDA = (uint32_t)_tx_descriptors;
+            xdmaTxChannel()->XDMAC_CNDC = XDMAC_CNDC_NDE_DSCR_FETCH_EN | XDMAC_CNDC_NDSUP_SRC_PARAMS_UPDATED | XDMAC_CNDC_NDVIEW_NDV1;
+            SamCommon::sync(); // the descriptors must be in RAM before the XDMAC goes looking for them
+            return true;
+        };
         void setNextTx(void * const buffer, const uint32_t length) const
         {
-            //            pdc->PERIPH_TNPR = (uint32_t)buffer;
-            //            pdc->PERIPH_TNCR = length;
+            // Appending to a running chain would race the XDMAC fetching the last descriptor.
+            // Hand all of the blocks to startTXTransfer() at once instead.
+        };
+        void flushWrite() const
+        {
+            xdmaTxChannel()->XDMAC_CNDC = 0; // drop the rest of the chain, if any
+            xdmaTxChannel()->XDMAC_CUBC = 0;
+            SamCommon::sync();
         };
         uint32_t leftToWrite(bool include_next = false) const
         {
-            //            if (include_next) {
-            //            }
             SamCommon::sync();
+            if (include_next) {
+                return xdmaTxChannel()->XDMAC_CUBC + leftToWriteNext();
+            }
             return xdmaTxChannel()->XDMAC_CUBC;
         };
+        // What's left in the blocks of the chain that haven't started yet
         uint32_t leftToWriteNext() const
         {
-            return 0;
-            //            return pdc->PERIPH_TNCR;
+            return DMA_XDMAC_common::_leftInDescriptors(xdmaTxChannel(), _tx_descriptors, _tx_descriptor_count);
         };
         bool doneWriting(bool include_next = false) const
         {
@@ -262,7 +367,7 @@ namespace Motate {
         // Bundle it all up
         bool startTXTransfer(void * const buffer, const uint32_t length, bool handle_interrupts = true, bool include_next = false) const
         {
-            if (doneWriting()) {
+            if (doneWriting(/*include_next=*/ true)) {
                 disableTx();
                 if (handle_interrupts) { stopTxDoneInterrupts(); }
                 setTx(buffer, length);
@@ -273,19 +378,63 @@ namespace Motate {
                 }
                 return false;
             }
-//            else if (include_next && doneWritingNext()) {
-//                setNextTx(buffer, length);
-//                return true;
-//            }
+            // We can't add a "next" to a running transfer, see setNextTx().
             return false;
         };
 
+        // Send a chain of blocks (up to maxBlocks) as one transfer, with one interrupt at the end.
+        bool startTXTransfer(const XDMACBlock *blocks, const uint8_t count, bool handle_interrupts = true) const
+        {
+            if (!doneWriting(/*include_next=*/ true)) {
+                return false;
+            }
+            disableTx();
+            if (handle_interrupts) { stopTxDoneInterrupts(); }
+            if (!setTxChain(blocks, count)) {
+                return false;
+            }
+            if (handle_interrupts) { startTxDoneInterrupts(); }
+            enableTx();
+            return true;
+        };
 
-        void startTxDoneInterrupts() const { xdmaTxChannel()->XDMAC_CIE = XDMAC_CIE_BIE | XDMAC_CIE_WBIE; };
-        void stopTxDoneInterrupts() const { xdmaTxChannel()->XDMAC_CID = XDMAC_CID_BID | XDMAC_CID_WBEID; };
+        // Send two regions (such as both halves of a wrapped circular buffer) as one transfer.
+        bool startTXTransfer(void * const buffer, const uint32_t length, void * const buffer2, const uint32_t length2, bool handle_interrupts = true) const
+        {
+            if (length2 == 0) {
+                return startTXTransfer(buffer, length, handle_interrupts);
+            }
+            const XDMACBlock blocks[2] = {{buffer, length}, {buffer2, length2}};
+            return startTXTransfer(blocks, 2, handle_interrupts);
+        };
+
+        // Send from a ring of blocks that never ends: the last descriptor links back to the
+        // first, and there's an interrupt at the end of each block (not just the end of the
+        // list, like a chain). The owner must refill a block before the DMA comes back around
+        // to it. Stop it with disableTx().
+        bool startTXRing(const XDMACBlock *blocks, const uint8_t count, bool handle_interrupts = true) const
+        {
+            disableTx();
+            if (handle_interrupts) { stopTxDoneInterrupts(); }
+            if (!setTxChain(blocks, count)) {
+                return false;
+            }
+            XDMACDescriptorView1 &last = _tx_descriptors[_tx_descriptor_count - 1];
+            last.mbr_nda = (uint32_t)_tx_descriptors;
+            last.mbr_ubc |= XDMAC_UBC_NDE;
+            SamCommon::sync();
+            if (handle_interrupts) { xdmaTxChannel()->XDMAC_CIE = XDMAC_CIE_BIE | XDMAC_CIE_WBIE; }
+            enableTx();
+            return true;
+        };
+
+
+        // A chain interrupts once, at the end of the list. A single block interrupts at the end of the block.
+        void startTxDoneInterrupts() const { xdmaTxChannel()->XDMAC_CIE = (_tx_descriptor_count ? XDMAC_CIE_LIE : XDMAC_CIE_BIE) | XDMAC_CIE_WBIE; };
+        void stopTxDoneInterrupts() const { xdmaTxChannel()->XDMAC_CID = XDMAC_CID_BID | XDMAC_CID_LID | XDMAC_CID_WBEID; };
 
         // XDMAC_Handler is handled with _tx_interrupt and _rx_interupt. They use
-        // the std::function _xdmaCInterruptHandler, which get's set by the peripheral
+        // the Delegate _xdmaCInterruptHandler, which get's set by the peripheral
         // in the constexpr constructor.
 
         // These two get called from the peripheral interrupt handler,
@@ -309,10 +458,11 @@ namespace Motate {
         typedef typename _hw::buffer_t buffer_t;
         static constexpr uint32_t buffer_width = std::alignment_of< typename std::remove_pointer<buffer_t>::type >::value;
 
-        const std::function<void(Interrupt::Type)> &_xdmaCInterruptHandler;
+        const Delegate<void(Interrupt::Type)> &_xdmaCInterruptHandler;
 
         _XDMACInterrupt _rx_interrupt{
             [&]() {
+                (void)xdmaRxChannel()->XDMAC_CIS; // reading CIS clears the channel's interrupt
                 if (_xdmaCInterruptHandler) {
                     _xdmaCInterruptHandler(Interrupt::OnRxTransferDone);
                 }
@@ -325,7 +475,11 @@ namespace Motate {
             return xdma()->XDMAC_CHID + xdmaRxChannelNumber();
         };
 
-        constexpr DMA_XDMAC_RX(const std::function<void(Interrupt::Type)> &handler) : _xdmaCInterruptHandler{handler} {};
+        // Descriptors for chained transfers, and how many the current chain uses (0 means it's a single block).
+        mutable XDMACDescriptorView1 _rx_descriptors[DMA_XDMAC_common::maxBlocks] {};
+        mutable uint8_t _rx_descriptor_count = 0;
+
+        constexpr DMA_XDMAC_RX(const Delegate<void(Interrupt::Type)> &handler) : _xdmaCInterruptHandler{handler} {};
 
         void resetRX() const
         {
@@ -339,7 +493,8 @@ namespace Motate {
             // ASSUMPTIONS:
             //  * Rx is from peripheral to memory
             //  * Not doing memory-to-memory or peripheral-to-peripheral (for now)
-            //  * Single Block, Single Microblock transfers (for now)
+            //  * Single Microblock per block, with either a single block or a
+            //    linked list of blocks (view 1 descriptors, see startRXTransfer)
             //  * All peripherals are using a FIFO for Rx and Tx
             //
             // If ANY of those assumptions are wrong, this code must change!!
@@ -359,8 +514,9 @@ namespace Motate {
             XDMAC_CC_DAM_INCREMENTED_AM | // destination address increments as read
             XDMAC_CC_PERID(xdmaRxPeripheralId()) // and finally, set the peripheral identifier
             ;
+            xdmaRxChannel()->XDMAC_CNDC = 0; // no "next descriptor"
+            _rx_descriptor_count = 0;
             // Datasheep says to clear these out explicitly:
-            //            xdmaRxChannel()->XDMAC_CNDC = 0; // no "next descriptor"
             //            xdmaRxChannel()->XDMAC_CBC = 0;  // ???
             //            xdmaRxChannel()->XDMAC_CDS_MSP = 0; // striding is disabled
             //            xdmaRxChannel()->XDMAC_CSUS = 0;
@@ -381,30 +537,48 @@ namespace Motate {
         };
         void setRx(void * const buffer, const uint32_t length) const
         {
+            xdmaRxChannel()->XDMAC_CNDC = 0; // single block
+            _rx_descriptor_count = 0;
             xdmaRxChannel()->XDMAC_CDA = (uint32_t)buffer;
             xdmaRxChannel()->XDMAC_CUBC = length;
         };
+        // Point the channel at a chain of blocks. The first descriptor is fetched when the channel is enabled.
+        // Returns false if there was no room given.
+        bool setRxChain(const XDMACBlock *blocks, const uint8_t count) const
+        {
+            _rx_descriptor_count = DMA_XDMAC_common::_fillDescriptors(_rx_descriptors, blocks, count, (uint32_t)xdmaPeripheralRxAddress(), false);
+            if (_rx_descriptor_count == 0) {
+                return false;
+            }
+            xdmaRxChannel()->XDMAC_CUBC = 0;
+            xdmaRxChannel()->XDMAC_CNDA = (uint32_t)_rx_descriptors;
+            xdmaRxChannel()->XDMAC_CNDC = XDMAC_CNDC_NDE_DSCR_FETCH_EN | XDMAC_CNDC_NDDUP_DST_PARAMS_UPDATED | XDMAC_CNDC_NDVIEW_NDV1;
+            SamCommon::sync(); // the descriptors must be in RAM before the XDMAC goes looking for them
+            return true;
+        };
         void setNextRx(void * const buffer, const uint32_t length) const
         {
-            //            pdc->PERIPH_RNPR = (uint32_t)buffer;
-            //            pdc->PERIPH_RNCR = length;
+            // Appending to a running chain would race the XDMAC fetching the last descriptor.
+            // Hand all of the blocks to startRXTransfer() at once instead.
         };
         void flushRead() const
         {
+            xdmaRxChannel()->XDMAC_CNDC = 0; // drop the rest of the chain, if any
             xdmaRxChannel()->XDMAC_CUBC = 0;
             SamCommon::sync();
         };
         uint32_t leftToRead(bool include_next = false) const
         {
-            //            if (include_next) {
-            //            }
             SamCommon::sync();
+            if (include_next) {
+                return xdmaRxChannel()->XDMAC_CUBC + leftToReadNext();
+            }
             return xdmaRxChannel()->XDMAC_CUBC;
         };
+        // What's left in the blocks of the chain that haven't started yet
         uint32_t leftToReadNext() const
         {
-            return 0;
-            //            return pdc->PERIPH_RNCR;
+            return DMA_XDMAC_common::_leftInDescriptors(xdmaRxChannel(), _rx_descriptors, _rx_descriptor_count);
         };
         bool doneReading(bool include_next = false) const
         {
@@ -431,7 +605,7 @@ namespace Motate {
         {
             if (0 == length) { return false; }
 
-            if (doneReading()) {
+            if (doneReading(/*include_next=*/ true)) {
                 disableRx();
                 if (handle_interrupts) { stopRxDoneInterrupts(); }
                 setRx(buffer, length);
@@ -474,12 +648,60 @@ namespace Motate {
             return (length > 0);
         };
 
+        // Receive into a chain of blocks (up to maxBlocks) as one transfer. Like the PDC's
+        // ENDRX, there's an interrupt at the end of *each* block, so the owner can tell
+        // when the DMA moves into the next region (such as a high-water region).
+        bool startRXTransfer(const XDMACBlock *blocks, const uint8_t count, bool handle_interrupts = true) const
+        {
+            if (!doneReading(/*include_next=*/ true)) {
+                return false;
+            }
+            disableRx();
+            if (handle_interrupts) { stopRxDoneInterrupts(); }
+            if (!setRxChain(blocks, count)) {
+                return false;
+            }
+            enableRx();
+            if (handle_interrupts) { startRxDoneInterrupts(); }
+            return true;
+        };
+
+        // Receive into two regions (such as both halves of a wrapped circular buffer) as one transfer.
+        bool startRXTransfer(void * const buffer, const uint32_t length, void * const buffer2, const uint32_t length2, bool handle_interrupts = true) const
+        {
+            if (length2 == 0) {
+                return startRXTransfer(buffer, length, handle_interrupts);
+            }
+            const XDMACBlock blocks[2] = {{buffer, length}, {buffer2, length2}};
+            return startRXTransfer(blocks, 2, handle_interrupts);
+        };
+
+        // Receive into a ring of blocks that never ends: the last descriptor links back to the
+        // first, and there's an interrupt at the end of each block. Nothing needs to be re-armed,
+        // so the owner must be done with a block before the DMA comes back around to it.
+        // Stop it with disableRx().
+        bool startRXRing(const XDMACBlock *blocks, const uint8_t count, bool handle_interrupts = true) const
+        {
+            disableRx();
+            if (handle_interrupts) { stopRxDoneInterrupts(); }
+            if (!setRxChain(blocks, count)) {
+                return false;
+            }
+            XDMACDescriptorView1 &last = _rx_descriptors[_rx_descriptor_count - 1];
+            last.mbr_nda = (uint32_t)_rx_descriptors;
+            last.mbr_ubc |= XDMAC_UBC_NDE;
+            SamCommon::sync();
+            enableRx();
+            if (handle_interrupts) { startRxDoneInterrupts(); }
+            return true;
+        };
+
 
         void startRxDoneInterrupts() const { xdmaRxChannel()->XDMAC_CIE = XDMAC_CIE_BIE; };
         void stopRxDoneInterrupts() const { xdmaRxChannel()->XDMAC_CID = XDMAC_CID_BID; };
 
         // XDMAC_Handler is handled with _tx_interrupt and _rx_interupt. They use
-        // the std::function _xdmaCInterruptHandler, which gets set by the peripheral
+        // the Delegate _xdmaCInterruptHandler, which gets set by the peripheral
         // in the constexpr constructor.
 
 
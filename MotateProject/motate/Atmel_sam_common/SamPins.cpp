@@ -29,72 +29,44 @@
 
 #include "MotatePins.h"
 
-using Motate::_pinChangeInterrupt;
+using Motate::_pinChangeInterruptTable;
 using Motate::ADC_Module;
 using Motate::PortHardware;
 
 template <>
-_pinChangeInterrupt* PortHardware<'A'>::_firstInterrupt = nullptr;
+_pinChangeInterruptTable PortHardware<'A'>::_interrupts {};
 extern "C" void PIOA_Handler(void) {
-    uint32_t isr = PIOA->PIO_ISR;
-
-    _pinChangeInterrupt *current = PortHardware<'A'>::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = PIOA->PIO_ISR & PIOA->PIO_IMR; // reading the ISR clears it
+    PortHardware<'A'>::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(PIOA_IRQn);
 }
 
 #ifdef PIOB
-template<> _pinChangeInterrupt * PortHardware<'B'>::_firstInterrupt = nullptr;
+template<> _pinChangeInterruptTable PortHardware<'B'>::_interrupts {};
 extern "C" void PIOB_Handler(void) {
-    uint32_t isr = PIOB->PIO_ISR;
-
-    _pinChangeInterrupt *current = PortHardware<'B'>::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = PIOB->PIO_ISR & PIOB->PIO_IMR; // reading the ISR clears it
+    PortHardware<'B'>::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(PIOB_IRQn);
 }
 #endif // PIOB
 
 #ifdef PIOC
-template<> _pinChangeInterrupt * PortHardware<'C'>::_firstInterrupt = nullptr;
+template<> _pinChangeInterruptTable PortHardware<'C'>::_interrupts {};
 extern "C" void PIOC_Handler(void) {
-    uint32_t isr = PIOC->PIO_ISR;
-
-    _pinChangeInterrupt *current = PortHardware<'C'>::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = PIOC->PIO_ISR & PIOC->PIO_IMR; // reading the ISR clears it
+    PortHardware<'C'>::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(PIOC_IRQn);
 }
 #endif // PIOC
 
 #ifdef PIOD
-template<> _pinChangeInterrupt * PortHardware<'D'>::_firstInterrupt = nullptr;
+template<> _pinChangeInterruptTable PortHardware<'D'>::_interrupts {};
 extern "C" void PIOD_Handler(void) {
-    uint32_t isr = PIOD->PIO_ISR;
-
-    _pinChangeInterrupt *current = PortHardware<'D'>::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = PIOD->PIO_ISR & PIOD->PIO_IMR; // reading the ISR clears it
+    PortHardware<'D'>::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(PIOD_IRQn);
 }
@@ -110,20 +82,13 @@ extern "C" {
 #if defined(__SAM3X8E__) || defined(__SAM3X8C__)
 namespace Motate {
     bool ADC_Module::_inited = false;
-    _pinChangeInterrupt* ADC_Module::_firstInterrupt {};
+    _pinChangeInterruptTable ADC_Module::_interrupts {};
 }
 
 extern "C"
 void ADC_Handler(void) {
-    uint32_t isr = ADC->ADC_ISR; // read it to clear the ISR
-
-    _pinChangeInterrupt *current = ADC_Module::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = ADC->ADC_ISR & ADC->ADC_IMR; // read it to clear the ISR
+    ADC_Module::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(ADC_IRQn);
 } // ADC_Handler
@@ -140,38 +105,24 @@ void ADC_Handler(void) {
 
 namespace Motate {
     template<> bool ADC_Module<0l>::_inited = false;
-    template<> _pinChangeInterrupt* ADC_Module<0l>::_firstInterrupt {};
+    template<> _pinChangeInterruptTable ADC_Module<0l>::_interrupts {};
 
     template<> bool ADC_Module<1l>::_inited = false;
-    template<> _pinChangeInterrupt* ADC_Module<1l>::_firstInterrupt {};
+    template<> _pinChangeInterruptTable ADC_Module<1l>::_interrupts {};
 }
 
 extern "C"
 void AFEC0_Handler(void) {
-    uint32_t isr = AFEC0->AFEC_ISR; // read it to clear the ISR
-
-    _pinChangeInterrupt *current = ADC_Module<0>::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = AFEC0->AFEC_ISR & AFEC0->AFEC_IMR; // read it to clear the ISR
+    ADC_Module<0>::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(AFEC0_IRQn);
 } // AFEC0_Handler
 
 extern "C"
 void AFEC1_Handler(void) {
-    uint32_t isr = AFEC1->AFEC_ISR; // read it to clear the ISR
-
-    _pinChangeInterrupt *current = ADC_Module<1>::_firstInterrupt;
-    while (current != nullptr) {
-        if ((isr & current->pc_mask) && (current->interrupt_handler)) {
-            current->interrupt_handler();
-        }
-        current = current->next;
-    }
+    uint32_t isr = AFEC1->AFEC_ISR & AFEC1->AFEC_IMR; // read it to clear the ISR
+    ADC_Module<1>::_interrupts.dispatch(isr);
 
     NVIC_ClearPendingIRQ(AFEC1_IRQn);
 } // AFEC1_Handler
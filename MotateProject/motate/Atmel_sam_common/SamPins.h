@@ -36,6 +36,10 @@
 #include "SamCommon.h"
 #include "MotateTimers.h"
 
+#include "SamPinsDMA.h"
+
+#include "MotateDelegate.h"
+
 #include <functional>   // for std::function
 #include <type_traits>
 
@@ -110,44 +114,101 @@ namespace Motate {
         kPinInterruptPriorityMask        = ((1<<10) - (1<<5))
     };
 
+    struct _pinChangeInterrupt;
+
+    // The pin change (or ADC) interrupts for one port (or ADC module), kept in a slot
+    // per bit of the status register. The interrupt handler only visits the bits that
+    // are set (and enabled), so the cost per edge doesn't grow with the number of
+    // interrupts on the port.
+    //
+    // All zeros is empty, so it's ready before any (static) constructors run.
+    struct _pinChangeInterruptTable {
+        _pinChangeInterrupt *_handlers[32]; // Each is the head of a list, for more than one on a bit
+        uint32_t _mask;                     // The bits that have any handlers
+
+        inline void add(_pinChangeInterrupt *pci);
+        inline void remove(_pinChangeInterrupt *pci);
+
+        // Call the handlers for every bit of isr, lowest bit first.
+        inline void dispatch(uint32_t isr);
+    };
+
     struct _pinChangeInterrupt {
-        const uint32_t pc_mask; // Pin uses "mask" so we use a different name. "pc" for pinChange
-        std::function<void(void)> interrupt_handler;
-        _pinChangeInterrupt *next;
+        const uint32_t pc_mask; // Pin uses "mask" so we use a different name. "pc" for pinChange -- a single bit
+        Delegate<void(void)> interrupt_handler;
+        _pinChangeInterrupt *next; // next on the same bit
+        _pinChangeInterruptTable &_table;
 
         _pinChangeInterrupt(const _pinChangeInterrupt &) = delete; // delete the copy constructor, we only allow moves
         _pinChangeInterrupt &operator=(const _pinChangeInterrupt &) = delete; // delete the assigment operator, we only allow moves
         _pinChangeInterrupt &operator=(const _pinChangeInterrupt &&) = delete; // delete the move assigment operator, we only allow moves
 
 
-        _pinChangeInterrupt(const uint32_t _mask, std::function<void(void)> &&_interrupt, _pinChangeInterrupt *&_first)
-            : pc_mask{_mask}, interrupt_handler{std::move(_interrupt)}, next{nullptr}
+        _pinChangeInterrupt(const uint32_t _mask, Delegate<void(void)> &&_interrupt, _pinChangeInterruptTable &table)
+            : pc_mask{_mask}, interrupt_handler{std::move(_interrupt)}, next{nullptr}, _table{table}
         {
-//            if (interrupt_handler) { // std::function returns false if the function isn't valid
-                if (_first == nullptr) {
-                    _first = this;
-                    return;
-                }
-
-                _pinChangeInterrupt *i = _first;
-                while (i->next != nullptr) {
-                    i = i->next;
-                }
-                i->next = this;
-//            }
+            _table.add(this);
         };
 
-        void setInterrupt(std::function<void(void)> &&_interrupt)
-        {
-            interrupt_handler = std::move(_interrupt);
+        ~_pinChangeInterrupt() {
+            _table.remove(this);
         };
 
-        void setInterrupt(const std::function<void(void)> &_interrupt)
+        void setInterrupt(const Delegate<void(void)> &_interrupt)
         {
             interrupt_handler = _interrupt;
         };
     };
 
+    void _pinChangeInterruptTable::add(_pinChangeInterrupt *pci) {
+        const uint32_t bit = __builtin_ctz(pci->pc_mask);
+        SamCommon::InterruptDisabler disabler;
+
+        // Add to the end, so handlers on the same bit are called in the order they were made
+        _pinChangeInterrupt **link = &_handlers[bit];
+        while (*link != nullptr) {
+            if (*link == pci) {
+                return; // already here
+            }
+            link = &(*link)->next;
+        }
+        pci->next = nullptr;
+        *link = pci;
+        _mask |= pci->pc_mask;
+    };
+
+    void _pinChangeInterruptTable::remove(_pinChangeInterrupt *pci) {
+        const uint32_t bit = __builtin_ctz(pci->pc_mask);
+        SamCommon::InterruptDisabler disabler;
+
+        _pinChangeInterrupt **link = &_handlers[bit];
+        while (*link != nullptr) {
+            if (*link == pci) {
+                *link = pci->next;
+                pci->next = nullptr;
+                break;
+            }
+            link = &(*link)->next;
+        }
+        if (_handlers[bit] == nullptr) {
+            _mask &= ~pci->pc_mask;
+        }
+    };
+
+    void _pinChangeInterruptTable::dispatch(uint32_t isr) {
+        isr &= _mask;
+        while (isr) {
+            const uint32_t bit = __builtin_ctz(isr);
+            isr &= isr - 1; // clear the lowest set bit
+
+            for (_pinChangeInterrupt *pci = _handlers[bit]; pci != nullptr; pci = pci->next) {
+                if (pci->interrupt_handler) {
+                    pci->interrupt_handler();
+                }
+            }
+        }
+    };
+
     typedef uint32_t uintPort_t;
 
 #pragma mark PortHardware
@@ -210,7 +271,7 @@ namespace Motate {
         };
 
 
-        static _pinChangeInterrupt *_firstInterrupt;
+        static _pinChangeInterruptTable _interrupts;
 
         void setModes(const PinMode type, const uintPort_t mask) {
             switch (type) {
@@ -477,15 +538,7 @@ namespace Motate {
         };
 
         void addInterrupt(_pinChangeInterrupt *newInt) {
-            _pinChangeInterrupt *i = _firstInterrupt;
-            if (i == nullptr) {
-                _firstInterrupt = newInt;
-                return;
-            }
-            while (i->next != nullptr) {
-                i = i->next;
-            }
-            i->next = newInt;
+            _interrupts.add(newInt);
         };
     };
 
@@ -555,7 +608,7 @@ namespace Motate {
         float _vref = _default_vref;
 
         static bool _inited;
-        static _pinChangeInterrupt *_firstInterrupt;
+        static _pinChangeInterruptTable _interrupts;
 
         void init(const uint32_t adc_clock_frequency, const uint8_t adc_startuptime) {
             if (_inited) {
@@ -695,15 +748,7 @@ namespace Motate {
         };
 
         void addInterrupt(_pinChangeInterrupt *newInt) {
-            _pinChangeInterrupt *i = _firstInterrupt;
-            if (i == nullptr) {
-                _firstInterrupt = newInt;
-                return;
-            }
-            while (i->next != nullptr) {
-                i = i->next;
-            }
-            i->next = newInt;
+            _interrupts.add(newInt);
         };
     };
 
@@ -714,6 +759,67 @@ namespace Motate {
             static constexpr uint32_t adcNumber = adcNum; \
         };
 
+#pragma mark ADCSampler support (Sam3x)
+
+    // The hardware half of ADCSampler (see MotateADCSampler.h): conversions of the enabled
+    // channels start on each rising edge of TIOA of a timer, and the PDC moves them into a
+    // ring of two blocks. ENDRX (through ADC_Handler) marks the end of each block.
+    template<uint8_t adcNum>
+    struct _ADCSamplerHardware {
+        static_assert(adcNum == 0, "_ADCSamplerHardware<n>: the Sam3x only has ADC 0");
+
+        // With the TAG enabled, the PDC moves ADC_LCDR as a half-word: the channel is in bits 15:12
+        typedef uint16_t sample_t;
+        static constexpr uint8_t channelCount = 16;
+        static uint8_t sampleChannel(const sample_t sample) { return sample >> 12; };
+        static int32_t sampleValue(const sample_t sample) { return sample & 0x0FFF; };
+
+        ADC_Module adc;
+        DMA<Adc*, adcNum> dma;
+        _pinChangeInterrupt _endOfBlockInterrupt;
+
+        _ADCSamplerHardware(Delegate<void(void)> &&blockDone)
+            : _endOfBlockInterrupt{ADC_ISR_ENDRX, std::move(blockDone), ADC_Module::_interrupts} {};
+
+        void setChannels(const uint32_t channelMask) {
+            ADC->ADC_CHDR = ~channelMask & 0xFFFF;
+            ADC->ADC_CHER = channelMask;
+            ADC->ADC_EMR |= ADC_EMR_TAG;
+        };
+
+        template<uint8_t timerNum>
+        void start(sample_t *blockA, sample_t *blockB, const uint16_t length) {
+            static_assert(timerNum < 3, "_ADCSamplerHardware: the Sam3x ADC can only be triggered by TIOA of Timer<0> through Timer<2>");
+
+            dma.disableRx();
+            dma.setRx(blockA, length);
+            dma.setNextRx(blockB, length);
+            dma.enableRx();
+
+            ADC->ADC_MR = (ADC->ADC_MR & ~(ADC_MR_TRGSEL_Msk | ADC_MR_FREERUN)) |
+                          ADC_MR_TRGEN | ((1 + timerNum) << ADC_MR_TRGSEL_Pos);
+
+            dma.startRxDoneInterrupts();
+            NVIC_EnableIRQ(ADC_IRQn);
+        };
+
+        void stop() {
+            ADC->ADC_MR &= ~ADC_MR_TRGEN;
+            dma.stopRxDoneInterrupts();
+            dma.disableRx();
+        };
+
+        // Called from the interrupt with the block that was just filled, to hand it back to the PDC.
+        // Returns false if the other block was already full too, and the PDC stopped.
+        bool blockDone(sample_t *block, const uint16_t length) {
+            if (dma.doneReading()) {
+                return false;
+            }
+            dma.setNextRx(block, length);
+            return true;
+        };
+    };
+
 #else // not Sam3x
 
 #pragma mark ADC_Module/ACD_Pin (SamS70)
@@ -759,7 +865,7 @@ namespace Motate {
         static constexpr bool is_real = true;
 
         static bool _inited;
-        static _pinChangeInterrupt *_firstInterrupt;
+        static _pinChangeInterruptTable _interrupts;
 
         void init(const uint32_t adc_clock_frequency, const uint8_t adc_startuptime) {
             if (_inited) {
@@ -1049,15 +1155,7 @@ namespace Motate {
         };
 
         void addInterrupt(_pinChangeInterrupt *newInt) {
-            _pinChangeInterrupt *i = _firstInterrupt;
-            if (i == nullptr) {
-                _firstInterrupt = newInt;
-                return;
-            }
-            while (i->next != nullptr) {
-                i = i->next;
-            }
-            i->next = newInt;
+            _interrupts.add(newInt);
         };
     };
 
@@ -1068,6 +1166,59 @@ namespace Motate {
             static constexpr uint32_t adcNumber = adcNum; \
         };
 
+#pragma mark ADCSampler support (SamS70)
+
+    // The hardware half of ADCSampler (see MotateADCSampler.h): conversions of the enabled
+    // channels start on each rising edge of TIOA of a timer, and the XDMAC moves them into a
+    // ring of two blocks that it follows forever, with an interrupt at the end of each block.
+    template<uint8_t afecNum>
+    struct _ADCSamplerHardware {
+        // With the TAG enabled, AFEC_LCDR has the channel in bits 27:24
+        typedef uint32_t sample_t;
+        static constexpr uint8_t channelCount = 12;
+        static uint8_t sampleChannel(const sample_t sample) { return (sample & AFEC_LCDR_CHNB_Msk) >> AFEC_LCDR_CHNB_Pos; };
+        static int32_t sampleValue(const sample_t sample) { return sample & AFEC_LCDR_LDATA_Msk; };
+
+        ADC_Module<afecNum> adc;
+        const Delegate<void(void)> _blockDone;
+        const Delegate<void(Interrupt::Type)> _dmaInterruptHandler;
+        DMA<Afec*, afecNum> dma;
+
+        _ADCSamplerHardware(Delegate<void(void)> &&blockDone)
+            : _blockDone{std::move(blockDone)},
+              _dmaInterruptHandler{[&](Interrupt::Type hint) { _blockDone(); }},
+              dma{_dmaInterruptHandler} {};
+
+        void setChannels(const uint32_t channelMask) {
+            adc.afec()->AFEC_CHDR = ~channelMask & 0x0FFF;
+            adc.afec()->AFEC_CHER = channelMask;
+        };
+
+        template<uint8_t timerNum>
+        void start(sample_t *blockA, sample_t *blockB, const uint16_t length) {
+            static_assert((timerNum / 3) == afecNum, "_ADCSamplerHardware: AFEC0 can only be triggered by TIOA of Timer<0> through Timer<2>, and AFEC1 by Timer<3> through Timer<5>");
+
+            const XDMACBlock blocks[2] = {{blockA, length}, {blockB, length}};
+            dma.reset();
+            dma.setInterrupts(Interrupt::OnRxTransferDone);
+            dma.startRXRing(blocks, 2);
+
+            adc.afec()->AFEC_MR = (adc.afec()->AFEC_MR & ~(AFEC_MR_TRGSEL_Msk | AFEC_MR_FREERUN)) |
+                                  AFEC_MR_TRGEN | AFEC_MR_TRGSEL(1 + (timerNum % 3));
+        };
+
+        void stop() {
+            adc.afec()->AFEC_MR &= ~AFEC_MR_TRGEN;
+            dma.stopRxDoneInterrupts();
+            dma.disableRx();
+        };
+
+        // The XDMAC ring never needs re-arming, and never stops, so there's nothing to tell.
+        bool blockDone(sample_t *block, const uint16_t length) {
+            return true;
+        };
+    };
+
 #endif
 
 //    template<pin_number negPinNum, pin_number posPinNum>
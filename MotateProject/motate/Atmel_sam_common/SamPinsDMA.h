@@ -0,0 +1,133 @@
+/*
+ SamPinsDMA.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SAMPINS_H_ONCE
+#error This file should ONLY be included from SamPins.h, and never included directly
+#endif
+
+#include "SamDMA.h"
+
+namespace Motate {
+#if defined(HAS_PDC) && defined(PDC_ADC)
+
+#pragma mark DMA_PDC ADC implementation
+
+    // The Sam3x ADC has a single PDC receive channel, reading ADC_LCDR as half-words.
+    template<uint8_t adcPeripheralNumber>
+    struct DMA_PDC_hardware<Adc*, adcPeripheralNumber> {
+        static_assert(adcPeripheralNumber == 0, "DMA_PDC_hardware<Adc*, n>: there is only ADC 0");
+
+        static constexpr RegisterPtr<SEPARATE_OFF_CAST(ADC)> adc{};
+        static constexpr RegisterPtr<SEPARATE_OFF_CAST(PDC_ADC)> pdc{};
+
+        typedef uint16_t* buffer_t;
+
+        void startRxDoneInterrupts(const bool include_next = false) const {
+            adc->ADC_IER = include_next ? ADC_IER_RXBUFF : ADC_IER_ENDRX;
+        };
+        void stopRxDoneInterrupts(const bool include_next = false) const {
+            adc->ADC_IDR = include_next ? ADC_IDR_RXBUFF : ADC_IDR_ENDRX;
+        };
+        // There's no transmit side
+        void startTxDoneInterrupts(const bool include_next = true) const {};
+        void stopTxDoneInterrupts(const bool include_next = true) const {};
+
+        int16_t readByte() const {
+            return -1; // conversions are read as they're made, not a byte at a time
+        }
+
+        bool inRxBufferFullInterrupt() const
+        {
+            const uint32_t imr = adc->ADC_IMR;
+            return (imr & (ADC_IMR_RXBUFF | ADC_IMR_ENDRX)) && (adc->ADC_ISR & imr & (ADC_ISR_RXBUFF | ADC_ISR_ENDRX));
+        }
+
+        bool inTxBufferEmptyInterrupt() const
+        {
+            return false;
+        }
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<Adc*, periph_num> : DMA_PDC<Adc*, periph_num> {
+        // The ADC's interrupts are dispatched by ADC_Handler (see ADC_Module), so there's no handler to take
+        constexpr DMA() : DMA_PDC<Adc*, periph_num>{} {};
+    };
+#endif // ADC + PDC
+
+#if defined(AFEC0) && defined(XDMAC)
+
+#pragma mark DMA_XDMAC AFEC implementation
+
+    template<uint8_t afecNum>
+    struct DMA_XDMAC_hardware<Afec*, afecNum>
+    {
+        static constexpr Afec * const afec() { return afecNum == 0 ? AFEC0 : AFEC1; };
+
+        // With the TAG enabled, AFEC_LCDR has the channel number in the top half, so take the whole word
+        typedef uint32_t* buffer_t;
+    };
+
+    template<uint8_t afecNum>
+    struct DMA_XDMAC_RX_hardware<Afec*, afecNum> : virtual DMA_XDMAC_hardware<Afec*, afecNum>, virtual DMA_XDMAC_common {
+        using DMA_XDMAC_hardware<Afec*, afecNum>::afec;
+
+        static constexpr uint8_t const xdmaRxPeripheralId()
+        {
+            return (afecNum == 0) ? 35 : 36;
+        };
+        static constexpr volatile void * const xdmaPeripheralRxAddress()
+        {
+            return &(afec()->AFEC_LCDR);
+        };
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<Afec*, periph_num> : DMA_XDMAC_RX<Afec*, periph_num> {
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<Afec*, periph_num>{handler} {};
+
+        void setInterrupts(const Interrupt::Type interrupts) const
+        {
+            DMA_XDMAC_common::setInterrupts(interrupts);
+
+            if (interrupts != Interrupt::Off) {
+                if (interrupts & Interrupt::OnRxTransferDone) {
+                    DMA_XDMAC_RX<Afec*, periph_num>::startRxDoneInterrupts();
+                } else {
+                    DMA_XDMAC_RX<Afec*, periph_num>::stopRxDoneInterrupts();
+                }
+            }
+        };
+
+        void reset() const {
+            DMA_XDMAC_RX<Afec*, periph_num>::resetRX();
+        };
+    };
+#endif // AFEC + XDMAC
+} // namespace Motate
@@ -31,9 +31,9 @@
 #include "MotateSPI.h"
 
 namespace Motate {
-    template<> std::function<void()> _SPIHardware<0>::_spiInterruptHandlerJumper {};
+    template<> Delegate<void()> _SPIHardware<0>::_spiInterruptHandlerJumper {};
 #if defined(HAS_SPI1)
-    template<> std::function<void()> _SPIHardware<1>::_spiInterruptHandlerJumper {};
+    template<> Delegate<void()> _SPIHardware<1>::_spiInterruptHandlerJumper {};
 #endif // HAS_SPI1
 }
 
@@ -55,11 +55,19 @@ namespace Motate {
         static constexpr auto spiIRQ = info::IRQ;
         static constexpr auto spiPeripheralNum = spiPeripheralNumber;
 
-        std::function<void(Interrupt::Type)> _spiInterruptHandler;
+        // How many messages startTransfer() can chain into one transfer. The XDMAC follows a
+        // linked list of descriptors on its own; the others get one message per transfer.
+#if !defined(CAN_SPI_PDC_DMA) && defined(XDMAC)
+        static constexpr uint8_t maxChainedTransfers = DMA_XDMAC_common::maxBlocks;
+#else
+        static constexpr uint8_t maxChainedTransfers = 1;
+#endif
+
+        Delegate<void(Interrupt::Type)> _spiInterruptHandler;
 
         DMA<SPI_tag, spiPeripheralNumber> dma {_spiInterruptHandler};
 
-        static std::function<void()> _spiInterruptHandlerJumper;
+        static Delegate<void()> _spiInterruptHandlerJumper;
         _SPIHardware() {
             SamCommon::enablePeripheralClock(peripheralId);
 
@@ -308,7 +316,7 @@ namespace Motate {
 #endif // temporarily removed read/write/transfer
 
 
-        void setInterruptHandler(std::function<void(Interrupt::Type)> &&handler) {
+        void setInterruptHandler(Delegate<void(Interrupt::Type)> &&handler) {
             _spiInterruptHandler = std::move(handler);
         }
 
@@ -418,11 +426,12 @@ namespace Motate {
             return count;
         };
 
+        // These include the rest of a chain, if there is one
         bool doneWriting() {
-            return dma.doneWriting();
+            return dma.doneWriting(/*include_next=*/ true);
         };
         bool doneReading() {
-            return dma.doneReading();
+            return dma.doneReading(/*include_next=*/ true);
         };
 
         // start transfer of message
@@ -460,6 +469,103 @@ namespace Motate {
             return rx_is_setup | tx_is_setup;
         }
 
+        // start transfer of count (up to maxChainedTransfers) messages, back-to-back with CS
+        // held, with one interrupt at the end
+        bool startTransfer(const SPITransferBlock *blocks, const uint8_t count) {
+            if (count == 1) {
+                return startTransfer(blocks[0].tx_buffer, blocks[0].rx_buffer, blocks[0].size);
+            }
+#if !defined(CAN_SPI_PDC_DMA) && defined(XDMAC)
+            // A nullptr buffer gets the same treatment as in a single transfer
+            XDMACBlock rx_blocks[maxChainedTransfers];
+            XDMACBlock tx_blocks[maxChainedTransfers];
+            for (uint8_t i = 0; i < count; i++) {
+                rx_blocks[i] = {blocks[i].rx_buffer, blocks[i].size};
+                tx_blocks[i] = {blocks[i].tx_buffer, blocks[i].size};
+            }
+
+            dma.setInterrupts(Interrupt::Off);
+            // The RX chain interrupts at the end of each block, but doneReading() holds off the
+            // bus until the last one.
+            if (!dma.startRXTransfer(rx_blocks, count, /*handle_interrupts=*/ false)) {
+                return false; // fail early
+            }
+            if (!dma.startTXTransfer(tx_blocks, count, /*handle_interrupts=*/ false)) {
+                return false;
+            }
+            dma.setInterrupts(Interrupt::OnRxTransferDone);
+            enable();
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // Streaming (see SPIStream): frames of frame_size clocked back to back, with CS held,
+        // into a ring of frame_count frames at ring, with an interrupt (OnRxTransferDone) at
+        // the end of each. Every frame sends tx_frame.
+        //
+        // The XDMAC runs the ring on its own. The DMAC can't, so ringFrameDone() starts each
+        // frame from the interrupt, and there's a gap of the interrupt latency between them.
+        // streamFramesInFlight is how many frames past the one that just finished the DMA may
+        // be writing to before the next interrupt is handled.
+#if !defined(CAN_SPI_PDC_DMA) && defined(XDMAC)
+        static constexpr uint8_t maxRingFrames = DMA_XDMAC_common::maxBlocks;
+        static constexpr uint8_t streamFramesInFlight = 2;
+#else
+        static constexpr uint8_t maxRingFrames = 255;
+        static constexpr uint8_t streamFramesInFlight = 1;
+#endif
+
+        bool startRing(const uint8_t *tx_frame, uint8_t *ring, const uint16_t frame_size, const uint8_t frame_count) {
+#if !defined(CAN_SPI_PDC_DMA) && defined(XDMAC)
+            if (frame_count > maxRingFrames) {
+                return false;
+            }
+            XDMACBlock rx_blocks[maxRingFrames];
+            XDMACBlock tx_blocks[maxRingFrames];
+            for (uint8_t i = 0; i < frame_count; i++) {
+                rx_blocks[i] = {ring + (i * frame_size), frame_size};
+                tx_blocks[i] = {(void *)tx_frame, frame_size};
+            }
+
+            dma.setInterrupts(Interrupt::Off);
+            if (!dma.startRXRing(rx_blocks, frame_count, /*handle_interrupts=*/ true)) {
+                return false;
+            }
+            if (!dma.startTXRing(tx_blocks, frame_count, /*handle_interrupts=*/ false)) {
+                return false;
+            }
+            enable();
+            return true;
+#else
+            return startTransfer((uint8_t *)tx_frame, ring, frame_size);
+#endif
+        };
+
+        // Called from the end-of-frame interrupt with the frame streamFramesInFlight past the
+        // one that finished. Returns false if the ring stopped, and has to be started again.
+        bool ringFrameDone(const uint8_t *tx_frame, uint8_t *next_frame, const uint16_t frame_size) {
+#if !defined(CAN_SPI_PDC_DMA) && defined(XDMAC)
+            return true;
+#else
+            if (!doneReading() || !doneWriting()) {
+                return true; // not actually done yet
+            }
+            return startTransfer((uint8_t *)tx_frame, next_frame, frame_size);
+#endif
+        };
+
+        // Stop a ring (or a single transfer) at once, dropping the frame in flight.
+        void stopRing() {
+            dma.setInterrupts(Interrupt::Off);
+            dma.reset(); // disables, too
+#if !defined(CAN_SPI_PDC_DMA) && defined(XDMAC)
+            dma.flushRead();
+            dma.flushWrite();
+#endif
+        };
+
         // abort transfer of message
         // TODO
 
@@ -99,7 +99,7 @@ namespace Motate {
         // nothing to do here, except for a constxpr constructor
         // we take the handler, but we don't actually handle interrupts for the peripheral
         // so we ignore it
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_PDC<SPI_tag, periph_num>{} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_PDC<SPI_tag, periph_num>{} {};
     };
 
     #elif defined (XDMAC)
@@ -156,7 +156,7 @@ namespace Motate {
     template<uint8_t periph_num>
     struct DMA<SPI_tag, periph_num> : DMA_XDMAC_RX<SPI_tag, periph_num>, DMA_XDMAC_TX<SPI_tag, periph_num> {
         // nothing to do here, except for a constxpr constructor
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<SPI_tag, periph_num>{handler}, DMA_XDMAC_TX<SPI_tag, periph_num>{handler} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<SPI_tag, periph_num>{handler}, DMA_XDMAC_TX<SPI_tag, periph_num>{handler} {};
 
         using DMA_XDMAC_common::xdma;
         using rx = DMA_XDMAC_RX<SPI_tag, periph_num>;
@@ -258,7 +258,7 @@ namespace Motate {
     template<uint8_t periph_num>
     struct DMA<SPI_tag, periph_num> : DMA_DMAC_RX<SPI_tag, periph_num>, DMA_DMAC_TX<SPI_tag, periph_num> {
         // nothing to do here, except for a constxpr constructor
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_DMAC_RX<SPI_tag, periph_num>{handler}, DMA_DMAC_TX<SPI_tag, periph_num>{handler} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_DMAC_RX<SPI_tag, periph_num>{handler}, DMA_DMAC_TX<SPI_tag, periph_num>{handler} {};
 
         using DMA_DMAC_common::dmac;
         using rx = DMA_DMAC_RX<SPI_tag, periph_num>;
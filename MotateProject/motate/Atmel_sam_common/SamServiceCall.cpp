@@ -38,7 +38,9 @@ extern "C" {
 
 namespace Motate {
     //volatile uint32_t _internal_pendsv_handler_number = 0;
-    std::atomic<ServiceCallEvent *> ServiceCallEvent::_first_service_call = nullptr;
+    std::atomic<ServiceCallEvent *> ServiceCallEvent::_ready_lists[ServiceCallEvent::kPriorityLevels] {};
+    std::atomic<uint32_t> ServiceCallEvent::_ready_levels {0};
+    ServiceCallEvent *ServiceCallEvent::_dispatch_lists[ServiceCallEvent::kPriorityLevels] {};
 
     // // We'll support just ten for now. These take up space when not using LTO.
     // template<> void ServiceCall<  0 >::interrupt() __attribute__ ((weak));
@@ -124,7 +126,5 @@ if (Motate::_internal_pendsv_handler_number == n) {\
 
 void PendSV_Handler() {
     Motate::SamCommon::sync();
-    if (Motate::ServiceCallEvent::_first_service_call) {
-        Motate::ServiceCallEvent::_first_service_call.load()->_call_from_handler();
-    }
+    Motate::ServiceCallEvent::_call_from_handler();
 }
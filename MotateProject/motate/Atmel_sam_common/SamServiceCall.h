@@ -53,156 +53,71 @@ namespace Motate {
     //extern volatile uint32_t _internal_pendsv_handler_number;
 
     struct ServiceCallEvent {
+        // The ready queue:
+        //
+        // There is one ready list per NVIC priority level, plus a bitmap (_ready_levels)
+        // with a bit set for every level that has calls waiting. Bit 31 is priority 0,
+        // so CLZ (__builtin_clz, a single instruction) of the bitmap is the highest
+        // priority level with work to do.
+        //
+        // Each ready list is an intrusive lock-free stack: queueing is one CAS, and can
+        // be done from any interrupt level. PendSV_Handler is the only consumer -- when
+        // a level's _dispatch_list runs dry it takes that level's whole ready list with
+        // one exchange and reverses it, so calls at the same level still happen in the
+        // order they were made.
+        //
+        // Queueing is one CAS however many calls are pending. Dispatching is amortized
+        // constant time, not constant: most dispatches just pop the dispatch list, but the
+        // one that refills it walks (and reverses) every call that was waiting at that
+        // level. So one dispatch can take time in proportion to the calls pending at its
+        // level -- at most the number of ServiceCallEvents there, since each can only be
+        // queued once at a time. PendSV is always pended at the priority of the
+        // highest-priority call waiting.
+
+        // REMEMBER: "higher priority" means a lower number!!!
+        //           0 is the highest priority!
+        static constexpr int32_t kPriorityLevels = 1 << __NVIC_PRIO_BITS;
+
         ServiceCallEventHandler *handler_;
         std::atomic<ServiceCallEvent *> _next = nullptr;
         std::atomic<bool> _queued = false;
-        std::atomic<bool> _pended = false;
 
-        static std::atomic<ServiceCallEvent *> _first_service_call; // the pointer is volatile
+        static std::atomic<ServiceCallEvent *> _ready_lists[kPriorityLevels];
+        static std::atomic<uint32_t> _ready_levels;
+        static ServiceCallEvent *_dispatch_lists[kPriorityLevels]; // only touched from PendSV_Handler
 
         uint32_t _interrupt_level = kInterruptPriorityLowest; // start at the lowest
         // we need to convert the enum to a priority value we can compare with
         int32_t _priority_value = 4;
 
+        static constexpr uint32_t _levelBit(const int32_t level) { return 0x80000000u >> level; };
+
         void _call_or_queue() {
-            if (_queued) {
+            if (_queued.exchange(true)) {
+                // Already queued -- it'll get called.
                 _debug_print_num(); svc_call_debug("💣");
                 return;
             }
 
-            _queued = true;
-            _next = nullptr;
-
-            // Things we know:
-            //   We are already in the highest priority ServiceCall or interrrupt, or we would have been interrupted.
-            //   We might get interrupted.
-
-            // This we need to know:
-            //  What is the current priority, either as an interrupt, or as BASEPRI?
-            //  What is the target priority?
-
-            // Then we can follow this plan:
-            //   If we are requesting a higher priority, we raise BASEPRI and call it.
-            //   If we are requesting the same priority, we queue and pend the task
-            //   If we are requesting a lower priority, we queue and pend the task
-
-            // Queuing a task:
-            //   Add the item to the linked list
-
-            // Pending a task:
-            //   If the queue is empty or has only lower-priority tasks, we set the priority of pendSV and pend it
-
-            // Handling pendSV:
-            //   Pop the highest priority item off of the list, call it
-
-            bool needs_pended = false;
-
-            // Thanks to http://embeddedgurus.com/state-space/2014/02/cutting-through-the-confusion-with-arm-cortex-m-interrupt-priorities/
-            // for explaining __get_BASEPRI and __set_BASEPRI needing shifted.
-
-            // REMEMBER: "higher priority" means a lower number!!!
-            //           0 is the highest priority!
-
-//             int32_t current_basepri = __get_BASEPRI() >> (8 - __NVIC_PRIO_BITS);
-//             int32_t effective_priority_level = current_basepri;
-// //            bool in_pendsv_irq = false;
-
-//             // get the currently highest-priority active "exception" (interrupt)
-//             // see http://infocenter.arm.com/help/index.jsp?topic=/com.arm.doc.dui0552a/CHDBIBGJ.html
-//             // NOTE: it's signed!
-//             int32_t active_interrupt_number = (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) >> SCB_ICSR_VECTACTIVE_Pos;
-//             if (active_interrupt_number != 0) {
-//                 // See note in previous link: we need to subtract 16 from the interrupt number to get the IRQn_Type
-//                 IRQn_Type active_irq = (IRQn_Type)(active_interrupt_number - 16);
-
-//                 int32_t interrupt_priority_level = NVIC_GetPriority(active_irq);
-//                 if (interrupt_priority_level < effective_priority_level) {
-//                     effective_priority_level = interrupt_priority_level;
-//                 }
-// //
-// //                if (PendSV_IRQn == active_irq) {
-// //                    in_pendsv_irq = true;
-// //                }
-//             }
-
-            // if (_priority_value < effective_priority_level) {
-            //     // we are asking for a higher priority, so we elevate BASEPI, call, reset BASEPRI, and return
-
-            //     __set_BASEPRI(_priority_value << (8 - __NVIC_PRIO_BITS));
-            //     svc_call_debug("🛫");
-            //     switch(_priority_value) {
-            //         case 0: svc_call_debug("⇈"); break;
-            //         case 1: svc_call_debug("⇡"); break;
-            //         case 2: svc_call_debug("⦿"); break;
-            //         case 3: svc_call_debug("⇣"); break;
-            //         case 4: svc_call_debug("⇊"); break;
-            //         default: svc_call_debug("?"); break;
-            //     }
-
-            //     _call();
-
-            //     svc_call_debug("🛬");
-            //     __set_BASEPRI(current_basepri << (8 - __NVIC_PRIO_BITS));
-
-            //     return;
-            // }
-
-            // else if (_priority_value == effective_priority_level) {
-            //     // we are asking for the same priority, so just call it and return
-            //     _call();
-            //     return;
-            // }
+            const int32_t level = _priority_value;
 
+            ServiceCallEvent *orig_first_service_call = _ready_lists[level].load(std::memory_order_relaxed);
             do {  // loop until it works
-                // SamCommon::InterruptDisabler disabler;
-
-                auto orig_first_service_call = _first_service_call.load();
-                // Again, higher _priority_value is lower priority!
-                if (true || orig_first_service_call == nullptr || orig_first_service_call->_priority_value > _priority_value) {
-                    if (!_first_service_call.compare_exchange_weak(orig_first_service_call, this)) {
-                        continue;  // something changed out from under us, try again
-                    }
-                    _next = orig_first_service_call;
-
-                    _debug_print_num();
-                    svc_call_debug("✂️");
+                _next.store(orig_first_service_call, std::memory_order_relaxed);
+            } while (!_ready_lists[level].compare_exchange_weak(orig_first_service_call, this,
+                                                                std::memory_order_release,
+                                                                std::memory_order_relaxed));
 
-                    needs_pended = true;
-                } else {
-                    ServiceCallEvent* walker = orig_first_service_call;
-                    ServiceCallEvent* next   = nullptr;
-                    while ((next = walker->_next) != nullptr) {
-                        // // put this in front of lower priority tasks
-                        // // Again, higher _priority_value is lower priority!
-                        // if (next->_priority_value > _priority_value) {
-                        //     if (walker == orig_first_service_call) {
-                        //         needs_pended = true;
-                        //     }
-                        //     break;
-                        // }
-                        walker = next;
-                    }
+            // The bit is set *after* the push, so if PendSV sees the bit it'll find the call.
+            _ready_levels.fetch_or(_levelBit(level), std::memory_order_release);
 
-                    _next = next;
-                    if (!walker->_next.compare_exchange_weak(next, this)) {
-                        continue;  // something changed out from under us, try again
-                    }
-                    // if (walker == _first_service_call) {
-                        needs_pended = true;
-                    // }
-                }
-            } while (0);
+            _debug_print_num(); svc_call_debug("✂️");
 
-            // If the first_service_call's priority is lower (has a higher number)
-            // then we'll pend another PendSV to esure the correct level.
-            if (needs_pended) {
-                _pend();
-            }
+            _pend();
         };
 
         // We were queued and pended, then called.
         void _call() {
-            _pended = false;
             #if 0
             // If we are here then we are in the interrupt context
             _debug_print_num(); svc_call_debug("☎️");
@@ -248,47 +163,80 @@ namespace Motate {
             _debug_print_num(); svc_call_debug("🎉\n");
         };
 
+        // Clear the bit for level if there's nothing left there. A call queued while we
+        // do this will either be seen by the re-check, or set the bit itself afterward.
+        static void _clearLevelIfEmpty(const int32_t level) {
+            if (_dispatch_lists[level] != nullptr) {
+                return;
+            }
+            _ready_levels.fetch_and(~_levelBit(level), std::memory_order_acq_rel);
+            if (_ready_lists[level].load(std::memory_order_acquire) != nullptr) {
+                _ready_levels.fetch_or(_levelBit(level), std::memory_order_release);
+            }
+        };
+
         // This is called *ONLY* from the handler (in the .cpp file)
-        void _call_from_handler() {
-            ServiceCallEvent* first_service_call;
-            while ((first_service_call = _first_service_call.load()) != nullptr) {
-                if (!_first_service_call.compare_exchange_weak(first_service_call, first_service_call->_next)) {
-                    continue; // it changed, try again
+        // Call the first of the highest-priority calls waiting, then re-pend for the rest.
+        static void _call_from_handler() {
+            uint32_t ready_levels;
+            while ((ready_levels = _ready_levels.load(std::memory_order_acquire)) != 0) {
+                const int32_t level = __builtin_clz(ready_levels);
+
+                if (_dispatch_lists[level] == nullptr) {
+                    ServiceCallEvent *ready = _ready_lists[level].exchange(nullptr, std::memory_order_acquire);
+                    while (ready != nullptr) {
+                        ServiceCallEvent *next = ready->_next.load(std::memory_order_relaxed);
+                        ready->_next.store(_dispatch_lists[level], std::memory_order_relaxed);
+                        _dispatch_lists[level] = ready;
+                        ready = next;
+                    }
                 }
-                first_service_call->_next = nullptr;
-                first_service_call->_call();
 
-                first_service_call = _first_service_call.load();
-                if (first_service_call != nullptr) {
-                    first_service_call->_pend();
+                ServiceCallEvent *first_service_call = _dispatch_lists[level];
+                if (first_service_call == nullptr) {
+                    // The bit was set by a call that we already dispatched
+                    _clearLevelIfEmpty(level);
+                    continue;
                 }
 
+                _dispatch_lists[level] = first_service_call->_next.load(std::memory_order_relaxed);
+                first_service_call->_next.store(nullptr, std::memory_order_relaxed);
+                _clearLevelIfEmpty(level);
+
+                first_service_call->_call();
                 break;
             }
-        }
-
-        void _pend() {
-            #if 0
-            _debug_print_num(); svc_call_debug("✍🏻");
 
-            switch(_priority_value) {
-                case 0: svc_call_debug("⇈"); break;
-                case 1: svc_call_debug("⇡"); break;
-                case 2: svc_call_debug("⦿"); break;
-                case 3: svc_call_debug("⇣"); break;
-                case 4: svc_call_debug("⇊"); break;
-                default: svc_call_debug("?"); break;
-            }
-            #endif
+            _pend();
+        }
 
+        // Pend PendSV at the priority of the highest-priority call waiting, if there is one.
+        static void _pend() {
             /* Set interrupt priority */
             {
                 // See erratum 837070 in "ARM Processor Cortex-M7 (AT610) and Cortex-M7 with FPU (AT611), Product revision r0, Sofware Developers Errata Notice".
+                // This also keeps a higher-priority call from being queued (and setting the priority)
+                // between reading _ready_levels and setting the priority here.
                 SamCommon::InterruptDisabler disabler;
-                NVIC_SetPriority(PendSV_IRQn, _first_service_call.load()->_priority_value);
-            }
 
-            _pended = true;
+                const uint32_t ready_levels = _ready_levels.load(std::memory_order_acquire);
+                if (ready_levels == 0) {
+                    return;
+                }
+
+                #if 0
+                switch(__builtin_clz(ready_levels)) {
+                    case 0: svc_call_debug("⇈"); break;
+                    case 1: svc_call_debug("⇡"); break;
+                    case 2: svc_call_debug("⦿"); break;
+                    case 3: svc_call_debug("⇣"); break;
+                    case 4: svc_call_debug("⇊"); break;
+                    default: svc_call_debug("?"); break;
+                }
+                #endif
+
+                NVIC_SetPriority(PendSV_IRQn, __builtin_clz(ready_levels));
+            }
 
             // see
             // http://infocenter.arm.com/help/topic/com.arm.doc.dai0321a/DAI0321A_programming_guide_memory_barriers_for_m_profile.pdf
@@ -58,7 +58,7 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
 
     TWIInterruptHandler* externalTWIInterruptHandler_;
 
-    std::function<void(Interrupt::Type)> TWIDMAInterruptHandler_;
+    Delegate<void(Interrupt::Type)> TWIDMAInterruptHandler_;
     static this_type_t     *twiInterruptHandler_;
 
     DMA<TWI_tag, twiPeripheralNumber> dma{TWIDMAInterruptHandler_};
@@ -178,6 +178,16 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
             status.setNACK();
         }
 
+#if defined(HAS_PDC_TWI)
+        // The PDC doesn't have an interrupt of its own
+        if (dma.inRxBufferFullInterrupt()) {
+            status.setRxTransferDone();
+        }
+        if (dma.inTxBufferEmptyInterrupt()) {
+            status.setTxTransferDone();
+        }
+#endif
+
         return status;
     }
 
@@ -319,11 +329,25 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
                 state_ = InternalState::RXWaitingForLastChar;
 
             } else if (local_buffer_size_ > 2) {
+#if defined(HAS_PDC_TWI)
+                // The PDC can take the bytes from the first one on, so the whole read is one
+                // interrupt at the end of the DMA, then one for the next-to-last byte.
+                // Note we set size to size-2 since we have to handle the last two characters "manually"
+                state_ = InternalState::RXDMAStarted;
+                if (!dma.startRXTransfer(local_buffer_ptr_, local_buffer_size_ - 2, /*handle_interrupts=*/ true, /*include_next=*/ false)) {
+                    state_ = InternalState::Idle;
+                    return false;
+                }
+                local_buffer_ptr_ = local_buffer_ptr_ + (local_buffer_size_ - 2);
+
+                // Start the reading transaction
+                this->setStart();
+#else
                 // Start the reading transaction
                 this->setStart();
 
                 state_ = InternalState::RXReadingFirstByte;
-
+#endif
             } else {  // local_buffer_size_ == 2
                 // Start the reading transaction
                 this->setStart();
@@ -339,11 +363,28 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
             prehandleInterrupt(empty_cause);  // ignore return value
         } else {
             // TX
-            state_ = InternalState::TXReadyToSendFirstByte;
-
             local_buffer_ptr_  = buffer;
             local_buffer_size_ = size;
 
+#if defined(HAS_PDC_TWI)
+            if (local_buffer_size_ > 1) {
+                // Writing starts when the PDC fills the holding register, so it can send all
+                // but the last character without waiting for the first TXRDY.
+                this->setWriting();
+                this->enableOnNACKInterrupt();
+
+                state_ = InternalState::TXDMAStarted;
+                if (!dma.startTXTransfer(local_buffer_ptr_, local_buffer_size_ - 1, /*handle_interrupts=*/ true, /*include_next=*/ false)) {
+                    state_ = InternalState::Idle;
+                    return false;
+                }
+                local_buffer_ptr_  = local_buffer_ptr_ + (local_buffer_size_ - 1);
+                local_buffer_size_ = 1;
+                return true;
+            }
+#endif
+            state_ = InternalState::TXReadyToSendFirstByte;
+
             this->enableOnTXReadyInterrupt();
             this->enableOnNACKInterrupt();
         }
@@ -84,7 +84,7 @@ struct DMA_XDMAC_RX_hardware<TWI_tag, twiPeripheralNumber> : virtual DMA_XDMAC_h
 // Construct a DMA specialization that uses the XDMAC
 template <uint8_t periph_num>
 struct DMA<TWI_tag, periph_num> : DMA_XDMAC_RX<TWI_tag, periph_num>, DMA_XDMAC_TX<TWI_tag, periph_num> {
-    constexpr DMA(const std::function<void(Interrupt::Type)>& handler)
+    constexpr DMA(const Delegate<void(Interrupt::Type)>& handler)
         : DMA_XDMAC_RX<TWI_tag, periph_num>{handler}, DMA_XDMAC_TX<TWI_tag, periph_num>{handler} {};
 
     // Merge the RX and TX channels here
@@ -141,47 +141,39 @@ struct DMA_PDC_hardware<TWI_tag, twiPeripheralNumber> : TWI_internal::TWIInfo<tw
     static constexpr auto peripheralId = info::peripheralId;
     typedef char*         buffer_t;
 
-    void startRxDoneInterrupts(const bool include_next = false) const { info::enableOnRXReadyInterrupt(); }
-    void stopRxDoneInterrupts(const bool include_next = false) const { info::disableOnRXReadyInterrupt(); }
-    void startTxDoneInterrupts(const bool include_next = true) const { info::enableOnTXReadyInterrupt(); }
-    void stopTxDoneInterrupts(const bool include_next = true) const { info::disableOnTXReadyInterrupt(); }
+    // The PDC interrupts through the TWI, with ENDRX/ENDTX at the end of the transfer
+    void startRxDoneInterrupts(const bool include_next = false) const { info::enableOnRXBufferEndInterrupt(); }
+    void stopRxDoneInterrupts(const bool include_next = false) const { info::disableOnRXBufferEndInterrupt(); }
+    void startTxDoneInterrupts(const bool include_next = true) const { info::enableOnTXBufferEndInterrupt(); }
+    void stopTxDoneInterrupts(const bool include_next = true) const { info::disableOnTXBufferEndInterrupt(); }
 
     int16_t readByte() const {
-        if (!twi->isRxReady()) {
+        if (!(twi->TWI_SR & TWI_SR_RXRDY)) {
             return -1;
         }
-        return twi->readByte();
+        return twi->TWI_RHR;
     }
 
+    // These only count if the interrupt is enabled (see TWIHardware_::getInterruptCause())
     bool inRxBufferFullInterrupt() const {
-        // we check if the interupt is enabled, then read it if it is
-        if (twi->isRxBufferFull()) {
-            return true;
-        }
-        if (twi->isRxBufferEnded()) {
-            return true;
-        }
-
-        return false;
+        return (twi->TWI_IMR & TWI_IMR_ENDRX) && (twi->TWI_SR & TWI_SR_ENDRX);
     }
 
     bool inTxBufferEmptyInterrupt() const {
-        // we check if the interupt is enabled, then read it if it is
-        if (twi->isTxBufferEmpty()) {
-            return true;
-        }
-        if (twi->isTxBufferEnded()) {
-            return true;
-        }
-        return false;
+        return (twi->TWI_IMR & TWI_IMR_ENDTX) && (twi->TWI_SR & TWI_SR_ENDTX);
     }
 };
 
-// Construct a DMA specialization that uses the XDMAC
+// Construct a DMA specialization that uses the PDC
 template <uint8_t periph_num>
 struct DMA<TWI_tag, periph_num> : DMA_PDC<TWI_tag, periph_num> {
-    // nothing to do here, except for a constxpr constructor
-    constexpr DMA(const std::function<void(Interrupt::Type)>& handler) : DMA_PDC<TWI_tag, periph_num>{handler} {};
+    // we take the handler, but the PDC interrupts through the TWI, so we ignore it
+    constexpr DMA(const Delegate<void(Interrupt::Type)>& handler) : DMA_PDC<TWI_tag, periph_num>{} {};
+
+    void disable() const {
+        this->disableRx();
+        this->disableTx();
+    };
 };
 #endif  // TWI + PDC
 }  // namespace Motate
@@ -134,7 +134,7 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
 
     void transmitChar(uint8_t b) { twi->TWIHS_THR = b; }
 
-   private:
+   protected:
     void _setAddress(uint8_t  adjusted_address,
                      uint32_t adjusted_internal_address,
                      uint8_t  adjusted_internal_address_size) {
@@ -267,6 +267,15 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
     void enableOnRXReadyInterrupt() const { twi->TWI_IER = TWI_IER_RXRDY; }
     void disableOnRXReadyInterrupt() const { twi->TWI_IDR = TWI_IDR_RXRDY; }
 
+    // The PDC's end of transfer, for the whole transfer in one interrupt (rather than one per byte)
+    void enableOnRXBufferEndInterrupt() const { twi->TWI_IER = TWI_IER_ENDRX; }
+    void disableOnRXBufferEndInterrupt() const { twi->TWI_IDR = TWI_IDR_ENDRX; }
+
+    void enableOnTXBufferEndInterrupt() const { twi->TWI_IER = TWI_IER_ENDTX; }
+    void disableOnTXBufferEndInterrupt() const { twi->TWI_IDR = TWI_IDR_ENDTX; }
+
+    auto getIMR() const { return twi->TWI_IMR; }
+
     bool isTxReady(uint32_t sr = twi->TWI_SR) { return (sr & TWI_SR_TXRDY); }
     bool isTxComp(uint32_t sr = twi->TWI_SR) { return (sr & TWI_SR_TXCOMP); }
     bool isRxReady(uint32_t sr = twi->TWI_SR) { return (sr & TWI_SR_RXRDY); }
@@ -302,7 +311,7 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
 
     void transmitChar(uint8_t b) { twi->TWI_THR = b; }
 
-   private:
+   protected:
     void _setAddress(uint8_t  adjusted_address,
                      uint32_t adjusted_internal_address,
                      uint8_t  adjusted_internal_address_size) {
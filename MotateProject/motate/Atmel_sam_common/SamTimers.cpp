@@ -47,6 +47,7 @@ namespace Motate {
 	Timer<WatchDogTimerNum> WatchDogTimer;
 
 	volatile uint32_t Timer<SysTickTimerNum>::_motateTickCount = 0;
+	volatile uint32_t Timer<SysTickTimerNum>::_motateTickCountHigh = 0;
 
 } // namespace Motate
 
@@ -74,6 +75,7 @@ extern "C" void SysTick_Handler(void)
         template<> void TimerChannel<x, 1>::interrupt() __attribute__ ((weak)); \
         template<> void Timer<x>::interrupt() __attribute__ ((weak)); \
         template<> volatile uint32_t Timer<x>::_interrupt_cause_cached = 0; \
+        template<> _InputCaptureHardware<x> *_InputCaptureHardware<x>::_active = nullptr; \
     } \
     extern "C" \
     void TC##x##_Handler(void) { /* delegate to the TimerChannels */ \
@@ -86,7 +88,7 @@ extern "C" void SysTick_Handler(void)
             ) { \
             Motate::TimerChannel<x, 0>::interrupt(); \
         } \
-        if (  Motate::TimerChannel<x, 1>::interrupt || \
+        if (  Motate::TimerChannel<x, 1>::interrupt && \
               (ch_  == 1 || ch_  == -1) \
             ) { \
             Motate::TimerChannel<x, 1>::interrupt(); \
@@ -94,6 +96,7 @@ extern "C" void SysTick_Handler(void)
         if (Motate::Timer<x>::interrupt) { \
             Motate::Timer<x>::interrupt(); \
         } \
+        Motate::_InputCaptureHardware<x>::_interrupt(Motate::Timer<x>::_interrupt_cause_cached); \
     }
 
     _MAKE_TCx_Handler(0)
@@ -130,6 +133,10 @@ namespace Motate {
     template<> void PWMTimer<0,6>::interrupt() __attribute__ ((weak));
     template<> void PWMTimer<0,7>::interrupt() __attribute__ ((weak));
 
+#ifdef PWM_PTCR_TXTEN
+    template<> _PWMWaveformHardware<0> *_PWMWaveformHardware<0>::_active = nullptr;
+#endif
+
 #if defined(PWM1)
     template<> void PWMTimer<1,0>::interrupt() __attribute__ ((weak));
     template<> void PWMTimer<1,1>::interrupt() __attribute__ ((weak));
@@ -144,8 +151,9 @@ namespace Motate {
 
 #if defined(PWM)
 void PWM_Handler(void) {
+    const uint32_t isr2 = PWM->PWM_ISR2; // read it once, since reading it clears the compare flags
     Motate::pwm_interrupt_cause_cached_1_ = PWM->PWM_ISR1 & 0x00ff;
-    Motate::pwm_interrupt_cause_cached_2_ = PWM->PWM_ISR2 & 0xff00;
+    Motate::pwm_interrupt_cause_cached_2_ = isr2 & 0xff00;
 
     uint32_t pwm_interrupt_cause_ = Motate::pwm_interrupt_cause_cached_1_ | (Motate::pwm_interrupt_cause_cached_2_>>8);
     Motate::SamCommon::sync();
@@ -174,6 +182,9 @@ void PWM_Handler(void) {
     if (Motate::PWMTimer<0,7>::interrupt && (pwm_interrupt_cause_ & (1<<  7))) {
         Motate::PWMTimer<0,7>::interrupt();
     };
+#ifdef PWM_PTCR_TXTEN
+    Motate::_PWMWaveformHardware<0>::_interrupt(isr2);
+#endif
 }
 #elif defined(PWM1)
 void PWM0_Handler(void) {
@@ -35,7 +35,8 @@
 
 #include "SamTimersDMA.h"
 
-#include <functional> // for std::function and related
+#include "MotateDelegate.h"
+#include "MotateTimingWheel.h"
 #include <type_traits> // for std::extent and std::alignment_of
 
 /* Sam hardware has two types of timer: "Timers" and "PWMTimers"
@@ -103,8 +104,18 @@ namespace Motate {
     };
 
     enum TimerSyncMode {
-        kTimerSyncManually = 0,
-        kTimerSyncDMA      = 1
+        kTimerSyncManually     = 0, // duty cycles written by software, and updated every few periods
+        kTimerSyncDMA          = 1, // duty cycles written by DMA, and updated every few periods
+        kTimerSyncManualUpdate = 2, // duty cycles written by software, and updated by triggerSyncUpdate()
+    };
+
+    /* Which edges of TIOA load RA and RB, in capture mode. RA and RB take turns, so
+     * with both on the same edge every edge is captured, alternately into RA and RB. */
+    enum TimerCaptureEdges {
+        kCaptureRisingEdges  = TC_CMR_LDRA_RISING | TC_CMR_LDRB_RISING,
+        kCaptureFallingEdges = TC_CMR_LDRA_FALLING | TC_CMR_LDRB_FALLING,
+        /* RA on rising, RB on falling -- the first edge captured is a rising one */
+        kCaptureBothEdges    = TC_CMR_LDRA_RISING | TC_CMR_LDRB_FALLING,
     };
 
     /* We're trading acronyms for verbose CamelCase. Dubious. */
@@ -709,6 +720,88 @@ namespace Motate {
     };
 
 
+#pragma mark InputCapture support
+    /**************************************************
+     *
+     * The hardware half of InputCapture (see MotateInputCapture.h): Timer<timerNum>
+     * counts freely on its fastest clock, and each selected edge of TIOA loads the
+     * count into RA or RB. Loads and counter overflows are handed, with the status
+     * they were read with, to the owner from TCx_Handler.
+     *
+     **************************************************/
+
+    template<uint8_t timerNum>
+    struct _InputCaptureHardware {
+#if (SAMV71 || SAMV70 || SAME70 || SAMS70)
+        static constexpr uint8_t counterBits = 16;
+        static constexpr uint32_t _clock = TC_CMR_TCCLKS_TIMER_CLOCK2; // CLOCK1 is PCK6
+        static constexpr uint32_t _divisor = 8;
+#else
+        static constexpr uint8_t counterBits = 32;
+        static constexpr uint32_t _clock = TC_CMR_TCCLKS_TIMER_CLOCK1;
+        static constexpr uint32_t _divisor = 2;
+#endif
+        static constexpr uint32_t kOverflow = TC_SR_COVFS;
+        static constexpr uint32_t kCaptureA = TC_SR_LDRAS;
+        static constexpr uint32_t kCaptureB = TC_SR_LDRBS;
+        static constexpr uint32_t kOverrun  = TC_SR_LOVRS;
+
+        // The one that's running, so TCx_Handler can find it
+        static _InputCaptureHardware *_active;
+
+        Timer<timerNum> timer;
+        const Delegate<void(uint32_t)> _statusHandler;
+
+        _InputCaptureHardware(Delegate<void(uint32_t)> &&statusHandler) : _statusHandler{std::move(statusHandler)} {};
+
+        // Returns the tick frequency
+        uint32_t start(const TimerCaptureEdges edges) {
+            auto tc = timer.tcChan();
+            tc->TC_CCR = TC_CCR_CLKDIS;
+            tc->TC_IDR = 0xFFFFFFFF;
+            SamCommon::enablePeripheralClock(timer.peripheralId());
+
+            // Capture mode (WAVE = 0), no trigger, so the counter only ever wraps
+            tc->TC_CMR = _clock | edges;
+            (void)tc->TC_SR;
+
+            _active = this;
+            tc->TC_IER = TC_IER_COVFS | TC_IER_LDRAS | TC_IER_LDRBS;
+            NVIC_EnableIRQ(timer.tcIRQ());
+            timer.start();
+
+            return SamCommon::getPeripheralClockFreq() / _divisor;
+        };
+
+        void stop() {
+            timer.stop();
+            timer.tcChan()->TC_IDR = 0xFFFFFFFF;
+            if (_active == this) {
+                _active = nullptr;
+            }
+        };
+
+        uint32_t getCaptureA() const { return timer.tcChan()->TC_RA; };
+        uint32_t getCaptureB() const { return timer.tcChan()->TC_RB; };
+
+        // Call action(value, status) with the counter value, then the status read right after it,
+        // with interrupts off -- whatever the status says has happened is handled by action.
+        template <typename action_t>
+        void poll(action_t &&action) {
+            SamCommon::InterruptDisabler disabler;
+            const uint32_t value = timer.tcChan()->TC_CV;
+            action(value, (uint32_t)timer.tcChan()->TC_SR);
+        };
+
+        // Called from TCx_Handler with the TC_SR it read
+        static void _interrupt(const uint32_t status) {
+            if (_active != nullptr) {
+                _active->_statusHandler(status);
+            }
+        };
+    };
+
+
 #pragma mark PWMTimer<n>
     /**************************************************
      *
@@ -805,6 +898,8 @@ namespace Motate {
             pwm()->PWM_SCM = (pwm()->PWM_SCM & ~(PWM_SCM_UPDM_Msk | PWM_SCM_PTRM | PWM_SCM_PTRCS_Msk)) |
               ((m == kTimerSyncManually) ?
                 PWM_SCM_UPDM_MODE1 :
+             (m == kTimerSyncManualUpdate) ?
+                PWM_SCM_UPDM_MODE0 :
 //               (PWM_SCM_UPDM_MODE2 | PWM_SCM_PTRM | PWM_SCM_PTRCS(2)) // set the update to occur int he middle of the period
                (PWM_SCM_UPDM_MODE2)
               );
@@ -815,6 +910,18 @@ namespace Motate {
             pwm()->PWM_SCUC = PWM_SCUC_UPDULOCK;
         };
 
+        // The synchronous channels' new (UPD) duty cycles and periods all take effect
+        // at the start of channel 0's next period. Only duty cycles written since the
+        // last update are changed, so stage them all before calling this.
+        void triggerSyncUpdate() {
+            pwm()->PWM_SCUC = PWM_SCUC_UPDULOCK;
+        };
+
+        // The hardware clears UPDULOCK when the update is done
+        bool isSyncUpdatePending() {
+            return pwm()->PWM_SCUC & PWM_SCUC_UPDULOCK;
+        };
+
         bool startTransfer(uint8_t * const buffer, const uint16_t length) {
 #ifdef PWM_PTCR_TXTEN
             if (pwm()->PWM_TCR == 0) {
@@ -1139,6 +1246,136 @@ namespace Motate {
         //Intentionally empty
     };
 
+#pragma mark PWMWaveformPlayer support
+    /**************************************************
+     *
+     * The hardware half of PWMWaveformPlayer (see MotatePWMWaveformPlayer.h): the DMA
+     * feeds the synchronous channels' duty cycles from memory, one frame per update
+     * period (PWMTimer::setSyncMode(kTimerSyncDMA)), and interrupts at the end of each
+     * buffer.
+     *
+     **************************************************/
+
+#ifdef PWM_PTCR_TXTEN
+    // The Sam3x PDC has a current and a next buffer. ENDTX (through PWM_Handler) marks the end
+    // of each buffer, and TXBUFE the end of both.
+    template<uint8_t moduleNum>
+    struct _PWMWaveformHardware {
+        static_assert(moduleNum == 0, "_PWMWaveformHardware<n>: the Sam3x only has PWM 0");
+
+        // The one that's playing, so PWM_Handler can find it
+        static _PWMWaveformHardware *_active;
+
+        const Delegate<void(void)> _bufferDone;
+
+        _PWMWaveformHardware(Delegate<void(void)> &&bufferDone) : _bufferDone{std::move(bufferDone)} {};
+
+        // Play length frames once, interrupting only when it's all done
+        void startOnce(uint16_t *buffer, const uint16_t length) {
+            stop();
+            PWM->PWM_TPR = (uint32_t)buffer;
+            PWM->PWM_TCR = length;
+            PWM->PWM_TNCR = 0;
+            _start(PWM_IER2_TXBUFE);
+        };
+
+        // Play bufferA then bufferB, interrupting at the end of each so it can be requeued
+        void startRing(uint16_t *bufferA, uint16_t *bufferB, const uint16_t length) {
+            stop();
+            PWM->PWM_TPR = (uint32_t)bufferA;
+            PWM->PWM_TCR = length;
+            PWM->PWM_TNPR = (uint32_t)bufferB;
+            PWM->PWM_TNCR = length;
+            _start(PWM_IER2_ENDTX);
+        };
+
+        // Called from the interrupt with the buffer that just finished, to hand it back to the PDC.
+        // Returns false if the other buffer was already done too, and the PDC had stopped -- the
+        // buffer is playing now, and nothing is queued behind it.
+        bool requeue(uint16_t *buffer, const uint16_t length) {
+            if (PWM->PWM_TCR == 0) {
+                PWM->PWM_TPR = (uint32_t)buffer;
+                PWM->PWM_TCR = length;
+                return false;
+            }
+            PWM->PWM_TNPR = (uint32_t)buffer;
+            PWM->PWM_TNCR = length;
+            return true;
+        };
+
+        // Nothing more will be queued: the next interrupt is when the PDC runs out
+        void finish() {
+            PWM->PWM_IDR2 = PWM_IDR2_ENDTX;
+            PWM->PWM_IER2 = PWM_IER2_TXBUFE;
+        };
+
+        void stop() {
+            PWM->PWM_IDR2 = PWM_IDR2_ENDTX | PWM_IDR2_TXBUFE;
+            PWM->PWM_PTCR = PWM_PTCR_TXTDIS;
+            if (_active == this) {
+                _active = nullptr;
+            }
+        };
+
+        void _start(const uint32_t interrupt) {
+            _active = this;
+            PWM->PWM_IER2 = interrupt;
+            NVIC_EnableIRQ(PWM_IRQn);
+            PWM->PWM_PTCR = PWM_PTCR_TXTEN;
+        };
+
+        // Called from PWM_Handler with PWM_ISR2 (which doesn't clear ENDTX or TXBUFE -- only writing TCR or TNCR does)
+        static void _interrupt(const uint32_t isr2) {
+            if ((_active != nullptr) && (isr2 & PWM->PWM_IMR2 & (PWM_ISR2_ENDTX | PWM_ISR2_TXBUFE))) {
+                _active->_bufferDone();
+            }
+        };
+    };
+
+#else // not Sam3x
+
+    // The S70 XDMAC follows a ring of descriptors, with an interrupt at the end of each
+    // buffer, so nothing needs to be requeued -- the buffers just have to be refilled in time.
+    template<uint8_t moduleNum>
+    struct _PWMWaveformHardware {
+        const Delegate<void(void)> _bufferDone;
+        const Delegate<void(Interrupt::Type)> _dmaInterruptHandler;
+        DMA<Pwm*, moduleNum> dma;
+
+        _PWMWaveformHardware(Delegate<void(void)> &&bufferDone)
+            : _bufferDone{std::move(bufferDone)},
+              _dmaInterruptHandler{[&](Interrupt::Type hint) { _bufferDone(); }},
+              dma{_dmaInterruptHandler} {
+            dma.reset();
+        };
+
+        void startOnce(uint16_t *buffer, const uint16_t length) {
+            stop();
+            dma.startTXTransfer(buffer, length);
+        };
+
+        void startRing(uint16_t *bufferA, uint16_t *bufferB, const uint16_t length) {
+            stop();
+            const XDMACBlock blocks[2] = {{bufferA, length}, {bufferB, length}};
+            dma.startTXRing(blocks, 2);
+        };
+
+        // The ring comes back around by itself (and can't tell if it got there first)
+        bool requeue(uint16_t *buffer, const uint16_t length) {
+            return true;
+        };
+
+        // The ring can't be told to end, so the owner stops it at the next interrupt.
+        // The XDMAC may have already started the first frame of the buffer after that.
+        void finish() {};
+
+        void stop() {
+            dma.stopTxDoneInterrupts();
+            dma.disableTx();
+        };
+    };
+#endif
+
 #pragma mark SysTickEvent, Timer<SysTickTimerNum> SysTickTimer
     /**************************************************
      *
@@ -1146,10 +1383,12 @@ namespace Motate {
      *  Timer<SysTickTimerNum> is the special Timer for Systick.
      *  SysTickTimer is the global singleton to access it.
      *  SysTickEvent is the class to use to register a new event to occur every Tick.
+     *  TimingWheelEvent is the class to use to schedule a one-shot or periodic event
+     *   some number of Ticks from now, with SysTickTimer.schedule().
      *
      **************************************************/
     struct SysTickEvent {
-        const std::function<void(void)> callback;
+        const Delegate<void(void)> callback;
         SysTickEvent *next;
     };
 
@@ -1157,7 +1396,9 @@ namespace Motate {
     template <>
     struct Timer<SysTickTimerNum> {
         static volatile uint32_t _motateTickCount;
+        static volatile uint32_t _motateTickCountHigh; // _motateTickCount overflows, see Clock
         SysTickEvent *firstEvent = nullptr;
+        TimingWheel<> _wheel;
 
         Timer() { init(); };
         Timer(const TimerMode mode, const uint32_t freq) {
@@ -1166,6 +1407,8 @@ namespace Motate {
 
         void init() {
             _motateTickCount = 0;
+            _motateTickCountHigh = 0;
+            _wheel._now = 1; // tick 0 is now, so the first one to process is 1
 
             // Set Systick to 1ms interval, common to all SAM3 variants
             if (SysTick_Config(SamCommon::getPeripheralClockFreq() / 1000))
@@ -1181,7 +1424,9 @@ namespace Motate {
         };
 
         void _increment() {
-            _motateTickCount++;
+            if (++_motateTickCount == 0) {
+                _motateTickCountHigh++;
+            }
         };
 
         void registerEvent(SysTickEvent *new_event) {
@@ -1214,12 +1459,28 @@ namespace Motate {
             }
         };
 
+        // Call event's callback (from the SysTick interrupt) after delay Ticks, and then every
+        // period Ticks if period isn't 0. The event must stay valid until it's cancelled (or, if
+        // it's one-shot, called). Scheduling a scheduled event moves it.
+        void schedule(TimingWheelEvent *event, const uint32_t delay, const uint32_t period = 0) {
+            SamCommon::InterruptDisabler disabler;
+            _wheel.schedule(event, delay, period);
+        };
+
+        void cancel(TimingWheelEvent *event) {
+            SamCommon::InterruptDisabler disabler;
+            _wheel.cancel(event);
+        };
+
         void _handleEvents() {
             SysTickEvent *event = firstEvent;
             while (event != nullptr) {
                 event->callback();
                 event = event->next;
             }
+
+            // Only the events that are due (if any) are touched here
+            _wheel.advance(_motateTickCount);
         };
 
         // Placeholder for user code.
@@ -1263,33 +1524,148 @@ namespace Motate {
     };
     extern Timer<WatchDogTimerNum> WatchDogTimer;
 
-#pragma mark delay()
+#pragma mark Clock
     /**************************************************
      *
-     * delay(): Arduino-compatible blocking-delay function
+     * Clock: 64-bit monotonic timestamps, in core clock cycles, microseconds, or
+     *  milliseconds since startup. This is the (64-bit) SysTick count plus how
+     *  far the SysTick counter is into the current tick, so it has the resolution
+     *  of the core clock without any extra hardware, and is safe to read from
+     *  any interrupt level -- including with SysTick itself pending.
      *
      **************************************************/
+    struct Clock {
+        // Read the tick count and the cycles into the current tick consistently.
+        static uint64_t _ticks(uint32_t &elapsed) {
+            uint32_t high, low;
+            uint64_t ticks;
+            do {
+                high = Timer<SysTickTimerNum>::_motateTickCountHigh;
+                low = Timer<SysTickTimerNum>::_motateTickCount;
+                ticks = ((uint64_t)high << 32) | low;
+
+                // VAL counts down from LOAD to 0
+                elapsed = SysTick->LOAD - SysTick->VAL;
+
+                // If the counter has wrapped but the interrupt hasn't run yet (we are in a
+                // higher-priority interrupt, or they are disabled), count that tick here, and
+                // re-read the counter since it may have been read before the wrap.
+                if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+                    elapsed = SysTick->LOAD - SysTick->VAL;
+                    ticks++;
+                }
+            } while ((low != Timer<SysTickTimerNum>::_motateTickCount) ||
+                     (high != Timer<SysTickTimerNum>::_motateTickCountHigh));
+            return ticks;
+        };
 
-    inline void delay( uint32_t microseconds )
-    {
-        uint32_t doneTime = SysTickTimer.getValue() + microseconds;
+        static uint64_t cycles() {
+            uint32_t elapsed;
+            const uint64_t ticks = _ticks(elapsed);
+            return (ticks * (SysTick->LOAD + 1)) + elapsed;
+        };
 
-        do
-        {
+        // This avoids a 64-bit division, since a tick is exactly 1000us.
+        static uint64_t microseconds() {
+            uint32_t elapsed;
+            const uint64_t ticks = _ticks(elapsed);
+            return (ticks * 1000) + (elapsed / ((SysTick->LOAD + 1) / 1000));
+        };
+
+        static uint64_t milliseconds() {
+            uint32_t elapsed;
+            return _ticks(elapsed);
+        };
+    };
+
+#pragma mark Deadline
+    /**************************************************
+     *
+     * Deadline: a point in time (with microsecond resolution) to poll for, as a
+     *  non-blocking alternative to delay_us(). Since it's 64-bit, it never wraps.
+     *
+     **************************************************/
+    struct Deadline {
+        uint64_t at_ = 0;
+        bool set_ = false;
+
+        Deadline() {};
+
+        static Deadline in_us(const uint64_t microseconds) { Deadline d; d.set_us(microseconds); return d; };
+        static Deadline in_ms(const uint32_t milliseconds) { Deadline d; d.set_ms(milliseconds); return d; };
+
+        void set_us(const uint64_t microseconds) {
+            at_ = Clock::microseconds() + microseconds;
+            set_ = true;
+        };
+
+        void set_ms(const uint32_t milliseconds) { set_us((uint64_t)milliseconds * 1000); };
+
+        void clear() { set_ = false; };
+
+        bool isSet() const { return set_; };
+
+        bool isPast() const { return set_ && (Clock::microseconds() >= at_); };
+
+        // Microseconds until the deadline, or 0 if it's past (or not set)
+        uint64_t remaining_us() const {
+            if (!set_) {
+                return 0;
+            }
+            const uint64_t now = Clock::microseconds();
+            return (now < at_) ? (at_ - now) : 0;
+        };
+    };
+
+#pragma mark delay_us(), delay_ms(), delay()
+    /**************************************************
+     *
+     * delay_us(), delay_ms(): blocking delays, accurate to about a microsecond
+     * delay(): Arduino-compatible blocking delay, in milliseconds
+     *
+     **************************************************/
+
+    inline void _delayUntil(const uint64_t done_us) {
+        while (Clock::microseconds() < done_us) {
             __NOP();
-        } while ( SysTickTimer.getValue() < doneTime );
+        }
+    }
+
+    inline void delay_us(const uint32_t microseconds) {
+        _delayUntil(Clock::microseconds() + microseconds);
+    }
+
+    inline void delay_ms(const uint32_t milliseconds) {
+        _delayUntil(Clock::microseconds() + ((uint64_t)milliseconds * 1000));
+    }
+
+    inline void delay(const uint32_t milliseconds) {
+        delay_ms(milliseconds);
     }
 
 
 #pragma mark Timeout
     /**************************************************
      *
-     * Timeout: Simple non-blocking (polling) timeout class.
+     * Timeout: Simple non-blocking timeout class. Either poll isPast(), or
+     *  give it a callback to be called (from the SysTick interrupt) when it
+     *  expires.
      *
      **************************************************/
     struct Timeout {
         uint32_t start_, delay_;
+        TimingWheelEvent expired_;
         Timeout() : start_ {0}, delay_ {0} {};
+        Timeout(Delegate<void(void)> &&callback) : start_ {0}, delay_ {0}, expired_ {std::move(callback)} {};
+
+        // expired_ may be linked into the SysTickTimer's wheel, so it has to come off of it
+        // before it goes away (and it can't be copied)
+        ~Timeout() { clear(); };
+
+        void setCallback(Delegate<void(void)> &&callback) {
+            clear();
+            expired_.callback = callback;
+        };
 
         bool isSet() {
             return (start_ > 0);
@@ -1308,11 +1684,20 @@ namespace Motate {
             }
             start_ = SysTickTimer.getValue();
             delay_ = delay;
+
+            // Called on the same Tick that isPast() becomes true
+            if (expired_.callback) {
+                SysTickTimer.schedule(&expired_, delay_);
+            }
         };
 
         void clear() {
             start_ = 0;
             delay_ = 0;
+
+            if (expired_.callback) {
+                SysTickTimer.cancel(&expired_);
+            }
         }
     };
 
@@ -88,7 +88,7 @@ namespace Motate {
     template<uint8_t periph_num>
     struct DMA<Pwm*, periph_num> : DMA_XDMAC_TX<Pwm*, periph_num> {
         // nothing to do here, except for a constxpr constructor
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_XDMAC_TX<Pwm*, periph_num>{handler} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_XDMAC_TX<Pwm*, periph_num>{handler} {};
         constexpr DMA() : DMA_XDMAC_TX<Pwm*, periph_num>{nullptr} {};
 
         void setInterrupts(const Interrupt::Type interrupts) const
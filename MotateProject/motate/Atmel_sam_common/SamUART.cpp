@@ -32,22 +32,22 @@
 #include "MotateDebug.h"
 
 namespace Motate {
-    template<> std::function<void()> _USARTHardware<0>::_uartInterruptHandlerJumper {};
+    template<> Delegate<void()> _USARTHardware<0>::_uartInterruptHandlerJumper {};
 
 #ifdef HAS_USART1
-    template<> std::function<void()> _USARTHardware<1>::_uartInterruptHandlerJumper {};
+    template<> Delegate<void()> _USARTHardware<1>::_uartInterruptHandlerJumper {};
 #endif
 
-    template<> std::function<void()> _UARTHardware<0>::_uartInterruptHandlerJumper {};
+    template<> Delegate<void()> _UARTHardware<0>::_uartInterruptHandlerJumper {};
 
 #ifdef HAS_UART1
-    template<> std::function<void()> _UARTHardware<1>::_uartInterruptHandlerJumper {};
+    template<> Delegate<void()> _UARTHardware<1>::_uartInterruptHandlerJumper {};
 #endif
 #ifdef HAS_UART2
-    template<> std::function<void()> _UARTHardware<2>::_uartInterruptHandlerJumper {};
+    template<> Delegate<void()> _UARTHardware<2>::_uartInterruptHandlerJumper {};
 #endif
 #ifdef HAS_UART3
-    template<> std::function<void()> _UARTHardware<3>::_uartInterruptHandlerJumper {};
+    template<> Delegate<void()> _UARTHardware<3>::_uartInterruptHandlerJumper {};
 #endif
 
 }
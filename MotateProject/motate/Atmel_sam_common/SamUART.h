@@ -35,7 +35,6 @@
 #include <MotateBuffer.h>
 #include <type_traits>
 #include <algorithm> // for std::max, etc.
-#include <functional>
 
 #include "SamCommon.h" // pull in defines and fix them
 #include "SamDMA.h" // pull in defines and fix them
@@ -116,14 +115,14 @@ namespace Motate {
 
         static constexpr const uint8_t uartPeripheralNum=uartPeripheralNumber;
 
-        std::function<void(Interrupt::Type)> _uartInterruptHandler;
+        Delegate<void(Interrupt::Type)> _uartInterruptHandler;
 
         DMA<Usart *, uartPeripheralNumber> dma_ {_uartInterruptHandler};
         constexpr const DMA<Usart *, uartPeripheralNumber> *dma() { return &dma_; };
 
         typedef _USARTHardware<uartPeripheralNumber> this_type_t;
 
-        static std::function<void()> _uartInterruptHandlerJumper;
+        static Delegate<void()> _uartInterruptHandlerJumper;
 
         _USARTHardware()
         {
@@ -254,7 +253,7 @@ namespace Motate {
             }
         };
 
-        void setInterruptHandler(std::function<void(Interrupt::Type)> &&handler) {
+        void setInterruptHandler(Delegate<void(Interrupt::Type)> &&handler) {
             _uartInterruptHandler = std::move(handler);
         }
 
@@ -379,6 +378,11 @@ namespace Motate {
             return dma()->startRXTransfer(buffer, length, handleInterrupts, includeNext);
         };
 
+        bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            const bool handleInterrupts = true;
+            return dma()->startRXTransfer(buffer, length, buffer2, length2, handleInterrupts);
+        };
+
         char* getRXTransferPosition() {
             return dma()->getRXTransferPosition();
         };
@@ -388,6 +392,10 @@ namespace Motate {
             return dma()->startTXTransfer(buffer, length, true);
         };
 
+        bool startTXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            return dma()->startTXTransfer(buffer, length, buffer2, length2, true);
+        };
+
         char* getTXTransferPosition() {
             if (_tx_paused) { return nullptr; }
             return dma()->getTXTransferPosition();
@@ -417,14 +425,14 @@ namespace Motate {
 
         static constexpr const uint8_t uartPeripheralNum=uartPeripheralNumber;
 
-        std::function<void(Interrupt::Type)> _uartInterruptHandler;
+        Delegate<void(Interrupt::Type)> _uartInterruptHandler;
 
         DMA<Uart *, uartPeripheralNumber> dma_ {_uartInterruptHandler};
         constexpr const DMA<Uart *, uartPeripheralNumber> *dma() { return &dma_; };
 
         typedef _UARTHardware<uartPeripheralNumber> this_type_t;
 
-        static std::function<void()> _uartInterruptHandlerJumper;
+        static Delegate<void()> _uartInterruptHandlerJumper;
 
         _UARTHardware()
         {
@@ -537,7 +545,7 @@ namespace Motate {
             }
         };
 
-        void setInterruptHandler(std::function<void(Interrupt::Type)> &&handler) {
+        void setInterruptHandler(Delegate<void(Interrupt::Type)> &&handler) {
             _uartInterruptHandler = std::move(handler);
         }
 
@@ -652,6 +660,11 @@ namespace Motate {
             return dma()->startRXTransfer(buffer, length, handleInterrupts, includeNext);
         };
 
+        bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            const bool handleInterrupts = true;
+            return dma()->startRXTransfer(buffer, length, buffer2, length2, handleInterrupts);
+        };
+
         char* getRXTransferPosition() {
             return dma()->getRXTransferPosition();
         };
@@ -662,6 +675,11 @@ namespace Motate {
             return dma()->startTXTransfer(buffer, length, true);
         };
 
+        bool startTXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            if (_tx_paused) { return false; }
+            return dma()->startTXTransfer(buffer, length, buffer2, length2, true);
+        };
+
         char* getTXTransferPosition() {
             return dma()->getTXTransferPosition();
         };
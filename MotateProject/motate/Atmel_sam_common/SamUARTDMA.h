@@ -97,7 +97,7 @@ namespace Motate {
     template<uint8_t periph_num>
     struct DMA<Usart*, periph_num> : virtual DMA_XDMAC_RX<Usart*, periph_num>, virtual DMA_XDMAC_TX<Usart*, periph_num> {
         // nothing to do here, except for a constxpr constructor
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<Usart*, periph_num>{handler}, DMA_XDMAC_TX<Usart*, periph_num>{handler} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<Usart*, periph_num>{handler}, DMA_XDMAC_TX<Usart*, periph_num>{handler} {};
 
         void setInterrupts(const Interrupt::Type interrupts) const
         {
@@ -191,7 +191,7 @@ namespace Motate {
     template<uint8_t periph_num>
     struct DMA<Uart*, periph_num> : DMA_XDMAC_RX<Uart*, periph_num>, DMA_XDMAC_TX<Uart*, periph_num> {
         // nothing to do here, except for a constxpr constructor
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<Uart*, periph_num>{handler}, DMA_XDMAC_TX<Uart*, periph_num>{handler} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_XDMAC_RX<Uart*, periph_num>{handler}, DMA_XDMAC_TX<Uart*, periph_num>{handler} {};
 
         void setInterrupts(const Interrupt::Type interrupts) const
         {
@@ -300,7 +300,7 @@ namespace Motate {
         // nothing to do here, except for a constxpr constructor
         // we take the handler, but we don't actually handle interrupts for the peripheral
         // so we ignore it
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_PDC<Usart*, periph_num>{} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_PDC<Usart*, periph_num>{} {};
     };
 #endif // USART + PDC
 
@@ -386,7 +386,7 @@ namespace Motate {
         // nothing to do here, except for a constxpr constructor
         // we take the handler, but we don't actually handle interrupts for the peripheral
         // so we ignore it
-        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_PDC<Uart*, periph_num>{} {};
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_PDC<Uart*, periph_num>{} {};
     };
 #endif // UART + PDC
 } // namespace Motate
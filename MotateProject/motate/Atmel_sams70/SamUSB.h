@@ -279,6 +279,10 @@ namespace Motate {
 
         static const uint8_t master_control_endpoint = 0;
 
+        // The DMA only counts bytes for the descriptor it's on, so those it moved past in a ring are
+        // reported with their full buffer_length. (See _advanceChain().)
+        static const bool exact_ring_lengths = false;
+
         // Init
         USBDeviceHardware(USBDevice_t * const _proxy) : proxy{_proxy}
         {
@@ -1416,6 +1420,11 @@ namespace Motate {
         };
 
         void _completeTransfer(const uint8_t ep) {
+            _endTransfer(ep);
+            proxy->handleTransferDone(ep);
+        }
+
+        void _endTransfer(const uint8_t ep) {
             if (_is_endpoint_a_tx_in(ep)) {
                 // case 2 or 3
                 _disable_in_send_interrupt(ep); // D
@@ -1426,7 +1435,71 @@ namespace Motate {
             // C
             _disable_endpoint_dma_interrupt(ep);
             _dma_used_by_endpoint &= ~(1<<ep);
-            proxy->handleTransferDone(ep);
+        }
+
+        // The DMA stopped: report the rest of the chain (usually just the last descriptor), then the transfer as a whole.
+        void _completeChain(const uint8_t ep) {
+            auto &chain = _chains[ep];
+            const uint8_t running = _runningDescriptor(ep);
+            const uint16_t length = chain.first[running].buffer_length;
+            const uint16_t left = _devdma_buffer_count(ep);
+
+            _advanceChain(ep);
+            chain.done = (running + 1) % chain.count;
+
+            // A ring stops after the last descriptor queued to it (see queueInRing()). If another was
+            // queued after the DMA had already loaded that one, carry on with it. This is settled before
+            // the callback, which may well queue this same descriptor again.
+            const bool carry_on = chain.ring && (chain.first[running].command == USB_DMA_Descriptor::run_and_link);
+            if (carry_on) {
+                _startChain(ep, chain.done);
+            } else {
+                _endTransfer(ep);
+            }
+
+            proxy->handleDescriptorDone(ep, running, (left < length) ? (length - left) : 0);
+            if (!carry_on) {
+                proxy->handleTransferDone(ep);
+            }
+        }
+
+        // The index of the descriptor of the chain the DMA is working on.
+        // The controller copies next_descriptor out of each descriptor as it loads it, so it's the one before that.
+        uint8_t _runningDescriptor(const uint8_t ep) {
+            auto &chain = _chains[ep];
+            USB_DMA_Descriptor *next = _devdma(ep)->next_descriptor;
+            if (next == nullptr) {
+                return chain.count - 1; // the last of a chain that isn't a ring
+            }
+            uint8_t next_index = next - chain.first;
+            if (chain.ring) {
+                return (next_index + chain.count - 1) % chain.count;
+            }
+            // before the first one is loaded next_descriptor points at it
+            return (next_index > 0) ? (next_index - 1) : 0;
+        }
+
+        // True if the DMA is on the descriptor that ends the transfer: the last of a chain (always true for a
+        // single descriptor), or for a ring, whichever one the channel stopped on without loading another.
+        bool _onLastDescriptor(const uint8_t ep) {
+            auto &chain = _chains[ep];
+            if (chain.ring) {
+                return !(_devdma_status(ep) & USBHS_DEVDMASTATUS_CHANN_ENB) &&
+                       !(_devdma(ep)->command & USB_DMA_Descriptor::load_next_desc);
+            }
+            return (chain.count == 1) || (_runningDescriptor(ep) == chain.count - 1);
+        }
+
+        // Report each descriptor the DMA has moved past since the last call.
+        // The DMA only counts bytes for the descriptor it's on, so these are reported as full. A descriptor
+        // of an OUT ring that a short packet ended early is only measured if the DMA stopped on it.
+        void _advanceChain(const uint8_t ep) {
+            auto &chain = _chains[ep];
+            const uint8_t running = _runningDescriptor(ep);
+            while (chain.done != running) {
+                proxy->handleDescriptorDone(ep, chain.done, chain.first[chain.done].buffer_length);
+                chain.done = (chain.done + 1) % chain.count;
+            }
         }
 
         bool checkAndHandleEndpoint() {
@@ -1484,19 +1557,21 @@ namespace Motate {
                         {
                             auto byte_count = get_byte_count(ep);
                             auto dma_bytes_left = _devdma_buffer_count(ep);
-                            if ((_get_endpoint_size(ep) == byte_count) || // case 3 or 4
-                                (0 == dma_bytes_left)                     // case 2 or 4
+                            // Between the descriptors of a chain the DMA buffer is empty too, but the transfer isn't done.
+                            const bool last_descriptor = _onLastDescriptor(ep);
+                            if ((_get_endpoint_size(ep) == byte_count) ||          // case 3 or 4
+                                (0 == dma_bytes_left && last_descriptor)           // case 2 or 4
                                 )
                             {
                                 _ack_in_send(ep); // A
                                 _ack_fifocon(ep); // B - This bit is cleared (by writing a one to USBHS_DEVEPTIDRx.FIFOCONC bit) to send the FIFO data and to switch to the next bank.
                             }
 
-                            if (0 == dma_bytes_left) { // case 2 or 4
+                            if (0 == dma_bytes_left && last_descriptor) { // case 2 or 4
                                 transfer_completed = true; // C+D
                             }
 
-                            if (0 == byte_count && dma_bytes_left > 0) { // case 1
+                            if (0 == byte_count && dma_bytes_left > 0 && _chains[ep].count == 1) { // case 1
                                 // goose it!
                                 transfer_completed = true; // C+D
                             }
@@ -1519,7 +1594,7 @@ namespace Motate {
                                 _ack_fifocon(ep);
                             } else {
                                 // case 6
-                                if (0 == _devdma_buffer_count(ep)) {
+                                if (0 == _devdma_buffer_count(ep) && _onLastDescriptor(ep)) {
                                     transfer_completed = true; // C+D
                                 }
                             }
@@ -1539,9 +1614,12 @@ namespace Motate {
                         if (_is_endpoint_a_tx_in(ep)) {
                             _enable_in_send_interrupt(ep);
                         }
+                        // loading a descriptor of a chain means the one before it is done
+                        _advanceChain(ep);
                     }
 
-                    if (ep_status & USBHS_DEVDMASTATUS_END_BF_ST)
+                    // a short packet ends a descriptor of an OUT ring early, the same as the buffer running out
+                    if (ep_status & (USBHS_DEVDMASTATUS_END_BF_ST | USBHS_DEVDMASTATUS_END_TR_ST))
                     {
                         // case 2, 4, or 7
 
@@ -1551,15 +1629,20 @@ namespace Motate {
 //                            _ack_fifocon(ep); // B - This bit is cleared (by writing a one to USBHS_DEVEPTIDRx.FIFOCONC bit) to send the FIFO data and to switch to the next bank.
 //                        }
 
-                        // cases 2, 4, or 7
-                        transfer_completed = true;
+                        // cases 2, 4, or 7 -- but only at the end of the last descriptor of a chain
+                        _advanceChain(ep);
+                        if (_onLastDescriptor(ep) &&
+                            ((_chains[ep].count == 1) || !(ep_status & USBHS_DEVDMASTATUS_CHANN_ENB)))
+                        {
+                            transfer_completed = true;
+                        }
                     }
 
                     handled = true;
                 } // is a dma interrupt
 
                 if (transfer_completed) {
-                    _completeTransfer(ep);
+                    _completeChain(ep);
                 }
             } // for (ep ...)
 
@@ -1567,31 +1650,158 @@ namespace Motate {
         };
 
         uint32_t _dma_used_by_endpoint;
+
+        // The descriptors handed to transfer(), per endpoint, and how far along the DMA is in them.
+        struct _DescriptorChain {
+            USB_DMA_Descriptor *first;
+            uint8_t count;
+            uint8_t done;   // the next descriptor to be reported to handleDescriptorDone()
+            bool ring;      // set up with setupRing()
+            bool stream;    // ... as one run of bytes
+        };
+        _DescriptorChain _chains[10] {};
+
         bool transfer(const uint8_t ep, USB_DMA_Descriptor& desc) {
+            return transfer(ep, &desc, 1);
+        };
+
+        // Transfer through count descriptors, linked with next_descriptor so the DMA loads each one as soon
+        // as the previous buffer is done -- without waiting for an interrupt and leaving the bus idle.
+        // proxy->handleDescriptorDone(ep, index, length) is called as each is finished (and may be reused),
+        // and proxy->handleTransferDone(ep) after the last one.
+        // The descriptors must stay put (and not be changed) until they're reported done.
+        bool transfer(const uint8_t ep, USB_DMA_Descriptor *descriptors, const uint8_t count) {
             if (!config_number) {
 #if IN_DEBUGGER == 1
                 __asm__("BKPT"); // endpoint not configured
 #endif
                 return false;
             }
+            if (count == 0) {
+                return false;
+            }
 
-            desc.command = USB_DMA_Descriptor::run_and_stop;
-            // DON'T interrupt when the descriptor is loaded
-            desc.descriptor_loaded_interrupt_enable = false;
-            if (_is_endpoint_a_tx_in(ep)) {
-                // if the endpoint is a TX IN:
-                // validate the packet at DMA Buffer End (BUFF_COUNT reaches 0)
-                desc.end_buffer_enable = true;
-                // we use the descriptor loaded to turn on the other iterrupts
+            for (uint8_t i = 0; i < count; i++) {
+                auto &desc = descriptors[i];
+                const bool last = (i == count - 1);
+
+                if (!last) {
+                    desc.command = USB_DMA_Descriptor::run_and_link;
+                    desc.next_descriptor = &descriptors[i + 1];
+                } else {
+                    desc.command = USB_DMA_Descriptor::run_and_stop;
+                    desc.next_descriptor = nullptr;
+                }
+
+                // DON'T interrupt when the descriptor is loaded, unless it's part of a chain
+                desc.descriptor_loaded_interrupt_enable = (count > 1);
+                if (_is_endpoint_a_tx_in(ep)) {
+                    // if the endpoint is a TX IN:
+                    // validate the packet at DMA Buffer End (BUFF_COUNT reaches 0)
+                    // In the middle of a chain we keep filling the packet from the next buffer instead.
+                    desc.end_buffer_enable = last;
+                    // we use the descriptor loaded to turn on the other iterrupts
+                    desc.descriptor_loaded_interrupt_enable = true;
+                }
+                // interrupt when the DMA transfer ends because the buffer ran out
+                desc.end_buffer_interrupt_enable = true;
+            }
+
+            _chains[ep] = {descriptors, count, 0, false, false};
+            _startChain(ep, 0);
+
+            return true;
+        };
+
+        // Set up count descriptors as a ring (linked in a circle) for an endpoint that streams, without starting
+        // it. Descriptors are then handed to the DMA in order with queueInRing(), and each is reported to
+        // proxy->handleDescriptorDone(ep, index, length) when it's done. When the DMA runs out of queued
+        // descriptors it stops (and proxy->handleTransferDone(ep) is called) rather than lapping buffers that
+        // haven't been handed back, and the next queueInRing() starts it again.
+        // On an OUT endpoint a short packet ends a descriptor early, so each one holds a message.
+        // With stream, the descriptors are one run of bytes instead: OUT packets carry on across them, and an IN
+        // packet keeps filling from the next one queued, so only the end of what's queued goes out short.
+        bool setupRing(const uint8_t ep, USB_DMA_Descriptor *descriptors, const uint8_t count, const bool stream = false) {
+            if (!config_number) {
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // endpoint not configured
+#endif
+                return false;
+            }
+            if (count == 0) {
+                return false;
+            }
+
+            stopTransfer(ep);
+
+            for (uint8_t i = 0; i < count; i++) {
+                auto &desc = descriptors[i];
+
+                // nothing is queued yet, so every descriptor is the end of the line
+                desc.command = USB_DMA_Descriptor::run_and_stop;
+                desc.next_descriptor = &descriptors[(i + 1) % count];
+
+                // the descriptor loaded interrupt is how we follow the DMA around the ring
                 desc.descriptor_loaded_interrupt_enable = true;
+                if (_is_endpoint_a_tx_in(ep)) {
+                    // each buffer is its own transfer, so validate the packet at the end of every one
+                    desc.end_buffer_enable = true;
+                } else {
+                    // a short packet ends the buffer (and its message) early
+                    desc.end_transfer_enable = !stream;
+                }
+                desc.end_transfer_interrupt_enable = desc.end_transfer_enable;
+                desc.end_buffer_interrupt_enable = true;
             }
-            // interrupt when the DMA transfer ends because the buffer ran out
-            desc.end_buffer_interrupt_enable = true;
 
+            _chains[ep] = {descriptors, count, 0, true, stream};
+
+            return true;
+        };
+
+        // Hand descriptor index of a ring (see setupRing()) to the DMA, after those already queued.
+        // Descriptors have to be queued in ring order.
+        bool queueInRing(const uint8_t ep, const uint8_t index) {
+            auto &chain = _chains[ep];
+            if (!chain.ring || (index >= chain.count)) {
+                return false;
+            }
+
+            SamCommon::InterruptDisabler disabler;
+
+            // this one is the new end of the line ...
+            const bool stream_in = chain.stream && _is_endpoint_a_tx_in(ep);
+            chain.first[index].command = USB_DMA_Descriptor::run_and_stop;
+            if (stream_in) {
+                // (the end of a stream goes out, short or not)
+                chain.first[index].end_buffer_enable = true;
+            }
+            if (_dma_used_by_endpoint & (1 << ep)) {
+                // ... and the one before it links to it. If the DMA has already loaded that one it'll stop
+                // there anyway, and _completeChain() picks this one up.
+                auto &previous = chain.first[(index + chain.count - 1) % chain.count];
+                SamCommon::sync();
+                previous.command = USB_DMA_Descriptor::run_and_link;
+                if (stream_in) {
+                    // A stream's packet carries on into this one, if the DMA hasn't loaded that one yet. It's
+                    // linked first, so the DMA never sees the end of the line without the packet validated.
+                    SamCommon::sync();
+                    previous.end_buffer_enable = false;
+                }
+            } else {
+                _startChain(ep, index);
+            }
+
+            return true;
+        };
+
+        // Point the DMA at descriptor index of the endpoint's chain, and start it.
+        void _startChain(const uint8_t ep, const uint8_t index) {
+            _chains[ep].done = index;
             _dma_used_by_endpoint |= 1 << ep;
 
             // IMPORTANT: UOTGHS_DEVDMA[0] is endpoint 1!!
-            _devdma(ep)->next_descriptor = &desc;
+            _devdma(ep)->next_descriptor = &_chains[ep].first[index];
             _devdma(ep)->command = USB_DMA_Descriptor::load_next_desc;
 
             if (_is_endpoint_a_tx_in(ep)) {
@@ -1603,8 +1813,21 @@ namespace Motate {
 
             _enable_endpoint_interrupt(ep);
             _enable_endpoint_dma_interrupt(ep);
+        };
 
-            return true;
+        // Stop a transfer (or ring) early. Nothing is reported for the descriptors that weren't done.
+        void stopTransfer(const uint8_t ep) {
+            if (!(_dma_used_by_endpoint & (1 << ep))) {
+                return;
+            }
+            _devdma(ep)->command = USB_DMA_Descriptor::stop_now;
+            if (_is_endpoint_a_tx_in(ep)) {
+                _disable_in_send_interrupt(ep);
+            } else {
+                _disable_out_received_interrupt(ep);
+            }
+            _disable_endpoint_dma_interrupt(ep);
+            _dma_used_by_endpoint &= ~(1<<ep);
         };
 
         char * getTransferPositon(const uint8_t endpoint) {
@@ -0,0 +1,251 @@
+/*
+ Host_sim/HostCommon.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "HostCommon.h"
+
+// Like the SAM3X default of 84MHz, so timing-sensitive code sees realistic numbers.
+uint32_t SystemCoreClock = 84000000;
+
+namespace {
+    static constexpr int32_t kCoreIRQs = 2; // PendSV and SysTick
+    static constexpr int32_t kIRQCount = kCoreIRQs + PERIPH_COUNT_IRQn;
+
+    // Higher than any possible priority -- the priority of "thread mode"
+    static constexpr uint32_t kThreadPriority = 0x100;
+
+    typedef void (*handler_t)(void);
+
+    // Indexed by IRQn + kCoreIRQs, and looked up at call time since the handlers are weak.
+    handler_t _handlerFor(const int32_t index) {
+        switch (index - kCoreIRQs) {
+            case PendSV_IRQn:  return PendSV_Handler;
+            case SysTick_IRQn: return SysTick_Handler;
+            case PIOA_IRQn:    return PIOA_Handler;
+            case PIOB_IRQn:    return PIOB_Handler;
+            case PIOC_IRQn:    return PIOC_Handler;
+            case PIOD_IRQn:    return PIOD_Handler;
+            case ADC_IRQn:     return ADC_Handler;
+            case TC0_IRQn:     return TC0_Handler;
+            case TC1_IRQn:     return TC1_Handler;
+            case TC2_IRQn:     return TC2_Handler;
+            case TC3_IRQn:     return TC3_Handler;
+            case TC4_IRQn:     return TC4_Handler;
+            case TC5_IRQn:     return TC5_Handler;
+            case TC6_IRQn:     return TC6_Handler;
+            case TC7_IRQn:     return TC7_Handler;
+            case TC8_IRQn:     return TC8_Handler;
+            case PWM_IRQn:     return PWM_Handler;
+            case SPI0_IRQn:    return SPI0_Handler;
+            case SPI1_IRQn:    return SPI1_Handler;
+            case USART0_IRQn:  return USART0_Handler;
+            case USART1_IRQn:  return USART1_Handler;
+            case USART2_IRQn:  return USART2_Handler;
+            case USART3_IRQn:  return USART3_Handler;
+            case UART_IRQn:    return UART_Handler;
+            case TWI0_IRQn:    return TWI0_Handler;
+            case TWI1_IRQn:    return TWI1_Handler;
+            case XDMAC_IRQn:   return XDMAC_Handler;
+            case USB_IRQn:     return USB_Handler;
+            default:           return nullptr;
+        }
+    };
+
+    // Everything here is constant-initialized (zeros), so it's valid before any static constructors run.
+    struct {
+        uint8_t priority[kIRQCount];
+        bool enabled[kIRQCount];
+        bool pending[kIRQCount];
+
+        uint32_t primask = 0;
+        uint32_t active_priority = kThreadPriority;
+        int32_t  active_index = -1;
+        uint32_t pending_count = 0;
+    } _nvic;
+
+    // Core exceptions can't be disabled
+    inline bool _isEnabled(const int32_t index) {
+        return (index < kCoreIRQs) || _nvic.enabled[index];
+    };
+
+    // Call every pending, enabled IRQ that has a higher priority than what's running now.
+    // Handlers run to completion unless they pend something of higher priority, in which
+    // case we recurse (nest) just like exception preemption.
+    void _dispatch() {
+        while ((_nvic.primask == 0) && (_nvic.pending_count > 0)) {
+            int32_t best = -1;
+            uint32_t best_priority = _nvic.active_priority;
+            for (int32_t i = 0; i < kIRQCount; i++) {
+                if (_nvic.pending[i] && _isEnabled(i) && (_nvic.priority[i] < best_priority)) {
+                    best = i;
+                    best_priority = _nvic.priority[i];
+                }
+            }
+            if (best < 0) {
+                return;
+            }
+
+            _nvic.pending[best] = false;
+            _nvic.pending_count--;
+
+            const uint32_t saved_priority = _nvic.active_priority;
+            const int32_t saved_index = _nvic.active_index;
+            _nvic.active_priority = best_priority;
+            _nvic.active_index = best;
+
+            handler_t handler = _handlerFor(best);
+            if (handler) {
+                handler();
+            }
+
+            _nvic.active_priority = saved_priority;
+            _nvic.active_index = saved_index;
+        }
+    };
+}
+
+extern "C" {
+    void __disable_irq(void) { _nvic.primask = 1; }
+    void __enable_irq(void) {
+        _nvic.primask = 0;
+        _dispatch();
+    }
+    uint32_t __get_PRIMASK(void) { return _nvic.primask; }
+    void __set_PRIMASK(uint32_t primask) {
+        _nvic.primask = primask & 1;
+        _dispatch();
+    }
+
+    uint32_t __get_IPSR(void) {
+        return (_nvic.active_index < 0) ? 0 : (_nvic.active_index - kCoreIRQs + 16);
+    }
+
+    void NVIC_EnableIRQ(IRQn_Type IRQn) {
+        _nvic.enabled[IRQn + kCoreIRQs] = true;
+        _dispatch();
+    }
+    void NVIC_DisableIRQ(IRQn_Type IRQn) {
+        if (IRQn >= 0) {
+            _nvic.enabled[IRQn + kCoreIRQs] = false;
+        }
+    }
+    uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn) { return _isEnabled(IRQn + kCoreIRQs) ? 1 : 0; }
+
+    void NVIC_SetPendingIRQ(IRQn_Type IRQn) {
+        if (!_nvic.pending[IRQn + kCoreIRQs]) {
+            _nvic.pending[IRQn + kCoreIRQs] = true;
+            _nvic.pending_count++;
+        }
+        _dispatch();
+    }
+    void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {
+        if (_nvic.pending[IRQn + kCoreIRQs]) {
+            _nvic.pending[IRQn + kCoreIRQs] = false;
+            _nvic.pending_count--;
+        }
+    }
+    uint32_t NVIC_GetPendingIRQ(IRQn_Type IRQn) { return _nvic.pending[IRQn + kCoreIRQs] ? 1 : 0; }
+
+    void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {
+        _nvic.priority[IRQn + kCoreIRQs] = priority & ((1 << __NVIC_PRIO_BITS) - 1);
+    }
+    uint32_t NVIC_GetPriority(IRQn_Type IRQn) { return _nvic.priority[IRQn + kCoreIRQs]; }
+}
+
+namespace Motate {
+
+uint64_t HostCommon::_peripheralClocks = 0;
+
+uint64_t HostSim::_now = 0;
+HostSimEvent *HostSim::_firstEvent = nullptr;
+std::function<void(void)> HostSim::loopHook MOTATE_HOST_MODEL;
+
+void HostSim::schedule(HostSimEvent *event, const uint64_t when) {
+    if (event->scheduled) {
+        cancel(event);
+    }
+    event->when = when;
+    event->scheduled = true;
+
+    // Keep the list sorted by when, and FIFO for events due at the same time.
+    HostSimEvent **link = &_firstEvent;
+    while ((*link != nullptr) && ((*link)->when <= when)) {
+        link = &(*link)->next;
+    }
+    event->next = *link;
+    *link = event;
+}
+
+void HostSim::cancel(HostSimEvent *event) {
+    if (!event->scheduled) {
+        return;
+    }
+    HostSimEvent **link = &_firstEvent;
+    while (*link != nullptr) {
+        if (*link == event) {
+            *link = event->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    event->next = nullptr;
+    event->scheduled = false;
+}
+
+void HostSim::advance(const uint64_t cycles) {
+    const uint64_t target = _now + cycles;
+    while ((_firstEvent != nullptr) && (_firstEvent->when <= target)) {
+        HostSimEvent *event = _firstEvent;
+        _firstEvent = event->next;
+        event->next = nullptr;
+        event->scheduled = false;
+
+        if (event->when > _now) {
+            _now = event->when;
+        }
+        // The action may reschedule this (or any other) event.
+        if (event->action) {
+            event->action();
+        }
+    }
+    // A nested advance (from inside an event) may have already gone past target
+    if (target > _now) {
+        _now = target;
+    }
+}
+
+bool HostSim::advanceToNextEvent() {
+    if (_firstEvent == nullptr) {
+        return false;
+    }
+    const uint64_t when = _firstEvent->when;
+    advance((when > _now) ? (when - _now) : 0);
+    return true;
+}
+
+}  // namespace Motate
@@ -0,0 +1,288 @@
+/*
+ Host_sim/HostCommon.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HOSTCOMMON_H_ONCE
+#define HOSTCOMMON_H_ONCE
+
+#include <cstdint>
+#include <functional>
+
+/* The host simulation ("host_sim") platform:
+ *
+ * This stands in for the Sam "chip" when building for BOARD=host. It's meant for
+ * running the Motate hardware-abstraction layer on a development machine, so
+ * drivers and application code can be exercised (and timed) without a board.
+ *
+ * Three parts live here:
+ *
+ * 1) CMSIS-alike shims: IRQn_Type, __NOP(), __DMB(), __disable_irq(), NVIC_*()
+ *    and friends, so the Host*.h files can be written the same way as the Sam*.h
+ *    files.
+ *
+ * 2) A model of the NVIC. Pending an IRQ (from a peripheral model or software)
+ *    calls the matching XXX_Handler() *synchronously*, honoring PRIMASK, the
+ *    enable bits, and priorities. A handler that pends a higher-priority IRQ is
+ *    preempted (the call nests), and a lower or equal priority IRQ waits for the
+ *    running handler to return, just like the hardware.
+ *
+ * 3) A simulated clock (HostSim). Time only moves when something advances it:
+ *    delay(), busy-waits inside the peripheral models, or the main loop (see
+ *    main.cpp). Peripheral models schedule HostSimEvents at absolute cycle
+ *    counts, and advancing the clock fires them in order.
+ */
+
+extern "C" {
+
+    typedef enum IRQn {
+        /* Cortex-M core exceptions we model */
+        PendSV_IRQn   = -2,
+        SysTick_IRQn  = -1,
+
+        /* "Peripheral" IRQs */
+        PIOA_IRQn     = 0,
+        PIOB_IRQn     = 1,
+        PIOC_IRQn     = 2,
+        PIOD_IRQn     = 3,
+        ADC_IRQn      = 4,
+        TC0_IRQn      = 5,
+        TC1_IRQn      = 6,
+        TC2_IRQn      = 7,
+        TC3_IRQn      = 8,
+        TC4_IRQn      = 9,
+        TC5_IRQn      = 10,
+        TC6_IRQn      = 11,
+        TC7_IRQn      = 12,
+        TC8_IRQn      = 13,
+        PWM_IRQn      = 14,
+        SPI0_IRQn     = 15,
+        SPI1_IRQn     = 16,
+        USART0_IRQn   = 17,
+        USART1_IRQn   = 18,
+        USART2_IRQn   = 19,
+        USART3_IRQn   = 20,
+        UART_IRQn     = 21,
+        TWI0_IRQn     = 22,
+        TWI1_IRQn     = 23,
+        XDMAC_IRQn    = 24,
+        USB_IRQn      = 25,
+
+        PERIPH_COUNT_IRQn = 26
+    } IRQn_Type;
+
+#define __NVIC_PRIO_BITS 4
+
+    extern uint32_t SystemCoreClock;
+
+    void __disable_irq(void);
+    void __enable_irq(void);
+    uint32_t __get_PRIMASK(void);
+    void __set_PRIMASK(uint32_t primask);
+
+    void NVIC_EnableIRQ(IRQn_Type IRQn);
+    void NVIC_DisableIRQ(IRQn_Type IRQn);
+    uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn);
+    void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+    void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+    uint32_t NVIC_GetPendingIRQ(IRQn_Type IRQn);
+    void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+    uint32_t NVIC_GetPriority(IRQn_Type IRQn);
+
+    // Returns 0 if outside of an exception handler, or IRQn+16 (like IPSR) inside one
+    uint32_t __get_IPSR(void);
+
+    /* The "vector table" -- define any of these to handle that IRQ. They're weak, so
+     * the simulated NVIC can skip the ones that aren't defined. */
+    void PendSV_Handler(void) __attribute__ ((weak));
+    void SysTick_Handler(void) __attribute__ ((weak));
+    void PIOA_Handler(void) __attribute__ ((weak));
+    void PIOB_Handler(void) __attribute__ ((weak));
+    void PIOC_Handler(void) __attribute__ ((weak));
+    void PIOD_Handler(void) __attribute__ ((weak));
+    void ADC_Handler(void) __attribute__ ((weak));
+    void TC0_Handler(void) __attribute__ ((weak));
+    void TC1_Handler(void) __attribute__ ((weak));
+    void TC2_Handler(void) __attribute__ ((weak));
+    void TC3_Handler(void) __attribute__ ((weak));
+    void TC4_Handler(void) __attribute__ ((weak));
+    void TC5_Handler(void) __attribute__ ((weak));
+    void TC6_Handler(void) __attribute__ ((weak));
+    void TC7_Handler(void) __attribute__ ((weak));
+    void TC8_Handler(void) __attribute__ ((weak));
+    void PWM_Handler(void) __attribute__ ((weak));
+    void SPI0_Handler(void) __attribute__ ((weak));
+    void SPI1_Handler(void) __attribute__ ((weak));
+    void USART0_Handler(void) __attribute__ ((weak));
+    void USART1_Handler(void) __attribute__ ((weak));
+    void USART2_Handler(void) __attribute__ ((weak));
+    void USART3_Handler(void) __attribute__ ((weak));
+    void UART_Handler(void) __attribute__ ((weak));
+    void TWI0_Handler(void) __attribute__ ((weak));
+    void TWI1_Handler(void) __attribute__ ((weak));
+    void XDMAC_Handler(void) __attribute__ ((weak));
+    void USB_Handler(void) __attribute__ ((weak));
+}
+
+// The barriers are only compiler (and host memory) barriers here -- the NVIC model is synchronous.
+static inline void __NOP(void) { __asm__ volatile("nop"); }
+static inline void __DMB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __DSB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __ISB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+// There are a few unguarded __asm__("BKPT") statements in the shared headers.
+// Make BKPT an assembler macro that traps into the host debugger instead.
+#if defined(__x86_64__) || defined(__i386__)
+__asm__(".ifndef __motate_host_bkpt\n\t.set __motate_host_bkpt, 1\n\t.macro BKPT\n\tint3\n\t.endm\n\t.endif");
+#elif defined(__aarch64__)
+__asm__(".ifndef __motate_host_bkpt\n\t.set __motate_host_bkpt, 1\n\t.macro BKPT\n\tbrk #0\n\t.endm\n\t.endif");
+#endif
+
+// The peripheral models are globals that are used from the constructors of other
+// globals (pins, timers, etc.) in other translation units, so they have to be
+// constructed first -- like the hardware, they "exist" before any user code runs.
+#define MOTATE_HOST_MODEL __attribute__ ((init_priority (200)))
+
+namespace Motate {
+
+// Peripheral IDs, used for the (simulated) peripheral clock enables.
+// These match the IRQ numbers, like they do on the Sam parts.
+static constexpr uint32_t ID_PIOA   = PIOA_IRQn;
+static constexpr uint32_t ID_PIOB   = PIOB_IRQn;
+static constexpr uint32_t ID_PIOC   = PIOC_IRQn;
+static constexpr uint32_t ID_PIOD   = PIOD_IRQn;
+static constexpr uint32_t ID_ADC    = ADC_IRQn;
+static constexpr uint32_t ID_TC0    = TC0_IRQn;
+static constexpr uint32_t ID_PWM    = PWM_IRQn;
+static constexpr uint32_t ID_SPI0   = SPI0_IRQn;
+static constexpr uint32_t ID_USART0 = USART0_IRQn;
+static constexpr uint32_t ID_UART   = UART_IRQn;
+static constexpr uint32_t ID_TWI0   = TWI0_IRQn;
+static constexpr uint32_t ID_USB    = USB_IRQn;
+
+#pragma mark HostSim
+/**************************************************
+ *
+ * HostSim: the simulated clock and event queue
+ *
+ **************************************************/
+
+// An event on the simulated timeline. Owned by whomever schedules it (usually a
+// peripheral model), and kept in an intrusive list sorted by cycle.
+struct HostSimEvent {
+    std::function<void(void)> action;
+    uint64_t when = 0;
+    HostSimEvent *next = nullptr;
+    bool scheduled = false;
+
+    HostSimEvent() {};
+    HostSimEvent(std::function<void(void)> &&_action) : action{std::move(_action)} {};
+
+    HostSimEvent(const HostSimEvent &) = delete;
+    HostSimEvent &operator=(const HostSimEvent &) = delete;
+};
+
+struct HostSim {
+    static uint64_t _now;
+    static HostSimEvent *_firstEvent;
+
+    // Current time, in core clock cycles since startup
+    static uint64_t now() { return _now; };
+
+    static uint64_t cyclesFromMicroseconds(const uint64_t us) { return (us * SystemCoreClock) / 1000000; };
+    static uint64_t cyclesFromNanoseconds(const uint64_t ns) { return (ns * SystemCoreClock) / 1000000000; };
+
+    // Schedule (or reschedule) event at the absolute cycle count when.
+    // Events scheduled in the past will fire on the next advance.
+    static void schedule(HostSimEvent *event, const uint64_t when);
+    static void scheduleIn(HostSimEvent *event, const uint64_t cycles) { schedule(event, _now + cycles); };
+    static void cancel(HostSimEvent *event);
+
+    // Move time forward by cycles, firing every event that comes due on the way.
+    static void advance(const uint64_t cycles);
+    // Move time to the next scheduled event and fire it (and any others that are due then).
+    // Returns false if there was nothing scheduled (time does not move in that case).
+    static bool advanceToNextEvent();
+
+    // Used in place of busy-waiting (and WFI): let the hardware make progress.
+    static void idle() {
+        if (!advanceToNextEvent()) {
+            advance(1);
+        }
+    };
+
+    // Called by main() after every loop(), if set.
+    static std::function<void(void)> loopHook;
+};
+
+#pragma mark HostCommon
+/**************************************************
+ *
+ * HostCommon: mirrors SamCommon
+ *
+ **************************************************/
+
+struct HostCommon {
+    static uint64_t _peripheralClocks;
+
+    static inline void sync() { __DMB(); };
+
+    static void enablePeripheralClock(uint32_t peripheralId) {
+        _peripheralClocks |= ((uint64_t)1 << peripheralId);
+    };
+
+    static void disablePeripheralClock(uint32_t peripheralId) {
+        _peripheralClocks &= ~((uint64_t)1 << peripheralId);
+    };
+
+    static bool isPeripheralClockEnabled(uint32_t peripheralId) {
+        return _peripheralClocks & ((uint64_t)1 << peripheralId);
+    };
+
+    static uint32_t getPeripheralClockFreq() {
+        return SystemCoreClock;
+    };
+
+    struct InterruptDisabler {
+        volatile uint32_t flags;
+        InterruptDisabler() : flags{__get_PRIMASK()} {
+            __disable_irq();
+            sync();
+        };
+        ~InterruptDisabler() {
+            sync();
+            // Only re-enable if they were enabled before, so these can nest
+            if (!flags) {
+                __enable_irq();
+            }
+         };
+    };
+};
+
+}  // namespace Motate
+
+#endif /* end of include guard: HOSTCOMMON_H_ONCE */
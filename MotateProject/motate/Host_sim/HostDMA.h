@@ -0,0 +1,374 @@
+/*
+ Host_sim/HostDMA.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// These two go outside the guard, so they can happen even though they
+// (eventually) include this file.
+#include "HostCommon.h"
+#include "MotateCommon.h"
+
+#ifndef HOSTDMA_H_ONCE
+#define HOSTDMA_H_ONCE
+
+#include <functional>  // for std::function
+#include <type_traits> // for std::alignment_of and std::remove_pointer
+
+#include "MotateDelegate.h"
+
+namespace Motate {
+
+    // DMA template - MUST be specialized
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA {
+        DMA() = delete; // this prevents accidental direct instantiation
+        template<typename... T>
+        DMA(T...) {}; // this prevents accidental direct instantiation
+        static constexpr bool exists = false;
+    };
+
+#pragma mark HostPDC
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostPDC
+     *
+     * A model of the Sam PDC (Peripheral DMA Controller) registers: a current
+     * and a "next" pointer/count pair for each direction. The peripheral models
+     * move data through it with pushRx() and pullTx(), one data unit at a time.
+     *
+     * Like the real PDC, when a count reaches zero the "next" pair is moved into
+     * the current pair, and when both are empty the pointer is left just past the
+     * end of the last buffer.
+     *
+     * A nullptr buffer is a "dummy" transfer: the count is honored, but nothing
+     * is read (zeros are sent) or written.
+     *
+     **************************************************/
+
+    struct HostPDC {
+        char *RPR = nullptr;
+        uint32_t RCR = 0;
+        char *RNPR = nullptr;
+        uint32_t RNCR = 0;
+
+        char *TPR = nullptr;
+        uint32_t TCR = 0;
+        char *TNPR = nullptr;
+        uint32_t TNCR = 0;
+
+        bool rx_enabled = false;
+        bool tx_enabled = false;
+
+        // Called whenever the DMA is (re)configured, so the peripheral model can start moving data
+        std::function<void(void)> on_change;
+
+        void changed() { if (on_change) { on_change(); } };
+
+        // Status bits, like ENDRX/RXBUFF/ENDTX/TXBUFE
+        bool endRx() const { return RCR == 0; };
+        bool rxBufferFull() const { return (RCR == 0) && (RNCR == 0); };
+        bool endTx() const { return TCR == 0; };
+        bool txBufferEmpty() const { return (TCR == 0) && (TNCR == 0); };
+
+        bool rxActive() const { return rx_enabled && (RCR > 0); };
+        bool txActive() const { return tx_enabled && (TCR > 0); };
+
+        // Store one received unit. Returns false if there was nowhere to put it.
+        // The counts are in units, so the peripheral picks the unit size (uint8_t or uint16_t).
+        template <typename unit_t = uint8_t>
+        bool pushRx(const unit_t value) {
+            if (!rxActive()) { return false; }
+            if (RPR != nullptr) { *(unit_t *)RPR = value; RPR += sizeof(unit_t); }
+            if (--RCR == 0 && RNCR > 0) {
+                RPR = RNPR;
+                RCR = RNCR;
+                RNPR = nullptr;
+                RNCR = 0;
+            }
+            return true;
+        };
+
+        // Fetch one unit to send. Returns false if there was nothing to send.
+        template <typename unit_t = uint8_t>
+        bool pullTx(unit_t &value) {
+            if (!txActive()) { return false; }
+            if (TPR != nullptr) { value = *(unit_t *)TPR; TPR += sizeof(unit_t); } else { value = 0; }
+            if (--TCR == 0 && TNCR > 0) {
+                TPR = TNPR;
+                TCR = TNCR;
+                TNPR = nullptr;
+                TNCR = 0;
+            }
+            return true;
+        };
+    };
+
+#pragma mark DMA_Host implementation
+    /**************************************************
+     *
+     * DMA_Host: the PDC-style DMA interface over a HostPDC
+     *
+     * Same interface as DMA_PDC (see SamDMAPDC.h), except that setInterrupts()
+     * actually enables the transfer-done interrupts, like the XDMAC version does.
+     *
+     **************************************************/
+
+    // DMA_Host_hardware template - - MUST be specialized
+    // Specializations provide: pdc(), buffer_t, start/stopRxDoneInterrupts(),
+    //  start/stopTxDoneInterrupts(), inRxBufferFullInterrupt(), inTxBufferEmptyInterrupt()
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_Host_hardware {
+        DMA_Host_hardware() = delete; // this prevents accidental direct instantiation
+    };
+
+    // generic DMA_Host object.
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_Host : DMA_Host_hardware<periph_t, periph_num>
+    {
+        typedef DMA_Host_hardware<periph_t, periph_num> _hw;
+        using _hw::pdc;
+        using _hw::startRxDoneInterrupts;
+        using _hw::stopRxDoneInterrupts;
+        using _hw::startTxDoneInterrupts;
+        using _hw::stopTxDoneInterrupts;
+        using _hw::inTxBufferEmptyInterrupt;
+        using _hw::inRxBufferFullInterrupt;
+
+        typedef typename _hw::buffer_t buffer_t;
+
+        void setInterrupts(const Interrupt::Type interrupts) const {
+            if (interrupts & Interrupt::OnRxTransferDone) {
+                startRxDoneInterrupts();
+            } else {
+                stopRxDoneInterrupts();
+            }
+            if (interrupts & Interrupt::OnTxTransferDone) {
+                startTxDoneInterrupts();
+            } else {
+                stopTxDoneInterrupts();
+            }
+        };
+
+        void reset() const
+        {
+            pdc()->rx_enabled = false; // disable all the things
+            pdc()->tx_enabled = false;
+            pdc()->RPR = nullptr;
+            pdc()->RNPR = nullptr;
+            pdc()->RCR = 0;
+            pdc()->RNCR = 0;
+            pdc()->TPR = nullptr;
+            pdc()->TNPR = nullptr;
+            pdc()->TCR = 0;
+            pdc()->TNCR = 0;
+        };
+
+        void disableRx() const
+        {
+            pdc()->rx_enabled = false; // disable for setup
+        };
+        void enableRx() const
+        {
+            pdc()->rx_enabled = true;  // enable
+            pdc()->changed();
+        };
+        void setRx(void * const buffer, const uint32_t length) const
+        {
+            pdc()->RPR = (char *)buffer;
+            pdc()->RCR = length;
+        };
+        void setNextRx(void * const buffer, const uint32_t length) const
+        {
+            pdc()->RNPR = (char *)buffer;
+            pdc()->RNCR = length;
+            pdc()->changed();
+        };
+        void flushRead() const {
+            pdc()->RNCR = 0;
+            pdc()->RCR = 0;
+        };
+        uint32_t leftToRead(bool include_next = false) const
+        {
+            if (pdc()->RPR == nullptr) { return 0; }
+            if (include_next) {
+                return pdc()->RCR + pdc()->RNCR;
+            }
+            return pdc()->RCR;
+        };
+        uint32_t leftToReadNext() const
+        {
+            if (pdc()->RNPR == nullptr) { return 0; }
+            return pdc()->RNCR;
+        };
+        bool doneReading(bool include_next = false) const
+        {
+            return leftToRead(include_next) == 0;
+        };
+        bool doneReadingNext() const {
+            return leftToReadNext() == 0;
+        };
+        buffer_t getRXTransferPosition() const
+        {
+            return (buffer_t)pdc()->RPR;
+        };
+
+        // Bundle it all up
+        bool startRXTransfer(void * const buffer,
+                             const uint32_t length,
+                             bool handle_interrupts = true,
+                             bool include_next = false
+                             ) const
+        {
+            if (0 == length) { return false; }
+
+            if (doneReading()) {
+                if (handle_interrupts) { stopRxDoneInterrupts(); }
+
+                setRx(buffer, length);
+
+                enableRx();
+                if (handle_interrupts) { startRxDoneInterrupts(); }
+            }
+            // check to see if they overlap, in which case we're extending the region
+            else if ((pdc()->RPR >= (char *)buffer) &&
+                     (pdc()->RPR < ((char *)buffer + length))
+                    )
+            {
+                if (handle_interrupts) { stopRxDoneInterrupts(); }
+
+                // they overlap, we need to compute the new length
+                // (the model can't advance while we're in here, so no need to re-check)
+                pdc()->RCR = ((char *)buffer + length) - pdc()->RPR;
+
+                enableRx();
+                if (handle_interrupts) { startRxDoneInterrupts(); }
+            }
+            // otherwise, we set the next region, if requested. We DON'T attempt to extend it.
+            else if (include_next && doneReadingNext()) {
+                setNextRx(buffer, length);
+                return true;
+            }
+
+            return (length > 0);
+        }
+
+        // Receive into two regions (such as both halves of a wrapped circular buffer): the
+        // second one goes in the "next" registers, so there's no gap between them.
+        bool startRXTransfer(void * const buffer, const uint32_t length, void * const buffer2, const uint32_t length2, bool handle_interrupts = true) const
+        {
+            if (!startRXTransfer(buffer, length, handle_interrupts, /*include_next=*/ false)) {
+                return false;
+            }
+            if (length2 > 0) {
+                startRXTransfer(buffer2, length2, handle_interrupts, /*include_next=*/ true);
+            }
+            return true;
+        }
+
+
+        void disableTx() const
+        {
+            pdc()->tx_enabled = false; // disable for setup
+        };
+        void enableTx() const
+        {
+            pdc()->tx_enabled = true;  // enable again
+            pdc()->changed();
+        };
+        void setTx(void * const buffer, const uint32_t length) const
+        {
+            pdc()->TPR = (char *)buffer;
+            pdc()->TCR = length;
+        };
+        void setNextTx(void * const buffer, const uint32_t length) const
+        {
+            pdc()->TNPR = (char *)buffer;
+            pdc()->TNCR = length;
+            pdc()->changed();
+        };
+        uint32_t leftToWrite(bool include_next = false) const
+        {
+            if (include_next) {
+                return pdc()->TCR + pdc()->TNCR;
+            }
+            return pdc()->TCR;
+        };
+        uint32_t leftToWriteNext() const
+        {
+            return pdc()->TNCR;
+        };
+        bool doneWriting(bool include_next = false) const
+        {
+            return leftToWrite(include_next) == 0;
+        };
+        bool doneWritingNext() const
+        {
+            return leftToWriteNext() == 0;
+        };
+        buffer_t getTXTransferPosition() const
+        {
+            return (buffer_t)pdc()->TPR;
+        };
+
+
+        // Bundle it all up
+        bool startTXTransfer(void * const buffer, const uint32_t length, bool handle_interrupts = true, bool include_next = false) const
+        {
+            if (doneWriting()) {
+                stopTxDoneInterrupts();
+                setTx(buffer, length);
+                if (length != 0) {
+                    if (handle_interrupts) { startTxDoneInterrupts(); }
+                    enableTx();
+                    return true;
+                }
+                return false;
+            }
+            else if (include_next && doneWritingNext()) {
+                setNextTx(buffer, length);
+                return true;
+            }
+            return false;
+        }
+
+        // Send two regions (such as both halves of a wrapped circular buffer): the
+        // second one goes in the "next" registers, so there's no gap between them.
+        bool startTXTransfer(void * const buffer, const uint32_t length, void * const buffer2, const uint32_t length2, bool handle_interrupts = true) const
+        {
+            if (!startTXTransfer(buffer, length, handle_interrupts, /*include_next=*/ false)) {
+                return false;
+            }
+            if (length2 > 0) {
+                startTXTransfer(buffer2, length2, handle_interrupts, /*include_next=*/ true);
+            }
+            return true;
+        }
+    };
+
+} // end namespace Motate
+
+#endif /* end of include guard: HOSTDMA_H_ONCE */
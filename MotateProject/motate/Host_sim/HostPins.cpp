@@ -0,0 +1,153 @@
+/*
+ Host_sim/HostPins.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MotatePins.h"
+
+using Motate::_pinChangeInterruptTable;
+using Motate::ADC_Module;
+using Motate::PortHardware;
+
+namespace Motate {
+    HostPio HostPIOA {PIOA_IRQn};
+    HostPio HostPIOB {PIOB_IRQn};
+    HostPio HostPIOC {PIOC_IRQn};
+    HostPio HostPIOD {PIOD_IRQn};
+
+    void HostPio::update() {
+        const uint32_t old_pdsr = PDSR;
+
+        // Pins we drive (PIO controlled outputs, and not released because of multi-drive)
+        const uint32_t driven_mask = PSR & OSR & ~(MDSR & ODSR);
+        // Pins that float are pulled up, if the pull-up is enabled, otherwise they read low
+        const uint32_t floating = PUSR & ~ext_mask;
+
+        PDSR = (driven_mask & ODSR) | (~driven_mask & ((ext_mask & ext_value) | floating));
+
+        // Multi-drive pins driven low by us, or by someone else, are low
+        PDSR &= ~(PSR & OSR & MDSR & ~ODSR);
+
+        const uint32_t changed = old_pdsr ^ PDSR;
+
+        // Simple (any change) interrupts
+        uint32_t triggered = changed & ~AIMMR;
+        // Edge interrupts
+        triggered |= changed & AIMMR & ~ELSR & ( FRLHSR &  PDSR);
+        triggered |= changed & AIMMR & ~ELSR & (~FRLHSR & ~PDSR);
+        // Level interrupts -- these are only checked when a pin changes, not continuously
+        triggered |= AIMMR & ELSR & ((FRLHSR & PDSR) | (~FRLHSR & ~PDSR));
+
+        ISR |= triggered;
+
+        if (ISR & IMR) {
+            NVIC_SetPendingIRQ(irq);
+        }
+    }
+
+    HostAdc HostADC MOTATE_HOST_MODEL {};
+
+    void HostAdc::startConversion() {
+        if (!conversion_event.action) {
+            conversion_event.action = [&]() { completeConversion(); };
+        }
+        if (!conversion_event.scheduled) {
+            HostSim::scheduleIn(&conversion_event, HostSim::cyclesFromNanoseconds(ADC_Module::_conversion_time_ns));
+        }
+    }
+
+    void HostAdc::completeConversion() {
+        for (uint32_t ch = 0; ch < 16; ch++) {
+            if (CHSR & (1u << ch)) {
+                CDR[ch] = input[ch];
+                LCDR = input[ch] | (ch << 12);
+
+                // The PDC reads each conversion from LCDR as it's made, and ENDRX is set when RCR reaches zero
+                if (pdc.rxActive()) {
+                    const bool last = (pdc.RCR == 1);
+                    pdc.pushRx<uint16_t>(LCDR);
+                    end_rx = end_rx || last;
+                }
+            }
+        }
+        ISR |= CHSR | DRDY;
+
+        if (freerun) {
+            startConversion();
+        }
+
+        if ((ISR | status()) & IMR) {
+            NVIC_SetPendingIRQ(ADC_IRQn);
+        }
+    }
+}
+
+template <>
+_pinChangeInterruptTable PortHardware<'A'>::_interrupts {};
+extern "C" void PIOA_Handler(void) {
+    uint32_t isr = Motate::HostPIOA.readISR() & Motate::HostPIOA.IMR;
+    PortHardware<'A'>::_interrupts.dispatch(isr);
+
+    NVIC_ClearPendingIRQ(PIOA_IRQn);
+}
+
+template<> _pinChangeInterruptTable PortHardware<'B'>::_interrupts {};
+extern "C" void PIOB_Handler(void) {
+    uint32_t isr = Motate::HostPIOB.readISR() & Motate::HostPIOB.IMR;
+    PortHardware<'B'>::_interrupts.dispatch(isr);
+
+    NVIC_ClearPendingIRQ(PIOB_IRQn);
+}
+
+template<> _pinChangeInterruptTable PortHardware<'C'>::_interrupts {};
+extern "C" void PIOC_Handler(void) {
+    uint32_t isr = Motate::HostPIOC.readISR() & Motate::HostPIOC.IMR;
+    PortHardware<'C'>::_interrupts.dispatch(isr);
+
+    NVIC_ClearPendingIRQ(PIOC_IRQn);
+}
+
+template<> _pinChangeInterruptTable PortHardware<'D'>::_interrupts {};
+extern "C" void PIOD_Handler(void) {
+    uint32_t isr = Motate::HostPIOD.readISR() & Motate::HostPIOD.IMR;
+    PortHardware<'D'>::_interrupts.dispatch(isr);
+
+    NVIC_ClearPendingIRQ(PIOD_IRQn);
+}
+
+namespace Motate {
+    bool ADC_Module::_inited = false;
+    _pinChangeInterruptTable ADC_Module::_interrupts {};
+}
+
+extern "C"
+void ADC_Handler(void) {
+    uint32_t isr = Motate::HostADC.readISR() & Motate::HostADC.IMR; // read it to clear the ISR
+    ADC_Module::_interrupts.dispatch(isr);
+
+    NVIC_ClearPendingIRQ(ADC_IRQn);
+} // ADC_Handler
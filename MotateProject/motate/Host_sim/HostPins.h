@@ -0,0 +1,1046 @@
+/*
+ Host_sim/HostPins.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef HOSTPINS_H_ONCE
+#define HOSTPINS_H_ONCE
+
+#include "HostCommon.h"
+#include "MotateTimers.h"
+
+#include "MotateDelegate.h"
+
+#include <functional>   // for std::function
+#include <type_traits>
+
+namespace Motate {
+    // Numbering is arbitrary:
+    enum PinMode : PinMode_t {
+        kUnchanged      = 0,
+        kOutput         = 1,
+        kInput          = 2,
+        // These next two are NOT available on other platforms,
+        // but cannot be masked out since they are required for
+        // special pin functions. These should not be used in
+        // end-user (sketch) code.
+        kPeripheralA    = 3,
+        kPeripheralB    = 4,
+        kPeripheralC    = 5,
+        kPeripheralD    = 6,
+    };
+
+    // Numbering is arbitrary, but bit unique for bitwise operations (unlike other architectures):
+    enum PinOptions : PinOptions_t {
+        kNormal         = 0,
+        kTotem          = 0, // alias
+        kPullUp         = 1<<1,
+#if !defined(MOTATE_AVR_COMPATIBILITY)
+        kWiredAnd       = 1<<2,
+        kDriveLowOnly   = 1<<2, // alias
+        kWiredAndPull   = kWiredAnd|kPullUp,
+        kDriveLowPullUp = kDriveLowOnly|kPullUp, // alias
+#endif // !MOTATE_AVR_COMPATIBILITY
+#if !defined(MOTATE_AVR_COMPATIBILITY) && !defined(MOTATE_AVRX_COMPATIBILITY)
+        kDeglitch       = 1<<4,
+        kDebounce       = 1<<5,
+#endif // !MOTATE_AVR_COMPATIBILITY && !MOTATE_SAM_COMPATIBILITY
+
+        // Set the intialized value of the pin
+        kStartHigh      = 1<<6,
+        kStartLow       = 1<<7,
+
+        // For use on PWM pins only!
+        kPWMPinInverted = 1<<8,
+
+        // For use on ADC pins only!
+        kDifferentialPair = 1<<9,
+    };
+
+    enum PinInterruptOptions : PinInterruptOptions_t {
+        kPinInterruptsOff                = 0,
+
+        kPinInterruptOnChange            = 1,
+
+        kPinInterruptOnRisingEdge        = 1<<1,
+        kPinInterruptOnFallingEdge       = 2<<1,
+
+        kPinInterruptOnLowLevel          = 3<<1,
+        kPinInterruptOnHighLevel         = 4<<1,
+
+        kPinInterruptAdvancedMask        = ((1<<3)-1)<<1,
+
+        /* This turns the IRQ on, but doesn't set the timer to ever trigger it. */
+        kPinInterruptOnSoftwareTrigger   = 1<<4,
+
+        kPinInterruptTypeMask            = (1<<5)-1,
+
+        /* Set priority levels here as well: */
+        kPinInterruptPriorityHighest     = 1<<5,
+        kPinInterruptPriorityHigh        = 1<<6,
+        kPinInterruptPriorityMedium      = 1<<7,
+        kPinInterruptPriorityLow         = 1<<8,
+        kPinInterruptPriorityLowest      = 1<<9,
+
+        kPinInterruptPriorityMask        = ((1<<10) - (1<<5))
+    };
+
+    struct _pinChangeInterrupt;
+
+    // The pin change (or ADC) interrupts for one port (or ADC module), kept in a slot
+    // per bit of the status register. The interrupt handler only visits the bits that
+    // are set (and enabled), so the cost per edge doesn't grow with the number of
+    // interrupts on the port.
+    //
+    // All zeros is empty, so it's ready before any (static) constructors run.
+    struct _pinChangeInterruptTable {
+        _pinChangeInterrupt *_handlers[32]; // Each is the head of a list, for more than one on a bit
+        uint32_t _mask;                     // The bits that have any handlers
+
+        inline void add(_pinChangeInterrupt *pci);
+        inline void remove(_pinChangeInterrupt *pci);
+
+        // Call the handlers for every bit of isr, lowest bit first.
+        inline void dispatch(uint32_t isr);
+    };
+
+    struct _pinChangeInterrupt {
+        const uint32_t pc_mask; // Pin uses "mask" so we use a different name. "pc" for pinChange -- a single bit
+        Delegate<void(void)> interrupt_handler;
+        _pinChangeInterrupt *next; // next on the same bit
+        _pinChangeInterruptTable &_table;
+
+        _pinChangeInterrupt(const _pinChangeInterrupt &) = delete; // delete the copy constructor, we only allow moves
+        _pinChangeInterrupt &operator=(const _pinChangeInterrupt &) = delete; // delete the assigment operator, we only allow moves
+        _pinChangeInterrupt &operator=(const _pinChangeInterrupt &&) = delete; // delete the move assigment operator, we only allow moves
+
+
+        _pinChangeInterrupt(const uint32_t _mask, Delegate<void(void)> &&_interrupt, _pinChangeInterruptTable &table)
+            : pc_mask{_mask}, interrupt_handler{std::move(_interrupt)}, next{nullptr}, _table{table}
+        {
+            _table.add(this);
+        };
+
+        ~_pinChangeInterrupt() {
+            _table.remove(this);
+        };
+
+        void setInterrupt(const Delegate<void(void)> &_interrupt)
+        {
+            interrupt_handler = _interrupt;
+        };
+    };
+
+    void _pinChangeInterruptTable::add(_pinChangeInterrupt *pci) {
+        const uint32_t bit = __builtin_ctz(pci->pc_mask);
+        HostCommon::InterruptDisabler disabler;
+
+        // Add to the end, so handlers on the same bit are called in the order they were made
+        _pinChangeInterrupt **link = &_handlers[bit];
+        while (*link != nullptr) {
+            if (*link == pci) {
+                return; // already here
+            }
+            link = &(*link)->next;
+        }
+        pci->next = nullptr;
+        *link = pci;
+        _mask |= pci->pc_mask;
+    };
+
+    void _pinChangeInterruptTable::remove(_pinChangeInterrupt *pci) {
+        const uint32_t bit = __builtin_ctz(pci->pc_mask);
+        HostCommon::InterruptDisabler disabler;
+
+        _pinChangeInterrupt **link = &_handlers[bit];
+        while (*link != nullptr) {
+            if (*link == pci) {
+                *link = pci->next;
+                pci->next = nullptr;
+                break;
+            }
+            link = &(*link)->next;
+        }
+        if (_handlers[bit] == nullptr) {
+            _mask &= ~pci->pc_mask;
+        }
+    };
+
+    void _pinChangeInterruptTable::dispatch(uint32_t isr) {
+        isr &= _mask;
+        while (isr) {
+            const uint32_t bit = __builtin_ctz(isr);
+            isr &= isr - 1; // clear the lowest set bit
+
+            for (_pinChangeInterrupt *pci = _handlers[bit]; pci != nullptr; pci = pci->next) {
+                if (pci->interrupt_handler) {
+                    pci->interrupt_handler();
+                }
+            }
+        }
+    };
+
+    typedef uint32_t uintPort_t;
+
+#pragma mark HostPio
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostPio
+     *
+     * A (simplified) register-level model of a Sam PIO controller. Bits set in
+     * a register mean "enabled" (so PUSR is *not* inverted like the real one).
+     *
+     * What the "outside world" drives onto the pins is set with drive() and
+     * release(). Every change to the pin levels is checked against the
+     * interrupt configuration, and the port's IRQ is pended as needed.
+     *
+     **************************************************/
+
+    struct HostPio {
+        uint32_t PSR;       // PIO (1) or peripheral (0) control
+        uint32_t OSR;       // output enabled
+        uint32_t ODSR;      // output data
+        uint32_t PDSR;      // pin data -- what is actually on the pins
+        uint32_t PUSR;      // pull-up enabled
+        uint32_t MDSR;      // multi-drive (open drain) enabled
+        uint32_t IFSR;      // input filter enabled
+        uint32_t IFDGSR;    // input filter is a debounce (1) or glitch (0) filter
+        uint32_t ABCDSR[2]; // peripheral select
+
+        uint32_t IMR;       // interrupts enabled
+        uint32_t ISR;       // interrupt status (cleared by readISR())
+        uint32_t AIMMR;     // additional interrupt modes enabled
+        uint32_t ELSR;      // level (1) or edge (0)
+        uint32_t FRLHSR;    // rising/high (1) or falling/low (0)
+
+        uint32_t ext_mask;  // pins being driven externally
+        uint32_t ext_value; // the values they are being driven to
+
+        const IRQn_Type irq;
+
+        constexpr HostPio(const IRQn_Type _irq)
+            : PSR{0xFFFFFFFF}, OSR{0}, ODSR{0}, PDSR{0}, PUSR{0}, MDSR{0}, IFSR{0}, IFDGSR{0}, ABCDSR{0, 0},
+              IMR{0}, ISR{0}, AIMMR{0}, ELSR{0}, FRLHSR{0}, ext_mask{0}, ext_value{0}, irq{_irq} {};
+
+        // Recompute PDSR and raise pin change interrupts.
+        void update();
+
+        // Read-and-clear, like reading PIO_ISR
+        uint32_t readISR() {
+            uint32_t isr = ISR;
+            ISR = 0;
+            return isr;
+        };
+
+        // Simulation hooks:
+        void drive(const uint32_t value, const uint32_t mask) {
+            ext_value = (ext_value & ~mask) | (value & mask);
+            ext_mask |= mask;
+            update();
+        };
+        void release(const uint32_t mask) {
+            ext_mask &= ~mask;
+            update();
+        };
+    };
+
+    extern HostPio HostPIOA;
+    extern HostPio HostPIOB;
+    extern HostPio HostPIOC;
+    extern HostPio HostPIOD;
+
+#pragma mark PortHardware
+    /**************************************************
+     *
+     * HARDWARE LAYER: PortHardware
+     *
+     **************************************************/
+
+    template <unsigned char portLetter>
+    struct PortHardware {
+        static const uint8_t letter = portLetter;
+
+        static_assert(portLetter >= 'A' && portLetter <= 'D', "PortHardware<>: host_sim only has ports A through D.");
+
+        // The constexpr functions we can define here, and get really great optimization.
+        // These switch statements are handled by the compiler, not at runtime.
+        static constexpr HostPio* const rawPort()
+        {
+            switch (portLetter) {
+                case 'A': return &HostPIOA;
+                case 'B': return &HostPIOB;
+                case 'C': return &HostPIOC;
+                default:  return &HostPIOD;
+            }
+        };
+        constexpr static const uint32_t peripheralId()
+        {
+            switch (portLetter) {
+                case 'A': return ID_PIOA;
+                case 'B': return ID_PIOB;
+                case 'C': return ID_PIOC;
+                default:  return ID_PIOD;
+            }
+        };
+        constexpr const IRQn_Type _IRQn() const
+        {
+            switch (portLetter) {
+                case 'A': return PIOA_IRQn;
+                case 'B': return PIOB_IRQn;
+                case 'C': return PIOC_IRQn;
+                default:  return PIOD_IRQn;
+            }
+        };
+
+
+        static _pinChangeInterruptTable _interrupts;
+
+        void setModes(const PinMode type, const uintPort_t mask) {
+            switch (type) {
+                case kOutput:
+                    rawPort()->OSR |= mask;
+                    rawPort()->PSR |= mask;
+                    break;
+                case kInput:
+                    rawPort()->OSR &= ~mask;
+                    rawPort()->PSR |= mask;
+                    break;
+                /*
+                 *   Truth Table (same as the S70):
+                 *  Sel | SR2 | SR1
+                 *    A |  0  |  0
+                 *    B |  0  |  1
+                 *    C |  1  |  0
+                 *    D |  1  |  1
+                 */
+                case kPeripheralA:
+                    rawPort()->ABCDSR[1] &= ~mask;
+                    rawPort()->ABCDSR[0] &= ~mask;
+                    rawPort()->PSR &= ~mask;
+                    break;
+                case kPeripheralB:
+                    rawPort()->ABCDSR[1] &= ~mask;
+                    rawPort()->ABCDSR[0] |=  mask;
+                    rawPort()->PSR &= ~mask;
+                    break;
+                case kPeripheralC:
+                    rawPort()->ABCDSR[1] |=  mask;
+                    rawPort()->ABCDSR[0] &= ~mask;
+                    rawPort()->PSR &= ~mask;
+                    break;
+                case kPeripheralD:
+                    rawPort()->ABCDSR[1] |=  mask;
+                    rawPort()->ABCDSR[0] |=  mask;
+                    rawPort()->PSR &= ~mask;
+                    break;
+
+                default:
+                    break;
+            }
+            rawPort()->update();
+
+            /* if all pins are output, disable PIO Controller clocking, reduce power consumption */
+            if ( rawPort()->OSR == 0xffffffff )
+            {
+                HostCommon::disablePeripheralClock(peripheralId());
+            } else {
+                HostCommon::enablePeripheralClock(peripheralId());
+            }
+        };
+        // Returns the mode of ONE pin, and only Input or Output
+        PinMode getMode(const uintPort_t mask) const {
+            if (!(rawPort()->PSR & mask)) {
+                if (!(rawPort()->ABCDSR[1] & mask)) {
+                    return (rawPort()->ABCDSR[0] & mask) ? kPeripheralB : kPeripheralA;
+                } else {
+                    return (rawPort()->ABCDSR[0] & mask) ? kPeripheralD : kPeripheralC;
+                }
+            }
+
+            return (rawPort()->OSR & mask) ? kOutput : kInput;
+        };
+        void setOptions(const PinOptions_t options, const uintPort_t mask) {
+            if (kStartHigh & options)
+            {
+                rawPort()->ODSR |= mask;
+            } else if (kStartLow & options)
+            {
+                rawPort()->ODSR &= ~mask;
+            }
+            if (kPullUp & options)
+            {
+                rawPort()->PUSR |= mask;
+            }
+            else
+            {
+                rawPort()->PUSR &= ~mask;
+            }
+            if (kWiredAnd & options)
+            {/*kDriveLowOnly - Enable Multidrive*/
+                rawPort()->MDSR |= mask;
+            }
+            else
+            {
+                rawPort()->MDSR &= ~mask;
+            }
+            if (kDeglitch & options)
+            {
+                rawPort()->IFSR |= mask;
+                rawPort()->IFDGSR &= ~mask;
+            }
+            else
+            {
+                if (kDebounce & options)
+                {
+                    rawPort()->IFSR |= mask;
+                    rawPort()->IFDGSR |= mask;
+                }
+                else
+                {
+                    rawPort()->IFSR &= ~mask;
+                }
+            }
+            rawPort()->update();
+        };
+        PinOptions_t getOptions(const uintPort_t mask) {
+            return ((rawPort()->PUSR & mask) ? kPullUp : 0) |
+            ((rawPort()->MDSR & mask) ? kWiredAnd : 0) |
+            ((rawPort()->IFSR & mask) ?
+             ((rawPort()->IFDGSR & mask) ? kDebounce : kDeglitch) : 0);
+        };
+        void set(const uintPort_t mask) {
+            rawPort()->ODSR |= mask;
+            rawPort()->update();
+        };
+        void clear(const uintPort_t mask) {
+            rawPort()->ODSR &= ~mask;
+            rawPort()->update();
+        };
+        void toggle(const uintPort_t mask) {
+            if (rawPort()->ODSR & mask) {
+                clear(mask);
+            } else {
+                set(mask);
+            }
+        };
+        void write(const uintPort_t value) {
+            rawPort()->ODSR = value;
+            rawPort()->update();
+        };
+        void write(const uintPort_t value, const uintPort_t mask) {
+            rawPort()->ODSR = (rawPort()->ODSR & ~mask) | (value & mask);
+            rawPort()->update();
+        };
+        uintPort_t getInputValues(const uintPort_t mask) {
+            return rawPort()->PDSR & mask;
+        };
+        uintPort_t getOutputValues(const uintPort_t mask) {
+            return rawPort()->ODSR & mask;
+        };
+        HostPio* portPtr() {
+            return rawPort();
+        };
+        void setInterrupts(const uint32_t interrupts, const uintPort_t mask) {
+            if (interrupts != kPinInterruptsOff) {
+                rawPort()->IMR &= ~mask;
+
+                /*Is it an "advanced" interrupt?*/
+                if (interrupts & kPinInterruptAdvancedMask) {
+                    rawPort()->AIMMR |= mask;
+                    /*Is it an edge interrupt?*/
+                    if ((interrupts & kPinInterruptTypeMask) == kPinInterruptOnRisingEdge ||
+                        (interrupts & kPinInterruptTypeMask) == kPinInterruptOnFallingEdge) {
+                        rawPort()->ELSR &= ~mask;
+                    }
+                    else
+                        if ((interrupts & kPinInterruptTypeMask) == kPinInterruptOnHighLevel ||
+                            (interrupts & kPinInterruptTypeMask) == kPinInterruptOnLowLevel) {
+                            rawPort()->ELSR |= mask;
+                        }
+                    /*Rising Edge/High Level, or Falling Edge/LowLevel?*/
+                    if ((interrupts & kPinInterruptTypeMask) == kPinInterruptOnRisingEdge ||
+                        (interrupts & kPinInterruptTypeMask) == kPinInterruptOnHighLevel) {
+                        rawPort()->FRLHSR |= mask;
+                    }
+                    else
+                    {
+                        rawPort()->FRLHSR &= ~mask;
+                    }
+                }
+                else
+                {
+                    rawPort()->AIMMR &= ~mask;
+                }
+
+                /* Set interrupt priority */
+                if (interrupts & kPinInterruptPriorityMask) {
+                    if (interrupts & kPinInterruptPriorityHighest) {
+                        NVIC_SetPriority(_IRQn(), 0);
+                    }
+                    else if (interrupts & kPinInterruptPriorityHigh) {
+                        NVIC_SetPriority(_IRQn(), 1);
+                    }
+                    else if (interrupts & kPinInterruptPriorityMedium) {
+                        NVIC_SetPriority(_IRQn(), 2);
+                    }
+                    else if (interrupts & kPinInterruptPriorityLow) {
+                        NVIC_SetPriority(_IRQn(), 3);
+                    }
+                    else if (interrupts & kPinInterruptPriorityLowest) {
+                        NVIC_SetPriority(_IRQn(), 4);
+                    }
+                }
+                /* Enable the IRQ */
+                NVIC_EnableIRQ(_IRQn());
+                /* Enable the interrupt */
+                rawPort()->IMR |= mask;
+            } else {
+                rawPort()->IMR &= ~mask;
+                if (rawPort()->IMR == 0)
+                    NVIC_DisableIRQ(_IRQn());
+            }
+        };
+
+        void addInterrupt(_pinChangeInterrupt *newInt) {
+            _interrupts.add(newInt);
+        };
+
+        // Simulation hooks: drive (or stop driving) the pins in mask from the "outside"
+        void simulateInput(const uintPort_t value, const uintPort_t mask) {
+            rawPort()->drive(value, mask);
+        };
+        void simulateRelease(const uintPort_t mask) {
+            rawPort()->release(mask);
+        };
+    };
+
+
+
+    /**************************************************
+     *
+     * BASIC PINS: _MAKE_MOTATE_PIN
+     *
+     **************************************************/
+
+#define _MAKE_MOTATE_PIN(pinNum, registerChar, registerPin) \
+    template<> \
+    struct Pin<pinNum> : RealPin<registerChar, registerPin> { \
+        static const int16_t number = pinNum; \
+        static const uint8_t portLetter = (uint8_t) registerChar; \
+        Pin() : RealPin<registerChar, registerPin>() {}; \
+        Pin(const PinMode type, const PinOptions_t options = kNormal) : RealPin<registerChar, registerPin>(type, options) {}; \
+    }; \
+    template<> \
+    struct ReversePinLookup<registerChar, registerPin> : Pin<pinNum> { \
+        ReversePinLookup() {}; \
+        ReversePinLookup(const PinMode type, const PinOptions_t options = kNormal) : Pin<pinNum>(type, options) {}; \
+    };
+
+
+
+#pragma mark IRQPin support
+    /**************************************************
+     *
+     * PIN CHANGE INTERRUPT SUPPORT: IsIRQPin / MOTATE_PIN_INTERRUPT
+     *
+     **************************************************/
+
+    template<int16_t pinNum>
+    constexpr const bool IsIRQPin() { return !Pin<pinNum>::isNull(); }; // Basically return if we have a valid pin.
+
+#define MOTATE_PIN_INTERRUPT(number) \
+    template<> void Motate::IRQPin<number>::interrupt()
+
+
+
+#pragma mark ADC_Module/ACD_Pin
+    /**************************************************
+     *
+     * PIN CHANGE INTERRUPT SUPPORT: ADC_Module/ACD_Pin
+     *
+     **************************************************/
+
+    // A (simplified) model of the Sam3x ADC. The "analog" input of each channel is set
+    // with simulateInput(), and a conversion of every enabled channel takes
+    // _conversion_time_ns after startSampling(). In free-running mode conversions
+    // repeat back-to-back. Conversions are also moved, tagged, by the PDC when it's
+    // enabled, and ENDRX is latched (as on the Sam3x) until the PDC is written again.
+    struct HostAdc {
+        static constexpr uint32_t DRDY = 1u << 24;
+        static constexpr uint32_t ENDRX = 1u << 27;
+        static constexpr uint32_t RXBUFF = 1u << 28;
+
+        uint32_t CHSR;      // channels enabled
+        uint32_t IMR;       // interrupts enabled
+        uint32_t ISR;       // end-of-conversion (per channel) and DRDY
+        uint32_t CDR[16];   // last converted data, per channel
+        uint32_t LCDR;      // last converted data
+        uint16_t input[16]; // simulated analog inputs
+        bool freerun;
+
+        HostPDC pdc;
+        bool end_rx;
+
+        HostSimEvent conversion_event;
+
+        HostAdc() {
+            pdc.on_change = [&]() { end_rx = false; };
+        };
+
+        void startConversion();
+        void completeConversion();
+
+        // The PDC status bits, which aren't cleared by reading
+        uint32_t status() const {
+            return (end_rx ? ENDRX : 0) | (pdc.rxBufferFull() ? RXBUFF : 0);
+        };
+
+        // Read-and-clear, like reading ADC_ISR (DRDY is cleared by reading LCDR on the real part)
+        uint32_t readISR() {
+            uint32_t isr = ISR | status();
+            ISR = 0;
+            return isr;
+        };
+    };
+
+    extern HostAdc HostADC;
+
+    // Internal ADC object, and a parent of the ADCPin objects.
+    // Handles: Setting options for the ADC module as a whole,
+    //          and initializing the ADC module once.
+    struct ADC_Module {
+        static const uint32_t _default_adc_clock_frequency = 20 * 1000000; // 20MHz
+        static const uint32_t _default_adc_startup_time = 12;
+
+        // Time one conversion of all enabled channels takes
+        static const uint32_t _conversion_time_ns = 1000;
+
+        static const uint32_t peripheralId() { return ID_ADC; }
+        static constexpr bool is_real = true;
+
+        const float _default_vref = 3.28;
+        float _vref = _default_vref;
+
+        static bool _inited;
+        static _pinChangeInterruptTable _interrupts;
+
+        void init(const uint32_t adc_clock_frequency, const uint8_t adc_startuptime) {
+            if (_inited) {
+                return;
+            }
+            _inited = true;
+
+            HostCommon::enablePeripheralClock(peripheralId());
+
+            HostADC.ISR = 0;
+        };
+
+        ADC_Module() {
+            init(_default_adc_clock_frequency, _default_adc_startup_time);
+        };
+
+        static void startSampling() {
+            HostADC.startConversion(); /* start the sample */;
+        };
+
+        static void startFreeRunning() {
+            HostADC.freerun = true;
+            HostADC.startConversion();
+        };
+
+        void initPin(const uint32_t adcNumber, bool differential) {
+            // NOTE: differential is ignored
+            const uint32_t adcMask = 1<<adcNumber;
+
+            /* Enable the pin */
+            HostADC.CHSR |= adcMask;
+        };
+        int32_t getRawPin(const uint32_t adcNumber) {
+            return HostADC.CDR[adcNumber];
+        };
+        int32_t getValuePin(const uint32_t adcNumber) {
+            const uint32_t adcMask = 1<<adcNumber;
+            if ((HostADC.CHSR & adcMask) != adcMask) {
+                HostADC.ISR &= ~HostAdc::DRDY;
+                HostADC.startConversion(); /* start the sample */
+                while ((HostADC.ISR & HostAdc::DRDY) != HostAdc::DRDY) { HostSim::idle(); } /* Wait... */
+            }
+            return getRawPin(adcNumber);
+        };
+        int32_t getBottomPin(const uint32_t adcNumber) {
+            return 0;
+        };
+        float getBottomVoltagePin(const uint32_t adcNumber) {
+            return 0.0;
+        }
+        int32_t getTopPin(const uint32_t adcNumber) {
+            return 4095;
+        };
+        float getTopVoltagePin(const uint32_t adcNumber) {
+            return _vref;
+        }
+        void setVoltageRangePin(const uint32_t adcNumber,
+                                const float vref,
+                                const float min_expected,
+                                const float max_expected,
+                                const float ideal_steps)
+        {
+            _vref = vref; // all pins on the same module share the same vref
+            // ignore min_expected and max_expected for now
+        };
+
+        void setInterrupts(const uint32_t interrupts, const uint32_t adcMask) {
+            if (interrupts != kPinInterruptsOff) {
+                /* Set interrupt priority */
+                if (interrupts & kPinInterruptPriorityMask) {
+                    if (interrupts & kPinInterruptPriorityHighest) {
+                        NVIC_SetPriority(ADC_IRQn, 0);
+                    }
+                    else if (interrupts & kPinInterruptPriorityHigh) {
+                        NVIC_SetPriority(ADC_IRQn, 1);
+                    }
+                    else if (interrupts & kPinInterruptPriorityMedium) {
+                        NVIC_SetPriority(ADC_IRQn, 2);
+                    }
+                    else if (interrupts & kPinInterruptPriorityLow) {
+                        NVIC_SetPriority(ADC_IRQn, 3);
+                    }
+                    else if (interrupts & kPinInterruptPriorityLowest) {
+                        NVIC_SetPriority(ADC_IRQn, 4);
+                    }
+                }
+                /* Enable the IRQ */
+                NVIC_EnableIRQ(ADC_IRQn);
+                /* Enable the interrupt */
+                HostADC.IMR |= adcMask;
+                /* Enable the pin */
+                HostADC.CHSR |= adcMask;
+            } else {
+                /* Disable the pin */
+                HostADC.CHSR &= ~adcMask;
+                /* Disable the interrupt */
+                HostADC.IMR &= ~adcMask;
+                /* Disable the interrupt - if all channels are disabled */
+                if (HostADC.CHSR == 0) {
+                    NVIC_DisableIRQ(ADC_IRQn);
+                }
+            }
+        };
+
+        void addInterrupt(_pinChangeInterrupt *newInt) {
+            _interrupts.add(newInt);
+        };
+
+        // Simulation hook: set the "analog" value (0..4095) the given channel will convert to
+        static void simulateInput(const uint32_t adcNumber, const uint16_t value) {
+            HostADC.input[adcNumber] = value & 0x0FFF;
+        };
+    };
+
+    #define _MAKE_MOTATE_ADC_PIN(registerChar, registerPin, adcNum) \
+        template<> \
+        struct ADCPinParent< ReversePinLookup<registerChar, registerPin>::number > : ADC_Module { \
+            static constexpr uint32_t adcMask = 1 << adcNum; \
+            static constexpr uint32_t adcNumber = adcNum; \
+        };
+
+#pragma mark ADCSampler support
+
+    template<uint8_t adcPeripheralNumber>
+    struct DMA_Host_hardware<HostAdc*, adcPeripheralNumber>
+    {
+        static HostAdc * const adc() { return &HostADC; };
+        static HostPDC * const pdc() { return &adc()->pdc; };
+
+        typedef uint16_t* buffer_t;
+
+        void startRxDoneInterrupts(const bool include_next = false) const {
+            adc()->IMR |= include_next ? HostAdc::RXBUFF : HostAdc::ENDRX;
+        };
+        void stopRxDoneInterrupts(const bool include_next = false) const {
+            adc()->IMR &= ~(include_next ? HostAdc::RXBUFF : HostAdc::ENDRX);
+        };
+        // There's no transmit side
+        void startTxDoneInterrupts(const bool include_next = true) const {};
+        void stopTxDoneInterrupts(const bool include_next = true) const {};
+
+        bool inRxBufferFullInterrupt() const
+        {
+            return adc()->IMR & adc()->status() & (HostAdc::RXBUFF | HostAdc::ENDRX);
+        }
+
+        bool inTxBufferEmptyInterrupt() const
+        {
+            return false;
+        }
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<HostAdc*, periph_num> : DMA_Host<HostAdc*, periph_num> {
+        constexpr DMA() : DMA_Host<HostAdc*, periph_num>{} {};
+    };
+
+    // The hardware half of ADCSampler (see MotateADCSampler.h), the same as the Sam3x:
+    // conversions start on each rising edge of TIOA of a timer, and the PDC moves them
+    // into a ring of two blocks, with ENDRX (through ADC_Handler) at the end of each.
+    template<uint8_t adcNum>
+    struct _ADCSamplerHardware {
+        static_assert(adcNum == 0, "_ADCSamplerHardware<n>: there is only ADC 0");
+
+        // The channel is in bits 15:12, like the Sam3x with the TAG enabled
+        typedef uint16_t sample_t;
+        static constexpr uint8_t channelCount = 16;
+        static uint8_t sampleChannel(const sample_t sample) { return sample >> 12; };
+        static int32_t sampleValue(const sample_t sample) { return sample & 0x0FFF; };
+
+        ADC_Module adc;
+        DMA<HostAdc*, adcNum> dma;
+        _pinChangeInterrupt _endOfBlockInterrupt;
+        HostTcChannel *_trigger = nullptr;
+
+        _ADCSamplerHardware(Delegate<void(void)> &&blockDone)
+            : _endOfBlockInterrupt{HostAdc::ENDRX, std::move(blockDone), ADC_Module::_interrupts} {};
+
+        void setChannels(const uint32_t channelMask) {
+            HostADC.CHSR = channelMask & 0xFFFF;
+        };
+
+        template<uint8_t timerNum>
+        void start(sample_t *blockA, sample_t *blockB, const uint16_t length) {
+            static_assert(timerNum < 3, "_ADCSamplerHardware: the ADC can only be triggered by TIOA of Timer<0> through Timer<2>");
+
+            dma.disableRx();
+            dma.setRx(blockA, length);
+            dma.setNextRx(blockB, length);
+            dma.enableRx();
+
+            HostADC.freerun = false;
+            _trigger = &HostTC[timerNum];
+            _trigger->on_tioa_rise = []() { HostADC.startConversion(); };
+            _trigger->update();
+
+            dma.startRxDoneInterrupts();
+            NVIC_EnableIRQ(ADC_IRQn);
+        };
+
+        void stop() {
+            if (_trigger != nullptr) {
+                _trigger->on_tioa_rise = nullptr;
+                _trigger->update();
+                _trigger = nullptr;
+            }
+            dma.stopRxDoneInterrupts();
+            dma.disableRx();
+        };
+
+        // Called from the interrupt with the block that was just filled, to hand it back to the PDC.
+        // Returns false if the other block was already full too, and the PDC stopped.
+        bool blockDone(sample_t *block, const uint16_t length) {
+            if (dma.doneReading()) {
+                return false;
+            }
+            dma.setNextRx(block, length);
+            return true;
+        };
+    };
+
+
+#pragma mark PWMOutputPin support
+    /**************************************************
+     *
+     * PWM ("fake" analog) output pin support: _MAKE_MOTATE_PWM_PIN
+     *
+     **************************************************/
+
+    #define _MAKE_MOTATE_PWM_PIN(registerChar, registerPin, timerOrPWM, peripheralAorB, invertedByDefault) \
+        template<> \
+        struct AvailablePWMOutputPin< ReversePinLookup<registerChar, registerPin>::number > : RealPWMOutputPin< ReversePinLookup<registerChar, registerPin>::number, timerOrPWM > { \
+            typedef timerOrPWM parentTimerType; \
+            static const pin_number pinNum = ReversePinLookup<registerChar, registerPin>::number; \
+            AvailablePWMOutputPin() : RealPWMOutputPin<pinNum, timerOrPWM>{kPeripheral ## peripheralAorB} { pwmpin_init(invertedByDefault ? kPWMOnInverted : kPWMOn);}; \
+            AvailablePWMOutputPin(const PinOptions_t options, const uint32_t freq) : RealPWMOutputPin<pinNum, timerOrPWM>{kPeripheral ## peripheralAorB, options, freq} { \
+                pwmpin_init((invertedByDefault ^ ((options & kPWMPinInverted)?true:false)) ? kPWMOnInverted : kPWMOn); \
+            }; \
+            using RealPWMOutputPin<pinNum, timerOrPWM>::operator=; \
+            /* Signal to _GetAvailablePWMOrAlike that we're here, AND a real Pin<> exists. */ \
+            static constexpr bool _isAvailable() { return !ReversePinLookup<registerChar, registerPin>::isNull(); };  \
+        };
+
+
+#pragma mark SPI Pins support
+    /**************************************************
+     *
+     * SPI PIN METADATA and wiring: specializes SPIChipSelectPin / SPIMISOPin / SPIMOSIPin / SPISCKPin
+     *
+     * Provides: _MAKE_MOTATE_SPI_CS_PIN
+     *           _MAKE_MOTATE_SPI_MISO_PIN
+     *           _MAKE_MOTATE_SPI_MOSI_PIN
+     *           _MAKE_MOTATE_SPI_SCK_PIN
+     *
+     **************************************************/
+
+
+#define _MAKE_MOTATE_SPI_CS_PIN(registerChar, registerPin, spiNumber, peripheralAorB, csNum)             \
+    template <>                                                                                          \
+    struct SPIChipSelectPin<ReversePinLookup<registerChar, registerPin>::number>                         \
+        : ReversePinLookup<registerChar, registerPin> {                                                  \
+        SPIChipSelectPin() : ReversePinLookup<registerChar, registerPin>(kPeripheral##peripheralAorB){}; \
+        static constexpr bool    is_real     = true;                                                     \
+        static constexpr uint8_t spiNum      = spiNumber;                                                \
+        static constexpr uint8_t csNumber    = csNum;                                                    \
+        static constexpr uint8_t csValue     = ~(1 << csNum);                                            \
+        static constexpr bool    usesDecoder = false;                                                    \
+    };
+
+#define _MAKE_MOTATE_SPI_MISO_PIN(registerChar, registerPin, spiNumber, peripheralAorB)             \
+    template <>                                                                                     \
+    struct SPIMISOPin<ReversePinLookup<registerChar, registerPin>::number>                          \
+        : ReversePinLookup<registerChar, registerPin> {                                             \
+        SPIMISOPin() : ReversePinLookup<registerChar, registerPin>{kPeripheral##peripheralAorB} {}; \
+        static constexpr bool    is_real = true;                                                    \
+        static constexpr uint8_t spiNum  = spiNumber;                                               \
+    };
+
+
+#define _MAKE_MOTATE_SPI_MOSI_PIN(registerChar, registerPin, spiNumber, peripheralAorB)             \
+    template <>                                                                                     \
+    struct SPIMOSIPin<ReversePinLookup<registerChar, registerPin>::number>                          \
+        : ReversePinLookup<registerChar, registerPin> {                                             \
+        SPIMOSIPin() : ReversePinLookup<registerChar, registerPin>{kPeripheral##peripheralAorB} {}; \
+        static constexpr bool    is_real = true;                                                    \
+        static constexpr uint8_t spiNum  = spiNumber;                                               \
+    };
+
+
+#define _MAKE_MOTATE_SPI_SCK_PIN(registerChar, registerPin, spiNumber, peripheralAorB)             \
+    template <>                                                                                    \
+    struct SPISCKPin<ReversePinLookup<registerChar, registerPin>::number>                          \
+        : ReversePinLookup<registerChar, registerPin> {                                            \
+        SPISCKPin() : ReversePinLookup<registerChar, registerPin>{kPeripheral##peripheralAorB} {}; \
+        static constexpr bool    is_real = true;                                                   \
+        static constexpr uint8_t spiNum  = spiNumber;                                              \
+    };
+
+
+#pragma mark TWI Pins support
+    /**************************************************
+     *
+     * TWI PIN METADATA and wiring: specializes TWISCKPin / TWISDAPin
+     *
+     * Provides: _MAKE_MOTATE_TWI_SCK_PIN
+     *           _MAKE_MOTATE_TWI_SDA_PIN
+     *
+     **************************************************/
+
+
+    #define _MAKE_MOTATE_TWI_SCK_PIN(registerChar, registerPin, twiNumber, peripheralAorB)\
+        template<>\
+        struct TWISCKPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            TWISCKPin() : ReversePinLookup<registerChar, registerPin>{kPeripheral ## peripheralAorB} {};\
+            static constexpr bool is_real = true; \
+            static constexpr uint8_t twiNum = twiNumber; \
+        };
+
+
+    #define _MAKE_MOTATE_TWI_SDA_PIN(registerChar, registerPin, twiNumber, peripheralAorB)\
+        template<>\
+        struct TWISDAPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            TWISDAPin() : ReversePinLookup<registerChar, registerPin>{kPeripheral ## peripheralAorB} {};\
+            static constexpr bool is_real = true; \
+            static constexpr uint8_t twiNum = twiNumber; \
+        };
+
+
+#pragma mark UART / USART Pin support
+    /**************************************************
+     *
+     * UART/USART PIN METADATA and wiring: specializes UARTTxPin / UARTRxPin / UARTRTSPin / UARTCTSPin
+     *
+     * Provides: _MAKE_MOTATE_UART_TX_PIN
+     *           _MAKE_MOTATE_UART_RX_PIN
+     *           _MAKE_MOTATE_UART_RTS_PIN
+     *           _MAKE_MOTATE_UART_CTS_PIN
+     *
+     **************************************************/
+
+    #define _MAKE_MOTATE_UART_TX_PIN(registerChar, registerPin, uartNumVal, peripheralAorB)\
+        template<>\
+        struct UARTTxPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            UARTTxPin() : ReversePinLookup<registerChar, registerPin>(kPeripheral ## peripheralAorB, kPullUp) {};\
+            static const uint8_t uartNum = uartNumVal;\
+            static const bool is_real = true;\
+        };
+
+    #define _MAKE_MOTATE_UART_RX_PIN(registerChar, registerPin, uartNumVal, peripheralAorB)\
+        template<>\
+        struct UARTRxPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            UARTRxPin() : ReversePinLookup<registerChar, registerPin>(kPeripheral ## peripheralAorB) {};\
+            static const uint8_t uartNum = uartNumVal;\
+            static const bool is_real = true;\
+        };
+
+    #define _MAKE_MOTATE_UART_RTS_PIN(registerChar, registerPin, uartNumVal, peripheralAorB)\
+        template<>\
+        struct UARTRTSPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            UARTRTSPin() : ReversePinLookup<registerChar, registerPin>(kPeripheral ## peripheralAorB) {};\
+            static const uint8_t uartNum = uartNumVal;\
+            static const bool is_real = true;\
+            void operator=(const bool value); /*Will cause a failure if used.*/\
+        };
+
+    #define _MAKE_MOTATE_UART_CTS_PIN(registerChar, registerPin, uartNumVal, peripheralAorB)\
+        template<>\
+        struct UARTCTSPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            UARTCTSPin() : ReversePinLookup<registerChar, registerPin>(kPeripheral ## peripheralAorB, kPullUp) {};\
+            UARTCTSPin(const PinOptions_t options, const std::function<void(void)> &&_interrupt, const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium) : ReversePinLookup<registerChar, registerPin>(kPeripheral ## peripheralAorB, options) {};\
+            void setInterrupts(const uint32_t interrupts); /*Will cause a failure if used.*/\
+            static const uint8_t uartNum = uartNumVal;\
+            static const bool is_real = true;\
+        };
+
+#pragma mark ClockOutputPin
+    /**************************************************
+     *
+     * Clock Output PIN METADATA and wiring: CLKOutPin
+     *
+     * Provides: _MAKE_MOTATE_CLOCK_OUTPUT_PIN
+     *
+     **************************************************/
+
+    // There's no PMC to program, so this only muxes the pin.
+    #define _MAKE_MOTATE_CLOCK_OUTPUT_PIN(registerChar, registerPin, clockNumber, peripheralAorB)\
+        template<>\
+        struct ClockOutputPin< ReversePinLookup<registerChar, registerPin>::number > : ReversePinLookup<registerChar, registerPin> {\
+            ClockOutputPin(const uint32_t target_freq) : ReversePinLookup<registerChar, registerPin>(kPeripheral ## peripheralAorB) {};\
+            static const bool is_real = true;\
+            void operator=(const bool value); /*Will cause a failure if used.*/\
+        };
+
+} // end namespace Motate
+
+#endif /* end of include guard: HOSTPINS_H_ONCE */
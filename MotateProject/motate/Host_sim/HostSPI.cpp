@@ -0,0 +1,98 @@
+/*
+ Host_sim/HostSPI.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MotateSPI.h"
+
+namespace Motate {
+    HostSpi HostSPI0 MOTATE_HOST_MODEL {SPI0_IRQn};
+
+    void HostSpi::_startTransfer() {
+        if (!enabled || busy || !pdc.txActive()) {
+            return;
+        }
+
+        const HostSpiChipSelect &csr = CSR[pcs];
+        transfer_units = pdc.TCR;
+        busy = true;
+
+        uint64_t cycles = (uint64_t)transfer_units * csr.bits * csr.divider;
+        cycles += (uint64_t)transfer_units * csr.dlybct * 32; // DLYBCT is in units of 32 clocks
+        if (!selected) {
+            selected = true;
+            cycles += dlybcs + csr.dlybs;
+        }
+        HostSim::scheduleIn(&transfer_event, cycles);
+
+        if (clocking) { clocking(true); }
+    }
+
+    void HostSpi::_completeTransfer() {
+        const bool wide = CSR[pcs].bits > 8;
+        for (uint32_t i = 0; i < transfer_units; i++) {
+            uint16_t out = 0;
+            if (wide) {
+                pdc.pullTx<uint16_t>(out);
+            } else {
+                uint8_t out8 = 0;
+                pdc.pullTx(out8);
+                out = out8;
+            }
+
+            const uint16_t in = slave ? slave(pcs, out) : out;
+
+            if (wide) {
+                pdc.pushRx<uint16_t>(in);
+            } else {
+                pdc.pushRx<uint8_t>(in);
+            }
+        }
+        busy = false;
+        transfer_units = 0;
+        end_rx = true;
+
+        // The "next" buffer may have rolled in
+        _startTransfer();
+        if (!busy && clocking) { clocking(false); }
+
+        checkInterrupts();
+    }
+
+    template<> Delegate<void()> _SPIHardware<0>::_spiInterruptHandlerJumper MOTATE_HOST_MODEL {};
+}
+
+extern "C" void SPI0_Handler(void)  {
+    if (Motate::_SPIHardware<0u>::_spiInterruptHandlerJumper) {
+        Motate::_SPIHardware<0u>::_spiInterruptHandlerJumper();
+        return;
+    }
+#ifdef IN_DEBUGGER
+    __asm__("BKPT");
+#endif
+}
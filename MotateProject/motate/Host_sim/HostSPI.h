@@ -0,0 +1,592 @@
+/*
+ Host_sim/HostSPI.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef HOSTSPI_H_ONCE
+#define HOSTSPI_H_ONCE
+
+#include "MotatePins.h"
+#include "HostCommon.h"
+#include "HostDMA.h"
+#include <functional>
+#include <type_traits>
+
+namespace Motate {
+
+#pragma mark HostSpi
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostSpi
+     *
+     * An SPI master with a PDC, like the Sam3x SPI. The PDC is drained one
+     * buffer at a time: a whole buffer is exchanged with the slave after the
+     * time it would take to clock it out, then the buffer-done status is set.
+     *
+     * The "wire" is the slave function: it gets the chip select in use and each
+     * word sent, and returns the word received. With no slave MISO is tied to
+     * MOSI (loopback).
+     *
+     **************************************************/
+
+    struct HostSpiChipSelect {
+        uint32_t divider = 1; // SCBR: peripheral clocks per SPI clock
+        uint8_t bits = 8;
+        bool cpol = false;
+        bool ncpha = false;
+        uint8_t dlybs = 0;
+        uint8_t dlybct = 0;
+    };
+
+    struct HostSpi {
+        // SR and IMR bits, same positions as on the Sam parts
+        static constexpr uint32_t RDRF    = 1u << 0;
+        static constexpr uint32_t TDRE    = 1u << 1;
+        static constexpr uint32_t ENDRX   = 1u << 4;
+        static constexpr uint32_t ENDTX   = 1u << 5;
+        static constexpr uint32_t RXBUFF  = 1u << 6;
+        static constexpr uint32_t TXBUFE  = 1u << 7;
+        static constexpr uint32_t TXEMPTY = 1u << 9;
+
+        bool enabled = false;
+        bool decoder = false;  // PCSDEC
+        uint8_t pcs = 0;       // the chip select (CSR index) in use
+        uint8_t dlybcs = 0;
+        bool selected = false; // is a chip select asserted?
+        HostSpiChipSelect CSR[4];
+
+        uint32_t IMR = 0;
+        bool busy = false;
+        uint32_t transfer_units = 0; // words in the transfer that's in flight
+        bool end_rx = false;         // ENDRX: latched at the end of each RX buffer, cleared by reloading the PDC
+
+        HostPDC pdc;
+        const IRQn_Type irq;
+        HostSimEvent transfer_event;
+
+        // The device(s) on the other end of the wire
+        std::function<uint16_t(uint8_t cs, uint16_t mosi)> slave;
+        // Called when the chip select is released, so a slave can see the end of a transaction
+        std::function<void(uint8_t cs)> deselected;
+        // Called when each transfer starts (true), and when the bus goes idle (false), so the
+        // gaps between transfers can be seen. A "next" buffer that rolls in is not a gap.
+        std::function<void(bool active)> clocking;
+
+        HostSpi(const IRQn_Type _irq) : irq{_irq} {
+            transfer_event.action = [this]() { _completeTransfer(); };
+            pdc.on_change = [this]() { end_rx = false; _startTransfer(); };
+        };
+
+        uint32_t status() const {
+            uint32_t sr = 0;
+            if (!busy) { sr |= TDRE | TXEMPTY; }
+            if (end_rx) { sr |= ENDRX; }
+            if (pdc.rxBufferFull()) { sr |= RXBUFF; }
+            if (pdc.endTx()) { sr |= ENDTX; }
+            if (pdc.txBufferEmpty()) { sr |= TXBUFE; }
+            return sr;
+        };
+
+        // Interrupt enables take effect immediately, like the level-sensitive hardware
+        void enableInterrupts(const uint32_t mask) {
+            IMR |= mask;
+            checkInterrupts();
+        };
+        void disableInterrupts(const uint32_t mask) { IMR &= ~mask; };
+        void checkInterrupts() {
+            if (status() & IMR) {
+                NVIC_SetPendingIRQ(irq);
+            }
+        };
+
+        void enable() {
+            enabled = true;
+            _startTransfer();
+        };
+        void disable() { enabled = false; };
+
+        // LASTXFER: release the chip select once the current transfer is done
+        void deassert() {
+            if (selected) {
+                selected = false;
+                if (deselected) { deselected(pcs); }
+            }
+        };
+
+        // Drop the transfer in flight, as though the PDC had been disabled mid-transfer
+        void abort() {
+            HostSim::cancel(&transfer_event);
+            if (busy) {
+                busy = false;
+                transfer_units = 0;
+                if (clocking) { clocking(false); }
+            }
+        };
+
+        void _startTransfer();
+        void _completeTransfer();
+    };
+
+    extern HostSpi HostSPI0;
+
+    // Empty class to use as a tag for template specialization
+    struct SPI_tag {};
+
+    template<uint8_t spiPeripheralNumber>
+    struct DMA_Host_hardware<SPI_tag, spiPeripheralNumber> {
+        static_assert(spiPeripheralNumber == 0, "Only SPI0 is simulated.");
+        static HostSpi * const spi() { return &HostSPI0; };
+        static HostPDC * const pdc() { return &HostSPI0.pdc; };
+
+        typedef char* buffer_t ;
+
+        void startRxDoneInterrupts(const bool include_next = false) const {
+            spi()->enableInterrupts(HostSpi::RXBUFF);
+        };
+        void stopRxDoneInterrupts(const bool include_next = false) const {
+            spi()->disableInterrupts(HostSpi::RXBUFF);
+        };
+        void startTxDoneInterrupts(const bool include_next = true) const {
+            spi()->enableInterrupts(HostSpi::TXBUFE);
+        };
+        void stopTxDoneInterrupts(const bool include_next = true) const {
+            spi()->disableInterrupts(HostSpi::TXBUFE);
+        };
+
+        bool inRxBufferFullInterrupt() const
+        {
+            return (spi()->IMR & HostSpi::RXBUFF) && (spi()->status() & HostSpi::RXBUFF);
+        }
+
+        bool inTxBufferEmptyInterrupt() const
+        {
+            return (spi()->IMR & HostSpi::TXBUFE) && (spi()->status() & HostSpi::TXBUFE);
+        }
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<SPI_tag, periph_num> : DMA_Host<SPI_tag, periph_num> {
+        // we take the handler, but we don't actually handle interrupts for the peripheral
+        // so we ignore it
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_Host<SPI_tag, periph_num>{} {};
+    };
+
+    template<int8_t spiPeripheralNumber>
+    struct _SPIHardware
+    {
+        static_assert(spiPeripheralNumber == 0,
+                "Only _SPIHardware<0> is valid on this processor.");
+
+        static HostSpi * const spi() { return &HostSPI0; };
+        static constexpr uint32_t peripheralId = ID_SPI0;
+        static constexpr IRQn_Type spiIRQ = SPI0_IRQn;
+        static constexpr auto spiPeripheralNum = spiPeripheralNumber;
+
+        // How many messages startTransfer() can chain into one transfer: the PDC's current
+        // and "next" buffers.
+        static constexpr uint8_t maxChainedTransfers = 2;
+
+        Delegate<void(Interrupt::Type)> _spiInterruptHandler;
+
+        DMA<SPI_tag, spiPeripheralNumber> dma {_spiInterruptHandler};
+
+        static Delegate<void()> _spiInterruptHandlerJumper;
+        _SPIHardware() {
+            HostCommon::enablePeripheralClock(peripheralId);
+
+            disable();
+        };
+
+        void init() {
+            spi()->deassert();
+
+            // Disable all interrupts
+            spi()->disableInterrupts(0x7FF);
+
+            // setup interrupt handlers BEFORE setting up DMA, in case it causes an interrupt
+            _spiInterruptHandlerJumper = [&]() {
+                if (_spiInterruptHandler) {
+                    _spiInterruptHandler(getInterruptCause());
+                } else {
+#ifdef IN_DEBUGGER
+                    __asm__("BKPT");
+#endif
+                }
+            };
+            setInterrupts(Interrupt::PriorityLow);
+            dma.reset();
+            dma.setInterrupts(Interrupt::PriorityLow);
+        };
+
+        // This is to be called by the device, once it detects a "decoded" CS pin
+        void setUsingCSDecoder(bool decoder) {
+            spi()->decoder = decoder;
+        }
+
+        void enable() {
+            spi()->enable();
+        };
+
+        void disable() {
+            spi()->disable();
+        };
+
+        void deassert() {
+            spi()->deassert();
+        }
+
+        bool setChannel(const uint8_t channel, const bool deassert_after = false) {
+            // if we are transmitting, we cannot switch
+            while (spi()->busy) {
+                HostSim::idle();
+            }
+
+            // Decode PCS like the hardware: with a decoder the chip select is the top two bits,
+            // otherwise it's the lowest bit that's low.
+            uint8_t pcs = 0;
+            if (spi()->decoder) {
+                pcs = (channel >> 2) & 0x3;
+            } else {
+                while ((pcs < 3) && (channel & (1 << pcs))) {
+                    pcs++;
+                }
+            }
+
+            if (spi()->pcs != pcs) {
+                spi()->deassert();
+            }
+            spi()->pcs = pcs;
+
+            enable();
+            return true;
+        }
+
+        void setChannelOptions(const uint8_t channel, const uint32_t baud, const uint16_t options, uint32_t min_between_cs_delay_ns, uint32_t cs_to_sck_delay_ns, uint32_t between_word_delay_ns) {
+            // We derive the baud from the master clock with a divider.
+            // We want the closest match *below* the value asked for. It's safer to bee too slow.
+            HostSpiChipSelect &csr = spi()->CSR[channel & 0x3];
+
+            uint32_t divider = HostCommon::getPeripheralClockFreq() / baud;
+            if (divider > 255) {
+                divider = 255;
+            } else if (divider < 1) {
+                divider = 1;
+            }
+            csr.divider = divider;
+
+            csr.cpol = (options & kSPIPolarityReversed);
+            csr.ncpha = !(options & kSPIClockPhaseReversed);
+
+            // kSPI8Bit is 0, and each step adds a bit
+            csr.bits = 8 + ((options & kSPIBitsMask) >> 2);
+            if (csr.bits > 16) {
+                csr.bits = 8;
+            }
+
+            // these are in mupliples of MCLK (master clock, a.k.a. SystemCoreClock)
+            // we want to round up, not down, so we divide by 100,000,000 instead of
+            // 1,000,000,000, then add 5 and then further divide by 10.
+            uint32_t dlybcs = (((min_between_cs_delay_ns*(uint64_t)HostCommon::getPeripheralClockFreq())/100000000)+5)/10;
+            uint32_t dlybs = (((cs_to_sck_delay_ns*(uint64_t)HostCommon::getPeripheralClockFreq())/100000000)+5)/10;
+            uint32_t dlybct = (((between_word_delay_ns*(uint64_t)HostCommon::getPeripheralClockFreq())/100000000)+5)/10;
+
+            spi()->dlybcs = (dlybcs > 0xff) ? 0xff : dlybcs;
+            csr.dlybs = (dlybs > 0xff) ? 0xff : dlybs;
+            csr.dlybct = (dlybct > 0xff) ? 0xff : dlybct;
+        };
+
+        void setInterruptHandler(Delegate<void(Interrupt::Type)> &&handler) {
+            _spiInterruptHandler = std::move(handler);
+        }
+
+        Interrupt::Type getInterruptCause() {
+            Interrupt::Type status = SPIInterrupt::Unknown;
+
+            auto SPI_SR_hold = spi()->status();
+            auto SPI_IMR_hold = spi()->IMR;
+
+            if ((SPI_IMR_hold & HostSpi::TDRE) && (SPI_SR_hold & HostSpi::TDRE))
+            {
+                status |= SPIInterrupt::OnTxReady;
+            }
+            if ((SPI_IMR_hold & HostSpi::RDRF) && (SPI_SR_hold & HostSpi::RDRF))
+            {
+                status |= SPIInterrupt::OnRxReady;
+            }
+
+            if (dma.inTxBufferEmptyInterrupt())
+            {
+                status |= SPIInterrupt::OnTxTransferDone;
+            }
+            if (dma.inRxBufferFullInterrupt() || ((SPI_IMR_hold & HostSpi::ENDRX) && (SPI_SR_hold & HostSpi::ENDRX)))
+            {
+                status |= SPIInterrupt::OnRxTransferDone;
+            }
+            return status;
+        }
+
+        void setInterrupts(const Interrupt::Type interrupts) {
+            if (interrupts != SPIInterrupt::Off) {
+
+                if (interrupts & SPIInterrupt::OnTxReady) {
+                    spi()->enableInterrupts(HostSpi::TDRE);
+                } else {
+                    spi()->disableInterrupts(HostSpi::TDRE);
+                }
+                if (interrupts & SPIInterrupt::OnRxReady) {
+                    spi()->enableInterrupts(HostSpi::RDRF);
+                } else {
+                    spi()->disableInterrupts(HostSpi::RDRF);
+                }
+
+                if (interrupts & SPIInterrupt::OnRxTransferDone) {
+                    dma.startRxDoneInterrupts();
+                } else {
+                    dma.stopRxDoneInterrupts();
+                }
+                if (interrupts & SPIInterrupt::OnTxTransferDone) {
+                    dma.startTxDoneInterrupts();
+                } else {
+                    dma.stopTxDoneInterrupts();
+                }
+
+                /* Set interrupt priority */
+                if (interrupts & SPIInterrupt::PriorityHighest) {
+                    NVIC_SetPriority(spiIRQ, 0);
+                }
+                else if (interrupts & SPIInterrupt::PriorityHigh) {
+                    NVIC_SetPriority(spiIRQ, 1);
+                }
+                else if (interrupts & SPIInterrupt::PriorityMedium) {
+                    NVIC_SetPriority(spiIRQ, 2);
+                }
+                else if (interrupts & SPIInterrupt::PriorityLow) {
+                    NVIC_SetPriority(spiIRQ, 3);
+                }
+                else if (interrupts & SPIInterrupt::PriorityLowest) {
+                    NVIC_SetPriority(spiIRQ, 4);
+                }
+
+                NVIC_EnableIRQ(spiIRQ);
+            } else {
+
+                NVIC_DisableIRQ(spiIRQ);
+            }
+        };
+
+        void _enableOnTXTransferDoneInterrupt() {
+            dma.startTxDoneInterrupts();
+        };
+
+        void _disableOnTXTransferDoneInterrupt() {
+            dma.stopTxDoneInterrupts();
+        };
+
+        void _enableOnRXTransferDoneInterrupt() {
+            dma.startRxDoneInterrupts();
+        };
+
+        void _disableOnRXTransferDoneInterrupt() {
+            dma.stopRxDoneInterrupts();
+        };
+
+        uint8_t getMessageSlotsAvailable() {
+            uint8_t count = 0;
+            if (dma.doneWriting() && dma.doneReading()) { count++; }
+            return count;
+        };
+
+        // These include the "next" buffer, if there is one
+        bool doneWriting() {
+            return dma.doneWriting(/*include_next=*/ true);
+        };
+        bool doneReading() {
+            return dma.doneReading(/*include_next=*/ true);
+        };
+
+        // start transfer of message
+        bool startTransfer(uint8_t *tx_buffer, uint8_t *rx_buffer, uint16_t size) {
+            bool rx_is_setup = false;
+            bool tx_is_setup = false;
+            const bool handle_interrupts = false;
+            const bool include_next = false;
+
+            dma.setInterrupts(Interrupt::Off);
+            if (rx_buffer != nullptr) {
+                rx_is_setup = dma.startRXTransfer(rx_buffer, size, handle_interrupts, include_next);
+                if (!rx_is_setup) { return false; } // fail early
+            } else {
+                // Setup to transfer one dummy byte repeatedly
+                dma.startRXTransfer(nullptr, size, handle_interrupts, include_next);
+            }
+            if (tx_buffer != nullptr) {
+                tx_is_setup = dma.startTXTransfer(tx_buffer, size, handle_interrupts, include_next);
+            } else {
+                // Setup to transfer one dummy byte repeatedly
+                dma.startTXTransfer(nullptr, size, handle_interrupts, include_next);
+            }
+            if (rx_is_setup || tx_is_setup) {
+                dma.setInterrupts(Interrupt::OnRxTransferDone);
+                enable();
+#ifdef IN_DEBUGGER
+            } else {
+                __asm__("BKPT"); // no transfer setup
+#endif
+            }
+            return rx_is_setup | tx_is_setup;
+        }
+
+        // start transfer of count (up to maxChainedTransfers) messages, back-to-back with CS
+        // held, with one interrupt at the end
+        bool startTransfer(const SPITransferBlock *blocks, const uint8_t count) {
+            if (count == 1) {
+                return startTransfer(blocks[0].tx_buffer, blocks[0].rx_buffer, blocks[0].size);
+            }
+            if (!doneReading() || !doneWriting()) {
+                return false;
+            }
+
+            // Load both buffer pairs directly: a nullptr RX buffer reads as "done" to
+            // startRXTransfer(), which would then put the second buffer in its place.
+            dma.setInterrupts(Interrupt::Off);
+            dma.disableRx();
+            dma.disableTx();
+            dma.setRx(blocks[0].rx_buffer, blocks[0].size);
+            dma.setNextRx(blocks[1].rx_buffer, blocks[1].size);
+            dma.setTx(blocks[0].tx_buffer, blocks[0].size);
+            dma.setNextTx(blocks[1].tx_buffer, blocks[1].size);
+            dma.enableRx();
+            dma.enableTx(); // this starts the clock
+            dma.setInterrupts(Interrupt::OnRxTransferDone);
+            enable();
+            return true;
+        }
+
+        // Streaming (see SPIStream): like the Sam PDC, the ring is kept going from the ENDRX
+        // interrupt at the end of each frame, by loading the "next" buffers two frames ahead.
+        static constexpr uint8_t maxRingFrames = 255;
+        static constexpr uint8_t streamFramesInFlight = 2;
+
+        bool startRing(const uint8_t *tx_frame, uint8_t *ring, const uint16_t frame_size, const uint8_t frame_count) {
+            dma.setInterrupts(Interrupt::Off);
+            dma.disableRx();
+            dma.disableTx();
+            dma.setRx(ring, frame_size);
+            dma.setNextRx(ring + frame_size, frame_size);
+            dma.setTx((void *)tx_frame, frame_size);
+            dma.setNextTx((void *)tx_frame, frame_size);
+            dma.enableRx();
+            dma.enableTx(); // this starts the clock
+            spi()->enableInterrupts(HostSpi::ENDRX);
+            enable();
+            return true;
+        };
+
+        bool ringFrameDone(const uint8_t *tx_frame, uint8_t *next_frame, const uint16_t frame_size) {
+            if (dma.doneReading(/*include_next=*/ true)) {
+                return false; // we were too late, and the clock stopped
+            }
+            dma.setNextRx(next_frame, frame_size);
+            dma.setNextTx((void *)tx_frame, frame_size);
+            return true;
+        };
+
+        void stopRing() {
+            spi()->disableInterrupts(HostSpi::ENDRX);
+            dma.setInterrupts(Interrupt::Off);
+            dma.reset();
+            spi()->abort();
+        };
+    };
+    template <pin_number csBit0PinNumber, pin_number csBit1PinNumber, pin_number csBit2PinNumber, pin_number csBit3PinNumber>
+    struct SPIChipSelectPinMux {
+        // These pins may be null, but if they're not, they must be valid CS pins
+        static_assert(SPIChipSelectPin<csBit0PinNumber>::is_real || Pin<csBit0PinNumber>::isNull(),
+                      "SPIChipSelectPinMux bit 0 pin is not on a real CS pin.");
+        static_assert(SPIChipSelectPin<csBit1PinNumber>::is_real || Pin<csBit1PinNumber>::isNull(),
+                      "SPIChipSelectPinMux bit 0 pin is not on a real CS pin.");
+        static_assert(SPIChipSelectPin<csBit2PinNumber>::is_real || Pin<csBit2PinNumber>::isNull(),
+                      "SPIChipSelectPinMux bit 0 pin is not on a real CS pin.");
+        static_assert(SPIChipSelectPin<csBit3PinNumber>::is_real || Pin<csBit3PinNumber>::isNull(),
+                      "SPIChipSelectPinMux bit 0 pin is not on a real CS pin.");
+
+        struct _dummyCSPin { static constexpr uint8_t csNumber = 0; };
+
+        template<pin_number n>
+        using dummyOrCSPin = typename std::conditional<SPIChipSelectPin<n>::is_real, SPIChipSelectPin<n>, _dummyCSPin>::type;
+
+        // create and initialize the CS pins we use
+        dummyOrCSPin<csBit0PinNumber> bit0Pin;
+        dummyOrCSPin<csBit1PinNumber> bit1Pin;
+        dummyOrCSPin<csBit2PinNumber> bit2Pin;
+        dummyOrCSPin<csBit3PinNumber> bit3Pin;
+
+        typedef SPIChipSelectPinMux<csBit0PinNumber, csBit1PinNumber, csBit2PinNumber, csBit3PinNumber> type;
+
+        constexpr uint8_t computeCsValue(uint8_t cs) {
+            uint8_t csValue = 0;
+            if (cs & (1<<0)) { csValue |= (1<<bit0Pin.csNumber); }
+            if (cs & (1<<1)) { csValue |= (1<<bit1Pin.csNumber); }
+            if (cs & (1<<2)) { csValue |= (1<<bit2Pin.csNumber); }
+            if (cs & (1<<3)) { csValue |= (1<<bit3Pin.csNumber); }
+            return csValue;
+        };
+
+        // Now provide a subobject that offers corect csNumber and csValue for each muxed output
+        // We have three names that are confusing:
+
+        // cs = the number we're going to call this one externally, using the order of the bits we provided
+        //  IOW, cs of 3  is what you get when bit0Pin and bit1Pin are HIGH
+
+        struct SPIChipSelect {
+            // the internal value provided to the spi hardware (PCS for the Sam chips)
+            const uint8_t csValue;
+            // the internal cs number used by the hardware. All cs where csNumber is the same MUST share settings.
+            const uint8_t csNumber;
+            const bool usesDecoder = true;
+
+            SPIChipSelect(SPIChipSelectPinMux * const pm, const uint8_t cs) : csValue{pm->computeCsValue(cs)}, csNumber {(uint8_t)(csValue >> 2)} {
+            };
+
+            // delete copy constructor
+            SPIChipSelect(const SPIChipSelect &) = delete;
+
+            // build move constructor
+            SPIChipSelect(SPIChipSelect && other) : csValue{other.csValue}, csNumber{other.csNumber} {};
+        };
+
+        constexpr SPIChipSelect getCS(const uint8_t cs) { return {this, cs}; };
+    };
+
+
+    // SPIGetHardware is just a pass-through for now
+    template <pin_number spiMISOPinNumber, pin_number spiMOSIPinNumber, pin_number spiSCKPinNumber>
+    using SPIGetHardware = _SPIHardware<SPIMISOPin<spiMISOPinNumber>::spiNum>;
+}
+
+#endif /* end of include guard: HOSTSPI_H_ONCE */
@@ -0,0 +1,168 @@
+/*
+ Host_sim/HostServiceCall.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef HOSTSERVICECALL_H_ONCE
+#define HOSTSERVICECALL_H_ONCE
+
+#include <sys/types.h>
+#include <functional>
+#include <atomic>
+
+#include "MotateTimers.h" // for the interrupt definitions
+
+// This is the same ready queue as SamServiceCall.h (see there for how it works),
+// with PendSV pended through the simulated NVIC (which calls PendSV_Handler right
+// away, if the priority allows).
+
+namespace Motate {
+    typedef const uint32_t service_call_number;
+
+    struct ServiceCallEvent {
+        // REMEMBER: "higher priority" means a lower number!!!
+        //           0 is the highest priority!
+        static constexpr int32_t kPriorityLevels = 1 << __NVIC_PRIO_BITS;
+
+        ServiceCallEventHandler *handler_;
+        std::atomic<ServiceCallEvent *> _next = nullptr;
+        std::atomic<bool> _queued = false;
+
+        static std::atomic<ServiceCallEvent *> _ready_lists[kPriorityLevels];
+        static std::atomic<uint32_t> _ready_levels;
+        static ServiceCallEvent *_dispatch_lists[kPriorityLevels]; // only touched from PendSV_Handler
+
+        uint32_t _interrupt_level = kInterruptPriorityLowest; // start at the lowest
+        // we need to convert the enum to a priority value we can compare with
+        int32_t _priority_value = 4;
+
+        static constexpr uint32_t _levelBit(const int32_t level) { return 0x80000000u >> level; };
+
+        void _call_or_queue() {
+            if (_queued.exchange(true)) {
+                // Already queued -- it'll get called.
+                return;
+            }
+
+            const int32_t level = _priority_value;
+
+            ServiceCallEvent *orig_first_service_call = _ready_lists[level].load(std::memory_order_relaxed);
+            do {  // loop until it works
+                _next.store(orig_first_service_call, std::memory_order_relaxed);
+            } while (!_ready_lists[level].compare_exchange_weak(orig_first_service_call, this,
+                                                                std::memory_order_release,
+                                                                std::memory_order_relaxed));
+
+            // The bit is set *after* the push, so if PendSV sees the bit it'll find the call.
+            _ready_levels.fetch_or(_levelBit(level), std::memory_order_release);
+
+            _pend();
+        };
+
+        // We were queued and pended, then called.
+        void _call() {
+            // Mark it as un-queued so it can be re-queued
+            _queued = false;
+
+            // ... and finally:
+            if (handler_) {
+                handler_->handleServiceCallEvent();
+            }
+        };
+
+        // Clear the bit for level if there's nothing left there. A call queued while we
+        // do this will either be seen by the re-check, or set the bit itself afterward.
+        static void _clearLevelIfEmpty(const int32_t level) {
+            if (_dispatch_lists[level] != nullptr) {
+                return;
+            }
+            _ready_levels.fetch_and(~_levelBit(level), std::memory_order_acq_rel);
+            if (_ready_lists[level].load(std::memory_order_acquire) != nullptr) {
+                _ready_levels.fetch_or(_levelBit(level), std::memory_order_release);
+            }
+        };
+
+        // This is called *ONLY* from the handler (in the .cpp file)
+        // Call the first of the highest-priority calls waiting, then re-pend for the rest.
+        static void _call_from_handler() {
+            uint32_t ready_levels;
+            while ((ready_levels = _ready_levels.load(std::memory_order_acquire)) != 0) {
+                const int32_t level = __builtin_clz(ready_levels);
+
+                if (_dispatch_lists[level] == nullptr) {
+                    ServiceCallEvent *ready = _ready_lists[level].exchange(nullptr, std::memory_order_acquire);
+                    while (ready != nullptr) {
+                        ServiceCallEvent *next = ready->_next.load(std::memory_order_relaxed);
+                        ready->_next.store(_dispatch_lists[level], std::memory_order_relaxed);
+                        _dispatch_lists[level] = ready;
+                        ready = next;
+                    }
+                }
+
+                ServiceCallEvent *first_service_call = _dispatch_lists[level];
+                if (first_service_call == nullptr) {
+                    // The bit was set by a call that we already dispatched
+                    _clearLevelIfEmpty(level);
+                    continue;
+                }
+
+                _dispatch_lists[level] = first_service_call->_next.load(std::memory_order_relaxed);
+                first_service_call->_next.store(nullptr, std::memory_order_relaxed);
+                _clearLevelIfEmpty(level);
+
+                first_service_call->_call();
+                break;
+            }
+
+            _pend();
+        }
+
+        // Pend PendSV at the priority of the highest-priority call waiting, if there is one.
+        static void _pend() {
+            /* Set interrupt priority */
+            {
+                // This keeps a higher-priority call from being queued (and setting the priority)
+                // between reading _ready_levels and setting the priority here.
+                HostCommon::InterruptDisabler disabler;
+
+                const uint32_t ready_levels = _ready_levels.load(std::memory_order_acquire);
+                if (ready_levels == 0) {
+                    return;
+                }
+
+                NVIC_SetPriority(PendSV_IRQn, __builtin_clz(ready_levels));
+            }
+
+            NVIC_SetPendingIRQ(PendSV_IRQn);
+        };
+
+        virtual void _debug_print_num() {;};
+    };
+}
+
+#endif /* end of include guard: HOSTSERVICECALL_H_ONCE */
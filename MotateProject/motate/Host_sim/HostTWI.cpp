@@ -0,0 +1,111 @@
+/*
+ Host_sim/HostTWI.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MotateTWI.h"
+
+namespace Motate {
+    HostTwi HostTWI0 MOTATE_HOST_MODEL {TWI0_IRQn};
+
+    // These are declared (but not defined) by MotateTWI.h.
+    void TWIInterruptHandler::handleTWIInterrupt(const TWIInterruptCause& interruptCause) {};
+    const TWIAddress& TWIBusDeviceBase::getAddress() const {
+        static const TWIAddress no_address {};
+        return no_address;
+    };
+
+    void HostTwi::_startTransfer() {
+        if (!enabled || busy || !(mread ? pdc.rxActive() : pdc.txActive())) {
+            return;
+        }
+
+        // START + address, the internal address bytes, a repeated START + address for
+        // reads with an internal address, then the data -- each byte is nine clocks
+        uint32_t bytes = 1 + iadr_size + (mread ? pdc.RCR : pdc.TCR);
+        if (mread && iadr_size) {
+            bytes++;
+        }
+        busy = true;
+        HostSim::scheduleIn(&transfer_event, (uint64_t)bytes * 9 * clock_divider);
+    }
+
+    void HostTwi::_completeTransfer() {
+        HostTwiSlave *slave = slaveAt(dadr);
+
+        // The internal address is sent MSB first, as a write
+        bool acked = (slave != nullptr) && slave->start(mread && (iadr_size == 0));
+        if (acked && iadr_size) {
+            for (int8_t i = iadr_size - 1; acked && (i >= 0); i--) {
+                acked = slave->write((iadr >> (i * 8)) & 0xFF);
+            }
+            if (acked && mread) {
+                acked = slave->start(true);
+            }
+        }
+
+        if (acked) {
+            if (mread) {
+                while (pdc.rxActive()) {
+                    const bool last = (pdc.RCR == 1) && (pdc.RNCR == 0);
+                    pdc.pushRx(slave->read(last));
+                }
+            } else {
+                uint8_t value;
+                while (acked && pdc.pullTx(value)) {
+                    acked = slave->write(value);
+                }
+            }
+        }
+
+        if (slave != nullptr) {
+            slave->stop();
+        }
+
+        if (!acked) {
+            nacked = true;
+        }
+        busy = false;
+        completed = true;
+
+        checkInterrupts();
+    }
+
+    template<> TWIHardware_<0>* TWIHardware_<0>::twiInterruptHandler_ = nullptr;
+}
+
+extern "C" void TWI0_Handler(void)  {
+    Motate::HostTWI0.interrupts++;
+    if (Motate::TWIHardware_<0>::twiInterruptHandler_) {
+        Motate::TWIHardware_<0>::twiInterruptHandler_->handleInterrupts();
+        return;
+    }
+#ifdef IN_DEBUGGER
+    __asm__("BKPT");
+#endif
+}
@@ -0,0 +1,607 @@
+/*
+ Host_sim/HostTWI.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HOSTTWI_H_ONCE
+#define HOSTTWI_H_ONCE
+
+#include "MotatePins.h"
+#include "HostCommon.h"
+#include "HostDMA.h"
+#include <type_traits>
+#include <cstring> // for memcpy and memset
+
+//NOTE: Currently only supporting master mode!!
+
+namespace Motate {
+
+#pragma mark HostTwiSlave
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostTwiSlave
+     *
+     * A device on the other end of the simulated TWI bus. Subclass it and attach
+     * it to the bus model (HostTWI0.attach()) to answer for an address.
+     *
+     * The bus calls these at the byte level, in the order the bytes would go
+     * over the wire: start() for each START (or repeated START) with the
+     * direction bit, write() for each byte the master sends (internal address
+     * bytes included), read() for each byte the master clocks in, and stop()
+     * for the STOP. Returning false from start() or write() is a NACK.
+     *
+     * For 10-bit addresses, address is the 0b011110xx form that goes on the
+     * wire, and the low eight bits of the address arrive as the first write().
+     *
+     **************************************************/
+
+    struct HostTwiSlave {
+        const uint8_t address;
+        HostTwiSlave *next = nullptr;
+
+        HostTwiSlave(const uint8_t _address) : address{_address} {};
+        virtual ~HostTwiSlave() {};
+
+        virtual bool start(const bool is_read) { return true; };
+        virtual bool write(const uint8_t value) { return true; };
+        virtual uint8_t read(const bool last) { return 0xFF; };
+        virtual void stop() {};
+    };
+
+#pragma mark HostTwiEeprom
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostTwiEeprom
+     *
+     * A 24C-series serial EEPROM (a 24C256 with the defaults). A write starts
+     * with the two-byte memory address, MSB first, and the bytes after that go
+     * into the page it's in, wrapping around at the end of the page. They're
+     * programmed at the STOP, which takes write_cycle_us, and until then the
+     * EEPROM NACKs its address (so the master has to poll for the ACK).
+     *
+     * Reads come from the address counter, which counts up across pages and
+     * wraps at the end of the memory. So a random read is a write of just the
+     * address, then a read, with or without a STOP between them.
+     *
+     **************************************************/
+
+    template <uint32_t memorySize = 32768, uint16_t pageSize = 64>
+    struct HostTwiEeprom : HostTwiSlave {
+        static_assert(((memorySize & (memorySize - 1)) == 0) && ((pageSize & (pageSize - 1)) == 0),
+                      "HostTwiEeprom: the memory and page sizes must be powers of two");
+
+        uint8_t memory[memorySize];
+        uint32_t write_cycle_us = 5000;
+        uint32_t writes = 0;        // page writes programmed
+
+        uint32_t address = 0;       // the address counter
+        uint8_t address_bytes = 0;  // of this write
+        bool staging = false;       // data was written, to be programmed at the STOP
+        uint8_t page[pageSize];
+        uint64_t busy_until = 0;
+
+        HostTwiEeprom(const uint8_t _address) : HostTwiSlave{_address} {
+            memset(memory, 0xFF, sizeof(memory));
+        };
+
+        bool start(const bool is_read) override {
+            if (HostSim::now() < busy_until) {
+                return false;
+            }
+            if (!is_read) {
+                address_bytes = 0;
+            }
+            return true;
+        };
+
+        bool write(const uint8_t value) override {
+            if (address_bytes < 2) {
+                address = ((address << 8) | value) & (memorySize - 1);
+                address_bytes++;
+                return true;
+            }
+            if (!staging) {
+                memcpy(page, memory + (address & ~(pageSize - 1)), pageSize);
+                staging = true;
+            }
+            page[address & (pageSize - 1)] = value;
+            address = (address & ~(pageSize - 1)) | ((address + 1) & (pageSize - 1));
+            return true;
+        };
+
+        uint8_t read(const bool last) override {
+            const uint8_t value = memory[address];
+            address = (address + 1) & (memorySize - 1);
+            return value;
+        };
+
+        void stop() override {
+            if (staging) {
+                staging = false;
+                memcpy(memory + (address & ~(pageSize - 1)), page, pageSize);
+                busy_until = HostSim::now() + HostSim::cyclesFromMicroseconds(write_cycle_us);
+                writes++;
+            }
+        };
+    };
+
+#pragma mark HostTwiRegisters
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostTwiRegisters
+     *
+     * A device with a bank of eight-bit registers, like most sensors and port
+     * expanders. The first byte of a write sets the register pointer, and the
+     * rest are written to the registers from there. Reads come from the
+     * pointer. The pointer counts up after each byte, wrapping at
+     * registerCount.
+     *
+     **************************************************/
+
+    template <uint16_t registerCount = 256>
+    struct HostTwiRegisters : HostTwiSlave {
+        uint8_t registers[registerCount] = {};
+        uint16_t pointer = 0;
+        bool pointer_set = false;   // in this write
+
+        HostTwiRegisters(const uint8_t _address) : HostTwiSlave{_address} {};
+
+        bool start(const bool is_read) override {
+            if (!is_read) {
+                pointer_set = false;
+            }
+            return true;
+        };
+
+        bool write(const uint8_t value) override {
+            if (!pointer_set) {
+                pointer = value % registerCount;
+                pointer_set = true;
+                return true;
+            }
+            registers[pointer] = value;
+            pointer = (pointer + 1) % registerCount;
+            return true;
+        };
+
+        uint8_t read(const bool last) override {
+            const uint8_t value = registers[pointer];
+            pointer = (pointer + 1) % registerCount;
+            return value;
+        };
+    };
+
+#pragma mark HostTwi
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostTwi
+     *
+     * A TWI (I2C) master with a PDC, like the Sam3x TWI. The whole message --
+     * address, internal address, a repeated START for reads with an internal
+     * address, the data, and the STOP -- is exchanged with the slave after the
+     * time it would take on the wire (nine clocks per byte), then TXCOMP (and
+     * NACK, if it was NACKed) is set.
+     *
+     **************************************************/
+
+    struct HostTwi {
+        // SR and IMR bits, same positions as on the Sam3x TWI
+        static constexpr uint32_t TXCOMP = 1u << 0;
+        static constexpr uint32_t RXRDY  = 1u << 1;
+        static constexpr uint32_t TXRDY  = 1u << 2;
+        static constexpr uint32_t NACK   = 1u << 8;
+        static constexpr uint32_t ENDRX  = 1u << 12;
+        static constexpr uint32_t ENDTX  = 1u << 13;
+        static constexpr uint32_t RXBUFF = 1u << 14;
+        static constexpr uint32_t TXBUFE = 1u << 15;
+
+        bool enabled = false;
+        uint32_t clock_divider = 1; // peripheral clocks per TWI clock
+
+        // MMR and IADR
+        uint8_t dadr = 0;
+        bool mread = false;
+        uint32_t iadr = 0;
+        uint8_t iadr_size = 0;
+
+        uint32_t IMR = 0;
+        bool busy = false;
+        bool nacked = false;       // sticky, cleared by reading the status
+        bool completed = true;     // TXCOMP
+        uint32_t interrupts = 0;   // TWI0_Handler calls, to see the interrupt load
+
+        HostPDC pdc;
+        const IRQn_Type irq;
+        HostSimEvent transfer_event;
+
+        HostTwiSlave *first_slave = nullptr;
+
+        HostTwi(const IRQn_Type _irq) : irq{_irq} {
+            transfer_event.action = [this]() { _completeTransfer(); };
+            pdc.on_change = [this]() { _startTransfer(); };
+        };
+
+        void attach(HostTwiSlave *slave) {
+            slave->next = first_slave;
+            first_slave = slave;
+        };
+        void detach(HostTwiSlave *slave) {
+            HostTwiSlave **link = &first_slave;
+            while (*link != nullptr) {
+                if (*link == slave) {
+                    *link = slave->next;
+                    slave->next = nullptr;
+                    return;
+                }
+                link = &(*link)->next;
+            }
+        };
+        HostTwiSlave *slaveAt(const uint8_t address) const {
+            for (HostTwiSlave *slave = first_slave; slave != nullptr; slave = slave->next) {
+                if (slave->address == address) { return slave; }
+            }
+            return nullptr;
+        };
+
+        uint32_t status() const {
+            uint32_t sr = 0;
+            if (completed) { sr |= TXCOMP; }
+            if (!busy) { sr |= TXRDY; }
+            if (nacked) { sr |= NACK; }
+            if (pdc.endRx()) { sr |= ENDRX; }
+            if (pdc.rxBufferFull()) { sr |= RXBUFF; }
+            if (pdc.endTx()) { sr |= ENDTX; }
+            if (pdc.txBufferEmpty()) { sr |= TXBUFE; }
+            return sr;
+        };
+
+        // Reading the status clears the sticky NACK, like the hardware
+        uint32_t readStatus() {
+            const uint32_t sr = status();
+            nacked = false;
+            return sr;
+        };
+
+        // Interrupt enables take effect immediately, like the level-sensitive hardware
+        void enableInterrupts(const uint32_t mask) {
+            IMR |= mask;
+            checkInterrupts();
+        };
+        void disableInterrupts(const uint32_t mask) { IMR &= ~mask; };
+        void checkInterrupts() {
+            if (status() & IMR) {
+                NVIC_SetPendingIRQ(irq);
+            }
+        };
+
+        void enable() {
+            enabled = true;
+            _startTransfer();
+        };
+        void disable() { enabled = false; };
+
+        void _startTransfer();
+        void _completeTransfer();
+    };
+
+    extern HostTwi HostTWI0;
+
+    // Empty class to use as a tag for template specialization
+    struct TWI_tag {};
+
+    template<uint8_t twiPeripheralNumber>
+    struct DMA_Host_hardware<TWI_tag, twiPeripheralNumber> {
+        static_assert(twiPeripheralNumber == 0, "Only TWI0 is simulated.");
+        static HostTwi * const twi() { return &HostTWI0; };
+        static HostPDC * const pdc() { return &HostTWI0.pdc; };
+
+        typedef uint8_t* buffer_t ;
+
+        void startRxDoneInterrupts(const bool include_next = false) const {
+            twi()->enableInterrupts(HostTwi::RXBUFF);
+        };
+        void stopRxDoneInterrupts(const bool include_next = false) const {
+            twi()->disableInterrupts(HostTwi::RXBUFF);
+        };
+        void startTxDoneInterrupts(const bool include_next = true) const {
+            twi()->enableInterrupts(HostTwi::TXBUFE);
+        };
+        void stopTxDoneInterrupts(const bool include_next = true) const {
+            twi()->disableInterrupts(HostTwi::TXBUFE);
+        };
+
+        bool inRxBufferFullInterrupt() const
+        {
+            return (twi()->IMR & HostTwi::RXBUFF) && (twi()->status() & HostTwi::RXBUFF);
+        }
+
+        bool inTxBufferEmptyInterrupt() const
+        {
+            return (twi()->IMR & HostTwi::TXBUFE) && (twi()->status() & HostTwi::TXBUFE);
+        }
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<TWI_tag, periph_num> : DMA_Host<TWI_tag, periph_num> {
+        // we take the handler, but we don't actually handle interrupts for the peripheral
+        // so we ignore it
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_Host<TWI_tag, periph_num>{} {};
+    };
+
+    template <int8_t twiPeripheralNumber>
+    struct TWIHardware_ {
+        static_assert(twiPeripheralNumber == 0,
+                "Only TWIHardware_<0> is valid on this processor.");
+
+        using this_type_t = TWIHardware_<twiPeripheralNumber>;
+
+        static HostTwi * const twi() { return &HostTWI0; };
+        static constexpr uint32_t peripheralId = ID_TWI0;
+        static constexpr IRQn_Type IRQ = TWI0_IRQn;
+        static constexpr auto twiPeripheralNum = twiPeripheralNumber;
+
+        TWIInterruptHandler* externalTWIInterruptHandler_ = nullptr;
+
+        Delegate<void(Interrupt::Type)> TWIDMAInterruptHandler_;
+        static this_type_t     *twiInterruptHandler_;
+
+        DMA<TWI_tag, twiPeripheralNumber> dma{TWIDMAInterruptHandler_};
+
+        TWIHardware_() {
+            twiInterruptHandler_ = this;
+            HostCommon::enablePeripheralClock(peripheralId);
+
+            // read the status register (Microchip says so)
+            twi()->readStatus();
+
+            this->disable();
+        }
+
+        void init() {
+            dma.reset();
+
+            this->setSpeed();  // use default fast I2C
+
+            this->enable();
+
+            // always have IRQs enabled for TWI, lowest priority
+            setInterrupts(TWIInterrupt::PriorityLow);
+        }
+
+        void enable() { twi()->enable(); }
+        void disable() { twi()->disable(); }
+
+        void setSpeed(const uint32_t speed = 400000) {
+            uint32_t divider = HostCommon::getPeripheralClockFreq() / speed;
+            twi()->clock_divider = (divider < 1) ? 1 : divider;
+        }
+
+        void handleInterrupts() {
+            auto interruptCause = getInterruptCause();
+            prehandleInterrupt(interruptCause);
+        }
+
+        bool setAddress(const TWIAddress& address, const TWIInternalAddress& internal_address) {
+            if (TWIDeviceAddressSize::k10Bit == address.size) {
+                if (internal_address.size > TWIInternalAddressSize::k2Bytes) {
+                    return false;  // we only support 3 total bytes of internal address
+                }
+                // top two bits (xx) of the 10-bit address ORd with special code 0b011110xx go into the device address
+                twi()->dadr      = 0b01111000 | ((address.address >> 8) & 0b11);
+                twi()->iadr      = (address.address & 0xFF) | ((internal_address.address & 0xFFFF) << 8);
+                twi()->iadr_size = (uint8_t)internal_address.size + 1;
+            } else {
+                // 7 bit address
+                twi()->dadr      = 0x7F & address.address;
+                twi()->iadr      = (internal_address.address & 0xFFFFFF);
+                twi()->iadr_size = (uint8_t)internal_address.size;
+            }
+
+            this->enable();
+            return true;
+        }
+
+        void setInterruptHandler(TWIInterruptHandler *handler) {
+            externalTWIInterruptHandler_ = handler;
+        }
+
+        TWIInterruptCause getInterruptCause() {
+            TWIInterruptCause status;
+
+            // Only consider the sources that are enabled in the mask, like the Sam version
+            auto TWI_SR_hold  = twi()->readStatus() & twi()->IMR;
+
+            if (TWI_SR_hold & HostTwi::TXRDY) {
+                status.setTxReady();
+            }
+            if (TWI_SR_hold & HostTwi::TXCOMP) {
+                status.setTxDone();
+            }
+            if (TWI_SR_hold & HostTwi::RXRDY) {
+                status.setRxReady();
+            }
+            if (TWI_SR_hold & HostTwi::NACK) {
+                status.setNACK();
+            }
+
+            return status;
+        }
+
+        void setInterrupts(const Interrupt::Type interrupts) {
+            if (interrupts != TWIInterrupt::Off) {
+                if (interrupts & TWIInterrupt::OnTxReady) {
+                    twi()->enableInterrupts(HostTwi::TXRDY);
+                } else {
+                    twi()->disableInterrupts(HostTwi::TXRDY);
+                }
+                if (interrupts & TWIInterrupt::OnTxDone) {
+                    twi()->enableInterrupts(HostTwi::TXCOMP);
+                } else {
+                    twi()->disableInterrupts(HostTwi::TXCOMP);
+                }
+
+                if (interrupts & TWIInterrupt::OnNACK) {
+                    twi()->enableInterrupts(HostTwi::NACK);
+                } else {
+                    twi()->disableInterrupts(HostTwi::NACK);
+                }
+
+                if (interrupts & TWIInterrupt::OnRxReady) {
+                    twi()->enableInterrupts(HostTwi::RXRDY);
+                } else {
+                    twi()->disableInterrupts(HostTwi::RXRDY);
+                }
+
+                if (interrupts & TWIInterrupt::OnRxTransferDone) {
+                    dma.startRxDoneInterrupts();
+                } else {
+                    dma.stopRxDoneInterrupts();
+                }
+                if (interrupts & TWIInterrupt::OnTxTransferDone) {
+                    dma.startTxDoneInterrupts();
+                } else {
+                    dma.stopTxDoneInterrupts();
+                }
+
+                /* Set interrupt priority */
+                if (interrupts & TWIInterrupt::PriorityHighest) {
+                    NVIC_SetPriority(IRQ, 0);
+                } else if (interrupts & TWIInterrupt::PriorityHigh) {
+                    NVIC_SetPriority(IRQ, 1);
+                } else if (interrupts & TWIInterrupt::PriorityMedium) {
+                    NVIC_SetPriority(IRQ, 2);
+                } else if (interrupts & TWIInterrupt::PriorityLow) {
+                    NVIC_SetPriority(IRQ, 3);
+                } else if (interrupts & TWIInterrupt::PriorityLowest) {
+                    NVIC_SetPriority(IRQ, 4);
+                }
+
+                // Always have IRQs enabled for TWI
+                NVIC_EnableIRQ(IRQ);
+            } else {
+                // Always have IRQs enabled for TWI
+                // NVIC_DisableIRQ(IRQ);
+            }
+        }
+
+        uint8_t getMessageSlotsAvailable() {
+            uint8_t count = 0;
+            if (dma.doneWriting() && dma.doneReading()) {
+                count++;
+            }
+            return count;
+        }
+
+        bool doneWriting() { return dma.doneWriting(); }
+        bool doneReading() { return dma.doneReading(); }
+
+        enum class InternalState {
+            Idle,
+            TXStarted,
+            RXStarted,
+        };
+
+        InternalState state_ = InternalState::Idle;
+
+        // start transfer of message
+        // The PDC does the whole message, so unlike the Sam version there's no
+        // byte-at-a-time state machine for the first and last characters.
+        bool startTransfer(uint8_t* buffer, const uint16_t size, const bool is_rx) {
+            if ((buffer == nullptr) || (state_ != InternalState::Idle) || (size == 0)) {
+#ifdef IN_DEBUGGER
+                __asm__("BKPT");
+#endif
+                return false;
+            }
+
+            const bool handle_interrupts = false;
+            const bool include_next      = false;
+
+            dma.setInterrupts(Interrupt::Off);
+            twi()->mread = is_rx;
+
+            // TXCOMP marks the end of the message (after the STOP), and NACK aborts it
+            state_ = is_rx ? InternalState::RXStarted : InternalState::TXStarted;
+            twi()->disableInterrupts(HostTwi::TXRDY | HostTwi::RXRDY);
+            twi()->completed = false;
+
+            bool dma_is_setup = is_rx ? dma.startRXTransfer(buffer, size, handle_interrupts, include_next)
+                                      : dma.startTXTransfer(buffer, size, handle_interrupts, include_next);
+            if (!dma_is_setup) {
+                state_ = InternalState::Idle;
+                twi()->completed = true;
+                return false;
+            }
+
+            twi()->enableInterrupts(HostTwi::TXCOMP | HostTwi::NACK);
+            return true;
+        }
+
+        bool prehandleInterrupt(TWIInterruptCause& cause) {
+            // Spurious interrupt
+            if (InternalState::Idle == state_) {
+                twi()->disableInterrupts(HostTwi::TXRDY | HostTwi::RXRDY | HostTwi::TXCOMP | HostTwi::NACK);
+                cause.clear();
+                return false;
+            }
+
+            if (!(cause.isTxDone() || cause.isNACK())) {
+                return false;
+            }
+
+            twi()->disableInterrupts(HostTwi::TXCOMP | HostTwi::NACK);
+            cause.clearTxDone();
+
+            if (cause.isNACK()) {
+                // Drop whatever was left of the transfer
+                dma.reset();
+            } else if (InternalState::RXStarted == state_) {
+                cause.setRxTransferDone();
+            } else {
+                cause.setTxTransferDone();
+            }
+            state_ = InternalState::Idle;
+
+            if (externalTWIInterruptHandler_) {
+                externalTWIInterruptHandler_->handleTWIInterrupt(cause);
+            } else {
+#ifdef IN_DEBUGGER
+                __asm__("BKPT");
+#endif
+            }
+
+            return true;
+        }
+    };
+
+    // TWIGetHardware is just a pass-through for now
+    template <pin_number twiSCKPinNumber, pin_number twiSDAPinNumber>
+    using TWIGetHardware = TWIHardware_<TWISCKPin<twiSCKPinNumber>::twiNum>;
+
+} // namespace Motate
+
+#endif /* end of include guard: HOSTTWI_H_ONCE */
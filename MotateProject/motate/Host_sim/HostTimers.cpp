@@ -0,0 +1,566 @@
+/*
+ Host_sim/HostTimers.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "HostTimers.h"
+#include "HostCommon.h"
+
+#include <limits>
+
+namespace Motate {
+
+#pragma mark HostTcChannel
+    HostTcChannel HostTC[9] MOTATE_HOST_MODEL {
+        {TC0_IRQn}, {TC1_IRQn}, {TC2_IRQn},
+        {TC3_IRQn}, {TC4_IRQn}, {TC5_IRQn},
+        {TC6_IRQn}, {TC7_IRQn}, {TC8_IRQn}
+    };
+
+    namespace {
+        struct _tcCompare {
+            uint64_t phase;
+            uint32_t flag;
+        };
+
+        // Find the first tick after `after` where one of the compares happens, and
+        // OR together the flags of all of the compares that happen on that tick.
+        uint64_t _nextCompare(const _tcCompare *compares, const uint8_t count, const uint64_t period,
+                              const uint64_t after, uint32_t &flags) {
+            const uint64_t base = after - (after % period);
+            uint64_t next = std::numeric_limits<uint64_t>::max();
+            flags = 0;
+            for (uint8_t i = 0; i < count; i++) {
+                uint64_t t = base + compares[i].phase;
+                if (t <= after) { t += period; }
+                if (t < next) {
+                    next = t;
+                    flags = compares[i].flag;
+                } else if (t == next) {
+                    flags |= compares[i].flag;
+                }
+            }
+            return next;
+        };
+
+        // Build the list of compares for one counter cycle of a TC channel
+        uint8_t _tcCompares(const HostTcChannel &c, _tcCompare *compares) {
+            const uint32_t top = c.top();
+            const uint64_t period = c.period();
+            const bool updown = c.isUpDown();
+            uint32_t watch = c.IMR | ((c.CMR & TC_CMR_CPCSTOP) ? TC_SR_CPCS : 0);
+            if (c.on_tioa_rise) {
+                watch |= ((c.CMR & TC_CMR_ACPA_Msk) ? TC_SR_CPAS : 0) | ((c.CMR & TC_CMR_ACPC_Msk) ? TC_SR_CPCS : 0);
+            }
+            uint8_t count = 0;
+
+            // Reaching TOP is an RC compare when RC is TOP, otherwise it's an overflow
+            const uint32_t top_flag = (c.CMR & TC_CMR_CPCTRG) ? TC_SR_CPCS : TC_SR_COVFS;
+            if (watch & top_flag) {
+                compares[count++] = {updown ? top : period, top_flag};
+            }
+            if ((watch & TC_SR_CPCS) && !(c.CMR & TC_CMR_CPCTRG) && (c.RC > 0) && (c.RC < top)) {
+                compares[count++] = {c.RC, TC_SR_CPCS};
+                if (updown) { compares[count++] = {period - c.RC, TC_SR_CPCS}; }
+            }
+            if ((watch & TC_SR_CPAS) && (c.RA > 0) && (c.RA < top)) {
+                compares[count++] = {c.RA, TC_SR_CPAS};
+                if (updown) { compares[count++] = {period - c.RA, TC_SR_CPAS}; }
+            }
+            if ((watch & TC_SR_CPBS) && (c.RB > 0) && (c.RB < top)) {
+                compares[count++] = {c.RB, TC_SR_CPBS};
+                if (updown) { compares[count++] = {period - c.RB, TC_SR_CPBS}; }
+            }
+            return count;
+        };
+
+        // Apply the TIOA action of a compare (RC has priority over RA), returning true on a rising edge
+        bool _tcTioaAction(HostTcChannel &c, const uint32_t flags) {
+            uint32_t action = 0;
+            if (flags & TC_SR_CPCS) {
+                action = (c.CMR & TC_CMR_ACPC_Msk) >> 18;
+            }
+            if ((action == 0) && (flags & TC_SR_CPAS)) {
+                action = (c.CMR & TC_CMR_ACPA_Msk) >> 16;
+            }
+
+            const bool was = c.tioa;
+            switch (action) {
+                case 1: c.tioa = true; break;
+                case 2: c.tioa = false; break;
+                case 3: c.tioa = !c.tioa; break;
+                default: break;
+            }
+            return c.tioa && !was;
+        };
+    }
+
+    uint32_t HostTcChannel::getCV() const {
+        if (!clock_enabled) {
+            return stopped_cv;
+        }
+        const uint64_t phase = ticks() % period();
+        if (isUpDown() && (phase > top())) {
+            return period() - phase;
+        }
+        return phase;
+    }
+
+    void HostTcChannel::start() {
+        clock_enabled = true;
+        start_cycle = HostSim::now();
+        last_tick = 0;
+        ra_loaded = false;
+        update();
+    }
+
+    void HostTcChannel::stop() {
+        if (clock_enabled) {
+            stopped_cv = getCV();
+            clock_enabled = false;
+        }
+        HostSim::cancel(&event);
+    }
+
+    void HostTcChannel::update() {
+        HostSim::cancel(&event);
+        if (!clock_enabled) {
+            return;
+        }
+
+        _tcCompare compares[7];
+        const uint8_t count = _tcCompares(*this, compares);
+        if (count == 0) {
+            return;
+        }
+
+        // Don't fire compares that were passed before this change, but do fire one that's due right now
+        const uint64_t now_tick = ticks();
+        if ((now_tick > 0) && (last_tick < now_tick - 1)) {
+            last_tick = now_tick - 1;
+        }
+
+        uint32_t flags;
+        next_tick = _nextCompare(compares, count, period(), last_tick, flags);
+        HostSim::schedule(&event, start_cycle + (next_tick * divisor()));
+    }
+
+    void HostTcChannel::fire() {
+        _tcCompare compares[7];
+        const uint8_t count = _tcCompares(*this, compares);
+        uint32_t flags = 0;
+        if (count > 0) {
+            _nextCompare(compares, count, period(), next_tick - 1, flags);
+        }
+        last_tick = next_tick;
+        SR |= flags;
+
+        const bool tioa_rose = on_tioa_rise && _tcTioaAction(*this, flags);
+
+        if ((flags & TC_SR_CPCS) && (CMR & TC_CMR_CPCSTOP)) {
+            stop();
+        } else {
+            update();
+        }
+
+        if (tioa_rose) {
+            on_tioa_rise();
+        }
+
+        if (SR & IMR) {
+            NVIC_SetPendingIRQ(irq);
+        }
+    }
+
+    void HostTcChannel::tioaInput(const bool level) {
+        if (level == tioa) {
+            return;
+        }
+        tioa = level;
+        if ((CMR & TC_CMR_WAVE) || !clock_enabled) {
+            return;
+        }
+
+        // RA loads first, then RB, then RA again -- each on its own selected edge.
+        // Loading one that hasn't been read (its flag still set) is an overrun.
+        const uint32_t edge = level ? 1 : 2;
+        if (!ra_loaded) {
+            if (((CMR & TC_CMR_LDRA_Msk) >> 16) & edge) {
+                if (SR & TC_SR_LDRAS) { SR |= TC_SR_LOVRS; }
+                RA = getCV();
+                SR |= TC_SR_LDRAS;
+                ra_loaded = (CMR & TC_CMR_LDRB_Msk) != 0;
+            }
+        } else if (((CMR & TC_CMR_LDRB_Msk) >> 18) & edge) {
+            if (SR & TC_SR_LDRBS) { SR |= TC_SR_LOVRS; }
+            RB = getCV();
+            SR |= TC_SR_LDRBS;
+            ra_loaded = false;
+        }
+
+        if (SR & IMR) {
+            NVIC_SetPendingIRQ(irq);
+        }
+    }
+
+#pragma mark HostPwm
+    HostPwm HostPWM MOTATE_HOST_MODEL;
+
+    namespace {
+        void _applyPwmPeriod(HostPwmChannel &c) {
+            if (c.cprd_update_pending) {
+                c.CPRD = c.CPRDUPD;
+                c.cprd_update_pending = false;
+            }
+        };
+        void _applyPwmDuty(HostPwmChannel &c) {
+            if (c.cdty_update_pending) {
+                c.CDTY = c.CDTYUPD;
+                c.cdty_update_pending = false;
+            }
+        };
+    }
+
+    void HostPwm::enable(uint32_t mask) {
+        // Enabling channel 0 enables all of the synchronous channels
+        if (mask & 1) {
+            mask |= syncChannels();
+        }
+        mask &= ~SR;
+        for (uint8_t i = 0; i < 8; i++) {
+            if (mask & (1u << i)) {
+                SR |= (1u << i);
+                ch[i].start_cycle = HostSim::now();
+                ch[i].last_tick = 0;
+                update(i);
+            }
+        }
+    }
+
+    void HostPwm::disable(uint32_t mask) {
+        if (mask & 1) {
+            mask |= syncChannels();
+        }
+        mask &= SR;
+        for (uint8_t i = 0; i < 8; i++) {
+            if (mask & (1u << i)) {
+                ch[i].stopped_ccnt = getCCNT(i);
+                SR &= ~(1u << i);
+                HostSim::cancel(&ch[i].event);
+            }
+        }
+    }
+
+    // While the channel is running the new values wait in the UPD registers for the end of the period
+    void HostPwm::setPeriod(const uint8_t channel, const uint32_t value) {
+        HostPwmChannel &c = ch[channel];
+        if (SR & (1u << channel)) {
+            c.CPRDUPD = value;
+            c.cprd_update_pending = true;
+            update(isSyncSlave(channel) ? 0 : channel);
+        } else {
+            c.CPRD = value;
+        }
+    }
+
+    void HostPwm::setDuty(const uint8_t channel, const uint32_t value) {
+        HostPwmChannel &c = ch[channel];
+        if (SR & (1u << channel)) {
+            c.CDTYUPD = value;
+            c.cdty_update_pending = true;
+            update(isSyncSlave(channel) ? 0 : channel);
+        } else {
+            c.CDTY = value;
+        }
+    }
+
+    uint32_t HostPwm::getCCNT(const uint8_t channel) const {
+        const HostPwmChannel &c = ch[channel];
+        if (!(SR & (1u << channel))) {
+            return c.stopped_ccnt;
+        }
+        const uint64_t phase = ((HostSim::now() - c.start_cycle) / c.divisor()) % c.period();
+        if ((c.CMR & PWM_CMR_CALG) && (phase > c.top())) {
+            return c.period() - phase;
+        }
+        return phase;
+    }
+
+    void HostPwm::update(const uint8_t channel) {
+        HostPwmChannel &c = ch[channel];
+        HostSim::cancel(&c.event);
+        if (!(SR & (1u << channel))) {
+            return;
+        }
+
+        bool watch_period = (IMR1 & (1u << channel));
+        if (!isSyncSlave(channel)) {
+            watch_period |= c.cprd_update_pending || c.cdty_update_pending;
+        }
+        if ((channel == 0) && syncChannels()) {
+            watch_period = true;
+        }
+
+        const uint64_t period = c.period();
+        _tcCompare compares[3];
+        uint8_t count = 0;
+        if (watch_period) {
+            compares[count++] = {period, 1};
+        }
+        if ((IMR2 & (PWM_IER2_CMPM0 << channel)) && (c.CDTY > 0) && (c.CDTY < c.top())) {
+            compares[count++] = {c.CDTY, 2};
+            if (c.CMR & PWM_CMR_CALG) { compares[count++] = {period - c.CDTY, 2}; }
+        }
+        if (count == 0) {
+            return;
+        }
+
+        const uint64_t now_tick = (HostSim::now() - c.start_cycle) / c.divisor();
+        if ((now_tick > 0) && (c.last_tick < now_tick - 1)) {
+            c.last_tick = now_tick - 1;
+        }
+
+        uint32_t flags;
+        c.next_tick = _nextCompare(compares, count, period, c.last_tick, flags);
+        HostSim::schedule(&c.event, c.start_cycle + (c.next_tick * c.divisor()));
+    }
+
+    void HostPwm::fire(const uint8_t channel) {
+        HostPwmChannel &c = ch[channel];
+        const uint64_t period = c.period();
+        const uint64_t tick = c.next_tick;
+
+        if ((IMR2 & (PWM_IER2_CMPM0 << channel)) && (c.CDTY > 0) && (c.CDTY < c.top())) {
+            const uint64_t phase = tick % period;
+            if ((phase == c.CDTY) || ((c.CMR & PWM_CMR_CALG) && (phase == period - c.CDTY))) {
+                ISR2 |= (PWM_IER2_CMPM0 << channel);
+            }
+        }
+
+        c.last_tick = tick;
+        if ((tick % period) == 0) {
+            ISR1 |= (1u << channel);
+
+            // Start the next period from zero, so a new period takes effect cleanly
+            c.start_cycle += tick * c.divisor();
+            c.last_tick = 0;
+
+            // The synchronous channels (channel 0 too, once it's one of them) update together, below
+            if (!(syncChannels() & (1u << channel))) {
+                _applyPwmPeriod(c);
+                _applyPwmDuty(c);
+            }
+
+            if ((channel == 0) && syncChannels()) {
+                const uint32_t mode = SCM & PWM_SCM_UPDM_Msk;
+                const bool unlocked = (SCUC & PWM_SCUC_UPDULOCK);
+
+                // Duty cycles update on request (UPDULOCK) in mode 0, and every UPR+1 periods
+                // in modes 1 and 2. Periods only ever update on request.
+                bool update_duty = unlocked && (mode == PWM_SCM_UPDM_MODE0);
+                if ((mode != PWM_SCM_UPDM_MODE0) && (++sync_periods > PWM_SCUPUPD_UPRUPD(SCUPUPD))) {
+                    sync_periods = 0;
+                    update_duty = true;
+
+                    if (mode == PWM_SCM_UPDM_MODE2) {
+                        // The PDC writes one duty cycle per synchronous channel, in channel order.
+                        // ENDTX latches when a buffer runs out, even if the next one takes over.
+                        for (uint8_t i = 0; i < 8; i++) {
+                            uint16_t duty;
+                            const bool last = (pdc.TCR == 1);
+                            if ((syncChannels() & (1u << i)) && pdc.pullTx(duty)) {
+                                ch[i].CDTY = duty;
+                                if (last) {
+                                    ISR2 |= PWM_ISR2_ENDTX;
+                                }
+                            }
+                        }
+                        if (pdc.txBufferEmpty()) {
+                            ISR2 |= PWM_ISR2_TXBUFE;
+                        }
+                    }
+                }
+
+                for (uint8_t i = 0; i < 8; i++) {
+                    if (syncChannels() & (1u << i)) {
+                        if (update_duty) { _applyPwmDuty(ch[i]); }
+                        if (unlocked) { _applyPwmPeriod(ch[i]); }
+                    }
+                }
+                if (unlocked) {
+                    SCUC &= ~PWM_SCUC_UPDULOCK;
+                }
+
+                // The synchronous channels stay in phase with channel 0
+                for (uint8_t i = 1; i < 8; i++) {
+                    if ((syncChannels() & SR & (1u << i))) {
+                        ch[i].start_cycle = c.start_cycle;
+                        ch[i].last_tick = 0;
+                        update(i);
+                    }
+                }
+            }
+        }
+
+        update(channel);
+
+        if ((ISR1 & IMR1) || (ISR2 & IMR2)) {
+            NVIC_SetPendingIRQ(PWM_IRQn);
+        }
+    }
+
+    void HostPwm::pdcChanged() {
+        ISR2 &= ~(PWM_ISR2_ENDTX | PWM_ISR2_TXBUFE);
+        if (pdc.endTx()) {
+            ISR2 |= PWM_ISR2_ENDTX;
+        }
+        if (pdc.txBufferEmpty()) {
+            ISR2 |= PWM_ISR2_TXBUFE;
+        }
+        if (ISR2 & IMR2) {
+            NVIC_SetPendingIRQ(PWM_IRQn);
+        }
+    }
+
+#pragma mark SysTickTimer, WatchDogTimer
+	/* System-wide tick counter */
+
+    // _tickEvent has to be constructed before SysTickTimer, which schedules it
+	HostSimEvent Timer<SysTickTimerNum>::_tickEvent MOTATE_HOST_MODEL;
+
+	Timer<SysTickTimerNum> SysTickTimer;
+	Timer<WatchDogTimerNum> WatchDogTimer;
+
+	volatile uint32_t Timer<SysTickTimerNum>::_motateTickCount = 0;
+	volatile uint32_t Timer<SysTickTimerNum>::_motateTickCountHigh = 0;
+
+} // namespace Motate
+
+extern "C" void SysTick_Handler(void)
+{
+	Motate::SysTickTimer._increment();
+
+	if (Motate::SysTickTimer.interrupt) {
+		Motate::SysTickTimer.interrupt();
+	}
+
+    Motate::SysTickTimer._handleEvents();
+}
+
+#define _MAKE_TCx_Handler(x) \
+    namespace Motate { \
+        template<> void TimerChannel<x, 0>::interrupt() __attribute__ ((weak)); \
+        template<> void TimerChannel<x, 1>::interrupt() __attribute__ ((weak)); \
+        template<> void Timer<x>::interrupt() __attribute__ ((weak)); \
+        template<> volatile uint32_t Timer<x>::_interrupt_cause_cached = 0; \
+        template<> _InputCaptureHardware<x> *_InputCaptureHardware<x>::_active = nullptr; \
+    } \
+    extern "C" \
+    void TC##x##_Handler(void) { /* delegate to the TimerChannels */ \
+        Motate::Timer<x>::_interrupt_cause_cached = Motate::Timer<x>::tcChan()->readSR();\
+        Motate::HostCommon::sync();\
+        int16_t ch_ = 0; \
+        Motate::Timer<x>::getInterruptCause(ch_); \
+        if (  Motate::TimerChannel<x, 0>::interrupt && \
+              (ch_  == 0 || ch_  == -1) \
+            ) { \
+            Motate::TimerChannel<x, 0>::interrupt(); \
+        } \
+        if (  Motate::TimerChannel<x, 1>::interrupt && \
+              (ch_  == 1 || ch_  == -1) \
+            ) { \
+            Motate::TimerChannel<x, 1>::interrupt(); \
+        } \
+        if (Motate::Timer<x>::interrupt) { \
+            Motate::Timer<x>::interrupt(); \
+        } \
+        Motate::_InputCaptureHardware<x>::_interrupt(Motate::Timer<x>::_interrupt_cause_cached); \
+    }
+
+    _MAKE_TCx_Handler(0)
+    _MAKE_TCx_Handler(1)
+    _MAKE_TCx_Handler(2)
+    _MAKE_TCx_Handler(3)
+    _MAKE_TCx_Handler(4)
+    _MAKE_TCx_Handler(5)
+    _MAKE_TCx_Handler(6)
+    _MAKE_TCx_Handler(7)
+    _MAKE_TCx_Handler(8)
+
+#undef _MAKE_TCx_Handler
+
+namespace Motate {
+    uint32_t pwm_interrupt_cause_cached_1_ = 0;
+    uint32_t pwm_interrupt_cause_cached_2_ = 0;
+
+    template<> void PWMTimer<0,0>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,1>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,2>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,3>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,4>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,5>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,6>::interrupt() __attribute__ ((weak));
+    template<> void PWMTimer<0,7>::interrupt() __attribute__ ((weak));
+
+    template<> _PWMWaveformHardware<0> *_PWMWaveformHardware<0>::_active = nullptr;
+}
+
+void PWM_Handler(void) {
+    const uint32_t isr2 = Motate::HostPWM.readISR2(); // read it once, since reading it clears the compare flags
+    Motate::pwm_interrupt_cause_cached_1_ = Motate::HostPWM.readISR1() & 0x00ff;
+    Motate::pwm_interrupt_cause_cached_2_ = isr2 & 0xff00;
+
+    uint32_t pwm_interrupt_cause_ = Motate::pwm_interrupt_cause_cached_1_ | (Motate::pwm_interrupt_cause_cached_2_>>8);
+    Motate::HostCommon::sync();
+
+    if (Motate::PWMTimer<0,0>::interrupt && (pwm_interrupt_cause_ & (1<<  0))) {
+        Motate::PWMTimer<0,0>::interrupt();
+    };
+    if (Motate::PWMTimer<0,1>::interrupt && (pwm_interrupt_cause_ & (1<<  1))) {
+        Motate::PWMTimer<0,1>::interrupt();
+    };
+    if (Motate::PWMTimer<0,2>::interrupt && (pwm_interrupt_cause_ & (1<<  2))) {
+        Motate::PWMTimer<0,2>::interrupt();
+    };
+    if (Motate::PWMTimer<0,3>::interrupt && (pwm_interrupt_cause_ & (1<<  3))) {
+        Motate::PWMTimer<0,3>::interrupt();
+    };
+    if (Motate::PWMTimer<0,4>::interrupt && (pwm_interrupt_cause_ & (1<<  4))) {
+        Motate::PWMTimer<0,4>::interrupt();
+    };
+    if (Motate::PWMTimer<0,5>::interrupt && (pwm_interrupt_cause_ & (1<<  5))) {
+        Motate::PWMTimer<0,5>::interrupt();
+    };
+    if (Motate::PWMTimer<0,6>::interrupt && (pwm_interrupt_cause_ & (1<<  6))) {
+        Motate::PWMTimer<0,6>::interrupt();
+    };
+    if (Motate::PWMTimer<0,7>::interrupt && (pwm_interrupt_cause_ & (1<<  7))) {
+        Motate::PWMTimer<0,7>::interrupt();
+    };
+    Motate::_PWMWaveformHardware<0>::_interrupt(isr2);
+}
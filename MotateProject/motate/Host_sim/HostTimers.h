@@ -0,0 +1,1628 @@
+/*
+ Host_sim/HostTimers.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HOSTTIMERS_H_ONCE
+#define HOSTTIMERS_H_ONCE
+
+#include "HostCommon.h"
+#include "HostDMA.h"
+
+#include "MotateDelegate.h"
+#include "MotateTimingWheel.h"
+#include <type_traits> // for std::extent and std::alignment_of
+
+/* The host simulation mirrors the Sam3x timers (see SamTimers.h):
+ *
+ * Timers:
+ *
+ * Nine Timers (three TC modules of three channels), each with two Motate
+ * channels (A and B), modeled at the register level in HostTcChannel.
+ *
+ * PWMTimers:
+ *
+ * One PWM module with eight channels, modeled in HostPwm, including the
+ * double-buffered update registers, synchronous channels and the PDC that
+ * feeds the synchronous channels' duty cycles.
+ *
+ * The counters aren't "run" cycle by cycle -- the counter value is computed
+ * from the simulated clock when read, and an event is only scheduled on the
+ * simulated timeline for the next compare or overflow that has an interrupt
+ * enabled (or a pending register update).
+ */
+
+
+namespace Motate {
+#pragma mark Register bits
+    /**************************************************
+     *
+     * Register bits (same positions as on the Sam parts)
+     *
+     **************************************************/
+
+    static constexpr uint32_t TC_CMR_TCCLKS_Msk          = 0x7u << 0;
+    static constexpr uint32_t TC_CMR_TCCLKS_TIMER_CLOCK1 = 0x0u << 0; // MCK/2
+    static constexpr uint32_t TC_CMR_TCCLKS_TIMER_CLOCK2 = 0x1u << 0; // MCK/8
+    static constexpr uint32_t TC_CMR_TCCLKS_TIMER_CLOCK3 = 0x2u << 0; // MCK/32
+    static constexpr uint32_t TC_CMR_TCCLKS_TIMER_CLOCK4 = 0x3u << 0; // MCK/128
+    static constexpr uint32_t TC_CMR_CPCSTOP             = 0x1u << 6;
+    static constexpr uint32_t TC_CMR_EEVT_XC0            = 0x1u << 10;
+    static constexpr uint32_t TC_CMR_CPCTRG              = 0x1u << 14;
+    static constexpr uint32_t TC_CMR_WAVSEL_Msk          = 0x3u << 13;
+    static constexpr uint32_t TC_CMR_WAVSEL_UP           = 0x0u << 13;
+    static constexpr uint32_t TC_CMR_WAVSEL_UPDOWN       = 0x1u << 13;
+    static constexpr uint32_t TC_CMR_WAVSEL_UP_RC        = 0x2u << 13;
+    static constexpr uint32_t TC_CMR_WAVSEL_UPDOWN_RC    = 0x3u << 13;
+    static constexpr uint32_t TC_CMR_WAVE                = 0x1u << 15;
+    static constexpr uint32_t TC_CMR_ACPA_Msk            = 0x3u << 16;
+    static constexpr uint32_t TC_CMR_ACPA_SET            = 0x1u << 16;
+    static constexpr uint32_t TC_CMR_ACPA_CLEAR          = 0x2u << 16;
+    static constexpr uint32_t TC_CMR_ACPA_TOGGLE         = 0x3u << 16;
+    static constexpr uint32_t TC_CMR_ACPC_Msk            = 0x3u << 18;
+    static constexpr uint32_t TC_CMR_ACPC_SET            = 0x1u << 18;
+    static constexpr uint32_t TC_CMR_ACPC_CLEAR          = 0x2u << 18;
+    static constexpr uint32_t TC_CMR_ACPC_TOGGLE         = 0x3u << 18;
+    static constexpr uint32_t TC_CMR_LDRA_Msk            = 0x3u << 16; // capture mode (WAVE = 0)
+    static constexpr uint32_t TC_CMR_LDRA_RISING         = 0x1u << 16;
+    static constexpr uint32_t TC_CMR_LDRA_FALLING        = 0x2u << 16;
+    static constexpr uint32_t TC_CMR_LDRA_EDGE           = 0x3u << 16;
+    static constexpr uint32_t TC_CMR_LDRB_Msk            = 0x3u << 18;
+    static constexpr uint32_t TC_CMR_LDRB_RISING         = 0x1u << 18;
+    static constexpr uint32_t TC_CMR_LDRB_FALLING        = 0x2u << 18;
+    static constexpr uint32_t TC_CMR_LDRB_EDGE           = 0x3u << 18;
+    static constexpr uint32_t TC_CMR_BCPB_Msk            = 0x3u << 24;
+    static constexpr uint32_t TC_CMR_BCPB_SET            = 0x1u << 24;
+    static constexpr uint32_t TC_CMR_BCPB_CLEAR          = 0x2u << 24;
+    static constexpr uint32_t TC_CMR_BCPB_TOGGLE         = 0x3u << 24;
+    static constexpr uint32_t TC_CMR_BCPC_Msk            = 0x3u << 26;
+    static constexpr uint32_t TC_CMR_BCPC_SET            = 0x1u << 26;
+    static constexpr uint32_t TC_CMR_BCPC_CLEAR          = 0x2u << 26;
+    static constexpr uint32_t TC_CMR_BCPC_TOGGLE         = 0x3u << 26;
+
+    static constexpr uint32_t TC_SR_COVFS                = 0x1u << 0;
+    static constexpr uint32_t TC_SR_LOVRS                = 0x1u << 1;
+    static constexpr uint32_t TC_SR_CPAS                 = 0x1u << 2;
+    static constexpr uint32_t TC_SR_CPBS                 = 0x1u << 3;
+    static constexpr uint32_t TC_SR_CPCS                 = 0x1u << 4;
+    static constexpr uint32_t TC_SR_LDRAS                = 0x1u << 5;
+    static constexpr uint32_t TC_SR_LDRBS                = 0x1u << 6;
+    static constexpr uint32_t TC_SR_ETRGS                = 0x1u << 7;
+    static constexpr uint32_t TC_SR_CLKSTA               = 0x1u << 16;
+    static constexpr uint32_t TC_SR_MTIOA                = 0x1u << 17;
+
+    static constexpr uint32_t PWM_CMR_CPRE_Msk           = 0xFu << 0;
+    static constexpr uint32_t PWM_CMR_CALG               = 0x1u << 8;
+    static constexpr uint32_t PWM_CMR_CPOL               = 0x1u << 9;
+    static constexpr uint32_t PWM_SCM_SYNC0              = 0x1u << 0;
+    static constexpr uint32_t PWM_SCM_UPDM_Msk           = 0x3u << 16;
+    static constexpr uint32_t PWM_SCM_UPDM_MODE0         = 0x0u << 16;
+    static constexpr uint32_t PWM_SCM_UPDM_MODE1         = 0x1u << 16;
+    static constexpr uint32_t PWM_SCM_UPDM_MODE2         = 0x2u << 16;
+    static constexpr uint32_t PWM_SCM_PTRM               = 0x1u << 20;
+    static constexpr uint32_t PWM_SCM_PTRCS_Msk          = 0x7u << 21;
+    static constexpr uint32_t PWM_SCUC_UPDULOCK          = 0x1u << 0;
+    static constexpr uint32_t PWM_ISR2_WRDY              = 0x1u << 0;
+    static constexpr uint32_t PWM_ISR2_ENDTX             = 0x1u << 1;
+    static constexpr uint32_t PWM_ISR2_TXBUFE            = 0x1u << 2;
+    static constexpr uint32_t PWM_IER2_ENDTX             = 0x1u << 1;
+    static constexpr uint32_t PWM_IER2_TXBUFE            = 0x1u << 2;
+    static constexpr uint32_t PWM_IER2_CMPM0             = 0x1u << 8;
+    static constexpr uint32_t PWM_IDR2_ENDTX             = 0x1u << 1;
+    static constexpr uint32_t PWM_IDR2_TXBUFE            = 0x1u << 2;
+    static constexpr uint32_t PWM_IDR2_CMPM0             = 0x1u << 8;
+
+    static constexpr uint32_t PWM_SCUPUPD_UPRUPD(const uint32_t value) { return value & 0xF; };
+
+#pragma mark HostTcChannel
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostTcChannel
+     *
+     * One channel of a TC. Since every Motate::Timer is one TC channel, this is
+     * the whole model for one Timer<n>.
+     *
+     * The counter is 16 bits wide, matching the 0xFFFF TOP that Timer<> assumes.
+     *
+     * TIOA is modeled as an internal trigger (like the ADC's TIOA trigger
+     * input): while on_tioa_rise is set, the RA and RC compare actions in CMR
+     * drive tioa, and on_tioa_rise is called on each rising edge.
+     *
+     * In capture mode (WAVE = 0) TIOA is an input instead: tioaInput() drives
+     * it, and the edges selected by LDRA and LDRB load RA and RB.
+     *
+     **************************************************/
+
+    struct HostTcChannel {
+        uint32_t CMR = 0;
+        uint32_t RA = 0;
+        uint32_t RB = 0;
+        uint32_t RC = 0;
+        uint32_t SR = 0;            // status, cleared by readSR()
+        uint32_t IMR = 0;           // interrupts enabled
+
+        bool clock_enabled = false;
+        uint64_t start_cycle = 0;   // when the counter was last reset to zero
+        uint32_t stopped_cv = 0;    // the counter value, while the clock is stopped
+        uint64_t last_tick = 0;     // counter ticks (since start_cycle) that compares have been checked through
+        uint64_t next_tick = 0;     // the tick the event is scheduled for
+
+        bool tioa = false;
+        bool ra_loaded = false;     // capture mode: RB is loaded next
+        std::function<void(void)> on_tioa_rise;
+
+        const IRQn_Type irq;
+        HostSimEvent event;
+
+        HostTcChannel(const IRQn_Type _irq) : irq{_irq}, event{[this]() { fire(); }} {};
+
+        uint32_t divisor() const {
+            switch (CMR & TC_CMR_TCCLKS_Msk) {
+                case TC_CMR_TCCLKS_TIMER_CLOCK1: return 2;
+                case TC_CMR_TCCLKS_TIMER_CLOCK2: return 8;
+                case TC_CMR_TCCLKS_TIMER_CLOCK3: return 32;
+                default:                         return 128;
+            }
+        };
+        bool isUpDown() const {
+            return (CMR & TC_CMR_WAVE) && (CMR & TC_CMR_WAVSEL_UPDOWN);
+        };
+        // See Timer<>::getTopValue() -- the RC trigger bit is in the same place for both modes
+        uint32_t top() const {
+            const uint32_t t = (CMR & TC_CMR_CPCTRG) ? RC : 0xFFFF;
+            return (t > 0) ? t : 1;
+        };
+        // The length of one full counter cycle, in ticks. Without an RC trigger
+        // the counter counts all the way through 0xFFFF, then overflows.
+        uint64_t period() const {
+            if (isUpDown()) {
+                return 2 * (uint64_t)top();
+            }
+            return (CMR & TC_CMR_CPCTRG) ? top() : 0x10000;
+        };
+        uint64_t ticks() const {
+            return (HostSim::now() - start_cycle) / divisor();
+        };
+
+        uint32_t getCV() const;
+
+        // TC_CCR
+        void start();   // CLKEN | SWTRG
+        void stop();    // CLKDIS
+
+        // Must be called after changing CMR, RA, RB, RC, IMR, or on_tioa_rise
+        void update();
+        void fire();
+
+        // Drive TIOA from outside, as the capture input
+        void tioaInput(const bool level);
+
+        // Read-and-clear, like reading TC_SR
+        uint32_t readSR() {
+            uint32_t sr = SR | (clock_enabled ? TC_SR_CLKSTA : 0) | (tioa ? TC_SR_MTIOA : 0);
+            SR = 0;
+            return sr;
+        };
+    };
+
+    extern HostTcChannel HostTC[9];
+
+#pragma mark HostPwm
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostPwm
+     *
+     * The PWM module: eight channels with double-buffered (UPD) period and duty
+     * registers, and synchronous channels. The synchronous channels' duty cycles
+     * update together, when software asks (UPDULOCK, update mode 0) or every
+     * UPR+1 periods of channel 0 (modes 1 and 2). In mode 2 a PDC writes them.
+     *
+     **************************************************/
+
+    struct HostPwmChannel {
+        uint32_t CMR = 0;
+        uint32_t CPRD = 0;
+        uint32_t CPRDUPD = 0;
+        uint32_t CDTY = 0;
+        uint32_t CDTYUPD = 0;
+
+        bool cprd_update_pending = false;
+        bool cdty_update_pending = false;
+
+        uint64_t start_cycle = 0;
+        uint32_t stopped_ccnt = 0;
+        uint64_t last_tick = 0;
+        uint64_t next_tick = 0;
+
+        HostSimEvent event;
+
+        uint32_t divisor() const {
+            return 1u << (CMR & PWM_CMR_CPRE_Msk);
+        };
+        uint32_t top() const {
+            return (CPRD > 0) ? CPRD : 1;
+        };
+        uint64_t period() const {
+            return (CMR & PWM_CMR_CALG) ? (2 * (uint64_t)top()) : top();
+        };
+    };
+
+    struct HostPwm {
+        uint32_t SR = 0;     // channels enabled
+        uint32_t IMR1 = 0;   // counter event (end of period) interrupts enabled, per channel
+        uint32_t ISR1 = 0;
+        uint32_t IMR2 = 0;   // compare (duty cycle) interrupts enabled, PWM_IER2_CMPM0 << channel
+        uint32_t ISR2 = 0;
+        uint32_t SCM = 0;    // synchronous channels and update mode
+        uint32_t SCUC = 0;   // UPDULOCK
+        uint32_t SCUPUPD = 0;
+        uint32_t sync_periods = 0; // channel 0 periods since the last synchronous update
+
+        HostPwmChannel ch[8];
+        HostPDC pdc;         // feeds the synchronous channels' duty cycles
+
+        HostPwm() {
+            for (uint8_t i = 0; i < 8; i++) {
+                ch[i].event.action = [this, i]() { fire(i); };
+            }
+            pdc.on_change = [this]() { pdcChanged(); };
+            pdcChanged();
+        };
+
+        uint32_t syncChannels() const { return SCM & 0xFF; };
+        // Synchronous channels other than 0 take their updates from channel 0
+        bool isSyncSlave(const uint8_t channel) const {
+            return (channel != 0) && (syncChannels() & (1u << channel));
+        };
+
+        // PWM_ENA / PWM_DIS
+        void enable(uint32_t mask);
+        void disable(uint32_t mask);
+
+        void setPeriod(const uint8_t channel, const uint32_t value);
+        void setDuty(const uint8_t channel, const uint32_t value);
+
+        uint32_t getCCNT(const uint8_t channel) const;
+
+        // Must be called after changing interrupts or pending updates of a channel
+        void update(const uint8_t channel);
+        void fire(const uint8_t channel);
+
+        // Writing TCR or TNCR clears ENDTX and TXBUFE, unless the counters are still zero
+        void pdcChanged();
+
+        // PWM_IER2 / PWM_IDR2, for the flags that aren't tied to a channel (ENDTX, TXBUFE)
+        void enableInterrupts2(const uint32_t mask) {
+            IMR2 |= mask;
+            if (ISR2 & IMR2) {
+                NVIC_SetPendingIRQ(PWM_IRQn);
+            }
+        };
+        void disableInterrupts2(const uint32_t mask) {
+            IMR2 &= ~mask;
+        };
+
+        // Read-and-clear, like reading PWM_ISR1 and PWM_ISR2.
+        // ENDTX and TXBUFE only clear when the PDC is given more to send.
+        uint32_t readISR1() {
+            uint32_t isr = ISR1;
+            ISR1 = 0;
+            return isr;
+        };
+        uint32_t readISR2() {
+            uint32_t isr = ISR2;
+            ISR2 &= (PWM_ISR2_ENDTX | PWM_ISR2_TXBUFE);
+            return isr;
+        };
+    };
+
+    extern HostPwm HostPWM;
+
+#pragma mark Enums, typedefs, etc.
+    /**************************************************
+     *
+     * Enums and typedefs
+     *
+     **************************************************/
+
+    enum TimerMode {
+        /* InputCapture mode (WAVE = 0) */
+        kTimerInputCapture         = 0,
+        /* InputCapture mode (WAVE = 0), counts up to RC */
+        kTimerInputCaptureToMatch  = 0 | TC_CMR_CPCTRG,
+
+        /* Waveform select, Up to 0xFFFFFFFF */
+        kTimerUp            = TC_CMR_WAVE | TC_CMR_WAVSEL_UP,
+        /* Waveform select, Up to TOP (RC) */
+        kTimerUpToTop       = TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC,
+        /* Keep the "ToMatch" naming for compatibility */
+        kTimerUpToMatch     = TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC,
+        /* For PWM, we'll alias kTimerUpToMatch as: */
+        kPWMLeftAligned     = TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC,
+        /* Waveform select, Up to 0xFFFFFFFF, then Down */
+        kTimerUpDown        = TC_CMR_WAVE | TC_CMR_WAVSEL_UPDOWN,
+        /* Waveform select, Up to TOP (RC), then Down */
+        kTimerUpDownToTop   = TC_CMR_WAVE | TC_CMR_WAVSEL_UPDOWN_RC,
+        /* Keep the "ToMatch" naming for compatibility */
+        kTimerUpDownToMatch = TC_CMR_WAVE | TC_CMR_WAVSEL_UPDOWN_RC,
+        /* For PWM, we'll alias kTimerUpDownToMatch as: */
+        kPWMCenterAligned     = kTimerUpDownToMatch,
+    };
+
+    /* Which edges of TIOA load RA and RB, in capture mode. RA and RB take turns, so
+     * with both on the same edge every edge is captured, alternately into RA and RB. */
+    enum TimerCaptureEdges {
+        kCaptureRisingEdges  = TC_CMR_LDRA_RISING | TC_CMR_LDRB_RISING,
+        kCaptureFallingEdges = TC_CMR_LDRA_FALLING | TC_CMR_LDRB_FALLING,
+        /* RA on rising, RB on falling -- the first edge captured is a rising one */
+        kCaptureBothEdges    = TC_CMR_LDRA_RISING | TC_CMR_LDRB_FALLING,
+    };
+
+    enum TimerSyncMode {
+        kTimerSyncManually     = 0, // duty cycles written by software, and updated every few periods
+        kTimerSyncDMA          = 1, // duty cycles written by DMA, and updated every few periods
+        kTimerSyncManualUpdate = 2, // duty cycles written by software, and updated by triggerSyncUpdate()
+    };
+
+    /* We're trading acronyms for verbose CamelCase. Dubious. */
+    enum TimerChannelOutputOptions {
+        kOutputDisconnected = 0,
+
+        kToggleOnMatch     = 1<<0,
+        kClearOnMatch      = 1<<1,
+        kSetOnMatch        = 1<<2,
+
+        kToggleOnOverflow  = 1<<3,
+        kClearOnOverflow   = 1<<4,
+        kSetOnOverflow     = 1<<5,
+
+
+        /* Aliases for use with PWM */
+        kPWMOn             = kClearOnMatch | kSetOnOverflow,
+        kPWMOnInverted     = kSetOnMatch | kClearOnOverflow,
+    };
+
+    /* We use TC_CMR_EEVT_XC0 in the above to allow TIOB to be an output.
+     * The defualt is for it to be the input for ExternalEvent.
+     * By setting it to XC0, we allow it to be an output.
+     */
+
+    enum TimerChannelInterruptOptions {
+        kInterruptsOff              = 0,
+        /* Alias for "off" to make more sense
+         when returned from setInterruptPending(). */
+        kInterruptUnknown           = 0,
+
+        kInterruptOnMatch          = 1<<1,
+        /* Note: Interrupt on overflow could be a match C as well. */
+        kInterruptOnOverflow        = 1<<3,
+
+        /* This turns the IRQ on, but doesn't set the timer to ever trigger it. */
+        kInterruptOnSoftwareTrigger = 1<<4,
+
+        /* Set priority levels here as well: */
+        kInterruptPriorityHighest   = 1<<5,
+        kInterruptPriorityHigh      = 1<<6,
+        kInterruptPriorityMedium    = 1<<7,
+        kInterruptPriorityLow       = 1<<8,
+        kInterruptPriorityLowest    = 1<<9,
+    };
+
+    enum TimerErrorCodes {
+        kFrequencyUnattainable = -1,
+        kInvalidMode = -2,
+    };
+
+    enum PWMTimerClockOptions {
+        kPWMClockPrescalerOnly = 0,
+        kPWMClockPrescaleAndDivA = 1,
+        kPWMClockPrescaleAndDivB = 2,
+    };
+
+    typedef const uint8_t timer_number;
+
+
+
+#pragma mark Timer<n>
+    /**************************************************
+     *
+     * TIMERS: Timer<n>
+     *
+     **************************************************/
+
+    template <uint8_t timerNum>
+    struct Timer {
+        // For external inspection
+        static constexpr uint8_t peripheral_num = (timerNum < 3) ? 0 : (timerNum < 6) ? 1 : 2;
+        static constexpr uint8_t timer_num = timerNum;
+
+        // This type of timer can't sync
+        static constexpr uint8_t can_sync = false;
+        static constexpr uint8_t sync_master = false;
+
+        // Try to catch invalid Timer usage ASAP
+        static_assert(timerNum < 9, "Timer<n> is only simulated for n in 0..8.");
+
+        static HostTcChannel * const tcChan()
+        {
+            return HostTC + timerNum;
+        };
+        static constexpr const uint32_t peripheralId()
+        {
+            return ID_TC0 + timerNum;
+        };
+        static constexpr const IRQn_Type tcIRQ()
+        {
+            return (IRQn_Type)(TC0_IRQn + timerNum);
+        };
+        static volatile uint32_t _interrupt_cause_cached;
+
+        static const bool has_channel_interrupts = false;
+
+        Timer() { init(); };
+        Timer(const TimerMode mode, const uint32_t freq) {
+            init();
+            setModeAndFrequency(mode, freq);
+        };
+
+        void init() {
+            // There's no write-protection to unlock in the simulation
+        }
+
+        void unlock() const {}
+        void lock() const {}
+
+        // Set the mode and frequency.
+        // Returns: The actual frequency that was used, or kFrequencyUnattainable
+        // freq is not const since we may "change" it
+        int32_t setModeAndFrequency(const TimerMode mode, uint32_t freq) {
+            /* Prepare to be able to make changes: */
+            /*   Disable TC clock */
+            tcChan()->stop();
+            /*   Disable interrupts */
+            tcChan()->IMR = 0;
+            /*   Clear status register */
+            tcChan()->readSR();
+
+            HostCommon::enablePeripheralClock(peripheralId());
+
+            if (mode == kTimerUpDownToMatch || mode == kTimerUpDown)
+                freq /= 2;
+
+            /* Setup clock "prescaler" */
+            /* Divisors: TC1: 2, TC2: 8, TC3: 32, TC4: 128 */
+
+            uint32_t masterClock = HostCommon::getPeripheralClockFreq();
+
+            // Store the divisor temporarily, to avoid looking it up again...
+            uint32_t divisor = 2; // sane default of 2
+            uint32_t clock_select = TC_CMR_TCCLKS_TIMER_CLOCK1;
+
+            // TC1 = MCK/2
+            if (freq > ((masterClock / 2) / 0x10000) && freq < (masterClock / 2)) {
+                clock_select = TC_CMR_TCCLKS_TIMER_CLOCK1;
+                divisor = 2;
+
+                // TC2 = MCK/8
+            } else if (freq > ((masterClock / 8) / 0x10000) && freq < (masterClock / 8)) {
+                clock_select = TC_CMR_TCCLKS_TIMER_CLOCK2;
+                divisor = 8;
+
+                // TC3 = MCK/32
+            } else if (freq > ((masterClock / 32) / 0x10000) && freq < (masterClock / 32)) {
+                clock_select = TC_CMR_TCCLKS_TIMER_CLOCK3;
+                divisor = 32;
+
+                // TC4 = MCK/128
+            } else if (freq > ((masterClock / 128) / 0x10000) && freq < (masterClock / 128)) {
+                clock_select = TC_CMR_TCCLKS_TIMER_CLOCK4;
+                divisor = 128;
+
+                // Nothing fit! Hmm...
+            } else {
+                // PUNT! For now, just guess TC1.
+                tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_WAVSEL_Msk | TC_CMR_TCCLKS_Msk)) |
+                    mode | TC_CMR_TCCLKS_TIMER_CLOCK1;
+                tcChan()->update();
+                return kFrequencyUnattainable;
+            }
+
+            /*  Set mode */
+            tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_WAVSEL_Msk | TC_CMR_TCCLKS_Msk)) |
+                mode | clock_select;
+
+            // Extra mile, set the actual frequency, but only if we're going to RC.
+            if (mode == kTimerInputCaptureToMatch
+                || mode == kTimerUpToMatch
+                || mode == kTimerUpDownToMatch) {
+
+                int32_t newTop = masterClock/(divisor*freq);
+                setTop(newTop);
+
+                // Determine and return the new frequency.
+                return masterClock/(divisor*newTop);
+            }
+
+            // Optimization -- we can't use RC for much when we're not using it,
+            //  so, instead of looking up if we're using it or not, just set it to
+            //  0xFFFF when we're not using it.
+            setTop(0xFFFF);
+
+            // Determine and return the new frequency.
+            return masterClock/(divisor*0xFFFF);
+        };
+
+        // Set the TOP value for modes that use it.
+        // WARNING: No sanity checking is done to verify that you are, indeed, in a mode that uses it.
+        void setTop(const uint32_t topValue) {
+            tcChan()->RC = topValue;
+            tcChan()->update();
+        };
+
+        // See SamTimers.h for why this works in both waveform and capture mode.
+        uint32_t getTopValue() {
+            return tcChan()->CMR & TC_CMR_CPCTRG ? tcChan()->RC : 0xFFFF;
+        };
+
+        // Return the current value of the counter. This is a fleeting thing...
+        uint32_t getValue() {
+            return tcChan()->getCV();
+        }
+
+        void start() {
+            tcChan()->start();
+        };
+
+        void stop() {
+            tcChan()->stop();
+        };
+
+        void stopOnMatch() {
+            tcChan()->CMR = TC_CMR_CPCSTOP;
+            tcChan()->update();
+        };
+
+        // Channel-specific functions. These are Motate channels, but they happen to line-up.
+        // Motate channel A = Sam channel A.
+        // Motate channel B = Sam channel B.
+
+        // Specify the duty cycle as a value from 0.0 .. 1.0;
+        void setDutyCycleForChannel(const uint8_t channel, const float ratio) {
+            setExactDutyCycleForChannel(channel, getTopValue() * ratio);
+        };
+        float getDutyCycleForChannel(const uint8_t channel) {
+            return (float)getExactDutyCycleForChannel(channel) / getTopValue();
+        };
+
+        // Specify channel A/B duty cycle as a integer value from 0 .. TOP.
+        // TOP in this case is either RC_RC or 0xFFFF.
+        void setExactDutyCycleForChannel(const uint8_t channel, const uint32_t absolute) {
+            if (channel == 0) {
+                tcChan()->RA = absolute;
+            } else if (channel == 1) {
+                tcChan()->RB = absolute;
+            }
+            tcChan()->update();
+        };
+
+        uint32_t getExactDutyCycleForChannel(const uint8_t channel) {
+            if (channel == 0) {
+                return tcChan()->RA;
+            } else /*if (channel == 1)*/ {
+                return tcChan()->RB;
+            }
+        };
+
+        void setOutputOptions(const uint8_t channel, const uint32_t options) {
+            uint32_t bitfield = 0;
+            if (channel == 0) {
+                if (options & kToggleOnMatch) {
+                    bitfield |= TC_CMR_ACPA_TOGGLE;
+                }
+                if (options & kClearOnMatch) {
+                    bitfield |= TC_CMR_ACPA_CLEAR;
+                }
+                if (options & kSetOnMatch) {
+                    bitfield |= TC_CMR_ACPA_SET;
+                }
+                if (options & kToggleOnOverflow) {
+                    bitfield |= TC_CMR_ACPC_TOGGLE;
+                }
+                if (options & kClearOnOverflow) {
+                    bitfield |= TC_CMR_ACPC_CLEAR;
+                }
+                if (options & kSetOnOverflow) {
+                    bitfield |= TC_CMR_ACPC_SET;
+                }
+
+                tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_ACPA_Msk | TC_CMR_ACPC_Msk)) | bitfield;
+            } else if (channel == 1) {
+
+                if (options & kToggleOnMatch) {
+                    bitfield |= TC_CMR_BCPB_TOGGLE;
+                }
+                if (options & kClearOnMatch) {
+                    bitfield |= TC_CMR_BCPB_CLEAR;
+                }
+                if (options & kSetOnMatch) {
+                    bitfield |= TC_CMR_BCPB_SET;
+                }
+                if (options & kToggleOnOverflow) {
+                    bitfield |= TC_CMR_BCPC_TOGGLE;
+                }
+                if (options & kClearOnOverflow) {
+                    bitfield |= TC_CMR_BCPC_CLEAR;
+                }
+                if (options & kSetOnOverflow) {
+                    bitfield |= TC_CMR_BCPC_SET;
+                }
+
+                tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_BCPB_Msk | TC_CMR_BCPC_Msk)) | bitfield | TC_CMR_EEVT_XC0;
+            }
+        };
+
+        // The output actions are kept in CMR for inspection, but no waveform is simulated.
+        void startPWMOutput(const uint8_t channel) {
+            if (channel == 0) {
+                if ((tcChan()->CMR & TC_CMR_ACPA_Msk) == TC_CMR_ACPA_SET)
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_ACPC_Msk)) | TC_CMR_ACPC_CLEAR;
+                else
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_ACPC_Msk)) | TC_CMR_ACPC_SET;
+            } else if (channel == 1) {
+                if ((tcChan()->CMR & TC_CMR_BCPB_Msk) == TC_CMR_BCPB_SET)
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_BCPC_Msk)) | TC_CMR_BCPC_CLEAR;
+                else
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_BCPC_Msk)) | TC_CMR_BCPC_SET;
+            }
+        };
+
+        void stopPWMOutput(const uint8_t channel) {
+            if (channel == 0) {
+                if ((tcChan()->CMR & TC_CMR_ACPA_Msk) == TC_CMR_ACPA_SET)
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_ACPC_Msk)) | TC_CMR_ACPC_SET;
+                else
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_ACPC_Msk)) | TC_CMR_ACPC_CLEAR;
+            } else if (channel == 1) {
+                if ((tcChan()->CMR & TC_CMR_BCPB_Msk) == TC_CMR_BCPB_SET)
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_BCPC_Msk)) | TC_CMR_BCPC_SET;
+                else
+                    tcChan()->CMR = (tcChan()->CMR & ~(TC_CMR_BCPC_Msk)) | TC_CMR_BCPC_CLEAR;
+            }
+        };
+
+        void setInterrupts(const uint32_t interrupts, const int16_t channel = -1) {
+            if (interrupts != kInterruptsOff) {
+                // We intentionally don't clear the interrupts so multiple calls
+                // will add to the interrupts, not replace them.
+
+                if (interrupts & kInterruptOnOverflow) {
+                    // Check to see if we're overflowing on C. See getTopValue() description.
+                    if (tcChan()->CMR & TC_CMR_CPCTRG) {
+                        tcChan()->IMR |= TC_SR_CPCS; // RC Compare
+                    } else {
+                        tcChan()->IMR |= TC_SR_COVFS; // Counter Overflow
+                    }
+                }
+                if (interrupts & kInterruptOnMatch && channel == 0) {
+                    tcChan()->IMR |= TC_SR_CPAS; // RA Compare
+                }
+                if (interrupts & kInterruptOnMatch && channel == 1) {
+                    tcChan()->IMR |= TC_SR_CPBS; // RB Compare
+                }
+                tcChan()->update();
+
+                /* Set interrupt priority */
+                if (interrupts & kInterruptPriorityHighest) {
+                    NVIC_SetPriority(tcIRQ(), 0);
+                }
+                else if (interrupts & kInterruptPriorityHigh) {
+                    NVIC_SetPriority(tcIRQ(), 1);
+                }
+                else if (interrupts & kInterruptPriorityMedium) {
+                    NVIC_SetPriority(tcIRQ(), 2);
+                }
+                else if (interrupts & kInterruptPriorityLow) {
+                    NVIC_SetPriority(tcIRQ(), 3);
+                }
+                else if (interrupts & kInterruptPriorityLowest) {
+                    NVIC_SetPriority(tcIRQ(), 4);
+                }
+
+                NVIC_EnableIRQ(tcIRQ());
+            } else {
+                tcChan()->IMR = 0;
+                tcChan()->update();
+                NVIC_DisableIRQ(tcIRQ());
+            }
+        }
+
+        void setInterruptPending() {
+            NVIC_SetPendingIRQ(tcIRQ());
+        }
+
+        static TimerChannelInterruptOptions getInterruptCause(int16_t &channel) {
+            uint32_t sr_ = _interrupt_cause_cached;
+            channel = -1;
+
+            // if it is either an overflow or a RC compare
+            if (sr_ & (TC_SR_COVFS | TC_SR_CPCS)) {
+                return kInterruptOnOverflow;
+            }
+            else if (sr_ & (TC_SR_CPAS)) {
+                channel = 0;
+                return kInterruptOnMatch;
+            }
+            else if (sr_ & (TC_SR_CPBS)) {
+                channel = 1;
+                return kInterruptOnMatch;
+            }
+            else if (sr_ & (TC_SR_ETRGS)) {
+                return kInterruptOnMatch;
+            }
+            return kInterruptUnknown;
+        }
+
+        // Placeholder for user code.
+        static void interrupt();
+    }; // Timer<>
+
+#pragma mark TimerChannel<n>
+    /**************************************************
+     *
+     * TIMERCHANNELSS: TimerChannel<n>
+     *
+     **************************************************/
+
+    template<uint8_t timerNum, uint8_t channelNum>
+    struct TimerChannel : Timer<timerNum> {
+        TimerChannel() : Timer<timerNum>{} {};
+        TimerChannel(const TimerMode mode, const uint32_t freq) : Timer<timerNum>{mode, freq} {};
+
+        void setDutyCycle(const float ratio) {
+            Timer<timerNum>::setDutyCycleForChannel(channelNum, ratio);
+        };
+
+        float getDutyCycle() {
+            return Timer<timerNum>::getDutyCycleForChannel(channelNum);
+        };
+
+        void setExactDutyCycle(const uint32_t absolute) {
+            Timer<timerNum>::setExactDutyCycleForChannel(channelNum, absolute);
+        };
+
+        uint32_t getExactDutyCycle() {
+            return Timer<timerNum>::getExactDutyCycleForChannel(channelNum);
+        };
+
+
+        void setOutputOptions(const uint32_t options) {
+            Timer<timerNum>::setOutputOptions(channelNum, options);
+        };
+
+        void startPWMOutput() {
+            Timer<timerNum>::startPWMOutput(channelNum);
+        };
+
+        void stopPWMOutput() {
+            Timer<timerNum>::stopPWMOutput(channelNum);
+        }
+
+        void setInterrupts(const uint32_t interrupts) {
+            Timer<timerNum>::setInterrupts(interrupts, channelNum);
+        };
+
+        TimerChannelInterruptOptions getInterruptCause(int16_t &channel) {
+            channel = 1;
+            return Timer<timerNum>::getInterruptCause(channel);
+        }
+
+        TimerChannelInterruptOptions getInterruptCause() {
+            int16_t channel = 1;
+            return Timer<timerNum>::getInterruptCause(channel);
+        }
+
+        // Placeholder for user code.
+        static void interrupt();
+    };
+
+
+#pragma mark InputCapture support
+    /**************************************************
+     *
+     * The hardware half of InputCapture (see MotateInputCapture.h), on a
+     * HostTcChannel: the counter is 16 bits wide, and the capture edges come
+     * from HostTC[timerNum].tioaInput().
+     *
+     **************************************************/
+
+    template<uint8_t timerNum>
+    struct _InputCaptureHardware {
+        static constexpr uint8_t counterBits = 16;
+        static constexpr uint32_t kOverflow = TC_SR_COVFS;
+        static constexpr uint32_t kCaptureA = TC_SR_LDRAS;
+        static constexpr uint32_t kCaptureB = TC_SR_LDRBS;
+        static constexpr uint32_t kOverrun  = TC_SR_LOVRS;
+
+        // The one that's running, so TCx_Handler can find it
+        static _InputCaptureHardware *_active;
+
+        Timer<timerNum> timer;
+        const Delegate<void(uint32_t)> _statusHandler;
+
+        _InputCaptureHardware(Delegate<void(uint32_t)> &&statusHandler) : _statusHandler{std::move(statusHandler)} {};
+
+        // Returns the tick frequency
+        uint32_t start(const TimerCaptureEdges edges) {
+            auto tc = timer.tcChan();
+            tc->stop();
+            tc->IMR = 0;
+            HostCommon::enablePeripheralClock(timer.peripheralId());
+
+            tc->CMR = TC_CMR_TCCLKS_TIMER_CLOCK1 | edges;
+            tc->readSR();
+
+            _active = this;
+            tc->IMR = TC_SR_COVFS | TC_SR_LDRAS | TC_SR_LDRBS;
+            NVIC_EnableIRQ(timer.tcIRQ());
+            timer.start();
+
+            return HostCommon::getPeripheralClockFreq() / 2;
+        };
+
+        void stop() {
+            timer.stop();
+            timer.tcChan()->IMR = 0;
+            if (_active == this) {
+                _active = nullptr;
+            }
+        };
+
+        uint32_t getCaptureA() const { return timer.tcChan()->RA; };
+        uint32_t getCaptureB() const { return timer.tcChan()->RB; };
+
+        // Call action(value, status) with the counter value, then the status read right after it,
+        // with interrupts off -- whatever the status says has happened is handled by action.
+        template <typename action_t>
+        void poll(action_t &&action) {
+            HostCommon::InterruptDisabler disabler;
+            const uint32_t value = timer.tcChan()->getCV();
+            action(value, timer.tcChan()->readSR());
+        };
+
+        // Called from TCx_Handler with the TC_SR it read
+        static void _interrupt(const uint32_t status) {
+            if (_active != nullptr) {
+                _active->_statusHandler(status);
+            }
+        };
+    };
+
+
+#pragma mark PWMTimer<n>
+    /**************************************************
+     *
+     * PWMTimer: PWMTimer<n>
+     *
+     **************************************************/
+
+    extern uint32_t pwm_interrupt_cause_cached_1_;
+    extern uint32_t pwm_interrupt_cause_cached_2_;
+
+    static constexpr uint32_t divisors[11] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+
+    template <uint8_t moduleNum, uint8_t timerNum>
+    struct PWMTimer {
+        static_assert(moduleNum==0, "PWMTimer<m,n>: m must be 0 on this processor.");
+        static_assert(timerNum>=0 && timerNum<8, "PWMTimer<m,n>: n must be within 0 through 7 on this processor.");
+
+        // For external inspection
+        static constexpr uint8_t peripheral_num = 0;
+        static constexpr uint8_t timer_num = timerNum;
+
+        static HostPwm * const pwm() { return &HostPWM; };
+        static HostPwmChannel * const pwmChan() { return HostPWM.ch + timerNum; };
+        static constexpr const uint32_t peripheralId() { return ID_PWM; };
+        static constexpr const IRQn_Type pwmIRQ() { return PWM_IRQn; };
+
+        PWMTimer() { init(); };
+        PWMTimer(const TimerMode mode, const uint32_t freq) {
+            init();
+            setModeAndFrequency(mode, freq);
+        };
+
+        void init() {
+        }
+
+
+        static constexpr uint8_t can_sync = true;
+        static constexpr uint8_t sync_master = (timer_num == 0);
+
+        void setSync(const bool is_sync) {
+            if (is_sync) {
+                pwm()->SCM |=   PWM_SCM_SYNC0 << timer_num;
+            } else {
+                pwm()->SCM &= ~(PWM_SCM_SYNC0 << timer_num);
+            }
+        };
+
+        void setSyncMode(const TimerSyncMode m, uint32_t periods = 1) {
+            pwm()->SCM = (pwm()->SCM & ~(PWM_SCM_UPDM_Msk | PWM_SCM_PTRM | PWM_SCM_PTRCS_Msk)) |
+              ((m == kTimerSyncManually) ? PWM_SCM_UPDM_MODE1 :
+               (m == kTimerSyncManualUpdate) ? PWM_SCM_UPDM_MODE0 : PWM_SCM_UPDM_MODE2);
+
+            if (periods < 1) { periods = 1; } // minimum of 1
+            if (periods > 0xF) { periods = 0xF; } // maximum of 0xF
+            pwm()->SCUPUPD = PWM_SCUPUPD_UPRUPD(periods - 1);
+            pwm()->SCUC = PWM_SCUC_UPDULOCK;
+            pwm()->update(0);
+        };
+
+        // The synchronous channels' new (UPD) duty cycles and periods all take effect
+        // at the start of channel 0's next period. Only duty cycles written since the
+        // last update are changed, so stage them all before calling this.
+        void triggerSyncUpdate() {
+            pwm()->SCUC = PWM_SCUC_UPDULOCK;
+            pwm()->update(0);
+        };
+
+        // The hardware clears UPDULOCK when the update is done
+        bool isSyncUpdatePending() {
+            return pwm()->SCUC & PWM_SCUC_UPDULOCK;
+        };
+
+        // Like the PDC version: the duty cycles of the synchronous channels, one uint16_t per channel per update.
+        bool startTransfer(uint8_t * const buffer, const uint16_t length) {
+            if (pwm()->pdc.TCR == 0) {
+                pwm()->pdc.TPR = (char *)buffer;
+                pwm()->pdc.TCR = length;
+            } else if (pwm()->pdc.TNCR == 0) {
+                pwm()->pdc.TNPR = (char *)buffer;
+                pwm()->pdc.TNCR = length;
+            } else {
+                return false; // was unable to start a transfer
+            }
+            pwm()->pdc.tx_enabled = true;
+            pwm()->pdc.changed();
+            start();
+            return true;
+        }
+        // This form allows passing a single-dimensional array by reference, and deduces the full length
+        template<typename T>
+        bool startTransfer(T const &buffer) {
+            static_assert(std::alignment_of<T>::value == 2, "startTransfer(buffer): buffer must be an array of two-byte values");
+            return startTransfer((uint8_t *)(&buffer), std::extent<T>::value);
+        }
+
+        bool isTransferDone() {
+            return ((pwm()->pdc.TCR == 0) && (pwm()->pdc.TNCR == 0));
+        }
+
+        // Non-ops to keep the compiler happy.
+        void unlock() {};
+        void lock() {};
+
+        /* Set the mode and frequency.
+         * Returns: The actual frequency that was used, or kFrequencyUnattainable
+         * freq is not const since we may "change" it.
+         * Clock A and B are not simulated, so clock is ignored (treated as kPWMClockPrescalerOnly).
+         */
+        int32_t setModeAndFrequency(const TimerMode mode, uint32_t frequency, const uint8_t clock = kPWMClockPrescalerOnly) {
+            /* Prepare to be able to make changes: */
+            /*   Disable TC clock */
+            pwm()->disable(1 << timerNum);
+            /*   Disable interrupts */
+            pwm()->IMR1 &= ~(1 << timerNum);
+            pwm()->IMR2 &= ~(PWM_IDR2_CMPM0 << timerNum);
+
+            HostCommon::enablePeripheralClock(peripheralId());
+
+            if (mode == kTimerInputCapture || mode == kTimerInputCaptureToMatch) {
+                return kFrequencyUnattainable;
+            }
+
+            // Remember: kTimerUpDownToMatch and kPWMCenterAligned are identical.
+            if (mode == kPWMCenterAligned) {
+                frequency /= 2;
+            }
+
+            /* Setup clock "prescaler" */
+            /* Divisors: 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024 */
+
+            // Grab the master clock value.
+            uint32_t masterClock = HostCommon::getPeripheralClockFreq();
+
+            uint8_t divisor_index = 0;
+
+            // Find prescaler value
+            uint32_t test_value = masterClock / divisors[divisor_index];
+
+            // We assume if (divisor_index == 10) then 10 will be the value we use...
+            // We want OUT of the while loop when we have the right divisor.
+            // AGAIN: FAILING this test means we have the RIGHT divisor.
+            while ((divisor_index < 10) && ((frequency > test_value) || (frequency < (test_value / 0x10000)))) {
+                divisor_index++;
+                test_value = masterClock / divisors[divisor_index];
+            }
+
+            pwmChan()->CMR = (divisor_index & 0xff) | (mode == kPWMCenterAligned ? PWM_CMR_CALG : 0) |
+            /* Preserve inversion: */(pwmChan()->CMR & PWM_CMR_CPOL);
+
+            int32_t newTop = test_value / frequency;
+            setTop(newTop);
+
+            // Determine and return the new frequency.
+            return test_value / newTop;
+        };
+
+        // Set the TOP value for modes that use it.
+        // WARNING: No sanity checking is done to verify that you are, indeed, in a mode that uses it.
+        void setTop(const uint32_t topValue) {
+            pwm()->setPeriod(timerNum, topValue);
+        };
+
+        // Here we want to get what the TOP value is.
+        uint32_t getTopValue() {
+            return pwmChan()->CPRD;
+        };
+
+        // Return the current value of the counter. This is a fleeting thing...
+        uint32_t getValue() {
+            return pwm()->getCCNT(timerNum);
+        }
+
+        void start() {
+            pwm()->enable(1 << timerNum);
+        };
+
+        void stop() {
+            pwm()->disable(1 << timerNum);
+        };
+
+        // Channel-specific functions. These are Motate channels, but they happen to line-up.
+
+        // Specify the duty cycle as a value from 0.0 .. 1.0;
+        void setDutyCycleForChannel(const uint8_t channel, const float ratio) {
+            setExactDutyCycle(ratio);
+        };
+        void setDutyCycle(const float ratio) {
+            pwm()->setDuty(timerNum, getTopValue() * ratio);
+        };
+        float getDutyCycleForChannel(const uint8_t channel) {
+            return getDutyCycle();
+
+        };
+        float getDutyCycle() {
+            return (float)pwmChan()->CDTY / getTopValue();
+
+        };
+
+
+        // Specify channel A/B duty cycle as a integer value from 0 .. TOP.
+        void setExactDutyCycleForChannel(const uint8_t channel, const uint32_t absolute) {
+            setExactDutyCycle(absolute);
+        };
+        void setExactDutyCycle(const uint32_t absolute) {
+            pwm()->setDuty(timerNum, absolute);
+        };
+        uint32_t getExactDutyCycleForChannel(const uint8_t channel) {
+            return getExactDutyCycle();
+        };
+        uint32_t getExactDutyCycle() {
+            return pwmChan()->CDTY;
+        };
+
+
+        void setOutputOptions(const uint32_t channel, const uint32_t options) {
+            setOutputOptions(options);
+        };
+
+        void setOutputOptions(const uint32_t options) {
+            if (options == kPWMOnInverted) {
+                pwmChan()->CMR |= PWM_CMR_CPOL;
+            }
+            else if (options == kPWMOn) {
+                pwmChan()->CMR &= ~PWM_CMR_CPOL;
+            }
+        };
+
+
+        // ASSUMPTION: The pin is not in Toggle mode.
+        void stopPWMOutput(const uint32_t channel) {
+            stopPWMOutput();
+        };
+        void stopPWMOutput() {
+        };
+
+        void startPWMOutput(const uint32_t channel) {
+            startPWMOutput();
+        };
+        void startPWMOutput() {
+            start();
+        };
+
+        void setInterrupts(const uint32_t interrupts) {
+            pwm()->IMR1 &= ~(1 << timerNum);
+            pwm()->IMR2 &= ~(PWM_IDR2_CMPM0 << timerNum);
+
+            if (interrupts != kInterruptsOff) {
+                if (interrupts & kInterruptOnOverflow) {
+                    pwm()->IMR1 |= (1 << timerNum);
+                }
+                if (interrupts & kInterruptOnMatch) {
+                    pwm()->IMR2 |= (PWM_IER2_CMPM0 << timerNum);
+                }
+                pwm()->update(timerNum);
+
+                /* Set interrupt priority */
+                if (interrupts & kInterruptPriorityHighest) {
+                    NVIC_SetPriority(pwmIRQ(), 0);
+                }
+                else if (interrupts & kInterruptPriorityHigh) {
+                    NVIC_SetPriority(pwmIRQ(), 1);
+                }
+                else if (interrupts & kInterruptPriorityMedium) {
+                    NVIC_SetPriority(pwmIRQ(), 2);
+                }
+                else if (interrupts & kInterruptPriorityLow) {
+                    NVIC_SetPriority(pwmIRQ(), 3);
+                }
+                else if (interrupts & kInterruptPriorityLowest) {
+                    NVIC_SetPriority(pwmIRQ(), 4);
+                }
+
+                NVIC_EnableIRQ(pwmIRQ());
+            } else {
+                pwm()->update(timerNum);
+
+                // If none of the interrupts are on, we can disable the IRQ altogether.
+                if (0==(pwm()->IMR1) && 0==(pwm()->IMR2)) {
+                    NVIC_DisableIRQ(pwmIRQ());
+                }
+            }
+        }
+
+        void setInterruptPending() {
+            NVIC_SetPendingIRQ(pwmIRQ());
+        }
+
+        TimerChannelInterruptOptions getInterruptCause(const uint32_t channel) {
+            return getInterruptCause();
+        }
+
+        TimerChannelInterruptOptions getInterruptCause() {
+            // if it is either an overflow or a RC compare
+            if (pwm_interrupt_cause_cached_1_ != 0) {
+                return kInterruptOnOverflow;
+            }
+            else if (pwm_interrupt_cause_cached_2_ != 0) {
+                return kInterruptOnMatch;
+            }
+
+            return kInterruptUnknown;
+        }
+
+        // Placeholder for user code.
+        static void interrupt();
+    }; // struct PWMTimer
+
+    template<uint8_t moduleNumber, uint8_t timerNum, uint8_t channelNum>
+    struct PWMTimerChannel : PWMTimer<moduleNumber, timerNum> {
+        //Intentionally empty
+    };
+
+#pragma mark PWMWaveformPlayer support
+    /**************************************************
+     *
+     * The hardware half of PWMWaveformPlayer (see MotatePWMWaveformPlayer.h), like
+     * the Sam3x: HostPWM.pdc feeds the synchronous channels' duty cycles, one frame
+     * per update period, and ENDTX (through PWM_Handler) marks the end of each
+     * buffer, and TXBUFE the end of both.
+     *
+     **************************************************/
+
+    template<uint8_t moduleNum>
+    struct _PWMWaveformHardware {
+        static_assert(moduleNum == 0, "_PWMWaveformHardware<n>: there is only PWM 0");
+
+        // The one that's playing, so PWM_Handler can find it
+        static _PWMWaveformHardware *_active;
+
+        const Delegate<void(void)> _bufferDone;
+
+        _PWMWaveformHardware(Delegate<void(void)> &&bufferDone) : _bufferDone{std::move(bufferDone)} {};
+
+        // Play length frames once, interrupting only when it's all done
+        void startOnce(uint16_t *buffer, const uint16_t length) {
+            stop();
+            HostPWM.pdc.TPR = (char *)buffer;
+            HostPWM.pdc.TCR = length;
+            HostPWM.pdc.TNCR = 0;
+            _start(PWM_IER2_TXBUFE);
+        };
+
+        // Play bufferA then bufferB, interrupting at the end of each so it can be requeued
+        void startRing(uint16_t *bufferA, uint16_t *bufferB, const uint16_t length) {
+            stop();
+            HostPWM.pdc.TPR = (char *)bufferA;
+            HostPWM.pdc.TCR = length;
+            HostPWM.pdc.TNPR = (char *)bufferB;
+            HostPWM.pdc.TNCR = length;
+            _start(PWM_IER2_ENDTX);
+        };
+
+        // Called from the interrupt with the buffer that just finished, to hand it back to the PDC.
+        // Returns false if the other buffer was already done too, and the PDC had stopped -- the
+        // buffer is playing now, and nothing is queued behind it.
+        bool requeue(uint16_t *buffer, const uint16_t length) {
+            bool queued = true;
+            if (HostPWM.pdc.TCR == 0) {
+                HostPWM.pdc.TPR = (char *)buffer;
+                HostPWM.pdc.TCR = length;
+                queued = false;
+            } else {
+                HostPWM.pdc.TNPR = (char *)buffer;
+                HostPWM.pdc.TNCR = length;
+            }
+            HostPWM.pdc.changed();
+            return queued;
+        };
+
+        // Nothing more will be queued: the next interrupt is when the PDC runs out
+        void finish() {
+            HostPWM.disableInterrupts2(PWM_IDR2_ENDTX);
+            HostPWM.enableInterrupts2(PWM_IER2_TXBUFE);
+        };
+
+        void stop() {
+            HostPWM.disableInterrupts2(PWM_IDR2_ENDTX | PWM_IDR2_TXBUFE);
+            HostPWM.pdc.tx_enabled = false;
+            if (_active == this) {
+                _active = nullptr;
+            }
+        };
+
+        void _start(const uint32_t interrupt) {
+            _active = this;
+            HostPWM.pdc.tx_enabled = true;
+            HostPWM.pdc.changed();
+            HostPWM.enableInterrupts2(interrupt);
+            NVIC_EnableIRQ(PWM_IRQn);
+        };
+
+        // Called from PWM_Handler with PWM_ISR2
+        static void _interrupt(const uint32_t isr2) {
+            if ((_active != nullptr) && (isr2 & HostPWM.IMR2 & (PWM_ISR2_ENDTX | PWM_ISR2_TXBUFE))) {
+                _active->_bufferDone();
+            }
+        };
+    };
+
+#pragma mark SysTickEvent, Timer<SysTickTimerNum> SysTickTimer
+    /**************************************************
+     *
+     * SysTickTimer and related:
+     *  Timer<SysTickTimerNum> is the special Timer for Systick.
+     *  SysTickTimer is the global singleton to access it.
+     *  SysTickEvent is the class to use to register a new event to occur every Tick.
+     *  TimingWheelEvent is the class to use to schedule a one-shot or periodic event
+     *   some number of Ticks from now, with SysTickTimer.schedule().
+     *
+     **************************************************/
+    struct SysTickEvent {
+        const Delegate<void(void)> callback;
+        SysTickEvent *next;
+    };
+
+    static const timer_number SysTickTimerNum = 0xFF;
+    template <>
+    struct Timer<SysTickTimerNum> {
+        static volatile uint32_t _motateTickCount;
+        static volatile uint32_t _motateTickCountHigh; // _motateTickCount overflows, see Clock
+        static HostSimEvent _tickEvent;
+        SysTickEvent *firstEvent = nullptr;
+        TimingWheel<> _wheel;
+
+        Timer() { init(); };
+        Timer(const TimerMode mode, const uint32_t freq) {
+            init();
+        };
+
+        void init() {
+            _motateTickCount = 0;
+            _motateTickCountHigh = 0;
+            _wheel._now = 1; // tick 0 is now, so the first one to process is 1
+
+            // Set Systick to 1ms interval, at the lowest priority (like SysTick_Config)
+            NVIC_SetPriority(SysTick_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+            if (!_tickEvent.action) {
+                _tickEvent.action = []() {
+                    HostSim::schedule(&_tickEvent, _tickEvent.when + (HostCommon::getPeripheralClockFreq() / 1000));
+                    NVIC_SetPendingIRQ(SysTick_IRQn);
+                };
+            }
+            HostSim::scheduleIn(&_tickEvent, HostCommon::getPeripheralClockFreq() / 1000);
+        };
+
+        // Return the current value of the counter. This is a fleeting thing...
+        uint32_t getValue() {
+            return _motateTickCount;
+        };
+
+        void _increment() {
+            if (++_motateTickCount == 0) {
+                _motateTickCountHigh++;
+            }
+        };
+
+        void registerEvent(SysTickEvent *new_event) {
+            if (firstEvent == nullptr) {
+                firstEvent = new_event;
+                return;
+            }
+            SysTickEvent *event = firstEvent;
+            if (new_event == event) { return; }
+            while (event->next != nullptr) {
+                event = event->next;
+                if (new_event == event) { return; }
+            }
+            event->next = new_event;
+            new_event->next = nullptr;
+        };
+
+        void unregisterEvent(SysTickEvent *new_event) {
+            if (firstEvent == new_event) {
+                firstEvent = firstEvent->next;
+                return;
+            }
+            SysTickEvent *event = firstEvent;
+            while (event->next != nullptr) {
+                if (event->next == new_event) {
+                    event->next = event->next->next;
+                    return;
+                }
+                event = event->next;
+            }
+        };
+
+        // Call event's callback (from the SysTick interrupt) after delay Ticks, and then every
+        // period Ticks if period isn't 0. The event must stay valid until it's cancelled (or, if
+        // it's one-shot, called). Scheduling a scheduled event moves it.
+        void schedule(TimingWheelEvent *event, const uint32_t delay, const uint32_t period = 0) {
+            HostCommon::InterruptDisabler disabler;
+            _wheel.schedule(event, delay, period);
+        };
+
+        void cancel(TimingWheelEvent *event) {
+            HostCommon::InterruptDisabler disabler;
+            _wheel.cancel(event);
+        };
+
+        void _handleEvents() {
+            SysTickEvent *event = firstEvent;
+            while (event != nullptr) {
+                event->callback();
+                event = event->next;
+            }
+
+            // Only the events that are due (if any) are touched here
+            _wheel.advance(_motateTickCount);
+        };
+
+        // Placeholder for user code.
+        static void interrupt() __attribute__ ((weak));
+    };
+    extern Timer<SysTickTimerNum> SysTickTimer;
+
+#pragma mark WatchDogTimer, Timer<WatchDogTimerNum>
+    /**************************************************
+     *
+     * Timer<WatchDogTimerNum> and related:
+     *  Timer<WatchDogTimerNum> is the special Timer for the hardware watchdog timer.
+     *  WatchDogTimer is the global singleton to access it.
+     *  Currently only supported is to call WatchDogTimer.disable(0 immediately.
+     *
+     **************************************************/
+
+    static const timer_number WatchDogTimerNum = 0xFE;
+    template <>
+    struct Timer<WatchDogTimerNum> {
+
+        Timer() { init(); };
+        Timer(const TimerMode mode, const uint32_t freq) {
+            init();
+            //			setModeAndFrequency(mode, freq);
+        };
+
+        void init() {
+        };
+
+        // There's no watchdog to disable in the simulation.
+        void disable() {
+        };
+
+        void checkIn() {
+
+        };
+
+        // Placeholder for user code.
+        static void interrupt() __attribute__ ((weak));
+    };
+    extern Timer<WatchDogTimerNum> WatchDogTimer;
+
+#pragma mark Clock
+    /**************************************************
+     *
+     * Clock: 64-bit monotonic timestamps, in core clock cycles, microseconds, or
+     *  milliseconds since startup. Here it's just the simulated clock.
+     *
+     **************************************************/
+    struct Clock {
+        static uint64_t cycles() { return HostSim::now(); };
+        static uint64_t microseconds() { return HostSim::now() / (SystemCoreClock / 1000000); };
+        static uint64_t milliseconds() { return HostSim::now() / (SystemCoreClock / 1000); };
+    };
+
+#pragma mark Deadline
+    /**************************************************
+     *
+     * Deadline: a point in time (with microsecond resolution) to poll for, as a
+     *  non-blocking alternative to delay_us(). Since it's 64-bit, it never wraps.
+     *
+     **************************************************/
+    struct Deadline {
+        uint64_t at_ = 0;
+        bool set_ = false;
+
+        Deadline() {};
+
+        static Deadline in_us(const uint64_t microseconds) { Deadline d; d.set_us(microseconds); return d; };
+        static Deadline in_ms(const uint32_t milliseconds) { Deadline d; d.set_ms(milliseconds); return d; };
+
+        void set_us(const uint64_t microseconds) {
+            at_ = Clock::microseconds() + microseconds;
+            set_ = true;
+        };
+
+        void set_ms(const uint32_t milliseconds) { set_us((uint64_t)milliseconds * 1000); };
+
+        void clear() { set_ = false; };
+
+        bool isSet() const { return set_; };
+
+        bool isPast() const { return set_ && (Clock::microseconds() >= at_); };
+
+        // Microseconds until the deadline, or 0 if it's past (or not set)
+        uint64_t remaining_us() const {
+            if (!set_) {
+                return 0;
+            }
+            const uint64_t now = Clock::microseconds();
+            return (now < at_) ? (at_ - now) : 0;
+        };
+    };
+
+#pragma mark delay_us(), delay_ms(), delay()
+    /**************************************************
+     *
+     * delay_us(), delay_ms(): blocking delays, accurate to about a microsecond
+     * delay(): Arduino-compatible blocking delay, in milliseconds
+     *
+     **************************************************/
+
+    // Nothing else can happen while we wait, so let simulated time pass (exactly)
+    inline void _delayUntil(const uint64_t done_us) {
+        const uint64_t done = done_us * (SystemCoreClock / 1000000);
+        if (done > HostSim::now()) {
+            HostSim::advance(done - HostSim::now());
+        }
+    }
+
+    inline void delay_us(const uint32_t microseconds) {
+        _delayUntil(Clock::microseconds() + microseconds);
+    }
+
+    inline void delay_ms(const uint32_t milliseconds) {
+        _delayUntil(Clock::microseconds() + ((uint64_t)milliseconds * 1000));
+    }
+
+    inline void delay(const uint32_t milliseconds) {
+        delay_ms(milliseconds);
+    }
+
+
+#pragma mark Timeout
+    /**************************************************
+     *
+     * Timeout: Simple non-blocking timeout class. Either poll isPast(), or
+     *  give it a callback to be called (from the SysTick interrupt) when it
+     *  expires.
+     *
+     **************************************************/
+    struct Timeout {
+        uint32_t start_, delay_;
+        TimingWheelEvent expired_;
+        Timeout() : start_ {0}, delay_ {0} {};
+        Timeout(Delegate<void(void)> &&callback) : start_ {0}, delay_ {0}, expired_ {std::move(callback)} {};
+
+        // expired_ may be linked into the SysTickTimer's wheel, so it has to come off of it
+        // before it goes away (and it can't be copied)
+        ~Timeout() { clear(); };
+
+        void setCallback(Delegate<void(void)> &&callback) {
+            clear();
+            expired_.callback = callback;
+        };
+
+        bool isSet() {
+            return (start_ > 0);
+        }
+
+        bool isPast() {
+            if (!isSet()) {
+                return false;
+            }
+            return ((SysTickTimer.getValue() - start_) > delay_);
+        };
+
+        void set(uint32_t delay, bool only_if_lower = false) {
+            if (only_if_lower && (delay_ - (SysTickTimer.getValue() - start_) <= delay)) {
+                return; // we would extend the timer
+            }
+            start_ = SysTickTimer.getValue();
+            delay_ = delay;
+
+            // Called on the same Tick that isPast() becomes true
+            if (expired_.callback) {
+                SysTickTimer.schedule(&expired_, delay_);
+            }
+        };
+
+        void clear() {
+            start_ = 0;
+            delay_ = 0;
+
+            if (expired_.callback) {
+                SysTickTimer.cancel(&expired_);
+            }
+        }
+    };
+
+} // namespace Motate
+
+#pragma mark MOTATE_TIMER_INTERRUPT, MOTATE_TIMER_CHANNEL_INTERRUPT
+/**************************************************
+ *
+ * #defines that allow simple definition of interrupt functions
+ *
+ **************************************************/
+
+#define MOTATE_TIMER_INTERRUPT(number) template<> void Motate::Timer<number>::interrupt()
+#define MOTATE_TIMER_CHANNEL_INTERRUPT(t, ch) template<> void Motate::TimerChannel<t, ch>::interrupt()
+
+
+#endif /* end of include guard: HOSTTIMERS_H_ONCE */
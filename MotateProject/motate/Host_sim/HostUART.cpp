@@ -0,0 +1,105 @@
+/*
+ Host_sim/HostUART.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MotateUART.h"
+
+namespace Motate {
+    HostUart HostUARTs[5] MOTATE_HOST_MODEL {
+        {USART0_IRQn}, {USART1_IRQn}, {USART2_IRQn}, {USART3_IRQn}, {UART_IRQn}
+    };
+
+    void HostUart::_startTx() {
+        if (!tx_enabled || shifting || !cts_asserted) {
+            return;
+        }
+        if (thr_full) {
+            // THR goes out first, like it would if the PDC had written it
+            tsr = thr;
+            thr_full = false;
+        } else if (!pdc.pullTx(tsr)) {
+            return;
+        }
+        shifting = true;
+        HostSim::scheduleIn(&tx_event, charTime());
+    }
+
+    void HostUart::_txDone() {
+        shifting = false;
+        if (tx_sink) {
+            tx_sink(tsr);
+        }
+        _startTx();
+        checkInterrupts();
+    }
+
+    void HostUart::_rxArrived() {
+        if (rx_pending.empty()) {
+            return;
+        }
+        const uint8_t value = rx_pending.front();
+        rx_pending.pop_front();
+
+        if (rx_enabled) {
+            if (!pdc.pushRx(value)) {
+                if (rhr >= 0) {
+                    flags |= OVRE;
+                }
+                rhr = value;
+            }
+        }
+
+        if (!rx_pending.empty()) {
+            HostSim::scheduleIn(&rx_event, charTime());
+        }
+        checkInterrupts();
+    }
+
+    template<> Delegate<void()> _UARTHardware<0>::_uartInterruptHandlerJumper MOTATE_HOST_MODEL {};
+    template<> Delegate<void()> _UARTHardware<1>::_uartInterruptHandlerJumper MOTATE_HOST_MODEL {};
+    template<> Delegate<void()> _UARTHardware<2>::_uartInterruptHandlerJumper MOTATE_HOST_MODEL {};
+    template<> Delegate<void()> _UARTHardware<3>::_uartInterruptHandlerJumper MOTATE_HOST_MODEL {};
+    template<> Delegate<void()> _UARTHardware<4>::_uartInterruptHandlerJumper MOTATE_HOST_MODEL {};
+}
+
+#define _MAKE_UART_Handler(handler, n) \
+    extern "C" void handler(void)  { \
+        if (Motate::_UARTHardware<n>::_uartInterruptHandlerJumper) { \
+            Motate::_UARTHardware<n>::_uartInterruptHandlerJumper(); \
+            return; \
+        } \
+    }
+
+_MAKE_UART_Handler(USART0_Handler, 0)
+_MAKE_UART_Handler(USART1_Handler, 1)
+_MAKE_UART_Handler(USART2_Handler, 2)
+_MAKE_UART_Handler(USART3_Handler, 3)
+_MAKE_UART_Handler(UART_Handler, 4)
+
+#undef _MAKE_UART_Handler
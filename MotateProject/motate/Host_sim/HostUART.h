@@ -0,0 +1,520 @@
+/*
+ Host_sim/HostUART.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef HOSTUART_H_ONCE
+#define HOSTUART_H_ONCE
+
+#include <MotateUART.h>
+#include <MotateBuffer.h>
+#include <type_traits>
+#include <functional>
+#include <deque>
+
+#include "HostCommon.h"
+#include "HostDMA.h"
+
+namespace Motate {
+    // Convenience template classes for specialization:
+
+    template<pin_number rxPinNumber, pin_number txPinNumber>
+    using IsValidUART = typename std::enable_if<
+        IsUARTRxPin<rxPinNumber>() &&
+        IsUARTTxPin<txPinNumber>() &&
+        rxPinNumber != txPinNumber &&
+        UARTTxPin<txPinNumber>::uartNum == UARTRxPin<rxPinNumber>::uartNum
+	>::type;
+
+    static const char kUARTXOn  = 0x11;
+    static const char kUARTXOff = 0x13;
+
+#pragma mark HostUart
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostUart
+     *
+     * A USART with a PDC. Characters are sent and received one at a time, each
+     * taking a character time at the configured baud rate.
+     *
+     * The other end of the line is the tx_sink function (it gets every character
+     * sent) and receive() (which queues characters to arrive on RX). The CTS
+     * line is cts_asserted, and toggling it with setCTS() sets CTSIC.
+     *
+     * The UARTs are numbered like the pins' uartNum: USART0-3 are 0-3, and the
+     * UART is 4.
+     *
+     **************************************************/
+
+    struct HostUart {
+        // CSR and IMR bits, same positions as on the Sam USART
+        static constexpr uint32_t RXRDY   = 1u << 0;
+        static constexpr uint32_t TXRDY   = 1u << 1;
+        static constexpr uint32_t ENDRX   = 1u << 3;
+        static constexpr uint32_t ENDTX   = 1u << 4;
+        static constexpr uint32_t OVRE    = 1u << 5;
+        static constexpr uint32_t TXEMPTY = 1u << 9;
+        static constexpr uint32_t TXBUFE  = 1u << 11;
+        static constexpr uint32_t RXBUFF  = 1u << 12;
+        static constexpr uint32_t CTSIC   = 1u << 19;
+        static constexpr uint32_t CTS     = 1u << 23;
+
+        bool tx_enabled = false;
+        bool rx_enabled = false;
+        uint32_t baud = 115200;
+        uint8_t bits_per_char = 10; // start + 8 data + stop, plus parity and extra stop bits
+
+        uint32_t IMR = 0;
+        uint32_t flags = 0;     // the sticky bits: OVRE and CTSIC
+
+        int16_t rhr = -1;       // the receive holding register, or -1 if empty
+        bool thr_full = false;  // the transmit holding register
+        uint8_t thr = 0;
+        uint8_t tsr = 0;        // the shift register (the character on the wire)
+        bool shifting = false;  // a character is going out
+
+        bool cts_asserted = true; // active-low on the wire, so true reads as CTS == 0
+
+        HostPDC pdc;
+        const IRQn_Type irq;
+        HostSimEvent tx_event;
+        HostSimEvent rx_event;
+
+        // The other end of the line
+        std::function<void(uint8_t)> tx_sink;
+        std::deque<uint8_t> rx_pending;
+
+        HostUart(const IRQn_Type _irq) : irq{_irq} {
+            tx_event.action = [this]() { _txDone(); };
+            rx_event.action = [this]() { _rxArrived(); };
+            pdc.on_change = [this]() { _startTx(); };
+        };
+
+        uint64_t charTime() const {
+            return ((uint64_t)HostCommon::getPeripheralClockFreq() * bits_per_char) / baud;
+        };
+
+        uint32_t status() const {
+            uint32_t sr = flags;
+            if (rhr >= 0) { sr |= RXRDY; }
+            if (!thr_full) { sr |= TXRDY; }
+            if (!thr_full && !shifting) { sr |= TXEMPTY; }
+            if (pdc.endRx()) { sr |= ENDRX; }
+            if (pdc.rxBufferFull()) { sr |= RXBUFF; }
+            if (pdc.endTx()) { sr |= ENDTX; }
+            if (pdc.txBufferEmpty()) { sr |= TXBUFE; }
+            if (!cts_asserted) { sr |= CTS; }
+            return sr;
+        };
+
+        // Reading the status clears the sticky bits, like US_CSR
+        uint32_t readStatus() {
+            uint32_t sr = status();
+            flags = 0;
+            return sr;
+        };
+
+        // Interrupt enables take effect immediately, like the level-sensitive hardware
+        void enableInterrupts(const uint32_t mask) {
+            IMR |= mask;
+            checkInterrupts();
+        };
+        void disableInterrupts(const uint32_t mask) { IMR &= ~mask; };
+        void checkInterrupts() {
+            if (status() & IMR) {
+                NVIC_SetPendingIRQ(irq);
+            }
+        };
+
+        int16_t readByte() {
+            int16_t value = rhr;
+            rhr = -1;
+            return value;
+        };
+
+        void writeByte(const uint8_t value) {
+            thr = value;
+            thr_full = true;
+            _startTx();
+        };
+
+        // Test interface: characters arrive on RX one character time apart
+        void receive(const uint8_t *data, const uint32_t length) {
+            for (uint32_t i = 0; i < length; i++) {
+                rx_pending.push_back(data[i]);
+            }
+            if (!rx_event.scheduled) {
+                HostSim::scheduleIn(&rx_event, charTime());
+            }
+        };
+
+        // Test interface: drive the CTS line
+        void setCTS(const bool asserted) {
+            if (asserted != cts_asserted) {
+                cts_asserted = asserted;
+                flags |= CTSIC;
+                _startTx(); // in case it was held off
+                checkInterrupts();
+            }
+        };
+
+        void _startTx();
+        void _txDone();
+        void _rxArrived();
+    };
+
+    extern HostUart HostUARTs[5];
+
+    template<uint8_t uartPeripheralNumber>
+    struct DMA_Host_hardware<HostUart*, uartPeripheralNumber>
+    {
+        static HostUart * const uart() { return HostUARTs + uartPeripheralNumber; };
+        static HostPDC * const pdc() { return &uart()->pdc; };
+
+        typedef char* buffer_t ;
+
+        void startRxDoneInterrupts(const bool include_next = false) const {
+            uart()->enableInterrupts(include_next ? HostUart::RXBUFF : HostUart::ENDRX);
+        };
+        void stopRxDoneInterrupts(const bool include_next = false) const {
+            uart()->disableInterrupts(include_next ? HostUart::RXBUFF : HostUart::ENDRX);
+        };
+        void startTxDoneInterrupts(const bool include_next = true) const {
+            uart()->enableInterrupts(include_next ? HostUart::TXBUFE : HostUart::ENDTX);
+        };
+        void stopTxDoneInterrupts(const bool include_next = true) const {
+            uart()->disableInterrupts(include_next ? HostUart::TXBUFE : HostUart::ENDTX);
+        };
+
+        bool inRxBufferFullInterrupt() const
+        {
+            return uart()->IMR & uart()->status() & (HostUart::RXBUFF | HostUart::ENDRX);
+        }
+
+        bool inTxBufferEmptyInterrupt() const
+        {
+            return uart()->IMR & uart()->status() & (HostUart::TXBUFE | HostUart::ENDTX);
+        }
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<HostUart*, periph_num> : DMA_Host<HostUart*, periph_num> {
+        // we take the handler, but we don't actually handle interrupts for the peripheral
+        // so we ignore it
+        constexpr DMA(const Delegate<void(Interrupt::Type)> &handler) : DMA_Host<HostUart*, periph_num>{} {};
+    };
+
+    template<uint8_t uartPeripheralNumber>
+    struct _UARTHardware {
+        static_assert(uartPeripheralNumber < 5, "_UARTHardware<n>: n must be 0 through 4 (USART0-3 and UART)");
+
+        static HostUart * const uart() { return HostUARTs + uartPeripheralNumber; };
+        static constexpr uint32_t peripheralId = ID_USART0 + uartPeripheralNumber;
+        static constexpr IRQn_Type IRQ = (IRQn_Type)(USART0_IRQn + uartPeripheralNumber);
+
+        static constexpr const uint8_t uartPeripheralNum=uartPeripheralNumber;
+
+        Delegate<void(Interrupt::Type)> _uartInterruptHandler;
+
+        DMA<HostUart*, uartPeripheralNumber> dma_ {_uartInterruptHandler};
+        constexpr const DMA<HostUart*, uartPeripheralNumber> *dma() { return &dma_; };
+
+        typedef _UARTHardware<uartPeripheralNumber> this_type_t;
+
+        static Delegate<void()> _uartInterruptHandlerJumper;
+
+        _UARTHardware()
+        {
+            // We DON'T init here, to match the Sam version.
+            // Instead, we call init from UART<>::init().
+        };
+
+        void init() {
+            // init is called once after reset, so clean up after a reset
+            HostCommon::enablePeripheralClock(peripheralId);
+
+            // Reset and disable TX and RX
+            disable();
+            uart()->rhr = -1;
+            uart()->thr_full = false;
+
+            // Disable interrupts
+            uart()->disableInterrupts(0xffffffff);
+            dma()->reset();
+
+            _uartInterruptHandlerJumper = [&]() {
+                auto interruptCause = getInterruptCause();
+                if (_uartInterruptHandler) {
+                    _uartInterruptHandler(interruptCause);
+                }
+            };
+
+            setInterrupts(UARTInterrupt::PriorityLow);
+            setInterruptTxTransferDone(false);
+            setInterruptRxTransferDone(false);
+        };
+
+        void enable() {
+            uart()->tx_enabled = true;
+            uart()->rx_enabled = true;
+            uart()->_startTx();
+        };
+        void disable () {
+            uart()->tx_enabled = false;
+            uart()->rx_enabled = false;
+        };
+
+        void setOptions(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
+            disable();
+
+            uart()->baud = baud;
+            uart()->bits_per_char = 1 + ((options & UARTMode::As9Bit) ? 9 : 8) +
+                                    ((options & (UARTMode::EvenParity | UARTMode::OddParity)) ? 1 : 0) +
+                                    ((options & UARTMode::TwoStopBits) ? 2 : 1);
+
+            /* Enable receiver and transmitter */
+            enable();
+        };
+
+        void setInterrupts(const Interrupt::Type interrupts) {
+            if (interrupts != UARTInterrupt::Off) {
+
+                if (interrupts & UARTInterrupt::OnRxDone) {
+                    uart()->enableInterrupts(HostUart::RXRDY);
+                } else {
+                    uart()->disableInterrupts(HostUart::RXRDY);
+                }
+                if (interrupts & UARTInterrupt::OnTxDone) {
+                    uart()->enableInterrupts(HostUart::TXRDY);
+                } else {
+                    uart()->disableInterrupts(HostUart::TXRDY);
+                }
+
+                if (interrupts & UARTInterrupt::OnRxTransferDone) {
+                    dma()->startRxDoneInterrupts();
+                } else {
+                    dma()->stopRxDoneInterrupts();
+                }
+                if (interrupts & UARTInterrupt::OnTxTransferDone) {
+                    dma()->startTxDoneInterrupts();
+                } else {
+                    dma()->stopTxDoneInterrupts();
+                }
+
+
+                /* Set interrupt priority */
+                if (interrupts & UARTInterrupt::PriorityHighest) {
+                    NVIC_SetPriority(IRQ, 0);
+                }
+                else if (interrupts & UARTInterrupt::PriorityHigh) {
+                    NVIC_SetPriority(IRQ, 1);
+                }
+                else if (interrupts & UARTInterrupt::PriorityMedium) {
+                    NVIC_SetPriority(IRQ, 2);
+                }
+                else if (interrupts & UARTInterrupt::PriorityLow) {
+                    NVIC_SetPriority(IRQ, 3);
+                }
+                else if (interrupts & kInterruptPriorityLowest) {
+                    NVIC_SetPriority(IRQ, 4);
+                }
+
+                NVIC_EnableIRQ(IRQ);
+            } else {
+
+                NVIC_DisableIRQ(IRQ);
+            }
+        };
+
+        void setInterruptHandler(Delegate<void(Interrupt::Type)> &&handler) {
+            _uartInterruptHandler = std::move(handler);
+        }
+
+        void _setInterruptTxReady(bool value) {
+            if (value) {
+                uart()->enableInterrupts(HostUart::TXRDY);
+            } else {
+                uart()->disableInterrupts(HostUart::TXRDY);
+            }
+        };
+
+        void setInterruptRxReady(bool value) {
+            if (value) {
+                uart()->enableInterrupts(HostUart::RXRDY);
+            } else {
+                uart()->disableInterrupts(HostUart::RXRDY);
+            }
+        };
+
+        void _setInterruptCTSChange(bool value) {
+            if (value) {
+                uart()->enableInterrupts(HostUart::CTSIC);
+            } else {
+                uart()->disableInterrupts(HostUart::CTSIC);
+            }
+        };
+
+        void setInterruptTxTransferDone(bool value) {
+            if (value) {
+                dma()->startTxDoneInterrupts();
+            } else {
+                dma()->stopTxDoneInterrupts();
+            }
+        };
+
+        void setInterruptRxTransferDone(bool value) {
+            if (value) {
+                dma()->startRxDoneInterrupts();
+            } else {
+                dma()->stopRxDoneInterrupts();
+            }
+        };
+
+        Interrupt::Type getInterruptCause() {
+            Interrupt::Type status = UARTInterrupt::Unknown;
+
+            auto US_CSR_hold = uart()->readStatus();
+            auto US_IMR_hold = uart()->IMR;
+            if ((US_IMR_hold & HostUart::TXRDY) && (US_CSR_hold & HostUart::TXRDY))
+            {
+                status |= UARTInterrupt::OnTxReady;
+            }
+            if (dma()->inTxBufferEmptyInterrupt())
+            {
+                status |= UARTInterrupt::OnTxTransferDone;
+            }
+            if ((US_IMR_hold & HostUart::RXRDY) && (US_CSR_hold & HostUart::RXRDY))
+            {
+                status |= UARTInterrupt::OnRxReady;
+            }
+            if (dma()->inRxBufferFullInterrupt())
+            {
+                status |= UARTInterrupt::OnRxTransferDone;
+            }
+            if ((US_IMR_hold & HostUart::CTSIC) && (US_CSR_hold & HostUart::CTSIC))
+            {
+                status |= UARTInterrupt::OnCTSChanged;
+            }
+            return status;
+        }
+
+        int16_t readByte() {
+            return uart()->readByte();
+        };
+
+        // Returns 1 if the character was taken, -1 if the holding register is still full
+        int16_t writeByte(const char value) {
+            if (uart()->status() & HostUart::TXRDY) {
+                uart()->writeByte(value);
+                return 1;
+            }
+            return -1;
+        };
+
+        void flush() {
+            // Wait for the buffer to be empty
+            while (!(uart()->status() & HostUart::TXEMPTY)) {
+                HostSim::idle();
+            }
+            _tx_paused = false;
+        };
+
+        void flushRead() {
+            // kill any incoming transfers
+            dma()->flushRead();
+        };
+
+
+        // ***** Connection status check (simple)
+        bool isConnected() {
+            return (uart()->status() & HostUart::CTS) == 0; // active LOW
+        };
+
+
+        // ***** Handle Tranfers
+        bool startRXTransfer(char *buffer, const uint16_t length) {
+            const bool handleInterrupts = true;
+            const bool includeNext = true;
+            return dma()->startRXTransfer(buffer, length, handleInterrupts, includeNext);
+        };
+
+        bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            const bool handleInterrupts = true;
+            return dma()->startRXTransfer(buffer, length, buffer2, length2, handleInterrupts);
+        };
+
+        char* getRXTransferPosition() {
+            return dma()->getRXTransferPosition();
+        };
+
+        bool _tx_paused = false;
+        bool startTXTransfer(char *buffer, const uint16_t length) {
+            return dma()->startTXTransfer(buffer, length, true);
+        };
+
+        bool startTXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            return dma()->startTXTransfer(buffer, length, buffer2, length2, true);
+        };
+
+        char* getTXTransferPosition() {
+            if (_tx_paused) { return nullptr; }
+            return dma()->getTXTransferPosition();
+        };
+
+        void pauseTX() {
+            _tx_paused = true;
+            dma()->disableTx();
+        };
+
+        void resumeTX() {
+            _tx_paused = false;
+            dma()->enableTx();
+        };
+    };
+
+    template<pin_number rxPinNumber, pin_number txPinNumber>
+    using UARTGetHardware = typename std::conditional<
+        IsUARTRxPin<rxPinNumber>() &&
+        IsUARTTxPin<txPinNumber>() &&
+        rxPinNumber != txPinNumber &&
+        UARTTxPin<txPinNumber>::uartNum == UARTRxPin<rxPinNumber>::uartNum,
+        /* True:  */ _UARTHardware<UARTTxPin<txPinNumber>::uartNum>,
+        /* False: */ _UARTHardware<0xff> // static_assert below should prevent this
+    >::type;
+
+    template<pin_number rtsPinNumber, pin_number rxPinNumber>
+    constexpr const bool isRealAndCorrectRTSPin() {
+        return IsUARTRTSPin<rtsPinNumber>() && (UARTRTSPin<rtsPinNumber>::uartNum == UARTRxPin<rxPinNumber>::uartNum);
+    }
+    template<pin_number ctsPinNumber, pin_number rxPinNumber>
+    constexpr const bool isRealAndCorrectCTSPin() {
+        return IsUARTCTSPin<ctsPinNumber>() && (UARTCTSPin<ctsPinNumber>::uartNum == UARTRxPin<rxPinNumber>::uartNum);
+    }
+}
+
+#endif /* end of include guard: HOSTUART_H_ONCE */
@@ -0,0 +1,410 @@
+/*
+ Host_sim/HostUSB.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "HostUSB.h"
+
+namespace Motate {
+
+    USBDeviceHardware *USBDeviceHardware::hw = nullptr;
+
+    uint8_t USBControlBuffer[512];
+
+    const char16_t MOTATE_USBLanguageString[] = {0x0409}; // English
+    const char16_t *getUSBLanguageString(int8_t &length) {
+        length = 2;
+        return MOTATE_USBLanguageString;
+    }
+
+    uint16_t checkEndpointSizeHardwareLimits(const uint16_t inSize, const uint8_t endpointNumber, const USBEndpointType_t endpointType, const bool otherSpeed) {
+        uint16_t tempSize = inSize;
+
+        if (endpointNumber == 0) {
+            if (tempSize > 64)
+                tempSize = 64;
+        } else if (tempSize > 1024) {
+            tempSize = 1024;
+        }
+
+        return tempSize;
+    }
+
+    HostUsb HostUSB MOTATE_HOST_MODEL {USB_IRQn};
+
+    /*** Host side ***/
+
+    void HostUsb::connect(const bool _high_speed) {
+        high_speed = _high_speed;
+        vbus = true;
+        vbus_changed = true;
+        _raiseInterrupt(/*now*/ true);
+
+        // the host resets the bus once it sees the pull-up
+        address = 0;
+        reset_pending = true;
+        _raiseInterrupt(/*now*/ true);
+    }
+
+    void HostUsb::disconnect() {
+        HostSim::cancel(&packet_event);
+        for (uint8_t i = 0; i < endpoint_count; i++) {
+            HostUsbEndpoint &e = ep[i];
+            e.first = e.last = nullptr;
+            e.zlp_pending = false;
+        }
+        vbus = false;
+        vbus_changed = true;
+        _raiseInterrupt(/*now*/ true);
+    }
+
+    int32_t HostUsb::controlTransfer(const uint8_t requestType, const uint8_t request, const uint16_t value, const uint16_t index,
+                                     const uint16_t length, void *data) {
+        if (!attached) {
+            return -1;
+        }
+
+        setup[0] = requestType;
+        setup[1] = request;
+        setup[2] = value & 0xff;
+        setup[3] = value >> 8;
+        setup[4] = index & 0xff;
+        setup[5] = index >> 8;
+        setup[6] = length & 0xff;
+        setup[7] = length >> 8;
+
+        control_data = (char *)data;
+        control_length = length;
+        control_actual = 0;
+        control_stalled = false;
+        setup_pending = true;
+        _raiseInterrupt(/*now*/ true);
+
+        // if interrupts are off, let time pass until the device gets to it
+        while (setup_pending) {
+            HostSim::idle();
+        }
+
+        if (control_stalled) {
+            return -1;
+        }
+        return control_actual;
+    }
+
+    bool HostUsb::enumerate() {
+        uint8_t descriptor[255];
+
+        // GET_DESCRIPTOR(device), SET_ADDRESS
+        if (controlTransfer(0x80, Setup_t::kGetDescriptor, kDeviceDescriptor << 8, 0, 18, descriptor) != 18) {
+            return false;
+        }
+        if (controlTransfer(0x00, Setup_t::kSetAddress, 1, 0, 0, nullptr) != 0) {
+            return false;
+        }
+
+        // GET_DESCRIPTOR(configuration), the header for the total length first
+        if (controlTransfer(0x80, Setup_t::kGetDescriptor, kConfigurationDescriptor << 8, 0, 9, descriptor) != 9) {
+            return false;
+        }
+        const uint16_t total = std::min<uint16_t>(descriptor[2] | (descriptor[3] << 8), sizeof(descriptor));
+        if (controlTransfer(0x80, Setup_t::kGetDescriptor, kConfigurationDescriptor << 8, 0, total, descriptor) != total) {
+            return false;
+        }
+
+        return controlTransfer(0x00, Setup_t::kSetConfiguration, 1, 0, 0, nullptr) == 0;
+    }
+
+    void HostUsb::submit(const uint8_t endpoint, HostUsbTransfer *transfer) {
+        HostUsbEndpoint &e = ep[endpoint];
+        transfer->reset();
+        if (e.last) {
+            e.last->next = transfer;
+        } else {
+            e.first = transfer;
+        }
+        e.last = transfer;
+
+        _startPacket();
+    }
+
+    /*** Device side ***/
+
+    void HostUsb::load(const uint8_t endpoint, USB_DMA_Descriptor *descriptor) {
+        HostUsbEndpoint &e = ep[endpoint];
+
+        e.loaded = descriptor;
+        e.command = descriptor->command;
+        e.address = descriptor->buffer_address;
+        e.length = descriptor->buffer_length;
+        e.left = e.length;
+        e.end_transfer_enable = descriptor->end_transfer_enable;
+        e.end_buffer_enable = descriptor->end_buffer_enable;
+
+        // data that was waiting in the bank goes first
+        if (e.bank_length) {
+            char data[sizeof(e.bank)];
+            const uint16_t length = e.bank_length;
+            memcpy(data, e.bank, length);
+            e.bank_length = 0;
+            _dmaWrite(endpoint, data, length, e.bank_short);
+        }
+
+        _startPacket();
+    }
+
+    void HostUsb::stop(const uint8_t endpoint) {
+        HostUsbEndpoint &e = ep[endpoint];
+        e.loaded = nullptr;
+        e.done_count = 0;
+        e.stopped = nullptr;
+    }
+
+    void HostUsb::resetEndpoints() {
+        for (uint8_t i = 0; i < endpoint_count; i++) {
+            HostUsbEndpoint &e = ep[i];
+            e.enabled = false;
+            e.loaded = nullptr;
+            e.done_count = 0;
+            e.stopped = nullptr;
+            e.bank_length = 0;
+        }
+    }
+
+    /*** Internal ***/
+
+    // Bus time for a packet: the data plus the token, handshake, CRCs, gaps, and the host controller's
+    // scheduling, sized so a full-speed bus tops out at 19 64-byte bulk packets per 1ms frame, and a
+    // high-speed one at 13 512-byte packets per 125us microframe -- the usual bulk ceilings.
+    uint64_t HostUsb::_packetCycles(const uint16_t bytes) const {
+        const uint64_t bit_rate = high_speed ? 480000000 : 12000000;
+        const uint64_t overhead = high_speed ? 65 : 15;
+        return std::max<uint64_t>(((bytes + overhead) * 8 * SystemCoreClock) / bit_rate, 1);
+    }
+
+    bool HostUsb::_ready(const uint8_t endpoint) const {
+        const HostUsbEndpoint &e = ep[endpoint];
+        if (!e.enabled || !e.first) {
+            return false;
+        }
+        if (e.in) {
+            return e.loaded != nullptr;
+        }
+        // an OUT packet can go to the DMA, or wait in an empty bank
+        return (e.loaded != nullptr) || (e.bank_length == 0);
+    }
+
+    void HostUsb::_startPacket() {
+        // (the DMA calls back in here as it loads descriptors while a packet is being made or taken apart)
+        if (packet_event.scheduled || busy || !attached) {
+            return;
+        }
+        busy = true;
+
+        for (uint8_t i = 0; i < endpoint_count - 1; i++) {
+            const uint8_t endpoint = next_ep;
+            next_ep = (next_ep % (endpoint_count - 1)) + 1;
+
+            if (!_ready(endpoint)) {
+                continue;
+            }
+
+            HostUsbEndpoint &e = ep[endpoint];
+            HostUsbTransfer *transfer = e.first;
+
+            packet_ep = endpoint;
+            if (e.in) {
+                // the DMA fills the bank before the host asks for it
+                bool valid;
+                packet_length = _dmaRead(endpoint, packet, e.size, valid);
+            } else {
+                packet_length = std::min<uint32_t>(e.size, transfer->length - transfer->actual);
+                memcpy(packet, transfer->buffer + transfer->actual, packet_length);
+            }
+
+            HostSim::scheduleIn(&packet_event, _packetCycles(packet_length));
+            break;
+        }
+
+        busy = false;
+    }
+
+    void HostUsb::_finishPacket() {
+        HostUsbEndpoint &e = ep[packet_ep];
+        HostUsbTransfer *transfer = e.first;
+        const bool short_packet = packet_length < e.size;
+
+        busy = true;
+        if (transfer) {
+            if (e.in) {
+                const uint16_t length = std::min<uint32_t>(packet_length, transfer->length - transfer->actual);
+                memcpy(transfer->buffer + transfer->actual, packet, length);
+                transfer->actual += length;
+                bytes_in += packet_length;
+
+                if (short_packet || (transfer->actual == transfer->length)) {
+                    transfer->done = true;
+                }
+            } else {
+                _dmaWrite(packet_ep, packet, packet_length, short_packet);
+                transfer->actual += packet_length;
+                bytes_out += packet_length;
+
+                if (transfer->actual == transfer->length) {
+                    if (e.zlp_pending || short_packet || !transfer->zero_length_packet) {
+                        e.zlp_pending = false;
+                        transfer->done = true;
+                    } else {
+                        // the next packet is a ZLP
+                        e.zlp_pending = true;
+                    }
+                }
+            }
+
+            if (transfer->done) {
+                e.first = transfer->next;
+                if (!e.first) {
+                    e.last = nullptr;
+                }
+            }
+        }
+        busy = false;
+
+        _startPacket();
+    }
+
+    // The DMA finished the loaded descriptor: note it for the interrupt, and follow the link (or stop).
+    void HostUsb::_descriptorDone(const uint8_t endpoint) {
+        HostUsbEndpoint &e = ep[endpoint];
+
+        if (e.done_count < HostUsbEndpoint::done_size) {
+            e.done[e.done_count++] = {e.loaded, (uint16_t)(e.length - e.left)};
+        }
+
+        USB_DMA_Descriptor *finished = e.loaded;
+        if (e.command == USB_DMA_Descriptor::run_and_link) {
+            load(endpoint, finished->next_descriptor);
+        } else {
+            e.loaded = nullptr;
+            e.stopped = finished;
+        }
+
+        _raiseInterrupt();
+    }
+
+    void HostUsb::_dmaWrite(const uint8_t endpoint, const char *data, uint16_t length, const bool short_packet) {
+        HostUsbEndpoint &e = ep[endpoint];
+        const bool zlp = (length == 0);
+        bool into_current = false; // did any of this packet go into the buffer that's loaded now?
+
+        while (length > 0) {
+            if (!e.loaded) {
+                // no buffer to take the rest: it waits in the bank
+                memcpy(e.bank, data, length);
+                e.bank_length = length;
+                e.bank_short = short_packet;
+                return;
+            }
+
+            const uint16_t take = std::min(length, e.left);
+            memcpy(e.address, data, take);
+            e.address += take;
+            e.left -= take;
+            data += take;
+            length -= take;
+            into_current = true;
+
+            if (e.left == 0) {
+                _descriptorDone(endpoint);
+                into_current = false;
+            }
+        }
+
+        // a short packet (or a ZLP) ends the buffer it went into
+        if (short_packet && e.loaded && e.end_transfer_enable && (into_current || zlp)) {
+            _descriptorDone(endpoint);
+        }
+    }
+
+    uint16_t HostUsb::_dmaRead(const uint8_t endpoint, char *data, const uint16_t max, bool &valid) {
+        HostUsbEndpoint &e = ep[endpoint];
+        uint16_t length = 0;
+        valid = false;
+
+        while (e.loaded) {
+            const uint16_t take = std::min<uint16_t>(max - length, e.left);
+            memcpy(data + length, e.address, take);
+            e.address += take;
+            e.left -= take;
+            length += take;
+            valid = true;
+
+            if (e.left == 0) {
+                // the packet goes at the end of the buffer, or carries on into the next one
+                const bool validate = e.end_buffer_enable;
+                _descriptorDone(endpoint);
+                if (validate) {
+                    break;
+                }
+                continue;
+            }
+            if (length == max) {
+                break;
+            }
+        }
+
+        return length;
+    }
+
+    void HostUsb::_raiseInterrupt(const bool now) {
+        if (now) {
+            NVIC_SetPendingIRQ(irq);
+            return;
+        }
+        dma_events = true;
+        if (!irq_event.scheduled) {
+            HostSim::scheduleIn(&irq_event, interrupt_latency);
+        }
+    }
+
+    extern "C"
+    void USB_Handler(void) {
+        USBDeviceHardware *hw = USBDeviceHardware::hw;
+        if (!hw) {
+            return;
+        }
+
+        // The hardware's interrupt stays asserted until everything is handled, so go around until it is:
+        // connect and disconnect, Control (ep == 0), endpoints (including DMA), then reset.
+        while (hw->checkAndHandleVbusChange() ||
+               hw->checkAndHandleControl() ||
+               hw->checkAndHandleEndpoint() ||
+               hw->checkAndHandleReset()) {
+            ;
+        }
+    }
+
+}; // namespace Motate
@@ -0,0 +1,737 @@
+/*
+ Host_sim/HostUSB.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// This goes outside the guard! We need to ensure this happens first.
+#include "MotateUSB.h"
+
+#ifndef HOSTUSB_H_ONCE
+#define HOSTUSB_H_ONCE
+
+#include <functional> // for std::function<>
+#include <cstring> // for memcpy
+#include <algorithm> // for std::min
+
+#include "HostCommon.h"
+#include "MotateUSBHelpers.h"
+
+namespace Motate {
+    /*** ENDPOINT CONFIGURATION ***/
+
+    // These are laid out like the USBHS DEVEPTCFG register, which is what the model decodes.
+    enum USBEndpointBufferSettingsFlags_t {
+        // null endpoint is all zeros
+        kEndpointBufferNull            = 0,
+
+        // endpoint direction
+        kEndpointBufferOutputFromHost  = 0 << 8,
+        kEndpointBufferInputToHost     = 1 << 8,
+
+        // This mask is not part of the public interface:
+        kEndpointBufferDirectionMask   = 1 << 8,
+
+        // buffer sizes
+        kEnpointBufferSizeUpTo8        = 0 << 4,
+        kEnpointBufferSizeUpTo16       = 1 << 4,
+        kEnpointBufferSizeUpTo32       = 2 << 4,
+        kEnpointBufferSizeUpTo64       = 3 << 4,
+        kEnpointBufferSizeUpTo128      = 4 << 4,
+        kEnpointBufferSizeUpTo256      = 5 << 4,
+        kEnpointBufferSizeUpTo512      = 6 << 4,
+        kEnpointBufferSizeUpTo1024     = 7 << 4,
+
+        // This mask is not part of the public interface:
+        kEnpointBufferSizeMask         = 7 << 4,
+
+        // buffer "blocks" -- 2 == "ping pong"
+        // Note that there must be one, or this is a null endpoint.
+        kEndpointBufferBlocks1         = 0 << 2,
+        kEndpointBufferBlocksUpTo2     = 1 << 2,
+        kEndpointBufferBlocksUpTo3     = 2 << 2,
+
+        // This mask is not part of the public interface:
+        kEndpointBufferBlocksMask      = 3 << 2,
+
+        // endpoint types (mildly redundant from the config)
+        kEndpointBufferTypeControl     = 0 << 11,
+        kEndpointBufferTypeIsochronous = 1 << 11,
+        kEndpointBufferTypeBulk        = 2 << 11,
+        kEndpointBufferTypeInterrupt   = 3 << 11,
+
+        // This mask is not part of the public interface:
+        kEndpointBufferTypeMask        = 3 << 11
+    };
+
+    // Convert from number to EndpointBufferSettings_t
+    // This should optimize out.
+    static const EndpointBufferSettings_t getBufferSizeFlags(const uint16_t size) {
+        if (size > 512) {
+            return kEnpointBufferSizeUpTo1024;
+        } else if (size > 256) {
+            return kEnpointBufferSizeUpTo512;
+        } else if (size > 128) {
+            return kEnpointBufferSizeUpTo256;
+        } else if (size > 64) {
+            return kEnpointBufferSizeUpTo128;
+        } else if (size > 32) {
+            return kEnpointBufferSizeUpTo64;
+        } else if (size > 16) {
+            return kEnpointBufferSizeUpTo32;
+        } else if (size > 8) {
+            return kEnpointBufferSizeUpTo16;
+        } else {
+            return kEnpointBufferSizeUpTo8;
+        }
+        return kEndpointBufferNull;
+    };
+
+    /*** STRINGS ***/
+
+    const char16_t *getUSBVendorString(int8_t &length) ATTR_WEAK;
+    const char16_t *getUSBProductString(int8_t &length) ATTR_WEAK;
+    const char16_t *getUSBSerialNumberString(int8_t &length) ATTR_WEAK;
+
+    // We break the rules here, sortof, by providing a macro shortcut that gets used in userland.
+    // I apologize, but this also opens it up to later optimization without changing user code.
+#define MOTATE_SET_USB_VENDOR_STRING(...)\
+    const char16_t MOTATE_USBVendorString[] = __VA_ARGS__;\
+    const char16_t *Motate::getUSBVendorString(int8_t &length) {\
+        length = sizeof(MOTATE_USBVendorString);\
+        return MOTATE_USBVendorString;\
+    }
+
+#define MOTATE_SET_USB_PRODUCT_STRING(...)\
+    const char16_t MOTATE_USBProductString[] = __VA_ARGS__;\
+    const char16_t *Motate::getUSBProductString(int8_t &length) {\
+        length = sizeof(MOTATE_USBProductString);\
+        return MOTATE_USBProductString;\
+    }
+
+#define MOTATE_SET_USB_SERIAL_NUMBER_STRING(...)\
+    const char16_t MOTATE_USBSerialNumberString[] = __VA_ARGS__;\
+    const char16_t *Motate::getUSBSerialNumberString(int8_t &length) {\
+        length = sizeof(MOTATE_USBSerialNumberString);\
+        return MOTATE_USBSerialNumberString;\
+    }
+
+    // This needs to be provided in the hardware file
+    const char16_t *getUSBLanguageString(int8_t &length);
+
+
+    /*** USBDeviceHardware ***/
+
+    // The same as the Sam parts, so the code using it reads the same.
+    struct alignas(16) USB_DMA_Descriptor {
+        enum _commands {  // This enum declaration takes up no space, but is in here for name scoping.
+            stop_now        = 0,  // These match those of the SAM3X8n datasheet, but downcased.
+            run_and_stop    = 1,
+            load_next_desc  = 2,
+            run_and_link    = 3
+        };
+
+        USB_DMA_Descriptor *next_descriptor;    // The address of the next Descriptor
+        char *buffer_address;                    // The address of the buffer to read/write
+        struct {                                // controlData is a bit field with the settings of the descriptor
+            _commands command : 2;
+
+            bool end_transfer_enable : 1;                   // END_TR_EN
+            bool end_buffer_enable : 1;                     // END_B_EN
+            bool end_transfer_interrupt_enable : 1;         // END_TR_IT
+            bool end_buffer_interrupt_enable : 1;           // END_BUFFIT
+            bool descriptor_loaded_interrupt_enable : 1;    // DESC_LD_IT
+            bool bust_lock_enable : 1;                      // BURST_LCK
+
+            uint8_t _unused_1 : 8;
+
+            uint16_t buffer_length : 16;                    // BUFF_LENGTH
+        };
+
+        void setBuffer(char* data, uint16_t len) {
+            buffer_address = data;
+            buffer_length = len;
+        }
+    };
+
+
+#pragma mark HostUsb
+    /**************************************************
+     *
+     * SIMULATED HARDWARE: HostUsb
+     *
+     * A USB device controller and the bus it's plugged into, with the host PC on the
+     * other end. The device side is what USBDeviceHardware (below) drives: endpoints
+     * with a DMA channel each that walks USB_DMA_Descriptors the way the USBHS one does
+     * -- loading next_descriptor when a buffer is done if the command says to link,
+     * closing a buffer early on a short OUT packet if end_transfer_enable is set, and
+     * validating an IN packet at the end of a buffer if end_buffer_enable is set.
+     *
+     * The host side is what a test calls. connect() and enumerate() do what a PC does
+     * when a device is plugged in, controlTransfer() sends any other request, and
+     * submit() queues bulk transfers, like a driver with several reads or writes
+     * outstanding.
+     *
+     * Bulk packets take bus time: one at a time, round-robin between the endpoints
+     * that have a transfer queued and a device that's ready for it. An endpoint whose
+     * DMA isn't running is NAKed and skipped, so gaps where the device isn't keeping up
+     * show up as lost throughput. The device's interrupt is raised interrupt_latency
+     * after the DMA reports something, standing in for the time to get into and
+     * through the handler. Control transfers are handled a whole stage at a time, and
+     * don't take bus time.
+     *
+     **************************************************/
+
+    // A bulk transfer the host has asked for. Owned by the caller, and must stay put until it's done.
+    struct HostUsbTransfer {
+        char *buffer = nullptr;
+        uint32_t length = 0;               // to send (OUT), or the most to receive (IN)
+        bool zero_length_packet = false;   // OUT: end a transfer that's a whole number of packets with a ZLP
+
+        uint32_t actual = 0;               // bytes moved so far
+        volatile bool done = false;        // IN: done at a short packet, or when length has arrived
+
+        HostUsbTransfer *next = nullptr;
+
+        HostUsbTransfer() {};
+        HostUsbTransfer(char *_buffer, const uint32_t _length) : buffer{_buffer}, length{_length} {};
+
+        void reset() { actual = 0; done = false; next = nullptr; };
+    };
+
+    struct HostUsbEndpoint {
+        // configuration, from USBDeviceHardware::_init_endpoint()
+        bool enabled = false;
+        bool in = false;
+        uint16_t size = 0;
+
+        // the device's DMA channel -- loaded is nullptr when it's stopped
+        USB_DMA_Descriptor *loaded = nullptr;
+        USB_DMA_Descriptor::_commands command = USB_DMA_Descriptor::stop_now; // as it was when loaded
+        char *address = nullptr;
+        uint16_t length = 0;
+        uint16_t left = 0;
+        bool end_transfer_enable = false;
+        bool end_buffer_enable = false;
+
+        // what the DMA finished, for the interrupt to report
+        struct Done {
+            USB_DMA_Descriptor *descriptor;
+            uint16_t length;
+        };
+        static constexpr uint8_t done_size = 32;
+        Done done[done_size];
+        uint8_t done_count = 0;
+        USB_DMA_Descriptor *stopped = nullptr; // the descriptor the DMA stopped after
+
+        // OUT data that came in without a DMA buffer to take it, like a full bank
+        char bank[1024];
+        uint16_t bank_length = 0;
+        bool bank_short = false;
+
+        // the host's transfers, oldest first
+        HostUsbTransfer *first = nullptr;
+        HostUsbTransfer *last = nullptr;
+        bool zlp_pending = false;
+    };
+
+    struct HostUsb {
+        static constexpr uint8_t endpoint_count = 10;
+
+        bool vbus = false;
+        bool attached = false;      // the pull-up is on
+        bool high_speed = true;
+        uint8_t address = 0;
+
+        HostUsbEndpoint ep[endpoint_count];
+
+        // The pending setup packet, and its data stage
+        uint8_t setup[8];
+        bool setup_pending = false;
+        bool control_stalled = false;
+        char *control_data = nullptr;  // IN: where to put it, OUT: what to send
+        uint16_t control_length = 0;   // wLength
+        uint16_t control_actual = 0;
+
+        // Event flags, for the interrupt
+        bool vbus_changed = false;
+        bool reset_pending = false;
+        bool dma_events = false;
+
+        uint64_t interrupt_latency = 0;
+        const IRQn_Type irq;
+
+        // The packet on the bus
+        HostSimEvent packet_event;
+        HostSimEvent irq_event;
+        char packet[1024];
+        uint16_t packet_length = 0;
+        uint8_t packet_ep = 0;
+        uint8_t next_ep = 1;
+        bool busy = false;
+
+        uint64_t bytes_out = 0;
+        uint64_t bytes_in = 0;
+
+        HostUsb(const IRQn_Type _irq) : irq{_irq} {
+            interrupt_latency = HostSim::cyclesFromMicroseconds(2);
+            packet_event.action = [this]() { _finishPacket(); };
+            irq_event.action = [this]() { NVIC_SetPendingIRQ(irq); };
+        };
+
+        /*** Host side ***/
+
+        // Plug the device in (VBUS on, then a bus reset at the chosen speed), or pull it out.
+        void connect(const bool _high_speed = true);
+        void disconnect();
+
+        // Send a request on the control endpoint. Returns the length of the data stage, or -1 for a STALL.
+        int32_t controlTransfer(const uint8_t requestType, const uint8_t request, const uint16_t value, const uint16_t index,
+                                const uint16_t length, void *data);
+
+        // The usual sequence from a host: the device descriptor, SET_ADDRESS, the configuration descriptor,
+        // then SET_CONFIGURATION 1. Returns false if any of it fails.
+        bool enumerate();
+
+        // Queue a bulk transfer on an endpoint -- the direction is the endpoint's.
+        void submit(const uint8_t endpoint, HostUsbTransfer *transfer);
+
+        /*** Device side ***/
+
+        void configureEndpoint(const uint8_t endpoint, const bool in, const uint16_t size) {
+            HostUsbEndpoint &e = ep[endpoint];
+            e.enabled = true;
+            e.in = in;
+            e.size = size;
+        };
+
+        // Start the DMA at descriptor, which it reads as the hardware would.
+        void load(const uint8_t endpoint, USB_DMA_Descriptor *descriptor);
+        void stop(const uint8_t endpoint);
+        void resetEndpoints();
+
+        /*** Internal ***/
+
+        uint64_t _packetCycles(const uint16_t bytes) const;
+        bool _ready(const uint8_t endpoint) const;
+        void _startPacket();
+        void _finishPacket();
+        void _descriptorDone(const uint8_t endpoint);
+        void _dmaWrite(const uint8_t endpoint, const char *data, uint16_t length, const bool short_packet);
+        uint16_t _dmaRead(const uint8_t endpoint, char *data, const uint16_t max, bool &valid);
+        void _raiseInterrupt(const bool now = false);
+    };
+
+    extern HostUsb HostUSB;
+
+
+    // USBDeviceHardware talks to the (simulated) hardware, and marshalls data to/from the interfaces.
+    struct USBDeviceHardware
+    {
+        uint32_t _inited = 0;
+        uint32_t config_number = 0;
+        bool _address_available = false;
+
+        enum USBSetupState_t {
+            SETUP                  = 0, // Waiting for a SETUP packet
+            DATA_OUT               = 1, // Waiting for a OUT data packet
+            DATA_IN                = 2, // Waiting for a IN data packet
+            HANDSHAKE_WAIT_IN_ZLP  = 3, // Waiting for a IN ZLP packet
+            HANDSHAKE_WAIT_OUT_ZLP = 4, // Waiting for a OUT ZLP packet
+            STALL_REQ              = 5, // STALL enabled on IN & OUT packet
+        };
+
+        USBSetupState_t setup_state = SETUP;
+        USBDevice_t * const proxy;
+        static USBDeviceHardware *hw;
+
+        static const uint8_t master_control_endpoint = 0;
+
+        // The model keeps count for every descriptor of a ring, not just the one the DMA stopped on.
+        static const bool exact_ring_lengths = true;
+
+        // Init
+        USBDeviceHardware(USBDevice_t * const _proxy) : proxy{_proxy}
+        {
+            hw = this;
+            _init();
+        };
+
+        // ensure we can't copy or move a USBDeviceHardware
+        USBDeviceHardware(const USBDeviceHardware&) = delete;
+        USBDeviceHardware(USBDeviceHardware&&) = delete;
+        USBDeviceHardware() = delete;
+
+        // hold the buffer pointers to setup responses.
+        // we hold two pointers and lengths, they are to be sent in order
+        // this allows us to store the header and the content seperately
+        struct SetupBuffer_t {
+            char *buf_addr_0;
+            uint16_t length_0;
+            char *buf_addr_1;
+            uint16_t length_1;
+        } _setup_buffer;
+
+        static constexpr uint32_t _get_endpoint_max_nbr() { return (9); };
+
+        // callback for after a control read is done
+        std::function<void(void)> _control_read_completed_callback;
+
+        void _init() {
+            if (_inited) { return; }
+            _inited = 1;
+
+            HostCommon::enablePeripheralClock(ID_USB);
+            NVIC_EnableIRQ(USB_IRQn);
+        };
+
+        void _attach() { HostUSB.attached = true; };
+        void _detach() { HostUSB.attached = false; };
+
+        void _init_endpoint(uint32_t endpoint, const uint32_t configuration) {
+            if (configuration == kEndpointBufferNull) {
+                return;
+            }
+            const uint16_t size = 8 << ((configuration & kEnpointBufferSizeMask) >> 4);
+            HostUSB.configureEndpoint(endpoint, (configuration & kEndpointBufferDirectionMask) == kEndpointBufferInputToHost, size);
+        };
+
+        void reset() {
+            // a reset ends any transfers
+            for (uint8_t ep = 1; ep < 10; ep++) {
+                if (_dma_used_by_endpoint & (1 << ep)) {
+                    _dma_used_by_endpoint &= ~(1 << ep);
+                    proxy->handleTransferDone(ep);
+                }
+            }
+            HostUSB.resetEndpoints();
+            config_number = 0;
+
+            _init_endpoint(0, proxy->getEndpointConfig(0, /* otherSpeed = */ false));
+        };
+
+        void initSetup() {
+            setup_state = SETUP;
+            _setup_buffer = {nullptr, 0, nullptr, 0};
+            _control_read_completed_callback = nullptr;
+        };
+
+        void setAddressAvailable() { _address_available = true; };
+
+        uint16_t get_byte_count(const uint8_t endpoint) {
+            if (endpoint == 0) {
+                return 8; // only asked while a setup packet is pending
+            }
+            return 0;
+        };
+
+        void readSetupPacket(Setup_t &setup) {
+            setup.set((char *)HostUSB.setup);
+        };
+
+        void readFromControlThen(char *buffer, uint16_t length, std::function<void(void)> &&callback) {
+            _control_read_completed_callback = std::move(callback);
+            _setup_buffer = {buffer, length, nullptr, 0};
+            setup_state = DATA_OUT;
+        }
+
+        void readFromControlThen(char *buffer, uint16_t length, const std::function<void(void)> &callback) {
+            _control_read_completed_callback = callback;
+            _setup_buffer = {buffer, length, nullptr, 0};
+            setup_state = DATA_OUT;
+        }
+
+        // This function sets the _setup_buffer to write to the control channel as IN packets come in.
+        void writeToControl(char* buffer_0, uint16_t length_0, char* buffer_1 = nullptr, uint16_t length_1 = 0) {
+            _setup_buffer = {buffer_0, length_0, buffer_1, length_1};
+        };
+
+        virtual bool isConnected() { return HostUSB.vbus; };
+
+        bool checkAndHandleVbusChange() {
+            if (!HostUSB.vbus_changed) { return false; }
+            HostUSB.vbus_changed = false;
+
+            if (!isConnected()) {
+                // catch the case where we are disconnected and reconnected, and we had open tranfers
+                for (uint8_t ep = 1; ep < 10; ep++) {
+                    if (_dma_used_by_endpoint & (1 << ep)) {
+                        _dma_used_by_endpoint &= ~(1 << ep);
+                        HostUSB.stop(ep);
+                        proxy->handleTransferDone(ep);
+                    }
+                }
+                _detach();
+            } else {
+                _attach();
+            }
+
+            proxy->handleConnectionStateChanged();
+
+            return true;
+        };
+
+        bool checkAndHandleReset() {
+            if (!HostUSB.reset_pending) { return false; }
+            HostUSB.reset_pending = false;
+            reset();
+            initSetup();
+
+            return true;
+        };
+
+        bool checkAndHandleControl() {
+            if (!HostUSB.setup_pending) { return false; }
+
+            setup_state = SETUP;
+            _setup_buffer = {nullptr, 0, nullptr, 0};
+
+            if (false == proxy->handleSetupPacket()) {
+                HostUSB.control_stalled = true;
+            } else if (setup_state == DATA_OUT) {
+                const uint16_t length = std::min(_setup_buffer.length_0, HostUSB.control_length);
+                memcpy(_setup_buffer.buf_addr_0, HostUSB.control_data, length);
+                HostUSB.control_actual = length;
+                setup_state = SETUP;
+                if (_control_read_completed_callback) {
+                    _control_read_completed_callback();
+                }
+            } else if (HostUSB.setup[0] & Setup_t::kRequestDeviceToHost) {
+                // the data stage, truncated at wLength like _handleControlTX() does
+                uint16_t left = HostUSB.control_length;
+                const uint16_t length_0 = std::min(_setup_buffer.length_0, left);
+                memcpy(HostUSB.control_data, _setup_buffer.buf_addr_0, length_0);
+                left -= length_0;
+                const uint16_t length_1 = std::min(_setup_buffer.length_1, left);
+                memcpy(HostUSB.control_data + length_0, _setup_buffer.buf_addr_1, length_1);
+                HostUSB.control_actual = length_0 + length_1;
+            }
+
+            if (_address_available) {
+                _address_available = false;
+                HostUSB.address = HostUSB.setup[2];
+            }
+
+            HostUSB.setup_pending = false;
+            return true;
+        };
+
+        uint32_t _dma_used_by_endpoint = 0;
+
+        // The descriptors handed to transfer(), per endpoint, and how far along the DMA is in them.
+        struct _DescriptorChain {
+            USB_DMA_Descriptor *first;
+            uint8_t count;
+            uint8_t done;   // the next descriptor to be reported to handleDescriptorDone()
+            bool ring;      // set up with setupRing()
+            bool stream;    // ... as one run of bytes
+        };
+        _DescriptorChain _chains[10] {};
+
+        bool checkAndHandleEndpoint() {
+            if (!HostUSB.dma_events) { return false; }
+            HostUSB.dma_events = false;
+
+            for (uint8_t ep = 1; ep <= _get_endpoint_max_nbr(); ep++) {
+                HostUsbEndpoint &e = HostUSB.ep[ep];
+                auto &chain = _chains[ep];
+
+                // A ring stops after the last descriptor queued to it (see queueInRing()). If another was
+                // queued after the DMA had already loaded that one, carry on with it. This is settled before
+                // the callbacks, which may well queue the same descriptor again.
+                bool transfer_done = false;
+                if (e.stopped) {
+                    USB_DMA_Descriptor *stopped = e.stopped;
+                    e.stopped = nullptr;
+
+                    if (chain.ring && (stopped->command == USB_DMA_Descriptor::run_and_link)) {
+                        _startChain(ep, (stopped - chain.first + 1) % chain.count);
+                    } else {
+                        _dma_used_by_endpoint &= ~(1 << ep);
+                        transfer_done = true;
+                    }
+                }
+
+                // report each descriptor as it's done (the callbacks may queue more)
+                for (uint8_t i = 0; i < e.done_count; i++) {
+                    const uint8_t index = e.done[i].descriptor - chain.first;
+                    proxy->handleDescriptorDone(ep, index, e.done[i].length);
+                }
+                e.done_count = 0;
+
+                if (transfer_done) {
+                    proxy->handleTransferDone(ep);
+                }
+            }
+
+            return true;
+        };
+
+        bool transfer(const uint8_t ep, USB_DMA_Descriptor& desc) {
+            return transfer(ep, &desc, 1);
+        };
+
+        // Transfer through count descriptors, linked with next_descriptor so the DMA loads each one as soon
+        // as the previous buffer is done. proxy->handleDescriptorDone(ep, index, length) is called as each is
+        // finished, and proxy->handleTransferDone(ep) after the last one. See the Sam version.
+        bool transfer(const uint8_t ep, USB_DMA_Descriptor *descriptors, const uint8_t count) {
+            if (!config_number || (count == 0)) {
+                return false;
+            }
+
+            for (uint8_t i = 0; i < count; i++) {
+                auto &desc = descriptors[i];
+                const bool last = (i == count - 1);
+
+                if (!last) {
+                    desc.command = USB_DMA_Descriptor::run_and_link;
+                    desc.next_descriptor = &descriptors[i + 1];
+                } else {
+                    desc.command = USB_DMA_Descriptor::run_and_stop;
+                    desc.next_descriptor = nullptr;
+                }
+
+                // In the middle of a chain we keep filling the packet from the next buffer.
+                desc.end_buffer_enable = HostUSB.ep[ep].in && last;
+                desc.end_transfer_enable = false;
+            }
+
+            _chains[ep] = {descriptors, count, 0, false, false};
+            _startChain(ep, 0);
+
+            return true;
+        };
+
+        // Set up count descriptors as a ring, to be handed to the DMA in order with queueInRing().
+        // See the Sam version.
+        bool setupRing(const uint8_t ep, USB_DMA_Descriptor *descriptors, const uint8_t count, const bool stream = false) {
+            if (!config_number || (count == 0)) {
+                return false;
+            }
+
+            stopTransfer(ep);
+
+            for (uint8_t i = 0; i < count; i++) {
+                auto &desc = descriptors[i];
+
+                // nothing is queued yet, so every descriptor is the end of the line
+                desc.command = USB_DMA_Descriptor::run_and_stop;
+                desc.next_descriptor = &descriptors[(i + 1) % count];
+
+                // each IN buffer is its own transfer, and a short packet ends an OUT one early -- unless
+                // it's a stream, where only the end of the line sends a short packet (see queueInRing())
+                desc.end_buffer_enable = HostUSB.ep[ep].in;
+                desc.end_transfer_enable = !HostUSB.ep[ep].in && !stream;
+            }
+
+            _chains[ep] = {descriptors, count, 0, true, stream};
+
+            return true;
+        };
+
+        // Hand descriptor index of a ring to the DMA, after those already queued.
+        bool queueInRing(const uint8_t ep, const uint8_t index) {
+            auto &chain = _chains[ep];
+            if (!chain.ring || (index >= chain.count)) {
+                return false;
+            }
+
+            HostCommon::InterruptDisabler disabler;
+
+            // this one is the new end of the line ...
+            const bool stream_in = chain.stream && HostUSB.ep[ep].in;
+            chain.first[index].command = USB_DMA_Descriptor::run_and_stop;
+            if (stream_in) {
+                // (the end of a stream goes out, short or not)
+                chain.first[index].end_buffer_enable = true;
+            }
+            if (_dma_used_by_endpoint & (1 << ep)) {
+                // ... and the one before it links to it. If the DMA has already loaded that one it'll stop
+                // there anyway, and checkAndHandleEndpoint() picks this one up.
+                auto &previous = chain.first[(index + chain.count - 1) % chain.count];
+                previous.command = USB_DMA_Descriptor::run_and_link;
+                if (stream_in) {
+                    // a stream's packet carries on into this one (if the DMA hasn't loaded it yet)
+                    previous.end_buffer_enable = false;
+                }
+            } else {
+                _startChain(ep, index);
+            }
+
+            return true;
+        };
+
+        void _startChain(const uint8_t ep, const uint8_t index) {
+            _chains[ep].done = index;
+            _dma_used_by_endpoint |= 1 << ep;
+            HostUSB.load(ep, &_chains[ep].first[index]);
+        };
+
+        // Stop a transfer (or ring) early. Nothing is reported for the descriptors that weren't done.
+        void stopTransfer(const uint8_t ep) {
+            if (!(_dma_used_by_endpoint & (1 << ep))) {
+                return;
+            }
+            HostUSB.stop(ep);
+            _dma_used_by_endpoint &= ~(1 << ep);
+        };
+
+        char * getTransferPositon(const uint8_t endpoint) {
+            return HostUSB.ep[endpoint].address;
+        }
+
+        void flush(const uint8_t endpoint) {};
+        void flushRead(const uint8_t endpoint) {};
+        void enableRXInterrupt(const uint8_t endpoint) {};
+        void disableRXInterrupt(const uint8_t endpoint) {};
+
+        // Request the speed that the device is communicating at.
+        static const USBDeviceSpeed_t getDeviceSpeed() {
+            return HostUSB.high_speed ? kUSBDeviceHighSpeed : kUSBDeviceFullSpeed;
+        }
+
+        uint16_t getEndpointSizeFromHardware(const uint8_t &endpoint, const bool otherSpeed) {
+            if (endpoint == 0) {
+                return 64;
+            }
+
+            // Indicate that we didn't set one...
+            return 0;
+        };
+
+        EndpointBufferSettings_t getEndpointConfigFromHardware(const uint8_t endpoint) {
+            if (endpoint == 0)
+            {
+                return getBufferSizeFlags(getEndpointSizeFromHardware(endpoint, false)) | kEndpointBufferBlocks1 | kEndpointBufferTypeControl;
+            }
+            return kEndpointBufferNull;
+        };
+    }; //class USBDeviceHardware
+
+}
+
+#endif
+//HOSTUSB_H_ONCE
@@ -289,6 +289,19 @@ export MOTATE_PATH
 
 CWD = $(realpath .)
 
+ifeq ($(DEVICE_NATIVE_TOOLS),1)
+# Compilation tools - the platform builds for this machine, so use what's installed
+CC      = gcc
+CXX     = g++
+LD      = ld
+AR      = ar
+SIZE    = size
+STRIP   = strip
+OBJCOPY = objcopy
+GDB     = gdb
+GDB_PY  = gdb
+NM      = nm
+else
 # Compilation tools - hardcode the full path to the ones we provide
 TOOLS_FULLPATH = "$(TOOLS_PATH)/$(TOOLS_SUBPATH)/bin"
 CC      = $(TOOLS_FULLPATH)/$(CROSS_COMPILE)-gcc
@@ -301,6 +314,7 @@ OBJCOPY = $(TOOLS_FULLPATH)/$(CROSS_COMPILE)-objcopy
 GDB     = $(TOOLS_FULLPATH)/$(CROSS_COMPILE)-gdb
 GDB_PY  = $(TOOLS_FULLPATH)/$(CROSS_COMPILE)-gdb-py
 NM      = $(TOOLS_FULLPATH)/$(CROSS_COMPILE)-nm
+endif
 
 
 ifneq ($(NOT_IN_GIT),1)
@@ -348,7 +362,7 @@ ASFLAGS = $(DEVICE_ASFLAGS)  $(LTO)
 
 DEBUG_SYMBOLS = -g3
 
-LDFLAGS += $(LIBS) $(USER_LIBS) $(DEBUG_SYMBOLS) -O$(OPTIMIZATION) -Wl,--cref -Wl,--check-sections -Wl,--gc-sections -ffunction-sections -Wl,--unresolved-symbols=report-all -Wl,--warn-common -Wl,--warn-section-align $(DEVICE_LDFLAGS)  $(LTO)
+LDFLAGS += $(LIBS) $(USER_LIBS) $(DEBUG_SYMBOLS) -O$(OPTIMIZATION) -Wl,--cref -Wl,--check-sections -Wl,--gc-sections -ffunction-sections -Wl,--unresolved-symbols=report-all -Wl,--warn-common $(DEVICE_LDFLAGS)  $(LTO)
 # To allow unresolved symbols, uncomment
 #LDFLAGS += -Wl,--warn-unresolved-symbols
 
@@ -407,7 +421,12 @@ $(info $(NEWLINE_ONLY)FIRST_LINK_SOURCES: $(patsubst %,$(NEWLINE_TAB)%,$(FIRST_L
 endif
 
 # We use tools as a "macro" for dependencies later
+ifeq ($(DEVICE_NATIVE_TOOLS),1)
+# Nothing to install for native builds
+tools:
+else
 tools: | $(TOOLS_PATH)/$(TOOLS_SUBPATH)/bin
+endif
 
 # and make it depend on the tools makefile to catch updates
 $(TOOLS_PATH)/$(TOOLS_SUBPATH)/bin: $(TOOLS_PATH)/Makefile
@@ -0,0 +1,169 @@
+/*
+ MotateADCSampler.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATEADCSAMPLER_H_ONCE
+#define MOTATEADCSAMPLER_H_ONCE
+
+#include <cstdint>
+#include "MotatePins.h"
+#include "MotateTimers.h"
+#include "MotateDelegate.h"
+
+namespace Motate {
+
+    /* ADCSampler<adcNum, timerNum, samplesPerBlock>: continuous, timer-paced ADC sampling.
+     *
+     * Timer<timerNum> runs at the sweep rate, and each rising edge of its TIOA starts a
+     * conversion of every enabled channel (a "sweep"). The DMA moves the conversions,
+     * tagged with their channel number, into a ring of two blocks of samplesPerBlock
+     * each, so the CPU isn't involved per conversion -- only once per block.
+     *
+     * At the end of each block the conversions are averaged per channel (a block of N
+     * sweeps decimates each channel by N), and the callback is called, from the
+     * interrupt, with the result. The block is handed back to the DMA after the callback
+     * returns, so the callback (and anything else at that priority or higher) has to be
+     * done within one block-time. If it isn't, the DMA stops (or, with the XDMAC ring,
+     * comes back around), the ring is restarted, and overruns() counts it.
+     *
+     * The platform provides _ADCSamplerHardware<adcNum> (see SamPins.h and HostPins.h),
+     * which is also where the limits on timerNum come from: the Sam3x ADC can only be
+     * triggered by Timer<0> through Timer<2>, and the S70 AFEC1 by Timer<3> through Timer<5>.
+     */
+    template <uint8_t adcNum, uint8_t timerNum, uint16_t samplesPerBlock>
+    struct ADCSampler {
+        typedef _ADCSamplerHardware<adcNum> hardware_t;
+        typedef typename hardware_t::sample_t sample_t;
+        static constexpr uint8_t channelCount = hardware_t::channelCount;
+
+        static_assert(samplesPerBlock > 0, "ADCSampler: samplesPerBlock must be more than zero");
+
+        struct block_t {
+            const sample_t *samples;        // the raw (tagged) conversions, only valid during the callback
+            uint16_t sampleCount;
+            uint32_t sequence;              // blocks completed since start()
+            uint32_t channels;              // the channels that had conversions in this block
+            int32_t average[channelCount];  // the mean of each channel's conversions, rounded
+            uint16_t count[channelCount];   // how many conversions went into each average
+        };
+
+        Timer<timerNum> _timer;
+        hardware_t _hardware {[&]() { _blockDone(); }};
+
+        sample_t _ring[2][samplesPerBlock];
+        uint8_t _filling = 0;           // the block the DMA is filling now
+        block_t _block {};
+        volatile uint32_t _overruns = 0;
+        Delegate<void(const block_t &)> _blockHandler;
+
+        ADCSampler() {};
+
+        ADCSampler(const ADCSampler &) = delete;
+        ADCSampler &operator=(const ADCSampler &) = delete;
+
+        // Sample the channels in channelMask sweepsPerSecond times a second, calling blockHandler
+        // (which may be empty) with every samplesPerBlock conversions.
+        // Returns the actual sweep rate, or kFrequencyUnattainable.
+        int32_t start(const uint32_t channelMask, const uint32_t sweepsPerSecond, const Delegate<void(const block_t &)> &blockHandler) {
+            stop();
+
+            _blockHandler = blockHandler;
+            _block = {};
+            _overruns = 0;
+            _filling = 0;
+
+            _hardware.setChannels(channelMask);
+            _hardware.template start<timerNum>(_ring[0], _ring[1], samplesPerBlock);
+
+            // TIOA rises on RA, at half of the period, and falls at the end of it
+            const int32_t rate = _timer.setModeAndFrequency(kTimerUpToMatch, sweepsPerSecond);
+            _timer.setDutyCycleForChannel(0, 0.5);
+            _timer.setOutputOptions(0, kSetOnMatch | kClearOnOverflow);
+            _timer.start();
+
+            return rate;
+        };
+
+        void stop() {
+            _timer.stop();
+            _hardware.stop();
+        };
+
+        // The average of channel from the last completed block, or 0 if it had no conversions
+        int32_t getAverage(const uint8_t channel) const {
+            return (channel < channelCount) ? _block.average[channel] : 0;
+        };
+
+        uint32_t blocks() const { return _block.sequence; };
+        uint32_t overruns() const { return _overruns; };
+
+        // Called from the end-of-block interrupt
+        void _blockDone() {
+            sample_t * const done = _ring[_filling];
+            _filling ^= 1;
+
+            uint32_t sums[channelCount] = {};
+            uint16_t counts[channelCount] = {};
+            for (uint16_t i = 0; i < samplesPerBlock; i++) {
+                const uint8_t channel = hardware_t::sampleChannel(done[i]);
+                if (channel < channelCount) {
+                    sums[channel] += hardware_t::sampleValue(done[i]);
+                    counts[channel]++;
+                }
+            }
+
+            _block.channels = 0;
+            for (uint8_t channel = 0; channel < channelCount; channel++) {
+                _block.count[channel] = counts[channel];
+                if (counts[channel] > 0) {
+                    _block.average[channel] = (sums[channel] + (counts[channel] / 2)) / counts[channel];
+                    _block.channels |= 1u << channel;
+                } else {
+                    _block.average[channel] = 0;
+                }
+            }
+            _block.samples = done;
+            _block.sampleCount = samplesPerBlock;
+            _block.sequence++;
+
+            if (_blockHandler) {
+                _blockHandler(_block);
+            }
+
+            if (!_hardware.blockDone(done, samplesPerBlock)) {
+                // Both blocks filled before we got here, and conversions were dropped. Start the ring over.
+                _overruns++;
+                _filling = 0;
+                _hardware.template start<timerNum>(_ring[0], _ring[1], samplesPerBlock);
+            }
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATEADCSAMPLER_H_ONCE */
@@ -31,11 +31,65 @@
 #ifndef MOTATEBUFFER_H_ONCE
 #define MOTATEBUFFER_H_ONCE
 
-#include <cstring> // for size_t
+#include <cstring> // for size_t and memcpy
 //#include <utility> // for std::move
 #include <functional> // for std::function
+#include <algorithm> // for std::min
+#include <atomic> // for std::atomic
+#include <type_traits> // for std::remove_pointer
 
 namespace Motate {
+    /* BufferSpan<base_type> and BufferSpans<base_type>
+     * A contiguous region of a circular buffer, and the (up to) two regions that make up
+     * a readable or writable area of one. The second span is only non-empty when the
+     * area wraps past the end of the buffer.
+     */
+    template <typename base_type>
+    struct BufferSpan {
+        base_type *data;
+        uint16_t length;
+    };
+
+    template <typename base_type>
+    struct BufferSpans {
+        BufferSpan<base_type> first;
+        BufferSpan<base_type> second;
+
+        uint16_t length() const { return first.length + second.length; };
+        bool isEmpty() const { return first.length == 0; };
+
+        // Copy up to max_length values out of the spans, with at most two memcpy calls.
+        uint16_t copyOut(base_type *dest, const uint16_t max_length) const {
+            uint16_t first_length = std::min(first.length, max_length);
+            uint16_t second_length = std::min(second.length, (uint16_t)(max_length - first_length));
+            memcpy(dest, first.data, first_length * sizeof(base_type));
+            if (second_length) {
+                memcpy(dest + first_length, second.data, second_length * sizeof(base_type));
+            }
+            return first_length + second_length;
+        };
+
+        // Copy up to max_length values into the spans, with at most two memcpy calls.
+        uint16_t copyIn(const base_type *src, const uint16_t max_length) const {
+            uint16_t first_length = std::min(first.length, max_length);
+            uint16_t second_length = std::min(second.length, (uint16_t)(max_length - first_length));
+            memcpy(first.data, src, first_length * sizeof(base_type));
+            if (second_length) {
+                memcpy(second.data, src + first_length, second_length * sizeof(base_type));
+            }
+            return first_length + second_length;
+        };
+    };
+
+    // The spans from start (inclusive) to end (exclusive) in the circular buffer data[_size].
+    template <uint16_t _size, typename base_type>
+    BufferSpans<base_type> _bufferSpansBetween(base_type *data, const uint16_t start, const uint16_t end) {
+        if (start <= end) {
+            return {{data + start, (uint16_t)(end - start)}, {data, 0}};
+        }
+        return {{data + start, (uint16_t)(_size - start)}, {data, end}};
+    };
+
     // Implement a simple circular buffer, with a compile-time size
     template <uint16_t _size, typename base_type = char>
     struct Buffer {
@@ -109,14 +163,192 @@ namespace Motate {
                 return (_read_offset) + (_size - _write_offset);
             }
         };
+
+        // The data that can be read now, without copying. Call consume() after using it.
+        BufferSpans<base_type> readableSpans() {
+            return _bufferSpansBetween<_size>(_data, _read_offset, _write_offset);
+        };
+
+        // The space that can be written now, without copying. Call commit() after filling it.
+        // One slot is always left open, so that full doesn't look like empty.
+        BufferSpans<base_type> writableSpans() {
+            return _bufferSpansBetween<_size>(_data, _write_offset, (_read_offset - 1)&(_size-1));
+        };
+
+        // Mark count values as read (from readableSpans()).
+        void consume(const uint16_t count) {
+            _read_offset = (_read_offset + count)&(_size-1);
+        };
+
+        // Mark count values as written (into writableSpans()).
+        void commit(const uint16_t count) {
+            _write_offset = (_write_offset + count)&(_size-1);
+        };
+
+        // Non-blocking bulk read. Returns how many values were read, which may be zero.
+        int16_t read(base_type *buffer, const size_t read_size) {
+            uint16_t count = readableSpans().copyOut(buffer, std::min(read_size, (size_t)_size));
+            consume(count);
+            return count;
+        };
+
+        // Non-blocking bulk write. Returns how many values were written, which may be zero.
+        int16_t write(const base_type *buffer, const size_t write_size) {
+            uint16_t count = writableSpans().copyIn(buffer, std::min(write_size, (size_t)_size));
+            commit(count);
+            return count;
+        };
+    };
+
+    /* SPSCBuffer<uint16_t _size, typename base_type = char>
+     * The same interface as Buffer, but safe to use lock-free between exactly one producer
+     * and exactly one consumer, such as an ISR and the main loop (either direction), or two
+     * threads on the host.
+     *
+     * Each offset is only ever stored by one side, and is published with release ordering
+     * after the data it covers is written (or read), then picked up with acquire ordering by
+     * the other side. Each side also keeps a plain copy of the other side's offset, and only
+     * re-reads the shared one when the copy says it's full (or empty).
+     *
+     * Producer side: isFull(), write(), writableSpans(), commit()
+     * Consumer side: isEmpty(), peek(), pop(), read(), readableSpans(), consume()
+     */
+    template <uint16_t _size, typename base_type = char>
+    struct SPSCBuffer {
+        static_assert(((_size-1)&_size)==0, "SPSCBuffer size must be 2^N");
+
+        // Internal properties!
+        base_type _data[_size+1];
+
+        // Consumer-owned
+        std::atomic<uint16_t> _read_offset {0};      // The offset into the buffer of our next read
+        uint16_t _cached_write_offset = 0;           // The last _write_offset the consumer saw
+
+        // Producer-owned
+        std::atomic<uint16_t> _write_offset {0};     // The offset into the buffer of our next write
+        uint16_t _cached_read_offset = 0;            // The last _read_offset the producer saw
+
+        SPSCBuffer() { _data[_size] = base_type{}; };
+
+        constexpr int16_t size() { return _size; };
+
+        bool isLocked() { return false; }
+
+        // Consumer side: refresh the cached write offset only if it looks empty.
+        bool isEmpty() {
+            uint16_t read_offset = _read_offset.load(std::memory_order_relaxed);
+            if (read_offset != _cached_write_offset) {
+                return false;
+            }
+            _cached_write_offset = _write_offset.load(std::memory_order_acquire);
+            return read_offset == _cached_write_offset;
+        };
+
+        // Producer side: refresh the cached read offset only if it looks full.
+        bool isFull() {
+            uint16_t next_write_offset = (_write_offset.load(std::memory_order_relaxed) + 1)&(_size-1);
+            if (next_write_offset != _cached_read_offset) {
+                return false;
+            }
+            _cached_read_offset = _read_offset.load(std::memory_order_acquire);
+            return next_write_offset == _cached_read_offset;
+        };
+
+        int16_t peek() {
+            if (isEmpty())
+                return -1;
+
+            return _data[_read_offset.load(std::memory_order_relaxed)];
+        };
+
+        void pop() {
+            if (isEmpty())
+                return; // Ignore pop on an empty buffer
+
+            consume(1);
+        };
+
+        int16_t read() {
+            if (isEmpty()) {
+                return -1;
+            }
+
+            uint16_t read_offset = _read_offset.load(std::memory_order_relaxed);
+            int16_t ret = _data[read_offset];
+            _read_offset.store((read_offset + 1)&(_size-1), std::memory_order_release);
+
+            return ret;
+        };
+
+        int16_t write(const base_type newValue) {
+            if (isFull())
+                return -1;
+
+            uint16_t write_offset = _write_offset.load(std::memory_order_relaxed);
+            _data[write_offset] = newValue;
+            _write_offset.store((write_offset + 1)&(_size-1), std::memory_order_release);
+
+            return 1;
+        };
+
+        // Consumer side. Call consume() after using them.
+        BufferSpans<base_type> readableSpans() {
+            _cached_write_offset = _write_offset.load(std::memory_order_acquire);
+            return _bufferSpansBetween<_size>(_data, _read_offset.load(std::memory_order_relaxed), _cached_write_offset);
+        };
+
+        // Producer side. Call commit() after filling them.
+        BufferSpans<base_type> writableSpans() {
+            _cached_read_offset = _read_offset.load(std::memory_order_acquire);
+            return _bufferSpansBetween<_size>(_data, _write_offset.load(std::memory_order_relaxed), (_cached_read_offset - 1)&(_size-1));
+        };
+
+        void consume(const uint16_t count) {
+            _read_offset.store((_read_offset.load(std::memory_order_relaxed) + count)&(_size-1), std::memory_order_release);
+        };
+
+        void commit(const uint16_t count) {
+            _write_offset.store((_write_offset.load(std::memory_order_relaxed) + count)&(_size-1), std::memory_order_release);
+        };
+
+        // Non-blocking bulk read. Returns how many values were read, which may be zero.
+        int16_t read(base_type *buffer, const size_t read_size) {
+            uint16_t count = readableSpans().copyOut(buffer, std::min(read_size, (size_t)_size));
+            consume(count);
+            return count;
+        };
+
+        // Non-blocking bulk write. Returns how many values were written, which may be zero.
+        int16_t write(const base_type *buffer, const size_t write_size) {
+            uint16_t count = writableSpans().copyIn(buffer, std::min(write_size, (size_t)_size));
+            commit(count);
+            return count;
+        };
+    }; // SPSCBuffer
+
+    /* _OwnerQueuesTransfers<owner_type>::value
+     * True if the owner of an RXBuffer or TXBuffer (a pointer type) has a static const bool queues_transfers
+     * that's true. Such an owner takes a transfer while others are still going: it's handed the whole region
+     * again, from where the DMA is now, and queues only the part past what it already has. Its done callback
+     * is called as each queued transfer finishes.
+     */
+    template <typename owner_type, typename = void>
+    struct _OwnerQueuesTransfers {
+        static const bool value = false;
+    };
+
+    template <typename owner_type>
+    struct _OwnerQueuesTransfers<owner_type, decltype((void)std::remove_pointer<owner_type>::type::queues_transfers)> {
+        static const bool value = std::remove_pointer<owner_type>::type::queues_transfers;
     };
 
     /* RXBuffer<uint16_t _size, typename owner_type, typename base_type = char>
      * Implements a simple circular buffer, with a compile-time size, and can only be written to by DMA
      * owner_type is a *pointer* type that implements these methods:
      *   const base_type* getRXTransferPosition()
-     *   void setRXTransferDoneCallback(std::function<void()> &&callback)
-     *   bool startRXTransfer(char *&buffer, uint16_t length)
+     *   void setRXTransferDoneCallback(Delegate<void()> &&callback) -- std::function<void()> works too
+     *   bool startRXTransfer(char *buffer, uint16_t length, char *buffer2, uint16_t length2)
+     * and may have a static const bool queues_transfers (see _OwnerQueuesTransfers).
      */
     template <uint16_t _size, typename owner_type, typename base_type = char>
     struct RXBuffer {
@@ -129,7 +361,11 @@ namespace Motate {
         volatile uint16_t _last_known_write_offset = 0;  // The offset into the buffer of the last known write (cached)
         volatile uint16_t _last_requested_write_offset = 0;  // The offset into the buffer of the last requested write
 
-        volatile uint16_t _transfer_requested = 0;   // keep track of how much we have requested. Non-zero means a request is active.
+        // keep track of how much we have requested. Non-zero means a request is active.
+        // Cleared by the owner (usually from an interrupt) when the transfer is done.
+        // (An owner that queues transfers takes more while one is active, so it's not checked for them.)
+        std::atomic<uint16_t> _transfer_requested {0};
+        static const bool _owner_queues_transfers = _OwnerQueuesTransfers<owner_type>::value;
 
         // Internal properties!
         // Some devices write in whole-word (4-byte) chunks, even though the last bytes are garbage, and past what we requested.
@@ -144,7 +380,7 @@ namespace Motate {
 
         void init() {
             _owner->setRXTransferDoneCallback([&]() { // use a closure
-                _transfer_requested = 0;
+                _transfer_requested.store(0, std::memory_order_release);
                 //_restartTransfer();
             });
         };
@@ -170,6 +406,8 @@ namespace Motate {
             if (nullptr != pos) {
                 _last_known_write_offset = (pos - _data) & (_size-1); // if it's one past the end, we want it to become zero
             }
+            // Don't let reads of the data move before we learned it was there.
+            std::atomic_thread_fence(std::memory_order_acquire);
             return _last_known_write_offset;
         }
 
@@ -228,7 +466,7 @@ namespace Motate {
         };
 
         void _restartTransfer() {
-            if (_transfer_requested != 0) {
+            if (!_owner_queues_transfers && (_transfer_requested.load(std::memory_order_acquire) != 0)) {
                 return;
             }
 
@@ -292,17 +530,18 @@ namespace Motate {
                 transfer_size_extra = std::max(0, _read_offset - 4);
             }
 
-            _transfer_requested = transfer_size + transfer_size_extra;
+            const uint16_t requested = transfer_size + transfer_size_extra;
+            _transfer_requested.store(requested, std::memory_order_relaxed);
 
             // startRXTransfer will return false if it couldn't start the transfer.
             if (_owner->startRXTransfer(write_pos, transfer_size, write_pos_extra, transfer_size_extra)) {
-                _last_requested_write_offset = (_last_known_write_offset + _transfer_requested) & (_size-1);
+                _last_requested_write_offset = (_last_known_write_offset + requested) & (_size-1);
                 return;
             }
 
             // If we're here, startRXTransfer loaded some data into the buffer and ran out of room.
             // Note that _getWriteOffset() must return the new position
-            _transfer_requested = 0;
+            _transfer_requested.store(0, std::memory_order_relaxed);
         };
 
         int16_t read() {
@@ -332,6 +571,26 @@ namespace Motate {
             _getWriteOffset(); // cache the write position
             return _getAvailableCached();
         };
+
+        // The data that has been received, without copying. Call consume() after using it.
+        // (There is no writableSpans() -- only the owner writes to this buffer.)
+        BufferSpans<base_type> readableSpans() {
+            _getWriteOffset(); // cache the write position
+            return _bufferSpansBetween<_size>(_data, _read_offset, _last_known_write_offset);
+        };
+
+        // Mark count values as read (from readableSpans()), freeing that space for the owner.
+        void consume(const uint16_t count) {
+            _read_offset = (_read_offset + count)&(_size-1);
+            _restartTransfer();
+        };
+
+        // Non-blocking bulk read. Returns how many values were read, which may be zero.
+        int16_t read(base_type *buffer, const size_t read_size) {
+            uint16_t count = readableSpans().copyOut(buffer, std::min(read_size, (size_t)_size));
+            consume(count);
+            return count;
+        };
     }; // RXBuffer
 
 
@@ -340,8 +599,10 @@ namespace Motate {
      * Implements a simple circular buffer, with a compile-time size, and can only be read from by DMA
      * owner_type is a *pointer* type that implements these methods:
      *   const base_type* getTXTransferPosition()
-     *   void setTXTransferDoneCallback(std::function<void()> &&callback)
-     *   bool startTXTransfer(char *&buffer, uint16_t length)
+     *   void setTXTransferDoneCallback(Delegate<void()> &&callback) -- std::function<void()> works too
+     *   bool startTXTransfer(char *buffer, uint16_t length, char *buffer2, uint16_t length2)
+     * The second region is only non-empty when the data wraps past the end of the buffer.
+     * The owner may have a static const bool queues_transfers (see _OwnerQueuesTransfers).
      */
 
     // Implement a simple circular buffer, with a compile-time size, and can only be read from by DMA
@@ -355,13 +616,19 @@ namespace Motate {
         // Internal properties!
         base_type _data[_size+1];
 
-        uint16_t _write_offset;             // The offset into the buffer of our next write
-        uint16_t _last_known_read_offset;   // The offset into the buffer of the last known read (cached)
+        // The offset into the buffer of our next write. Published (with release ordering) after the
+        // data is written, since the transfer-done callback may start the next transfer from an interrupt.
+        std::atomic<uint16_t> _write_offset {0};
+        uint16_t _last_known_read_offset = 0;   // The offset into the buffer of the last known read (cached)
 
-        uint16_t _transfer_requested = 0;   // keep track of how much we have requested. Non-zero means a request is active.
+        // keep track of how much we have requested. Non-zero means a request is active.
+        // Cleared by the owner (usually from an interrupt) when the transfer is done.
+        // (An owner that queues transfers takes more while one is active, so it's not checked for them.)
+        std::atomic<uint16_t> _transfer_requested {0};
+        static const bool _owner_queues_transfers = _OwnerQueuesTransfers<owner_type>::value;
 
         // DEBUGGING STRUCTURES
-#if true && IN_DEBUGGER
+#if true && defined(IN_DEBUGGER) && IN_DEBUGGER
 #define TRACE_TRANSACTIONS true
 #else
 #define TRACE_TRANSACTIONS false
@@ -390,13 +657,13 @@ namespace Motate {
 
         void init() {
             _owner->setTXTransferDoneCallback([&]() { // use a closure
-                _transfer_requested = 0;
+                _transfer_requested.store(0, std::memory_order_release);
                 _restartTransfer();
             });
         }
 
         uint16_t _nextWriteOffset() {
-            return (_write_offset + 1)&(_size-1);
+            return (_write_offset.load(std::memory_order_relaxed) + 1)&(_size-1);
         };
 
         bool _canBeWritten(uint16_t pos) {
@@ -417,6 +684,8 @@ namespace Motate {
             } else {
                 _last_known_read_offset = (pos - _data) & (_size-1); // if it's one past the end, we want it to become zero
             }
+            // Don't let writes into the freed space move before we learned it was free.
+            std::atomic_thread_fence(std::memory_order_acquire);
             return _last_known_read_offset;
         }
 
@@ -448,7 +717,7 @@ namespace Motate {
         }
 
         // It's empty if the write position would be the same as the read.
-        bool _isEmptyCached() { return _write_offset == _last_known_read_offset; }
+        bool _isEmptyCached() { return _write_offset.load(std::memory_order_acquire) == _last_known_read_offset; }
 
         // It's full if the next write position would be the same as the read.
         bool _isFullCached() { return _nextWriteOffset() == _last_known_read_offset; }
@@ -460,13 +729,15 @@ namespace Motate {
         void _restartTransfer() {
             volatile static bool is_requesting = false;
             if (is_requesting) { return; }
-            if ((_transfer_requested == 0) && !isEmpty()) {
+            if ((_owner_queues_transfers || (_transfer_requested.load(std::memory_order_acquire) == 0)) && !isEmpty()) {
                 is_requesting = true;
                 // We can only request contiguous chunks. Let's see what the next one is.
                 _getReadOffset(); // cache the read position
 
                 int16_t transfer_size = 0;
+                int16_t transfer_size_extra = 0;
                 base_type *_read_pos = _data + _last_known_read_offset;
+                const uint16_t write_offset = _write_offset.load(std::memory_order_acquire);
 
                 // Possible cases:
                 // [0] _read_pos == _write_pos
@@ -474,18 +745,21 @@ namespace Motate {
                 // [1] _read_pos > _write_pos
                 //     IOW: We read to some position in the middle, and _write_pos is before it
                 //          The unread data is between read->end, then 0->write.
-                //          So, we transfer from _read_pos to the end of the buffer.
+                //          So, we transfer from _read_pos to the end of the buffer, then
+                //          a second region from the start of the buffer to _write_pos.
+                //          (Owners that can't chain two regions will only send the first.)
                 // [2] _read_pos < _write_pos
                 //     IOW: We read to some position in the middle, and _read_pos is in the range 0 through _write_pos.
                 //          So, we can transfer from _read_pos to _write_pos.
 
                 // Case [1]
-                if (_last_known_read_offset > _write_offset) {
+                if (_last_known_read_offset > write_offset) {
                     transfer_size = _size - _last_known_read_offset;
+                    transfer_size_extra = write_offset;
 
                 // Case [2]
                 } else {
-                    transfer_size = _write_offset - _last_known_read_offset;
+                    transfer_size = write_offset - _last_known_read_offset;
                 }
 
                 // We set _transfer_requested BEFORE startRXTransfer, in case an interrupt fires before we exit startRXTransfer
@@ -496,19 +770,30 @@ namespace Motate {
                 transactions.add(_last_known_read_offset, _last_known_read_offset + transfer_size);
 #endif
 
-                _transfer_requested = transfer_size;
+                _transfer_requested.store(transfer_size + transfer_size_extra, std::memory_order_relaxed);
                 is_requesting = false;
-                while (!_owner->startTXTransfer(_read_pos, transfer_size)) {
+                while (!_owner->startTXTransfer(_read_pos, transfer_size, _data, transfer_size_extra)) {
                     //_transfer_requested = 0;
                 }
             }
         };
 
+        // The space that can be written now, without copying. Call commit() after filling it.
+        // (There is no readableSpans() -- only the owner reads from this buffer.)
+        BufferSpans<base_type> writableSpans() {
+            _getReadOffset(); // cache the read position
+            return _bufferSpansBetween<_size>(_data, _write_offset.load(std::memory_order_relaxed), (_last_known_read_offset - 1)&(_size-1));
+        };
+
+        // Mark count values as written (into writableSpans()). This does not start a transfer.
+        void commit(const uint16_t count) {
+            _write_offset.store((_write_offset.load(std::memory_order_relaxed) + count)&(_size-1), std::memory_order_release);
+        };
+
         // BLOCKING write
-        int16_t write(const char *buffer, size_t write_size) {
-            uint16_t to_write = write_size;
-            const char *src = buffer;
-            while (to_write--) {
+        int16_t write(const base_type *buffer, size_t write_size) {
+            const base_type *src = buffer;
+            while (write_size > 0) {
                 if (isFull()) {
                     _restartTransfer();
 
@@ -517,34 +802,28 @@ namespace Motate {
                         ;
                     }
                 }
-                _data[_write_offset] = *src;
 
-                src++;
-                _write_offset = _nextWriteOffset();
+                uint16_t written = writableSpans().copyIn(src, std::min(write_size, (size_t)_size));
+                commit(written);
+
+                src += written;
+                write_size -= written;
             }
 
             _restartTransfer();
 
-            return write_size;
+            return src - buffer;
         };
 
         // non-blocking write
-        int16_t write_nb(const char *buffer, size_t write_size) {
+        int16_t write_nb(const base_type *buffer, size_t write_size) {
             if (isFull()) {
                 _restartTransfer();
                 return -1;
             }
 
-            uint16_t written = 0;
-            uint16_t to_write = write_size;
-            const char *src = buffer;
-            while (to_write-- && !isFull()) {
-                _data[_write_offset] = *src;
-
-                src++;
-                written++;
-                _write_offset = _nextWriteOffset();
-            }
+            uint16_t written = writableSpans().copyIn(buffer, std::min(write_size, (size_t)_size));
+            commit(written);
 
             if (isFull()) {
                 _restartTransfer();
@@ -555,12 +834,13 @@ namespace Motate {
 
 
         int16_t _getAvailableCached() {
-            if (_write_offset == _last_known_read_offset) {
+            const uint16_t write_offset = _write_offset.load(std::memory_order_relaxed);
+            if (write_offset == _last_known_read_offset) {
                 return _size;
-            } else if (_write_offset < _last_known_read_offset) {
-                return _size  - (_last_known_read_offset - _write_offset);
+            } else if (write_offset < _last_known_read_offset) {
+                return _size  - (_last_known_read_offset - write_offset);
             } else {
-                return (_last_known_read_offset) + (_size - _write_offset);
+                return (_last_known_read_offset) + (_size - write_offset);
             }
         };
 
@@ -0,0 +1,414 @@
+/*
+ MotateBusScheduler.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATEBUSSCHEDULER_H_ONCE
+#define MOTATEBUSSCHEDULER_H_ONCE
+
+#include <cstdint>
+#include <atomic>
+#include "MotateTimers.h" // for Deadline
+
+namespace Motate {
+
+    /* BusPriority: the priority class of a message on a shared bus (SPIBus, TWIBus).
+     *
+     * Between devices, the bus always sends for the highest class that has something
+     * waiting, so a latency-critical poll doesn't wait behind a stream of bulk
+     * transfers to another device. It still waits for the message (or transaction)
+     * that's already on the wire, since those can't be interrupted.
+     */
+    enum class BusPriority : uint8_t {
+        kUrgent = 0, // status polls, fault checks
+        kHigh   = 1,
+        kNormal = 2, // the default
+        kBulk   = 3, // long transfers that can wait: displays, EEPROMs, flash
+    };
+    static constexpr uint8_t kBusPriorityClasses = 4;
+
+    template <typename message_t>
+    struct BusMessagePoolBase;
+
+    /* BusMessageScheduling<message_t>: the scheduling part of a bus message.
+     *
+     * priority and deadline are set by the owner, before the message is queued. The
+     * deadline is optional: within a priority class, the message with the earliest
+     * deadline goes first, and those without one go after, in the order they were
+     * queued. The rest is maintained by the bus.
+     */
+    template <typename message_t>
+    struct BusMessageScheduling {
+        BusPriority priority = BusPriority::kNormal;
+        Deadline deadline {};
+
+        std::atomic<message_t *> _bus_next {nullptr};
+        std::atomic<bool> _bus_queued {false}; // from being queued until it's done sending
+
+        BusMessagePoolBase<message_t> *_pool = nullptr; // set if it belongs to a BusMessagePool
+    };
+
+    /* BusDeviceQueue<message_t>: the queue of messages waiting for one device on the bus.
+     *
+     * A device's own messages always go in the order they were queued, since they may
+     * be parts of one transaction -- priority and deadline choose between devices, by
+     * the first message each one has waiting.
+     *
+     * max_queue_depth limits how many messages the device may have queued (counting
+     * the one that's sending) so one device can't tie up all of the bus's time and
+     * memory. Queueing one more fails, and the owner has to try again later.
+     */
+    template <typename message_t>
+    struct BusDeviceQueue {
+        uint8_t max_queue_depth = 0; // 0 is no limit
+
+        std::atomic<uint8_t> _queue_depth {0};
+
+        // Only touched from the bus's interrupt level
+        message_t *_queue_first = nullptr;
+        message_t *_queue_last = nullptr;
+        BusDeviceQueue *_ready_next = nullptr;
+        uint8_t _ready_class = kBusPriorityClasses; // kBusPriorityClasses means it's not in a ready list
+
+        void setMaxQueueDepth(const uint8_t depth) { max_queue_depth = depth; };
+        uint8_t queueDepth() const { return _queue_depth.load(std::memory_order_relaxed); };
+
+        // Make room for count more messages, or return false if that would go over the limit.
+        bool _reserve(const uint8_t count) {
+            uint8_t depth = _queue_depth.load(std::memory_order_relaxed);
+            do {
+                if ((max_queue_depth != 0) && ((depth + count) > max_queue_depth)) {
+                    return false;
+                }
+            } while (!_queue_depth.compare_exchange_weak(depth, depth + count, std::memory_order_relaxed));
+            return true;
+        };
+        void _unreserve(const uint8_t count) { _queue_depth.fetch_sub(count, std::memory_order_relaxed); };
+    };
+
+    /* BusScheduler<message_t>: picks the next message for a bus, in bounded time.
+     *
+     * Messages can be pushed from any context: push() only puts them on a lock-free
+     * "inbox" list, like the ServiceCall ready lists. Everything else is only called
+     * from the bus's own interrupt level, which first moves the inbox onto the device
+     * queues (in the order they were pushed).
+     *
+     * A device with messages waiting is in the ready list for the class of its first
+     * message, sorted by that message's deadline (devices that tie take turns, since a
+     * device goes to the back of the ties each time it sends), and a bit per class says
+     * which lists aren't empty. So next() is a count-trailing-zeros and a list head, and
+     * moving a device between lists is bounded by the number of devices on the bus.
+     *
+     * message_t must have a BusMessageScheduling<message_t> base, and a device member
+     * that points to a BusDeviceQueue<message_t>.
+     */
+    template <typename message_t>
+    struct BusScheduler {
+        using device_queue_t = BusDeviceQueue<message_t>;
+
+        std::atomic<message_t *> _inbox {nullptr};
+
+        device_queue_t *_ready_lists[kBusPriorityClasses] = {};
+        uint32_t _ready_classes = 0; // bit n is set if _ready_lists[n] isn't empty
+
+        // Hand a message to the bus. Its device must already be set, and room reserved for it.
+        // Returns false if it was already queued.
+        bool push(message_t *msg) {
+            if (msg->_bus_queued.exchange(true)) {
+                return false;
+            }
+            if (msg->_pool != nullptr) {
+                msg->_pool->_retain(msg); // until finished()
+            }
+
+            message_t *orig_inbox = _inbox.load(std::memory_order_relaxed);
+            do {  // loop until it works
+                msg->_bus_next.store(orig_inbox, std::memory_order_relaxed);
+            } while (!_inbox.compare_exchange_weak(orig_inbox, msg,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+            return true;
+        };
+
+        // The first message of the highest-priority device that has one waiting, if any.
+        message_t *next() {
+            _collect();
+            if (_ready_classes == 0) {
+                return nullptr;
+            }
+            return _ready_lists[__builtin_ctz(_ready_classes)]->_queue_first;
+        };
+
+        // The first message that device has waiting, if any (for continuing a transaction).
+        message_t *nextFor(device_queue_t *device) {
+            _collect();
+            return device->_queue_first;
+        };
+
+        // The message after msg in its device's queue, if any.
+        static message_t *following(message_t *msg) {
+            return msg->_bus_next.load(std::memory_order_relaxed);
+        };
+
+        // Take the first message off of device's queue, once it's done sending. After this,
+        // it can be queued again (from its callback, for instance).
+        message_t *pop(device_queue_t *device) {
+            // Anything pushed while it was sending gets in line before device goes around again
+            _collect();
+
+            message_t *msg = device->_queue_first;
+            if (msg == nullptr) {
+                return nullptr;
+            }
+
+            _unready(device);
+            device->_queue_first = following(msg);
+            if (device->_queue_first == nullptr) {
+                device->_queue_last = nullptr;
+            } else {
+                _ready(device);
+            }
+
+            msg->_bus_next.store(nullptr, std::memory_order_relaxed);
+            device->_unreserve(1);
+            msg->_bus_queued.store(false);
+            return msg;
+        };
+
+        // The bus is done with msg: it's been popped, and its callback has returned. A
+        // pooled message goes back to its pool here, unless a handle still holds it (or
+        // the callback queued it again).
+        static void finished(message_t *msg) {
+            if (msg->_pool != nullptr) {
+                msg->_pool->_release(msg);
+            }
+        };
+
+        // Move everything pushed since last time onto the device queues.
+        void _collect() {
+            message_t *pushed = _inbox.exchange(nullptr, std::memory_order_acquire);
+
+            // The inbox is newest-first, so turn it around
+            message_t *oldest = nullptr;
+            while (pushed != nullptr) {
+                message_t *next_pushed = following(pushed);
+                pushed->_bus_next.store(oldest, std::memory_order_relaxed);
+                oldest = pushed;
+                pushed = next_pushed;
+            }
+
+            while (oldest != nullptr) {
+                message_t *msg = oldest;
+                oldest = following(msg);
+                msg->_bus_next.store(nullptr, std::memory_order_relaxed);
+
+                device_queue_t *device = msg->device;
+                if (device->_queue_last == nullptr) {
+                    device->_queue_first = msg;
+                    device->_queue_last = msg;
+                    _ready(device);
+                } else {
+                    device->_queue_last->_bus_next.store(msg, std::memory_order_relaxed);
+                    device->_queue_last = msg;
+                }
+            }
+        };
+
+        // Does a go before b? Set deadlines go before unset ones, and ties keep their order.
+        static bool _sooner(const Deadline &a, const Deadline &b) {
+            return a.isSet() && (!b.isSet() || (a.at_ < b.at_));
+        };
+
+        // Put device in the ready list for the class of its first message.
+        void _ready(device_queue_t *device) {
+            message_t *first = device->_queue_first;
+            const uint8_t ready_class = (uint8_t)first->priority;
+
+            device_queue_t **link = &_ready_lists[ready_class];
+            while ((*link != nullptr) && !_sooner(first->deadline, (*link)->_queue_first->deadline)) {
+                link = &(*link)->_ready_next;
+            }
+            device->_ready_next = *link;
+            *link = device;
+            device->_ready_class = ready_class;
+            _ready_classes |= (1u << ready_class);
+        };
+
+        void _unready(device_queue_t *device) {
+            const uint8_t ready_class = device->_ready_class;
+            if (ready_class >= kBusPriorityClasses) {
+                return;
+            }
+
+            device_queue_t **link = &_ready_lists[ready_class];
+            while (*link != nullptr) {
+                if (*link == device) {
+                    *link = device->_ready_next;
+                    break;
+                }
+                link = &(*link)->_ready_next;
+            }
+            device->_ready_next = nullptr;
+            device->_ready_class = kBusPriorityClasses;
+            if (_ready_lists[ready_class] == nullptr) {
+                _ready_classes &= ~(1u << ready_class);
+            }
+        };
+    };
+
+    /* BusMessagePool<message_t, capacity>: a fixed set of messages for the drivers on a bus.
+     *
+     * Rather than each driver keeping its own static messages (and tracking whether
+     * each one is still in flight before reusing it), drivers take messages from a
+     * pool as they need them, and can have as many outstanding as the pool holds.
+     * Usually there's one pool per bus, shared by the drivers on it, so RAM grows
+     * with how deep the bus is pipelined rather than with the number of devices.
+     *
+     * acquire() returns a BusMessageHandle, which owns the message like a
+     * std::unique_ptr, or an empty one if they're all in use. The message comes back
+     * with its callback cleared and the default priority, and the rest is up to its
+     * setup(). Once queued, the bus holds the message too, so the handle can go away
+     * (fire and forget) and the message returns to the pool when the bus is done with
+     * it -- after its callback. Or keep the handle to queue the same message again.
+     *
+     * The free list is a bitmask, so acquire() and releasing are a compare-and-swap
+     * each, and can be called from any context, including bus callbacks.
+     */
+    template <typename message_t>
+    struct BusMessagePoolBase {
+        message_t *const _messages;
+        std::atomic<uint8_t> *const _refs; // per message: its handle, plus one while it's queued
+        std::atomic<uint32_t> _free;       // bit n is set if _messages[n] is free
+
+        BusMessagePoolBase(message_t *messages, std::atomic<uint8_t> *refs, const uint8_t capacity)
+            : _messages{messages}, _refs{refs}, _free{(capacity == 32) ? 0xFFFFFFFFu : ((1u << capacity) - 1)} {};
+
+        // prevent copying or moving, since the messages point back here
+        BusMessagePoolBase(const BusMessagePoolBase &) = delete;
+        BusMessagePoolBase(BusMessagePoolBase &&) = delete;
+
+        // The number of messages not in use.
+        uint8_t available() const { return __builtin_popcount(_free.load(std::memory_order_relaxed)); };
+
+        // Take a message out of the free list, or return nullptr if it's empty.
+        message_t *_acquire() {
+            uint32_t free = _free.load(std::memory_order_relaxed);
+            uint8_t index;
+            do {
+                if (free == 0) {
+                    return nullptr;
+                }
+                index = __builtin_ctz(free);
+            } while (!_free.compare_exchange_weak(free, free & ~(1u << index),
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed));
+
+            message_t *msg = &_messages[index];
+            _refs[index].store(1, std::memory_order_relaxed);
+
+            // Don't let the last owner's callback or scheduling leak into this one
+            msg->message_done_callback = nullptr;
+            msg->priority = BusPriority::kNormal;
+            msg->deadline.clear();
+            return msg;
+        };
+
+        void _retain(message_t *msg) {
+            _refs[msg - _messages].fetch_add(1, std::memory_order_relaxed);
+        };
+
+        void _release(message_t *msg) {
+            const uint8_t index = msg - _messages;
+            if (_refs[index].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                _free.fetch_or(1u << index, std::memory_order_release);
+            }
+        };
+    };
+
+    /* BusMessageHandle<message_t>: owns one message from a BusMessagePool.
+     *
+     * Move-only. Destroying it (or reset()) lets go of the message, which goes back
+     * to the pool then, or when the bus is done with it if it's queued.
+     */
+    template <typename message_t>
+    struct BusMessageHandle {
+        message_t *_msg = nullptr;
+
+        constexpr BusMessageHandle() {};
+        explicit BusMessageHandle(message_t *msg) : _msg{msg} {};
+
+        BusMessageHandle(const BusMessageHandle &) = delete;
+        BusMessageHandle &operator=(const BusMessageHandle &) = delete;
+
+        BusMessageHandle(BusMessageHandle &&other) : _msg{other._msg} { other._msg = nullptr; };
+        BusMessageHandle &operator=(BusMessageHandle &&other) {
+            if (this != &other) {
+                reset();
+                _msg = other._msg;
+                other._msg = nullptr;
+            }
+            return *this;
+        };
+
+        ~BusMessageHandle() { reset(); };
+
+        void reset() {
+            if (_msg != nullptr) {
+                _msg->_pool->_release(_msg);
+                _msg = nullptr;
+            }
+        };
+
+        // False if the pool was empty
+        explicit operator bool() const { return _msg != nullptr; };
+
+        message_t *get() const { return _msg; };
+        message_t *operator->() const { return _msg; };
+        message_t &operator*() const { return *_msg; };
+    };
+
+    template <typename message_t, uint8_t capacity>
+    struct BusMessagePool : BusMessagePoolBase<message_t> {
+        static_assert((capacity > 0) && (capacity <= 32), "BusMessagePool: capacity must be 1 to 32");
+
+        using handle_t = BusMessageHandle<message_t>;
+
+        message_t _pooled[capacity];
+        std::atomic<uint8_t> _pooled_refs[capacity] {};
+
+        BusMessagePool() : BusMessagePoolBase<message_t>{_pooled, _pooled_refs, capacity} {
+            for (auto &msg : _pooled) {
+                msg._pool = this;
+            }
+        };
+
+        handle_t acquire() { return handle_t{this->_acquire()}; };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATEBUSSCHEDULER_H_ONCE */
@@ -0,0 +1,133 @@
+/*
+ MotateDelegate.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATEDELEGATE_H_ONCE
+#define MOTATEDELEGATE_H_ONCE
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Motate {
+
+    /* Delegate<R(Args...), N>: a callback for interrupt paths.
+     *
+     * This is used in place of std::function for callbacks that are called from
+     * interrupts. The callable (usually a lambda capturing this, or a reference or
+     * two) is stored inline in N bytes, so assigning one never allocates, and calling
+     * one is a single indirect call.
+     *
+     * The callable must fit in N bytes, and be trivially copyable and destructible,
+     * which is checked at compile time. Function pointers and lambdas that capture
+     * pointers, references, or plain values all qualify -- capture this (or [&]) and
+     * keep the state in the object. In return Delegate is itself trivially copyable.
+     */
+
+    template <typename Signature, std::size_t N = 2 * sizeof(void *)>
+    class Delegate;
+
+    template <typename R, typename... Args, std::size_t N>
+    class Delegate<R(Args...), N> {
+        typedef R (*invoker_t)(void *storage, Args... args);
+
+        invoker_t _invoker = nullptr;
+        alignas(std::max_align_t) mutable unsigned char _storage[N] {};
+
+        template <typename F>
+        static R _invoke(void *storage, Args... args) {
+            return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+        };
+
+        template <typename F>
+        void _assign(F &&f) {
+            typedef typename std::decay<F>::type callable_t;
+
+            static_assert(sizeof(callable_t) <= N,
+                          "Delegate: the callable (or its captures) doesn't fit -- capture less, or make N larger");
+            static_assert(alignof(callable_t) <= alignof(std::max_align_t),
+                          "Delegate: the callable is over-aligned");
+            static_assert(std::is_trivially_copyable<callable_t>::value && std::is_trivially_destructible<callable_t>::value,
+                          "Delegate: the callable must be trivially copyable -- capture pointers, references, or plain values");
+
+            // A null function pointer makes an empty Delegate, like std::function
+            if constexpr (std::is_pointer<callable_t>::value) {
+                if (f == nullptr) {
+                    _invoker = nullptr;
+                    return;
+                }
+            }
+
+            ::new (static_cast<void *>(_storage)) callable_t(std::forward<F>(f));
+            _invoker = &_invoke<callable_t>;
+        };
+
+       public:
+        constexpr Delegate() {};
+        constexpr Delegate(std::nullptr_t) {};
+
+        // A function passed by name takes this over the template, as a pointer. Bound to a
+        // reference (F&&), a weak function that nobody defined would be assumed not null.
+        Delegate(R (*function)(Args...)) {
+            _assign(function);
+        };
+
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Delegate>::value>::type>
+        Delegate(F &&f) {
+            _assign(std::forward<F>(f));
+        };
+
+        Delegate &operator=(std::nullptr_t) {
+            _invoker = nullptr;
+            return *this;
+        };
+
+        Delegate &operator=(R (*function)(Args...)) {
+            _assign(function);
+            return *this;
+        };
+
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Delegate>::value>::type>
+        Delegate &operator=(F &&f) {
+            _assign(std::forward<F>(f));
+            return *this;
+        };
+
+        // Like std::function, this is false if nothing has been assigned.
+        explicit operator bool() const { return _invoker != nullptr; };
+
+        // Unlike std::function, calling an empty Delegate is undefined -- check it first.
+        R operator()(Args... args) const {
+            return _invoker(_storage, std::forward<Args>(args)...);
+        };
+    };
+
+}  // namespace Motate
+
+#endif /* end of include guard: MOTATEDELEGATE_H_ONCE */
@@ -0,0 +1,268 @@
+/*
+ MotateInputCapture.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATEINPUTCAPTURE_H_ONCE
+#define MOTATEINPUTCAPTURE_H_ONCE
+
+#include <cstdint>
+#include <atomic>
+#include "MotateTimers.h"
+#include "MotateBuffer.h"
+#include "MotateDelegate.h"
+
+namespace Motate {
+
+    /* InputCapture<timerNum, queueSize, timestamp_t>: hardware timestamps of the edges on TIOA.
+     *
+     * Timer<timerNum> counts freely, and the hardware latches the count into RA or RB on
+     * each selected edge of the channel's TIOA pin, so the timestamps don't depend on how
+     * long the interrupt took to get there. The interrupt extends each one past the counter's
+     * width with a count of overflows (the counter is 16 bits on the S70 and the host, 32 on
+     * the Sam3x), queues it, and updates the measurements:
+     *
+     *  read(edge)         - the oldest queued edge (time and polarity), for decoding
+     *  getPeriod()        - ticks between the last two edges of the period's polarity
+     *  getHighTime()      - ticks from the last rising edge to the falling edge after it
+     *  getFrequency(), getDutyCycle(), getDutyFraction()
+     *  ticksSinceLastEdge(), isStale(ticks)
+     *                     - for telling a stopped spindle or encoder from a slow one
+     *
+     * The measurements are written by the interrupt under a sequence count and read without
+     * turning interrupts off. The queue is an SPSCBuffer, so one reader may drain it while
+     * the interrupt fills it. If it's full the edge is dropped (the measurements still see
+     * it) and dropped() counts it; if an edge is captured before the last one in its
+     * register was read, overruns() counts it.
+     *
+     * An overflow and a capture can be reported by the same interrupt in either order, so
+     * a capture in the top half of the counter range that comes with an overflow is taken
+     * to be from before it. That only holds if the interrupt (or now()) is serviced within
+     * half a counter wrap: 32768 ticks of a 16-bit counter -- 4.3ms on the S70, whose
+     * counter runs at MCK/8. timestamp_t can be uint64_t, for timestamps that don't wrap.
+     *
+     * The pin isn't set up here: put TIOA's pin on its timer function first (e.g. a
+     * Pin<n> constructed with kPeripheralB). The platform provides _InputCaptureHardware<timerNum>
+     * (see SamTimers.h and HostTimers.h).
+     */
+    template <uint8_t timerNum, uint16_t queueSize = 16, typename timestamp_t = uint32_t>
+    struct InputCapture {
+        typedef _InputCaptureHardware<timerNum> hardware_t;
+        static constexpr uint8_t counterBits = hardware_t::counterBits;
+        static constexpr uint32_t _halfRange = 1ul << (counterBits - 1);
+
+        struct edge_t {
+            timestamp_t time;
+            bool rising;
+        };
+
+        struct measurement_t {
+            timestamp_t lastEdge;
+            timestamp_t lastRise;
+            timestamp_t period;         // zero until there have been two edges of the period's polarity
+            timestamp_t highTime;       // zero until a falling edge has followed a rising one
+            uint32_t edges;
+        };
+
+        hardware_t _hardware {[&](uint32_t status) { _service(status); }};
+        SPSCBuffer<queueSize, edge_t> _queue;
+
+        TimerCaptureEdges _edges = kCaptureBothEdges;
+        uint32_t _tickFrequency = 0;
+        uint32_t _overflows = 0;
+
+        std::atomic<uint32_t> _sequence {0};  // odd while _measurement is being written
+        measurement_t _measurement {};
+        timestamp_t _lastFall = 0;
+
+        volatile uint32_t _dropped = 0;
+        volatile uint32_t _overruns = 0;
+
+        InputCapture() {};
+
+        InputCapture(const InputCapture &) = delete;
+        InputCapture &operator=(const InputCapture &) = delete;
+
+        // Start timestamping edges. Returns the tick frequency.
+        uint32_t start(const TimerCaptureEdges edges = kCaptureBothEdges) {
+            stop();
+
+            _edges = edges;
+            _overflows = 0;
+            _dropped = 0;
+            _overruns = 0;
+            _lastFall = 0;
+            _queue.consume(_queue.readableSpans().length());
+            _sequence.fetch_add(1, std::memory_order_relaxed);
+            _measurement = {};
+            _sequence.fetch_add(1, std::memory_order_release);
+
+            _tickFrequency = _hardware.start(edges);
+            return _tickFrequency;
+        };
+
+        void stop() {
+            _hardware.stop();
+        };
+
+        uint32_t getTickFrequency() const { return _tickFrequency; };
+
+        // The current time, on the same (extended) timeline as the edges
+        timestamp_t now() {
+            timestamp_t time = 0;
+            _hardware.poll([&](const uint32_t value, const uint32_t status) {
+                _service(status);
+                time = _extend(value, status & hardware_t::kOverflow);
+            });
+            return time;
+        };
+
+        // Take the oldest queued edge, returning false if there aren't any
+        bool read(edge_t &edge) { return _queue.read(&edge, 1) == 1; };
+        // Take up to count of the oldest queued edges, returning how many were taken
+        uint16_t read(edge_t *edges, const uint16_t count) { return _queue.read(edges, count); };
+        bool isEmpty() { return _queue.isEmpty(); };
+
+        uint32_t dropped() const { return _dropped; };
+        uint32_t overruns() const { return _overruns; };
+
+        // A consistent copy of the measurements, read without turning interrupts off
+        measurement_t getMeasurement() const {
+            measurement_t copy;
+            uint32_t before, after;
+            do {
+                before = _sequence.load(std::memory_order_acquire);
+                copy = _measurement;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = _sequence.load(std::memory_order_relaxed);
+            } while ((before != after) || (before & 1));
+            return copy;
+        };
+
+        // In ticks -- rising edge to rising edge, unless only falling edges are captured
+        timestamp_t getPeriod() const { return getMeasurement().period; };
+        timestamp_t getHighTime() const { return getMeasurement().highTime; };
+        uint32_t edges() const { return getMeasurement().edges; };
+
+        // In Hz, or 0 before there's a period
+        float getFrequency() const {
+            const timestamp_t period = getPeriod();
+            return (period > 0) ? ((float)_tickFrequency / (float)period) : 0.0;
+        };
+
+        // The high time over the period, 0.0 to 1.0, or 0 before there's one of each
+        float getDutyCycle() const {
+            const measurement_t m = getMeasurement();
+            return ((m.period > 0) && (m.highTime <= m.period)) ? ((float)m.highTime / (float)m.period) : 0.0;
+        };
+
+        // getDutyCycle() without floats, with 0x10000 for 100%
+        uint32_t getDutyFraction() const {
+            const measurement_t m = getMeasurement();
+            return ((m.period > 0) && (m.highTime <= m.period)) ? (((uint64_t)m.highTime << 16) / m.period) : 0;
+        };
+
+        timestamp_t ticksSinceLastEdge() {
+            return now() - getMeasurement().lastEdge;
+        };
+
+        // True if there's been no edge for more than ticks (or no edge at all)
+        bool isStale(const timestamp_t ticks) {
+            return (edges() == 0) || (ticksSinceLastEdge() > ticks);
+        };
+
+        // Extend a counter value read along with status -- see above for why the top half is special
+        timestamp_t _extend(const uint32_t value, const bool overflowed) const {
+            const uint32_t high = (overflowed && (value >= _halfRange)) ? (_overflows - 1) : _overflows;
+            return (timestamp_t)(((uint64_t)high << counterBits) | value);
+        };
+
+        // Called from the interrupt, or from now() with interrupts off, with the status that was read
+        void _service(const uint32_t status) {
+            const bool overflowed = status & hardware_t::kOverflow;
+            if (overflowed) {
+                _overflows++;
+            }
+            if (status & hardware_t::kOverrun) {
+                _overruns++;
+            }
+
+            edge_t captured[2];
+            uint8_t count = 0;
+            // RA always takes the first edge of a pair, which is the rising one when capturing both
+            if (status & hardware_t::kCaptureA) {
+                captured[count++] = {_extend(_hardware.getCaptureA(), overflowed), _edges != kCaptureFallingEdges};
+            }
+            if (status & hardware_t::kCaptureB) {
+                captured[count++] = {_extend(_hardware.getCaptureB(), overflowed), _edges == kCaptureRisingEdges};
+            }
+            if (count == 2 && (timestamp_t)(captured[1].time - captured[0].time) >= ((timestamp_t)1 << (sizeof(timestamp_t) * 8 - 1))) {
+                // B came first: the interrupt was late, and the next pair was started
+                const edge_t first = captured[1];
+                captured[1] = captured[0];
+                captured[0] = first;
+            }
+
+            for (uint8_t i = 0; i < count; i++) {
+                _record(captured[i]);
+            }
+        };
+
+        void _record(const edge_t &edge) {
+            if (_queue.write(&edge, 1) != 1) {
+                _dropped++;
+            }
+
+            const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+            _sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            measurement_t &m = _measurement;
+            if (edge.rising) {
+                if (m.edges > 0 && _edges != kCaptureFallingEdges) {
+                    m.period = edge.time - m.lastRise;
+                }
+                m.lastRise = edge.time;
+            } else {
+                if (m.edges > 0 && _edges == kCaptureFallingEdges) {
+                    m.period = edge.time - _lastFall;
+                }
+                if (m.edges > 0 && _edges == kCaptureBothEdges) {
+                    m.highTime = edge.time - m.lastRise;
+                }
+                _lastFall = edge.time;
+            }
+            m.lastEdge = edge.time;
+            m.edges++;
+
+            _sequence.store(sequence + 2, std::memory_order_release);
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATEINPUTCAPTURE_H_ONCE */
@@ -0,0 +1,210 @@
+/*
+ MotatePWMWaveformPlayer.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATEPWMWAVEFORMPLAYER_H_ONCE
+#define MOTATEPWMWAVEFORMPLAYER_H_ONCE
+
+#include <cstdint>
+#include "MotatePins.h"
+#include "MotateTimers.h"
+#include "MotateDelegate.h"
+
+namespace Motate {
+
+    /* PWMWaveformPlayer<pinNums...>: duty cycles played from memory by the DMA.
+     *
+     * The pins run as a PWMOutputGroup, and the DMA writes the next duty cycle of every
+     * one of them at the start of each frame -- every periodsPerFrame periods of channel
+     * 0. The CPU isn't involved per frame, only once per buffer, so laser power ramps,
+     * dithered spindle speeds, or WS2812-style bit streams (one bit per period, with a
+     * short or long high time) come out exactly on time, without an interrupt per period.
+     *
+     * A frame is one duty cycle (in counts, 0 .. getTopValue()) for each PWM channel in
+     * the group, in channel order -- not pin order -- and channel 0 always has one, since
+     * the group runs it even if none of the pins are on it. frameSize is how many values
+     * that is, and frameIndex(i) is where the i'th pin's value goes.
+     *
+     *  player.play(frames, count)  - play count frames once, then hold the last duty cycles
+     *  player.loop(frames, count)  - play count frames over and over until stop()
+     *  player.stream(a, b, count, refill)
+     *                              - play buffers a and b (count frames each) in turn,
+     *                                calling refill(buffer) from the interrupt to refill each
+     *                                one as it finishes. refill returns false when there's
+     *                                no more, and the other buffer is the last one played.
+     *
+     * Each returns false, and leaves anything already playing alone, if there are no frames or
+     * count * frameSize is more than 65535 values (a buffer's length is 16 bits, like the
+     * PDC's counter).
+     *
+     * refill has to be done before the other buffer runs out. If it isn't, the PDC (Sam3x)
+     * stops until the refilled buffer is handed back, and underruns() counts it. The S70
+     * XDMAC ring never stops, so it can't tell -- it comes back around to the stale buffer.
+     * The XDMAC ring can't be told to end either, so when a stream ends the player stops
+     * it at the end of the last buffer, and the first frame of the one after may get out.
+     * End WS2812 data with a few all-zero frames (which is also the reset/latch time).
+     *
+     * The platform provides _PWMWaveformHardware<moduleNum> (see SamTimers.h and HostTimers.h).
+     */
+    template<pin_number... pinNums>
+    struct PWMWaveformPlayer {
+        typedef PWMOutputGroup<pinNums...> group_t;
+        typedef _PWMWaveformHardware<group_t::module_num> hardware_t;
+
+        static constexpr uint8_t _bitsIn(const uint32_t mask) {
+            return (mask == 0) ? 0 : ((mask & 1) + _bitsIn(mask >> 1));
+        };
+
+        static constexpr uint8_t frameSize = _bitsIn(group_t::channel_mask);
+
+        // Where the i'th pin's duty cycle goes in each frame
+        static constexpr uint8_t frameIndex(const uint8_t i) {
+            return _bitsIn(group_t::channel_mask & ((1u << group_t::channels[i]) - 1));
+        };
+
+        group_t _group;
+        hardware_t _hardware {[&]() { _bufferDone(); }};
+
+        uint16_t *_buffers[2] = {nullptr, nullptr};
+        uint16_t _length = 0;           // of each buffer, in values (frames * frameSize)
+        uint8_t _pending = 0;           // the buffer that will finish next
+        Delegate<bool(uint16_t *)> _refill;
+        volatile bool _playing = false;
+        volatile bool _finishing = false;
+        volatile uint32_t _underruns = 0;
+
+        PWMWaveformPlayer(const uint32_t freq = kDefaultPWMFrequency, const uint8_t periodsPerFrame = 1) : _group{freq} {
+            _group._master.setSyncMode(kTimerSyncDMA, periodsPerFrame);
+        };
+
+        PWMWaveformPlayer(const PWMWaveformPlayer &) = delete;
+        PWMWaveformPlayer &operator=(const PWMWaveformPlayer &) = delete;
+
+        uint32_t getTopValue() { return _group.getTopValue(); };
+        group_t &group() { return _group; };
+
+        bool play(const uint16_t *frames, const uint16_t frameCount) {
+            if (!_begin(frames, frames, frameCount, nullptr)) {
+                return false;
+            }
+            _finishing = true;
+            _hardware.startOnce(_buffers[0], _length);
+            return true;
+        };
+
+        bool loop(const uint16_t *frames, const uint16_t frameCount) {
+            if (!_begin(frames, frames, frameCount, nullptr)) {
+                return false;
+            }
+            _hardware.startRing(_buffers[0], _buffers[1], _length);
+            return true;
+        };
+
+        // Both buffers are filled (by refill) before it starts.
+        // Also returns false if refill had nothing at all to play.
+        bool stream(uint16_t *bufferA, uint16_t *bufferB, const uint16_t frameCount, const Delegate<bool(uint16_t *)> &refill) {
+            if (!_begin(bufferA, bufferB, frameCount, refill)) {
+                return false;
+            }
+            if (!_refill(bufferA)) {
+                _playing = false;
+                return false;
+            }
+            if (!_refill(bufferB)) {
+                _finishing = true;
+                _hardware.startOnce(bufferA, _length);
+                return true;
+            }
+            _hardware.startRing(bufferA, bufferB, _length);
+            return true;
+        };
+
+        // The outputs hold whatever duty cycles they had last
+        void stop() {
+            _hardware.stop();
+            _playing = false;
+        };
+
+        bool isPlaying() const { return _playing; };
+        uint32_t underruns() const { return _underruns; };
+
+        // _length is only 16 bits, so check that before anything is stopped
+        bool _begin(const uint16_t *bufferA, const uint16_t *bufferB, const uint16_t frameCount, const Delegate<bool(uint16_t *)> &refill) {
+            const uint32_t length = (uint32_t)frameCount * frameSize;
+            if ((length == 0) || (length > 0xFFFF)) {
+                return false;
+            }
+            stop();
+            _buffers[0] = (uint16_t *)bufferA;
+            _buffers[1] = (uint16_t *)bufferB;
+            _length = length;
+            _pending = 0;
+            _refill = refill;
+            _finishing = false;
+            _underruns = 0;
+            _playing = true;
+            return true;
+        };
+
+        void _end() {
+            _finishing = true;
+            _hardware.finish();
+        };
+
+        // Called from the end-of-buffer interrupt
+        void _bufferDone() {
+            if (_finishing) {
+                stop();
+                return;
+            }
+
+            uint16_t * const done = _buffers[_pending];
+            if (_refill && !_refill(done)) {
+                _end();
+                return;
+            }
+            if (_hardware.requeue(done, _length)) {
+                _pending ^= 1;
+                return;
+            }
+
+            // The other buffer ran out before we got here, and the DMA stopped. The one we just
+            // handed back is playing now (and will finish next), so queue the other behind it.
+            _underruns++;
+            uint16_t * const other = _buffers[_pending ^ 1];
+            if (_refill && !_refill(other)) {
+                _end();
+                return;
+            }
+            _hardware.requeue(other, _length);
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATEPWMWAVEFORMPLAYER_H_ONCE */
@@ -32,6 +32,8 @@
 
 #include <cinttypes>
 #include <algorithm> // for std::conditional
+#include <utility>   // for std::index_sequence
+#include <tuple>     // for PWMOutputGroup
 
 /* After some setup, we call the processor-specific bits, then we have the
  * any-processor parts.
@@ -174,6 +176,10 @@ namespace Motate {
 #include <Freescale_klxx/KL05ZPins.h>
 #endif
 
+#if defined(__HOST_SIM__)
+#include <HostPins.h>
+#endif
+
 
 namespace Motate {
 
@@ -291,6 +297,217 @@ namespace Motate {
     };
 
 
+#pragma mark PinGroup
+    /**************************************************
+     *
+     * MULTI-PIN OUTPUT: PinGroup
+     *
+     * PinGroup<pinNums...> drives a handful of pins as one value: bit n of the
+     * value is the n'th pin in the list. Pins can be on any mix of ports.
+     *
+     * The per-port masks, and the shifts to move each bit of the value to its pin,
+     * are worked out at compile time. Then each call touches each port once, so
+     * the pins on a port all change at the same instant:
+     *
+     *  group.set(bits)   - set the pins for the 1s in bits (SODR), leave the rest
+     *  group.clear(bits) - clear the pins for the 1s in bits (CODR), leave the rest
+     *  group.write(value) or group = value - every pin takes its bit (ODSR)
+     *
+     * Pins on the same port with the same distance between their bit in the value
+     * and their bit in the port are moved with one mask and one shift, so a bus
+     * laid out in order on a port costs the same as one pin.
+     *
+     * Null pins (-1, or pins the board doesn't have) are skipped, like Pin<>.
+     *
+     * It's built on PortHardware<>, so it's on the SAM parts and host_sim only. The
+     * XMega's Port8 and the KL05Z's Port32 don't have that interface.
+     *
+     **************************************************/
+
+#if defined(__AVR_XMEGA__) || defined(__KL05Z__)
+
+    template<pin_number... pinNums>
+    struct PinGroup {
+        static_assert(sizeof...(pinNums) != sizeof...(pinNums),
+                      "PinGroup<>: needs PortHardware<> (SAM or host_sim) -- there's no XMega Port8 or KL05Z Port32 version.");
+    };
+
+#else
+
+    template<pin_number... pinNums>
+    struct PinGroup {
+        static constexpr uint8_t count = sizeof...(pinNums);
+        static_assert((count > 0) && (count <= 32), "PinGroup<>: must have between 1 and 32 pins.");
+
+        static constexpr int16_t  _numbers[count]     = {pinNums...};
+        static constexpr uint8_t  _portLetters[count] = {Pin<pinNums>::portLetter...};
+        static constexpr uint32_t _masks[count]       = {Pin<pinNums>::mask...};
+
+        // The pins on otherPortLetter, as a port mask
+        static constexpr uint32_t maskForPort(const uint8_t otherPortLetter) {
+            return (0u | ... | (uint32_t)Pin<pinNums>::maskForPort(otherPortLetter));
+        };
+
+        // One "mask and shift" for the value, and all of the shifts for a port
+        struct _scatter_term_t {
+            uint32_t value_mask;
+            int8_t shift; // port bit - value bit
+        };
+        struct _port_scatter_t {
+            _scatter_term_t terms[count];
+            uint8_t term_count;
+        };
+
+        static constexpr _port_scatter_t _scatterFor(const uint8_t portLetter) {
+            _port_scatter_t scatter {};
+            for (uint8_t i = 0; i < count; i++) {
+                if ((_portLetters[i] != portLetter) || (_masks[i] == 0)) {
+                    continue;
+                }
+                const int8_t shift = __builtin_ctz(_masks[i]) - i;
+                uint8_t t = 0;
+                while ((t < scatter.term_count) && (scatter.terms[t].shift != shift)) {
+                    t++;
+                }
+                if (t == scatter.term_count) {
+                    scatter.terms[t] = {0, shift};
+                    scatter.term_count++;
+                }
+                scatter.terms[t].value_mask |= (1u << i);
+            }
+            return scatter;
+        };
+
+        // The first pin on each port is the one that handles that port
+        static constexpr bool _handlesPort(const uint8_t i) {
+            if (_masks[i] == 0) {
+                return false;
+            }
+            for (uint8_t j = 0; j < i; j++) {
+                if ((_masks[j] != 0) && (_portLetters[j] == _portLetters[i])) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        template <uint8_t portLetter, std::size_t t>
+        static constexpr uint32_t _toPortTerm(const uint32_t value) {
+            constexpr _scatter_term_t term = _scatterFor(portLetter).terms[t];
+            if constexpr (term.shift >= 0) {
+                return (value & term.value_mask) << term.shift;
+            } else {
+                return (value & term.value_mask) >> -term.shift;
+            }
+        };
+
+        template <uint8_t portLetter, std::size_t t>
+        static constexpr uint32_t _fromPortTerm(const uint32_t port_value) {
+            constexpr _scatter_term_t term = _scatterFor(portLetter).terms[t];
+            if constexpr (term.shift >= 0) {
+                return (port_value >> term.shift) & term.value_mask;
+            } else {
+                return (port_value << -term.shift) & term.value_mask;
+            }
+        };
+
+        template <uint8_t portLetter, std::size_t... t>
+        static constexpr uint32_t _toPort(const uint32_t value, std::index_sequence<t...>) {
+            return (0u | ... | _toPortTerm<portLetter, t>(value));
+        };
+
+        template <uint8_t portLetter, std::size_t... t>
+        static constexpr uint32_t _fromPort(const uint32_t port_value, std::index_sequence<t...>) {
+            return (0u | ... | _fromPortTerm<portLetter, t>(port_value));
+        };
+
+        // Move the bits of value to where they go on portLetter (and back)
+        template <uint8_t portLetter>
+        static constexpr uint32_t toPort(const uint32_t value) {
+            return _toPort<portLetter>(value, std::make_index_sequence<_scatterFor(portLetter).term_count>{});
+        };
+        template <uint8_t portLetter>
+        static constexpr uint32_t fromPort(const uint32_t port_value) {
+            return _fromPort<portLetter>(port_value, std::make_index_sequence<_scatterFor(portLetter).term_count>{});
+        };
+
+        // Call action(port, port_mask, portLetter-as-a-type) once for each port that has pins
+        template <std::size_t i, typename action_t>
+        static void _onPortOf(action_t &&action) {
+            if constexpr (_handlesPort(i)) {
+                constexpr uint8_t portLetter = _portLetters[i];
+                PortHardware<portLetter> port;
+                action(port, maskForPort(portLetter), std::integral_constant<uint8_t, portLetter>{});
+            }
+        };
+        template <typename action_t, std::size_t... i>
+        static void _eachPort(action_t &&action, std::index_sequence<i...>) {
+            (_onPortOf<i>(action), ...);
+        };
+        template <typename action_t>
+        static void _eachPort(action_t &&action) {
+            _eachPort(action, std::make_index_sequence<count>{});
+        };
+
+        PinGroup() {};
+        PinGroup(const PinMode type, const PinOptions_t options = kNormal) {
+            init(type, options);
+        };
+
+        void init(const PinMode type, const PinOptions_t options = kNormal) {
+            _eachPort([&](auto &port, const uint32_t port_mask, auto) {
+                port.setModes(type, port_mask);
+                port.setOptions(options, port_mask);
+            });
+        };
+
+        // Set the pins for the 1 bits, the rest are unchanged
+        void set(const uint32_t bits = 0xFFFFFFFF) {
+            _eachPort([&](auto &port, const uint32_t, auto letter) {
+                const uint32_t port_bits = toPort<decltype(letter)::value>(bits);
+                if (port_bits) {
+                    port.set(port_bits);
+                }
+            });
+        };
+
+        // Clear the pins for the 1 bits, the rest are unchanged
+        void clear(const uint32_t bits = 0xFFFFFFFF) {
+            _eachPort([&](auto &port, const uint32_t, auto letter) {
+                const uint32_t port_bits = toPort<decltype(letter)::value>(bits);
+                if (port_bits) {
+                    port.clear(port_bits);
+                }
+            });
+        };
+
+        // Every pin takes its bit of value
+        void write(const uint32_t value) {
+            _eachPort([&](auto &port, const uint32_t port_mask, auto letter) {
+                port.write(toPort<decltype(letter)::value>(value), port_mask);
+            });
+        };
+        void operator=(const uint32_t value) { write(value); };
+
+        uint32_t getInputValue() {
+            uint32_t value = 0;
+            _eachPort([&](auto &port, const uint32_t port_mask, auto letter) {
+                value |= fromPort<decltype(letter)::value>(port.getInputValues(port_mask));
+            });
+            return value;
+        };
+        uint32_t getOutputValue() {
+            uint32_t value = 0;
+            _eachPort([&](auto &port, const uint32_t port_mask, auto letter) {
+                value |= fromPort<decltype(letter)::value>(port.getOutputValues(port_mask));
+            });
+            return value;
+        };
+    };
+
+#endif // PinGroup needs PortHardware
+
+
 #pragma mark IRQPin / LookupIRQPin
     /**************************************************
      *
@@ -313,8 +530,8 @@ namespace Motate {
 
         IRQPin() : Pin<pinNum>(kInput) {};
         IRQPin(const PinOptions_t options) : Pin<pinNum>(kInput, options) {};
-        IRQPin(const std::function<void(void)> &&_interrupt) : Pin<pinNum>(kInput) {};
-        IRQPin(const PinOptions_t options, const std::function<void(void)> &&_interrupt, const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium) : Pin<pinNum>(kInput, options) {};
+        IRQPin(Delegate<void(void)> &&_interrupt) : Pin<pinNum>(kInput) {};
+        IRQPin(const PinOptions_t options, Delegate<void(void)> &&_interrupt, const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium) : Pin<pinNum>(kInput, options) {};
 
         void init(const PinOptions_t options = kNormal  ) {Pin<pinNum>::init(kInput, options);};
 
@@ -322,7 +539,7 @@ namespace Motate {
 
         void setInterrupts(const uint32_t interrupts) {};
         static void interrupt() __attribute__ (( weak, unused ));
-        void setInterruptHandler(std::function<void(void)> &&handler) {};
+        void setInterruptHandler(const Delegate<void(void)> &handler) {};
     };
 
     // This is the REAL IRQPin defintition, and is used only wehn the pin is really defined.
@@ -335,7 +552,7 @@ namespace Motate {
 
         IRQPin()
         : Pin<pinNum>(kInput),
-        _pinChangeInterrupt(Pin<pinNum>::mask, interrupt, PortHardware<Pin<pinNum>::portLetter>::_firstInterrupt)
+        _pinChangeInterrupt(Pin<pinNum>::mask, &interrupt, PortHardware<Pin<pinNum>::portLetter>::_interrupts)
         {
             setInterrupts(kPinInterruptOnChange|kPinInterruptPriorityMedium);
         };
@@ -344,26 +561,26 @@ namespace Motate {
                const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium
                )
         : Pin<pinNum>(kInput, options),
-        _pinChangeInterrupt(Pin<pinNum>::mask, interrupt, PortHardware<Pin<pinNum>::portLetter>::_firstInterrupt)
+        _pinChangeInterrupt(Pin<pinNum>::mask, &interrupt, PortHardware<Pin<pinNum>::portLetter>::_interrupts)
         {
             setInterrupts(interrupt_settings);
         };
 
-        IRQPin(std::function<void(void)> &&_interrupt,
+        IRQPin(Delegate<void(void)> &&_interrupt,
                const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium
                )
         : Pin<pinNum>(kInput),
-        _pinChangeInterrupt(Pin<pinNum>::mask, std::move(_interrupt), PortHardware<Pin<pinNum>::portLetter>::_firstInterrupt)
+        _pinChangeInterrupt(Pin<pinNum>::mask, std::move(_interrupt), PortHardware<Pin<pinNum>::portLetter>::_interrupts)
         {
             setInterrupts(interrupt_settings);
         };
 
         IRQPin(const PinOptions_t options,
-               std::function<void(void)> &&_interrupt,
+               Delegate<void(void)> &&_interrupt,
                const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium
                )
         : Pin<pinNum>(kInput, options),
-        _pinChangeInterrupt(Pin<pinNum>::mask, std::move(_interrupt), PortHardware<Pin<pinNum>::portLetter>::_firstInterrupt)
+        _pinChangeInterrupt(Pin<pinNum>::mask, std::move(_interrupt), PortHardware<Pin<pinNum>::portLetter>::_interrupts)
         {
             setInterrupts(interrupt_settings);
         };
@@ -386,10 +603,7 @@ namespace Motate {
         static void interrupt() __attribute__ (( weak ));
 
         // Inferface option 2: call this function with your closure or function pointer
-        void setInterruptHandler(std::function<void(void)> &&handler) {
-            _pinChangeInterrupt::setInterrupt(std::move(handler)); // enable interrupts and set the priority
-        };
-        void setInterruptHandler(const std::function<void(void)> &handler) {
+        void setInterruptHandler(const Delegate<void(void)> &handler) {
             _pinChangeInterrupt::setInterrupt(handler); // enable interrupts and set the priority
         };
     };
@@ -488,8 +702,7 @@ namespace Motate {
 //        void setInterrupts(const uint32_t interrupts) { };
 //
 //        static void interrupt() __attribute__ (( weak ));
-//        void setInterruptHandler(std::function<void(void)> &&handler) { };
-//        void setInterruptHandler(const std::function<void(void)> &handler) { };
+//        void setInterruptHandler(const Delegate<void(void)> &handler) { };
 
     };
 
@@ -509,7 +722,7 @@ namespace Motate {
         using ADCPinParent<pinNum>::setVoltageRangePin;
 
         ADCPin() : ADCPinParent<pinNum>(), Pin<pinNum>(kInput),
-        _pinChangeInterrupt(adcMask, interrupt, ADCPinParent<pinNum>::_firstInterrupt)
+        _pinChangeInterrupt(adcMask, &interrupt, ADCPinParent<pinNum>::_interrupts)
         {
             init();
             setInterrupts(kPinInterruptOnChange|kPinInterruptPriorityMedium);
@@ -520,19 +733,19 @@ namespace Motate {
                )
         : ADCPinParent<pinNum>(),
         Pin<pinNum>(kInput, options),
-        _pinChangeInterrupt(adcMask, interrupt, ADCPinParent<pinNum>::_firstInterrupt)
+        _pinChangeInterrupt(adcMask, &interrupt, ADCPinParent<pinNum>::_interrupts)
         {
             init(options);
             setInterrupts(interrupt_settings);
         };
 
         ADCPin(const PinOptions_t options,
-               std::function<void(void)> &&_interrupt,
+               Delegate<void(void)> &&_interrupt,
                const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium
                )
         : ADCPinParent<pinNum>(),
         Pin<pinNum>(kInput, options),
-        _pinChangeInterrupt(adcMask, std::move(_interrupt), ADCPinParent<pinNum>::_firstInterrupt)
+        _pinChangeInterrupt(adcMask, std::move(_interrupt), ADCPinParent<pinNum>::_interrupts)
         {
             init(options);
             setInterrupts(interrupt_settings);
@@ -589,10 +802,7 @@ namespace Motate {
         static void interrupt() __attribute__ (( weak ));
 
         // Inerrupt inferface option 2: call this function with your closure or function pointer
-        void setInterruptHandler(std::function<void(void)> &&handler) {
-            _pinChangeInterrupt::setInterrupt(std::move(handler)); // enable interrupts and set the priority
-        };
-        void setInterruptHandler(const std::function<void(void)> &handler) {
+        void setInterruptHandler(const Delegate<void(void)> &handler) {
             _pinChangeInterrupt::setInterrupt(handler); // enable interrupts and set the priority
         };
     };
@@ -659,8 +869,7 @@ namespace Motate {
 //        void setInterrupts(const uint32_t interrupts) { };
 //
 //        static void interrupt() __attribute__ (( weak ));
-//        void setInterruptHandler(std::function<void(void)> &&handler) { };
-//        void setInterruptHandler(const std::function<void(void)> &handler) { };
+//        void setInterruptHandler(const Delegate<void(void)> &handler) { };
 //#else
 //        static_assert(false, "Tried to use a fake ADCDifferentialPair!");
 //#endif
@@ -693,7 +902,7 @@ namespace Motate {
         : ADCPinParent<negPinNum>(),
           Pin<negPinNum>(kInput),
           Pin<posPinNum>(kInput),
-          _pinChangeInterrupt(adcMask, interrupt, ADCPinParent<negPinNum>::_firstInterrupt)
+          _pinChangeInterrupt(adcMask, &interrupt, ADCPinParent<negPinNum>::_interrupts)
         {
             init(kDifferentialPair);
             setInterrupts(kPinInterruptOnChange|kPinInterruptPriorityMedium);
@@ -705,20 +914,20 @@ namespace Motate {
         : ADCPinParent<negPinNum>(),
           Pin<negPinNum>(kInput),
           Pin<posPinNum>(kInput),
-          _pinChangeInterrupt(adcMask, interrupt, ADCPinParent<negPinNum>::_firstInterrupt)
+          _pinChangeInterrupt(adcMask, &interrupt, ADCPinParent<negPinNum>::_interrupts)
         {
             init(options);
             setInterrupts(interrupt_settings);
         };
 
         ADCDifferentialPair(const PinOptions_t options,
-                            std::function<void(void)> &&_interrupt,
+                            Delegate<void(void)> &&_interrupt,
                             const uint32_t interrupt_settings = kPinInterruptOnChange|kPinInterruptPriorityMedium
                             )
         : ADCPinParent<negPinNum>(),
           Pin<negPinNum>(kInput),
           Pin<posPinNum>(kInput),
-          _pinChangeInterrupt(adcMask, std::move(_interrupt), ADCPinParent<negPinNum>::_firstInterrupt)
+          _pinChangeInterrupt(adcMask, std::move(_interrupt), ADCPinParent<negPinNum>::_interrupts)
         {
             init(options);
             setInterrupts(interrupt_settings);
@@ -775,10 +984,7 @@ namespace Motate {
         static void interrupt() __attribute__ (( weak ));
 
         // Inerrupt inferface option 2: call this function with your closure or function pointer
-        void setInterruptHandler(std::function<void(void)> &&handler) {
-            _pinChangeInterrupt::setInterrupt(std::move(handler)); // enable interrupts and set the priority
-        };
-        void setInterruptHandler(const std::function<void(void)> &handler) {
+        void setInterruptHandler(const Delegate<void(void)> &handler) {
             _pinChangeInterrupt::setInterrupt(handler); // enable interrupts and set the priority
         };
 
@@ -919,6 +1125,117 @@ namespace Motate {
     };
 
 
+#pragma mark PWMOutputGroup
+    /**************************************************
+     *
+     * SYNCHRONOUS PWM OUTPUTS: PWMOutputGroup
+     *
+     * PWMOutputGroup<pinNums...> runs several PWMOutputPins as synchronous PWM
+     * channels: they share channel 0's counter and period, and new duty cycles
+     * for any of them take effect together, at the start of a period:
+     *
+     *  group.stage(i, fraction) - the i'th pin's next duty cycle, 0 .. 0x10000 (100%)
+     *  group.stageRaw(i, duty)  - the same in counts, 0 .. getTopValue()
+     *  group.commit()           - everything staged takes effect at the next period
+     *  group.write({...})       - stage every pin, then commit
+     *
+     * Until commit(), the outputs keep their old duty cycles no matter how long the
+     * staging takes, so heaters, spindles and LED drivers never see half of an
+     * update. Duty cycles are computed with integer math only.
+     *
+     * Staging while an earlier commit() is pending would join that update, so
+     * check isCommitPending() first (write() refuses, and returns false).
+     *
+     * The pins must all be on PWMTimer channels of one PWM module -- TC outputs
+     * don't have update registers to synchronize. Channel 0 sets the period of
+     * the whole group, so the group takes it over, even if none of the pins use it.
+     *
+     **************************************************/
+
+    template<pin_number... pinNums>
+    struct PWMOutputGroup {
+        static constexpr uint8_t count = sizeof...(pinNums);
+        static_assert((count > 0) && (count <= 8), "PWMOutputGroup<>: must have between 1 and 8 pins.");
+        static_assert((PWMOutputPin<pinNums>::parentTimerType::can_sync && ...), "PWMOutputGroup<>: every pin must be on a PWM channel that can sync.");
+
+        typedef typename std::tuple_element<0, std::tuple<typename PWMOutputPin<pinNums>::parentTimerType...>>::type _firstTimer;
+        static constexpr uint8_t module_num = _firstTimer::peripheral_num;
+        static_assert(((PWMOutputPin<pinNums>::parentTimerType::peripheral_num == module_num) && ...), "PWMOutputGroup<>: every pin must be on the same PWM module.");
+
+        // The PWM channel of each pin, and every channel the group runs (always including channel 0)
+        static constexpr uint8_t channels[count] = {PWMOutputPin<pinNums>::parentTimerType::timer_num...};
+        static constexpr uint32_t channel_mask = (1u | ... | (1u << PWMOutputPin<pinNums>::parentTimerType::timer_num));
+
+        PWMTimer<module_num, 0> _master;
+        std::tuple<PWMOutputPin<pinNums>...> _pins;
+
+        // Call action(pin, index) for each pin
+        template <typename action_t, std::size_t... i>
+        void _eachPin(action_t &&action, std::index_sequence<i...>) {
+            (action(std::get<i>(_pins), (uint8_t)i), ...);
+        };
+        template <typename action_t>
+        void _eachPin(action_t &&action) {
+            _eachPin(action, std::make_index_sequence<count>{});
+        };
+
+        PWMOutputGroup(const uint32_t freq = kDefaultPWMFrequency) {
+            setFrequency(freq);
+        };
+
+        // All of the channels stop while they're changed, then start again together, at zero duty
+        // cycle. The end of the first period is an update, so isCommitPending() is true until then.
+        void setFrequency(const uint32_t freq) {
+            _master.stop();
+            _eachPin([&](auto &pin, uint8_t) {
+                pin.stop();
+                pin.setSync(true);
+                pin.setModeAndFrequency(kTimerUpToMatch, freq);
+                pin.setExactDutyCycle(0);
+            });
+            _master.setSync(true);
+            _master.setModeAndFrequency(kTimerUpToMatch, freq);
+            _master.setSyncMode(kTimerSyncManualUpdate);
+            _master.start(); // starts every synchronous channel
+        };
+
+        // Channel 0's, which is the period of every pin
+        uint32_t getTopValue() { return _master.getTopValue(); };
+
+        template <uint8_t i>
+        auto &pin() { return std::get<i>(_pins); };
+
+        void stageRaw(const uint8_t index, const uint32_t duty) {
+            _eachPin([&](auto &pin, uint8_t i) {
+                if (i == index) {
+                    pin.setExactDutyCycle(duty);
+                }
+            });
+        };
+
+        // The period is at most 16 bits, so top * fraction fits in 32 bits
+        void stage(const uint8_t index, uint32_t fraction) {
+            if (fraction > 0x10000) { fraction = 0x10000; }
+            stageRaw(index, (getTopValue() * fraction) >> 16);
+        };
+
+        void commit() { _master.triggerSyncUpdate(); };
+        bool isCommitPending() { return _master.isSyncUpdatePending(); };
+
+        // Returns false, and stages nothing, if the last commit() hasn't happened yet
+        bool write(const uint32_t (&fractions)[count]) {
+            if (isCommitPending()) {
+                return false;
+            }
+            for (uint8_t i = 0; i < count; i++) {
+                stage(i, fractions[i]);
+            }
+            commit();
+            return true;
+        };
+    };
+
+
 #pragma mark SPIChipSelectPin / SPIMISOPin / SPIMOSIPin / SPISCKPin
     /**************************************************
      *
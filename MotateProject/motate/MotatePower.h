@@ -64,4 +64,8 @@ namespace Motate {
 //#include <Freescale_klxx/KL05ZPower.h>
 #endif
 
+#if defined(__HOST_SIM__)
+#include <HostPower.h>
+#endif
+
 #endif /* end of include guard: MOTATEPOWER_H_ONCE */
\ No newline at end of file
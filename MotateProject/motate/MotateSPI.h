@@ -32,7 +32,9 @@
 
 #include <cinttypes>
 #include "MotateCommon.h"
+#include "MotateDelegate.h"
 #include "MotateServiceCall.h"
+#include "MotateBusScheduler.h"
 
 
 /* After some setup, we call the processor-specific bits, then we have the
@@ -46,6 +48,9 @@
  * Whatever type that returns must also be defined, such as:
  *
  * template<uint8_t uartPeripheralNumber> struct _SPIHardware
+ *
+ * That type must provide maxChainedTransfers, and a startTransfer() that takes an array of
+ * (up to that many) SPITransferBlocks and sends them as one transfer, interrupting once at the end.
 
  * Using the wikipedia deifinition of "normal phase," see:
  *   http://en.wikipedia.org/wiki/Serial_Peripheral_Interface_Bus#Clock_polarity_and_phase
@@ -108,6 +113,15 @@ namespace Motate {
 
     struct SPIInterrupt : Interrupt {
     };
+
+    // One message's worth of a transfer, as handed to the hardware. Several of these may be
+    // chained into one transfer (up to the hardware's maxChainedTransfers), with CS held
+    // asserted from the start of the first to the end of the last.
+    struct SPITransferBlock {
+        uint8_t *tx_buffer;
+        uint8_t *rx_buffer;
+        uint16_t size;
+    };
 } // namespace Motate
 
 #include <ProcessorSPI.h>
@@ -123,21 +137,21 @@ namespace Motate {
 
     struct SPIMessage;
 
-    struct SPIBusDeviceBase
+    struct SPIBusDeviceBase : BusDeviceQueue<SPIMessage>
     {
         // store a link to the next device on the bus (maintained by the Bus)
         SPIBusDeviceBase *_next_device = 0;
 
         // set device options
         virtual void setOptions(const uint32_t baud, const uint16_t options, uint32_t min_between_cs_delay_ns, uint32_t cs_to_sck_delay_ns, uint32_t between_word_delay_ns) {};
-        // queue message
-        virtual void queueMessage(SPIMessage *msg) {};
+        // queue message, returns false if this device's queue is full (see BusDeviceQueue)
+        virtual bool queueMessage(SPIMessage *msg) { return false; };
         // return a value that can be used by hardware to select this device
         virtual uint32_t getChannel() { return 0; };
     };
 
     // useful verbose enums
-    struct SPIMessage
+    struct SPIMessage : BusMessageScheduling<SPIMessage>
     {
         enum {
             RemainAsserted = false,
@@ -164,9 +178,8 @@ namespace Motate {
 
 
         SPIBusDeviceBase *device;
-        SPIMessage * volatile next_message;
 
-        std::function<void(void)> message_done_callback;
+        Delegate<void(void)> message_done_callback; // called from the SPI interrupt
         volatile State state = State::Idle;
 
 
@@ -186,6 +199,30 @@ namespace Motate {
         }
     };
 
+    // A pool of SPIMessages for the drivers on a bus, see BusMessagePool in MotateBusScheduler.h
+    template <uint8_t capacity>
+    using SPIMessagePool = BusMessagePool<SPIMessage, capacity>;
+    using SPIMessageHandle = BusMessageHandle<SPIMessage>;
+
+#pragma mark SPIStreamBase
+    /**************************************************
+     *
+     * SPI Stream Base, the part of an SPIStream (see MotateSPIStream.h) that the bus uses
+     *
+     **************************************************/
+
+    struct SPIStreamBase
+    {
+        SPIBusDeviceBase *device;
+
+        SPIStreamBase(SPIBusDeviceBase *_device) : device{_device} {};
+
+        // Called by the bus, from its interrupt level, once the stream has the bus (and CS is selected)
+        virtual void _streamStart() {};
+        // Called from the SPI interrupt for as long as the stream has the bus
+        virtual void _streamInterrupt(const uint16_t interruptCause) {};
+    };
+
     // attach device to spi bus
 
 #pragma mark SPIBus
@@ -217,16 +254,25 @@ namespace Motate {
         SPIMOSIPin<spiMOSIPinNumber> mosiPin {};
         SPISCKPin<spiSCKPinNumber> sckPin {};
 
-        SPIGetHardware<spiMISOPinNumber, spiMOSIPinNumber, spiSCKPinNumber> hardware;
+        using hardware_t = SPIGetHardware<spiMISOPinNumber, spiMOSIPinNumber, spiSCKPinNumber>;
+        hardware_t hardware;
 
         ServiceCall message_manager;
 
 
-        SPIBusDeviceBase *_first_device, *_current_transaction_device;
-        SPIMessage * volatile _first_message;//, *_last_message;
+        SPIBusDeviceBase *_first_device = nullptr, *_current_transaction_device = nullptr;
+        BusScheduler<SPIMessage> _scheduler; // the queued messages, see MotateBusScheduler.h
 
         volatile bool sending = false; // as long as this is true, sendNextMessage() does nothing
 
+        // The messages in the transfer that's in flight, in the order they are being sent
+        SPIMessage *_batch[hardware_t::maxChainedTransfers];
+        uint8_t _batch_count = 0;
+
+        // The stream that has the bus (once _streaming), or is waiting for it
+        SPIStreamBase * volatile _stream = nullptr;
+        volatile bool _streaming = false;
+
         SPIBus() : hardware{} {
         }
 
@@ -293,55 +339,92 @@ namespace Motate {
             //sendNextMessageActual();
         }
 
+        // Give the bus to stream, as soon as the transaction in progress (if any) is done. Until
+        // releaseStream(), queued messages wait, and the SPI interrupt goes to the stream.
+        // Returns false if another stream has (or is waiting for) the bus.
+        bool claimForStream(SPIStreamBase *stream) {
+            if (_stream != nullptr) {
+                return false;
+            }
+            _stream = stream;
+            sendNextMessage();
+            return true;
+        };
+
+        // Hand the bus back, once the stream has stopped its transfers.
+        void releaseStream(SPIStreamBase *stream) {
+            if (_stream != stream) {
+                return;
+            }
+            hardware.deassert();
+            _streaming = false;
+            _stream = nullptr;
+            sendNextMessage();
+        };
+
         void handleServiceCallEvent() override {
-            if (sending) { return; }
-            while (_first_message && (SPIMessage::State::Done == _first_message->state)) {
-                auto done_message = _first_message;
-                _first_message = _first_message->next_message;
-                done_message->next_message = nullptr;
+            if (sending || _streaming) { return; }
+
+            if ((_stream != nullptr) && (_current_transaction_device == nullptr)) {
+                _streaming = true;
+                hardware.setChannel(_stream->device->getChannel());
+                _stream->_streamStart();
+                return;
             }
-            if (_first_message == nullptr) { return;}
-            if (SPIMessage::State::Sending == _first_message->state) { return; }
 
+            SPIMessage *next_message;
             if (_current_transaction_device != nullptr) {
                 // the next message we send must be from the _current_transaction_device
-                if (!(_first_message->device == _current_transaction_device)) {
-                    // now we'll make a pass throught the messages, looking for one
-                    // for the _current_transaction_device
-                    SPIMessage *previous_message = _first_message;
-                    SPIMessage *walker_message = _first_message->next_message;
-
-                    while (walker_message != nullptr) {
-                        if (walker_message->device == _current_transaction_device) {
-                            // we have our actual next message, we'll pop it to the first position
-                            previous_message->next_message = walker_message->next_message;
-                            walker_message->next_message = _first_message;
-                            _first_message = walker_message;
-                            break;
-                        }
-
-                        previous_message = walker_message;
-                        walker_message = walker_message->next_message;
-                    }
+                next_message = _scheduler.nextFor(_current_transaction_device);
+            } else {
+                // otherwise it's the highest priority one waiting
+                next_message = _scheduler.next();
+            }
 
-                    if (walker_message == nullptr) {
-                        // we have to wait for a new message to be queued up
-                        return;
-                    }
-                }
+            if (next_message == nullptr) {
+                // we have to wait for a new message to be queued up
+                return;
             }
 
 #ifdef IN_DEBUGGER
-            if (SPIMessage::State::Setup != _first_message->state) {
+            if (SPIMessage::State::Setup != next_message->state) {
                 __asm__("BKPT"); // SPI about to send non-Setup message
             }
 #endif
 
+            _startBatch(next_message);
+        }
+
+        // Send first_message, along with as many of the messages queued behind it for the same
+        // device as the hardware can chain, as one transfer with CS held across all of them.
+        // The chain stops after a message that deasserts or ends the transaction, since CS has
+        // to be released (or the bus handed to another device) there.
+        //
+        // To get a whole transaction into as few chains as possible, queue its messages together
+        // (with interrupts off, for instance). Any that are queued while a chain is in flight are
+        // picked up by spiInterruptHandler() when it ends.
+        void _startBatch(SPIMessage *first_message) {
+            SPITransferBlock blocks[hardware_t::maxChainedTransfers];
+
             sending = true;
-            _first_message->state = SPIMessage::State::Sending;
-            _current_transaction_device = _first_message->device;
-            hardware.setChannel(_current_transaction_device->getChannel(), _first_message->deassert_after);
-            hardware.startTransfer(_first_message->tx_buffer, _first_message->rx_buffer, _first_message->size);
+            _current_transaction_device = first_message->device;
+            _batch_count = 0;
+
+            // first_message is first in its device's queue, so the rest are right behind it
+            SPIMessage *walker_message = first_message;
+            while ((walker_message != nullptr) && (_batch_count < hardware_t::maxChainedTransfers)) {
+                walker_message->state = SPIMessage::State::Sending;
+                blocks[_batch_count] = {walker_message->tx_buffer, walker_message->rx_buffer, walker_message->size};
+                _batch[_batch_count++] = walker_message;
+
+                if (walker_message->deassert_after || walker_message->ends_transaction) {
+                    break;
+                }
+                walker_message = _scheduler.following(walker_message);
+            }
+
+            hardware.setChannel(_current_transaction_device->getChannel(), _batch[_batch_count-1]->deassert_after);
+            hardware.startTransfer(blocks, _batch_count);
         }
 
         void spiInterruptHandler(uint16_t interruptCause) {
@@ -351,6 +434,11 @@ namespace Motate {
 
             // So, we have to be careful not to move something out from under the other code.
 
+            if (_streaming) {
+                _stream->_streamInterrupt(interruptCause);
+                return;
+            }
+
             if (interruptCause & SPIInterrupt::OnTxReady) {
                 // ready to transfer...
             }
@@ -373,53 +461,74 @@ namespace Motate {
                 hardware._disableOnRXTransferDoneInterrupt();
 
 
-                if (nullptr == _first_message) {
+                if (0 == _batch_count) {
 #ifdef IN_DEBUGGER
-                    __asm__("BKPT"); // no first message!?
+                    __asm__("BKPT"); // no messages were sending!?
 #endif
                     return;
                 }
 
-                // _first_message is done sending.
-                // Go ahead and pop it from the list and reset (partially)
-                auto this_message = _first_message;
-                while (this_message && (SPIMessage::State::Done == this_message->state)) {
-                    this_message = this_message->next_message;
+                // The messages in _batch are done sending. Take them off of the queue, so
+                // they can be queued again, then mark them Done and call their callbacks, in
+                // the order they were sent.
+                for (uint8_t i = 0; i < _batch_count; i++) {
+                    _scheduler.pop(_batch[i]->device);
                 }
 
-                if (this_message && (SPIMessage::State::Sending == this_message->state)) {
-                    // Then grab the (only) Sending message and mark it Done, then call it's done callback.
-                    this_message->state = SPIMessage::State::Done;
+                // Set the values for each message before its callback, so the callback
+                // can re-queue with different values AND tell us how to handle the rest
+                // of this transaction. With these defaulted like this, the callback can do
+                // nothing and get the original behavior the message was configured for.
 
-                    // Set the values for *this* message before the callback, so
-                    // the callback can re-queue with different values AND tell us
-                    // how to handle the rest of this transaction. With these defaulted
-                    // like this, the callback can do nothing and get the original
-                    // behavior the message was configured for.
-                    this_message->immediate_ends_transaction = this_message->ends_transaction;
-                    this_message->immediate_deassert_after = this_message->deassert_after;
+                // Ignore ends_transaction and deassert_after, since those are for the next
+                // queueing of the message - which may happen in the callback as well.
 
-                    // Call the message's callback, if any, THEN check immediate_ends_transaction
-                    // and immediate_deassert_after, since the callback might decide to change those.
+                // Only the last message in the batch could have been sent with those set, and
+                // the ones after an earlier message have already been sent with CS held, so a
+                // callback that sets them on an earlier message takes effect at the end of the
+                // batch -- the earliest we can honor it.
 
-                    // Ignore ends_transaction and deassert_after, since those are for the next queueing
-                    // of the message - which may happen in the callback as well.
+                // IMPORTANT NOTE: the callbacks may call sendNextMessage(), so we
+                //   keep sending at true to prevent issues.
 
-                    // IMPORTANT NOTE: the callback may call sendNextMessage(), so we
-                    //   keep sending at true to prevent issues.
+                bool ends_transaction = false;
+                bool deassert_after = false;
+                for (uint8_t i = 0; i < _batch_count; i++) {
+                    auto this_message = _batch[i];
+                    this_message->state = SPIMessage::State::Done;
+
+                    this_message->immediate_ends_transaction = this_message->ends_transaction;
+                    this_message->immediate_deassert_after = this_message->deassert_after;
 
                     if (this_message->message_done_callback) {
                         this_message->message_done_callback();
                     }
 
-                    if (this_message->immediate_ends_transaction) {
-                        _current_transaction_device = nullptr;
-                    }
+                    ends_transaction |= this_message->immediate_ends_transaction;
+                    deassert_after |= this_message->immediate_deassert_after;
+
+                    _scheduler.finished(this_message);
+                }
+                _batch_count = 0;
+
+                if (ends_transaction) {
+                    _current_transaction_device = nullptr;
+                }
+
+                if (deassert_after) {
+                    hardware.deassert();
+                }
 
-                    if (this_message->immediate_deassert_after) {
-                        hardware.deassert();
+                // If the transaction continues and its next message is already queued, send it
+                // from here, rather than going around through the message_manager for it.
+                if (_current_transaction_device != nullptr) {
+                    SPIMessage *next_message = _scheduler.nextFor(_current_transaction_device);
+                    if (next_message != nullptr) {
+                        _startBatch(next_message);
+                        return;
                     }
                 }
+
                 sending = false; // we can now allow more sending
                 //sendNextMessageActual();
                 message_manager.call();
@@ -474,21 +583,17 @@ namespace Motate {
             };
 
             // queue message
-            void queueMessage (SPIMessage *msg) override {
-                msg->device = this;
-                if (_spi_bus->_first_message == nullptr) {
-                    _spi_bus->_first_message = msg;
-                    //_spi_bus->_last_message = msg;
+            bool queueMessage (SPIMessage *msg) override {
+                if (msg->_bus_queued) {
+                    return true; // it's already queued
                 }
-                else {
-                    SPIMessage *walker_message = _spi_bus->_first_message;
-                    while ((walker_message != msg) && (walker_message->next_message != nullptr)) {
-                        walker_message = walker_message->next_message;
-                    }
-
-                    if (walker_message != msg) {
-                        walker_message->next_message = msg;
-                    }
+                if (!_reserve(1)) {
+                    return false;
+                }
+                msg->device = this;
+                if (!_spi_bus->_scheduler.push(msg)) {
+                    _unreserve(1); // it was queued out from under us
+                    return true;
                 }
 
                 // Either we just queued the first message, OR we *might* have
@@ -497,6 +602,7 @@ namespace Motate {
 
                 // In either case, we want to:
                 _spi_bus->sendNextMessage();
+                return true;
             };
 
             uint32_t getChannel() override { return _cs_value; };
@@ -0,0 +1,301 @@
+/*
+ MotateSPIStream.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATESPISTREAM_H_ONCE
+#define MOTATESPISTREAM_H_ONCE
+
+#include <cstdint>
+#include <cstring>     // for memcpy
+#include <atomic>
+#include <type_traits> // for std::conditional
+#include "MotateSPI.h"
+#include "MotateTimers.h"
+#include "MotateDelegate.h"
+
+namespace Motate {
+
+    /* SPIStream<bus_t, frameSize, frameCount, timerNum>: full-duplex frames, over and over.
+     *
+     * A stream owns its device's bus from start() to stop(). Once the transaction in progress
+     * (if any) is done, the bus stops sending messages, and the stream clocks frames of
+     * frameSize bytes -- sending the same tx frame (see setTxFrame()) every time -- into a
+     * ring of frameCount frames. The frame callback is called, from the SPI interrupt, at
+     * the end of each one, and readFrame() takes them out in order from the main loop.
+     *
+     * With no timer (timerNum < 0) the frames are back to back, with CS held for the whole
+     * stream. The DMA runs the ring on its own where it can (the XDMAC), so there's no CPU
+     * work per frame other than the callback. The PDC and DMAC have to be given each frame
+     * from the end-of-frame interrupt: the PDC keeps one frame queued behind the one in
+     * flight, so it's gapless as long as the interrupt is handled within a frame-time, but
+     * the DMAC stops between frames for the interrupt latency. If the DMA runs dry anyway,
+     * the ring is started over (dropping the frames that weren't read) and restarts()
+     * counts it.
+     *
+     * With a timer, Timer<timerNum> paces the frames, one per period, and CS is released
+     * between them (so each frame is one "conversion" of a sensor, say). The SPI can't be
+     * started by a timer event in hardware, so the frame is started from the timer
+     * interrupt, from buffers that are already set up. A tick that comes while the last
+     * frame is still going is dropped, and missedTicks() counts it. The timer interrupt has
+     * to be routed in one translation unit:
+     *
+     *   SPIStream<decltype(spiBus), 6, 8, 4> accel {accelDevice, 1000};
+     *   MOTATE_SPI_STREAM_INTERRUPT(4, accel)
+     *
+     * The ring holds frameCount, less the frames the DMA may be writing to (one, or two
+     * with a DMA that runs ahead), for the reader. When the reader falls behind the oldest
+     * unread frame is dropped, and overruns() counts it.
+     */
+    template <typename bus_t, uint16_t frameSize, uint8_t frameCount, int8_t timerNum = -1>
+    struct SPIStream : SPIStreamBase {
+        typedef typename bus_t::hardware_t hardware_t;
+        typedef typename bus_t::SPIBusDevice device_t;
+
+        static constexpr bool paced = (timerNum >= 0);
+        // How many frames past the one that just finished may be written before we hear about it
+        static constexpr uint8_t framesInFlight = paced ? 1 : hardware_t::streamFramesInFlight;
+
+        static_assert(frameSize > 0, "SPIStream: frameSize must be more than zero");
+        static_assert(frameCount > framesInFlight, "SPIStream: frameCount must be more than the frames the DMA may have in flight");
+        static_assert(paced || (frameCount <= hardware_t::maxRingFrames), "SPIStream: frameCount is more than this DMA can hold in a ring");
+
+        struct frame_t {
+            const uint8_t *data;    // only valid during the callback
+            uint16_t size;
+            uint32_t sequence;      // frames completed since start(), counting this one
+        };
+
+        struct _noTimer {};
+        typedef typename std::conditional<paced, Timer<(paced ? timerNum : 0)>, _noTimer>::type timer_t;
+
+        bus_t * const _bus;
+        timer_t _timer;
+        int32_t _frameRate = 0;
+
+        uint8_t _tx_frame[frameSize] = {};
+        uint8_t _frames[frameCount][frameSize];
+
+        // Frame numbers: _completed are done, and _consumed of those have been read (or dropped)
+        std::atomic<uint32_t> _completed {0};
+        std::atomic<uint32_t> _consumed {0};
+        uint32_t _base = 0;                 // the frame that went in _frames[0] when the ring was (re)started
+
+        volatile bool _running = false;     // between start() and stop()
+        volatile bool _in_flight = false;   // paced: a frame is being clocked
+        volatile uint32_t _overruns = 0;
+        volatile uint32_t _restarts = 0;
+        volatile uint32_t _missedTicks = 0;
+        Delegate<void(const frame_t &)> _frameHandler;
+
+        // framesPerSecond is only used (and must be given) with a timer
+        SPIStream(device_t &stream_device, const uint32_t framesPerSecond = 0)
+            : SPIStreamBase{&stream_device}, _bus{stream_device._spi_bus} {
+            if constexpr (paced) {
+                _frameRate = _timer.setModeAndFrequency(kTimerUpToMatch, framesPerSecond);
+                _timer.setInterrupts(kInterruptOnOverflow | kInterruptPriorityLow);
+            }
+        };
+
+        SPIStream(const SPIStream &) = delete;
+        SPIStream &operator=(const SPIStream &) = delete;
+
+        // The actual frame rate with a timer, or kFrequencyUnattainable
+        int32_t getFrameRate() const { return _frameRate; };
+
+        // What to send with each frame: size bytes of data, and zeros after that.
+        // Only change this while stopped.
+        void setTxFrame(const uint8_t *data, const uint16_t size) {
+            const uint16_t count = (size < frameSize) ? size : frameSize;
+            memcpy(_tx_frame, data, count);
+            memset(_tx_frame + count, 0, frameSize - count);
+        };
+
+        // Start streaming, calling frameHandler (which may be empty) at the end of each frame.
+        // Frames start once the bus is free. Returns false if another stream has the bus.
+        bool start(const Delegate<void(const frame_t &)> &frameHandler = {}) {
+            if (_running) {
+                return true;
+            }
+            _frameHandler = frameHandler;
+            _completed.store(0);
+            _consumed.store(0);
+            _base = 0;
+            _in_flight = false;
+            _overruns = 0;
+            _restarts = 0;
+            _missedTicks = 0;
+
+            _running = true;
+            if (!_bus->claimForStream(this)) {
+                _running = false;
+                return false;
+            }
+            return true;
+        };
+
+        // Stop at once, dropping the frame in flight, and give the bus back. Frames that
+        // were done can still be read.
+        void stop() {
+            if (!_running) {
+                return;
+            }
+            _running = false; // the interrupts leave everything alone from here on
+            if constexpr (paced) {
+                _timer.stop();
+            }
+            _bus->hardware.stopRing();
+            _in_flight = false;
+            _bus->releaseStream(this);
+        };
+
+        bool isRunning() const { return _running; };
+        // Has the bus (rather than waiting for it)
+        bool isStreaming() const { return _running && _bus->_streaming && (_bus->_stream == this); };
+
+        uint32_t frames() const { return _completed.load(std::memory_order_acquire); };
+        uint32_t available() const {
+            return _completed.load(std::memory_order_acquire) - _consumed.load(std::memory_order_acquire);
+        };
+        uint32_t overruns() const { return _overruns; };
+        uint32_t restarts() const { return _restarts; };
+        uint32_t missedTicks() const { return _missedTicks; };
+
+        // Copy the oldest unread frame (frameSize bytes) to dest. Returns false if there isn't one.
+        bool readFrame(uint8_t *dest) {
+            uint32_t frame = _consumed.load(std::memory_order_acquire);
+            while (frame != _completed.load(std::memory_order_acquire)) {
+                memcpy(dest, _slot(frame), frameSize);
+                // If the interrupt dropped it while we were copying, the copy may be torn: go again
+                if (_consumed.compare_exchange_strong(frame, frame + 1, std::memory_order_acq_rel)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        uint8_t *_slot(const uint32_t frame) { return _frames[(frame - _base) % frameCount]; };
+
+        // Drop unread frames so that frame's slot can be written
+        void _makeRoomFor(const uint32_t frame) {
+            uint32_t consumed = _consumed.load(std::memory_order_acquire);
+            while ((frame - consumed) >= frameCount) {
+                if (_consumed.compare_exchange_weak(consumed, consumed + 1, std::memory_order_acq_rel)) {
+                    _overruns = _overruns + 1;
+                    consumed++;
+                }
+            }
+        };
+
+        // Called by the bus, from the service call, once we have it
+        void _streamStart() override {
+            if (!_running) {
+                return;
+            }
+            if constexpr (paced) {
+                _timer.start();
+            } else {
+                _makeRoomFor(_base + framesInFlight);
+                _bus->hardware.startRing(_tx_frame, _frames[0], frameSize, frameCount);
+            }
+        };
+
+        // Called from the SPI interrupt for as long as we have the bus
+        void _streamInterrupt(const uint16_t interruptCause) override {
+            if (!_running) {
+                _bus->hardware.stopRing(); // so it doesn't keep coming back
+                return;
+            }
+            if (!(interruptCause & SPIInterrupt::OnRxTransferDone)) {
+                return;
+            }
+            if constexpr (paced || (hardware_t::streamFramesInFlight == 1)) {
+                if (!_bus->hardware.doneReading()) {
+                    return;
+                }
+            }
+
+            const uint32_t frame = _completed.load(std::memory_order_relaxed);
+            if constexpr (paced) {
+                _bus->hardware._disableOnTXTransferDoneInterrupt();
+                _bus->hardware._disableOnRXTransferDoneInterrupt();
+                _bus->hardware.deassert();
+                _in_flight = false;
+            } else {
+                _makeRoomFor(frame + framesInFlight);
+            }
+            _completed.store(frame + 1, std::memory_order_release);
+
+            if (_frameHandler) {
+                const frame_t done {_slot(frame), frameSize, frame + 1};
+                _frameHandler(done);
+            }
+
+            if constexpr (!paced) {
+                if (!_running) {
+                    return; // the handler stopped us
+                }
+                if (!_bus->hardware.ringFrameDone(_tx_frame, _slot(frame + framesInFlight), frameSize)) {
+                    // We were too late, and the DMA stopped. Drop what wasn't read (the slots move
+                    // with _base), and start the ring over.
+                    _restarts = _restarts + 1;
+                    _base = frame + 1;
+                    _makeRoomFor(_base + frameCount - 1);
+                    _bus->hardware.startRing(_tx_frame, _frames[0], frameSize, frameCount);
+                }
+            }
+        };
+
+        // Called from Timer<timerNum>::interrupt() -- see MOTATE_SPI_STREAM_INTERRUPT
+        void _timerInterrupt() {
+            if constexpr (paced) {
+                int16_t channel;
+                if (_timer.getInterruptCause(channel) != kInterruptOnOverflow) {
+                    return;
+                }
+                if (!_running) {
+                    return;
+                }
+                if (_in_flight) {
+                    _missedTicks = _missedTicks + 1;
+                    return;
+                }
+                const uint32_t frame = _completed.load(std::memory_order_relaxed);
+                _makeRoomFor(frame);
+                _in_flight = true;
+                _bus->hardware.startTransfer(_tx_frame, _slot(frame), frameSize);
+            }
+        };
+    };
+
+} // namespace Motate
+
+// Route Timer<number>'s interrupt to a paced stream -- use once, in one translation unit
+#define MOTATE_SPI_STREAM_INTERRUPT(number, stream) \
+    MOTATE_TIMER_INTERRUPT(number) { stream._timerInterrupt(); }
+
+#endif /* end of include guard: MOTATESPISTREAM_H_ONCE */
@@ -0,0 +1,185 @@
+/*
+ MotateSensorTable.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATESENSORTABLE_H_ONCE
+#define MOTATESENSORTABLE_H_ONCE
+
+#include <cstdint>
+
+namespace Motate {
+
+    /* SensorTable<points>: integer-only linearization of raw ADC counts.
+     *
+     * A piecewise-linear table of the sensor's value (in whatever fixed-point units
+     * the caller picks, such as hundredths of a degree) from bottom to top raw counts
+     * (such as adc_pin.getBottom() and adc_pin.getTop()). A lookup is a binary search
+     * of the breakpoints and one multiply to interpolate -- no floating point and no
+     * division, so it's cheap on parts without an FPU (or a divider).
+     *
+     * The table is filled by calling toValue(raw), so the expensive math (such as
+     * Steinhart-Hart) happens up front, about a dozen times per point. toValue must
+     * be monotonic (in either direction). If it's constexpr (like SensorCalibration
+     * below) the whole table can be built at compile time.
+     *
+     * The breakpoints aren't evenly spaced in raw counts: they're spaced evenly along
+     * the curve (raw and value both normalized to their spans), so where the value
+     * changes quickly, like the ends of a thermistor's range, they're close together.
+     * The range should still be the part of the ADC range that's useful -- the ends
+     * of a thermistor's range are a shorted or open sensor, and a huge jump in value
+     * there takes points away from everywhere else.
+     */
+    template <uint16_t points>
+    struct SensorTable {
+        static_assert(points >= 2, "SensorTable: needs at least two points");
+
+        int32_t _raw[points];       // increasing
+        int32_t _value[points];
+        int32_t _slope[points - 1]; // value per raw count, in 16.16 fixed point
+
+        constexpr SensorTable() : _raw{}, _value{}, _slope{} {};
+
+        template <typename toValue_t>
+        constexpr SensorTable(const int32_t bottom, const int32_t top, toValue_t &&toValue) : _raw{}, _value{}, _slope{} {
+            build(bottom, top, toValue);
+        };
+
+        // There must be at least as many raw counts from bottom to top (inclusive) as points
+        template <typename toValue_t>
+        constexpr void build(const int32_t bottom, const int32_t top, toValue_t &&toValue) {
+            const int32_t first = toValue(bottom);
+            const int32_t last = toValue(top);
+            const int64_t raw_span = top - bottom;
+            // (A flat curve still needs a nonzero span, so the raw counts spread the points out.)
+            const int64_t value_span = (last > first) ? (last - first) : ((last < first) ? (first - last) : 1);
+
+            // How far along the curve raw is, with raw and value each normalized by the other's span
+            auto distance = [&](const int32_t raw, const int32_t value) -> int64_t {
+                const int64_t dv = (value > first) ? (value - first) : (first - value);
+                return ((raw - bottom) * value_span) + (dv * raw_span);
+            };
+            const int64_t length = distance(top, last);
+
+            _raw[0] = bottom;
+            _value[0] = first;
+            for (uint16_t i = 1; i < points - 1; i++) {
+                // Find the first raw that's at least i/(points-1) of the way along, leaving
+                // room for a distinct raw count for each of the points after this one
+                const int64_t target = (length * i) / (points - 1);
+                int32_t low = _raw[i - 1] + 1;
+                int32_t high = top - (points - 1 - i);
+                while (low < high) {
+                    const int32_t middle = low + ((high - low) / 2);
+                    if (distance(middle, toValue(middle)) < target) {
+                        low = middle + 1;
+                    } else {
+                        high = middle;
+                    }
+                }
+                _raw[i] = low;
+                _value[i] = toValue(low);
+            }
+            _raw[points - 1] = top;
+            _value[points - 1] = last;
+
+            for (uint16_t i = 0; i < points - 1; i++) {
+                const int64_t dv = (int64_t)(_value[i + 1] - _value[i]) * 65536;
+                const int32_t dr = _raw[i + 1] - _raw[i];
+                _slope[i] = (dv + ((dv < 0) ? -(dr / 2) : (dr / 2))) / dr;
+            }
+        };
+
+        // Raw counts outside of the table are clamped
+        constexpr int32_t lookup(const int32_t raw) const {
+            if (raw <= _raw[0]) {
+                return _value[0];
+            }
+            if (raw >= _raw[points - 1]) {
+                return _value[points - 1];
+            }
+
+            // Find the segment: the last breakpoint at or below raw
+            uint16_t low = 0;
+            uint16_t high = points - 1;
+            while ((high - low) > 1) {
+                const uint16_t middle = (low + high) / 2;
+                if (_raw[middle] <= raw) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+
+            return _value[low] + (int32_t)((((int64_t)(raw - _raw[low]) * _slope[low]) + 32768) >> 16);
+        };
+
+        constexpr int32_t operator()(const int32_t raw) const { return lookup(raw); };
+    };
+
+    /* SensorCalibration<count>: a sensor described by measured (raw, value) points.
+     *
+     * Linear between the points (which must be in increasing raw order), and flat
+     * past either end. Use it directly, or (since it's constexpr) to fill a
+     * SensorTable at compile time, which makes the lookups a constant cost no
+     * matter how many calibration points there are:
+     *
+     *   constexpr SensorCalibration<3> kProbe {{{100, -4000}, {2000, 2500}, {3900, 15000}}};
+     *   constexpr SensorTable<65> kProbeTable {0, 4095, kProbe};
+     */
+    struct SensorCalibrationPoint {
+        int32_t raw;
+        int32_t value;
+    };
+
+    template <uint16_t count>
+    struct SensorCalibration {
+        static_assert(count >= 1, "SensorCalibration: needs at least one point");
+
+        SensorCalibrationPoint _points[count];
+
+        constexpr int32_t operator()(const int32_t raw) const {
+            if (raw <= _points[0].raw) {
+                return _points[0].value;
+            }
+            for (uint16_t i = 1; i < count; i++) {
+                const SensorCalibrationPoint &a = _points[i - 1];
+                const SensorCalibrationPoint &b = _points[i];
+                if (raw <= b.raw) {
+                    // Round to nearest (in 64 bits, since a span can be most of the range)
+                    const int64_t scaled = (int64_t)(b.value - a.value) * (raw - a.raw);
+                    const int32_t span = b.raw - a.raw;
+                    return a.value + (int32_t)((scaled + ((scaled < 0) ? -(span / 2) : (span / 2))) / span);
+                }
+            }
+            return _points[count - 1].value;
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATESENSORTABLE_H_ONCE */
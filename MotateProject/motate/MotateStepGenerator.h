@@ -0,0 +1,261 @@
+/*
+ MotateStepGenerator.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATESTEPGENERATOR_H_ONCE
+#define MOTATESTEPGENERATOR_H_ONCE
+
+#include <cstdint>
+#include <atomic>
+#include "MotatePins.h"
+#include "MotateTimers.h"
+#include "MotateBuffer.h"
+
+namespace Motate {
+
+    /* StepGenerator<timerNum, stepPins_t, dirPins_t, queueSize>: step/direction pulses from a DDA.
+     *
+     * Timer<timerNum> ticks at a fixed rate (the RC compare), and each tick advances every
+     * axis's DDA: a 32-bit fixed-point accumulator that steps when it carries. All of the
+     * step pins that are due go high with one write per port (stepPins_t is a PinGroup, bit
+     * n is axis n), and they all go low again at the RA compare, pulseNanoseconds later.
+     *
+     * Moves are queued as segments -- a number of ticks, and a signed step count per axis to
+     * spread evenly over them -- from the main loop (or one other interrupt) with push().
+     * The queue is an SPSCBuffer (so it holds queueSize - 1), and neither side turns
+     * interrupts off. The steps of a
+     * segment land within half a tick of where a continuous move would put them, and the
+     * count is exact, so segments can be chained to make any velocity profile.
+     *
+     * The direction pins (a PinGroup of the same size, high for positive steps) change
+     * with the step pins low, at least a tick less the pulse width before the next step.
+     * When the queue runs dry the timer is stopped, and push() starts it again; the first
+     * steps come a tick later.
+     *
+     * The pulse ends at a fixed point in the tick, so it's shortened by however late the
+     * tick's interrupt is. Keep pulseNanoseconds above the driver's minimum plus the longest
+     * time interrupts are held off.
+     *
+     * Every tick is two interrupts (the tick and the end of the pulse), so the tick rate --
+     * which is also the highest step rate of any one axis -- is bounded by how long those
+     * take with all of the axes. The interrupt has to be routed in one translation unit:
+     *
+     *   StepGenerator<3, PinGroup<...>, PinGroup<...>> steppers {100000};
+     *   MOTATE_STEP_GENERATOR_INTERRUPT(3, steppers)
+     */
+    template <uint8_t timerNum, typename stepPins_t, typename dirPins_t, uint16_t queueSize = 16>
+    struct StepGenerator {
+        static constexpr uint8_t axes = stepPins_t::count;
+        static_assert(axes == dirPins_t::count, "StepGenerator: there must be as many direction pins as step pins");
+
+        struct _segment_t {
+            uint32_t ticks;
+            uint32_t directions;          // bit n is set if axis n steps forward
+            uint32_t increments[axes];    // steps per tick, in 0.32 fixed point
+            int32_t steps[axes];
+        };
+
+        Timer<timerNum> _timer;
+        stepPins_t _stepPins {kOutput};
+        dirPins_t _dirPins {kOutput};
+        SPSCBuffer<queueSize, _segment_t> _queue;
+
+        // Owned by the interrupt
+        _segment_t _segment {};
+        uint32_t _ticksLeft = 0;
+        uint32_t _accumulators[axes];
+        uint32_t _stepBits = 0;
+        uint32_t _directions = 0;
+
+        std::atomic<bool> _idle {true};   // the timer is stopped, and push() has to start it
+        int32_t _tickFrequency = 0;
+        volatile int32_t _position[axes] = {};
+        volatile uint32_t _segmentsDone = 0;
+
+        StepGenerator(const uint32_t tickFrequency, const uint32_t pulseNanoseconds = 1000) {
+            _tickFrequency = _timer.setModeAndFrequency(kTimerUpToMatch, tickFrequency);
+
+            const uint32_t top = _timer.getTopValue();
+            uint32_t pulse = ((uint64_t)pulseNanoseconds * tickFrequency * top) / 1000000000;
+            pulse = (pulse < 1) ? 1 : (pulse >= top) ? (top - 1) : pulse;
+            _timer.setExactDutyCycleForChannel(0, pulse);
+
+            _timer.setInterrupts(kInterruptOnOverflow | kInterruptOnMatch | kInterruptPriorityHighest, 0);
+        };
+
+        StepGenerator(const StepGenerator &) = delete;
+        StepGenerator &operator=(const StepGenerator &) = delete;
+
+        // The actual tick rate, or kFrequencyUnattainable
+        int32_t getTickFrequency() const { return _tickFrequency; };
+
+        // Queue a move of steps[n] on each axis n over ticks ticks. Returns false if the
+        // queue is full, or if any axis would have to step more than once a tick.
+        bool push(const uint32_t ticks, const int32_t (&steps)[axes]) {
+            if (ticks == 0) {
+                return false;
+            }
+
+            _segment_t segment;
+            segment.ticks = ticks;
+            segment.directions = 0;
+            for (uint8_t i = 0; i < axes; i++) {
+                const uint32_t count = (steps[i] < 0) ? -steps[i] : steps[i];
+                if (count > ticks) {
+                    return false;
+                }
+                // count == ticks doesn't fit, but 0xFFFFFFFF still carries on every tick (for up to 2^31 ticks)
+                const uint64_t increment = ((uint64_t)count << 32) / ticks;
+                segment.increments[i] = (increment > 0xFFFFFFFF) ? 0xFFFFFFFF : increment;
+                segment.steps[i] = steps[i];
+                if (steps[i] > 0) {
+                    segment.directions |= 1u << i;
+                }
+            }
+
+            if (_queue.write(&segment, 1) != 1) {
+                return false;
+            }
+            if (_idle.exchange(false)) {
+                _timer.start();
+            }
+            return true;
+        };
+
+        bool isIdle() const { return _idle.load(std::memory_order_acquire); };
+
+        // Where axis is, as of the end of the last finished segment
+        int32_t getPosition(const uint8_t axis) const { return (axis < axes) ? _position[axis] : 0; };
+        void setPosition(const uint8_t axis, const int32_t position) {
+            if (axis < axes) {
+                _position[axis] = position;
+            }
+        };
+        uint32_t segmentsDone() const { return _segmentsDone; };
+
+        // Stop now, mid-segment if need be, and drop anything queued
+        void stop() {
+            _timer.stop();
+            _stepPins.clear(_stepBits);
+            _stepBits = 0;
+            _ticksLeft = 0;
+            _queue.consume(_queue.readableSpans().length());
+            _idle.store(true, std::memory_order_release);
+        };
+
+        // Called from Timer<timerNum>::interrupt() -- see MOTATE_STEP_GENERATOR_INTERRUPT
+        void _interrupt() {
+            int16_t channel;
+            const TimerChannelInterruptOptions cause = _timer.getInterruptCause(channel);
+            if (cause == kInterruptOnOverflow) {
+                _tick();
+            } else if (cause == kInterruptOnMatch) {
+                _pulseEnd();
+            }
+        };
+
+        void _tick() {
+            _clearSteps(); // if the end of the last pulse was missed
+
+            if (_ticksLeft == 0) {
+                // Nothing was ready at the end of the last pulse: set the direction now, and step from the next tick
+                if (!_nextSegment()) {
+                    _goIdle();
+                }
+                return;
+            }
+
+            uint32_t bits = 0;
+            for (uint8_t i = 0; i < axes; i++) {
+                const uint32_t before = _accumulators[i];
+                _accumulators[i] = before + _segment.increments[i];
+                if (_accumulators[i] < before) {
+                    bits |= 1u << i;
+                }
+            }
+            if (bits) {
+                _stepPins.set(bits);
+                _stepBits = bits;
+            }
+
+            if (--_ticksLeft == 0) {
+                for (uint8_t i = 0; i < axes; i++) {
+                    _position[i] = _position[i] + _segment.steps[i];
+                }
+                _segmentsDone = _segmentsDone + 1;
+            }
+        };
+
+        void _pulseEnd() {
+            _clearSteps();
+            // The segment ended with that tick, so change direction now, while the steps are low
+            if (_ticksLeft == 0) {
+                _nextSegment();
+            }
+        };
+
+        void _clearSteps() {
+            if (_stepBits) {
+                _stepPins.clear(_stepBits);
+                _stepBits = 0;
+            }
+        };
+
+        bool _nextSegment() {
+            if (_queue.read(&_segment, 1) != 1) {
+                return false;
+            }
+            // Start each DDA half way, so the steps are centered in their ticks
+            for (uint8_t i = 0; i < axes; i++) {
+                _accumulators[i] = 0x80000000;
+            }
+            _ticksLeft = _segment.ticks;
+            if (_segment.directions != _directions) {
+                _directions = _segment.directions;
+                _dirPins.write(_directions);
+            }
+            return true;
+        };
+
+        void _goIdle() {
+            _timer.stop();
+            _idle.store(true, std::memory_order_release);
+            // A push() may have come in after the queue was checked, and seen that we weren't idle yet
+            if (!_queue.isEmpty() && _idle.exchange(false)) {
+                _timer.start();
+            }
+        };
+    };
+
+} // namespace Motate
+
+// Route Timer<number>'s interrupt to generator -- use once, in one translation unit
+#define MOTATE_STEP_GENERATOR_INTERRUPT(number, generator) \
+    MOTATE_TIMER_INTERRUPT(number) { generator._interrupt(); }
+
+#endif /* end of include guard: MOTATESTEPGENERATOR_H_ONCE */
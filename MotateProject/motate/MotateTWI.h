@@ -33,7 +33,9 @@
 #include <cinttypes>
 #include <atomic>
 #include "MotateCommon.h"
+#include "MotateDelegate.h"
 #include "MotateServiceCall.h"
+#include "MotateBusScheduler.h"
 
 
 /* After some setup, we call the processor-specific bits, then we have the
@@ -104,20 +106,20 @@ namespace Motate {
 
 struct TWIMessage;
 
-struct TWIBusDeviceBase {
+struct TWIBusDeviceBase : BusDeviceQueue<TWIMessage> {
     // store a link to the next device on the bus (maintained by the Bus)
     TWIBusDeviceBase* _next_device = 0;
 
     // set device options
     // virtual void setOptions() {};
-    // queue message
-    virtual void queueMessage(TWIMessage* msg){};
+    // queue message (and any chained to it), returns false if this device's queue is full (see BusDeviceQueue)
+    virtual bool queueMessage(TWIMessage* msg) { return false; };
     // return a value that can be used by hardware to select this device
     virtual const TWIAddress& getAddress() const;
 };
 
 // useful verbose enums
-struct TWIMessage {
+struct TWIMessage : BusMessageScheduling<TWIMessage> {
     enum class Instruction {
         kNormal,
         kWithoutStop,  // Don't send a STOP after, making the next message have a RESTART
@@ -131,13 +133,13 @@ struct TWIMessage {
     uint16_t size   = 0;
 
     TWIBusDeviceBase*        device                = nullptr;
-    std::atomic<TWIMessage*> next_message          = nullptr;
+    std::atomic<TWIMessage*> next_message          = nullptr; // sent right after this one, as one transaction
     Instruction              instruction           = Instruction::kNormal;
     Direction                direction             = Direction::kTX;
 
     TWIInternalAddress internal_address;
 
-    std::function<void(bool)> message_done_callback;
+    Delegate<void(bool)>      message_done_callback;  // called from the TWI interrupt
     std::atomic<State>        state = State::kIdle;
 
     TWIMessage(){};
@@ -167,6 +169,11 @@ struct TWIMessage {
     }
 };
 
+// A pool of TWIMessages for the drivers on a bus, see BusMessagePool in MotateBusScheduler.h
+template <uint8_t capacity>
+using TWIMessagePool = BusMessagePool<TWIMessage, capacity>;
+using TWIMessageHandle = BusMessageHandle<TWIMessage>;
+
 #pragma mark TWIBus
 /**************************************************
  *
@@ -192,11 +199,14 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
 
     ServiceCall message_manager;
 
-    TWIBusDeviceBase *_first_device, *_current_transaction_device;
-    std::atomic<TWIMessage*> _first_message, _last_message;
+    TWIBusDeviceBase *_first_device = nullptr, *_current_transaction_device = nullptr;
+    BusScheduler<TWIMessage> _scheduler;  // the queued messages, see MotateBusScheduler.h
 
     std::atomic<bool> sending = false;  // as long as this is true, sendNextMessage() does nothing
 
+    // The read that went out with the message that's sending, as one combined write-then-read
+    TWIMessage* _combined_read = nullptr;
+
     TWIBus() : hardware{} {}
 
     void addDevice(TWIBusDeviceBase* new_next) {
@@ -269,10 +279,15 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         if (sending.load()) {
             return;
         }
-        // We'll load this atomically, ensuring to get a fresh copy,
-        // and cache a local copy to work on for the rest of this routine
-        // (if it changes, somethng went wrong here.)
-        auto first_message = _first_message.load(std::memory_order_acquire);
+
+        TWIMessage* first_message;
+        if (_current_transaction_device != nullptr) {
+            // the next message we send must be from the _current_transaction_device
+            first_message = _scheduler.nextFor(_current_transaction_device);
+        } else {
+            // otherwise it's the highest priority one waiting
+            first_message = _scheduler.next();
+        }
         if (first_message == nullptr) {
             return;
         }
@@ -288,13 +303,53 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         sending.store(true);
         first_message->state        = TWIMessage::State::kSending;
         _current_transaction_device = first_message->device;
-        hardware.setAddress(_current_transaction_device->getAddress(), first_message->internal_address);
-        if (!hardware.startTransfer(first_message->buffer, first_message->size,
-                                    first_message->direction == TWIMessage::Direction::kRX)) {
+
+        TWIMessage*        transfer_message = first_message;
+        TWIInternalAddress internal_address = first_message->internal_address;
+        _combined_read                      = _combinableRead(first_message);
+        if (_combined_read != nullptr) {
+            // The write becomes the read's internal address, so the hardware sends it, then a
+            // repeated START, then reads -- one transfer, and one DMA, for both.
+            internal_address.address = 0;
+            for (uint16_t i = 0; i < first_message->size; i++) {
+                internal_address.address = (internal_address.address << 8) | first_message->buffer[i];
+            }
+            internal_address.size  = (TWIInternalAddressSize)first_message->size;
+            _combined_read->state  = TWIMessage::State::kSending;
+            transfer_message       = _combined_read;
+        }
+
+        hardware.setAddress(_current_transaction_device->getAddress(), internal_address);
+        if (!hardware.startTransfer(transfer_message->buffer, transfer_message->size,
+                                    transfer_message->direction == TWIMessage::Direction::kRX)) {
             __asm__("BKPT");  // about to send non-Setup message
         }
     }
 
+    // The TWI master can only do a repeated START between a write of up to three bytes (the
+    // internal address) and a read. So a write of that size with kWithoutStop, chained to a
+    // read from the same device (such as a register or EEPROM address, then the data), goes
+    // out as one transfer. Returns the read, or nullptr if the write has to go out alone.
+    //
+    // Other kWithoutStop messages still hold the bus for the rest of the transaction, but
+    // the hardware sends a STOP and a START between them.
+    TWIMessage* _combinableRead(TWIMessage* write) {
+        TWIMessage* read = write->next_message.load();
+        if ((read == nullptr) || (write->direction != TWIMessage::Direction::kTX) ||
+            (write->instruction != TWIMessage::Instruction::kWithoutStop) ||
+            (write->internal_address.size != TWIInternalAddressSize::kNone) || (write->size == 0)) {
+            return nullptr;
+        }
+        // A 10-bit address uses one of the three internal address bytes
+        const uint16_t max_size = (write->device->getAddress().size == TWIDeviceAddressSize::k10Bit) ? 2 : 3;
+        if ((write->size > max_size) || (read->direction != TWIMessage::Direction::kRX) ||
+            (read->internal_address.size != TWIInternalAddressSize::kNone) || (read->device != write->device) ||
+            (BusScheduler<TWIMessage>::following(write) != read)) {
+            return nullptr;
+        }
+        return read;
+    }
+
     void handleTWIInterrupt(const TWIInterruptCause& interruptCause) override {
         // This bears stating, even though it's somewhat obvious:
         // This entire function is in an interrupt (higher priority) context, and will occasionally
@@ -314,43 +369,42 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         //     return;
         // }
 
-        // _first_message is done sending, cache the pointer itself and manipulate it
-        auto this_message = _first_message.load();
-#ifdef IN_DEBUGGER
-        if (nullptr == this_message) {
-            __asm__("BKPT");  // no first message!?
-            return;
-        }
-#endif
-        // Update the state
-        this_message->state.store(TWIMessage::State::kDone);
+        const bool success = !(interruptCause.isNACK() || interruptCause.isRxError() || interruptCause.isTxError());
 
-        // IMPORTANT NOTE: the callback may call sendNextMessage(), so we
-        //   keep sending at true to prevent issues.
+        // A combined write-then-read finishes both messages
+        const uint8_t done_count = (_combined_read != nullptr) ? 2 : 1;
+        _combined_read           = nullptr;
 
-        // Pop _first_message off
-
-        // // Atomically set the new _first_message to the next message (may be nullptr)
-        // _first_message.store(this_message->next_message.load());
-
-        // Use Compare-And-Store (CAS) to atomically change _first_message safely
-        while(!_first_message.compare_exchange_weak(this_message, this_message->next_message)) {
-            __asm__("BKPT");  // missed the set!
-        }
+        for (uint8_t i = 0; i < done_count; i++) {
+            // The first message of the _current_transaction_device is done sending, pop it off
+            // (so it can be queued again from the callback)
+            auto this_message = _scheduler.pop(_current_transaction_device);
+#ifdef IN_DEBUGGER
+            if (nullptr == this_message) {
+                __asm__("BKPT");  // no first message!?
+                return;
+            }
+#endif
+            // Update the state
+            this_message->state.store(TWIMessage::State::kDone);
+
+            // A message without a STOP, or with more chained to it, holds the bus for the
+            // rest of the transaction
+            if ((this_message->instruction == TWIMessage::Instruction::kNormal) &&
+                (this_message->next_message.load() == nullptr)) {
+                _current_transaction_device = nullptr;
+            }
 
-        // Use Compare-And-Store (CAS) to atomically change _last_message safely
-        // This will ONLY change _last_message IF _last_message==this_message.
-        // If it fails, this_message will be set to the value found at _last_message,
-        // so be careful to either not use this_message anymore or know it may have changed!
-        // _last_message.compare_exchange_weak(this_message, this_message->next_message);
+            // IMPORTANT NOTE: the callback may call sendNextMessage(), so we
+            //   keep sending at true to prevent issues.
 
-        this_message->next_message.store(nullptr);
+            if (this_message->message_done_callback) {
+                this_message->message_done_callback(success);
+            } else {
+                __asm__("BKPT");  // no callback!?
+            }
 
-        if (this_message->message_done_callback) {
-            this_message->message_done_callback(
-                !(interruptCause.isNACK() || interruptCause.isRxError() || interruptCause.isTxError()));
-        } else {
-            __asm__("BKPT");  // no callback!?
+            _scheduler.finished(this_message);
         }
 
         sending.store(false);  // we can now allow more sending
@@ -358,36 +412,36 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         sendNextMessage();
     };
 
-    void queueAndSendMessage(TWIMessage* new_message) {
-        // TWIMessage* old_last_message = _last_message.load();
-
-        // // the result of this next line is that:
-        // // 1- _last_message is set to new_message
-        // // 2- old_last_message is set to the previous value of _last_message
-        // while(!_last_message.compare_exchange_weak(old_last_message, new_message)) { ; }
-
-        // // now we can safely set this:
-        // old_last_message->next_message = new_message;
+    // Queue new_message, along with any messages chained to it (with next_message), for its
+    // device. Returns false, and queues none of them, if they don't all fit in the device's queue,
+    // or if one chained to it is still queued from before.
+    bool queueAndSendMessage(TWIMessage* new_message) {
+        TWIBusDeviceBase* device = new_message->device;
 
-        // // And to carefully set _first_message, we'll store a temporary nullptr
-        // TWIMessage* null_temp = nullptr;
-        // // Then, IF _first_message matches nullptr, it'll set it to the new_message
-        // _first_message.compare_exchange_weak(null_temp, new_message);
+        if (new_message->_bus_queued.load()) {
+            return true;  // it's already queued
+        }
 
-        TWIMessage* message_walker = _first_message.load();
+        uint8_t count = 0;
+        for (TWIMessage* walker = new_message; walker != nullptr; walker = walker->next_message.load()) {
+            if (walker->_bus_queued.load()) {
+                return false;  // part of the chain is still on the bus
+            }
+            count++;
+        }
 
-        // If _first_message != nullptr or we can't set it to new_message...
-        if (message_walker != nullptr ||
-            !_first_message.compare_exchange_weak(message_walker, new_message)) {
-            TWIMessage* next_message = message_walker;
-            while (next_message) {
-                message_walker = next_message;
-                next_message   = message_walker->next_message.load();
+        if (!device->_reserve(count)) {
+            return false;
+        }
+        for (TWIMessage* walker = new_message; walker != nullptr; walker = walker->next_message.load()) {
+            walker->device = device;
+            if (!_scheduler.push(walker)) {
+                device->_unreserve(1);  // it was queued out from under us
             }
-            message_walker->next_message.store(new_message);
         }
 
         sendNextMessage();
+        return true;
     };
 
 
@@ -421,9 +475,9 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         TWIBusDevice(TWIBusDevice&& other) = delete;
 
         // queue message
-        void queueMessage(TWIMessage* msg) override {
+        bool queueMessage(TWIMessage* msg) override {
             msg->device = this;
-            _twi_bus->queueAndSendMessage(msg);
+            return _twi_bus->queueAndSendMessage(msg);
         };
 
         const TWIAddress& getAddress() const override { return _twi_address; };
@@ -90,4 +90,8 @@ namespace Motate {
 #include <Freescale_klxx/KL05ZTimers.h>
 #endif
 
+#if defined(__HOST_SIM__)
+#include <HostTimers.h>
+#endif
+
 #endif /* end of include guard: MOTATETIMERS_H_ONCE */
\ No newline at end of file
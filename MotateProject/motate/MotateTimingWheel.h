@@ -0,0 +1,202 @@
+/*
+ MotateTimingWheel.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATETIMINGWHEEL_H_ONCE
+#define MOTATETIMINGWHEEL_H_ONCE
+
+#include <cstdint>
+#include "MotateDelegate.h"
+
+namespace Motate {
+
+    /* TimingWheelEvent: a one-shot or periodic deadline in a TimingWheel.
+     *
+     * The owner keeps it alive while it's scheduled -- the wheel only links to it.
+     * The callback is called from whatever calls TimingWheel::advance() (for the
+     * SysTickTimer that's the SysTick interrupt).
+     */
+    struct TimingWheelEvent {
+        Delegate<void(void)> callback;
+        uint32_t deadline = 0;  // the tick it's due on
+        uint32_t period = 0;    // 0 for one-shot, otherwise the ticks between calls
+
+        TimingWheelEvent *next = nullptr;
+        TimingWheelEvent **prev_next = nullptr; // what points to this one, nullptr if not scheduled
+
+        TimingWheelEvent() {};
+        TimingWheelEvent(Delegate<void(void)> &&_callback) : callback{_callback} {};
+
+        // It's linked into a list, so it can't be copied
+        TimingWheelEvent(const TimingWheelEvent &) = delete;
+        TimingWheelEvent &operator=(const TimingWheelEvent &) = delete;
+
+        bool isScheduled() const { return prev_next != nullptr; };
+    };
+
+    /* TimingWheel<slot_bits, levels>: hierarchical timing wheel of TimingWheelEvents.
+     *
+     * Level 0 has one slot per tick for the next 2^slot_bits ticks, level 1 has one
+     * slot per 2^slot_bits ticks for the next 2^(2*slot_bits) ticks, and so on. Each
+     * slot is a doubly-linked list, so schedule() and cancel() are O(1). advance()
+     * only looks at the one level-0 slot that's due, except every 2^slot_bits ticks
+     * when it also moves ("cascades") one slot of the level above down a level.
+     *
+     * The defaults (5 bits, 5 levels) reach 2^25 ticks (over nine hours of 1ms ticks)
+     * with 160 slots. Events further out than that are parked in the last level and
+     * re-filed each time they come around.
+     *
+     * This does no locking of its own -- if advance() is called from an interrupt,
+     * call schedule() and cancel() with that interrupt masked. Callbacks are called
+     * from advance(), and may schedule or cancel any event, including their own.
+     */
+    template <uint8_t slot_bits = 5, uint8_t levels = 5>
+    struct TimingWheel {
+        static_assert((slot_bits * levels) < 32, "TimingWheel: slot_bits * levels must be less than 32");
+
+        static constexpr uint32_t kSlots = 1 << slot_bits;
+        static constexpr uint32_t kSlotMask = kSlots - 1;
+        static constexpr uint32_t kMaxDelta = (1u << (slot_bits * levels)) - 1;
+
+        TimingWheelEvent *_slots[levels][kSlots] = {};
+        uint32_t _now = 0; // the next tick to be processed
+
+        // The tick that the next advance() will process first
+        uint32_t now() const { return _now; };
+
+        // Call event after delay ticks (delay 0 means the next tick processed), then every period
+        // ticks after that if period isn't 0. Rescheduling an event that's already scheduled moves it.
+        // Deadlines are compared wrap-safe, so delay has to be less than 2^31 ticks.
+        void schedule(TimingWheelEvent *event, const uint32_t delay, const uint32_t period = 0) {
+            cancel(event);
+            event->deadline = _now + delay;
+            event->period = period;
+            _insert(event);
+        };
+
+        void cancel(TimingWheelEvent *event) {
+            if (!event->isScheduled()) {
+                return;
+            }
+            *event->prev_next = event->next;
+            if (event->next != nullptr) {
+                event->next->prev_next = event->prev_next;
+            }
+            event->next = nullptr;
+            event->prev_next = nullptr;
+        };
+
+        // Process every tick up to and including tick, calling every event that comes due.
+        void advance(const uint32_t tick) {
+            while ((int32_t)(tick - _now) >= 0) {
+                _processTick();
+            }
+        };
+
+        void _insert(TimingWheelEvent *event) {
+            uint32_t when = event->deadline;
+            uint32_t delta = when - _now;
+            if ((int32_t)delta < 0) {
+                // already late, do it next
+                when = event->deadline = _now;
+                delta = 0;
+            } else if (delta > kMaxDelta) {
+                // parked in the slot for the furthest tick we can reach, see above
+                when = _now + kMaxDelta;
+                delta = kMaxDelta;
+            }
+
+            uint8_t level = 0;
+            while ((level < (levels - 1)) && (delta >= (1u << (slot_bits * (level + 1))))) {
+                level++;
+            }
+
+            TimingWheelEvent *&slot = _slots[level][(when >> (slot_bits * level)) & kSlotMask];
+            event->next = slot;
+            event->prev_next = &slot;
+            if (slot != nullptr) {
+                slot->prev_next = &event->next;
+            }
+            slot = event;
+        };
+
+        // Re-file everything in a slot of a higher level. Each lands in a lower level (or, if
+        // parked, comes back around to the last level).
+        void _cascade(const uint8_t level, const uint32_t index) {
+            TimingWheelEvent *event = _slots[level][index];
+            _slots[level][index] = nullptr;
+            while (event != nullptr) {
+                TimingWheelEvent *next = event->next;
+                _insert(event);
+                event = next;
+            }
+        };
+
+        void _processTick() {
+            const uint32_t index = _now & kSlotMask;
+
+            // Every kSlots ticks bring the next slot of level 1 down, every kSlots^2 ticks bring
+            // the next slot of level 2 down (before level 1), and so on.
+            if (index == 0) {
+                uint8_t level = 1;
+                while ((level < levels) && (((_now >> (slot_bits * (level - 1))) & kSlotMask) == 0)) {
+                    level++;
+                }
+                while (--level > 0) {
+                    _cascade(level, (_now >> (slot_bits * level)) & kSlotMask);
+                }
+            }
+
+            // Everything left in this slot is due now. Take the whole list, so anything
+            // scheduled from a callback goes into the wheel for a later tick.
+            TimingWheelEvent *due = _slots[0][index];
+            _slots[0][index] = nullptr;
+            if (due != nullptr) {
+                due->prev_next = &due;
+            }
+            _now++;
+
+            while (due != nullptr) {
+                TimingWheelEvent *event = due;
+                cancel(event);
+
+                if (event->period != 0) {
+                    event->deadline += event->period;
+                    _insert(event);
+                }
+
+                if (event->callback) {
+                    event->callback();
+                }
+            }
+        };
+    };
+
+}  // namespace Motate
+
+#endif /* end of include guard: MOTATETIMINGWHEEL_H_ONCE */
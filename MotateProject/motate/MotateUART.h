@@ -29,6 +29,7 @@
 
 #include "MotatePins.h"
 #include "MotateCommon.h"
+#include "MotateDelegate.h"
 
 #ifndef MOTATEUART_H_ONCE
 #define MOTATEUART_H_ONCE
@@ -101,9 +102,10 @@ namespace Motate {
         UARTGetHardware<rxPinNumber, txPinNumber> hardware;
 
         // Use to handle pass interrupts back to the user
-        std::function<void(bool)> connection_state_changed_callback;
-        std::function<void(void)> transfer_rx_done_callback;
-        std::function<void(void)> transfer_tx_done_callback;
+        // These are called from the UART interrupt
+        Delegate<void(bool)> connection_state_changed_callback;
+        Delegate<void(void)> transfer_rx_done_callback;
+        Delegate<void(void)> transfer_tx_done_callback;
 
         uint8_t highWaterChars;
 
@@ -227,35 +229,30 @@ namespace Motate {
 
         template<uint16_t _size>
         int16_t write(Motate::Buffer<_size> &data, const uint16_t length = 0, bool autoFlush = false) {
-            int16_t total_written = 0;
-            int16_t to_write = length;
-
-            do {
-                int16_t value = data.peek();
-                if (value < 0) // no more data
-                    break;
-
-                int16_t ret = hardware.writeByte(value);
-                if (ret > 0) {
-                    data.pop();
-                    to_write--;
-                } else if (autoFlush) {
-                    flush();
-                } else {
-                    break;
-                }
-            } while (to_write != 0);
+            // Write straight out of the buffer's storage, then mark it all read at once.
+            auto spans = data.readableSpans();
+            uint16_t to_write = spans.length();
+            if ((length > 0) && (length < to_write)) {
+                to_write = length;
+            }
 
-            if (autoFlush && total_written > 0)
-                flush();
+            uint16_t first_length = std::min(to_write, spans.first.length);
+            int16_t total_written = 0;
+            if (first_length > 0) {
+                total_written = write(spans.first.data, first_length, autoFlush);
+            }
+            if ((total_written == first_length) && (to_write > first_length)) {
+                total_written += write(spans.second.data, to_write - first_length, autoFlush);
+            }
 
+            data.consume(total_written);
             return total_written;
         };
 
 
         // **** Transfers and handling transfers
 
-        void setConnectionCallback(std::function<void(bool)> &&callback) {
+        void setConnectionCallback(Delegate<void(bool)> &&callback) {
             connection_state_changed_callback = std::move(callback);
             hardware._setInterruptCTSChange((bool)connection_state_changed_callback);
 
@@ -300,8 +297,8 @@ namespace Motate {
 
 
         bool _addTransfer(char *start, uint16_t length, char *high_water_start) {
-            if (!hardware.startRXTransfer(start, length)) { return false; }
-            if (!hardware.startRXTransfer(high_water_start, highWaterChars)) { return false; }
+            // Both regions go to the hardware at once, so it can chain them.
+            if (!hardware.startRXTransfer(start, length, high_water_start, highWaterChars)) { return false; }
             hardware.setInterruptRxTransferDone(true);
             _startRX();
             return true;
@@ -343,7 +340,7 @@ namespace Motate {
             return hardware.getRXTransferPosition();
         };
 
-        void setRXTransferDoneCallback(std::function<void()> &&callback) {
+        void setRXTransferDoneCallback(Delegate<void()> &&callback) {
             transfer_rx_done_callback = std::move(callback);
         }
 
@@ -354,12 +351,17 @@ namespace Motate {
 
         };
 
+        // Send both regions (such as the two halves of a wrapped buffer) without a gap between them.
+        bool startTXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            return hardware.startTXTransfer(buffer, length, buffer2, length2);
+        };
+
         char* getTXTransferPosition() {
             return hardware.getTXTransferPosition();
             return nullptr;
         };
 
-        void setTXTransferDoneCallback(std::function<void()> &&callback) {
+        void setTXTransferDoneCallback(Delegate<void()> &&callback) {
             transfer_tx_done_callback = std::move(callback);
         }
 
@@ -374,7 +376,7 @@ namespace Motate {
 
             if (interruptCause & UARTInterrupt::OnRxReady) {
                 // uh oh, we just lost data!
-#if IN_DEBUGGER == 1
+#if defined(IN_DEBUGGER) && (IN_DEBUGGER == 1)
                 __asm__("BKPT"); // UART buffer overflow!
 #endif
             }
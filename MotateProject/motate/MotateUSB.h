@@ -69,6 +69,7 @@ namespace Motate {
 
         virtual bool handleDataAvailable(const uint8_t &endpointNum, const size_t &length) = 0;
         virtual bool handleTransferDone(const uint8_t &endpointNum) = 0;
+        virtual bool handleDescriptorDone(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) = 0;
 
         virtual Setup_t& getSetup() = 0;
         virtual bool handleSetupPacket() = 0;
@@ -106,6 +107,10 @@ namespace Motate {
 #include <SamUSB.h>
 #endif
 
+#if defined(__HOST_SIM__)
+#include <HostUSB.h>
+#endif
+
 namespace Motate {
 
 #pragma mark struct USBDevice<interfaceTypes...>
@@ -291,6 +296,9 @@ namespace Motate {
                         //endpointSizes[ep] = getEndpointSize(ep, /* otherSpeed = */ config_number == 2);
                     }
 
+                    // Now that the endpoints exist, the mixins can start transfers on them
+                    _mixins_type::handleConfiguredInMixin();
+
                     /* OLD CODE
                      // Enable interrupt for CDC reception from host (OUT packet)
                      udd_enable_out_received_interrupt(CDC_RX);
@@ -313,7 +321,7 @@ namespace Motate {
                 _set_interface = setup.valueLow();
                 return true;
             } else {
-#if IN_DEBUGGER == 1
+#if defined(IN_DEBUGGER) && (IN_DEBUGGER == 1)
                 __asm__("BKPT"); // unknown setup type
 #endif
             }
@@ -415,6 +423,10 @@ namespace Motate {
             return _mixins_type::handleTransferDoneInMixin(endpointNum);
         };
 
+        bool handleDescriptorDone(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) override {
+            return _mixins_type::handleDescriptorDoneInMixin(endpointNum, descriptorIndex, length);
+        };
+
         const EndpointBufferSettings_t getEndpointConfig(const uint8_t endpoint, const bool otherSpeed) override {
             EndpointBufferSettings_t ebs = _hardware_type::getEndpointConfigFromHardware(endpoint);
 
@@ -464,7 +476,9 @@ namespace Motate {
             return kEndpointBufferNull;
         };
         void handleConnectionStateChangedInMixin(const bool connected) { ; };
+        void handleConfiguredInMixin() { ; };
         bool handleNonstandardRequestInMixin(Setup_t &setup) { return false; };
+        bool handleDescriptorDoneInMixin(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) { return false; };
         bool sendSpecialDescriptorOrConfig(Setup_t &setup) const { return false; };
         constexpr uint16_t getEndpointSizeFromMixin(const uint8_t &endpointNum, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) { return 8; };
     };
@@ -550,12 +564,19 @@ namespace Motate {
             first_mixin::handleConnectionStateChangedInMixin(connected);
             other_mixins::handleConnectionStateChangedInMixin(connected);
         };
+        void handleConfiguredInMixin() {
+            first_mixin::handleConfiguredInMixin();
+            other_mixins::handleConfiguredInMixin();
+        };
         bool handleNonstandardRequestInMixin(const Setup_t &setup) {
             return first_mixin::handleNonstandardRequestInMixin(setup) || other_mixins::handleNonstandardRequestInMixin(setup);
         };
         bool handleTransferDoneInMixin(const uint8_t &endpointNum) {
             return first_mixin::handleTransferDoneInMixin(endpointNum) || other_mixins::handleTransferDoneInMixin(endpointNum);
         }
+        bool handleDescriptorDoneInMixin(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            return first_mixin::handleDescriptorDoneInMixin(endpointNum, descriptorIndex, length) || other_mixins::handleDescriptorDoneInMixin(endpointNum, descriptorIndex, length);
+        }
         bool handleDataAvailableInMixin(const uint8_t &endpointNum, const size_t &length) {
             return first_mixin::handleDataAvailableInMixin(endpointNum, length) || other_mixins::handleDataAvailableInMixin(endpointNum, length);
         }
@@ -606,12 +627,18 @@ namespace Motate {
         void handleConnectionStateChangedInMixin(const bool connected) {
             first_mixin::handleConnectionStateChangedInMixin(connected);
         };
+        void handleConfiguredInMixin() {
+            first_mixin::handleConfiguredInMixin();
+        };
         bool handleNonstandardRequestInMixin(const Setup_t &setup) {
             return first_mixin::handleNonstandardRequestInMixin(setup);
         };
         bool handleTransferDoneInMixin(const uint8_t &endpointNum) {
             return first_mixin::handleTransferDoneInMixin(endpointNum);
         }
+        bool handleDescriptorDoneInMixin(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            return first_mixin::handleDescriptorDoneInMixin(endpointNum, descriptorIndex, length);
+        }
         bool handleDataAvailableInMixin(const uint8_t &endpointNum, const size_t &length) {
             return first_mixin::handleDataAvailableInMixin(endpointNum, length);
         }
@@ -646,12 +673,18 @@ namespace Motate {
         void handleConnectionStateChangedInMixin(const bool connected) {
             other_mixins::handleConnectionStateChangedInMixin(connected);
         };
+        void handleConfiguredInMixin() {
+            other_mixins::handleConfiguredInMixin();
+        };
         bool handleNonstandardRequestInMixin(const Setup_t &setup) {
             return other_mixins::handleNonstandardRequestInMixin(setup);
         };
         bool handleTransferDoneInMixin(const uint8_t &endpointNum) {
             return other_mixins::handleTransferDoneInMixin(endpointNum);
         }
+        bool handleDescriptorDoneInMixin(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            return other_mixins::handleDescriptorDoneInMixin(endpointNum, descriptorIndex, length);
+        }
         bool handleDataAvailableInMixin(const uint8_t &endpointNum, const size_t &length) {
             return other_mixins::handleDataAvailableInMixin(endpointNum, length);
         }
@@ -339,14 +339,88 @@ namespace Motate {
             return total_read;
         };
 
-        USB_DMA_Descriptor _rx_dma_descriptor;
-        // for now we ignore buffer2 and length2
+        // Each way, the regions of the buffer are handed to the DMA as a ring of descriptors (see setupRing()),
+        // queued behind those it's still working through, so it moves straight on to the next one without
+        // waiting for an interrupt to start it. The buffers hand the whole region over again as data (or space)
+        // turns up, from where the DMA is now, and only the part past what's already queued is added.
+        static const bool queues_transfers = true;
+        static const uint8_t _ring_size = 4;
+
+        struct _StreamRing {
+            USB_DMA_Descriptor descriptors[_ring_size];
+            // The counters run freely and wrap, and only their difference (and their value mod _ring_size) is
+            // used. done is only changed in the USB interrupt.
+            volatile uint8_t queued = 0;
+            volatile uint8_t done = 0;
+            char *queued_end = nullptr;     // just past the last byte queued
+            volatile bool queueing = false;
+            volatile bool queue_again = false;
+
+            bool isRunning() const { return queued != done; }
+
+            void reset() {
+                queued = done = 0;
+                queued_end = nullptr;
+            }
+        };
+        _StreamRing _rx_ring;
+        _StreamRing _tx_ring;
+        volatile bool _configured = false;
+
+        // Queue what of the two regions (the second is only non-empty when they wrap past the end of the buffer)
+        // is past the end of what's queued already. If the ring is still going that end is in one of them,
+        // unless the DMA has reached it -- then it may have wrapped to the start, and it's all new.
+        void _queueRegions(const uint8_t ep, _StreamRing &ring, char *buffer, uint16_t length, char *buffer2, uint16_t length2) {
+            if (ring.isRunning()) {
+                if ((ring.queued_end >= buffer) && (ring.queued_end <= buffer + length)) {
+                    length -= ring.queued_end - buffer;
+                    buffer = ring.queued_end;
+                } else if (length2 && (ring.queued_end >= buffer2) && (ring.queued_end <= buffer2 + length2)) {
+                    length = 0;
+                    length2 -= ring.queued_end - buffer2;
+                    buffer2 = ring.queued_end;
+                }
+            }
+
+            char *buffers[2] = {buffer, buffer2};
+            const uint16_t lengths[2] = {length, length2};
+            for (uint8_t i = 0; i < 2; i++) {
+                if ((uint8_t)(ring.queued - ring.done) == _ring_size) {
+                    break; // the rest waits for a descriptor to be done
+                }
+                if (lengths[i] == 0) {
+                    continue;
+                }
+                const uint8_t index = ring.queued % _ring_size;
+                ring.descriptors[index].setBuffer(buffers[i], lengths[i]);
+                ring.queued_end = buffers[i] + lengths[i];
+                ring.queued = ring.queued + 1;
+                usb.queueInRing(ep, index);
+            }
+        }
+
+        // The TX done callback may ask for more from the interrupt while the buffer is in here: then it's
+        // left to this call to go around again, with the same regions.
+        bool _startTransfer(const uint8_t ep, _StreamRing &ring, char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            if (!_configured) {
+                return false;
+            }
+            if (ring.queueing) {
+                ring.queue_again = true;
+                return true;
+            }
+            do {
+                ring.queueing = true;
+                ring.queue_again = false;
+                _queueRegions(ep, ring, buffer, length, buffer2, length2);
+                ring.queueing = false;
+            } while (ring.queue_again);
+
+            return ring.isRunning();
+        }
+
         bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
-            _rx_dma_descriptor.setBuffer(buffer, length);
-            // // DON'T allow the DMA transfer to be stopped if the buffer runs out
-            // // IOW, don't stop reading when a packet doesn't fill the buffer.
-            // _rx_dma_descriptor.end_buffer_enable = false;
-            return usb.transfer(read_endpoint, _rx_dma_descriptor);
+            return _startTransfer(read_endpoint, _rx_ring, buffer, length, buffer2, length2);
         };
 
         char* getRXTransferPosition() {
@@ -361,14 +435,12 @@ namespace Motate {
             transfer_rx_done_callback = std::move(callback);
         }
 
-
-        USB_DMA_Descriptor _tx_dma_descriptor;
         bool startTXTransfer(char *buffer, const uint16_t length) {
-            _tx_dma_descriptor.setBuffer(buffer, length);
-            // // Allow the DMA transfer to be stopped if the buffer runs out.
-            // // IOW, send a partially filled packet.
-            // _tx_dma_descriptor.end_buffer_enable = true;
-            return usb.transfer(write_endpoint, _tx_dma_descriptor);
+            return startTXTransfer(buffer, length, nullptr, 0);
+        };
+
+        bool startTXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
+            return _startTransfer(write_endpoint, _tx_ring, buffer, length, buffer2, length2);
         };
 
         char* getTXTransferPosition() {
@@ -487,20 +559,49 @@ namespace Motate {
             return false;
         }
 
-        // This is to be called from USBDeviceHardware when a transfer is done.
+        // This is to be called from USBDeviceHardware as each descriptor of a ring is done.
         // It returns if the request was handled or not.
-        bool handleTransferDone(const uint8_t &endpointNum) {
-            if (transfer_rx_done_callback && (endpointNum == read_endpoint)) {
-                transfer_rx_done_callback();
+        bool handleDescriptorDone(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            if (endpointNum == read_endpoint) {
+                _rx_ring.done = _rx_ring.done + 1;
+                if (transfer_rx_done_callback) {
+                    transfer_rx_done_callback();
+                }
                 return true;
             }
-            if (transfer_tx_done_callback && (endpointNum == write_endpoint)) {
-                transfer_tx_done_callback();
+            if (endpointNum == write_endpoint) {
+                _tx_ring.done = _tx_ring.done + 1;
+                if (transfer_tx_done_callback) {
+                    transfer_tx_done_callback();
+                }
                 return true;
             }
             return false;
         }
 
+        // The end of a ring's run means nothing more was queued, which handleDescriptorDone() has covered.
+        bool handleTransferDone(const uint8_t &endpointNum) {
+            return (endpointNum == read_endpoint) || (endpointNum == write_endpoint);
+        }
+
+        // This is called from the USBDevice once the host has picked our configuration.
+        void handleConfigured() {
+            _rx_ring.reset();
+            _tx_ring.reset();
+            _configured = true;
+
+            usb.setupRing(read_endpoint, _rx_ring.descriptors, _ring_size, /*stream=*/ true);
+            usb.setupRing(write_endpoint, _tx_ring.descriptors, _ring_size, /*stream=*/ true);
+
+            // the buffers may have been waiting for this
+            if (transfer_rx_done_callback) {
+                transfer_rx_done_callback();
+            }
+            if (transfer_tx_done_callback) {
+                transfer_tx_done_callback();
+            }
+        }
+
         bool handleNonstandardRequest(const Setup_t &setup) {
             if (setup.index() != interface_number)
                 return false;
@@ -557,6 +658,12 @@ namespace Motate {
         };
 
         void handleConnectionStateChanged(const bool connected) {
+            if (!connected) {
+                _configured = false;
+                _rx_ring.reset();
+                _tx_ring.reset();
+            }
+
             // We only use this to inform if DISconnects
             // We only connection_state_changed_callback(true) when the DTR changes,
             // which is later than this hardware change, and happens when host software
@@ -636,12 +743,18 @@ namespace Motate {
         void handleConnectionStateChangedInMixin(const bool connected) {
             Serial.handleConnectionStateChanged(connected);
         };
+        void handleConfiguredInMixin() {
+            Serial.handleConfigured();
+        };
         bool handleNonstandardRequestInMixin(const Setup_t &setup) {
             return Serial.handleNonstandardRequest(setup);
         };
         bool handleTransferDoneInMixin(const uint8_t &endpointNum) {
             return Serial.handleTransferDone(endpointNum);
         }
+        bool handleDescriptorDoneInMixin(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            return Serial.handleDescriptorDone(endpointNum, descriptorIndex, length);
+        }
         bool handleDataAvailableInMixin(const uint8_t &endpointNum, const size_t &length) {
             return Serial.handleDataAvailable(endpointNum, length);
         }
@@ -0,0 +1,566 @@
+/*
+ MotateUSBVendorBulk.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MOTATEUSBVENDORBULK_ONCE
+#define MOTATEUSBVENDORBULK_ONCE
+
+#include "MotateUSB.h"
+#include "MotateUSBHelpers.h"
+#include "MotateDelegate.h"
+#include <algorithm> // for std::min
+
+namespace Motate {
+
+    /* ############################################ */
+    /* #                                          # */
+    /* #       USB Vendor-Specific Bulk Pipe      # */
+    /* #                                          # */
+    /* ############################################ */
+
+    // A pair of bulk endpoints (OUT from the host and IN to it) with none of CDC's line-coding requests or
+    // byte-stream semantics: data moves as whole messages of up to messageSize bytes, straight between the
+    // USB DMA and slots of memory, with nothing copied on the way.
+    //
+    //   USBDevice< USBDeviceHardware, USBVendorBulk<> > usb;
+    //
+    //   usb.mixin<0>::Bulk.setMessageReceivedCallback([]{ ... });   // from the USB interrupt
+    //   if (usb.mixin<0>::Bulk.available()) {
+    //       const char *data; uint16_t length;
+    //       usb.mixin<0>::Bulk.receive(data, length);
+    //       ...
+    //       usb.mixin<0>::Bulk.release();
+    //   }
+    //   usb.mixin<0>::Bulk.send(reply, reply_length);   // reply must stay put until it's been sent
+    //
+    // Message boundaries: an OUT message ends with a short packet or when it fills a slot, so a message
+    // that's a whole number of packets shorter than messageSize has to be followed by a zero-length packet.
+    // (One after a full slot arrives as an empty message.) IN messages are sent as-is, without a trailing
+    // zero-length packet, so the host should read each one with the length it expects, or messageSize.
+    //
+    // The device announces itself to Windows with MS OS 2.0 descriptors, so WinUSB binds to it without an
+    // INF file. That only works when USBVendorBulk is the only interface: the BOS descriptor is only read
+    // from USB 2.01 (and later) devices, and the default descriptor for a composite device says 1.1.
+    //
+    // packetSize is the largest bulk packet to use (512 is the high-speed maximum, and it's cut to 64 at full
+    // speed), messageSize must be a multiple of it, and slots (a power of two) is how many messages can be
+    // in flight each way.
+    template <uint16_t packetSize = 512, uint16_t messageSize = 2048, uint8_t slots = 4>
+    struct USBVendorBulk {
+        static bool isNull() { return false; };
+        static const uint8_t endpoints_used = (uint8_t)2;
+    };
+
+    // The GUID of the device interface that WinUSB registers, which is how software on the host finds the
+    // device. Override the default with (in a .cpp file):
+    //   MOTATE_SET_USB_VENDOR_BULK_GUID(u"{01234567-89AB-CDEF-0123-456789ABCDEF}")
+    const char16_t *getUSBVendorBulkGUID() ATTR_WEAK;
+
+#define MOTATE_SET_USB_VENDOR_BULK_GUID(...)\
+    const char16_t MOTATE_USBVendorBulkGUID[] = __VA_ARGS__;\
+    static_assert(sizeof(MOTATE_USBVendorBulkGUID) == 39 * sizeof(char16_t), "The GUID must be in the form {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}");\
+    const char16_t *Motate::getUSBVendorBulkGUID() {\
+        return MOTATE_USBVendorBulkGUID;\
+    }
+
+#pragma mark MS OS 2.0 descriptors
+
+    // See "Microsoft OS 2.0 Descriptors Specification" -- these are what's asked for by Windows 8.1 and later.
+
+    enum USBMSOSDescriptorValues_t {
+        kBOSDescriptor                  = 0x0F, // descriptor type of the BOS (Binary device Object Store)
+        kDeviceCapabilityDescriptor     = 0x10,
+        kPlatformCapability             = 0x05,
+
+        kMSOSDescriptorIndex            = 0x07, // wIndex of the vendor request for the descriptor set
+
+        kMSOSSetHeaderDescriptor        = 0x00,
+        kMSOSFeatureCompatibleID        = 0x03,
+        kMSOSFeatureRegProperty         = 0x04,
+
+        kMSOSRegMultiSZ                 = 0x07,
+
+        // bRequest of the vendor request, our choice
+        kMSOSVendorCode                 = 0x20,
+    };
+
+    static const uint32_t kMSOSWindowsVersion = 0x06030000; // Windows 8.1
+
+    struct USBDescriptorBOSHeader_t {
+        USBDescriptorHeader_t Header;
+        uint16_t TotalLength;
+        uint8_t  NumDeviceCaps;
+
+        constexpr USBDescriptorBOSHeader_t(const uint16_t _TotalLength, const uint8_t _NumDeviceCaps)
+        : Header{(uint8_t)sizeof(USBDescriptorBOSHeader_t), kBOSDescriptor},
+        TotalLength{_TotalLength},
+        NumDeviceCaps{_NumDeviceCaps}
+        {};
+    } ATTR_PACKED;
+
+    struct USBDescriptorMSOSPlatformCapability_t {
+        USBDescriptorHeader_t Header;
+        uint8_t  DevCapabilityType;
+        uint8_t  Reserved;
+        uint8_t  PlatformCapabilityUUID[16];
+        uint32_t WindowsVersion;
+        uint16_t MSOSDescriptorSetTotalLength;
+        uint8_t  VendorCode;
+        uint8_t  AltEnumCode;
+
+        constexpr USBDescriptorMSOSPlatformCapability_t(const uint16_t _SetTotalLength)
+        : Header{(uint8_t)sizeof(USBDescriptorMSOSPlatformCapability_t), kDeviceCapabilityDescriptor},
+        DevCapabilityType{kPlatformCapability},
+        Reserved{0},
+        // {D8DD60DF-4589-4CC7-9CD2-659D9E648A9F}, as it goes over the wire
+        PlatformCapabilityUUID{0xDF, 0x60, 0xDD, 0xD8, 0x89, 0x45, 0xC7, 0x4C, 0x9C, 0xD2, 0x65, 0x9D, 0x9E, 0x64, 0x8A, 0x9F},
+        WindowsVersion{kMSOSWindowsVersion},
+        MSOSDescriptorSetTotalLength{_SetTotalLength},
+        VendorCode{kMSOSVendorCode},
+        AltEnumCode{0}
+        {};
+    } ATTR_PACKED;
+
+    // The descriptor set: "use WinUSB", and "register this device interface GUID"
+    struct USBDescriptorMSOSSet_t {
+        // Set header
+        uint16_t HeaderLength;
+        uint16_t HeaderType;
+        uint32_t WindowsVersion;
+        uint16_t TotalLength;
+
+        // Compatible ID
+        uint16_t CompatibleIDLength;
+        uint16_t CompatibleIDType;
+        char     CompatibleID[8];
+        char     SubCompatibleID[8];
+
+        // Registry property
+        uint16_t PropertyLength;
+        uint16_t PropertyType;
+        uint16_t PropertyDataType;
+        uint16_t PropertyNameLength;
+        char16_t PropertyName[21];
+        uint16_t PropertyDataLength;
+        char16_t PropertyData[40]; // REG_MULTI_SZ: the GUID string, then an empty one
+
+        USBDescriptorMSOSSet_t(const char16_t *guid)
+        : HeaderLength{10},
+        HeaderType{kMSOSSetHeaderDescriptor},
+        WindowsVersion{kMSOSWindowsVersion},
+        TotalLength{(uint16_t)sizeof(USBDescriptorMSOSSet_t)},
+
+        CompatibleIDLength{20},
+        CompatibleIDType{kMSOSFeatureCompatibleID},
+        CompatibleID{'W', 'I', 'N', 'U', 'S', 'B', 0, 0},
+        SubCompatibleID{0},
+
+        PropertyLength{(uint16_t)(sizeof(USBDescriptorMSOSSet_t) - 30)},
+        PropertyType{kMSOSFeatureRegProperty},
+        PropertyDataType{kMSOSRegMultiSZ},
+        PropertyNameLength{sizeof(PropertyName)},
+        PropertyName{u"DeviceInterfaceGUIDs"},
+        PropertyDataLength{sizeof(PropertyData)},
+        PropertyData{0}
+        {
+            // 38 characters, and the last two stay 0
+            for (uint8_t i = 0; i < 38; i++) {
+                PropertyData[i] = guid[i];
+            }
+        };
+    } ATTR_PACKED;
+
+    static_assert(sizeof(USBDescriptorMSOSSet_t) == 162, "MS OS 2.0 descriptor set is the wrong size");
+
+#pragma mark USBVendorBulkPipe
+
+    //Actual implementation of the vendor bulk pipe
+    template <typename usb_parent_type, uint16_t packetSize, uint16_t messageSize, uint8_t slots>
+    struct USBVendorBulkPipe {
+        static_assert((packetSize >= 8) && (packetSize <= 512) && ((packetSize & (packetSize - 1)) == 0),
+                      "USBVendorBulk packetSize must be a power of two from 8 to 512");
+        static_assert((messageSize % packetSize) == 0, "USBVendorBulk messageSize must be a multiple of packetSize");
+        static_assert((slots >= 1) && (slots <= 32) && ((slots & (slots - 1)) == 0),
+                      "USBVendorBulk slots must be a power of two, up to 32");
+
+        usb_parent_type &usb;
+        const uint8_t read_endpoint;
+        const uint8_t write_endpoint;
+        const uint8_t interface_number;
+
+        // Without exact lengths for every descriptor in a ring, only one OUT slot can be handed to the DMA at a
+        // time. (The other is queued as soon as it's done, and the endpoint's two banks cover the gap.)
+        static const uint8_t _rx_depth = usb_parent_type::exact_ring_lengths ? slots : 1;
+
+        // The counters run freely and wrap, and only differences between them (and their value mod slots)
+        // are used. _rx_done and _tx_done are only changed in the USB interrupt, the others by the user of
+        // the pipe (from one context, which may be the callbacks).
+        alignas(4) char _rx_buffers[slots][messageSize];
+        USB_DMA_Descriptor _rx_descriptors[slots];
+        uint16_t _rx_lengths[slots];
+        volatile uint8_t _rx_done = 0;
+        volatile uint8_t _rx_released = 0;
+        volatile uint8_t _rx_queued = 0;
+
+        USB_DMA_Descriptor _tx_descriptors[slots];
+        volatile uint8_t _tx_done = 0;
+        volatile uint8_t _tx_queued = 0;
+
+        volatile bool _configured = false;
+
+        Delegate<void()> message_received_callback;
+        Delegate<void()> message_sent_callback;
+
+        USBVendorBulkPipe(usb_parent_type &usb_parent,
+                          const uint8_t new_endpoint_offset,
+                          const uint8_t new_interface_number
+                          )
+        : usb(usb_parent),
+        read_endpoint(new_endpoint_offset),
+        write_endpoint(new_endpoint_offset+1),
+        interface_number(new_interface_number)
+        {};
+
+        USBVendorBulkPipe(const USBVendorBulkPipe&) = delete;
+        USBVendorBulkPipe(USBVendorBulkPipe&& other) = delete;
+
+        bool isConnected() {
+            return usb.isConnected() && _configured;
+        }
+
+        // How many received messages are waiting to be released.
+        uint8_t available() const {
+            return (uint8_t)(_rx_done - _rx_released);
+        }
+
+        // Look at the nth (from 0) received message, in place. It stays valid until it's release()d.
+        bool receive(const char *&data, uint16_t &length, const uint8_t n = 0) const {
+            if (n >= available()) {
+                return false;
+            }
+            const uint8_t index = (_rx_released + n) % slots;
+            data = _rx_buffers[index];
+            length = _rx_lengths[index];
+            return true;
+        }
+
+        // Hand the oldest received message's slot back, to receive into again.
+        void release() {
+            if (available() == 0) {
+                return;
+            }
+            _rx_released = _rx_released + 1;
+
+            // If the DMA is still going, the interrupt will queue the slot when the next message comes in.
+            if (_rx_queued == _rx_done) {
+                _fillRXRing();
+            }
+        }
+
+        // How many more messages send() will take right now.
+        uint8_t sendable() const {
+            return slots - (uint8_t)(_tx_queued - _tx_done);
+        }
+
+        // Queue length bytes of data (up to messageSize) to be sent from where they are, without copying.
+        // The data must stay put until message_sent_callback says it's gone. Returns false if there's no slot.
+        bool send(const char *data, const uint16_t length) {
+            if (!_configured || (length > messageSize) || (sendable() == 0)) {
+                return false;
+            }
+            const uint8_t index = _tx_queued % slots;
+            _tx_descriptors[index].setBuffer((char *)data, length);
+            _tx_queued = _tx_queued + 1;
+            return usb.queueInRing(write_endpoint, index);
+        }
+
+        // Both are called from the USB interrupt, once per message.
+        void setMessageReceivedCallback(const Delegate<void()> &callback) {
+            message_received_callback = callback;
+        }
+
+        void setMessageSentCallback(const Delegate<void()> &callback) {
+            message_sent_callback = callback;
+        }
+
+        void _fillRXRing() {
+            while (_configured && ((uint8_t)(_rx_queued - _rx_released) < slots) && ((uint8_t)(_rx_queued - _rx_done) < _rx_depth)) {
+                const uint8_t index = _rx_queued % slots;
+                _rx_descriptors[index].setBuffer(_rx_buffers[index], messageSize);
+                _rx_queued = _rx_queued + 1;
+                usb.queueInRing(read_endpoint, index);
+            }
+        }
+
+        void _resetCounters() {
+            _rx_done = _rx_released = _rx_queued = 0;
+            _tx_done = _tx_queued = 0;
+        }
+
+        // This is called from the USBDevice once the host has picked our configuration.
+        void handleConfigured() {
+            _resetCounters();
+            _configured = true;
+
+            for (uint8_t i = 0; i < slots; i++) {
+                _rx_descriptors[i].setBuffer(_rx_buffers[i], messageSize);
+            }
+            usb.setupRing(read_endpoint, _rx_descriptors, slots);
+            usb.setupRing(write_endpoint, _tx_descriptors, slots);
+
+            _fillRXRing();
+        }
+
+        void handleConnectionStateChanged(const bool connected) {
+            if (!connected) {
+                _configured = false;
+                _resetCounters();
+            }
+        }
+
+        // This is to be called from USBDeviceHardware as each message is received or sent.
+        // It returns if the request was handled or not.
+        bool handleDescriptorDone(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            if (endpointNum == read_endpoint) {
+                _rx_lengths[descriptorIndex] = length;
+                _rx_done = _rx_done + 1;
+                _fillRXRing();
+                if (message_received_callback) {
+                    message_received_callback();
+                }
+                return true;
+            }
+            if (endpointNum == write_endpoint) {
+                _tx_done = _tx_done + 1;
+                if (message_sent_callback) {
+                    message_sent_callback();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        // The end of a ring's run means nothing more was queued, which handleDescriptorDone() has covered.
+        bool handleTransferDone(const uint8_t &endpointNum) {
+            return (endpointNum == read_endpoint) || (endpointNum == write_endpoint);
+        }
+
+        // The BOS descriptor, which points Windows at the MS OS 2.0 descriptor set.
+        bool sendSpecialDescriptorOrConfig(const Setup_t &setup) const {
+            if (setup.valueHigh() != kBOSDescriptor) {
+                return false;
+            }
+
+            struct _bos_t {
+                USBDescriptorBOSHeader_t BOS_Header;
+                USBDescriptorMSOSPlatformCapability_t MSOS_Capability;
+            } ATTR_PACKED;
+
+            _bos_t *bos = new (&USBControlBuffer) _bos_t{
+                {/* _TotalLength = */ sizeof(_bos_t), /* _NumDeviceCaps = */ 1},
+                {/* _SetTotalLength = */ sizeof(USBDescriptorMSOSSet_t)}
+            };
+            usb.writeToControl((char *)bos, sizeof(_bos_t));
+            return true;
+        }
+
+        bool handleNonstandardRequest(const Setup_t &setup) {
+            if ((setup._bmRequestType == (Setup_t::kRequestDeviceToHost | Setup_t::kRequestVendor | Setup_t::kRequestDevice)) &&
+                setup.requestIs(kMSOSVendorCode) && (setup.index() == kMSOSDescriptorIndex)) {
+                static const char16_t default_guid[] = u"{2B7C5F0A-6D3E-4C1B-9A8F-4D6F7E5C3B21}";
+                const char16_t *guid = getUSBVendorBulkGUID ? getUSBVendorBulkGUID() : default_guid;
+
+                USBDescriptorMSOSSet_t *set = new (&USBControlBuffer) USBDescriptorMSOSSet_t(guid);
+                usb.writeToControl((char *)set, sizeof(USBDescriptorMSOSSet_t));
+                return true;
+            }
+            return false;
+        }
+
+        static uint16_t _packetSize(const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed, const uint8_t endpoint) {
+            return std::min<uint16_t>(packetSize, Motate::getEndpointSize(endpoint, kEndpointTypeBulk, deviceSpeed, otherSpeed));
+        }
+
+        const EndpointBufferSettings_t getEndpointSettings(const uint8_t endpoint, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) const {
+            if (endpoint == read_endpoint)
+            {
+                const EndpointBufferSettings_t _buffer_size = getBufferSizeFlags(_packetSize(deviceSpeed, otherSpeed, endpoint));
+                return kEndpointBufferOutputFromHost | _buffer_size | kEndpointBufferBlocksUpTo2 | kEndpointBufferTypeBulk;
+            }
+            else if (endpoint == write_endpoint)
+            {
+                const EndpointBufferSettings_t _buffer_size = getBufferSizeFlags(_packetSize(deviceSpeed, otherSpeed, endpoint));
+                return kEndpointBufferInputToHost | _buffer_size | kEndpointBufferBlocksUpTo2 | kEndpointBufferTypeBulk;
+            }
+            return kEndpointBufferNull;
+        };
+
+        uint16_t getEndpointSize(const uint8_t &endpoint, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) const {
+            if ((endpoint == read_endpoint) || (endpoint == write_endpoint))
+            {
+                return _packetSize(deviceSpeed, otherSpeed, endpoint);
+            }
+            return 0;
+        };
+    };
+
+#pragma mark USBMixin< usb_parent_type, position, USBVendorBulk<...> >
+    template <typename usb_parent_type, uint8_t position, uint16_t packetSize, uint16_t messageSize, uint8_t slots>
+    struct USBMixin< usb_parent_type, position, USBVendorBulk<packetSize, messageSize, slots> > : USBVendorBulk<packetSize, messageSize, slots> {
+
+        typedef USBMixin<usb_parent_type, position, USBVendorBulk<packetSize, messageSize, slots>> this_type;
+
+        // USBVendorBulk defines endpoints_used
+        static const uint8_t interfaces_used = 1;
+
+        USBVendorBulkPipe< usb_parent_type, packetSize, messageSize, slots > Bulk;
+
+        USBMixin (usb_parent_type &usb_parent,
+                  const uint8_t new_endpoint_offset,
+                  const uint8_t first_interface_number
+                  )
+        : Bulk(usb_parent, new_endpoint_offset, first_interface_number)
+        {};
+
+        const EndpointBufferSettings_t getEndpointConfigFromMixin(const uint8_t endpoint, const USBDeviceSpeed_t deviceSpeed, const bool other_speed) const {
+            return Bulk.getEndpointSettings(endpoint, deviceSpeed, other_speed);
+        };
+        void handleConnectionStateChangedInMixin(const bool connected) {
+            Bulk.handleConnectionStateChanged(connected);
+        };
+        void handleConfiguredInMixin() {
+            Bulk.handleConfigured();
+        };
+        bool handleNonstandardRequestInMixin(const Setup_t &setup) {
+            return Bulk.handleNonstandardRequest(setup);
+        };
+        bool handleTransferDoneInMixin(const uint8_t &endpointNum) {
+            return Bulk.handleTransferDone(endpointNum);
+        }
+        bool handleDescriptorDoneInMixin(const uint8_t &endpointNum, const uint8_t &descriptorIndex, const uint16_t &length) {
+            return Bulk.handleDescriptorDone(endpointNum, descriptorIndex, length);
+        }
+        bool handleDataAvailableInMixin(const uint8_t &endpointNum, const size_t &length) {
+            return false;
+        }
+        uint16_t getEndpointSizeFromMixin(const uint8_t endpoint, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) const {
+            return Bulk.getEndpointSize(endpoint, deviceSpeed, otherSpeed);
+        };
+        bool sendSpecialDescriptorOrConfig(const Setup_t &setup) const {
+            return Bulk.sendSpecialDescriptorOrConfig(setup);
+        };
+    };
+
+#pragma mark USBDefaultDescriptor < USBVendorBulk<...> >
+    // Alone, we say USB 2.1 so the host asks for the BOS descriptor (and so the MS OS 2.0 descriptors).
+    template <uint16_t packetSize, uint16_t messageSize, uint8_t slots>
+    struct USBDefaultDescriptor < USBVendorBulk<packetSize, messageSize, slots> > : USBDescriptorDevice_t {
+        USBDefaultDescriptor(const uint16_t vendorID, const uint16_t productID, const uint16_t productVersion, const USBDeviceSpeed_t deviceSpeed) :
+        USBDescriptorDevice_t(
+                              /*    USBSpecificationBCD = */ USBFloatToBCD(2.1),
+                              /*                  Class = */ kNoDeviceClass,
+                              /*               SubClass = */ kNoDeviceSubclass,
+                              /*               Protocol = */ kNoDeviceProtocol,
+
+                              /*          Endpoint0Size = */ (uint8_t)getEndpointSize(0, kEndpointTypeControl, deviceSpeed, false),
+
+                              /*               VendorID = */ vendorID,
+                              /*              ProductID = */ productID,
+                              /*          ReleaseNumber = */ productVersion,
+
+                              /*   ManufacturerStrIndex = */ kManufacturerStringId,
+                              /*        ProductStrIndex = */ kProductStringId,
+                              /*      SerialNumStrIndex = */ kSerialNumberId,
+
+                              /* NumberOfConfigurations = */ 1
+                              )
+        {};
+    };
+
+#pragma mark USBConfigMixins< USBVendorBulk<...>, ?, ? >
+
+    // One vendor-specific interface with its two endpoints, the same alone or alongside others.
+    template <uint16_t packetSize, uint16_t messageSize, uint8_t slots, uint8_t usb_interface_positon, uint8_t interface_count>
+    struct USBConfigMixin<USBVendorBulk<packetSize, messageSize, slots>, usb_interface_positon, interface_count>
+    {
+        static const uint8_t interfaces = 1;
+        static const uint8_t endpoints = 2;
+
+        const USBDescriptorInterface_t Bulk_Interface;
+        USBDescriptorEndpoint_t Bulk_DataOutEndpoint;
+        USBDescriptorEndpoint_t Bulk_DataInEndpoint;
+
+        USBConfigMixin (
+                        const uint8_t _first_endpoint_number,
+                        const uint8_t _first_interface_number,
+                        const USBDeviceSpeed_t _deviceSpeed,
+                        const bool _other_speed
+                        )
+        : Bulk_Interface(
+                         /* _InterfaceNumber   = */ _first_interface_number,
+                         /* _AlternateSetting  = */ 0,
+                         /* _TotalEndpoints    = */ 2,
+
+                         /* _Class             = */ kVendorSpecificClass,
+                         /* _SubClass          = */ kVendorSpecificSubclass,
+                         /* _Protocol          = */ kVendorSpecificProtocol,
+
+                         /* _InterfaceStrIndex = */ 0 // none
+                         ),
+        Bulk_DataOutEndpoint(
+                             /* _deviceSpeed       = */ _deviceSpeed,
+                             /* _otherSpeed        = */ _other_speed,
+                             /* _input             = */ false,
+                             /* _EndpointAddress   = */ _first_endpoint_number,
+                             /* _Attributes        = */ (kEndpointTypeBulk | kEndpointAttrNoSync | kEndpointUsageData),
+                             /* _PollingIntervalMS = */ 0x01
+                             ),
+        Bulk_DataInEndpoint(
+                            /* _deviceSpeed       = */ _deviceSpeed,
+                            /* _otherSpeed        = */ _other_speed,
+                            /* _input             = */ true,
+                            /* _EndpointAddress   = */ _first_endpoint_number+1,
+                            /* _Attributes        = */ (kEndpointTypeBulk | kEndpointAttrNoSync | kEndpointUsageData),
+                            /* _PollingIntervalMS = */ 0x01
+                            )
+        {
+            // The endpoint descriptor picks the largest packet for the speed, and we may want less.
+            if (Bulk_DataOutEndpoint.EndpointSize > packetSize) {
+                Bulk_DataOutEndpoint.EndpointSize = packetSize;
+            }
+            if (Bulk_DataInEndpoint.EndpointSize > packetSize) {
+                Bulk_DataInEndpoint.EndpointSize = packetSize;
+            }
+        };
+
+        static bool isNull() { return false; };
+    };
+}
+
+#endif
+// MOTATEUSBVENDORBULK_ONCE
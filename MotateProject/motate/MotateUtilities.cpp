@@ -39,82 +39,416 @@ namespace Motate {
     // We'll put these in the Private namespace for now, to indicate that they're private.
     namespace Private {
 
-        constexpr float round_lookup_[] = {
-                0.5,          // precision 0
-                0.05,         // precision 1
-                0.005,        // precision 2
-                0.0005,       // precision 3
-                0.00005,      // precision 4
-                0.000005,     // precision 5
-                0.0000005,    // precision 6
-                0.00000005,   // precision 7
-                0.000000005,  // precision 8
-                0.0000000005, // precision 9
-                0.00000000005 // precision 10
-            };
+        // "00" "01" ... "99": two digits per lookup halves the divides (and on the M0 and
+        // AVR parts, where there's no hardware divide, those are the expensive part).
+        static const char digit_pairs_[201] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
 
-        int c_floattoa(float in, char *buffer, int maxlen, int precision) {
-            int length_ = 0;
-            char *b_ = buffer;
+        // These are small and in every loop, and -Os won't inline them on its own
+        static inline __attribute__ ((always_inline)) void copy_pair_(char *p, const uint32_t pair) {
+            p[0] = digit_pairs_[pair * 2];
+            p[1] = digit_pairs_[pair * 2 + 1];
+        }
+
+        // The high word of a * b, with the low word in low. The M3 and up do that in one
+        // UMULL, but the M0 and AVR have no long multiply, and a uint64_t one would be a library
+        // call there, so they take it as four 16x16->32 multiplies.
+        static inline __attribute__ ((always_inline)) uint32_t mul_high_(const uint32_t a, const uint32_t b, uint32_t &low) {
+#if defined(__AVR__) || defined(__ARM_ARCH_6M__)
+            const uint32_t low_low_ = (a & 0xFFFF) * (b & 0xFFFF);
+            const uint32_t low_high_ = (a & 0xFFFF) * (b >> 16);
+            const uint32_t high_low_ = (a >> 16) * (b & 0xFFFF);
+            // Three numbers under 2^16, so no carry is lost
+            const uint32_t middle_ = (low_low_ >> 16) + (low_high_ & 0xFFFF) + (high_low_ & 0xFFFF);
+            low = (middle_ << 16) | (low_low_ & 0xFFFF);
+            return ((a >> 16) * (b >> 16)) + (low_high_ >> 16) + (high_low_ >> 16) + (middle_ >> 16);
+#else
+            const uint64_t product_ = (uint64_t)a * b;
+            low = (uint32_t)product_;
+            return (uint32_t)(product_ >> 32);
+#endif
+        }
 
-            if (in < 0.0) {
-                *b_++ = '-';
-                return c_floattoa(-in, b_, maxlen-1, precision) + 1;
+        // value / 100 and value / 10 as a multiply and a shift, exact for any uint32_t. gcc only
+        // does this itself above -Os, and a divide is slower than a multiply (or, on the M0 and
+        // AVR, a library call).
+        static inline __attribute__ ((always_inline)) uint32_t div100_(const uint32_t value) {
+            uint32_t low_ = 0;
+            return mul_high_(value, 0x51EB851Fu, low_) >> 5;
+        }
+        static inline __attribute__ ((always_inline)) uint32_t div10_(const uint32_t value) {
+            uint32_t low_ = 0;
+            return mul_high_(value, 0xCCCCCCCDu, low_) >> 3;
+        }
+
+        // Write value in decimal *backwards*, ending just before end, and return the
+        // first character written.
+        static char *u32_backwards_(uint32_t value, char *end) {
+            while (value >= 100) {
+                const uint32_t q = div100_(value);
+                end -= 2;
+                copy_pair_(end, value - (q * 100));
+                value = q;
+            }
+            if (value >= 10) {
+                end -= 2;
+                copy_pair_(end, value);
+            } else {
+                *--end = '0' + value;
             }
+            return end;
+        }
 
-            // float round_ = 0.5;
-            in = in + round_lookup_[precision];
+        // Write the last count digits of value *backwards*, with leading zeros, ending just before end.
+        static void u32_padded_backwards_(uint32_t value, int count, char *end) {
+            while (count >= 2) {
+                const uint32_t q = div100_(value);
+                end -= 2;
+                copy_pair_(end, value - (q * 100));
+                value = q;
+                count -= 2;
+            }
+            if (count > 0) {
+                *--end = '0' + value;
+            }
+        }
 
-            int int_length_ = 0;
+        static constexpr uint32_t kPowersOf10[] = {1, 10, 100, 1000, 10000, 100000,
+            1000000, 10000000, 100000000, 1000000000};
 
-            int integer_part_ = (int)in;
+        // Without branches: the bit length gives the digit count to within one (1233/4096 is
+        // just over log10(2)), and one compare settles it.
+        static inline __attribute__ ((always_inline)) int u32_length_(uint32_t value) {
+            value |= 1; // 0 is one digit, like 1
+            // (unsigned int is only 16 bits on the AVR parts, so this takes the long one)
+            const int bits_ = (int)(sizeof(unsigned long) * 8) - __builtin_clzl(value);
+            // (and so is int, so bits_ * 1233, up to 39456, is done as a uint32_t)
+            const int guess_ = (int)(((uint32_t)bits_ * 1233) >> 12);
+            return guess_ + ((value >= kPowersOf10[guess_]) ? 1 : 0);
+        }
 
-            while (integer_part_ > 0) {
-                if (length_++ > maxlen) {
+        // Check that length chars and a \0 fit in maxlen, and write the \0 if they do.
+        static inline __attribute__ ((always_inline)) bool reserve_(char *buffer, const int length, const int maxlen) {
+            if (length >= maxlen) {
+                if (maxlen > 0) {
                     *buffer = 0;
+                }
+                return false;
+            }
+            buffer[length] = 0;
+            return true;
+        }
+
+        int c_u32toa(uint32_t value, char *buffer, int maxlen) {
+            const int length_ = u32_length_(value);
+            if (!reserve_(buffer, length_, maxlen)) {
+                return 0;
+            }
+            u32_backwards_(value, buffer + length_);
+            return length_;
+        }
+
+        int c_i32toa(int32_t value, char *buffer, int maxlen) {
+            if (value >= 0) {
+                return c_u32toa(value, buffer, maxlen);
+            }
+            // Negate as unsigned, so INT32_MIN works
+            const uint32_t magnitude_ = 0u - (uint32_t)value;
+            const int length_ = u32_length_(magnitude_) + 1;
+            if (!reserve_(buffer, length_, maxlen)) {
+                return 0;
+            }
+            *buffer = '-';
+            u32_backwards_(magnitude_, buffer + length_);
+            return length_;
+        }
+
+        // The float is handled as the exact binary value it holds, mantissa * 2^exponent,
+        // using nothing wider than 32-bit math, apart from the 32x32->64 multiplies in
+        // mul_high_ (which the M0 and AVR do in 16-bit halves):
+        //
+        // * Up to nine places of a value of 2^-9 and up (nearly everything we print) is one
+        //   multiply of the fraction, as 32-bit fixed point, by 10^places. See below.
+        //
+        // * The fraction is a fixed-point number held in 16-bit "limbs" (in uint32_t's),
+        //   with the binary point just above the top limb. Multiplying every limb by
+        //   10000 moves the next four decimal digits out the top, and 0xFFFF * 10000 plus
+        //   the carry still fits in 32 bits. Whatever is left after the last digit is the
+        //   exact remainder, so rounding is exact too.
+        //
+        // * The integer part fits in 24 bits unless the value is 2^32 or larger, which
+        //   takes the (rare) slow path: divide limbs by 10000 to get four digits at a time.
+        //
+        // Rounding is to nearest, with exact ties going to the even digit, which is what
+        // printf("%.*f") does.
+
+        static constexpr int kMaxPrecision = 10;
+
+        // The fast path takes up to nine digits at once
+        static constexpr int kMaxFastPrecision = 9;
+
+        // A float has up to 149 fraction bits (the smallest denormal is 2^-149)
+        static constexpr int kFractionLimbs = (149 + 15) / 16;
+        // ... and up to 128 integer bits
+        static constexpr int kIntegerLimbs = 128 / 16 + 1;
+
+        // Take up to four digits at a time
+        static inline uint32_t multiplier_for_(const int remaining) {
+            return (remaining >= 4) ? 10000 : (remaining >= 2) ? 100 : 10;
+        }
+
+        // Write the digits that multiplier moved out of the fraction, returning how many.
+        static inline int emit_digits_(const uint32_t carry, const uint32_t multiplier, char *p) {
+            if (multiplier == 10000) {
+                const uint32_t high_ = carry / 100;
+                copy_pair_(p, high_);
+                copy_pair_(p + 2, carry - (high_ * 100));
+                return 4;
+            }
+            if (multiplier == 100) {
+                copy_pair_(p, carry);
+                return 2;
+            }
+            *p = '0' + carry;
+            return 1;
+        }
+
+        // Writes the integer part mantissa * 2^exponent (exponent > 8) backwards, ending at end.
+        static char *big_integer_backwards_(const uint32_t mantissa, const int exponent, char *end) {
+            uint32_t limbs_[kIntegerLimbs] = {};
+            const int limb_ = exponent / 16;
+            const int shift_ = exponent % 16;
+            // mantissa < 2^24, so it spans at most three limbs after the shift
+            limbs_[limb_]     = (mantissa << shift_) & 0xFFFF;
+            limbs_[limb_ + 1] = (mantissa >> (16 - shift_)) & 0xFFFF;
+            if (shift_ > 8) {
+                limbs_[limb_ + 2] = (mantissa >> (32 - shift_)) & 0xFFFF;
+            }
+
+            int top_ = kIntegerLimbs - 1;
+            while (true) {
+                while ((top_ > 0) && (limbs_[top_] == 0)) {
+                    top_--;
+                }
+                uint32_t remainder_ = 0;
+                for (int i = top_; i >= 0; i--) {
+                    const uint32_t t_ = (remainder_ << 16) | limbs_[i];
+                    limbs_[i] = t_ / 10000;
+                    remainder_ = t_ - (limbs_[i] * 10000);
+                }
+                if ((top_ == 0) && (limbs_[0] == 0)) {
+                    // The last group: no leading zeros
+                    return u32_backwards_(remainder_, end);
+                }
+                const uint32_t high_ = remainder_ / 100;
+                end -= 4;
+                copy_pair_(end, high_);
+                copy_pair_(end + 2, remainder_ - (high_ * 100));
+            }
+        }
+
+        int c_floattoa(float in, char *buffer, int maxlen, int precision) {
+            if (precision < 0) {
+                precision = 0;
+            } else if (precision > kMaxPrecision) {
+                precision = kMaxPrecision;
+            }
+
+            uint32_t bits_;
+            static_assert(sizeof(bits_) == sizeof(in), "c_floattoa requires a 32-bit IEEE-754 float");
+            __builtin_memcpy(&bits_, &in, sizeof(bits_));
+
+            const int sign_length_ = (bits_ & 0x80000000) ? 1 : 0;
+            const uint32_t biased_exponent_ = (bits_ >> 23) & 0xFF;
+            uint32_t mantissa_ = bits_ & 0x7FFFFF;
+            if (biased_exponent_ == 0xFF) {
+                // There's no "-nan"
+                const char *name_ = mantissa_ ? "nan" : sign_length_ ? "-inf" : "inf";
+                const int length_ = c_strlen(name_);
+                if (!reserve_(buffer, length_, maxlen)) {
                     return 0;
                 }
-                int t_ = integer_part_ / 10;
-                *b_++ = '0' + (integer_part_ - (t_*10));
-                integer_part_ = t_;
-                int_length_++;
+                for (int i = 0; i < length_; i++) {
+                    buffer[i] = name_[i];
+                }
+                return length_;
             }
-            if (length_ > 0) {
-                c_strreverse(buffer, int_length_);
+
+            // value == mantissa_ * 2^exponent_
+            int exponent_;
+            if (biased_exponent_ == 0) {
+                exponent_ = -149; // denormal
             } else {
-                *b_++ = '0';
-                int_length_++;
+                mantissa_ |= 0x800000;
+                exponent_ = (int)biased_exponent_ - 150;
             }
 
-            *b_++ = '.';
-            length_ = int_length_+1;
+            if (exponent_ >= 0) {
+                // An integer, with no fraction to round
+                if (exponent_ <= 8) {
+                    const uint32_t integer_ = mantissa_ << exponent_;
+                    const int length_ = sign_length_ + u32_length_(integer_);
+                    if (!reserve_(buffer, length_, maxlen)) {
+                        return 0;
+                    }
+                    *buffer = '-'; // overwritten if it's positive
+                    u32_backwards_(integer_, buffer + length_);
+                    return length_;
+                }
 
-            float frac_part_ = in;
-            frac_part_ -= (int)frac_part_;
-            while (precision-- > 0) {
-                if (length_++ > maxlen) {
-                    *buffer = 0;
+                char digits_[39];
+                char *end_ = digits_ + sizeof(digits_);
+                const char *start_ = big_integer_backwards_(mantissa_, exponent_, end_);
+                const int length_ = sign_length_ + (end_ - start_);
+                if (!reserve_(buffer, length_, maxlen)) {
                     return 0;
                 }
-                frac_part_ *= 10.0;
-                // if (precision==0) {
-                //     t_ += 0.5;
-                // }
-                *b_++ = ('0' + (int)frac_part_);
-                frac_part_ -= (int)frac_part_;
+                *buffer = '-';
+                for (char *b_ = buffer + sign_length_; start_ < end_; ) {
+                    *b_++ = *start_++;
+                }
+                return length_;
             }
 
-            // reduce extra characters
-            while (*(b_-1) == '0' && length_>1) {
-                b_--; *b_ = 0;
-                length_--;
+            const int fraction_bits_ = -exponent_;
+            uint32_t integer_part_ = (fraction_bits_ < 24) ? (mantissa_ >> fraction_bits_) : 0;
+            const uint32_t fraction_ = (fraction_bits_ < 24) ? (mantissa_ & ((1u << fraction_bits_) - 1)) : mantissa_;
+
+            if ((fraction_bits_ <= 32) && (precision <= kMaxFastPrecision)) {
+                // |in| >= 2^-9 and up to nine places, which is nearly everything we print.
+                // The fraction is a 32-bit fixed-point number, and one 32x32->64 multiply (a
+                // single UMULL on the M3 and up) moves all of the digits out at once: the high
+                // word is the digits, and the low word is the exact remainder.
+                const uint32_t fraction32_ = (fraction_bits_ < 32) ? (fraction_ << (32 - fraction_bits_)) : fraction_;
+                uint32_t remainder_ = 0;
+                uint32_t decimals_ = mul_high_(fraction32_, kPowersOf10[precision], remainder_);
+
+                // Round: above half rounds up, and exactly half rounds to even.
+                if ((remainder_ > 0x80000000) ||
+                    ((remainder_ == 0x80000000) && (((precision > 0) ? decimals_ : integer_part_) & 1))) {
+                    if (++decimals_ == kPowersOf10[precision]) {
+                        decimals_ = 0;
+                        integer_part_++;
+                    }
+                }
+
+                // reduce extra characters
+                int decimal_count_ = precision;
+                while ((decimal_count_ > 0) && (decimals_ == (div10_(decimals_) * 10))) {
+                    decimals_ = div10_(decimals_);
+                    decimal_count_--;
+                }
+
+                const int integer_length_ = sign_length_ + u32_length_(integer_part_);
+                const int length_ = integer_length_ + ((decimal_count_ > 0) ? (decimal_count_ + 1) : 0);
+                if (!reserve_(buffer, length_, maxlen)) {
+                    return 0;
+                }
+                *buffer = '-';
+                u32_backwards_(integer_part_, buffer + integer_length_);
+                if (decimal_count_ > 0) {
+                    buffer[integer_length_] = '.';
+                    u32_padded_backwards_(decimals_, decimal_count_, buffer + length_);
+                }
+                return length_;
+            }
+
+            char digits_[kMaxPrecision + 4];
+            int digit_count_ = 0;
+            // Where the remainder (what's left after the last digit) is, compared to one half
+            int versus_half_;
+
+            if (fraction_bits_ <= 32) {
+                // |in| >= 2^-9 at ten places: the fraction fits in 32 bits, as two limbs.
+                uint32_t fraction32_ = (fraction_bits_ < 32) ? (fraction_ << (32 - fraction_bits_)) : fraction_;
+                while ((digit_count_ < precision) && (fraction32_ != 0)) {
+                    const uint32_t multiplier_ = multiplier_for_(precision - digit_count_);
+                    const uint32_t low_ = (fraction32_ & 0xFFFF) * multiplier_;
+                    const uint32_t high_ = ((fraction32_ >> 16) * multiplier_) + (low_ >> 16);
+                    fraction32_ = (high_ << 16) | (low_ & 0xFFFF);
+                    digit_count_ += emit_digits_(high_ >> 16, multiplier_, digits_ + digit_count_);
+                }
+                versus_half_ = (fraction32_ > 0x80000000) ? 1 : (fraction32_ == 0x80000000) ? 0 : -1;
+
+            } else {
+                // Line the fraction up so the binary point is just above the top limb
+                uint32_t limbs_[kFractionLimbs];
+                const int limb_count_ = (fraction_bits_ + 15) / 16;
+                const int pad_ = (limb_count_ * 16) - fraction_bits_;
+                for (int i = 0; i < limb_count_; i++) {
+                    const int shift_ = (i * 16) - pad_;
+                    limbs_[i] = (shift_ < 0) ? ((fraction_ << -shift_) & 0xFFFF)
+                              : (shift_ < 24) ? ((fraction_ >> shift_) & 0xFFFF)
+                              : 0;
+                }
+
+                // The low limbs go to zero as we go (10000 is 2^4 * 625), so skip them,
+                // and stop early once the fraction runs out.
+                int low_ = 0;
+                while ((low_ < limb_count_) && (limbs_[low_] == 0)) {
+                    low_++;
+                }
+                while ((digit_count_ < precision) && (low_ < limb_count_)) {
+                    const uint32_t multiplier_ = multiplier_for_(precision - digit_count_);
+                    uint32_t carry_ = 0;
+                    for (int i = low_; i < limb_count_; i++) {
+                        const uint32_t t_ = (limbs_[i] * multiplier_) + carry_;
+                        limbs_[i] = t_ & 0xFFFF;
+                        carry_ = t_ >> 16;
+                    }
+                    digit_count_ += emit_digits_(carry_, multiplier_, digits_ + digit_count_);
+                    while ((low_ < limb_count_) && (limbs_[low_] == 0)) {
+                        low_++;
+                    }
+                }
+
+                const uint32_t top_ = (low_ < limb_count_) ? limbs_[limb_count_ - 1] : 0;
+                versus_half_ = (top_ < 0x8000) ? -1 : ((top_ > 0x8000) || (low_ < limb_count_ - 1)) ? 1 : 0;
+            }
+
+            // Round: above half rounds up, and exactly half rounds to even.
+            if ((versus_half_ > 0) ||
+                ((versus_half_ == 0) && (((digit_count_ > 0) ? (uint32_t)(digits_[digit_count_ - 1] - '0') : integer_part_) & 1))) {
+                int i = digit_count_ - 1;
+                while ((i >= 0) && (digits_[i] == '9')) {
+                    digits_[i--] = '0';
+                }
+                if (i >= 0) {
+                    digits_[i]++;
+                } else {
+                    integer_part_++;
+                }
             }
 
-            if (*(b_-1) == '.') {
-                b_--; *b_ = 0;
-                length_--;
+            // reduce extra characters
+            while ((digit_count_ > 0) && (digits_[digit_count_ - 1] == '0')) {
+                digit_count_--;
             }
 
+            // integer_part_ < 2^24 here, even after rounding
+            const int integer_length_ = sign_length_ + u32_length_(integer_part_);
+            const int length_ = integer_length_ + ((digit_count_ > 0) ? (digit_count_ + 1) : 0);
+            if (!reserve_(buffer, length_, maxlen)) {
+                return 0;
+            }
+            *buffer = '-';
+            u32_backwards_(integer_part_, buffer + integer_length_);
+            if (digit_count_ > 0) {
+                char *b_ = buffer + integer_length_;
+                *b_++ = '.';
+                for (int i = 0; i < digit_count_; i++) {
+                    b_[i] = digits_[i];
+                }
+            }
             return length_;
         }
 
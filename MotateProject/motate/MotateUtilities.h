@@ -30,6 +30,7 @@
 #ifndef MOTATEUTILITIES_H_ONCE
 #define MOTATEUTILITIES_H_ONCE
 
+#include <cstdint>
 #include <type_traits>
 #include <utility>
 #include <stdio.h>
@@ -68,9 +69,21 @@ namespace Motate {
                 : count_;
         }
 
+        // Runtime formatters. These write at most maxlen characters *including* the \0,
+        // and return the number of characters written (not counting the \0), or 0 (with
+        // buffer[0] = \0) if it wouldn't fit. They only use 32-bit math.
+
+        // Formats the exact value of in, rounded to precision (0-10) decimal places like
+        // printf("%.*f") does, then drops trailing zeros (and a trailing '.').
+        // Values of 2^31 and up are fine, as are "inf" and "nan".
         // TODO: Make c_floattoa a constexpr, which will be difficult.
         int c_floattoa(float in, char *buffer, int maxlen, int precision);
 
+        // Integer to decimal, two digits at a time. Use these instead of c_itoa when
+        // the value isn't a compile-time constant.
+        int c_u32toa(uint32_t value, char *buffer, int maxlen);
+        int c_i32toa(int32_t value, char *buffer, int maxlen);
+
 
         // Returns the number of characters written (not counting the final \0), or 0 if it needed > maxlen.
         // NOTE: It will NOT replace the \0 at the beginning when it runs out of room!
@@ -263,7 +276,9 @@ namespace Motate {
             template <typename int_type>
             constexpr bool copy(int_type i) const {
                 return (l_>w_)
-                    ? record_copy_zerofail_(c_itoa(i, b_+w_, l_-w_-r_))
+                    ? record_copy_zerofail_(std::is_unsigned<int_type>::value
+                                            ? c_u32toa(i, b_+w_, l_-w_-r_)
+                                            : c_i32toa(i, b_+w_, l_-w_-r_))
                     : false;
             };
 
@@ -275,30 +290,484 @@ namespace Motate {
 
         // constexp atof = c_atof
 
-        // Fraction part
-        constexpr float c_atof_frac_(char *&p_, float v_, float m_) {
-            return ((*p_ >= '0') && (*p_ <= '9'))
-            ? (v_=((v_)+((*p_)-'0')*m_), c_atof_frac_(++p_, v_, m_/10.0))
-            : v_;
+        enum class NumberParseError : uint8_t {
+            kNone,
+            kNoDigits,  // There wasn't a number there (length is 0)
+            kOverflow,  // Too big for a float: value is +/-inf
+            kUnderflow, // Too small for a float: value is +/-0
+        };
+
+        // The value, how many characters it took, and if it went wrong.
+        struct c_strtof_t {
+            float value;
+            int length;
+            NumberParseError error;
+        };
+
+        // Four ASCII characters, first one in the low byte, to check or convert at once.
+        constexpr uint32_t c_load4_(const char *p_) {
+            return (uint32_t)(uint8_t)p_[0] | ((uint32_t)(uint8_t)p_[1] << 8) |
+                   ((uint32_t)(uint8_t)p_[2] << 16) | ((uint32_t)(uint8_t)p_[3] << 24);
         }
 
-        // Integer part
-        template <typename int_type>
-        constexpr float c_atof_int_(char *&p_, int_type v_) {
-            return (*p_ == '.')
-            ? (float)(v_) + c_atof_frac_(++p_, 0, 1.0/10.0)
-            : (
-               ((*p_ >= '0') && (*p_ <= '9'))
-               ? ((v_=((*p_)-'0')+(v_*10)), c_atof_int_(++p_, v_))
-               : v_
-               );
+        // True if all four are '0'-'9': the high nibbles are all 3, and adding 6 doesn't carry into them.
+        constexpr bool c_is4digits_(const uint32_t v_) {
+            return (((v_ & 0xF0F0F0F0) | (((v_ + 0x06060606) & 0xF0F0F0F0) >> 4)) == 0x33333333);
+        }
+
+        // Four digits (as above) to their value: pairs first, then the pairs together.
+        constexpr uint32_t c_4digits_value_(uint32_t v_) {
+            v_ &= 0x0F0F0F0F;
+            v_ = ((v_ * 10) + (v_ >> 8)) & 0x00FF00FF;
+            return ((v_ * 100) + (v_ >> 16)) & 0x0000FFFF;
+        }
+
+        constexpr bool c_isdigit_(const char c_) { return (c_ >= '0') && (c_ <= '9'); }
+        constexpr char c_lower_(const char c_) { return ((c_ >= 'A') && (c_ <= 'Z')) ? (c_ + ('a' - 'A')) : c_; }
+
+        // Powers of ten that are exact: 10^10 is the largest exact float, and 10^22 the largest exact double
+        constexpr float c_pow10f_[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+        constexpr double c_pow10_[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        // With no end_ the string is \0 terminated, and the \0 stops everything anyway.
+        constexpr bool c_before_end_(const char *p_, const char *end_) { return !end_ || (p_ < end_); }
+
+        // Match word (lower-case) at p_, ignoring case, returning its length or 0.
+        constexpr int c_match_word_(const char *p_, const char *end_, const char *word_) {
+            int length_ = 0;
+            while (word_[length_]) {
+                if (!c_before_end_(p_ + length_, end_) || (c_lower_(p_[length_]) != word_[length_])) {
+                    return 0;
+                }
+                length_++;
+            }
+            return length_;
+        }
+
+        // Compare the number with the digits in [p_, digits_end_) (skipping a '.'), taken as
+        // 0.digits * 10^point_, with m_ * 2^e_, exactly. Returns <0, 0, or >0 like strcmp.
+        //
+        // This is c_strtof's slow path, for when the number is too close to halfway between
+        // two floats to tell which it rounds to from a double. m_ * 2^e_ (that halfway point)
+        // is made an integer times a power of ten in a big integer, and written out in decimal
+        // to compare digit for digit. The biggest is 2^25 * 5^150 (halfway to the smallest
+        // denormal), 373 bits and 113 digits.
+        constexpr int c_strtof_compare_(const char *p_, const char * const digits_end_, const int point_,
+                                        const uint32_t m_, const int e_) {
+            uint32_t n_[13] = {};
+            int words_ = 1;
+            n_[0] = m_;
+            int e10_ = 0;
+            if (e_ >= 0) {
+                const int word_shift_ = e_ / 32;
+                const int bit_shift_ = e_ % 32;
+                uint64_t carry_ = 0;
+                for (int i_ = 0; i_ < words_; i_++) {
+                    carry_ |= (uint64_t)n_[i_] << bit_shift_;
+                    n_[i_] = (uint32_t)carry_;
+                    carry_ >>= 32;
+                }
+                if (carry_) {
+                    n_[words_++] = (uint32_t)carry_;
+                }
+                for (int i_ = words_ - 1; i_ >= 0; i_--) {
+                    n_[i_ + word_shift_] = n_[i_];
+                }
+                for (int i_ = 0; i_ < word_shift_; i_++) {
+                    n_[i_] = 0;
+                }
+                words_ += word_shift_;
+            } else {
+                // m_ * 2^e_ == m_ * 5^-e_ * 10^e_
+                e10_ = e_;
+                for (int remaining_ = -e_; remaining_ > 0; remaining_ -= 13) {
+                    uint32_t factor_ = 1;
+                    for (int i_ = 0; (i_ < 13) && (i_ < remaining_); i_++) {
+                        factor_ *= 5;
+                    }
+                    uint64_t carry_ = 0;
+                    for (int i_ = 0; i_ < words_; i_++) {
+                        carry_ += (uint64_t)n_[i_] * factor_;
+                        n_[i_] = (uint32_t)carry_;
+                        carry_ >>= 32;
+                    }
+                    if (carry_) {
+                        n_[words_++] = (uint32_t)carry_;
+                    }
+                }
+            }
+
+            // Nine decimal digits at a time, least significant first
+            uint32_t chunks_[15] = {};
+            int chunk_count_ = 0;
+            while (words_ > 0) {
+                uint64_t remainder_ = 0;
+                for (int i_ = words_ - 1; i_ >= 0; i_--) {
+                    const uint64_t current_ = (remainder_ << 32) | n_[i_];
+                    n_[i_] = (uint32_t)(current_ / 1000000000u);
+                    remainder_ = current_ % 1000000000u;
+                }
+                chunks_[chunk_count_++] = (uint32_t)remainder_;
+                while ((words_ > 0) && (n_[words_ - 1] == 0)) {
+                    words_--;
+                }
+            }
+
+            char digits_[136] = {};
+            int count_ = 0;
+            for (int c_ = chunk_count_ - 1; c_ >= 0; c_--) {
+                char chunk_digits_[9] = {};
+                uint32_t chunk_ = chunks_[c_];
+                for (int i_ = 8; i_ >= 0; i_--) {
+                    chunk_digits_[i_] = '0' + (chunk_ % 10);
+                    chunk_ /= 10;
+                }
+                for (int i_ = 0; i_ < 9; i_++) {
+                    if ((count_ > 0) || (chunk_digits_[i_] != '0')) {
+                        digits_[count_++] = chunk_digits_[i_];
+                    }
+                }
+            }
+
+            // Both have a non-zero first digit, so the point decides, if they differ
+            const int m_point_ = count_ + e10_;
+            if (point_ != m_point_) {
+                return (point_ > m_point_) ? 1 : -1;
+            }
+            int i_ = 0;
+            for (; p_ < digits_end_; p_++) {
+                if (*p_ == '.') {
+                    continue;
+                }
+                const char m_digit_ = (i_ < count_) ? digits_[i_] : '0';
+                if (*p_ != m_digit_) {
+                    return (*p_ > m_digit_) ? 1 : -1;
+                }
+                i_++;
+            }
+            for (; i_ < count_; i_++) {
+                if (digits_[i_] != '0') {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+
+        // A positive float's IEEE bits, and back, with only float math (so they're constexpr).
+        // Anything too big is inf's bits (0x7F800000), and anything not above zero is 0.
+        constexpr uint32_t c_float_bits_(float f_) {
+            if (!(f_ > 0.0f)) {
+                return 0;
+            }
+            if (!(f_ <= 0x1.fffffep+127f)) {
+                return 0x7F800000;
+            }
+            if (f_ < 0x1p-126f) {
+                // Denormal: the bits are just how many 2^-149s it is
+                return (uint32_t)(f_ * 0x1p100f * 0x1p49f);
+            }
+            // Otherwise it's m_ * 2^e_, with m_ in [2^23, 2^24) (powers of two are exact)
+            int e_ = 0;
+            while (f_ >= 0x1p32f) { f_ *= 0x1p-8f; e_ += 8; }
+            while (f_ >= 0x1p24f) { f_ *= 0.5f;    e_++;    }
+            while (f_ <  0x1p15f) { f_ *= 0x1p8f;  e_ -= 8; }
+            while (f_ <  0x1p23f) { f_ *= 2.0f;    e_--;    }
+            return ((uint32_t)(e_ + 150) << 23) | ((uint32_t)f_ & 0x7FFFFF);
+        }
+
+        // The float with bits_ is m_ * 2^e_, exactly.
+        constexpr uint32_t c_float_bits_m_(const uint32_t bits_) {
+            return (bits_ >> 23) ? ((bits_ & 0x7FFFFF) | 0x800000) : bits_;
+        }
+        constexpr int c_float_bits_e_(const uint32_t bits_) {
+            return (bits_ >> 23) ? ((int)(bits_ >> 23) - 150) : -149;
+        }
+
+        constexpr float c_bits_float_(const uint32_t bits_) {
+            float f_ = (float)c_float_bits_m_(bits_);
+            int e_ = c_float_bits_e_(bits_);
+            while (e_ >= 8)  { f_ *= 0x1p8f;  e_ -= 8; }
+            while (e_ > 0)   { f_ *= 2.0f;    e_--;    }
+            while (e_ <= -8) { f_ *= 0x1p-8f; e_ += 8; }
+            while (e_ < 0)   { f_ *= 0.5f;    e_++;    }
+            return f_;
+        }
+
+        // Correctly rounded, from approx_ (a few ULPs off at most), with only integer math: step
+        // one float at a time while the digits are past the halfway point to the next one. This
+        // is for where double is the same as float (avr-gcc), so c_strtof can't use one to get
+        // within 2^-45 of the number. Each step is a c_strtof_compare_, which isn't quick.
+        constexpr float c_strtof_nearest_(const float approx_, const char *p_, const char * const digits_end_,
+                                          const int point_) {
+            uint32_t bits_ = c_float_bits_(approx_);
+            bool moved_up_ = false;
+            while (bits_ < 0x7F800000) {
+                // Halfway up to bits_ + 1 is (2m + 1) * 2^(e - 1). On a tie, the even one.
+                const int compared_ = c_strtof_compare_(p_, digits_end_, point_, (c_float_bits_m_(bits_) * 2) + 1,
+                                                        c_float_bits_e_(bits_) - 1);
+                if (!((compared_ > 0) || ((compared_ == 0) && (bits_ & 1)))) {
+                    break;
+                }
+                bits_++;
+                moved_up_ = true;
+            }
+            while (!moved_up_ && (bits_ > 0)) {
+                const uint32_t below_ = bits_ - 1;
+                const int compared_ = c_strtof_compare_(p_, digits_end_, point_, (c_float_bits_m_(below_) * 2) + 1,
+                                                        c_float_bits_e_(below_) - 1);
+                if (!((compared_ < 0) || ((compared_ == 0) && (bits_ & 1)))) {
+                    break;
+                }
+                bits_ = below_;
+            }
+            return c_bits_float_(bits_);
+        }
+
+        // Take the digits at p_ (stopping at end_, if given) into high_ (the first nine
+        // significant) and low_ (the nine after), counting all of them in significant_.
+        // Leading zeros have to be skipped already. Returns past the last digit.
+        constexpr __attribute__ ((always_inline)) const char *c_strtof_digits_(const char *p_, const char * const end_,
+                                                                               uint32_t &high_, uint32_t &low_,
+                                                                               int32_t &significant_) {
+            // Four at once, while they fit in high_, if end_ says there's room to look ahead
+            if (end_) {
+                while ((end_ - p_ >= 4) && (significant_ <= 5) && c_is4digits_(c_load4_(p_))) {
+                    high_ = (high_ * 10000) + c_4digits_value_(c_load4_(p_));
+                    significant_ += 4;
+                    p_ += 4;
+                }
+            }
+            for (; c_before_end_(p_, end_) && c_isdigit_(*p_); p_++) {
+                if (significant_ < 9) {
+                    high_ = (high_ * 10) + (*p_ - '0');
+                } else if (significant_ < 18) {
+                    low_ = (low_ * 10) + (*p_ - '0');
+                }
+                // (Past eighteen they're only counted -- c_strtof_compare_ still sees them)
+                significant_++;
+            }
+            return p_;
+        }
+
+        // c_strtof past its fast path: the digits from first_digit_ to digits_end_ (with
+        // high_, low_, and the rest as in there) rounded to a float, which is 0 if they
+        // underflow and inf if they overflow. On its own to keep c_strtof small.
+        template <bool wide_double>
+        constexpr float c_strtof_round_(const uint32_t high_, const uint32_t low_, const int32_t significant_,
+                                        const int32_t exponent_, const char * const first_digit_,
+                                        const char * const digits_end_) {
+            // The number is 0.digits * 10^point_. It's out of range either way past these.
+            const int32_t point_ = significant_ + exponent_;
+            if (point_ > 40) {
+                return __builtin_huge_valf();
+            }
+            if (point_ < -46) {
+                return 0.0f;
+            }
+
+            // high_ and low_ (low_digits_ of it) times 10^scale_ is the number, less any digits
+            // past eighteen.
+            const int kept_ = (significant_ > 18) ? 18 : (int)significant_;
+            const int low_digits_ = (kept_ > 9) ? (kept_ - 9) : 0;
+            const int scale_ = (int)point_ - kept_;
+            int remaining_ = (scale_ < 0) ? -scale_ : scale_;
+
+            if (wide_double) {
+                double value_ = ((double)high_ * c_pow10_[low_digits_]) + low_;
+                while (remaining_ > 0) {
+                    const int step_ = (remaining_ > 22) ? 22 : remaining_;
+                    value_ = (scale_ < 0) ? (value_ / c_pow10_[step_]) : (value_ * c_pow10_[step_]);
+                    remaining_ -= step_;
+                }
+
+                // value_ is within a few double ULPs of the number (and the dropped digits are
+                // less than 10^-17 of it), so if both ends of this agree, that's the float. (Both
+                // are positive, and lower_ <= upper_, so only < and > are needed here on.)
+                float lower_ = (float)(value_ * (1.0 - 0x1p-45));
+                const float upper_ = (float)(value_ * (1.0 + 0x1p-45));
+                if (lower_ < upper_) {
+                    // Too close to call: compare with the halfway point, m_ * 2^e_ with m_ odd
+                    double halfway_ = (upper_ > 0x1.fffffep+127f) ? 0x1.ffffffp+127 : (((double)lower_ + upper_) / 2);
+                    int e_ = 0;
+                    while (halfway_ >= 0x1p25) {
+                        halfway_ /= 2;
+                        e_++;
+                    }
+                    while (halfway_ < 0x1p24) {
+                        halfway_ *= 2;
+                        e_--;
+                    }
+                    uint32_t m_ = (uint32_t)halfway_;
+                    while ((m_ & 1) == 0) {
+                        m_ >>= 1;
+                        e_++;
+                    }
+
+                    const int compared_ = c_strtof_compare_(first_digit_, digits_end_, point_, m_, e_);
+                    // On a tie, the even one (lower_ is m_ / 2 in its last place)
+                    if ((compared_ > 0) || ((compared_ == 0) && ((m_ >> 1) & 1))) {
+                        lower_ = upper_;
+                    }
+                }
+                return lower_;
+            } else {
+                // Each of these is within half a float ULP, so a few ULPs all told
+                float approx_ = (float)high_;
+                if (low_digits_ > 0) {
+                    approx_ = (approx_ * c_pow10f_[low_digits_]) + (float)low_;
+                }
+                while (remaining_ > 0) {
+                    const int step_ = (remaining_ > 10) ? 10 : remaining_;
+                    approx_ = (scale_ < 0) ? (approx_ / c_pow10f_[step_]) : (approx_ * c_pow10f_[step_]);
+                    remaining_ -= step_;
+                }
+                return c_strtof_nearest_(approx_, first_digit_, digits_end_, point_);
+            }
+        }
+
+        // Parses [+-]digits[.digits][(e|E)[+-]digits], or inf, infinity, or nan (in any case),
+        // from the start of p_. There's no leading whitespace skipping. It stops at the first
+        // character that doesn't fit, or at end_ (if given), whichever is first. The result is
+        // correctly rounded (to nearest, ties to even), like strtof.
+        //
+        // Non-recursive, and the digits are gathered in a uint32_t -- four at a time when
+        // end_ says there's room to look ahead, one at a time otherwise (so never for c_atof).
+        // That's not what makes it fast or slow, though: for short command-line numbers the
+        // per-number checks cost more than the digits, and the old recursive c_atof (which had
+        // none of them, and got some numbers wrong) was about twice as fast on the host.
+        //
+        // Numbers of up to nine significant digits, with a small exponent, are exact float
+        // math. Otherwise, with a 64-bit double, the first eighteen digits go through a double,
+        // which is close enough to settle the rounding unless the number is within 2^-45
+        // (relative) of halfway between two floats. Only then are all of the digits compared
+        // with that halfway point exactly. Where double is only 32 bits, as on avr-gcc
+        // (wide_double is false), it's c_strtof_nearest_ from a float instead.
+        template <bool wide_double = (sizeof(double) >= 8)>
+        constexpr c_strtof_t c_strtof(const char * const start_, const char * const end_ = nullptr) {
+            const char *p_ = start_;
+
+            bool negative_ = false;
+            if (c_before_end_(p_, end_) && ((*p_ == '-') || (*p_ == '+'))) {
+                negative_ = (*p_ == '-');
+                p_++;
+            }
+
+            // inf, infinity, nan (numbers don't need to check)
+            if (c_before_end_(p_, end_) && !c_isdigit_(*p_) && (*p_ != '.')) {
+                if (int word_length_ = c_match_word_(p_, end_, "inf")) {
+                    p_ += word_length_;
+                    p_ += c_match_word_(p_, end_, "inity");
+                    return {negative_ ? -__builtin_huge_valf() : __builtin_huge_valf(), (int)(p_ - start_), NumberParseError::kNone};
+                }
+                if (int word_length_ = c_match_word_(p_, end_, "nan")) {
+                    p_ += word_length_;
+                    // nan(chars), like strtof
+                    if (c_before_end_(p_, end_) && (*p_ == '(')) {
+                        const char *q_ = p_ + 1;
+                        while (c_before_end_(q_, end_) && (c_isdigit_(*q_) || ((c_lower_(*q_) >= 'a') && (c_lower_(*q_) <= 'z')) || (*q_ == '_'))) {
+                            q_++;
+                        }
+                        if (c_before_end_(q_, end_) && (*q_ == ')')) {
+                            p_ = q_ + 1;
+                        }
+                    }
+                    return {__builtin_nanf(""), (int)(p_ - start_), NumberParseError::kNone};
+                }
+            }
+
+            // The number is 0.digits * 10^(significant_ + exponent_), where the digits start at
+            // first_digit_. high_ has the first nine of them, low_ the nine after. (These are
+            // int32_t since int may only be 16 bits, and there may be any number of digits.)
+            uint32_t high_ = 0;
+            uint32_t low_ = 0;
+            int32_t significant_ = 0;
+            int32_t exponent_ = 0;
+            const char * const digits_start_ = p_;
+            // Leading zeros aren't significant
+            while (c_before_end_(p_, end_) && (*p_ == '0')) {
+                p_++;
+            }
+            const char *first_digit_ = p_;
+            p_ = c_strtof_digits_(p_, end_, high_, low_, significant_);
+            bool any_digits_ = (p_ != digits_start_);
+            if (c_before_end_(p_, end_) && (*p_ == '.')) {
+                p_++;
+                const char * const fraction_start_ = p_;
+                // After the point leading zeros aren't significant either, but they move it
+                if (significant_ == 0) {
+                    while (c_before_end_(p_, end_) && (*p_ == '0')) {
+                        p_++;
+                    }
+                    first_digit_ = p_;
+                    exponent_ = -(int32_t)(p_ - fraction_start_);
+                }
+                const int32_t integer_digits_ = significant_;
+                p_ = c_strtof_digits_(p_, end_, high_, low_, significant_);
+                exponent_ -= significant_ - integer_digits_;
+                any_digits_ = any_digits_ || (p_ != fraction_start_);
+            }
+            const char *digits_end_ = p_;
+
+            if (!any_digits_) {
+                return {0.0f, 0, NumberParseError::kNoDigits};
+            }
+
+            // The exponent only counts if there's at least one digit in it
+            if (c_before_end_(p_, end_) && ((*p_ == 'e') || (*p_ == 'E'))) {
+                const char *e_ = p_ + 1;
+                bool negative_exponent_ = false;
+                if (c_before_end_(e_, end_) && ((*e_ == '-') || (*e_ == '+'))) {
+                    negative_exponent_ = (*e_ == '-');
+                    e_++;
+                }
+                if (c_before_end_(e_, end_) && c_isdigit_(*e_)) {
+                    int32_t explicit_exponent_ = 0;
+                    while (c_before_end_(e_, end_) && c_isdigit_(*e_)) {
+                        // Anything this big is already out of range, so don't overflow
+                        if (explicit_exponent_ < 10000) {
+                            explicit_exponent_ = (explicit_exponent_ * 10) + (*e_ - '0');
+                        }
+                        e_++;
+                    }
+                    exponent_ += negative_exponent_ ? -explicit_exponent_ : explicit_exponent_;
+                    p_ = e_;
+                }
+            }
+
+            const int length_ = p_ - start_;
+            const float zero_ = negative_ ? -0.0f : 0.0f;
+            const float inf_ = negative_ ? -__builtin_huge_valf() : __builtin_huge_valf();
+
+            // No significant digits means they were all zeros
+            if (significant_ == 0) {
+                return {zero_, length_, NumberParseError::kNone};
+            }
+
+            // The common case: the digits and 10^exponent are both exact floats, so one
+            // multiply or divide is correctly rounded.
+            if ((significant_ <= 9) && (high_ <= (1u << 24)) && (exponent_ >= -10) && (exponent_ <= 10)) {
+                const float value_ = (exponent_ < 0) ? ((float)high_ / c_pow10f_[-exponent_])
+                                                       : ((float)high_ * c_pow10f_[exponent_]);
+                return {negative_ ? -value_ : value_, length_, NumberParseError::kNone};
+            }
+
+            const float value_ = c_strtof_round_<wide_double>(high_, low_, significant_, exponent_,
+                                                               first_digit_, digits_end_);
+            if (value_ > 0x1.fffffep+127f) {
+                return {inf_, length_, NumberParseError::kOverflow};
+            }
+            if (!(value_ > 0.0f)) {
+                return {zero_, length_, NumberParseError::kUnderflow};
+            }
+            return {negative_ ? -value_ : value_, length_, NumberParseError::kNone};
         }
 
-        // Start portion
+        // Parse a float at p_, and move p_ past it.
         constexpr float c_atof(char *&p_) {
-            return (*p_ == '-')
-            ? (c_atof_int_(++p_, 0) * -1.0)
-            : (c_atof_int_(p_, 0));
+            const c_strtof_t parsed_ = c_strtof(p_);
+            p_ += parsed_.length;
+            return parsed_.value;
         }
 
 
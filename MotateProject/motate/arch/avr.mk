@@ -67,7 +67,7 @@ DEVICE_ASFLAGS  := $(LTO) -D__$(CHIP)__ -D__$(CHIP_SERIES)__ -mmcu=$(CPU_DEV)
 # ---------------------------------------------------------------------------------------
 # Linker Flags
 
-DEVICE_LDFLAGS := $(LTO) -mmcu=$(CPU_DEV) ${PRINTF_FLOAT_FLAGS} -mrelax
+DEVICE_LDFLAGS := $(LTO) -mmcu=$(CPU_DEV) ${PRINTF_FLOAT_FLAGS} -mrelax -Wl,--warn-section-align
 
 
 # ---------------------------------------------------------------------------------------
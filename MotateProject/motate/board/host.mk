@@ -0,0 +1,17 @@
+# ----------------------------------------------------------------------------
+# This file is part of the Motate project.
+
+ifeq ("$(BOARD)","host")
+    BASE_BOARD = host
+    DEVICE_DEFINES += MOTATE_BOARD="host"
+endif
+
+ifeq ("$(BASE_BOARD)","host")
+    _BOARD_FOUND = 1
+
+    BOARD_PATH = ${MOTATE_PATH}/board/host
+    DEVICE_INCLUDE_DIRS += ./board/host $(BOARD_PATH)
+
+    PLATFORM_BASE = ${MOTATE_PATH}/platform/host_sim
+    include $(PLATFORM_BASE).mk
+endif
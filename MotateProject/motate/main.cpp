@@ -74,6 +74,13 @@ extern "C"{
 
 #endif // __ARM__
 
+#ifdef __HOST_SIM__
+
+extern void loop();
+void setup() __attribute__ ((weak));
+
+#endif // __HOST_SIM__
+
 /*
  * _system_init()
  */
@@ -97,6 +104,13 @@ int main(void) {
     // main loop
     for (;;) {
         loop();
+#ifdef __HOST_SIM__
+        // Nothing runs "in the background" on the host, so let simulated time pass
+        Motate::HostSim::idle();
+        if (Motate::HostSim::loopHook) {
+            Motate::HostSim::loopHook();
+        }
+#endif
     }
     return 0;
 }
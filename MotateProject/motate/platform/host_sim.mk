@@ -0,0 +1,39 @@
+# ----------------------------------------------------------------------------
+# This file is part of the Motate project.
+#
+# The host simulation platform: builds Motate (and the project) with the
+# native compiler, against the simulated peripherals in Host_sim. The result
+# is a normal executable that can be run, debugged, and profiled (perf,
+# callgrind, etc.) on the development machine.
+
+# Use the native tools that are already installed, not the ones in Tools
+DEVICE_NATIVE_TOOLS = 1
+
+HOST_SOURCE_DIRS += $(MOTATE_PATH)/Host_sim
+
+DEVICE_RULES = $(call CREATE_DEVICE_LIBRARY,HOST,host_sim)
+
+DEVICE_INCLUDE_DIRS += $(MOTATE_PATH)/Host_sim
+
+DEVICE_DEFINES += __HOST_SIM__
+
+# ---------------------------------------------------------------------------------------
+# C Flags (NOT CPP flags)
+
+DEVICE_CFLAGS := -ffunction-sections -fdata-sections -std=c11
+
+# ---------------------------------------------------------------------------------------
+# CPP Flags
+
+# -pthread: host projects may use real threads (to drive the simulation, or to stress-test code)
+DEVICE_CPPFLAGS := -ffunction-sections -fdata-sections -std=gnu++17 -fno-rtti -fno-exceptions -fdiagnostics-show-option -pthread
+
+# ---------------------------------------------------------------------------------------
+# Assembly Flags
+
+DEVICE_ASFLAGS  :=
+
+# ---------------------------------------------------------------------------------------
+# Linker Flags
+
+DEVICE_LDFLAGS := -pthread